@@ -18,6 +18,9 @@ if [ "$TRAVIS_OS_NAME" = "linux" -o -z "$TRAVIS_OS_NAME" ]; then
     mkdir build && cd build
     cmake -DCITRA_FORCE_QT4=ON ..
     make -j4
+
+    # Report the kernel timings in the build log, so that changes to them can be tracked
+    ./src/citra_microbench/citra-microbench --min-time=0.05 --csv=microbench.csv
 elif [ "$TRAVIS_OS_NAME" = "osx" ]; then
     export Qt5_DIR=$(brew --prefix)/opt/qt5
     mkdir build && cd build
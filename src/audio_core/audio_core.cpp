@@ -0,0 +1,189 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "common/logging/log.h"
+#include "common/ring_buffer.h"
+#include "common/thread.h"
+
+#include "audio_core/audio_core.h"
+#include "audio_core/null_sink.h"
+#include "audio_core/sink.h"
+
+namespace AudioCore {
+
+using Frame = std::array<s16, 2>;
+
+/// Number of frames the mixer hands to the sink at once, about 5 ms
+static const size_t PERIOD_FRAMES = 160;
+/// Number of frames the mixer keeps queued in the sink, about 20 ms
+static const size_t TARGET_QUEUED_FRAMES = 4 * PERIOD_FRAMES;
+/// Below this many frames in the sink, an incomplete period is stretched rather than waited for
+static const size_t LOW_QUEUED_FRAMES = PERIOD_FRAMES;
+
+/// Samples queued by the emulation thread, about 250 ms
+static Common::RingBuffer<Frame, 8192> ring;
+
+static std::unique_ptr<Sink> sink;
+static std::thread mixer_thread;
+static std::atomic<bool> mixer_running(false);
+
+/// Set by the mixer before it waits for samples, so that the producer knows to wake it up
+static std::atomic<bool> mixer_idle(false);
+static Common::Event samples_available;
+
+/// Number of frames queued in the sink as of the last mixer iteration
+static std::atomic<size_t> sink_queued_frames(0);
+static std::atomic<u64> underruns(0);
+static std::atomic<u64> stretched_periods(0);
+static std::atomic<u64> dropped_frames(0);
+
+/// Only touched by the emulation thread, see SetMuted()
+static bool muted = false;
+
+/**
+ * Stretches the given frames over a longer span by linear interpolation. The pitch rises for the
+ * length of the output, which is much less noticeable than the gap it fills.
+ */
+static void StretchFrames(const Frame* in, size_t in_frames, Frame* out, size_t out_frames) {
+    for (size_t i = 0; i < out_frames; ++i) {
+        // Position in the input, in 16.16 fixed point
+        u64 position = (u64)i * ((in_frames - 1) << 16) / std::max<size_t>(out_frames - 1, 1);
+        size_t index = static_cast<size_t>(position >> 16);
+        s32 fraction = static_cast<s32>(position & 0xFFFF);
+        size_t next = std::min(index + 1, in_frames - 1);
+
+        for (size_t channel = 0; channel < 2; ++channel) {
+            s32 a = in[index][channel];
+            s32 b = in[next][channel];
+            out[i][channel] = static_cast<s16>(a + (((b - a) * fraction) >> 16));
+        }
+    }
+}
+
+/// Sleeps until the emulation thread queues samples, or the mixer is stopped
+static void WaitForSamples() {
+    mixer_idle = true;
+
+    // Samples may have been queued before the flag was set
+    if (ring.Size() == 0 && mixer_running)
+        samples_available.Wait();
+
+    mixer_idle = false;
+}
+
+static void MixerLoop() {
+    Common::SetCurrentThreadName("AudioMixer");
+
+    const auto period_duration = std::chrono::microseconds(PERIOD_FRAMES * 1000000 / NATIVE_SAMPLE_RATE);
+
+    std::array<Frame, PERIOD_FRAMES> period;
+    std::array<Frame, PERIOD_FRAMES> stretched;
+    bool playing = false;
+
+    while (mixer_running) {
+        const size_t queued = sink->FramesInQueue();
+        sink_queued_frames = queued;
+
+        // Keep the sink filled up to the target, but not any further to keep the latency low
+        if (queued >= TARGET_QUEUED_FRAMES) {
+            std::this_thread::sleep_for(period_duration / 2);
+            continue;
+        }
+
+        // With enough frames left in the sink, the rest of the period will likely arrive in time
+        const size_t buffered = ring.Size();
+        if (buffered < PERIOD_FRAMES && queued > LOW_QUEUED_FRAMES) {
+            std::this_thread::sleep_for(period_duration / 4);
+            continue;
+        }
+
+        if (buffered == 0) {
+            if (queued == 0) {
+                if (playing)
+                    ++underruns;
+                playing = false;
+                WaitForSamples();
+            } else {
+                std::this_thread::sleep_for(period_duration / 4);
+            }
+            continue;
+        }
+
+        const size_t count = ring.Pop(period.data(), period.size());
+        if (count < PERIOD_FRAMES) {
+            StretchFrames(period.data(), count, stretched.data(), stretched.size());
+            sink->EnqueueSamples(stretched[0].data(), stretched.size());
+            ++stretched_periods;
+        } else {
+            sink->EnqueueSamples(period[0].data(), period.size());
+        }
+        playing = true;
+    }
+}
+
+void Init() {
+    underruns = 0;
+    stretched_periods = 0;
+    dropped_frames = 0;
+    sink_queued_frames = 0;
+
+    // TODO: Add sinks for host audio APIs, and a setting to pick one
+    sink.reset(new NullSink);
+
+    mixer_running = true;
+    mixer_thread = std::thread(MixerLoop);
+
+    LOG_DEBUG(Audio, "Audio mixer started");
+}
+
+void Shutdown() {
+    if (!mixer_thread.joinable())
+        return;
+
+    mixer_running = false;
+    samples_available.Set();
+    mixer_thread.join();
+
+    // Drop the samples which weren't mixed, from the consumer side now that the mixer is gone
+    std::array<Frame, PERIOD_FRAMES> discard;
+    while (ring.Pop(discard.data(), discard.size()) != 0) {}
+
+    sink.reset();
+
+    LOG_DEBUG(Audio, "Audio mixer stopped");
+}
+
+void QueueSamples(const s16* samples, size_t num_frames) {
+    if (muted)
+        return;
+
+    const Frame* frames = reinterpret_cast<const Frame*>(samples);
+    size_t pushed = ring.Push(frames, num_frames);
+    if (pushed < num_frames)
+        dropped_frames += num_frames - pushed;
+
+    if (pushed != 0 && mixer_idle.exchange(false))
+        samples_available.Set();
+}
+
+void SetMuted(bool muted_) {
+    muted = muted_;
+}
+
+Stats GetStats() {
+    Stats stats;
+    stats.latency_ms = (ring.Size() + sink_queued_frames) * 1000.0 / NATIVE_SAMPLE_RATE;
+    stats.underruns = underruns;
+    stats.stretched_periods = stretched_periods;
+    stats.dropped_frames = dropped_frames;
+    return stats;
+}
+
+} // namespace
@@ -0,0 +1,57 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+/**
+ * Audio output pipeline. The emulated DSP queues its output into a lock-free ring, from which a
+ * host mixer thread feeds the audio device. The emulation thread never waits for audio: when the
+ * ring is full, new samples are dropped, and when the device is about to run dry, whatever the
+ * ring holds is stretched to cover the gap instead of waiting for the emulation to catch up.
+ */
+namespace AudioCore {
+
+/// Sample rate of the DSP output, in frames per second
+static const unsigned NATIVE_SAMPLE_RATE = 32728;
+
+struct Stats {
+    /// Time until a frame queued now is played, in milliseconds
+    double latency_ms;
+    /// Number of times the device ran dry while playing
+    u64 underruns;
+    /// Number of periods which were stretched to hide the lack of samples
+    u64 stretched_periods;
+    /// Number of frames dropped because the ring was full
+    u64 dropped_frames;
+};
+
+/// Starts the mixer thread
+void Init();
+
+/// Stops the mixer thread and drops the samples which weren't played yet
+void Shutdown();
+
+/**
+ * Queues interleaved stereo frames for playback. Never blocks.
+ * @note Must only be called from the emulation thread
+ * @param samples Interleaved left and right samples
+ * @param num_frames Number of frames, i.e. half the number of samples
+ */
+void QueueSamples(const s16* samples, size_t num_frames);
+
+/**
+ * Drops the samples queued from now on instead of playing them, for frames which are emulated but
+ * never shown (see RunAhead). They aren't counted as dropped frames.
+ * @note Must only be called from the emulation thread
+ */
+void SetMuted(bool muted);
+
+/// Returns the current latency and glitch counters. May be called from any thread.
+Stats GetStats();
+
+} // namespace
@@ -0,0 +1,52 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+#include "audio_core/audio_core.h"
+#include "audio_core/sink.h"
+
+namespace AudioCore {
+
+/**
+ * Sink which discards the samples, but consumes them at the native sample rate so that the mixer
+ * is paced and the latency reported the same as with a real device.
+ */
+class NullSink final : public Sink {
+public:
+    NullSink() : queued_frames(0), last_update(std::chrono::steady_clock::now()) {}
+
+    void EnqueueSamples(const s16* samples, size_t num_frames) override {
+        Update();
+        queued_frames += num_frames;
+    }
+
+    size_t FramesInQueue() override {
+        Update();
+        return queued_frames;
+    }
+
+private:
+    /// Removes the frames which would have been played since the last update
+    void Update() {
+        auto now = std::chrono::steady_clock::now();
+        auto played = std::chrono::duration_cast<std::chrono::microseconds>(now - last_update).count()
+                      * NATIVE_SAMPLE_RATE / 1000000;
+        if (played == 0)
+            return;
+
+        // Only advance by the time of the frames played, so the remainder isn't lost
+        last_update += std::chrono::microseconds(played * 1000000 / NATIVE_SAMPLE_RATE);
+        queued_frames -= std::min<size_t>(queued_frames, static_cast<size_t>(played));
+    }
+
+    size_t queued_frames;
+    std::chrono::steady_clock::time_point last_update;
+};
+
+} // namespace
@@ -0,0 +1,28 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace AudioCore {
+
+/**
+ * Host audio output. Plays interleaved stereo 16-bit frames at the native sample rate, and is only
+ * ever used from the mixer thread.
+ */
+class Sink {
+public:
+    virtual ~Sink() {}
+
+    /// Queues frames for playback, without waiting for the device to play earlier ones
+    virtual void EnqueueSamples(const s16* samples, size_t num_frames) = 0;
+
+    /// Returns the number of queued frames which haven't been played yet
+    virtual size_t FramesInQueue() = 0;
+};
+
+} // namespace
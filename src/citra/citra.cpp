@@ -20,6 +20,8 @@
 #include "core/settings.h"
 #include "core/system.h"
 #include "core/core.h"
+#include "core/host_threads.h"
+#include "core/title_profile.h"
 #include "core/loader/loader.h"
 
 #include "citra/config.h"
@@ -71,6 +73,7 @@ int main(int argc, char **argv) {
     EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
 
     VideoCore::g_hw_renderer_enabled = Settings::values.use_hw_renderer;
+    TitleProfile::ApplyForFile(boot_filename);
 
     System::Init(emu_window);
 
@@ -80,8 +83,13 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    // The main thread runs the emulation itself
+    HostThreads::ApplyToCurrentThread(HostThreads::Role::Emulation);
+
+    // Nothing stops the core from another thread, the window is checked after each frame
+    const std::atomic<bool> running(true);
     while (emu_window->IsOpen()) {
-        Core::RunLoop();
+        Core::RunFrames(1, running);
     }
 
     System::Shutdown();
@@ -55,12 +55,50 @@ void Config::ReadValues() {
         Settings::values.input_mappings[Settings::NativeInput::All[i]] =
             glfw_config->GetInteger("Controls", Settings::NativeInput::Mapping[i], defaults[i]);
     }
+    Settings::values.input_polling_rate = glfw_config->GetInteger("Controls", "input_polling_rate", 250);
 
     // Core
     Settings::values.frame_skip = glfw_config->GetInteger("Core", "frame_skip", 0);
+    Settings::values.use_frame_limit = glfw_config->GetBoolean("Core", "use_frame_limit", true);
+    Settings::values.use_idle_sleep = glfw_config->GetBoolean("Core", "use_idle_sleep", true);
+    Settings::values.use_dynamic_frame_skip = glfw_config->GetBoolean("Core", "use_dynamic_frame_skip", false);
+    Settings::values.run_ahead_frames = glfw_config->GetInteger("Core", "run_ahead_frames", 0);
+    Settings::values.use_async_y2r = glfw_config->GetBoolean("Core", "use_async_y2r", false);
+    Settings::values.use_async_fs = glfw_config->GetBoolean("Core", "use_async_fs", false);
+    Settings::values.use_deterministic_timeslices = glfw_config->GetBoolean("Core", "use_deterministic_timeslices", false);
+    Settings::values.max_slice_length = glfw_config->GetInteger("Core", "max_slice_length", 20000);
+    Settings::values.memory_access_cost = glfw_config->GetInteger("Core", "memory_access_cost", 2);
+    Settings::values.multiply_cost = glfw_config->GetInteger("Core", "multiply_cost", 2);
+    Settings::values.vfp_cost = glfw_config->GetInteger("Core", "vfp_cost", 2);
+    Settings::values.branch_cost = glfw_config->GetInteger("Core", "branch_cost", 2);
+    Settings::values.use_speculative_translation = glfw_config->GetBoolean("Core", "use_speculative_translation", false);
+    Settings::values.use_disk_translation_cache = glfw_config->GetBoolean("Core", "use_disk_translation_cache", false);
+    Settings::values.worker_threads = glfw_config->GetInteger("Core", "worker_threads", -1);
+    Settings::values.worker_affinity_mask = glfw_config->GetInteger("Core", "worker_affinity_mask", 0);
+    Settings::values.use_auto_thread_affinity = glfw_config->GetBoolean("Core", "use_auto_thread_affinity", false);
+    Settings::values.emu_thread_affinity_mask = glfw_config->GetInteger("Core", "emu_thread_affinity_mask", 0);
+    Settings::values.gpu_thread_affinity_mask = glfw_config->GetInteger("Core", "gpu_thread_affinity_mask", 0);
+    Settings::values.present_thread_affinity_mask = glfw_config->GetInteger("Core", "present_thread_affinity_mask", 0);
+    Settings::values.emu_thread_priority = glfw_config->GetInteger("Core", "emu_thread_priority", 1);
+    Settings::values.gpu_thread_priority = glfw_config->GetInteger("Core", "gpu_thread_priority", 1);
+    Settings::values.present_thread_priority = glfw_config->GetInteger("Core", "present_thread_priority", 1);
+    Settings::values.worker_thread_priority = glfw_config->GetInteger("Core", "worker_thread_priority", 1);
 
     // Renderer
     Settings::values.use_hw_renderer = glfw_config->GetBoolean("Renderer", "use_hw_renderer", false);
+    Settings::values.use_hw_vertex_shader = glfw_config->GetBoolean("Renderer", "use_hw_vertex_shader", false);
+    Settings::values.use_gpu_thread = glfw_config->GetBoolean("Renderer", "use_gpu_thread", false);
+    Settings::values.use_present_thread = glfw_config->GetBoolean("Renderer", "use_present_thread", false);
+    Settings::values.use_command_list_cache = glfw_config->GetBoolean("Renderer", "use_command_list_cache", false);
+    Settings::values.resolution_factor = glfw_config->GetInteger("Renderer", "resolution_factor", 1);
+    Settings::values.rasterizer_threads = glfw_config->GetInteger("Renderer", "rasterizer_threads", 0);
+    Settings::values.texture_cache_size = glfw_config->GetInteger("Renderer", "texture_cache_size", 256);
+    Settings::values.use_compressed_textures = glfw_config->GetBoolean("Renderer", "use_compressed_textures", true);
+    Settings::values.texture_pack_path = glfw_config->Get("Renderer", "texture_pack_path", "");
+    Settings::values.profile_gpu = glfw_config->GetBoolean("Renderer", "profile_gpu", false);
+    Settings::values.show_perf_overlay = glfw_config->GetBoolean("Renderer", "show_perf_overlay", false);
+    Settings::values.frame_capture_path = glfw_config->Get("Renderer", "frame_capture_path", "");
+    Settings::values.frame_capture_format = glfw_config->GetInteger("Renderer", "frame_capture_format", 0);
 
     Settings::values.bg_red   = (float)glfw_config->GetReal("Renderer", "bg_red",   1.0);
     Settings::values.bg_green = (float)glfw_config->GetReal("Renderer", "bg_green", 1.0);
@@ -68,6 +106,8 @@ void Config::ReadValues() {
 
     // Data Storage
     Settings::values.use_virtual_sd = glfw_config->GetBoolean("Data Storage", "use_virtual_sd", true);
+    Settings::values.romfs_cache_size = glfw_config->GetInteger("Data Storage", "romfs_cache_size", 16);
+    Settings::values.buffer_file_writes = glfw_config->GetBoolean("Data Storage", "buffer_file_writes", false);
 
     // System Region
     Settings::values.region_value = glfw_config->GetInteger("System Region", "region_value", 1);
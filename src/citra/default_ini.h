@@ -32,16 +32,156 @@ pad_cdown =
 pad_cleft =
 pad_cright =
 
+# Rate at which the input is sampled into the emulated HID, in Hz. Independent of the frame rate.
+# Default: 250
+input_polling_rate =
+
 [Core]
 # The applied frameskip amount. Must be a power of two.
 # 0 (default): No frameskip, 1: x2 frameskip, 2: x4 frameskip, 3: x8 frameskip, etc.
 frame_skip =
 
+# Whether to limit emulation speed to that of the 3DS.
+# 0: No, 1 (default): Yes
+use_frame_limit =
+
+# Whether to sleep while all emulated threads are waiting, until the next event is due, instead of
+# running ahead to it and spinning at the end of the frame. Only used if use_frame_limit is enabled.
+# 0: No, 1 (default): Yes
+use_idle_sleep =
+
+# Whether to skip rendering frames while emulation is slower than the 3DS. Only used if frame_skip is 0.
+# 0 (default): No, 1: Yes
+use_dynamic_frame_skip =
+
+# Number of frames to emulate ahead of the shown one with the current input, which hides that much of
+# the games' own input latency at the cost of emulating each frame that many more times. Replaces frame_skip.
+# 0 (default): Off, 1-4: Number of frames
+run_ahead_frames =
+
+# Whether to perform Y2R (video) conversions on a separate thread while the emulated CPU keeps running.
+# 0 (default): No, 1: Yes
+use_async_y2r =
+
+# Whether to perform large file reads on separate threads while the emulated system keeps running.
+# 0 (default): No, 1: Yes
+use_async_fs =
+
+# Whether to end every CPU timeslice exactly at the next scheduled event, instead of adapting its length heuristically.
+# 0 (default): No, 1: Yes
+use_deterministic_timeslices =
+
+# Maximum length of a CPU timeslice in cycles, when deterministic timeslices are enabled. Shorter slices
+# reduce the latency of events posted by other threads, at the cost of more scheduling overhead.
+# Default: 20000
+max_slice_length =
+
+# Number of CPU cycles charged for each class of instructions, other instructions take one cycle.
+# Loads and stores are charged per transferred register. Default: 2
+memory_access_cost =
+multiply_cost =
+vfp_cost =
+branch_cost =
+
+# Whether to translate the code reachable through static branches from new code on a separate thread,
+# ahead of its execution. Reduces stutter when a game runs code for the first time.
+# 0 (default): No, 1: Yes
+use_speculative_translation =
+
+# Whether to save the translated code of a game when it exits, and reuse it the next time the game boots.
+# Only works with the same build of citra, the cache files are ignored by any other build.
+# 0 (default): No, 1: Yes
+use_disk_translation_cache =
+
+# Number of threads in the pool shared by the parallel parts of the emulator, like tiled rasterization
+# and texture decoding. -1 (default): One less than the number of host cores
+worker_threads =
+
+# Host CPUs the pool's threads may run on, as a bit mask. 0 (default): Any, or automatic
+worker_affinity_mask =
+
+# Whether to pin the emulator's threads to the cores of one host CPU package, giving the emulation, GPU
+# and present threads a physical core each, as far as possible, and the pool's threads the remaining ones.
+# Explicit affinity masks take precedence. 0 (default): No, 1: Yes
+use_auto_thread_affinity =
+
+# Host CPUs the emulation, GPU and present threads may run on, as bit masks. 0 (default): Any, or automatic
+emu_thread_affinity_mask =
+gpu_thread_affinity_mask =
+present_thread_affinity_mask =
+
+# Scheduling priorities of the emulator's threads. Raising a priority may need extra privileges.
+# 0: Low, 1 (default): Normal, 2: High
+emu_thread_priority =
+gpu_thread_priority =
+present_thread_priority =
+worker_thread_priority =
+
 [Renderer]
 # Whether to use software or hardware rendering.
 # 0 (default): Software, 1: Hardware
 use_hw_renderer =
 
+# Whether the hardware renderer runs vertex shaders on the host GPU. Shaders which can't be
+# translated to GLSL are still run on the CPU.
+# 0 (default): No, 1: Yes
+use_hw_vertex_shader =
+
+# Whether to process GPU command lists on a separate thread. Only used by the software renderer.
+# 0 (default): No, 1: Yes
+use_gpu_thread =
+
+# Whether to present frames to the window from a separate thread, so that emulation doesn't wait for vsync.
+# 0 (default): No, 1: Yes
+use_present_thread =
+
+# Whether to keep the decoded commands of GPU command lists, so that lists which are submitted again
+# unchanged are replayed without decoding them. The hit rate is logged when emulation stops.
+# 0 (default): No, 1: Yes
+use_command_list_cache =
+
+# Multiplier of the 3DS's native resolution at which the hardware renderer draws. Framebuffers are
+# only scaled back down when the emulated system reads them.
+# 1 (default): Native resolution, 2: Twice the native resolution, etc. (up to 10)
+resolution_factor =
+
+# Number of threads which rasterize screen tiles in parallel, taken from the worker_threads pool.
+# Only used by the software renderer. 0 (default): Rasterize triangles one by one on the GPU thread
+rasterizer_threads =
+
+# Estimated host GPU memory in MB which the hardware renderer's texture cache may use, after which the
+# least recently used textures are evicted.
+# 0: Unlimited, Default: 256
+texture_cache_size =
+
+# Whether to keep ETC1 textures compressed on the host GPU, which takes an eighth of the memory and upload
+# bandwidth. Uses ETC2 if supported, or transcodes to S3TC otherwise, which loses some color precision.
+# 0: No, 1 (default): Yes
+use_compressed_textures =
+
+# Directory of a texture pack, whose PNG images replace the emulated textures of the same hash.
+# Images are named tex_<width>x<height>_<hash>_<format>.png, and are loaded in the background.
+# Empty (default): Don't replace textures
+texture_pack_path =
+
+# Whether to measure the time the host GPU spends drawing, uploading and reading back, and show it in the profiler.
+# Requires OpenGL 3.3 or GL_ARB_timer_query.
+# 0 (default): No, 1: Yes
+profile_gpu =
+
+# Whether to draw the emulation speed, frame rate, a graph of the frame times and the most expensive
+# profiler categories over the screens.
+# 0 (default): No, 1: Yes
+show_perf_overlay =
+
+# Directory to capture every frame's screens into, for visual regression testing. Frames are read
+# back and written out asynchronously. Empty (default): Don't capture
+frame_capture_path =
+
+# Format of the captured frames.
+# 0 (default): Numbered PNG images, 1: One raw RGB24 video stream per screen
+frame_capture_format =
+
 # The clear color for the renderer. What shows up on the sides of the bottom screen.
 # Must be in range of 0.0-1.0. Defaults to 1.0 for all.
 bg_red =
@@ -53,6 +193,15 @@ bg_green =
 # 1 (default): Yes, 0: No
 use_virtual_sd =
 
+# Size of the cache for RomFS blocks in MB, used when the game file can't be mapped into memory.
+# 0: Disabled, Default: 16
+romfs_cache_size =
+
+# Whether to keep files written by the application in memory, and only write them to disk when they're
+# closed or flushed, once per second and on shutdown. Files are replaced on disk as a whole.
+# 0 (default): No, 1: Yes
+buffer_file_writes =
+
 [System Region]
 # The system region that Citra will use during emulation
 # 0: Japan, 1: USA (default), 2: Europe, 3: Australia, 4: China, 5: Korea, 6: Taiwan
@@ -14,6 +14,7 @@
 #include "common/assert.h"
 #include "common/key_map.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 #include "common/scm_rev.h"
 #include "common/string_util.h"
 
@@ -139,6 +140,41 @@ void EmuWindow_GLFW::PollEvents() {
     glfwPollEvents();
 }
 
+/// GLFW contexts belong to windows, so shared contexts use an invisible one
+class SharedContext_GLFW : public EmuWindow::SharedContext {
+public:
+    explicit SharedContext_GLFW(GLFWwindow* window) : window(window) {}
+
+    ~SharedContext_GLFW() override {
+        glfwDestroyWindow(window);
+    }
+
+    void MakeCurrent() override {
+        glfwMakeContextCurrent(window);
+    }
+
+    void DoneCurrent() override {
+        glfwMakeContextCurrent(nullptr);
+    }
+
+private:
+    GLFWwindow* window;
+};
+
+std::unique_ptr<EmuWindow::SharedContext> EmuWindow_GLFW::CreateSharedContext() {
+    // The context hints given in the constructor still apply
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, m_render_window);
+    glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+
+    if (window == nullptr) {
+        LOG_ERROR(Frontend, "Failed to create shared GLFW context");
+        return nullptr;
+    }
+
+    return Common::make_unique<SharedContext_GLFW>(window);
+}
+
 /// Makes the GLFW OpenGL context current for the caller thread
 void EmuWindow_GLFW::MakeCurrent() {
     glfwMakeContextCurrent(m_render_window);
@@ -27,6 +27,9 @@ public:
     /// Releases (dunno if this is the "right" word) the GLFW context from the caller thread
     void DoneCurrent() override;
 
+    /// Creates a context sharing objects with the window's, backed by a hidden window
+    std::unique_ptr<SharedContext> CreateSharedContext() override;
+
     static void OnKeyEvent(GLFWwindow* win, int key, int scancode, int action, int mods);
 
     static void OnMouseButtonEvent(GLFWwindow* window, int button, int action, int mods);
@@ -0,0 +1,565 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <getopt.h>
+#else
+#include <unistd.h>
+#include <getopt.h>
+#endif
+
+#include "common/logging/log.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+#include "common/profiler_reporting.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/settings.h"
+#include "core/system.h"
+#include "core/loader/loader.h"
+#include "core/tracer/player.h"
+
+#include "citra_bench/perf_gate.h"
+#include "citra_bench/emu_window/emu_window_null.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/renderer_base.h"
+#include "video_core/video_core.h"
+
+using namespace Common::Profiling;
+
+static void PrintHelp()
+{
+    std::cout << "Usage: citra-bench [options] <filename>\n"
+                 "       citra-bench [options] --citrace=FILE\n"
+                 "       citra-bench [options] --manifest=FILE [--json=FILE] [--baseline=FILE]\n"
+                 "  -c, --citrace=FILE          Replay the GPU commands of a CiTrace instead of running a ROM\n"
+                 "  -f, --frames=N              Number of emulated frames to measure (default 600)\n"
+                 "  -w, --warmup=N              Number of frames to run before measuring (default 60)\n"
+                 "  -g, --gpu-thread            Process command lists on a separate thread\n"
+                 "  -r, --rasterizer-threads=N  Number of software rasterizer threads (default 0)\n"
+                 "  -m, --command-list-cache    Replay command lists which were submitted before from a cache\n"
+                 "  -x, --translation-cache     Load and save the translated CPU code of the title across runs\n"
+                 "  -t, --trace=FILE            Write a Chrome trace of the measured frames to FILE\n"
+                 "  -s, --pc-samples=FILE       Sample the emulated PC during the measured frames and write\n"
+                 "                              the collapsed stacks to FILE, for flamegraph tools\n"
+                 "  -p, --frame-pointers        Follow the frame pointer chain when sampling the PC\n"
+                 "  -l, --log-filter=FILTER     Log filter, see citra's configuration (default *:Error)\n"
+                 "  -M, --manifest=FILE         Run all the ROMs and CiTraces listed in FILE, see perf_gate.h\n"
+                 "  -j, --json=FILE             Write the results of the runs to FILE as JSON\n"
+                 "  -b, --baseline=FILE         Compare the results against the ones written to FILE by --json,\n"
+                 "                              exits with 1 if any of them regressed\n"
+                 "  -T, --tolerance=PERCENT     How much worse than the baseline results may be (default 10)\n"
+                 "  -h, --help                  Display this help\n";
+}
+
+/// Configures the emulator the same way for every run, so that results can be compared.
+static void SetBenchmarkSettings() {
+    Settings::values.input_polling_rate = 250;
+
+    Settings::values.frame_skip = 0;
+    Settings::values.use_frame_limit = false;
+    Settings::values.use_idle_sleep = false;
+    Settings::values.use_dynamic_frame_skip = false;
+    Settings::values.run_ahead_frames = 0;
+    Settings::values.use_async_y2r = false;
+    Settings::values.use_async_fs = false;
+    Settings::values.use_deterministic_timeslices = true;
+    Settings::values.max_slice_length = 20000;
+    Settings::values.memory_access_cost = 2;
+    Settings::values.multiply_cost = 2;
+    Settings::values.vfp_cost = 2;
+    Settings::values.branch_cost = 2;
+    Settings::values.use_speculative_translation = false;
+    Settings::values.use_disk_translation_cache = false;
+    Settings::values.worker_threads = -1;
+    Settings::values.worker_affinity_mask = 0;
+    Settings::values.use_auto_thread_affinity = false;
+    Settings::values.emu_thread_affinity_mask = 0;
+    Settings::values.gpu_thread_affinity_mask = 0;
+    Settings::values.present_thread_affinity_mask = 0;
+    Settings::values.emu_thread_priority = 1;
+    Settings::values.gpu_thread_priority = 1;
+    Settings::values.present_thread_priority = 1;
+    Settings::values.worker_thread_priority = 1;
+
+    Settings::values.use_virtual_sd = true;
+    Settings::values.romfs_cache_size = 16;
+    Settings::values.buffer_file_writes = false;
+    Settings::values.region_value = 1;
+
+    // The null renderer can't rasterize in hardware
+    Settings::values.use_hw_renderer = false;
+    Settings::values.use_hw_vertex_shader = false;
+    Settings::values.use_gpu_thread = false;
+    Settings::values.use_present_thread = false;
+    Settings::values.use_command_list_cache = false;
+    Settings::values.resolution_factor = 1;
+    Settings::values.rasterizer_threads = 0;
+    Settings::values.texture_cache_size = 256;
+    // Transcoding is lossy on drivers without ETC2, which would make captures differ between hosts
+    Settings::values.use_compressed_textures = false;
+    Settings::values.texture_pack_path = "";
+    Settings::values.profile_gpu = false;
+    Settings::values.show_perf_overlay = false;
+    Settings::values.frame_capture_path = "";
+
+    Settings::values.bg_red = Settings::values.bg_green = Settings::values.bg_blue = 1.0f;
+}
+
+static void RunUntilFrame(int frame) {
+    while (VideoCore::g_renderer->current_frame() < frame) {
+        Core::RunLoop();
+    }
+}
+
+static double ToMilliseconds(Duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// Prints the mean, median, 99th percentile and maximum of a set of durations
+static void PrintDistribution(const char* name, std::vector<Duration> durations) {
+    if (durations.empty()) {
+        std::printf("%-12s %10s %10s %10s %10s\n", name, "-", "-", "-", "-");
+        return;
+    }
+
+    std::sort(durations.begin(), durations.end());
+    Duration total = Duration::zero();
+    for (Duration duration : durations)
+        total += duration;
+
+    std::printf("%-12s %10.4f %10.4f %10.4f %10.4f\n", name,
+                ToMilliseconds(total) / durations.size(),
+                ToMilliseconds(durations[durations.size() / 2]),
+                ToMilliseconds(durations[(durations.size() - 1) * 99 / 100]),
+                ToMilliseconds(durations.back()));
+}
+
+/// Returns the name of a profiler category or counter, prefixed with the names of its parents
+template <typename Info>
+static std::string GetPathName(const std::vector<Info>& infos, size_t index) {
+    std::string name = infos[index].name;
+    for (unsigned int parent = infos[index].parent; parent < infos.size(); parent = infos[parent].parent)
+        name = std::string(infos[parent].name) + "/" + name;
+    return name;
+}
+
+/// Sums up the per-frame profiler results of the measured frames, and the peaks of the memory counters
+struct MeasuredFrames {
+    /// Called after each measured frame
+    void AddFrame() {
+        ProfilingManager& profiler = GetProfilingManager();
+        const ProfilingFrameResult& results = profiler.GetPreviousFrameResults();
+        frame_time += results.frame_time;
+        time_per_category.resize(results.time_per_category.size(), Duration::zero());
+        for (size_t i = 0; i < results.time_per_category.size(); ++i)
+            time_per_category[i] += results.time_per_category[i];
+
+        const auto& counters = profiler.GetMemoryCountersInfo();
+        memory_peaks.resize(counters.size(), 0);
+        for (size_t i = 0; i < counters.size(); ++i)
+            memory_peaks[i] = std::max(memory_peaks[i], counters[i].counter->Get());
+    }
+
+    /// Fills in the measurements of a run, which took the given host time
+    void GetResult(int num_frames, double elapsed, PerfGate::BenchResult& result) const {
+        const ProfilingManager& profiler = GetProfilingManager();
+        result.num_frames = num_frames;
+        result.frames_per_second = num_frames / elapsed;
+        result.frame_ms = ToMilliseconds(frame_time) / num_frames;
+
+        const auto& categories = profiler.GetTimingCategoriesInfo();
+        for (size_t i = 0; i < time_per_category.size() && i < categories.size(); ++i)
+            result.category_ms.emplace_back(GetPathName(categories, i), ToMilliseconds(time_per_category[i]) / num_frames);
+
+        const auto& counters = profiler.GetMemoryCountersInfo();
+        for (size_t i = 0; i < memory_peaks.size() && i < counters.size(); ++i)
+            result.memory_peaks.emplace_back(GetPathName(counters, i), (double)memory_peaks[i]);
+    }
+
+    Duration frame_time = Duration::zero();
+    std::vector<Duration> time_per_category;
+    std::vector<u64> memory_peaks;
+};
+
+/// Prints the mean time per frame spent in each profiler category
+static void PrintCategories(const MeasuredFrames& measured, int num_frames) {
+    std::printf("\n%-36s %12s %8s\n", "Category", "ms/frame", "Share");
+    std::printf("%-36s %12.3f %7.1f%%\n", "Frame", ToMilliseconds(measured.frame_time) / num_frames, 100.0);
+
+    const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
+    for (size_t i = 0; i < measured.time_per_category.size() && i < categories.size(); ++i) {
+        // Indent child categories below their parents
+        std::string name = categories[i].name;
+        for (unsigned int parent = categories[i].parent; parent < categories.size(); parent = categories[parent].parent)
+            name = "  " + name;
+
+        const double share = measured.frame_time == Duration::zero() ? 0.0 :
+                100.0 * measured.time_per_category[i].count() / measured.frame_time.count();
+        std::printf("%-36s %12.3f %7.1f%%\n", name.c_str(),
+                    ToMilliseconds(measured.time_per_category[i]) / num_frames, share);
+    }
+}
+
+/// Prints the current and peak values of the memory counters, with byte sizes in KiB
+static void PrintMemoryCounters(const MeasuredFrames& measured) {
+    const auto& counters = GetProfilingManager().GetMemoryCountersInfo();
+
+    std::printf("\n%-36s %12s %12s\n", "Memory", "Current", "Peak");
+    for (size_t i = 0; i < counters.size(); ++i) {
+        const MemoryCounterInfo& info = counters[i];
+
+        // Indent child counters below their parents
+        std::string name = info.name;
+        for (unsigned int parent = info.parent; parent < counters.size(); parent = counters[parent].parent)
+            name = "  " + name;
+
+        const u64 value = info.counter->Get();
+        const u64 peak = std::max(value, i < measured.memory_peaks.size() ? measured.memory_peaks[i] : 0);
+        if (info.unit == MemoryCounter::Unit::Bytes) {
+            std::printf("%-36s %8.1f KiB %8.1f KiB\n", name.c_str(), value / 1024.0, peak / 1024.0);
+        } else {
+            std::printf("%-36s %12llu %12llu\n", name.c_str(), (unsigned long long)value,
+                        (unsigned long long)peak);
+        }
+    }
+}
+
+/// Prints the hit rate of the command list cache, if it is enabled
+static void PrintCommandListCacheStats() {
+    if (!Settings::values.use_command_list_cache)
+        return;
+
+    const auto stats = Pica::CommandProcessor::GetCommandListCacheStats();
+    const u64 lookups = stats.hits + stats.misses;
+    std::printf("\nCommand lists: %llu, %.1f%% replayed from the cache\n", (unsigned long long)lookups,
+                lookups == 0 ? 0.0 : 100.0 * stats.hits / lookups);
+}
+
+/// Options of the runs which only apply to single runs, since their output files would be overwritten
+struct ProfilingOptions {
+    std::string trace_filename;
+    std::string samples_filename;
+    bool walk_frame_pointers = false;
+};
+
+/**
+ * Replays the frames of a CiTrace, starting over once the end of the recording is reached, and
+ * reports the host time taken per frame and per draw call.
+ */
+static bool RunCiTrace(const std::string& filename, int num_frames, int num_warmup_frames,
+                       PerfGate::BenchResult& result) {
+    CiTrace::Player player(filename);
+    if (!player.IsValid())
+        return false;
+    if (player.GetNumFrames() == 0) {
+        LOG_CRITICAL(Frontend, "CiTrace %s doesn't contain any frames", filename.c_str());
+        return false;
+    }
+
+    player.Reset();
+
+    std::vector<Duration> frame_times;
+    std::vector<Duration> draw_times;
+    frame_times.reserve(num_frames);
+    MeasuredFrames measured;
+
+    for (int frame = 0; frame < num_warmup_frames + num_frames; ++frame) {
+        // Draws are only recorded for the measured frames
+        if (frame == num_warmup_frames) {
+            Pica::CommandProcessor::SetDrawCallback([&draw_times](Duration duration) {
+                draw_times.push_back(duration);
+            });
+        }
+
+        const auto start_time = Clock::now();
+        while (!player.PlayFrame()) {
+            // Start over at the end of the recording. Commands after its last frame marker are still
+            // played, as part of the frame being measured.
+            player.Reset();
+        }
+        GPUThread::Synchronize();
+
+        if (frame >= num_warmup_frames) {
+            frame_times.push_back(Clock::now() - start_time);
+            measured.AddFrame();
+        }
+    }
+
+    Pica::CommandProcessor::SetDrawCallback(nullptr);
+
+    Duration total_time = Duration::zero();
+    for (Duration duration : frame_times)
+        total_time += duration;
+    measured.GetResult(num_frames, std::chrono::duration<double>(total_time).count(), result);
+
+    std::printf("CiTrace:       %s (%u frames)\n", filename.c_str(), player.GetNumFrames());
+    std::printf("Frames:        %d (after %d warm-up frames)\n", num_frames, num_warmup_frames);
+    std::printf("Frames/sec:    %.2f\n", result.frames_per_second);
+    std::printf("Draws/frame:   %.1f\n", static_cast<double>(draw_times.size()) / num_frames);
+    std::printf("\n%-12s %10s %10s %10s %10s\n", "ms", "mean", "median", "p99", "max");
+    PrintDistribution("Frame", frame_times);
+    PrintDistribution("Draw", draw_times);
+    PrintCategories(measured, num_frames);
+    PrintCommandListCacheStats();
+    PrintMemoryCounters(measured);
+
+    return true;
+}
+
+/// Runs a ROM, and reports the host time taken per frame in each profiler category
+static bool RunROM(const std::string& filename, int num_frames, int num_warmup_frames,
+                   const ProfilingOptions& options, PerfGate::BenchResult& result) {
+    Loader::ResultStatus load_result = Loader::LoadFile(filename);
+    if (Loader::ResultStatus::Success != load_result) {
+        LOG_CRITICAL(Frontend, "Failed to load ROM (Error %i)!", load_result);
+        return false;
+    }
+
+    TraceRecorder& trace_recorder = GetTraceRecorder();
+    trace_recorder.SetThreadName("Emulation");
+
+    RunUntilFrame(num_warmup_frames);
+
+    if (!options.trace_filename.empty())
+        trace_recorder.Start();
+
+    PCSampler& pc_sampler = GetPCSampler();
+    if (!options.samples_filename.empty())
+        pc_sampler.SetEnabled(true, PCSampler::DEFAULT_INTERVAL, options.walk_frame_pointers);
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const u64 start_ticks = CoreTiming::GetTicks();
+    const u64 start_idle_ticks = CoreTiming::GetIdleTicks();
+
+    MeasuredFrames measured;
+    for (int frame = num_warmup_frames + 1; frame <= num_warmup_frames + num_frames; ++frame) {
+        RunUntilFrame(frame);
+        measured.AddFrame();
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    const u64 ticks = CoreTiming::GetTicks() - start_ticks;
+    const u64 idle_ticks = CoreTiming::GetIdleTicks() - start_idle_ticks;
+
+    if (!options.trace_filename.empty()) {
+        trace_recorder.Stop();
+        if (!trace_recorder.ExportChromeTrace(options.trace_filename))
+            LOG_ERROR(Frontend, "Failed to write the trace to %s", options.trace_filename.c_str());
+    }
+
+    if (!options.samples_filename.empty()) {
+        pc_sampler.SetEnabled(false);
+        if (!pc_sampler.ExportCollapsedStacks(options.samples_filename))
+            LOG_ERROR(Frontend, "Failed to write the PC samples to %s", options.samples_filename.c_str());
+    }
+
+    measured.GetResult(num_frames, elapsed, result);
+
+    // The interpreter accounts one tick per executed instruction, which idling skips over
+    std::printf("ROM:           %s\n", filename.c_str());
+    std::printf("Frames:        %d (after %d warm-up frames)\n", num_frames, num_warmup_frames);
+    std::printf("Host time:     %.3f s\n", elapsed);
+    std::printf("Frames/sec:    %.2f\n", result.frames_per_second);
+    std::printf("Guest MIPS:    %.2f\n", (ticks - idle_ticks) / elapsed / 1000000.0);
+    PrintCategories(measured, num_frames);
+    PrintCommandListCacheStats();
+    PrintMemoryCounters(measured);
+
+    return true;
+}
+
+/// Application entry point
+int main(int argc, char **argv) {
+    int option_index = 0;
+    std::string boot_filename;
+    std::string citrace_filename;
+    std::string manifest_filename;
+    std::string json_filename;
+    std::string baseline_filename;
+    ProfilingOptions profiling_options;
+    int num_frames = 600;
+    int num_warmup_frames = 60;
+    double tolerance_percent = 10.0;
+    static struct option long_options[] = {
+        { "frames", required_argument, 0, 'f' },
+        { "warmup", required_argument, 0, 'w' },
+        { "gpu-thread", no_argument, 0, 'g' },
+        { "rasterizer-threads", required_argument, 0, 'r' },
+        { "command-list-cache", no_argument, 0, 'm' },
+        { "translation-cache", no_argument, 0, 'x' },
+        { "trace", required_argument, 0, 't' },
+        { "pc-samples", required_argument, 0, 's' },
+        { "frame-pointers", no_argument, 0, 'p' },
+        { "log-filter", required_argument, 0, 'l' },
+        { "citrace", required_argument, 0, 'c' },
+        { "manifest", required_argument, 0, 'M' },
+        { "json", required_argument, 0, 'j' },
+        { "baseline", required_argument, 0, 'b' },
+        { "tolerance", required_argument, 0, 'T' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    SetBenchmarkSettings();
+    Settings::values.log_filter = "*:Error";
+
+    while (optind < argc) {
+        int arg = getopt_long(argc, argv, ":f:w:gr:mxt:s:pl:c:M:j:b:T:h", long_options, &option_index);
+        if (arg != -1) {
+            switch (arg) {
+            case 'f':
+                num_frames = std::atoi(optarg);
+                break;
+            case 'w':
+                num_warmup_frames = std::atoi(optarg);
+                break;
+            case 'g':
+                Settings::values.use_gpu_thread = true;
+                break;
+            case 'r':
+                Settings::values.rasterizer_threads = std::atoi(optarg);
+                break;
+            case 'm':
+                Settings::values.use_command_list_cache = true;
+                break;
+            case 'x':
+                Settings::values.use_disk_translation_cache = true;
+                break;
+            case 't':
+                profiling_options.trace_filename = optarg;
+                break;
+            case 's':
+                profiling_options.samples_filename = optarg;
+                break;
+            case 'p':
+                profiling_options.walk_frame_pointers = true;
+                break;
+            case 'l':
+                Settings::values.log_filter = optarg;
+                break;
+            case 'c':
+                citrace_filename = optarg;
+                break;
+            case 'M':
+                manifest_filename = optarg;
+                break;
+            case 'j':
+                json_filename = optarg;
+                break;
+            case 'b':
+                baseline_filename = optarg;
+                break;
+            case 'T':
+                tolerance_percent = std::atof(optarg);
+                break;
+            case 'h':
+                PrintHelp();
+                return 0;
+            default:
+                PrintHelp();
+                return -1;
+            }
+        } else {
+            boot_filename = argv[optind];
+            optind++;
+        }
+    }
+
+    Log::Filter log_filter(Log::Level::Error);
+    log_filter.ParseFilterString(Settings::values.log_filter);
+    Log::SetFilter(&log_filter);
+
+    if (boot_filename.empty() && citrace_filename.empty() && manifest_filename.empty()) {
+        LOG_CRITICAL(Frontend, "Failed to load ROM: No ROM specified");
+        return -1;
+    }
+    if (num_frames <= 0 || num_warmup_frames < 0) {
+        LOG_CRITICAL(Frontend, "Invalid number of frames");
+        return -1;
+    }
+    if (tolerance_percent < 0.0) {
+        LOG_CRITICAL(Frontend, "Invalid tolerance");
+        return -1;
+    }
+
+    std::vector<PerfGate::ManifestEntry> entries;
+    if (!manifest_filename.empty()) {
+        if (!profiling_options.trace_filename.empty() || !profiling_options.samples_filename.empty()) {
+            LOG_CRITICAL(Frontend, "Traces and PC samples can only be written for single runs");
+            return -1;
+        }
+        if (!PerfGate::ReadManifest(manifest_filename, num_frames, num_warmup_frames, entries))
+            return -1;
+    } else {
+        PerfGate::ManifestEntry entry;
+        entry.type = citrace_filename.empty() ? PerfGate::ManifestEntry::Type::ROM
+                                              : PerfGate::ManifestEntry::Type::CiTrace;
+        entry.name = entry.path = citrace_filename.empty() ? boot_filename : citrace_filename;
+        entry.num_frames = num_frames;
+        entry.num_warmup_frames = num_warmup_frames;
+        entries.push_back(entry);
+    }
+
+    // Read first, so that a bad baseline doesn't only show up after all the runs
+    std::vector<PerfGate::BenchResult> baseline;
+    if (!baseline_filename.empty() && !PerfGate::ReadResults(baseline_filename, baseline))
+        return -1;
+
+    EmuWindow_Null emu_window;
+
+    VideoCore::g_renderer_type = VideoCore::RendererType::Null;
+    VideoCore::g_hw_renderer_enabled = false;
+
+    // Each run boots a fresh system, so that they don't depend on the order of the manifest
+    std::vector<PerfGate::BenchResult> results;
+    bool all_succeeded = true;
+    for (const PerfGate::ManifestEntry& entry : entries) {
+        if (results.size() != 0)
+            std::printf("\n");
+
+        PerfGate::BenchResult result;
+        result.name = entry.name;
+
+        System::Init(&emu_window);
+        if (entry.type == PerfGate::ManifestEntry::Type::CiTrace) {
+            result.failed = !RunCiTrace(entry.path, entry.num_frames, entry.num_warmup_frames, result);
+        } else {
+            result.failed = !RunROM(entry.path, entry.num_frames, entry.num_warmup_frames, profiling_options,
+                                    result);
+        }
+        System::Shutdown();
+
+        all_succeeded &= !result.failed;
+        results.push_back(std::move(result));
+    }
+
+    if (!json_filename.empty() && !PerfGate::WriteResults(json_filename, results)) {
+        LOG_CRITICAL(Frontend, "Failed to write the results to %s", json_filename.c_str());
+        return -1;
+    }
+
+    if (!baseline_filename.empty()) {
+        std::printf("\n");
+        const unsigned regressions = PerfGate::CompareResults(baseline, results, tolerance_percent / 100.0);
+        if (regressions != 0) {
+            std::printf("%u regressions against %s\n", regressions, baseline_filename.c_str());
+            return 1;
+        }
+        std::printf("No regressions against %s\n", baseline_filename.c_str());
+    }
+
+    return all_succeeded ? 0 : -1;
+}
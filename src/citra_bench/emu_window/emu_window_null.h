@@ -0,0 +1,17 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/emu_window.h"
+
+/// Window without a surface or input devices, used together with the null renderer.
+class EmuWindow_Null : public EmuWindow {
+public:
+    void SwapBuffers() override {}
+    void PollEvents() override {}
+    void MakeCurrent() override {}
+    void DoneCurrent() override {}
+    void ReloadSetKeymaps() override {}
+};
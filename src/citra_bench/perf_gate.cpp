@@ -0,0 +1,404 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "citra_bench/perf_gate.h"
+
+namespace PerfGate {
+
+static bool IsAbsolutePath(const std::string& path) {
+    return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+}
+
+bool ReadManifest(const std::string& filename, int num_frames, int num_warmup_frames,
+                  std::vector<ManifestEntry>& entries) {
+    std::string text;
+    if (FileUtil::ReadFileToString(true, filename.c_str(), text) == 0) {
+        LOG_CRITICAL(Frontend, "Failed to read the manifest %s", filename.c_str());
+        return false;
+    }
+
+    std::string directory;
+    Common::SplitPath(filename, &directory, nullptr, nullptr);
+
+    std::istringstream lines(text);
+    std::string line;
+    for (unsigned line_number = 1; std::getline(lines, line); ++line_number) {
+        std::istringstream fields(line);
+        std::string type;
+        if (!(fields >> type) || type[0] == '#')
+            continue;
+
+        ManifestEntry entry;
+        entry.num_frames = num_frames;
+        entry.num_warmup_frames = num_warmup_frames;
+        if (type == "rom") {
+            entry.type = ManifestEntry::Type::ROM;
+        } else if (type == "citrace") {
+            entry.type = ManifestEntry::Type::CiTrace;
+        } else {
+            LOG_CRITICAL(Frontend, "%s:%u: Unknown run type %s", filename.c_str(), line_number, type.c_str());
+            return false;
+        }
+
+        if (!(fields >> entry.name)) {
+            LOG_CRITICAL(Frontend, "%s:%u: Missing path", filename.c_str(), line_number);
+            return false;
+        }
+        entry.path = IsAbsolutePath(entry.name) ? entry.name : directory + entry.name;
+
+        if (fields >> entry.num_frames)
+            fields >> entry.num_warmup_frames;
+        if (entry.num_frames <= 0 || entry.num_warmup_frames < 0) {
+            LOG_CRITICAL(Frontend, "%s:%u: Invalid number of frames", filename.c_str(), line_number);
+            return false;
+        }
+
+        entries.push_back(entry);
+    }
+
+    if (entries.empty()) {
+        LOG_CRITICAL(Frontend, "The manifest %s doesn't list any runs", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+static std::string EscapeJSONString(const std::string& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            result += Common::StringFromFormat("\\u%04x", c);
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+static void WriteMetrics(std::string& json, const char* name,
+                         const std::vector<std::pair<std::string, double>>& metrics) {
+    json += Common::StringFromFormat(",\n      \"%s\": {", name);
+    for (size_t i = 0; i < metrics.size(); ++i) {
+        json += Common::StringFromFormat("%s\n        \"%s\": %.17g", i == 0 ? "" : ",",
+                                         EscapeJSONString(metrics[i].first).c_str(), metrics[i].second);
+    }
+    json += metrics.empty() ? "}" : "\n      }";
+}
+
+bool WriteResults(const std::string& filename, const std::vector<BenchResult>& results) {
+    std::string json = "{\n  \"runs\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& result = results[i];
+        json += Common::StringFromFormat("%s\n    {\n      \"name\": \"%s\",\n      \"failed\": %s",
+                                         i == 0 ? "" : ",", EscapeJSONString(result.name).c_str(),
+                                         result.failed ? "true" : "false");
+        if (!result.failed) {
+            json += Common::StringFromFormat(",\n      \"frames\": %d,\n      \"fps\": %.17g,\n      \"frame_ms\": %.17g",
+                                             result.num_frames, result.frames_per_second, result.frame_ms);
+            WriteMetrics(json, "categories", result.category_ms);
+            WriteMetrics(json, "memory_peaks", result.memory_peaks);
+        }
+        json += "\n    }";
+    }
+    json += "\n  ]\n}\n";
+
+    FileUtil::IOFile file(filename, "wb");
+    return file.IsOpen() && file.WriteBytes(json.data(), json.size()) == json.size();
+}
+
+/// Value of the JSON documents written by WriteResults
+struct JSONValue {
+    enum class Type {
+        Null,
+        Boolean,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    const JSONValue* Find(const std::string& key) const {
+        for (const auto& member : members) {
+            if (member.first == key)
+                return &member.second;
+        }
+        return nullptr;
+    }
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JSONValue> elements;
+    std::vector<std::pair<std::string, JSONValue>> members;
+};
+
+/// Recursive descent parser for JSON, without support for escaped characters beyond ASCII
+class JSONParser {
+public:
+    explicit JSONParser(const std::string& text) : text(text), position(0) {}
+
+    bool Parse(JSONValue& value) {
+        if (!ParseValue(value))
+            return false;
+        SkipWhitespace();
+        return position == text.size();
+    }
+
+private:
+    void SkipWhitespace() {
+        while (position < text.size() && (text[position] == ' ' || text[position] == '\t' ||
+                                          text[position] == '\n' || text[position] == '\r')) {
+            ++position;
+        }
+    }
+
+    bool Consume(char c) {
+        SkipWhitespace();
+        if (position == text.size() || text[position] != c)
+            return false;
+        ++position;
+        return true;
+    }
+
+    bool ConsumeWord(const char* word) {
+        const size_t length = std::char_traits<char>::length(word);
+        if (text.compare(position, length, word) != 0)
+            return false;
+        position += length;
+        return true;
+    }
+
+    bool ParseString(std::string& str) {
+        if (!Consume('"'))
+            return false;
+
+        while (position < text.size()) {
+            const char c = text[position++];
+            if (c == '"')
+                return true;
+            if (c != '\\') {
+                str += c;
+                continue;
+            }
+
+            if (position == text.size())
+                return false;
+            const char escaped = text[position++];
+            switch (escaped) {
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'n': str += '\n'; break;
+            case 'r': str += '\r'; break;
+            case 't': str += '\t'; break;
+            case 'u':
+                if (position + 4 > text.size())
+                    return false;
+                str += (char)std::strtoul(text.substr(position, 4).c_str(), nullptr, 16);
+                position += 4;
+                break;
+            default:
+                str += escaped;
+                break;
+            }
+        }
+        return false;
+    }
+
+    bool ParseValue(JSONValue& value) {
+        SkipWhitespace();
+        if (position == text.size())
+            return false;
+
+        switch (text[position]) {
+        case '{':
+            value.type = JSONValue::Type::Object;
+            ++position;
+            if (Consume('}'))
+                return true;
+            do {
+                std::pair<std::string, JSONValue> member;
+                if (!ParseString(member.first) || !Consume(':') || !ParseValue(member.second))
+                    return false;
+                value.members.push_back(std::move(member));
+            } while (Consume(','));
+            return Consume('}');
+
+        case '[':
+            value.type = JSONValue::Type::Array;
+            ++position;
+            if (Consume(']'))
+                return true;
+            do {
+                value.elements.emplace_back();
+                if (!ParseValue(value.elements.back()))
+                    return false;
+            } while (Consume(','));
+            return Consume(']');
+
+        case '"':
+            value.type = JSONValue::Type::String;
+            return ParseString(value.string);
+
+        case 't':
+        case 'f':
+            value.type = JSONValue::Type::Boolean;
+            value.boolean = text[position] == 't';
+            return ConsumeWord(value.boolean ? "true" : "false");
+
+        case 'n':
+            return ConsumeWord("null");
+
+        default: {
+            const char* begin = text.c_str() + position;
+            char* end;
+            value.type = JSONValue::Type::Number;
+            value.number = std::strtod(begin, &end);
+            position += end - begin;
+            return end != begin;
+        }
+        }
+    }
+
+    const std::string& text;
+    size_t position;
+};
+
+static void ReadMetrics(const JSONValue* object, std::vector<std::pair<std::string, double>>& metrics) {
+    if (object == nullptr)
+        return;
+    for (const auto& member : object->members) {
+        if (member.second.type == JSONValue::Type::Number)
+            metrics.emplace_back(member.first, member.second.number);
+    }
+}
+
+static double ReadNumber(const JSONValue& object, const char* key) {
+    const JSONValue* value = object.Find(key);
+    return value != nullptr && value->type == JSONValue::Type::Number ? value->number : 0.0;
+}
+
+bool ReadResults(const std::string& filename, std::vector<BenchResult>& results) {
+    std::string text;
+    if (FileUtil::ReadFileToString(true, filename.c_str(), text) == 0) {
+        LOG_CRITICAL(Frontend, "Failed to read the results %s", filename.c_str());
+        return false;
+    }
+
+    JSONValue document;
+    const JSONValue* runs = nullptr;
+    if (JSONParser(text).Parse(document))
+        runs = document.Find("runs");
+    if (runs == nullptr || runs->type != JSONValue::Type::Array) {
+        LOG_CRITICAL(Frontend, "%s doesn't contain benchmark results", filename.c_str());
+        return false;
+    }
+
+    for (const JSONValue& run : runs->elements) {
+        const JSONValue* name = run.Find("name");
+        if (name == nullptr || name->type != JSONValue::Type::String)
+            continue;
+
+        BenchResult result;
+        result.name = name->string;
+        const JSONValue* failed = run.Find("failed");
+        result.failed = failed != nullptr && failed->boolean;
+        result.num_frames = (int)ReadNumber(run, "frames");
+        result.frames_per_second = ReadNumber(run, "fps");
+        result.frame_ms = ReadNumber(run, "frame_ms");
+        ReadMetrics(run.Find("categories"), result.category_ms);
+        ReadMetrics(run.Find("memory_peaks"), result.memory_peaks);
+        results.push_back(std::move(result));
+    }
+    return true;
+}
+
+static double FindMetric(const std::vector<std::pair<std::string, double>>& metrics, const std::string& name,
+                         double default_value) {
+    for (const auto& metric : metrics) {
+        if (metric.first == name)
+            return metric.second;
+    }
+    return default_value;
+}
+
+/// Prints a regression, by how much the value is worse than the baseline
+static void PrintRegression(const std::string& run, const std::string& metric, double value, double baseline) {
+    std::printf("REGRESSION %s: %s is %.3f, baseline %.3f (%+.1f%%)\n", run.c_str(), metric.c_str(),
+                value, baseline, baseline == 0.0 ? 0.0 : 100.0 * (value - baseline) / baseline);
+}
+
+unsigned CompareResults(const std::vector<BenchResult>& baseline, const std::vector<BenchResult>& results,
+                        double tolerance) {
+    unsigned regressions = 0;
+    for (const BenchResult& result : results) {
+        if (result.failed) {
+            std::printf("REGRESSION %s: the run failed\n", result.name.c_str());
+            ++regressions;
+            continue;
+        }
+
+        const BenchResult* base = nullptr;
+        for (const BenchResult& candidate : baseline) {
+            if (candidate.name == result.name && !candidate.failed)
+                base = &candidate;
+        }
+        if (base == nullptr) {
+            std::printf("No baseline for %s\n", result.name.c_str());
+            continue;
+        }
+
+        if (result.frames_per_second < base->frames_per_second * (1.0 - tolerance)) {
+            PrintRegression(result.name, "frames/sec", result.frames_per_second, base->frames_per_second);
+            ++regressions;
+        }
+
+        if (base->frame_ms >= MIN_COMPARED_MS && result.frame_ms > base->frame_ms * (1.0 + tolerance)) {
+            PrintRegression(result.name, "ms/frame", result.frame_ms, base->frame_ms);
+            ++regressions;
+        }
+
+        for (const auto& base_category : base->category_ms) {
+            if (base_category.second < MIN_COMPARED_MS)
+                continue;
+            const double value = FindMetric(result.category_ms, base_category.first, 0.0);
+            if (value > base_category.second * (1.0 + tolerance)) {
+                PrintRegression(result.name, base_category.first + " ms/frame", value, base_category.second);
+                ++regressions;
+            }
+        }
+
+        for (const auto& base_peak : base->memory_peaks) {
+            const double value = FindMetric(result.memory_peaks, base_peak.first, 0.0);
+            if (value > base_peak.second * (1.0 + tolerance)) {
+                PrintRegression(result.name, base_peak.first + " peak", value, base_peak.second);
+                ++regressions;
+            }
+        }
+    }
+
+    for (const BenchResult& base : baseline) {
+        bool found = false;
+        for (const BenchResult& result : results)
+            found |= result.name == base.name;
+        if (!found)
+            std::printf("Baseline run %s wasn't run\n", base.name.c_str());
+    }
+
+    return regressions;
+}
+
+} // namespace
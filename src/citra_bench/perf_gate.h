@@ -0,0 +1,74 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Performance regression gate of citra-bench. A manifest lists the ROMs and CiTraces to run, and
+ * the results of all of them are written to a JSON file, which a later run can use as its baseline.
+ *
+ * Manifests have one run per line, "rom <path> [frames [warmup frames]]" or
+ * "citrace <path> [frames [warmup frames]]". Relative paths are relative to the manifest, and runs
+ * without a number of frames use the ones given on the command line. Lines starting with # are
+ * comments.
+ */
+namespace PerfGate {
+
+struct ManifestEntry {
+    enum class Type {
+        ROM,
+        CiTrace,
+    };
+
+    Type type;
+    /// Path as written in the manifest, identifies the run in the results
+    std::string name;
+    std::string path;
+    int num_frames;
+    int num_warmup_frames;
+};
+
+/// Measurements of a single run
+struct BenchResult {
+    std::string name;
+    /// Set if the run failed, in which case none of the measurements are valid
+    bool failed = false;
+
+    int num_frames = 0;
+    double frames_per_second = 0.0;
+    double frame_ms = 0.0;
+    /// Mean host time per frame of each profiler category, by its path of parent categories
+    std::vector<std::pair<std::string, double>> category_ms;
+    /// Highest value of each memory counter during the measured frames
+    std::vector<std::pair<std::string, double>> memory_peaks;
+};
+
+/**
+ * Reads a manifest, see above.
+ * @return Whether the manifest could be read and all of its lines are valid
+ */
+bool ReadManifest(const std::string& filename, int num_frames, int num_warmup_frames,
+                  std::vector<ManifestEntry>& entries);
+
+bool WriteResults(const std::string& filename, const std::vector<BenchResult>& results);
+
+/// Reads results written by WriteResults
+bool ReadResults(const std::string& filename, std::vector<BenchResult>& results);
+
+/// Mean time per frame below which the baseline of a profiler category isn't compared
+const double MIN_COMPARED_MS = 0.05;
+
+/**
+ * Compares results against a baseline, and prints the regressions. Frame rates and times may be
+ * worse than the baseline by the given fraction, memory peaks may be higher by the same fraction.
+ * @return The number of regressions, including failed runs
+ */
+unsigned CompareResults(const std::vector<BenchResult>& baseline, const std::vector<BenchResult>& results,
+                        double tolerance);
+
+} // namespace
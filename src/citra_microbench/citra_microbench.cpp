@@ -0,0 +1,140 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#ifdef _MSC_VER
+#include <getopt.h>
+#else
+#include <unistd.h>
+#include <getopt.h>
+#endif
+
+#include "common/logging/log.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "core/settings.h"
+#include "core/system.h"
+
+#include "citra_bench/emu_window/emu_window_null.h"
+#include "citra_microbench/microbench.h"
+
+#include "video_core/video_core.h"
+
+static void PrintHelp()
+{
+    std::cout << "Usage: citra-microbench [options]\n"
+                 "  -f, --filter=STRING         Only run the benchmarks whose name contains STRING\n"
+                 "  -m, --min-time=SECONDS      Minimum duration of a measured run (default 0.1)\n"
+                 "  -r, --repetitions=N         Number of measured runs, of which the fastest is reported (default 3)\n"
+                 "  -c, --csv=FILE              Also write the results to FILE as CSV\n"
+                 "  -l, --list                  List the benchmarks instead of running them\n"
+                 "  -h, --help                  Display this help\n";
+}
+
+/// Configures the emulated system the kernels are measured in, matching citra-bench
+static void SetBenchmarkSettings() {
+    Settings::values.use_auto_thread_affinity = false;
+    Settings::values.emu_thread_priority = 1;
+    Settings::values.gpu_thread_priority = 1;
+    Settings::values.present_thread_priority = 1;
+    Settings::values.worker_thread_priority = 1;
+    Settings::values.use_hw_renderer = false;
+    Settings::values.use_hw_vertex_shader = false;
+    Settings::values.use_gpu_thread = false;
+    Settings::values.use_present_thread = false;
+    Settings::values.use_command_list_cache = false;
+    Settings::values.run_ahead_frames = 0;
+    Settings::values.use_async_y2r = false;
+    Settings::values.resolution_factor = 1;
+    Settings::values.rasterizer_threads = 0;
+    Settings::values.profile_gpu = false;
+    Settings::values.show_perf_overlay = false;
+    Settings::values.frame_capture_path = "";
+    Settings::values.texture_pack_path = "";
+}
+
+/// Application entry point
+int main(int argc, char **argv) {
+    int option_index = 0;
+    MicroBench::Options options;
+    bool list = false;
+    static struct option long_options[] = {
+        { "filter", required_argument, 0, 'f' },
+        { "min-time", required_argument, 0, 'm' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "csv", required_argument, 0, 'c' },
+        { "list", no_argument, 0, 'l' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+
+    while (optind < argc) {
+        int arg = getopt_long(argc, argv, ":f:m:r:c:lh", long_options, &option_index);
+        if (arg == -1) {
+            PrintHelp();
+            return -1;
+        }
+
+        switch (arg) {
+        case 'f':
+            options.filter = optarg;
+            break;
+        case 'm':
+            options.min_time = std::atof(optarg);
+            break;
+        case 'r':
+            options.repetitions = std::atoi(optarg);
+            break;
+        case 'c':
+            options.csv_filename = optarg;
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 'h':
+            PrintHelp();
+            return 0;
+        default:
+            PrintHelp();
+            return -1;
+        }
+    }
+
+    Log::Filter log_filter(Log::Level::Error);
+    Log::SetFilter(&log_filter);
+
+    if (options.min_time <= 0.0 || options.repetitions <= 0) {
+        LOG_CRITICAL(Frontend, "Invalid minimum time or number of repetitions");
+        return -1;
+    }
+
+    SetBenchmarkSettings();
+
+    // Kernels like the rasterizer work on emulated memory and registers, so they are measured
+    // inside an emulated system without a loaded application
+    EmuWindow_Null emu_window;
+
+    VideoCore::g_renderer_type = VideoCore::RendererType::Null;
+    VideoCore::g_hw_renderer_enabled = false;
+
+    System::Init(&emu_window);
+
+    MicroBench::RegisterVideoCoreBenchmarks();
+    MicroBench::RegisterCoreBenchmarks();
+
+    int result = 0;
+    if (list) {
+        MicroBench::ListBenchmarks();
+    } else if (MicroBench::RunBenchmarks(options) < 0) {
+        result = -1;
+    }
+
+    System::Shutdown();
+
+    return result;
+}
@@ -0,0 +1,287 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/core_timing.h"
+#include "core/memory.h"
+#include "core/memory_setup.h"
+#include "core/arm/skyeye_common/armstate.h"
+#include "core/arm/skyeye_common/vfp/vfp.h"
+#include "core/hle/kernel/vm_manager.h"
+#include "core/hle/service/y2r_u.h"
+#include "core/hw/display_transfer.h"
+#include "core/hw/gpu.h"
+#include "core/hw/y2r.h"
+
+#include "citra_microbench/microbench.h"
+
+namespace MicroBench {
+
+/// Fills the given buffer with the same pseudo-random bytes on every run
+static void FillPseudoRandom(std::vector<u8>& data) {
+    u32 state = 0x87654321;
+    for (u8& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = (u8)(state >> 24);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Display transfers
+
+static void RegisterDisplayTransferBenchmarks() {
+    using PixelFormat = GPU::Regs::PixelFormat;
+
+    // Dimensions of the top screen framebuffer, which is stored rotated
+    static const u32 WIDTH = 240;
+    static const u32 HEIGHT = 400;
+
+    static const struct {
+        const char* name;
+        PixelFormat input_format;
+        PixelFormat output_format;
+        bool input_tiled;
+        bool output_tiled;
+        bool scale;
+    } transfers[] = {
+        // Framebuffers copied to the display, as done every frame
+        { "RGBA8ToRGB8/TiledToLinear",   PixelFormat::RGBA8,  PixelFormat::RGB8,   true,  false, false },
+        { "RGBA8ToRGBA8/TiledToLinear",  PixelFormat::RGBA8,  PixelFormat::RGBA8,  true,  false, false },
+        { "RGB565ToRGB565/TiledToLinear", PixelFormat::RGB565, PixelFormat::RGB565, true,  false, false },
+        // Anti-aliased framebuffers downscaled by 2x2
+        { "RGBA8ToRGB8/TiledToLinear/Downscale", PixelFormat::RGBA8, PixelFormat::RGB8, true, false, true },
+        // Linear images converted to textures
+        { "RGBA8ToRGBA8/LinearToTiled",  PixelFormat::RGBA8,  PixelFormat::RGBA8,  false, true,  false },
+        { "RGBA8ToRGBA8/TiledToTiled",   PixelFormat::RGBA8,  PixelFormat::RGBA8,  true,  true,  false },
+    };
+
+    // One full screen per iteration
+    for (const auto& transfer : transfers) {
+        GPU::DisplayTransfer::Config config;
+        config.input_format = transfer.input_format;
+        config.output_format = transfer.output_format;
+        config.input_width = transfer.scale ? WIDTH * 2 : WIDTH;
+        config.output_width = WIDTH;
+        config.output_height = HEIGHT;
+        config.input_tiled = transfer.input_tiled;
+        config.output_tiled = transfer.output_tiled;
+        config.flip_vertically = false;
+        config.horizontal_scale = transfer.scale;
+        config.vertical_scale = transfer.scale;
+
+        const u32 input_height = transfer.scale ? HEIGHT * 2 : HEIGHT;
+        const u32 input_size = config.input_width * input_height * GPU::Regs::BytesPerPixel(config.input_format);
+        const u32 output_size = WIDTH * HEIGHT * GPU::Regs::BytesPerPixel(config.output_format);
+
+        Register(std::string("GPU/DisplayTransfer/") + transfer.name, [config, input_size, output_size](u64 iterations) {
+            std::vector<u8> src(input_size);
+            std::vector<u8> dst(output_size);
+            FillPseudoRandom(src);
+
+            for (u64 i = 0; i < iterations; ++i) {
+                GPU::DisplayTransfer::Perform(config, src.data(), dst.data());
+                DoNotOptimize(dst[0]);
+            }
+        }, output_size);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Y2R conversions
+
+static void RegisterY2RBenchmarks() {
+    using namespace Y2R_U;
+
+    // Resolution of the cameras, and of most videos
+    static const u16 WIDTH = 320;
+    static const u16 HEIGHT = 240;
+
+    static const struct {
+        const char* name;
+        InputFormat input_format;
+        OutputFormat output_format;
+        BlockAlignment block_alignment;
+    } conversions[] = {
+        { "YUV422ToRGBA8/Linear",    InputFormat::YUV422_Indiv8,       OutputFormat::RGBA8,  BlockAlignment::Linear },
+        { "YUV420ToRGB565/Block8x8", InputFormat::YUV420_Indiv8,       OutputFormat::RGB565, BlockAlignment::Block8x8 },
+        { "YUYV422ToRGBA8/Linear",   InputFormat::YUYV422_Interleaved, OutputFormat::RGBA8,  BlockAlignment::Linear },
+        { "YUYV422ToRGB8/Block8x8",  InputFormat::YUYV422_Interleaved, OutputFormat::RGB8,   BlockAlignment::Block8x8 },
+    };
+
+    static const u32 BYTES_PER_PIXEL[] = { 4, 3, 2, 2 };
+
+    // One full image per iteration
+    for (const auto& conversion : conversions) {
+        const u32 output_size = WIDTH * HEIGHT * BYTES_PER_PIXEL[(size_t)conversion.output_format];
+        const auto input_format = conversion.input_format;
+        const auto output_format = conversion.output_format;
+        const auto block_alignment = conversion.block_alignment;
+
+        Register(std::string("Y2R/PerformConversion/") + conversion.name, [=](u64 iterations) {
+            // Conversions read and write emulated memory, so the buffers are mapped into an
+            // address space of their own
+            const VAddr y_address = Memory::HEAP_VADDR;
+            const VAddr u_address = y_address + WIDTH * HEIGHT * 2;
+            const VAddr v_address = u_address + WIDTH * HEIGHT;
+            const VAddr dst_address = v_address + WIDTH * HEIGHT;
+            const u32 memory_size = dst_address + output_size - y_address;
+
+            std::vector<u8> memory((memory_size + Memory::PAGE_MASK) & ~Memory::PAGE_MASK);
+            FillPseudoRandom(memory);
+
+            Kernel::VMManager address_space;
+            address_space.MapBackingMemory(y_address, memory.data(), (u32)memory.size(), Kernel::MemoryState::Private);
+            Memory::SetCurrentPageTable(address_space.GetPageTable());
+
+            ConversionConfiguration cvt = {};
+            cvt.input_format = input_format;
+            cvt.output_format = output_format;
+            cvt.rotation = Rotation::None;
+            cvt.block_alignment = block_alignment;
+            cvt.input_line_width = WIDTH;
+            cvt.input_lines = HEIGHT;
+            cvt.SetStandardCoefficient(StandardCoefficient::ITU_Rec601);
+            cvt.alpha = 0xFF;
+
+            // Each transfer unit holds one line of a plane
+            const u32 chroma_size = input_format == InputFormat::YUV420_Indiv8 ? WIDTH * HEIGHT / 4 : WIDTH * HEIGHT / 2;
+            cvt.src_Y = { y_address, (u32)WIDTH * HEIGHT, WIDTH, 0 };
+            cvt.src_YUYV = { y_address, (u32)WIDTH * HEIGHT * 2, (u16)(WIDTH * 2), 0 };
+            cvt.src_U = { u_address, chroma_size, (u16)(WIDTH / 2), 0 };
+            cvt.src_V = { v_address, chroma_size, (u16)(WIDTH / 2), 0 };
+            cvt.dst = { dst_address, output_size, (u16)(output_size / HEIGHT), 0 };
+
+            for (u64 i = 0; i < iterations; ++i) {
+                // The conversion advances the buffer addresses as it goes
+                ConversionConfiguration run = cvt;
+                HW::Y2R::PerformConversion(run);
+            }
+
+            Memory::SetCurrentPageTable(nullptr);
+        }, output_size);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// VFP
+
+static void RegisterVFPBenchmarks() {
+    static const struct {
+        const char* name;
+        u32 instruction;
+        bool is_double;
+    } instructions[] = {
+        { "VADD.F32",  0xEE300A81, false }, // vadd.f32 s0, s1, s2
+        { "VMUL.F32",  0xEE200A81, false }, // vmul.f32 s0, s1, s2
+        { "VMLA.F32",  0xEE000A81, false }, // vmla.f32 s0, s1, s2
+        { "VDIV.F32",  0xEE800A81, false }, // vdiv.f32 s0, s1, s2
+        { "VSQRT.F32", 0xEEB10AE0, false }, // vsqrt.f32 s0, s1
+        { "VADD.F64",  0xEE310B02, true },  // vadd.f64 d0, d1, d2
+        { "VMUL.F64",  0xEE210B02, true },  // vmul.f64 d0, d1, d2
+        { "VDIV.F64",  0xEE810B02, true },  // vdiv.f64 d0, d1, d2
+        { "VSQRT.F64", 0xEEB10BC1, true },  // vsqrt.f64 d0, d1
+    };
+
+    // Normal operands can take fast paths, denormal ones always go through soft-float
+    static const struct {
+        const char* name;
+        u32 single_bits[2];
+        u64 double_bits[2];
+    } operands[] = {
+        { "Normal",   { 0x3FC00000, 0x40200000 }, { 0x3FF8000000000000ull, 0x4004000000000000ull } },
+        { "Denormal", { 0x00012345, 0x40200000 }, { 0x0000123456789ABCull, 0x4004000000000000ull } },
+    };
+
+    // One instruction per iteration
+    for (const auto& instruction : instructions) {
+        for (const auto& operand : operands) {
+            const u32 inst = instruction.instruction;
+            const bool is_double = instruction.is_double;
+            const u32 single_bits[2] = { operand.single_bits[0], operand.single_bits[1] };
+            const u64 double_bits[2] = { operand.double_bits[0], operand.double_bits[1] };
+
+            Register(std::string("VFP/") + instruction.name + "/" + operand.name, [=](u64 iterations) {
+                std::unique_ptr<ARMul_State> state(new ARMul_State(USER32MODE));
+                VFPInit(state.get());
+
+                for (u64 i = 0; i < iterations; ++i) {
+                    // Restore the operands, which accumulating instructions overwrite
+                    if (is_double) {
+                        vfp_put_double(state.get(), double_bits[0], 1);
+                        vfp_put_double(state.get(), double_bits[1], 2);
+                        DoNotOptimize(vfp_double_cpdo(state.get(), inst, state->VFP[VFP_FPSCR]));
+                    } else {
+                        vfp_put_float(state.get(), single_bits[0], 1);
+                        vfp_put_float(state.get(), single_bits[1], 2);
+                        DoNotOptimize(vfp_single_cpdo(state.get(), inst, state->VFP[VFP_FPSCR]));
+                    }
+                }
+            });
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Event scheduling
+
+static void RegisterCoreTimingBenchmarks() {
+    // Events are spread over a frame, and never fire as the benchmarks don't advance the clock
+    static const int NUM_EVENTS = 64;
+    const s64 max_cycles_into_future = g_clock_rate_arm11 / 60;
+
+    const int event_type = CoreTiming::RegisterEvent("MicroBench", [](u64, int) {});
+
+    // NUM_EVENTS events scheduled and unscheduled (through their handles) per iteration
+    Register("CoreTiming/ScheduleEvent/UnscheduleHandle", [=](u64 iterations) {
+        std::vector<CoreTiming::EventHandle> handles(NUM_EVENTS);
+        u32 random = 1;
+        for (u64 i = 0; i < iterations; ++i) {
+            for (int event = 0; event < NUM_EVENTS; ++event) {
+                random = random * 1664525 + 1013904223;
+                handles[event] = CoreTiming::ScheduleEvent(random % max_cycles_into_future, event_type, event);
+            }
+            for (int event = 0; event < NUM_EVENTS; ++event)
+                CoreTiming::UnscheduleEvent(handles[event]);
+        }
+    });
+
+    // NUM_EVENTS events scheduled and unscheduled by their type and userdata per iteration
+    Register("CoreTiming/ScheduleEvent/UnscheduleUserdata", [=](u64 iterations) {
+        u32 random = 1;
+        for (u64 i = 0; i < iterations; ++i) {
+            for (int event = 0; event < NUM_EVENTS; ++event) {
+                random = random * 1664525 + 1013904223;
+                CoreTiming::ScheduleEvent(random % max_cycles_into_future, event_type, event);
+            }
+            for (int event = 0; event < NUM_EVENTS; ++event)
+                CoreTiming::UnscheduleEvent(event_type, event);
+        }
+    });
+
+    // NUM_EVENTS events scheduled and removed at once per iteration
+    Register("CoreTiming/ScheduleEvent/RemoveEvent", [=](u64 iterations) {
+        u32 random = 1;
+        for (u64 i = 0; i < iterations; ++i) {
+            for (int event = 0; event < NUM_EVENTS; ++event) {
+                random = random * 1664525 + 1013904223;
+                CoreTiming::ScheduleEvent(random % max_cycles_into_future, event_type, event);
+            }
+            CoreTiming::RemoveEvent(event_type);
+        }
+    });
+}
+
+void RegisterCoreBenchmarks() {
+    RegisterDisplayTransferBenchmarks();
+    RegisterY2RBenchmarks();
+    RegisterVFPBenchmarks();
+    RegisterCoreTimingBenchmarks();
+}
+
+} // namespace
@@ -0,0 +1,111 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "common/logging/log.h"
+
+#include "citra_microbench/microbench.h"
+
+namespace MicroBench {
+
+using Clock = std::chrono::steady_clock;
+
+struct Benchmark {
+    std::string name;
+    Function function;
+    u64 bytes_per_iteration;
+};
+
+/// Upper bound on the number of iterations of a run, in case a benchmark doesn't do any work
+static const u64 MAX_ITERATIONS = 1ull << 32;
+
+static std::vector<Benchmark>& GetBenchmarks() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+void Register(const std::string& name, Function function, u64 bytes_per_iteration) {
+    GetBenchmarks().push_back({ name, std::move(function), bytes_per_iteration });
+}
+
+/// Runs the given number of iterations and returns the time they took in seconds
+static double TimeRun(const Benchmark& benchmark, u64 iterations) {
+    const auto start_time = Clock::now();
+    benchmark.function(iterations);
+    return std::chrono::duration<double>(Clock::now() - start_time).count();
+}
+
+/// Returns the fastest time of a single iteration in seconds
+static double Measure(const Benchmark& benchmark, const Options& options) {
+    // Warm up caches and lazily initialized state, then find an iteration count which takes
+    // long enough for the clock resolution not to matter
+    u64 iterations = 1;
+    double elapsed = TimeRun(benchmark, iterations);
+    while (elapsed < options.min_time && iterations < MAX_ITERATIONS) {
+        // Aim slightly past the minimum time, but don't grow by more than 10x at once, as the
+        // first few runs are too short to extrapolate from reliably
+        const double factor = elapsed > 0.0 ? options.min_time * 1.2 / elapsed : 10.0;
+        iterations = std::max(iterations + 1, (u64)(iterations * std::min(factor, 10.0)));
+        elapsed = TimeRun(benchmark, iterations);
+    }
+
+    double best = elapsed;
+    for (int repetition = 1; repetition < options.repetitions; ++repetition)
+        best = std::min(best, TimeRun(benchmark, iterations));
+
+    return best / iterations;
+}
+
+int RunBenchmarks(const Options& options) {
+    FILE* csv = nullptr;
+    if (!options.csv_filename.empty()) {
+        csv = std::fopen(options.csv_filename.c_str(), "w");
+        if (csv == nullptr) {
+            LOG_CRITICAL(Frontend, "Failed to open %s for writing", options.csv_filename.c_str());
+            return -1;
+        }
+        std::fprintf(csv, "name,ns_per_iteration,mb_per_second\n");
+    }
+
+    std::printf("%-56s %14s %12s\n", "Benchmark", "ns/iteration", "MB/s");
+
+    int num_run = 0;
+    for (const Benchmark& benchmark : GetBenchmarks()) {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        const double seconds = Measure(benchmark, options);
+        const double ns = seconds * 1e9;
+        const double mb_per_second = benchmark.bytes_per_iteration != 0 && seconds > 0.0 ?
+                benchmark.bytes_per_iteration / seconds / (1024.0 * 1024.0) : 0.0;
+
+        if (benchmark.bytes_per_iteration != 0) {
+            std::printf("%-56s %14.1f %12.1f\n", benchmark.name.c_str(), ns, mb_per_second);
+        } else {
+            std::printf("%-56s %14.1f %12s\n", benchmark.name.c_str(), ns, "-");
+        }
+        std::fflush(stdout);
+
+        if (csv != nullptr)
+            std::fprintf(csv, "%s,%.3f,%.3f\n", benchmark.name.c_str(), ns, mb_per_second);
+
+        ++num_run;
+    }
+
+    if (csv != nullptr)
+        std::fclose(csv);
+
+    return num_run;
+}
+
+void ListBenchmarks() {
+    for (const Benchmark& benchmark : GetBenchmarks())
+        std::printf("%s\n", benchmark.name.c_str());
+}
+
+} // namespace
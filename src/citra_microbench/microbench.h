@@ -0,0 +1,72 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Minimal harness for measuring isolated emulator kernels.
+ *
+ * A benchmark is a function which runs the measured operation a given number of times. The
+ * runner grows the number of iterations until a run takes at least the minimum time, repeats the
+ * run a few times and reports the fastest one, which is the least disturbed by the rest of the
+ * system.
+ */
+namespace MicroBench {
+
+/// Runs the measured operation the given number of times
+using Function = std::function<void(u64 iterations)>;
+
+/**
+ * Adds a benchmark to the suite.
+ * @param name Unique name of the benchmark, conventionally "Subsystem/Operation/Variant"
+ * @param function Function running the measured operation
+ * @param bytes_per_iteration Amount of data processed by one iteration, used to report the
+ *                            throughput. Zero if the throughput isn't meaningful.
+ */
+void Register(const std::string& name, Function function, u64 bytes_per_iteration = 0);
+
+struct Options {
+    /// Only benchmarks whose name contains this string are run
+    std::string filter;
+    /// Minimum duration of a measured run in seconds
+    double min_time = 0.1;
+    /// Number of measured runs per benchmark, of which the fastest is reported
+    int repetitions = 3;
+    /// If not empty, the results are also written to this file as CSV, for tracking them over time
+    std::string csv_filename;
+};
+
+/**
+ * Runs the registered benchmarks and prints their results.
+ * @return Number of benchmarks which were run, or -1 if the CSV file couldn't be written
+ */
+int RunBenchmarks(const Options& options);
+
+/// Prints the names of the registered benchmarks
+void ListBenchmarks();
+
+/// Keeps the compiler from optimizing away the computation of the given value
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    // Reading the object through a volatile pointer forces it to be materialized
+    static volatile char sink;
+    sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+}
+
+/// Benchmarks of the video core: tiling, texture decoding, vertex shading and rasterization
+void RegisterVideoCoreBenchmarks();
+
+/// Benchmarks of the core: GPU display transfers, Y2R conversions, VFP and event scheduling
+void RegisterCoreBenchmarks();
+
+} // namespace
@@ -0,0 +1,460 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "core/memory.h"
+
+#include "video_core/pica.h"
+#include "video_core/rasterizer.h"
+#include "video_core/utils.h"
+#include "video_core/vertex_shader.h"
+#include "video_core/debug_utils/debug_utils.h"
+
+#include "citra_microbench/microbench.h"
+
+using namespace Pica;
+
+namespace MicroBench {
+
+/// Fills the given buffer with the same pseudo-random bytes on every run
+static void FillPseudoRandom(std::vector<u8>& data) {
+    u32 state = 0x12345678;
+    for (u8& byte : data) {
+        state = state * 1664525 + 1013904223;
+        byte = (u8)(state >> 24);
+    }
+}
+
+/// Encodes a normal float as a float24 register value
+static u32 ToRawFloat24(float value) {
+    if (value == 0.f)
+        return 0;
+
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const u32 sign = bits >> 31;
+    const u32 exponent = ((bits >> 23) & 0xFF) - 127 + 63;
+    const u32 mantissa = (bits >> 7) & 0xFFFF;
+    return (sign << 23) | (exponent << 16) | mantissa;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Morton tiling
+
+static const u32 MORTON_IMAGE_SIZE = 256;
+
+static void RegisterMortonBenchmarks() {
+    // One 8x8 tile per iteration
+    Register("VideoCore/MortonInterleave/Tile", [](u64 iterations) {
+        for (u64 i = 0; i < iterations; ++i) {
+            u32 sum = 0;
+            for (u32 y = 0; y < 8; ++y)
+                for (u32 x = 0; x < 8; ++x)
+                    sum += VideoCore::MortonInterleave(x + (u32)i, y);
+            DoNotOptimize(sum);
+        }
+    });
+
+    // Offsets of all pixels of a 256x256 image per iteration
+    for (u32 bytes_per_pixel : { 2u, 4u }) {
+        Register("VideoCore/GetMortonOffset/" + std::to_string(bytes_per_pixel) + "Bpp", [bytes_per_pixel](u64 iterations) {
+            for (u64 i = 0; i < iterations; ++i) {
+                u32 sum = 0;
+                for (u32 y = 0; y < MORTON_IMAGE_SIZE; ++y)
+                    for (u32 x = 0; x < MORTON_IMAGE_SIZE; ++x)
+                        sum += VideoCore::GetMortonOffset(x, y, bytes_per_pixel);
+                DoNotOptimize(sum);
+            }
+        }, MORTON_IMAGE_SIZE * MORTON_IMAGE_SIZE * bytes_per_pixel);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Texture decoding
+
+static const int TEXTURE_SIZE = 128;
+
+static void RegisterLookupTextureBenchmarks() {
+    static const struct {
+        const char* name;
+        Regs::TextureFormat format;
+    } formats[] = {
+        { "RGBA8",  Regs::TextureFormat::RGBA8 },
+        { "RGB8",   Regs::TextureFormat::RGB8 },
+        { "RGB5A1", Regs::TextureFormat::RGB5A1 },
+        { "RGB565", Regs::TextureFormat::RGB565 },
+        { "RGBA4",  Regs::TextureFormat::RGBA4 },
+        { "IA8",    Regs::TextureFormat::IA8 },
+        { "I8",     Regs::TextureFormat::I8 },
+        { "A8",     Regs::TextureFormat::A8 },
+        { "IA4",    Regs::TextureFormat::IA4 },
+        { "I4",     Regs::TextureFormat::I4 },
+        { "A4",     Regs::TextureFormat::A4 },
+        { "ETC1",   Regs::TextureFormat::ETC1 },
+        { "ETC1A4", Regs::TextureFormat::ETC1A4 },
+    };
+
+    // Decodes every texel of a 128x128 texture per iteration, in the order a linear copy would
+    for (const auto& format : formats) {
+        DebugUtils::TextureInfo info;
+        info.physical_address = 0;
+        info.width = info.height = TEXTURE_SIZE;
+        info.stride = Regs::NibblesPerPixel(format.format) * TEXTURE_SIZE / 2;
+        info.format = format.format;
+
+        Register(std::string("DebugUtils/LookupTexture/") + format.name, [info](u64 iterations) {
+            std::vector<u8> data(info.stride * info.height);
+            FillPseudoRandom(data);
+
+            for (u64 i = 0; i < iterations; ++i) {
+                for (int t = 0; t < info.height; ++t) {
+                    for (int s = 0; s < info.width; ++s) {
+                        Math::Vec4<u8> texel = DebugUtils::LookupTexture(data.data(), s, t, info);
+                        DoNotOptimize(texel);
+                    }
+                }
+            }
+        }, TEXTURE_SIZE * TEXTURE_SIZE * 4);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Vertex shading
+
+/// Register indices as encoded in shader instructions
+static const u32 REG_INPUT = 0x00;
+static const u32 REG_OUTPUT = 0x00;
+static const u32 REG_TEMPORARY = 0x10;
+static const u32 REG_FLOAT_UNIFORM = 0x20;
+
+/// Operand descriptors (swizzle patterns) used by the canned programs
+enum OperandDescriptor : u32 {
+    DESC_XYZW,       ///< Writes xyzw, reads src1.xyzw and src2.xyzw
+    DESC_X,          ///< Writes x, reads src1.xyzw and src2.xyzw
+    DESC_Y,
+    DESC_Z,
+    DESC_W,
+    DESC_XYZW_SRC2X, ///< Writes xyzw, reads src1.xyzw and src2.xxxx
+    DESC_XYZW_SRC1X, ///< Writes xyzw, reads src1.xxxx and src2.xyzw
+    DESC_X_SRC2X,    ///< Writes x, reads src1.xyzw and src2.xxxx
+    DESC_X_SRC1X,    ///< Writes x, reads src1.xxxx and src2.xyzw
+
+    NUM_OPERAND_DESCRIPTORS
+};
+
+/**
+ * Encodes an operand descriptor. Components of the destination mask and the selectors are
+ * stored with x in the most significant position.
+ */
+static u32 EncodeOperandDescriptor(u32 dest_mask, u32 src1_selector, u32 src2_selector) {
+    return dest_mask | (src1_selector << 5) | (src2_selector << 14) | (0x1B << 23);
+}
+
+static const u32 MASK_XYZW = 0xF;
+static const u32 SELECT_XYZW = 0x1B;
+static const u32 SELECT_XXXX = 0x00;
+
+/// Encodes an arithmetic instruction. src1 can address any register, src2 only inputs and temporaries.
+static u32 EncodeArithmetic(nihstro::OpCode::Id opcode, u32 dest, u32 src1, u32 src2, OperandDescriptor desc) {
+    return ((u32)opcode << 26) | (dest << 21) | (src1 << 12) | (src2 << 7) | desc;
+}
+
+static u32 EncodeEnd() {
+    return (u32)nihstro::OpCode::Id::END << 26;
+}
+
+struct ShaderProgram {
+    const char* name;
+    std::vector<u32> code;
+};
+
+/**
+ * Canned programs of increasing complexity: a pass-through, a position transform as used for 2D
+ * and simple 3D geometry, and a transform with per-vertex diffuse lighting. Inputs are the
+ * position (v0), color (v1), texture coordinate (v2) and normal (v3). Outputs are the position
+ * (o0), color (o1) and texture coordinate (o2).
+ */
+static std::vector<ShaderProgram> GetShaderPrograms() {
+    using Id = nihstro::OpCode::Id;
+
+    const u32 v0 = REG_INPUT, v1 = REG_INPUT + 1, v2 = REG_INPUT + 2, v3 = REG_INPUT + 3;
+    const u32 o0 = REG_OUTPUT, o1 = REG_OUTPUT + 1, o2 = REG_OUTPUT + 2;
+    const u32 r0 = REG_TEMPORARY, r1 = REG_TEMPORARY + 1, r2 = REG_TEMPORARY + 2;
+    auto c = [](u32 index) { return REG_FLOAT_UNIFORM + index; };
+
+    const std::vector<u32> transform = {
+        EncodeArithmetic(Id::DP4, o0, c(0), v0, DESC_X),
+        EncodeArithmetic(Id::DP4, o0, c(1), v0, DESC_Y),
+        EncodeArithmetic(Id::DP4, o0, c(2), v0, DESC_Z),
+        EncodeArithmetic(Id::DP4, o0, c(3), v0, DESC_W),
+        EncodeArithmetic(Id::MOV, o2, v2, 0, DESC_XYZW),
+    };
+
+    ShaderProgram passthrough = { "Passthrough", {
+        EncodeArithmetic(Id::MOV, o0, v0, 0, DESC_XYZW),
+        EncodeArithmetic(Id::MOV, o1, v1, 0, DESC_XYZW),
+        EncodeArithmetic(Id::MOV, o2, v2, 0, DESC_XYZW),
+        EncodeEnd(),
+    } };
+
+    ShaderProgram transformed = { "Transform", transform };
+    transformed.code.push_back(EncodeArithmetic(Id::MOV, o1, v1, 0, DESC_XYZW));
+    transformed.code.push_back(EncodeEnd());
+
+    // color = ambient (c7) + light color (c6) * max(0, dot(light direction (c4), normalize(normal)))
+    ShaderProgram lit = { "Lighting", transform };
+    lit.code.insert(lit.code.end(), {
+        EncodeArithmetic(Id::DP3, r2, v3, v3, DESC_X),
+        EncodeArithmetic(Id::RSQ, r2, r2, 0, DESC_X),
+        EncodeArithmetic(Id::MUL, r2, r2, v3, DESC_XYZW_SRC1X),
+        EncodeArithmetic(Id::DP3, r0, c(4), r2, DESC_X),
+        EncodeArithmetic(Id::MAX, r0, c(5), r0, DESC_X_SRC2X),
+        EncodeArithmetic(Id::MUL, r1, c(6), r0, DESC_XYZW_SRC2X),
+        EncodeArithmetic(Id::ADD, o1, c(7), r1, DESC_XYZW),
+        EncodeEnd(),
+    });
+
+    return { passthrough, transformed, lit };
+}
+
+/// Loads the given program and a matching configuration into the vertex shader registers
+static void SetupVertexShader(const ShaderProgram& program) {
+    auto& setup = g_state.vs;
+    auto& config = g_state.regs.vs;
+
+    setup.program_code.fill(0);
+    std::copy(program.code.begin(), program.code.end(), setup.program_code.begin());
+
+    setup.swizzle_data.fill(0);
+    const u32 masks[] = { 0x8, 0x4, 0x2, 0x1 };
+    setup.swizzle_data[DESC_XYZW] = EncodeOperandDescriptor(MASK_XYZW, SELECT_XYZW, SELECT_XYZW);
+    for (int i = 0; i < 4; ++i)
+        setup.swizzle_data[DESC_X + i] = EncodeOperandDescriptor(masks[i], SELECT_XYZW, SELECT_XYZW);
+    setup.swizzle_data[DESC_XYZW_SRC2X] = EncodeOperandDescriptor(MASK_XYZW, SELECT_XYZW, SELECT_XXXX);
+    setup.swizzle_data[DESC_XYZW_SRC1X] = EncodeOperandDescriptor(MASK_XYZW, SELECT_XXXX, SELECT_XYZW);
+    setup.swizzle_data[DESC_X_SRC2X] = EncodeOperandDescriptor(masks[0], SELECT_XYZW, SELECT_XXXX);
+    setup.swizzle_data[DESC_X_SRC1X] = EncodeOperandDescriptor(masks[0], SELECT_XXXX, SELECT_XYZW);
+
+    // c0-c3: a scale and translation matrix, c4: light direction, c5: zero, c6 and c7: light colors
+    const float uniforms[8][4] = {
+        { 0.5f, 0.f,  0.f,  0.25f },
+        { 0.f,  0.5f, 0.f,  0.25f },
+        { 0.f,  0.f,  0.5f, 0.5f },
+        { 0.f,  0.f,  0.f,  1.f },
+        { 0.f,  0.6f, 0.8f, 0.f },
+        { 0.f,  0.f,  0.f,  0.f },
+        { 0.8f, 0.7f, 0.6f, 1.f },
+        { 0.1f, 0.1f, 0.1f, 0.f },
+    };
+    for (int i = 0; i < 8; ++i)
+        for (int comp = 0; comp < 4; ++comp)
+            setup.uniforms.f[i][comp] = float24::FromFloat32(uniforms[i][comp]);
+
+    config.main_offset = 0;
+    config.input_register_map.attribute0_register = 0;
+    config.input_register_map.attribute1_register = 1;
+    config.input_register_map.attribute2_register = 2;
+    config.input_register_map.attribute3_register = 3;
+
+    using Semantic = Regs::VSOutputAttributes::Semantic;
+    const Semantic semantics[3][4] = {
+        { Semantic::POSITION_X, Semantic::POSITION_Y, Semantic::POSITION_Z, Semantic::POSITION_W },
+        { Semantic::COLOR_R, Semantic::COLOR_G, Semantic::COLOR_B, Semantic::COLOR_A },
+        { Semantic::TEXCOORD0_U, Semantic::TEXCOORD0_V, Semantic::INVALID, Semantic::INVALID },
+    };
+    for (int i = 0; i < 7; ++i) {
+        auto& output = g_state.regs.vs_output_attributes[i];
+        const bool used = i < 3;
+        output.map_x = used ? semantics[i][0] : Semantic::INVALID;
+        output.map_y = used ? semantics[i][1] : Semantic::INVALID;
+        output.map_z = used ? semantics[i][2] : Semantic::INVALID;
+        output.map_w = used ? semantics[i][3] : Semantic::INVALID;
+    }
+}
+
+static const int NUM_SHADER_ATTRIBUTES = 4;
+
+static VertexShader::InputVertex MakeShaderInput(int index) {
+    const float t = (index % 64) / 64.f;
+    const float attributes[NUM_SHADER_ATTRIBUTES][4] = {
+        { t, 1.f - t, 0.5f, 1.f },
+        { 1.f, t, 0.f, 1.f },
+        { t, t, 0.f, 0.f },
+        { 0.f, t, 1.f - t, 0.f },
+    };
+
+    VertexShader::InputVertex input;
+    std::memset(&input, 0, sizeof(input));
+    for (int attribute = 0; attribute < NUM_SHADER_ATTRIBUTES; ++attribute)
+        for (int comp = 0; comp < 4; ++comp)
+            input.attr[attribute][comp] = float24::FromFloat32(attributes[attribute][comp]);
+    return input;
+}
+
+static void RegisterVertexShaderBenchmarks() {
+    static const int NUM_INPUTS = 64;
+
+    for (const ShaderProgram& program : GetShaderPrograms()) {
+        // One vertex per iteration
+        Register(std::string("VertexShader/RunShader/") + program.name, [program](u64 iterations) {
+            SetupVertexShader(program);
+            std::vector<VertexShader::InputVertex> inputs;
+            for (int i = 0; i < NUM_INPUTS; ++i)
+                inputs.push_back(MakeShaderInput(i));
+
+            for (u64 i = 0; i < iterations; ++i) {
+                VertexShader::OutputVertex output = VertexShader::RunShader(
+                        inputs[i % NUM_INPUTS], NUM_SHADER_ATTRIBUTES, g_state.regs.vs, g_state.vs);
+                DoNotOptimize(output);
+            }
+        });
+
+        // One batch of vertices per iteration
+        Register(std::string("VertexShader/RunShaderBatch/") + program.name, [program](u64 iterations) {
+            SetupVertexShader(program);
+            std::vector<VertexShader::InputVertex> inputs;
+            for (int i = 0; i < NUM_INPUTS; ++i)
+                inputs.push_back(MakeShaderInput(i));
+
+            VertexShader::OutputVertex outputs[VertexShader::BATCH_SIZE];
+            for (u64 i = 0; i < iterations; ++i) {
+                const int first = (int)(i * VertexShader::BATCH_SIZE % NUM_INPUTS);
+                VertexShader::RunShaderBatch(&inputs[first], outputs, VertexShader::BATCH_SIZE,
+                                             NUM_SHADER_ATTRIBUTES, g_state.regs.vs, g_state.vs);
+                DoNotOptimize(outputs);
+            }
+        });
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rasterization
+
+static const u32 FRAMEBUFFER_WIDTH = 240;
+static const u32 FRAMEBUFFER_HEIGHT = 400;
+
+enum class RasterizerSetup {
+    Flat,      ///< Color writes only
+    DepthTest, ///< Depth testing and depth writes against a D24S8 buffer
+    Blend,     ///< Alpha blending with the destination color
+};
+
+/// Points the framebuffer at VRAM and configures the output merger for the given setup
+static void SetupRasterizer(RasterizerSetup setup) {
+    auto& regs = g_state.regs;
+
+    regs.cull_mode = Regs::CullMode::KeepAll;
+    regs.viewport_size_x = ToRawFloat24(FRAMEBUFFER_WIDTH / 2.f);
+    regs.viewport_size_y = ToRawFloat24(FRAMEBUFFER_HEIGHT / 2.f);
+    regs.viewport_corner.x = 0;
+    regs.viewport_corner.y = 0;
+
+    // Address registers are stored in units of 8 bytes
+    auto& framebuffer = regs.framebuffer;
+    framebuffer.color_format = Regs::ColorFormat::RGBA8;
+    framebuffer.depth_format = Regs::DepthFormat::D24S8;
+    framebuffer.color_buffer_address = Memory::VRAM_PADDR / 8;
+    framebuffer.depth_buffer_address = (Memory::VRAM_PADDR + FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT * 4) / 8;
+    framebuffer.width = FRAMEBUFFER_WIDTH;
+    framebuffer.height = FRAMEBUFFER_HEIGHT;
+
+    // The texture units and combiners stay disabled and pass the vertex color through
+    auto& output_merger = regs.output_merger;
+    output_merger.red_enable = output_merger.green_enable = 1;
+    output_merger.blue_enable = output_merger.alpha_enable = 1;
+    output_merger.depth_test_enable = setup == RasterizerSetup::DepthTest;
+    output_merger.depth_test_func = Regs::CompareFunc::GreaterThanOrEqual;
+    output_merger.depth_write_enable = setup == RasterizerSetup::DepthTest;
+
+    output_merger.alphablend_enable = setup == RasterizerSetup::Blend;
+    output_merger.logic_op = Regs::LogicOp::Copy;
+    output_merger.alpha_blending.blend_equation_rgb = Regs::BlendEquation::Add;
+    output_merger.alpha_blending.blend_equation_a = Regs::BlendEquation::Add;
+    output_merger.alpha_blending.factor_source_rgb = Regs::BlendFactor::SourceAlpha;
+    output_merger.alpha_blending.factor_dest_rgb = Regs::BlendFactor::OneMinusSourceAlpha;
+    output_merger.alpha_blending.factor_source_a = Regs::BlendFactor::One;
+    output_merger.alpha_blending.factor_dest_a = Regs::BlendFactor::Zero;
+
+    Rasterizer::InvalidateDrawState();
+    Rasterizer::BeginDraw();
+}
+
+/// Returns a vertex as output by the clipper, in screen coordinates with 1/w stored in pos.w
+static VertexShader::OutputVertex MakeScreenVertex(float x, float y, float z, float r, float g, float b) {
+    VertexShader::OutputVertex vertex;
+    std::memset(&vertex, 0, sizeof(vertex));
+    vertex.pos.w = float24::FromFloat32(1.f);
+    vertex.screenpos[0] = float24::FromFloat32(x);
+    vertex.screenpos[1] = float24::FromFloat32(y);
+    vertex.screenpos[2] = float24::FromFloat32(z);
+    vertex.color[0] = float24::FromFloat32(r);
+    vertex.color[1] = float24::FromFloat32(g);
+    vertex.color[2] = float24::FromFloat32(b);
+    vertex.color[3] = float24::FromFloat32(0.5f);
+    vertex.tc0[0] = float24::FromFloat32(x / FRAMEBUFFER_WIDTH);
+    vertex.tc0[1] = float24::FromFloat32(y / FRAMEBUFFER_HEIGHT);
+    return vertex;
+}
+
+static void RegisterRasterizerBenchmarks() {
+    static const struct {
+        const char* name;
+        float size;
+    } sizes[] = {
+        { "Small", 8.f },   // Typical of dense 3D geometry
+        { "Medium", 64.f },
+        { "Large", 240.f }, // Typical of 2D layers covering the screen
+    };
+
+    static const struct {
+        const char* name;
+        RasterizerSetup setup;
+    } setups[] = {
+        { "Flat", RasterizerSetup::Flat },
+        { "DepthTest", RasterizerSetup::DepthTest },
+        { "Blend", RasterizerSetup::Blend },
+    };
+
+    // One right triangle with the given leg length per iteration, moved around the framebuffer
+    for (const auto& size : sizes) {
+        for (const auto& setup : setups) {
+            const float length = size.size;
+            const RasterizerSetup rasterizer_setup = setup.setup;
+            const std::string name = std::string("Rasterizer/ProcessTriangle/") + size.name + "/" + setup.name;
+
+            Register(name, [length, rasterizer_setup](u64 iterations) {
+                SetupRasterizer(rasterizer_setup);
+
+                const int positions_x = (int)((FRAMEBUFFER_WIDTH - length) / 4) + 1;
+                const int positions_y = (int)((FRAMEBUFFER_HEIGHT - length) / 4) + 1;
+                for (u64 i = 0; i < iterations; ++i) {
+                    const float x = (float)(i % positions_x * 4);
+                    const float y = (float)(i / positions_x % positions_y * 4);
+                    const float z = (i % 16) / 16.f;
+                    Rasterizer::ProcessTriangle(MakeScreenVertex(x, y, z, 1.f, 0.f, 0.f),
+                                                MakeScreenVertex(x + length, y, z, 0.f, 1.f, 0.f),
+                                                MakeScreenVertex(x, y + length, z, 0.f, 0.f, 1.f));
+                }
+                Rasterizer::FlushTriangles();
+            }, (u64)(length * length / 2) * 4);
+        }
+    }
+}
+
+void RegisterVideoCoreBenchmarks() {
+    RegisterMortonBenchmarks();
+    RegisterLookupTextureBenchmarks();
+    RegisterVertexShaderBenchmarks();
+    RegisterRasterizerBenchmarks();
+}
+
+} // namespace
@@ -14,8 +14,11 @@
 #include "common/string_util.h"
 #include "common/scm_rev.h"
 #include "common/key_map.h"
+#include "common/profiler_reporting.h"
 
 #include "core/core.h"
+#include "core/host_threads.h"
+#include "core/memory.h"
 #include "core/settings.h"
 #include "core/system.h"
 
@@ -35,6 +38,8 @@ EmuThread::EmuThread(GRenderWindow* render_window) :
 }
 
 void EmuThread::run() {
+    Common::Profiling::GetTraceRecorder().SetThreadName("Emulation");
+    HostThreads::ApplyToCurrentThread(HostThreads::Role::Emulation);
     render_window->MakeCurrent();
 
     stop_run = false;
@@ -48,7 +53,12 @@ void EmuThread::run() {
             if (!was_active)
                 emit DebugModeLeft();
 
-            Core::RunLoop();
+            Core::RunFrames(1, running);
+
+            // Break into the debugger when a memory watchpoint was hit
+            Memory::WatchpointHit hit;
+            if (Memory::PopWatchpointHit(hit))
+                running = false;
 
             was_active = running || exec_step;
             if (!was_active && !stop_run)
@@ -69,7 +69,7 @@ public:
 
 private:
     bool exec_step;
-    bool running;
+    std::atomic<bool> running;
     std::atomic<bool> stop_run;
     std::mutex running_mutex;
     std::condition_variable running_cv;
@@ -36,14 +36,52 @@ void Config::ReadValues() {
         Settings::values.input_mappings[Settings::NativeInput::All[i]] =
             qt_config->value(QString::fromStdString(Settings::NativeInput::Mapping[i]), defaults[i]).toInt();
     }
+    Settings::values.input_polling_rate = qt_config->value("input_polling_rate", 250).toInt();
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
     Settings::values.frame_skip = qt_config->value("frame_skip", 0).toInt();
+    Settings::values.use_frame_limit = qt_config->value("use_frame_limit", true).toBool();
+    Settings::values.use_idle_sleep = qt_config->value("use_idle_sleep", true).toBool();
+    Settings::values.use_dynamic_frame_skip = qt_config->value("use_dynamic_frame_skip", false).toBool();
+    Settings::values.run_ahead_frames = qt_config->value("run_ahead_frames", 0).toInt();
+    Settings::values.use_async_y2r = qt_config->value("use_async_y2r", false).toBool();
+    Settings::values.use_async_fs = qt_config->value("use_async_fs", false).toBool();
+    Settings::values.use_deterministic_timeslices = qt_config->value("use_deterministic_timeslices", false).toBool();
+    Settings::values.max_slice_length = qt_config->value("max_slice_length", 20000).toInt();
+    Settings::values.memory_access_cost = qt_config->value("memory_access_cost", 2).toInt();
+    Settings::values.multiply_cost = qt_config->value("multiply_cost", 2).toInt();
+    Settings::values.vfp_cost = qt_config->value("vfp_cost", 2).toInt();
+    Settings::values.branch_cost = qt_config->value("branch_cost", 2).toInt();
+    Settings::values.use_speculative_translation = qt_config->value("use_speculative_translation", false).toBool();
+    Settings::values.use_disk_translation_cache = qt_config->value("use_disk_translation_cache", false).toBool();
+    Settings::values.worker_threads = qt_config->value("worker_threads", -1).toInt();
+    Settings::values.worker_affinity_mask = qt_config->value("worker_affinity_mask", 0).toInt();
+    Settings::values.use_auto_thread_affinity = qt_config->value("use_auto_thread_affinity", false).toBool();
+    Settings::values.emu_thread_affinity_mask = qt_config->value("emu_thread_affinity_mask", 0).toInt();
+    Settings::values.gpu_thread_affinity_mask = qt_config->value("gpu_thread_affinity_mask", 0).toInt();
+    Settings::values.present_thread_affinity_mask = qt_config->value("present_thread_affinity_mask", 0).toInt();
+    Settings::values.emu_thread_priority = qt_config->value("emu_thread_priority", 1).toInt();
+    Settings::values.gpu_thread_priority = qt_config->value("gpu_thread_priority", 1).toInt();
+    Settings::values.present_thread_priority = qt_config->value("present_thread_priority", 1).toInt();
+    Settings::values.worker_thread_priority = qt_config->value("worker_thread_priority", 1).toInt();
     qt_config->endGroup();
 
     qt_config->beginGroup("Renderer");
     Settings::values.use_hw_renderer = qt_config->value("use_hw_renderer", false).toBool();
+    Settings::values.use_hw_vertex_shader = qt_config->value("use_hw_vertex_shader", false).toBool();
+    Settings::values.use_gpu_thread = qt_config->value("use_gpu_thread", false).toBool();
+    Settings::values.use_present_thread = qt_config->value("use_present_thread", false).toBool();
+    Settings::values.use_command_list_cache = qt_config->value("use_command_list_cache", false).toBool();
+    Settings::values.resolution_factor = qt_config->value("resolution_factor", 1).toInt();
+    Settings::values.rasterizer_threads = qt_config->value("rasterizer_threads", 0).toInt();
+    Settings::values.texture_cache_size = qt_config->value("texture_cache_size", 256).toInt();
+    Settings::values.use_compressed_textures = qt_config->value("use_compressed_textures", true).toBool();
+    Settings::values.texture_pack_path = qt_config->value("texture_pack_path", "").toString().toStdString();
+    Settings::values.profile_gpu = qt_config->value("profile_gpu", false).toBool();
+    Settings::values.show_perf_overlay = qt_config->value("show_perf_overlay", false).toBool();
+    Settings::values.frame_capture_path = qt_config->value("frame_capture_path", "").toString().toStdString();
+    Settings::values.frame_capture_format = qt_config->value("frame_capture_format", 0).toInt();
 
     Settings::values.bg_red   = qt_config->value("bg_red",   1.0).toFloat();
     Settings::values.bg_green = qt_config->value("bg_green", 1.0).toFloat();
@@ -52,6 +90,8 @@ void Config::ReadValues() {
 
     qt_config->beginGroup("Data Storage");
     Settings::values.use_virtual_sd = qt_config->value("use_virtual_sd", true).toBool();
+    Settings::values.romfs_cache_size = qt_config->value("romfs_cache_size", 16).toInt();
+    Settings::values.buffer_file_writes = qt_config->value("buffer_file_writes", false).toBool();
     qt_config->endGroup();
 
     qt_config->beginGroup("System Region");
@@ -69,14 +109,52 @@ void Config::SaveValues() {
         qt_config->setValue(QString::fromStdString(Settings::NativeInput::Mapping[i]),
             Settings::values.input_mappings[Settings::NativeInput::All[i]]);
     }
+    qt_config->setValue("input_polling_rate", Settings::values.input_polling_rate);
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
     qt_config->setValue("frame_skip", Settings::values.frame_skip);
+    qt_config->setValue("use_frame_limit", Settings::values.use_frame_limit);
+    qt_config->setValue("use_idle_sleep", Settings::values.use_idle_sleep);
+    qt_config->setValue("use_dynamic_frame_skip", Settings::values.use_dynamic_frame_skip);
+    qt_config->setValue("run_ahead_frames", Settings::values.run_ahead_frames);
+    qt_config->setValue("use_async_y2r", Settings::values.use_async_y2r);
+    qt_config->setValue("use_async_fs", Settings::values.use_async_fs);
+    qt_config->setValue("use_deterministic_timeslices", Settings::values.use_deterministic_timeslices);
+    qt_config->setValue("max_slice_length", Settings::values.max_slice_length);
+    qt_config->setValue("memory_access_cost", Settings::values.memory_access_cost);
+    qt_config->setValue("multiply_cost", Settings::values.multiply_cost);
+    qt_config->setValue("vfp_cost", Settings::values.vfp_cost);
+    qt_config->setValue("branch_cost", Settings::values.branch_cost);
+    qt_config->setValue("use_speculative_translation", Settings::values.use_speculative_translation);
+    qt_config->setValue("use_disk_translation_cache", Settings::values.use_disk_translation_cache);
+    qt_config->setValue("worker_threads", Settings::values.worker_threads);
+    qt_config->setValue("worker_affinity_mask", Settings::values.worker_affinity_mask);
+    qt_config->setValue("use_auto_thread_affinity", Settings::values.use_auto_thread_affinity);
+    qt_config->setValue("emu_thread_affinity_mask", Settings::values.emu_thread_affinity_mask);
+    qt_config->setValue("gpu_thread_affinity_mask", Settings::values.gpu_thread_affinity_mask);
+    qt_config->setValue("present_thread_affinity_mask", Settings::values.present_thread_affinity_mask);
+    qt_config->setValue("emu_thread_priority", Settings::values.emu_thread_priority);
+    qt_config->setValue("gpu_thread_priority", Settings::values.gpu_thread_priority);
+    qt_config->setValue("present_thread_priority", Settings::values.present_thread_priority);
+    qt_config->setValue("worker_thread_priority", Settings::values.worker_thread_priority);
     qt_config->endGroup();
 
     qt_config->beginGroup("Renderer");
     qt_config->setValue("use_hw_renderer", Settings::values.use_hw_renderer);
+    qt_config->setValue("use_hw_vertex_shader", Settings::values.use_hw_vertex_shader);
+    qt_config->setValue("use_gpu_thread", Settings::values.use_gpu_thread);
+    qt_config->setValue("use_present_thread", Settings::values.use_present_thread);
+    qt_config->setValue("use_command_list_cache", Settings::values.use_command_list_cache);
+    qt_config->setValue("resolution_factor", Settings::values.resolution_factor);
+    qt_config->setValue("rasterizer_threads", Settings::values.rasterizer_threads);
+    qt_config->setValue("texture_cache_size", Settings::values.texture_cache_size);
+    qt_config->setValue("use_compressed_textures", Settings::values.use_compressed_textures);
+    qt_config->setValue("texture_pack_path", QString::fromStdString(Settings::values.texture_pack_path));
+    qt_config->setValue("profile_gpu", Settings::values.profile_gpu);
+    qt_config->setValue("show_perf_overlay", Settings::values.show_perf_overlay);
+    qt_config->setValue("frame_capture_path", QString::fromStdString(Settings::values.frame_capture_path));
+    qt_config->setValue("frame_capture_format", Settings::values.frame_capture_format);
 
     // Cast to double because Qt's written float values are not human-readable
     qt_config->setValue("bg_red",   (double)Settings::values.bg_red);
@@ -86,6 +164,8 @@ void Config::SaveValues() {
 
     qt_config->beginGroup("Data Storage");
     qt_config->setValue("use_virtual_sd", Settings::values.use_virtual_sd);
+    qt_config->setValue("romfs_cache_size", Settings::values.romfs_cache_size);
+    qt_config->setValue("buffer_file_writes", Settings::values.buffer_file_writes);
     qt_config->endGroup();
 
     qt_config->beginGroup("System Region");
@@ -64,7 +64,8 @@ void CallstackWidget::OnDebugModeEntered()
             callstack_model->setItem(counter, 1, new QStandardItem(QString("0x%1").arg(ret_addr, 8, 16, QLatin1Char('0'))));
             callstack_model->setItem(counter, 2, new QStandardItem(QString("0x%1").arg(call_addr, 8, 16, QLatin1Char('0'))));
 
-            name = Symbols::HasSymbol(func_addr) ? Symbols::GetSymbol(func_addr).name : "unknown";
+            const TSymbol* symbol = Symbols::Lookup(func_addr);
+            name = symbol != nullptr ? symbol->name : "unknown";
             callstack_model->setItem(counter, 3, new QStandardItem(QString("%1_%2").arg(QString::fromStdString(name))
                 .arg(QString("0x%1").arg(func_addr, 8, 16, QLatin1Char('0')))));
 
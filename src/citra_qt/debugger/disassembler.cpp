@@ -35,13 +35,16 @@ QVariant DisassemblerModel::data(const QModelIndex& index, int role) const {
         case Qt::DisplayRole:
         {
             u32 address = base_address + index.row() * 4;
-            u32 instr = Memory::Read32(address);
-            std::string disassembly = ARM_Disasm::Disassemble(address, instr);
+            u32 instr = (static_cast<size_t>(index.row()) < code_snapshot.size()) ? code_snapshot[index.row()] : 0;
 
             if (index.column() == 0) {
                 return QString("0x%1").arg((uint)(address), 8, 16, QLatin1Char('0'));
             } else if (index.column() == 1) {
-                return QString::fromStdString(disassembly);
+                // Only rows which are shown get here, each of them is disassembled once
+                auto it = disassembly_cache.find(address);
+                if (it == disassembly_cache.end())
+                    it = disassembly_cache.emplace(address, QString::fromStdString(ARM_Disasm::Disassemble(address, instr))).first;
+                return it->second;
             } else if (index.column() == 2) {
                 if(Symbols::HasSymbol(address)) {
                     TSymbol symbol = Symbols::GetSymbol(address);
@@ -126,9 +129,37 @@ void DisassemblerModel::ParseFromAddress(unsigned int address) {
         endInsertRows();
     }
 
+    UpdateSnapshot();
     SetNextInstruction(address);
 }
 
+void DisassemblerModel::UpdateSnapshot() {
+    std::vector<u32> new_snapshot(code_size);
+    Memory::ReadBlock(base_address, new_snapshot.data(), new_snapshot.size() * sizeof(u32));
+
+    // Drop the cached disassembly of the instructions which changed. The cache is indexed by
+    // address rather than by row, so that it stays valid when rows get inserted at the top.
+    int first_changed = -1;
+    int last_changed = -1;
+    for (unsigned int row = 0; row < code_size; ++row) {
+        const u32 address = base_address + row * 4;
+        const u32 old_row = (address - snapshot_base_address) / 4;
+        if (address >= snapshot_base_address && old_row < code_snapshot.size() && code_snapshot[old_row] == new_snapshot[row])
+            continue;
+
+        disassembly_cache.erase(address);
+        if (first_changed == -1)
+            first_changed = row;
+        last_changed = row;
+    }
+
+    code_snapshot = std::move(new_snapshot);
+    snapshot_base_address = base_address;
+
+    if (first_changed != -1)
+        emit dataChanged(index(first_changed, 0), index(last_changed, 2));
+}
+
 void DisassemblerModel::OnSelectionChanged(const QModelIndex& new_selection) {
     selection = new_selection;
 }
@@ -223,6 +254,8 @@ void DisassemblerWidget::OnDebugModeEntered() {
     if (model->GetBreakPoints().IsAddressBreakPoint(next_instr))
         emu_thread->SetRunning(false);
 
+    // The emulation thread is blocked until this returns, so memory can be read safely
+    model->UpdateSnapshot();
     model->SetNextInstruction(next_instr);
 
     QModelIndex model_index = model->IndexFromAbsoluteAddress(next_instr);
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include <QAbstractListModel>
 #include <QDockWidget>
 
@@ -29,6 +32,13 @@ public:
     QModelIndex IndexFromAbsoluteAddress(unsigned int address) const;
     const BreakPoints& GetBreakPoints() const;
 
+    /**
+     * Copies the disassembled memory range, which is only read from the copy afterwards: the view
+     * may be repainted at any time, also while the emulated CPU is running and modifying memory.
+     * @note Only call this while the emulation is paused
+     */
+    void UpdateSnapshot();
+
 public slots:
     void ParseFromAddress(unsigned int address);
     void OnSelectionChanged(const QModelIndex&);
@@ -40,6 +50,13 @@ private:
     unsigned int code_size;
     unsigned int program_counter;
 
+    /// Instructions of the disassembled range, as of the last UpdateSnapshot
+    std::vector<u32> code_snapshot;
+    unsigned int snapshot_base_address = 0;
+
+    /// Disassembly of the rows shown so far, by address
+    mutable std::unordered_map<u32, QString> disassembly_cache;
+
     QModelIndex selection;
 
     // TODO: Make BreakPoints less crappy (i.e. const-correct) so that this needn't be mutable.
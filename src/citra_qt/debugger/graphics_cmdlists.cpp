@@ -2,6 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
 #include <QApplication>
 #include <QClipboard>
 #include <QLabel>
@@ -190,7 +192,7 @@ QVariant GPUCommandListModel::data(const QModelIndex& index, int role) const {
         QString content;
         switch ( index.column() ) {
         case 0:
-            return QString::fromLatin1(Pica::Regs::GetCommandName(cmd.cmd_id).c_str());
+            return GetCommandName(cmd.cmd_id);
         case 1:
             return QString("%1").arg(cmd.cmd_id, 3, 16, QLatin1Char('0'));
         case 2:
@@ -223,11 +225,51 @@ QVariant GPUCommandListModel::headerData(int section, Qt::Orientation orientatio
     return QVariant();
 }
 
+const QString& GPUCommandListModel::GetCommandName(u32 cmd_id) const {
+    auto it = command_names.find(cmd_id);
+    if (it == command_names.end())
+        it = command_names.emplace(cmd_id, QString::fromStdString(Pica::Regs::GetCommandName(cmd_id))).first;
+    return it->second;
+}
+
+int GPUCommandListModel::FindNextDraw(int row) const {
+    auto it = std::upper_bound(draw_rows.begin(), draw_rows.end(), row);
+    return (it != draw_rows.end()) ? *it : -1;
+}
+
+QString GPUCommandListModel::ToText() const {
+    // Roughly the length of a line, to avoid reallocating the string all the time
+    const int line_length = 48;
+
+    QString text;
+    text.reserve(static_cast<int>(pica_trace.writes.size()) * line_length);
+
+    for (const auto& write : pica_trace.writes) {
+        const Pica::CommandProcessor::CommandHeader cmd{write.Id()};
+
+        text += GetCommandName(cmd.cmd_id);
+        text += '\t';
+        text += QString("%1").arg(cmd.cmd_id, 3, 16, QLatin1Char('0'));
+        text += '\t';
+        text += QString("%1").arg(write.Value(), 8, 16, QLatin1Char('0'));
+        text += "\t\n";
+    }
+
+    return text;
+}
+
 void GPUCommandListModel::OnPicaTraceFinished(const Pica::DebugUtils::PicaTrace& trace) {
     beginResetModel();
 
     pica_trace = trace;
 
+    draw_rows.clear();
+    for (size_t row = 0; row < pica_trace.writes.size(); ++row) {
+        const Pica::CommandProcessor::CommandHeader cmd{pica_trace.writes[row].Id()};
+        if (cmd.cmd_id == PICA_REG_INDEX(trigger_draw) || cmd.cmd_id == PICA_REG_INDEX(trigger_draw_indexed))
+            draw_rows.push_back(static_cast<int>(row));
+    }
+
     endResetModel();
 }
 
@@ -317,12 +359,14 @@ GPUCommandListWidget::GPUCommandListWidget(QWidget* parent) : QDockWidget(tr("Pi
 
     toggle_tracing = new QPushButton(tr("Start Tracing"));
     QPushButton* copy_all = new QPushButton(tr("Copy All"));
+    QPushButton* next_draw = new QPushButton(tr("Next Draw"));
 
     connect(toggle_tracing, SIGNAL(clicked()), this, SLOT(OnToggleTracing()));
     connect(this, SIGNAL(TracingFinished(const Pica::DebugUtils::PicaTrace&)),
             model, SLOT(OnPicaTraceFinished(const Pica::DebugUtils::PicaTrace&)));
 
     connect(copy_all, SIGNAL(clicked()), this, SLOT(CopyAllToClipboard()));
+    connect(next_draw, SIGNAL(clicked()), this, SLOT(OnNextDraw()));
 
     command_info_widget = new QWidget;
 
@@ -332,6 +376,7 @@ GPUCommandListWidget::GPUCommandListWidget(QWidget* parent) : QDockWidget(tr("Pi
         QHBoxLayout* sub_layout = new QHBoxLayout;
         sub_layout->addWidget(toggle_tracing);
         sub_layout->addWidget(copy_all);
+        sub_layout->addWidget(next_draw);
         main_layout->addLayout(sub_layout);
     }
     main_layout->addWidget(command_info_widget);
@@ -352,19 +397,21 @@ void GPUCommandListWidget::OnToggleTracing() {
 }
 
 void GPUCommandListWidget::CopyAllToClipboard() {
-    QClipboard* clipboard = QApplication::clipboard();
-    QString text;
+    // Formatted straight from the trace, going through the model's QVariants for every cell took
+    // ages for large traces
+    auto model = static_cast<GPUCommandListModel*>(list_widget->model());
+    QApplication::clipboard()->setText(model->ToText());
+}
 
-    QAbstractItemModel* model = static_cast<QAbstractListModel*>(list_widget->model());
+void GPUCommandListWidget::OnNextDraw() {
+    auto model = static_cast<GPUCommandListModel*>(list_widget->model());
 
-    for (int row = 0; row < model->rowCount({}); ++row) {
-        for (int col = 0; col < model->columnCount({}); ++col) {
-            QModelIndex index = model->index(row, col);
-            text += model->data(index).value<QString>();
-            text += '\t';
-        }
-        text += '\n';
-    }
+    const QModelIndex current = list_widget->selectionModel()->currentIndex();
+    const int row = model->FindNextDraw(current.isValid() ? current.row() : -1);
+    if (row == -1)
+        return;
 
-    clipboard->setText(text);
+    const QModelIndex index = model->index(row, 0);
+    list_widget->scrollTo(index);
+    list_widget->selectionModel()->setCurrentIndex(index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
 }
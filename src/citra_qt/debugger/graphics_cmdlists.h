@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <unordered_map>
+#include <vector>
+
 #include <QAbstractListModel>
 #include <QDockWidget>
 
@@ -29,11 +32,25 @@ public:
     QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
+    /// Returns the row of the first draw call after the given row, or -1 if there is none
+    int FindNextDraw(int row) const;
+
+    /// Formats all writes of the trace as tab-separated text, one write per line
+    QString ToText() const;
+
 public slots:
     void OnPicaTraceFinished(const Pica::DebugUtils::PicaTrace& trace);
 
 private:
+    /// Returns the name of the given register, which are looked up once per register
+    const QString& GetCommandName(u32 cmd_id) const;
+
     Pica::DebugUtils::PicaTrace pica_trace;
+
+    /// Rows of the writes which trigger a draw call, in ascending order
+    std::vector<int> draw_rows;
+
+    mutable std::unordered_map<u32, QString> command_names;
 };
 
 class GPUCommandListWidget : public QDockWidget
@@ -50,6 +67,7 @@ public slots:
     void SetCommandInfo(const QModelIndex&);
 
     void CopyAllToClipboard();
+    void OnNextDraw();
 
 signals:
     void TracingFinished(const Pica::DebugUtils::PicaTrace&);
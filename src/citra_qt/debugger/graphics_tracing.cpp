@@ -5,6 +5,7 @@
 #include <memory>
 
 #include <QBoxLayout>
+#include <QCheckBox>
 #include <QComboBox>
 #include <QFileDialog>
 #include <QLabel>
@@ -43,6 +44,15 @@ GraphicsTracingWidget::GraphicsTracingWidget(std::shared_ptr<Pica::DebugContext>
     stop_recording->setVisible(false);
     abort_recording->setVisible(false);
 
+    compress_memory = new QCheckBox(tr("Compress memory data"));
+    compress_memory->setToolTip(tr("Makes recordings much smaller, at the cost of some recording speed"));
+#ifdef HAVE_ZSTD
+    compress_memory->setChecked(true);
+    connect(this, SIGNAL(SetStartTracingButtonEnabled(bool)), compress_memory, SLOT(setEnabled(bool)));
+#else
+    compress_memory->setEnabled(false);
+#endif
+
     auto main_widget = new QWidget;
     auto main_layout = new QVBoxLayout;
     {
@@ -52,6 +62,7 @@ GraphicsTracingWidget::GraphicsTracingWidget(std::shared_ptr<Pica::DebugContext>
         sub_layout->addWidget(abort_recording);
         main_layout->addLayout(sub_layout);
     }
+    main_layout->addWidget(compress_memory);
     main_widget->setLayout(main_layout);
     setWidget(main_widget);
 }
@@ -78,6 +89,11 @@ void GraphicsTracingWidget::StartRecording() {
         for (unsigned comp = 0; comp < 3; ++comp)
             vs_float_uniforms[4 * i + comp] = nihstro::to_float24(Pica::g_state.vs.uniforms.f[i][comp].ToFloat32());
 
+    std::array<uint32_t, 4 * 96> gs_float_uniforms;
+    for (unsigned i = 0; i < 96; ++i)
+        for (unsigned comp = 0; comp < 3; ++comp)
+            gs_float_uniforms[4 * i + comp] = nihstro::to_float24(Pica::g_state.gs.uniforms.f[i][comp].ToFloat32());
+
     CiTrace::Recorder::InitialState state;
     std::copy_n((u32*)&GPU::g_regs, sizeof(GPU::g_regs) / sizeof(u32), std::back_inserter(state.gpu_registers));
     std::copy_n((u32*)&LCD::g_regs, sizeof(LCD::g_regs) / sizeof(u32), std::back_inserter(state.lcd_registers));
@@ -86,11 +102,11 @@ void GraphicsTracingWidget::StartRecording() {
     boost::copy(shader_binary, std::back_inserter(state.vs_program_binary));
     boost::copy(swizzle_data, std::back_inserter(state.vs_swizzle_data));
     boost::copy(vs_float_uniforms, std::back_inserter(state.vs_float_uniforms));
-    //boost::copy(TODO: Not implemented, std::back_inserter(state.gs_program_binary));
-    //boost::copy(TODO: Not implemented, std::back_inserter(state.gs_swizzle_data));
-    //boost::copy(TODO: Not implemented, std::back_inserter(state.gs_float_uniforms));
+    boost::copy(Pica::g_state.gs.program_code, std::back_inserter(state.gs_program_binary));
+    boost::copy(Pica::g_state.gs.swizzle_data, std::back_inserter(state.gs_swizzle_data));
+    boost::copy(gs_float_uniforms, std::back_inserter(state.gs_float_uniforms));
 
-    auto recorder = new CiTrace::Recorder(state);
+    auto recorder = new CiTrace::Recorder(state, compress_memory->isChecked());
     context->recorder = std::shared_ptr<CiTrace::Recorder>(recorder);
 
     emit SetStartTracingButtonEnabled(false);
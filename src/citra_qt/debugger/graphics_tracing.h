@@ -7,6 +7,7 @@
 #include "graphics_breakpoint_observer.h"
 
 class EmuThread;
+class QCheckBox;
 
 class GraphicsTracingWidget : public BreakPointObserverDock {
     Q_OBJECT
@@ -29,4 +30,7 @@ signals:
     void SetStartTracingButtonEnabled(bool enable);
     void SetStopTracingButtonEnabled(bool enable);
     void SetAbortTracingButtonEnabled(bool enable);
+
+private:
+    QCheckBox* compress_memory;
 };
@@ -0,0 +1,145 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QPushButton>
+#include <QTreeView>
+
+#include "hle_calls.h"
+
+using namespace Common::Profiling;
+
+HLECallsModel::HLECallsModel(QObject* parent) : QAbstractItemModel(parent)
+{
+}
+
+QVariant HLECallsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Service");
+        case 1: return tr("Function");
+        case 2: return tr("ID");
+        case 3: return tr("Calls");
+        case 4: return tr("Total (ms)");
+        case 5: return tr("Average (us)");
+        case 6: return tr("Calls/frame");
+        case 7: return tr("Max calls/frame");
+        }
+    }
+
+    return QVariant();
+}
+
+QModelIndex HLECallsModel::index(int row, int column, const QModelIndex& parent) const
+{
+    return createIndex(row, column);
+}
+
+QModelIndex HLECallsModel::parent(const QModelIndex& child) const
+{
+    return QModelIndex();
+}
+
+int HLECallsModel::columnCount(const QModelIndex& parent) const
+{
+    return 8;
+}
+
+int HLECallsModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    } else {
+        return static_cast<int>(calls.size());
+    }
+}
+
+QVariant HLECallsModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)calls.size())
+        return QVariant();
+
+    const HLECallEntry& call = calls[index.row()];
+    const double time_us = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(call.time).count();
+    switch (index.column()) {
+    case 0: return QString::fromStdString(call.group);
+    case 1: return QString::fromLatin1(call.function);
+    case 2: return QString("0x%1").arg(call.id, 8, 16, QLatin1Char('0'));
+    case 3: return QString::number(call.calls);
+    case 4: return QString::number(time_us / 1000.0, 'f', 3);
+    case 5: return QString::number(call.calls == 0 ? 0.0 : time_us / call.calls, 'f', 2);
+    case 6: return QString::number(call.average_calls_per_frame, 'f', 1);
+    case 7: return QString::number(call.max_calls_per_frame);
+    default: return QVariant();
+    }
+}
+
+void HLECallsModel::updateCalls()
+{
+    beginResetModel();
+    calls = GetHLECallProfiler().GetCalls();
+    endResetModel();
+}
+
+HLECallsWidget::HLECallsWidget(QWidget* parent) : QDockWidget(tr("HLE Calls"), parent)
+{
+    setObjectName("HLECalls");
+
+    QCheckBox* record_calls = new QCheckBox(tr("Record HLE calls"));
+    record_calls->setChecked(GetHLECallProfiler().IsEnabled());
+    QPushButton* clear_calls = new QPushButton(tr("Clear"));
+
+    model = new HLECallsModel(this);
+    QTreeView* call_view = new QTreeView;
+    call_view->setModel(model);
+    call_view->setAlternatingRowColors(true);
+    call_view->setRootIsDecorated(false);
+    call_view->setItemsExpandable(false);
+
+    connect(this, SIGNAL(visibilityChanged(bool)), SLOT(setUpdateEnabled(bool)));
+    connect(record_calls, SIGNAL(toggled(bool)), SLOT(setRecordingEnabled(bool)));
+    connect(clear_calls, SIGNAL(clicked()), SLOT(clearCalls()));
+    connect(&update_timer, SIGNAL(timeout()), model, SLOT(updateCalls()));
+
+    auto main_widget = new QWidget;
+    auto main_layout = new QVBoxLayout;
+    {
+        auto sub_layout = new QHBoxLayout;
+        sub_layout->addWidget(record_calls);
+        sub_layout->addStretch();
+        sub_layout->addWidget(clear_calls);
+        main_layout->addLayout(sub_layout);
+    }
+    main_layout->addWidget(call_view);
+    main_widget->setLayout(main_layout);
+    setWidget(main_widget);
+}
+
+void HLECallsWidget::setUpdateEnabled(bool enable)
+{
+    if (enable) {
+        update_timer.start(500);
+        model->updateCalls();
+    } else {
+        update_timer.stop();
+    }
+}
+
+void HLECallsWidget::setRecordingEnabled(bool enable)
+{
+    // Start every recording session from a clean slate
+    if (enable)
+        GetHLECallProfiler().Clear();
+    GetHLECallProfiler().SetEnabled(enable);
+}
+
+void HLECallsWidget::clearCalls()
+{
+    GetHLECallProfiler().Clear();
+    model->updateCalls();
+}
@@ -0,0 +1,53 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include <QAbstractItemModel>
+#include <QDockWidget>
+#include <QTimer>
+
+#include "common/profiler_reporting.h"
+
+class HLECallsModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    HLECallsModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateCalls();
+
+private:
+    std::vector<Common::Profiling::HLECallEntry> calls;
+};
+
+/// Lists the HLE service commands and SVCs called by the emulated application
+class HLECallsWidget : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    HLECallsWidget(QWidget* parent = 0);
+
+private slots:
+    void setUpdateEnabled(bool enable);
+    void setRecordingEnabled(bool enable);
+    void clearCalls();
+
+private:
+    HLECallsModel* model;
+
+    QTimer update_timer;
+};
@@ -2,9 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <QFileDialog>
+#include <QMessageBox>
+
 #include "profiler.h"
 
 #include "common/profiler_reporting.h"
+#include "common/symbols.h"
 
 using namespace Common::Profiling;
 
@@ -96,7 +100,17 @@ QVariant ProfilerModel::data(const QModelIndex& index, int role) const
         } else {
             if (index.column() == 0) {
                 const TimingCategoryInfo* info = GetCategoryInfo(index.row() - 2);
-                return info != nullptr ? QString(info->name) : QVariant();
+                if (info == nullptr)
+                    return QVariant();
+
+                // Indent child categories below their parents
+                QString name(info->name);
+                for (unsigned int parent = info->parent; parent != TimingCategoryInfo::NO_PARENT;) {
+                    name.prepend("    ");
+                    const TimingCategoryInfo* parent_info = GetCategoryInfo(parent);
+                    parent = parent_info != nullptr ? parent_info->parent : TimingCategoryInfo::NO_PARENT;
+                }
+                return name;
             } else {
                 if (index.row() - 2 < (int)results.time_per_category.size()) {
                     return GetDataForColumn(index.column(), results.time_per_category[index.row() - 2]);
@@ -112,8 +126,93 @@ QVariant ProfilerModel::data(const QModelIndex& index, int role) const
 
 void ProfilerModel::updateProfilingInfo()
 {
-    results = GetTimingResultsAggregator()->GetAggregatedResults();
-    emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 3));
+    auto new_results = GetTimingResultsAggregator()->GetAggregatedResults();
+    if (new_results.time_per_category.size() != results.time_per_category.size()) {
+        // Categories registered on first use add rows
+        beginResetModel();
+        results = std::move(new_results);
+        endResetModel();
+    } else {
+        results = std::move(new_results);
+        emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 3));
+    }
+}
+
+/// Number of blocks listed in the hot block report
+static const size_t NUM_HOT_BLOCKS = 50;
+
+HotBlocksModel::HotBlocksModel(QObject* parent) : QAbstractItemModel(parent)
+{
+}
+
+QVariant HotBlocksModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Address");
+        case 1: return tr("Symbol");
+        case 2: return tr("Executions");
+        case 3: return tr("Instructions");
+        case 4: return tr("Share");
+        }
+    }
+
+    return QVariant();
+}
+
+QModelIndex HotBlocksModel::index(int row, int column, const QModelIndex& parent) const
+{
+    return createIndex(row, column);
+}
+
+QModelIndex HotBlocksModel::parent(const QModelIndex& child) const
+{
+    return QModelIndex();
+}
+
+int HotBlocksModel::columnCount(const QModelIndex& parent) const
+{
+    return 5;
+}
+
+int HotBlocksModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    } else {
+        return static_cast<int>(blocks.size());
+    }
+}
+
+QVariant HotBlocksModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)blocks.size())
+        return QVariant();
+
+    const BlockProfileEntry& block = blocks[index.row()];
+    switch (index.column()) {
+    case 0: return QString("0x%1").arg(block.address, 8, 16, QLatin1Char('0'));
+    case 1: {
+        // Blocks mostly start inside functions rather than at their entry points
+        const TSymbol* symbol = Symbols::Lookup(block.address);
+        return symbol != nullptr ? QString::fromStdString(symbol->name) : QString();
+    }
+    case 2: return QString::number(block.executions);
+    case 3: return QString::number(block.instructions);
+    case 4:
+        if (total_instructions == 0)
+            return QVariant();
+        return QString("%1 %").arg(100.0 * block.instructions / total_instructions, 0, 'f', 2);
+    default: return QVariant();
+    }
+}
+
+void HotBlocksModel::updateProfilingInfo()
+{
+    beginResetModel();
+    blocks = GetBlockProfiler().GetHottestBlocks(NUM_HOT_BLOCKS);
+    total_instructions = GetBlockProfiler().GetTotalInstructions();
+    endResetModel();
 }
 
 ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
@@ -123,8 +222,19 @@ ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
     model = new ProfilerModel(this);
     ui.treeView->setModel(model);
 
+    blocks_model = new HotBlocksModel(this);
+    ui.blockView->setModel(blocks_model);
+    ui.profileBlocksCheckBox->setChecked(GetBlockProfiler().IsEnabled());
+    ui.profileSlicesCheckBox->setChecked(GetSliceProfiler().IsEnabled());
+    ui.recordTraceButton->setChecked(GetTraceRecorder().IsRecording());
+
     connect(this, SIGNAL(visibilityChanged(bool)), SLOT(setProfilingInfoUpdateEnabled(bool)));
+    connect(ui.profileBlocksCheckBox, SIGNAL(toggled(bool)), SLOT(setBlockProfilingEnabled(bool)));
+    connect(ui.profileSlicesCheckBox, SIGNAL(toggled(bool)), SLOT(setSliceProfilingEnabled(bool)));
+    connect(ui.recordTraceButton, SIGNAL(toggled(bool)), SLOT(setTraceRecordingEnabled(bool)));
     connect(&update_timer, SIGNAL(timeout()), model, SLOT(updateProfilingInfo()));
+    connect(&update_timer, SIGNAL(timeout()), blocks_model, SLOT(updateProfilingInfo()));
+    connect(&update_timer, SIGNAL(timeout()), SLOT(updateSliceStatistics()));
 }
 
 void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
@@ -132,7 +242,68 @@ void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
     if (enable) {
         update_timer.start(100);
         model->updateProfilingInfo();
+        blocks_model->updateProfilingInfo();
+        updateSliceStatistics();
     } else {
         update_timer.stop();
     }
 }
+
+void ProfilerWidget::setBlockProfilingEnabled(bool enable)
+{
+    // Start every profiling session from a clean slate
+    if (enable)
+        GetBlockProfiler().Clear();
+    GetBlockProfiler().SetEnabled(enable);
+}
+
+void ProfilerWidget::setSliceProfilingEnabled(bool enable)
+{
+    if (enable)
+        GetSliceProfiler().Clear();
+    GetSliceProfiler().SetEnabled(enable);
+}
+
+void ProfilerWidget::setTraceRecordingEnabled(bool enable)
+{
+    TraceRecorder& recorder = GetTraceRecorder();
+    if (enable) {
+        recorder.Start();
+        ui.recordTraceButton->setText(tr("Stop recording and save trace..."));
+        return;
+    }
+
+    recorder.Stop();
+    ui.recordTraceButton->setText(tr("Record trace"));
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save trace"), "citra_trace.json",
+                                                    tr("Chrome trace (*.json)"));
+    if (filename.isEmpty())
+        return;
+
+    if (!recorder.ExportChromeTrace(filename.toStdString())) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to write the trace to %1.").arg(filename));
+    } else if (recorder.GetDroppedEvents() != 0) {
+        QMessageBox::warning(this, tr("Trace incomplete"),
+                             tr("%1 events did not fit into the trace buffers and were dropped.")
+                                     .arg(recorder.GetDroppedEvents()));
+    }
+}
+
+void ProfilerWidget::updateSliceStatistics()
+{
+    const SliceStatistics stats = GetSliceProfiler().GetStatistics();
+    if (stats.slices == 0) {
+        ui.sliceStatisticsLabel->clear();
+        return;
+    }
+
+    ui.sliceStatisticsLabel->setText(tr("%1 slices, %2 cycles on average (min %3, max %4)\n"
+                                        "%5 events per slice, %6 % of cycles idled")
+            .arg(stats.slices)
+            .arg(stats.cycles / stats.slices)
+            .arg(stats.min_cycles)
+            .arg(stats.max_cycles)
+            .arg((double)stats.events_fired / stats.slices, 0, 'f', 2)
+            .arg(stats.cycles == 0 ? 0.0 : 100.0 * stats.idle_cycles / stats.cycles, 0, 'f', 1));
+}
@@ -32,6 +32,28 @@ private:
     Common::Profiling::AggregatedFrameResult results;
 };
 
+class HotBlocksModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    HotBlocksModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateProfilingInfo();
+
+private:
+    std::vector<Common::Profiling::BlockProfileEntry> blocks;
+    u64 total_instructions = 0;
+};
+
 class ProfilerWidget : public QDockWidget
 {
     Q_OBJECT
@@ -41,10 +63,15 @@ public:
 
 private slots:
     void setProfilingInfoUpdateEnabled(bool enable);
+    void setBlockProfilingEnabled(bool enable);
+    void setSliceProfilingEnabled(bool enable);
+    void setTraceRecordingEnabled(bool enable);
+    void updateSliceStatistics();
 
 private:
     Ui::Profiler ui;
     ProfilerModel* model;
+    HotBlocksModel* blocks_model;
 
     QTimer update_timer;
 };
@@ -0,0 +1,174 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <QImage>
+#include <QPixmap>
+#include <QStandardItemModel>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+#include "common/common_paths.h"
+#include "common/file_util.h"
+#include "common/make_unique.h"
+
+#include "core/loader/title_index.h"
+
+#include "video_core/utils.h"
+
+#include "game_list.h"
+
+/// Item data role holding the path of the file of a title
+static const int PATH_ROLE = Qt::UserRole + 1;
+
+/// Size of the large icon in the SMDH of titles
+static const int ICON_SIZE = 48;
+
+/// Converts a title's icon from the tiled RGB565 format of the SMDH to a pixmap
+static QPixmap GetIcon(const std::vector<u8>& icon)
+{
+    if (icon.size() != ICON_SIZE * ICON_SIZE * 2)
+        return QPixmap();
+
+    QImage image(ICON_SIZE, ICON_SIZE, QImage::Format_RGB16);
+    for (int y = 0; y < ICON_SIZE; ++y) {
+        for (int x = 0; x < ICON_SIZE; ++x) {
+            u32 coarse_y = y & ~7;
+            u32 offset = VideoCore::GetMortonOffset(x, y, 2) + coarse_y * ICON_SIZE * 2;
+            const u8* pixel = &icon[offset];
+            reinterpret_cast<u16*>(image.scanLine(y))[x] = pixel[0] | (pixel[1] << 8);
+        }
+    }
+    return QPixmap::fromImage(image);
+}
+
+GameList::GameList(QWidget* parent) : QWidget(parent)
+{
+    title_index = Common::make_unique<Loader::TitleIndex>(
+            FileUtil::GetUserPath(D_CACHE_IDX) + "title_index.bin");
+
+    QVBoxLayout* layout = new QVBoxLayout;
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    tree_view = new QTreeView;
+    item_model = new QStandardItemModel(tree_view);
+    tree_view->setModel(item_model);
+
+    tree_view->setAlternatingRowColors(true);
+    tree_view->setSelectionMode(QAbstractItemView::SingleSelection);
+    tree_view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tree_view->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    tree_view->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    tree_view->setSortingEnabled(true);
+    tree_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    tree_view->setUniformRowHeights(true);
+    tree_view->setRootIsDecorated(false);
+    tree_view->setIconSize(QSize(ICON_SIZE, ICON_SIZE));
+
+    item_model->setHorizontalHeaderLabels(QStringList() << tr("Name") << tr("Program ID")
+                                                        << tr("File type") << tr("Size") << tr("Path"));
+
+    connect(tree_view, SIGNAL(activated(const QModelIndex&)), this, SLOT(ValidateEntry(const QModelIndex&)));
+
+    layout->addWidget(tree_view);
+    setLayout(layout);
+}
+
+GameList::~GameList()
+{
+    // Stops the scanner before any of its queued callbacks could reach a destroyed widget
+    title_index.reset();
+}
+
+void GameList::AppendRow(const Loader::TitleInfo& info)
+{
+    QString path = QString::fromStdString(info.path);
+
+    QStandardItem* name = new QStandardItem(GetIcon(info.icon), QString::fromStdString(info.title));
+    name->setData(path, PATH_ROLE);
+
+    QString program_id = info.program_id != 0
+            ? QString("%1").arg(info.program_id, 16, 16, QLatin1Char('0')).toUpper() : QString();
+
+    QStandardItem* size = new QStandardItem(QString("%1 MiB").arg(info.file_size / (1024.0 * 1024.0), 0, 'f', 1));
+
+    item_model->appendRow(QList<QStandardItem*>()
+            << name
+            << new QStandardItem(program_id)
+            << new QStandardItem(Loader::GetFileTypeString(info.type))
+            << size
+            << new QStandardItem(path));
+
+    listed_paths.insert(path);
+}
+
+void GameList::PopulateAsync(const QString& dir_path, bool deep_scan)
+{
+    item_model->removeRows(0, item_model->rowCount());
+    listed_paths.clear();
+    scanned_paths.clear();
+
+    // Results of a previous scan which are still queued are dropped
+    ++scan_generation;
+
+    std::string directory = dir_path.toStdString();
+    std::string prefix = directory + DIR_SEP;
+
+    // List what's already indexed right away, the scan only adds and removes changed titles
+    for (const auto& info : title_index->GetTitles()) {
+        if (info.path.compare(0, prefix.size(), prefix) != 0)
+            continue;
+        if (!deep_scan && info.path.find(DIR_SEP_CHR, prefix.size()) != std::string::npos)
+            continue;
+        AppendRow(info);
+    }
+
+    // The callbacks run on the scanner thread, so they are forwarded to the GUI thread
+    int generation = scan_generation;
+    title_index->StartScan(directory, deep_scan,
+        [this, generation](const std::string& path) {
+            QMetaObject::invokeMethod(this, "AddEntry", Qt::QueuedConnection,
+                                      Q_ARG(QString, QString::fromStdString(path)), Q_ARG(int, generation));
+        },
+        [this, generation]() {
+            QMetaObject::invokeMethod(this, "OnScanFinished", Qt::QueuedConnection, Q_ARG(int, generation));
+        });
+}
+
+void GameList::AddEntry(QString path, int generation)
+{
+    if (generation != scan_generation)
+        return;
+
+    scanned_paths.insert(path);
+    if (listed_paths.contains(path))
+        return;
+
+    // The title was just indexed by the scanner, so this doesn't parse the file again
+    Loader::TitleInfo info;
+    if (title_index->Lookup(path.toStdString(), info))
+        AppendRow(info);
+}
+
+void GameList::OnScanFinished(int generation)
+{
+    if (generation != scan_generation)
+        return;
+
+    for (int row = item_model->rowCount() - 1; row >= 0; --row) {
+        QString path = item_model->item(row, 0)->data(PATH_ROLE).toString();
+        if (!scanned_paths.contains(path)) {
+            item_model->removeRow(row);
+            listed_paths.remove(path);
+        }
+    }
+}
+
+void GameList::ValidateEntry(const QModelIndex& item)
+{
+    QString path = item_model->item(item.row(), 0)->data(PATH_ROLE).toString();
+    if (path.isEmpty())
+        return;
+
+    emit GameChosen(path);
+}
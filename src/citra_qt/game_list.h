@@ -0,0 +1,65 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+
+#include <QSet>
+#include <QString>
+#include <QWidget>
+
+class QModelIndex;
+class QStandardItemModel;
+class QTreeView;
+
+namespace Loader {
+class TitleIndex;
+struct TitleInfo;
+}
+
+/**
+ * Lists the titles found in a directory. The list is filled from the title index right away and
+ * then updated by a background scan of the directory, so only new or changed files are parsed.
+ */
+class GameList : public QWidget
+{
+    Q_OBJECT
+
+public:
+    GameList(QWidget* parent = nullptr);
+    ~GameList();
+
+    /**
+     * Shows the indexed titles in the given directory and starts a scan for changes in it
+     * @param dir_path Directory to list the titles of
+     * @param deep_scan Whether to include titles in subdirectories
+     */
+    void PopulateAsync(const QString& dir_path, bool deep_scan);
+
+signals:
+    /// Emitted when the user activates a title in the list
+    void GameChosen(QString game_path);
+
+private slots:
+    /// Adds a title found by the scanner to the list, unless it is listed already
+    void AddEntry(QString path, int generation);
+    /// Removes the titles which the scan didn't find anymore
+    void OnScanFinished(int generation);
+    void ValidateEntry(const QModelIndex& item);
+
+private:
+    void AppendRow(const Loader::TitleInfo& info);
+
+    QTreeView* tree_view;
+    QStandardItemModel* item_model;
+
+    std::unique_ptr<Loader::TitleIndex> title_index;
+
+    /// Paths of the listed titles, and of the ones reported by the current scan
+    QSet<QString> listed_paths;
+    QSet<QString> scanned_paths;
+    /// Incremented by each PopulateAsync call, to tell the results of the current scan apart
+    int scan_generation = 0;
+};
@@ -21,6 +21,7 @@
 #include "common/scope_exit.h"
 
 #include "bootmanager.h"
+#include "game_list.h"
 #include "hotkeys.h"
 
 //debugger
@@ -34,11 +35,13 @@
 #include "debugger/graphics_framebuffer.h"
 #include "debugger/graphics_tracing.h"
 #include "debugger/graphics_vertex_shader.h"
+#include "debugger/hle_calls.h"
 #include "debugger/profiler.h"
 
 #include "core/settings.h"
 #include "core/system.h"
 #include "core/core.h"
+#include "core/title_profile.h"
 #include "core/loader/loader.h"
 #include "core/arm/disassembler/load_symbol_map.h"
 #include "citra_qt/config.h"
@@ -56,6 +59,9 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     ui.setupUi(this);
     statusBar()->hide();
 
+    game_list = new GameList();
+    ui.horizontalLayout->addWidget(game_list);
+
     render_window = new GRenderWindow(this, emu_thread.get());
     render_window->hide();
 
@@ -63,6 +69,10 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     addDockWidget(Qt::BottomDockWidgetArea, profilerWidget);
     profilerWidget->hide();
 
+    auto hleCallsWidget = new HLECallsWidget(this);
+    addDockWidget(Qt::BottomDockWidgetArea, hleCallsWidget);
+    hleCallsWidget->hide();
+
     disasmWidget = new DisassemblerWidget(this, emu_thread.get());
     addDockWidget(Qt::BottomDockWidgetArea, disasmWidget);
     disasmWidget->hide();
@@ -101,6 +111,7 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
 
     QMenu* debug_menu = ui.menu_View->addMenu(tr("Debugging"));
     debug_menu->addAction(profilerWidget->toggleViewAction());
+    debug_menu->addAction(hleCallsWidget->toggleViewAction());
     debug_menu->addAction(disasmWidget->toggleViewAction());
     debug_menu->addAction(registersWidget->toggleViewAction());
     debug_menu->addAction(callstackWidget->toggleViewAction());
@@ -138,9 +149,15 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     ui.actionDisplay_widget_title_bars->setChecked(settings.value("displayTitleBars", true).toBool());
     OnDisplayTitleBars(ui.actionDisplay_widget_title_bars->isChecked());
 
+    QString game_list_root = settings.value("gameListRootDir").toString();
+    if (!game_list_root.isEmpty())
+        game_list->PopulateAsync(game_list_root, settings.value("gameListDeepScan", false).toBool());
+
     // Setup connections
     connect(ui.action_Load_File, SIGNAL(triggered()), this, SLOT(OnMenuLoadFile()));
     connect(ui.action_Load_Symbol_Map, SIGNAL(triggered()), this, SLOT(OnMenuLoadSymbolMap()));
+    connect(ui.action_Select_Game_List_Root, SIGNAL(triggered()), this, SLOT(OnMenuSelectGameListRoot()));
+    connect(game_list, SIGNAL(GameChosen(QString)), this, SLOT(OnGameListLoadFile(QString)));
     connect(ui.action_Start, SIGNAL(triggered()), this, SLOT(OnStartGame()));
     connect(ui.action_Pause, SIGNAL(triggered()), this, SLOT(OnPauseGame()));
     connect(ui.action_Stop, SIGNAL(triggered()), this, SLOT(OnStopGame()));
@@ -210,6 +227,9 @@ void GMainWindow::OnDisplayTitleBars(bool show)
 void GMainWindow::BootGame(const std::string& filename) {
     LOG_INFO(Frontend, "Citra starting...\n");
 
+    // Titles may override the settings, which the subsystems read while they initialize
+    TitleProfile::ApplyForFile(filename);
+
     // Initialize the core emulation
     System::Init(render_window);
 
@@ -237,6 +257,7 @@ void GMainWindow::BootGame(const std::string& filename) {
     // Update the GUI
     registersWidget->OnDebugModeEntered();
     callstackWidget->OnDebugModeEntered();
+    game_list->hide();
     render_window->show();
 
     OnStartGame();
@@ -267,6 +288,7 @@ void GMainWindow::ShutdownGame() {
     ui.action_Pause->setEnabled(false);
     ui.action_Stop->setEnabled(false);
     render_window->hide();
+    game_list->show();
 }
 
 void GMainWindow::OnMenuLoadFile()
@@ -281,6 +303,27 @@ void GMainWindow::OnMenuLoadFile()
     }
 }
 
+void GMainWindow::OnGameListLoadFile(QString game_path)
+{
+    // Shutdown previous session if the emu thread is still active...
+    if (emu_thread != nullptr)
+        ShutdownGame();
+
+    BootGame(game_path.toLatin1().data());
+}
+
+void GMainWindow::OnMenuSelectGameListRoot()
+{
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "Citra team", "Citra");
+
+    QString dir_path = QFileDialog::getExistingDirectory(this, tr("Select Game Directory"),
+                                                         settings.value("gameListRootDir").toString());
+    if (dir_path.size()) {
+        settings.setValue("gameListRootDir", dir_path);
+        game_list->PopulateAsync(dir_path, settings.value("gameListDeepScan", false).toBool());
+    }
+}
+
 void GMainWindow::OnMenuLoadSymbolMap() {
     QString filename = QFileDialog::getOpenFileName(this, tr("Load Symbol Map"), QString(), tr("Symbol map (*)"));
     if (filename.size())
@@ -326,7 +369,7 @@ void GMainWindow::ToggleWindowMode() {
         // Render in the main window...
         render_window->BackupGeometry();
         ui.horizontalLayout->addWidget(render_window);
-        render_window->setVisible(true);
+        render_window->setVisible(emu_thread != nullptr);
         render_window->setFocusPolicy(Qt::ClickFocus);
         render_window->setFocus();
 
@@ -334,7 +377,7 @@ void GMainWindow::ToggleWindowMode() {
         // Render in a separate window...
         ui.horizontalLayout->removeWidget(render_window);
         render_window->setParent(nullptr);
-        render_window->setVisible(true);
+        render_window->setVisible(emu_thread != nullptr);
         render_window->RestoreGeometry();
         render_window->setFocusPolicy(Qt::NoFocus);
     }
@@ -11,6 +11,7 @@
 #include "ui_main.h"
 
 class GImageInfo;
+class GameList;
 class GRenderWindow;
 class EmuThread;
 class ProfilerWidget;
@@ -66,6 +67,9 @@ private slots:
     void OnStopGame();
     void OnMenuLoadFile();
     void OnMenuLoadSymbolMap();
+    void OnMenuSelectGameListRoot();
+    /// Called when a title is activated in the game list
+    void OnGameListLoadFile(QString game_path);
     void OnOpenHotkeysDialog();
     void OnConfigure();
     void OnDisplayTitleBars(bool);
@@ -76,6 +80,7 @@ private:
     Ui::MainWindow ui;
 
     GRenderWindow* render_window;
+    GameList* game_list;
 
     std::unique_ptr<EmuThread> emu_thread;
 
@@ -11,9 +11,7 @@
 
 bool BreakPoints::IsAddressBreakPoint(u32 iAddress) const
 {
-    auto cond = [&iAddress](const TBreakPoint& bp) { return bp.iAddress == iAddress; };
-    auto it   = std::find_if(m_BreakPoints.begin(), m_BreakPoints.end(), cond);
-    return it != m_BreakPoints.end();
+    return m_Addresses.count(iAddress) != 0;
 }
 
 bool BreakPoints::IsTempBreakPoint(u32 iAddress) const
@@ -58,6 +56,7 @@ void BreakPoints::Add(const TBreakPoint& bp)
     if (!IsAddressBreakPoint(bp.iAddress))
     {
         m_BreakPoints.push_back(bp);
+        m_Addresses.insert(bp.iAddress);
         //if (jit)
         //    jit->GetBlockCache()->InvalidateICache(bp.iAddress, 4);
     }
@@ -73,6 +72,7 @@ void BreakPoints::Add(u32 em_address, bool temp)
         pt.iAddress = em_address;
 
         m_BreakPoints.push_back(pt);
+        m_Addresses.insert(em_address);
 
         //if (jit)
         //    jit->GetBlockCache()->InvalidateICache(em_address, 4);
@@ -84,7 +84,10 @@ void BreakPoints::Remove(u32 em_address)
     auto cond = [&em_address](const TBreakPoint& bp) { return bp.iAddress == em_address; };
     auto it   = std::find_if(m_BreakPoints.begin(), m_BreakPoints.end(), cond);
     if (it != m_BreakPoints.end())
+    {
         m_BreakPoints.erase(it);
+        m_Addresses.erase(em_address);
+    }
 }
 
 void BreakPoints::Clear()
@@ -100,6 +103,7 @@ void BreakPoints::Clear()
     //}
 
     m_BreakPoints.clear();
+    m_Addresses.clear();
 }
 
 MemChecks::TMemChecksStr MemChecks::GetStrings() const
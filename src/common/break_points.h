@@ -6,6 +6,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_set>
 
 #include "common/common_types.h"
 
@@ -71,6 +72,8 @@ public:
 
 private:
     TBreakPoints m_BreakPoints;
+    // Addresses of m_BreakPoints, to look them up without scanning the list
+    std::unordered_set<u32> m_Addresses;
     u32          m_iBreakOnCount;
 };
 
@@ -4,11 +4,13 @@
 
 #pragma once
 
+#include <memory>
 #include <tuple>
 #include <utility>
 
 #include "common/common_types.h"
 #include "common/math_util.h"
+#include "common/seqlock.h"
 
 #include "core/hle/service/hid/hid.h"
 
@@ -74,6 +76,27 @@ public:
     /// Releases (dunno if this is the "right" word) the GLFW context from the caller thread
     virtual void DoneCurrent() = 0;
 
+    /// Graphics context sharing objects with the window's context, without a surface of its own
+    class SharedContext {
+    public:
+        virtual ~SharedContext() {}
+
+        /// Makes the context current for the caller thread
+        virtual void MakeCurrent() = 0;
+
+        /// Releases the context from the caller thread
+        virtual void DoneCurrent() = 0;
+    };
+
+    /**
+     * Creates a context sharing objects with the window's context, so that rendering can happen
+     * on one thread while another one presents to the window.
+     * @return The new context, or nullptr if the frontend doesn't support shared contexts
+     */
+    virtual std::unique_ptr<SharedContext> CreateSharedContext() {
+        return nullptr;
+    }
+
     virtual void ReloadSetKeymaps() = 0;
 
     /// Signals a key press action to the HID module
@@ -99,25 +122,41 @@ public:
      */
     void TouchMoved(unsigned framebuffer_x, unsigned framebuffer_y);
 
+    /// State of the emulated buttons and touch screen, as set by the frontend
+    struct InputState {
+        Service::HID::PadState pad_state;
+        u16 touch_x;        ///< Touchpad X-position in native 3DS pixel coordinates (0-320)
+        u16 touch_y;        ///< Touchpad Y-position in native 3DS pixel coordinates (0-240)
+        u32 touch_pressed;  ///< Nonzero if touchpad area is currently pressed
+    };
+
+    /**
+     * Gets a consistent snapshot of the current input state.
+     * @note This is thread-safe: it's called by the core emu thread to get a state set by the
+     *       window thread, and never waits for it.
+     */
+    InputState GetInputState() const {
+        return published_input.Read();
+    }
+
     /**
      * Gets the current pad state (which buttons are pressed and the circle pad direction).
-     * @note This should be called by the core emu thread to get a state set by the window thread.
-     * @todo Fix this function to be thread-safe.
+     * @note This is thread-safe, see GetInputState
      * @return PadState object indicating the current pad state
      */
     const Service::HID::PadState GetPadState() const {
-        return pad_state;
+        return GetInputState().pad_state;
     }
 
     /**
      * Gets the current touch screen state (touch X/Y coordinates and whether or not it is pressed).
-     * @note This should be called by the core emu thread to get a state set by the window thread.
-     * @todo Fix this function to be thread-safe.
+     * @note This is thread-safe, see GetInputState
      * @return std::tuple of (x, y, pressed) where `x` and `y` are the touch coordinates and
      *         `pressed` is true if the touch screen is currently being pressed
      */
     const std::tuple<u16, u16, bool> GetTouchState() const {
-        return std::make_tuple(touch_x, touch_y, touch_pressed);
+        InputState state = GetInputState();
+        return std::make_tuple(state.touch_x, state.touch_y, state.touch_pressed != 0);
     }
 
     /**
@@ -149,10 +188,11 @@ protected:
         // TODO: Find a better place to set this.
         config.min_client_area_size = std::make_pair(400u, 480u);
         active_config = config;
-        pad_state.hex = 0;
-        touch_x = 0;
-        touch_y = 0;
-        touch_pressed = false;
+        input.pad_state.hex = 0;
+        input.touch_x = 0;
+        input.touch_y = 0;
+        input.touch_pressed = 0;
+        published_input.Write(input);
     }
     virtual ~EmuWindow() {}
 
@@ -207,15 +247,11 @@ private:
     WindowConfig config;         ///< Internal configuration (changes pending for being applied in ProcessConfigurationChanges)
     WindowConfig active_config;  ///< Internal active configuration
 
-    bool touch_pressed;          ///< True if touchpad area is currently pressed, otherwise false
-
-    u16 touch_x;    ///< Touchpad X-position in native 3DS pixel coordinates (0-320)
-    u16 touch_y;    ///< Touchpad Y-position in native 3DS pixel coordinates (0-240)
+    InputState input;                           ///< Input state, only accessed by the window thread
+    Common::SeqLock<InputState> published_input; ///< Copy of `input` which other threads read
 
    /**
     * Clip the provided coordinates to be inside the touchscreen area.
     */
     std::tuple<unsigned,unsigned> ClipToTouchScreen(unsigned new_x, unsigned new_y);
-
-    Service::HID::PadState pad_state;
 };
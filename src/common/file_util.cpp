@@ -35,8 +35,10 @@
     #include <cstdlib>
     #include <cstring>
     #include <dirent.h>
+    #include <fcntl.h>
     #include <pwd.h>
     #include <unistd.h>
+    #include <sys/mman.h>
 #endif
 
 #if defined(__APPLE__)
@@ -46,6 +48,7 @@
 #endif
 
 #include <algorithm>
+#include <cstdint>
 #include <sys/stat.h>
 
 #ifndef S_ISDIR
@@ -264,6 +267,24 @@ bool Rename(const std::string &srcFilename, const std::string &destFilename)
     return false;
 }
 
+bool Replace(const std::string &srcFilename, const std::string &destFilename)
+{
+    LOG_TRACE(Common_Filesystem, "%s --> %s",
+            srcFilename.c_str(), destFilename.c_str());
+#ifdef _WIN32
+    if (MoveFileExW(Common::UTF8ToUTF16W(srcFilename).c_str(), Common::UTF8ToUTF16W(destFilename).c_str(),
+                    MOVEFILE_REPLACE_EXISTING))
+        return true;
+#else
+    // rename() replaces the destination atomically on POSIX systems
+    if (rename(srcFilename.c_str(), destFilename.c_str()) == 0)
+        return true;
+#endif
+    LOG_ERROR(Common_Filesystem, "failed %s --> %s: %s",
+              srcFilename.c_str(), destFilename.c_str(), GetLastErrorMsg());
+    return false;
+}
+
 // copies file srcFilename to destFilename, returns true on success
 bool Copy(const std::string &srcFilename, const std::string &destFilename)
 {
@@ -373,6 +394,21 @@ u64 GetSize(const std::string &filename)
     return 0;
 }
 
+u64 GetModificationTime(const std::string &filename)
+{
+    struct stat64 buf;
+#ifdef _WIN32
+    if (_tstat64(Common::UTF8ToTStr(filename).c_str(), &buf) == 0)
+#else
+    if (stat64(filename.c_str(), &buf) == 0)
+#endif
+        return buf.st_mtime;
+
+    LOG_ERROR(Common_Filesystem, "Stat failed %s: %s",
+            filename.c_str(), GetLastErrorMsg());
+    return 0;
+}
+
 // Overloaded GetSize, accepts file descriptor
 u64 GetSize(const int fd)
 {
@@ -988,6 +1024,77 @@ u64 IOFile::Tell()
         return -1;
 }
 
+size_t IOFile::ReadBytesAt(void* data, size_t length, u64 offset)
+{
+    if (!IsOpen())
+        return 0;
+
+    // Anything still buffered by stdio has to reach the file first
+    std::fflush(m_file);
+
+    u8* out = static_cast<u8*>(data);
+    size_t done = 0;
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_file)));
+    while (done < length) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset + done);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(length - done, 0x80000000));
+        DWORD read = 0;
+        if (!ReadFile(handle, out + done, chunk, &read, &overlapped) || read == 0)
+            break;
+        done += read;
+    }
+#else
+    while (done < length) {
+        ssize_t read = pread(fileno(m_file), out + done, length - done, offset + done);
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read <= 0)
+            break;
+        done += read;
+    }
+#endif
+    return done;
+}
+
+size_t IOFile::WriteBytesAt(const void* data, size_t length, u64 offset)
+{
+    if (!IsOpen())
+        return 0;
+
+    std::fflush(m_file);
+
+    const u8* in = static_cast<const u8*>(data);
+    size_t done = 0;
+#ifdef _WIN32
+    HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_file)));
+    while (done < length) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset + done);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+
+        DWORD chunk = static_cast<DWORD>(std::min<size_t>(length - done, 0x80000000));
+        DWORD written = 0;
+        if (!WriteFile(handle, in + done, chunk, &written, &overlapped) || written == 0)
+            break;
+        done += written;
+    }
+#else
+    while (done < length) {
+        ssize_t written = pwrite(fileno(m_file), in + done, length - done, offset + done);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+        done += written;
+    }
+#endif
+    return done;
+}
+
 bool IOFile::Flush()
 {
     if (!IsOpen() || 0 != std::fflush(m_file))
@@ -1013,4 +1120,164 @@ bool IOFile::Resize(u64 size)
     return m_good;
 }
 
+MappedFile::MappedFile(const std::string& filename, bool copy_on_write)
+    : m_data(nullptr), m_size(0), m_copy_on_write(copy_on_write)
+{
+#ifdef _WIN32
+    m_mapping = nullptr;
+
+    HANDLE file = CreateFileW(Common::UTF8ToUTF16W(filename).c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart != 0 && (u64)size.QuadPart <= SIZE_MAX) {
+        m_mapping = CreateFileMappingW(file, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping != nullptr) {
+            m_data = static_cast<u8*>(MapViewOfFile(m_mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+            if (m_data != nullptr) {
+                m_size = size.QuadPart;
+            } else {
+                CloseHandle(m_mapping);
+                m_mapping = nullptr;
+            }
+        }
+    }
+    // The mapping keeps the file open
+    CloseHandle(file);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+
+    struct stat64 file_info;
+    if (fstat64(fd, &file_info) == 0 && file_info.st_size != 0 && (u64)file_info.st_size <= SIZE_MAX) {
+        void* data = copy_on_write
+            ? mmap(nullptr, (size_t)file_info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+            : mmap(nullptr, (size_t)file_info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            m_data = static_cast<u8*>(data);
+            m_size = file_info.st_size;
+        }
+    }
+    // The mapping keeps the file open
+    close(fd);
+#endif
+
+    if (m_data == nullptr)
+        LOG_WARNING(Common_Filesystem, "Unable to map %s into memory", filename.c_str());
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+#else
+    munmap(m_data, (size_t)m_size);
+#endif
+}
+
+static bool IsDotEntry(const std::string& name)
+{
+    return name == "." || name == "..";
+}
+
+#ifdef _WIN32
+struct DirectoryIterator::FindData
+{
+    WIN32_FIND_DATA ffd;
+};
+
+DirectoryIterator::DirectoryIterator(const std::string& directory)
+    : m_directory(directory), m_find_data(new FindData)
+{
+    m_handle = FindFirstFile(Common::UTF8ToTStr(directory + "\\*").c_str(), &m_find_data->ffd);
+    m_has_pending = m_handle != INVALID_HANDLE_VALUE;
+}
+
+DirectoryIterator::~DirectoryIterator()
+{
+    if (m_handle != INVALID_HANDLE_VALUE)
+        FindClose(m_handle);
+}
+
+bool DirectoryIterator::IsOpen() const
+{
+    return m_handle != INVALID_HANDLE_VALUE;
+}
+
+bool DirectoryIterator::Next(FSTEntry& entry)
+{
+    while (m_has_pending)
+    {
+        const WIN32_FIND_DATA& ffd = m_find_data->ffd;
+        entry.virtualName = Common::TStrToUTF8(ffd.cFileName);
+        entry.isDirectory = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        entry.size = entry.isDirectory ? 0 : ((u64)ffd.nFileSizeHigh << 32) | ffd.nFileSizeLow;
+
+        m_has_pending = FindNextFile(m_handle, &m_find_data->ffd) != 0;
+
+        if (IsDotEntry(entry.virtualName))
+            continue;
+
+        entry.physicalName = m_directory + DIR_SEP + entry.virtualName;
+        entry.children.clear();
+        return true;
+    }
+    return false;
+}
+#else
+DirectoryIterator::DirectoryIterator(const std::string& directory)
+    : m_directory(directory), m_dir(opendir(directory.c_str()))
+{
+}
+
+DirectoryIterator::~DirectoryIterator()
+{
+    if (m_dir != nullptr)
+        closedir(static_cast<DIR*>(m_dir));
+}
+
+bool DirectoryIterator::IsOpen() const
+{
+    return m_dir != nullptr;
+}
+
+bool DirectoryIterator::Next(FSTEntry& entry)
+{
+    if (m_dir == nullptr)
+        return false;
+
+    while (const struct dirent* result = readdir(static_cast<DIR*>(m_dir)))
+    {
+        entry.virtualName = result->d_name;
+        if (IsDotEntry(entry.virtualName))
+            continue;
+
+        entry.physicalName = m_directory + DIR_SEP + entry.virtualName;
+        entry.children.clear();
+
+        struct stat64 file_info;
+        if (stat64(entry.physicalName.c_str(), &file_info) != 0)
+        {
+            LOG_ERROR(Common_Filesystem, "stat failed on %s: %s", entry.physicalName.c_str(), GetLastErrorMsg());
+            entry.isDirectory = false;
+            entry.size = 0;
+        }
+        else
+        {
+            entry.isDirectory = S_ISDIR(file_info.st_mode);
+            entry.size = entry.isDirectory ? 0 : (u64)file_info.st_size;
+        }
+        return true;
+    }
+    return false;
+}
+#endif
+
 } // namespace
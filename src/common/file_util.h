@@ -8,6 +8,7 @@
 #include <fstream>
 #include <cstddef>
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -74,6 +75,9 @@ u64 GetSize(const int fd);
 // Overloaded GetSize, accepts FILE*
 u64 GetSize(FILE *f);
 
+// Returns the last modification time of filename in seconds since the epoch, or 0 on errors
+u64 GetModificationTime(const std::string &filename);
+
 // Returns true if successful, or path already exists.
 bool CreateDir(const std::string &filename);
 
@@ -90,6 +94,10 @@ bool DeleteDir(const std::string &filename);
 // renames file srcFilename to destFilename, returns true on success
 bool Rename(const std::string &srcFilename, const std::string &destFilename);
 
+// renames file srcFilename to destFilename, atomically replacing destFilename if it exists.
+// returns true on success
+bool Replace(const std::string &srcFilename, const std::string &destFilename);
+
 // copies file srcFilename to destFilename, returns true on success
 bool Copy(const std::string &srcFilename, const std::string &destFilename);
 
@@ -210,6 +218,21 @@ public:
         return WriteArray(&object, 1);
     }
 
+    /**
+     * Reads from the given position of the file straight from the OS, bypassing stdio's buffer
+     * and leaving the file position alone. As long as the file is only accessed through these
+     * positional functions, several threads can use them at the same time.
+     * Unlike the other functions, these don't change the m_good flag.
+     * @return Number of bytes read, which is less than length at the end of the file or on errors
+     */
+    size_t ReadBytesAt(void* data, size_t length, u64 offset);
+
+    /**
+     * Writes to the given position of the file straight to the OS. See ReadBytesAt.
+     * @return Number of bytes written, which is less than length on errors
+     */
+    size_t WriteBytesAt(const void* data, size_t length, u64 offset);
+
     bool IsOpen() { return nullptr != m_file; }
 
     // m_good is set to false when a read, write or other function fails
@@ -238,6 +261,73 @@ private:
     IOFile& operator=(IOFile& other);
 };
 
+/**
+ * Read-only view of a whole file mapped into memory. Reads from the mapping are plain memory
+ * accesses served from the page cache, so unlike with an IOFile there is no file position to share
+ * and any number of threads can read concurrently.
+ */
+class MappedFile : public NonCopyable
+{
+public:
+    /**
+     * Maps the given file. Check IsOpen() to find out whether this succeeded.
+     * @param copy_on_write Whether the mapping can be written to. Written pages are copied into
+     *                      private memory, the file itself is never modified.
+     */
+    explicit MappedFile(const std::string& filename, bool copy_on_write = false);
+    ~MappedFile();
+
+    bool IsOpen() const { return m_data != nullptr; }
+
+    const u8* GetData() const { return m_data; }
+    u64 GetSize() const { return m_size; }
+
+    /// Returns the writable view of a copy-on-write mapping, or nullptr for read-only ones
+    u8* GetWritableData() { return m_copy_on_write ? m_data : nullptr; }
+
+private:
+    u8* m_data;
+    u64 m_size;
+    bool m_copy_on_write;
+#ifdef _WIN32
+    void* m_mapping;
+#endif
+};
+
+/**
+ * Enumerates the immediate children of a directory one at a time, for directories which may be
+ * too large to scan all at once with ScanDirectoryTree. Only the entries actually read are
+ * stat'ed, and subdirectories are not entered.
+ */
+class DirectoryIterator : public NonCopyable
+{
+public:
+    /// Opens the given directory. Check IsOpen() to find out whether this succeeded.
+    explicit DirectoryIterator(const std::string& directory);
+    ~DirectoryIterator();
+
+    bool IsOpen() const;
+
+    /**
+     * Reads the next entry of the directory, skipping "." and "..". The size of subdirectories
+     * is reported as 0, and their children are left empty.
+     * @return False once all entries have been read
+     */
+    bool Next(FSTEntry& entry);
+
+private:
+    std::string m_directory;
+#ifdef _WIN32
+    struct FindData;
+    std::unique_ptr<FindData> m_find_data;
+    void* m_handle;
+    /// Whether m_find_data holds an entry which hasn't been returned yet
+    bool m_has_pending;
+#else
+    void* m_dir;
+#endif
+};
+
 }  // namespace
 
 // To deal with Windows being dumb at unicode:
@@ -0,0 +1,51 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/hash.h"
+
+namespace Common {
+
+// This is MurmurHash64A by Austin Appleby, which is in the public domain.
+u64 ComputeHash64(const void* data, size_t len, u64 seed) {
+    const u64 m = 0xC6A4A7935BD1E995ULL;
+    const int r = 47;
+
+    u64 h = seed ^ (len * m);
+
+    const u8* bytes = static_cast<const u8*>(data);
+    const u8* end = bytes + (len & ~size_t(7));
+
+    for (; bytes != end; bytes += 8) {
+        u64 k;
+        std::memcpy(&k, bytes, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= u64(bytes[6]) << 48;
+    case 6: h ^= u64(bytes[5]) << 40;
+    case 5: h ^= u64(bytes[4]) << 32;
+    case 4: h ^= u64(bytes[3]) << 24;
+    case 3: h ^= u64(bytes[2]) << 16;
+    case 2: h ^= u64(bytes[1]) << 8;
+    case 1: h ^= u64(bytes[0]);
+            h *= m;
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+} // namespace
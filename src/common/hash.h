@@ -0,0 +1,22 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Computes a 64-bit hash over the given data. This is not a cryptographic hash; it is meant for
+ * quickly identifying identical blocks of emulated data, e.g. for caching purposes.
+ * @param data Pointer to the data to hash
+ * @param len Length of the data in bytes
+ * @param seed Initial value of the hash, can be used to combine hashes of separate blocks
+ */
+u64 ComputeHash64(const void* data, size_t len, u64 seed = 0);
+
+} // namespace
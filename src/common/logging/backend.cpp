@@ -4,13 +4,20 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "common/common_funcs.h" // snprintf compatibility define
 #include "common/logging/backend.h"
 #include "common/logging/filter.h"
 #include "common/logging/log.h"
 #include "common/logging/text_formatter.h"
+#include "common/thread.h"
 
 namespace Log {
 
@@ -55,6 +62,7 @@ namespace Log {
         CLS(Render) \
         SUB(Render, Software) \
         SUB(Render, OpenGL) \
+        CLS(Audio) \
         CLS(Loader)
 
 // GetClassName is a macro defined by Windows.h, grrr...
@@ -109,8 +117,238 @@ Entry CreateEntry(Class log_class, Level log_level,
 
 static Filter* filter = nullptr;
 
+/// Level table used while no filter is set, which lets everything through
+static const std::array<Level, (size_t)Class::Count> unfiltered_levels = {};
+
+const Level* g_class_min_levels = unfiltered_levels.data();
+
 void SetFilter(Filter* new_filter) {
     filter = new_filter;
+    // Point the fast path straight at the filter's table, so later changes to it apply immediately
+    g_class_min_levels = filter != nullptr ? filter->GetClassLevels() : unfiltered_levels.data();
+}
+
+void ConsoleSink::Write(const Entry& entry) {
+    PrintColoredMessage(entry);
+}
+
+FileSink::FileSink(const std::string& filename) : file(filename, "w") {
+}
+
+void FileSink::Write(const Entry& entry) {
+    if (!file.IsOpen())
+        return;
+
+    std::array<char, 4 * 1024> format_buffer;
+    FormatLogMessage(entry, format_buffer.data(), format_buffer.size() - 1);
+
+    size_t length = strlen(format_buffer.data());
+    format_buffer[length++] = '\n';
+    file.WriteBytes(format_buffer.data(), length);
+
+    // Make sure the log survives a crash
+    if (entry.log_level >= Level::Error)
+        file.Flush();
+}
+
+/**
+ * Bounded multi-producer/single-consumer queue of log entries. Each cell carries a sequence number
+ * which tells producers whether it is free to be written and the consumer whether it has been
+ * fully written, so neither side ever takes a lock.
+ */
+class EntryQueue final {
+public:
+    EntryQueue() : push_position(0), pop_position(0) {
+        for (size_t i = 0; i < QUEUE_SIZE; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /// Queues an entry, returning false if the queue is full. May be called from any thread.
+    bool Push(Entry& entry) {
+        size_t position = push_position.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[position % QUEUE_SIZE];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)position;
+            if (diff == 0) {
+                if (push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = push_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->entry = std::move(entry);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Dequeues the oldest entry, returning false if there is none. Only called by the consumer.
+    bool Pop(Entry& entry) {
+        size_t position = pop_position.load(std::memory_order_relaxed);
+        Cell& cell = cells[position % QUEUE_SIZE];
+        if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+            return false;
+
+        entry = std::move(cell.entry);
+        cell.sequence.store(position + QUEUE_SIZE, std::memory_order_release);
+        pop_position.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Number of entries pushed so far
+    size_t GetPushPosition() const {
+        return push_position.load(std::memory_order_acquire);
+    }
+
+    /// Number of entries popped so far
+    size_t GetPopPosition() const {
+        return pop_position.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t QUEUE_SIZE = 1024;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Entry entry;
+    };
+
+    std::array<Cell, QUEUE_SIZE> cells;
+    std::atomic<size_t> push_position;
+    std::atomic<size_t> pop_position;
+};
+
+/// Owns the log queue, the registered sinks and the thread that writes entries to them.
+class Logger final {
+public:
+    Logger() : running(true), dropped_messages(0), total_dropped_messages(0) {
+        sinks.emplace_back(new ConsoleSink);
+        writer = std::thread([this] { WriterLoop(); });
+    }
+
+    ~Logger() {
+        {
+            std::lock_guard<std::mutex> lock(wakeup_mutex);
+            running = false;
+        }
+        wakeup.notify_one();
+        writer.join();
+    }
+
+    void Push(Entry& entry) {
+        if (!queue.Push(entry)) {
+            dropped_messages.fetch_add(1, std::memory_order_relaxed);
+            total_dropped_messages.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Notifying without holding the mutex may miss a sleeping writer, which is why the
+        // writer also wakes up periodically on its own.
+        wakeup.notify_one();
+    }
+
+    void Flush() {
+        if (std::this_thread::get_id() == writer.get_id())
+            return;
+
+        size_t target = queue.GetPushPosition();
+        wakeup.notify_one();
+
+        std::unique_lock<std::mutex> lock(wakeup_mutex);
+        while ((ptrdiff_t)(queue.GetPopPosition() - target) < 0)
+            drained.wait_for(lock, std::chrono::milliseconds(1));
+    }
+
+    void AddSink(std::unique_ptr<Sink> sink) {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        sinks.push_back(std::move(sink));
+    }
+
+    void RemoveAllSinks() {
+        std::lock_guard<std::mutex> lock(sink_mutex);
+        sinks.clear();
+    }
+
+    u64 GetDroppedMessageCount() const {
+        return total_dropped_messages.load(std::memory_order_relaxed);
+    }
+
+private:
+    void WriteToSinks(const Entry& entry) {
+        for (auto& sink : sinks)
+            sink->Write(entry);
+    }
+
+    void WriterLoop() {
+        Common::SetCurrentThreadName("Logger");
+
+        Entry entry;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex);
+                while (queue.Pop(entry))
+                    WriteToSinks(entry);
+
+                u64 dropped = dropped_messages.exchange(0, std::memory_order_relaxed);
+                if (dropped != 0) {
+                    Entry notice;
+                    notice.timestamp = entry.timestamp;
+                    notice.log_class = Class::Log;
+                    notice.log_level = Level::Warning;
+                    notice.location = "";
+                    notice.message = std::to_string(dropped) + " log messages were dropped because the log queue was full";
+                    WriteToSinks(notice);
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(wakeup_mutex);
+            drained.notify_all();
+            if (!running && queue.GetPopPosition() == queue.GetPushPosition())
+                break;
+            wakeup.wait_for(lock, std::chrono::milliseconds(10));
+        }
+    }
+
+    EntryQueue queue;
+
+    bool running;
+    std::mutex wakeup_mutex;
+    std::condition_variable wakeup;
+    std::condition_variable drained;
+
+    std::atomic<u64> dropped_messages;
+    std::atomic<u64> total_dropped_messages;
+
+    std::mutex sink_mutex; ///< Held by the writer thread while writing to the sinks
+    std::vector<std::unique_ptr<Sink>> sinks;
+
+    std::thread writer;
+};
+
+static Logger& GetLogger() {
+    // Takes advantage of "magic" static initialization for race-free initialization.
+    static Logger logger;
+    return logger;
+}
+
+void AddSink(std::unique_ptr<Sink> sink) {
+    GetLogger().AddSink(std::move(sink));
+}
+
+void RemoveAllSinks() {
+    GetLogger().RemoveAllSinks();
+}
+
+void Flush() {
+    GetLogger().Flush();
+}
+
+u64 GetDroppedMessageCount() {
+    return GetLogger().GetDroppedMessageCount();
 }
 
 void LogMessage(Class log_class, Level log_level,
@@ -125,7 +363,18 @@ void LogMessage(Class log_class, Level log_level,
             filename, line_nr, function, format, args);
     va_end(args);
 
-    PrintColoredMessage(entry);
+    Logger& logger = GetLogger();
+    logger.Push(entry);
+
+    // Critical messages are usually followed by a crash, so make sure they make it out
+    if (log_level == Level::Critical)
+        logger.Flush();
+}
+
+void LogSuppressedRepeats(Class log_class, Level log_level,
+                          const char* filename, unsigned int line_nr, const char* function, u32 count) {
+    LogMessage(log_class, log_level, filename, line_nr, function,
+               "(suppressed %u repeats of the next message)", count);
 }
 
 }
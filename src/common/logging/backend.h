@@ -6,9 +6,11 @@
 
 #include <chrono>
 #include <cstdarg>
+#include <memory>
 #include <string>
 #include <utility>
 
+#include "common/file_util.h"
 #include "common/logging/log.h"
 
 namespace Log {
@@ -36,7 +38,7 @@ struct Entry {
     {}
 #undef MOVE
 
-    Entry& operator=(const Entry&& o) {
+    Entry& operator=(Entry&& o) {
 #define MOVE(member) member = std::move(o.member)
         MOVE(timestamp);
         MOVE(log_class);
@@ -66,4 +68,45 @@ Entry CreateEntry(Class log_class, Level log_level,
 
 void SetFilter(Filter* filter);
 
+/**
+ * Interface for log entry destinations. Log messages are queued by the emulator threads without
+ * blocking and written out to all registered sinks by a background thread, so sinks are only
+ * ever called from that thread.
+ */
+class Sink {
+public:
+    virtual ~Sink() {}
+
+    virtual void Write(const Entry& entry) = 0;
+};
+
+/// Prints log entries to stderr, colored according to their severity.
+class ConsoleSink final : public Sink {
+public:
+    void Write(const Entry& entry) override;
+};
+
+/// Writes log entries as plain text to a file.
+class FileSink final : public Sink {
+public:
+    explicit FileSink(const std::string& filename);
+
+    void Write(const Entry& entry) override;
+
+private:
+    FileUtil::IOFile file;
+};
+
+/// Registers an additional sink. A ConsoleSink is registered by default.
+void AddSink(std::unique_ptr<Sink> sink);
+
+/// Unregisters all sinks, including the default ConsoleSink.
+void RemoveAllSinks();
+
+/// Blocks until all messages logged so far have been written to the sinks.
+void Flush();
+
+/// Returns the number of messages which were dropped because the log queue was full.
+u64 GetDroppedMessageCount();
+
 }
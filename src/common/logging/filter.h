@@ -47,6 +47,11 @@ public:
     /// Matches class/level combination against the filter, returning true if it passed.
     bool CheckMessage(Class log_class, Level level) const;
 
+    /// Returns the minimum level of each class, indexed by class.
+    const Level* GetClassLevels() const {
+        return class_levels.data();
+    }
+
 private:
     std::array<Level, (size_t)Class::Count> class_levels;
 };
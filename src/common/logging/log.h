@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "common/common_types.h"
 
 namespace Log {
@@ -71,11 +73,23 @@ enum class Class : ClassType {
     Render,                     ///< Emulator video output and hardware acceleration
     Render_Software,            ///< Software renderer backend
     Render_OpenGL,              ///< OpenGL backend
+    Audio,                      ///< Emulator audio output
     Loader,                     ///< ROM loader
 
     Count ///< Total number of logging classes
 };
 
+/**
+ * Minimum level of each class, as configured in the active filter. Indexed by class, this lets
+ * log macros reject messages before their arguments are evaluated or formatted.
+ */
+extern const Level* g_class_min_levels;
+
+/// Returns true if a message of the given class and level would pass the active filter.
+inline bool IsEnabled(Class log_class, Level log_level) {
+    return log_level >= g_class_min_levels[static_cast<ClassType>(log_class)];
+}
+
 /// Logs a message to the global logger.
 void LogMessage(Class log_class, Level log_level,
     const char* filename, unsigned int line_nr, const char* function,
@@ -88,20 +102,92 @@ void LogMessage(Class log_class, Level log_level,
 #endif
     ;
 
+/// Number of messages each call site logs before it starts being rate-limited.
+const u32 RATE_LIMIT_BURST = 100;
+/// Once rate-limited, a call site only logs one in this many messages.
+const u32 RATE_LIMIT_PERIOD = 10000;
+
+/// Counts the messages which reached a single log call site, see LOG_GENERIC.
+typedef std::atomic<u32> RateLimiter;
+
+/// Logs a summary of the messages a call site suppressed since it last logged.
+void LogSuppressedRepeats(Class log_class, Level log_level,
+    const char* filename, unsigned int line_nr, const char* function, u32 count);
+
+/**
+ * Counts a message from a call site, returning true if it should be logged. Past the first
+ * RATE_LIMIT_BURST messages, only one in RATE_LIMIT_PERIOD is, preceded by the number of
+ * repeats which were suppressed in between.
+ */
+inline bool CheckRateLimit(RateLimiter& limiter, Class log_class, Level log_level,
+                           const char* filename, unsigned int line_nr, const char* function) {
+    const u32 count = limiter.fetch_add(1, std::memory_order_relaxed);
+    if (count < RATE_LIMIT_BURST)
+        return true;
+
+    const u32 repeat = count - RATE_LIMIT_BURST + 1;
+    if (repeat % RATE_LIMIT_PERIOD != 0)
+        return false;
+
+    LogSuppressedRepeats(log_class, log_level, filename, line_nr, function, RATE_LIMIT_PERIOD - 1);
+    return true;
+}
+
 } // namespace Log
 
+/// Returns a rate limiter which is private to the call site it is expanded at.
+#define LOG_RATE_LIMITER() \
+    ([]() -> ::Log::RateLimiter& { static ::Log::RateLimiter limiter(0); return limiter; }())
+
+// Messages are rate-limited per call site, so that one firing in a hot path can't flood the logs
+// or throttle emulation by formatting millions of them.
 #define LOG_GENERIC(log_class, log_level, ...) \
-    ::Log::LogMessage(::Log::Class::log_class, ::Log::Level::log_level, \
-        __FILE__, __LINE__, __func__, __VA_ARGS__)
+    (::Log::IsEnabled(::Log::Class::log_class, ::Log::Level::log_level) && \
+     ::Log::CheckRateLimit(LOG_RATE_LIMITER(), ::Log::Class::log_class, ::Log::Level::log_level, \
+            __FILE__, __LINE__, __func__) ? \
+        ::Log::LogMessage(::Log::Class::log_class, ::Log::Level::log_level, \
+            __FILE__, __LINE__, __func__, __VA_ARGS__) : \
+        (void(0)))
 
+// Levels below LOG_MIN_LEVEL are compiled out. It can be set through CMake, and otherwise only
+// excludes Trace messages from release builds.
+#ifndef LOG_MIN_LEVEL
 #ifdef _DEBUG
+#define LOG_MIN_LEVEL 0
+#else
+#define LOG_MIN_LEVEL 1
+#endif
+#endif
+
+#if LOG_MIN_LEVEL <= 0
 #define LOG_TRACE(   log_class, ...) LOG_GENERIC(log_class, Trace,    __VA_ARGS__)
 #else
 #define LOG_TRACE(   log_class, ...) (void(0))
 #endif
 
+#if LOG_MIN_LEVEL <= 1
 #define LOG_DEBUG(   log_class, ...) LOG_GENERIC(log_class, Debug,    __VA_ARGS__)
+#else
+#define LOG_DEBUG(   log_class, ...) (void(0))
+#endif
+
+#if LOG_MIN_LEVEL <= 2
 #define LOG_INFO(    log_class, ...) LOG_GENERIC(log_class, Info,     __VA_ARGS__)
+#else
+#define LOG_INFO(    log_class, ...) (void(0))
+#endif
+
+#if LOG_MIN_LEVEL <= 3
 #define LOG_WARNING( log_class, ...) LOG_GENERIC(log_class, Warning,  __VA_ARGS__)
+#else
+#define LOG_WARNING( log_class, ...) (void(0))
+#endif
+
+#if LOG_MIN_LEVEL <= 4
 #define LOG_ERROR(   log_class, ...) LOG_GENERIC(log_class, Error,    __VA_ARGS__)
+#else
+#define LOG_ERROR(   log_class, ...) (void(0))
+#endif
+
+// Critical messages precede crashes and are never compiled out
 #define LOG_CRITICAL(log_class, ...) LOG_GENERIC(log_class, Critical, __VA_ARGS__)
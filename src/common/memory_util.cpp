@@ -103,6 +103,83 @@ void* AllocateMemoryPages(size_t size)
     return ptr;
 }
 
+#ifndef _WIN32
+/// Size of the huge pages requested by AllocateLargeMemoryPages
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t RoundUpToHugePage(size_t size)
+{
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+#endif
+
+// Allocates one contiguous, zero-filled region which is backed by huge pages where the system
+// allows it, to cut down on TLB misses when accessing large emulated memories. Falls back to
+// regular pages, so the result only differs from AllocateMemoryPages in performance.
+void* AllocateLargeMemoryPages(size_t size)
+{
+#ifdef _WIN32
+    // Large pages need the SeLockMemoryPrivilege, which most users don't have
+    const size_t large_page_size = GetLargePageMinimum();
+    if (large_page_size != 0)
+    {
+        const size_t rounded_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+        void* ptr = VirtualAlloc(0, rounded_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (ptr != nullptr)
+        {
+            LOG_INFO(Common_Memory, "Allocated %u KiB of large pages", (unsigned)(rounded_size / 1024));
+            return ptr;
+        }
+    }
+    return AllocateMemoryPages(size);
+#else
+    const size_t rounded_size = RoundUpToHugePage(size);
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages, only available if the administrator reserved a pool of them
+    void* ptr = mmap(0, rounded_size, PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED)
+    {
+        LOG_INFO(Common_Memory, "Allocated %u KiB of huge pages", (unsigned)(rounded_size / 1024));
+        return ptr;
+    }
+#endif
+
+    // Otherwise over-allocate to get a huge page aligned range, so that transparent huge pages
+    // can be used for all of it, and return the unused ends to the system
+    u8* base = static_cast<u8*>(mmap(0, rounded_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+            MAP_ANON | MAP_PRIVATE, -1, 0));
+    if (base == MAP_FAILED)
+    {
+        LOG_ERROR(Common_Memory, "Failed to allocate raw memory");
+        return nullptr;
+    }
+
+    u8* aligned = reinterpret_cast<u8*>(RoundUpToHugePage(reinterpret_cast<uintptr_t>(base)));
+    if (aligned != base)
+        munmap(base, aligned - base);
+    if (aligned + rounded_size != base + rounded_size + HUGE_PAGE_SIZE)
+        munmap(aligned + rounded_size, base + HUGE_PAGE_SIZE - aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, rounded_size, MADV_HUGEPAGE);
+#endif
+
+    return aligned;
+#endif
+}
+
+void FreeLargeMemoryPages(void* ptr, size_t size)
+{
+#ifdef _WIN32
+    FreeMemoryPages(ptr, size);
+#else
+    // Both allocation paths map a whole number of huge pages
+    FreeMemoryPages(ptr, RoundUpToHugePage(size));
+#endif
+}
+
 void* AllocateAlignedMemory(size_t size,size_t alignment)
 {
 #ifdef _WIN32
@@ -0,0 +1,125 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+#include "common/thread.h"
+
+namespace Common {
+
+/**
+ * Allocator for node based containers (std::map, std::list, ...) which keeps freed nodes in a
+ * free list, so that frequently inserting and erasing elements doesn't go through the heap every
+ * time. The free list is shared by all containers with the same node type on a thread. Freed nodes
+ * are never returned to the heap, so it's only meant for containers of bounded size.
+ */
+template <typename T>
+class NodePoolAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef NodePoolAllocator<U> other;
+    };
+
+    NodePoolAllocator() {}
+    template <typename U>
+    NodePoolAllocator(const NodePoolAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        // Only single nodes are pooled, arrays (e.g. hash table buckets) come from the heap
+        if (n != 1)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+
+        FreeNode* node = free_list;
+        if (node == nullptr)
+            return reinterpret_cast<T*>(new FreeNode);
+
+        free_list = node->next;
+        return reinterpret_cast<T*>(node);
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (n != 1) {
+            ::operator delete(p);
+            return;
+        }
+
+        FreeNode* node = reinterpret_cast<FreeNode*>(p);
+        node->next = free_list;
+        free_list = node;
+    }
+
+private:
+    union FreeNode {
+        FreeNode* next;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+    };
+
+    static thread_local FreeNode* free_list;
+};
+
+template <typename T>
+thread_local typename NodePoolAllocator<T>::FreeNode* NodePoolAllocator<T>::free_list = nullptr;
+
+template <typename T, typename U>
+bool operator==(const NodePoolAllocator<T>&, const NodePoolAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const NodePoolAllocator<T>&, const NodePoolAllocator<U>&) { return false; }
+
+/**
+ * Base class giving the objects of a class their own free list, for objects which are created and
+ * destroyed at high rates. Like NodePoolAllocator, the free list is per thread and never shrinks.
+ * Allocations of classes derived from T have a different size and go to the heap as usual.
+ */
+template <typename T>
+class PoolAllocated {
+public:
+    static void* operator new(std::size_t size) {
+        if (size != sizeof(T) || free_list == nullptr)
+            return ::operator new(size);
+
+        FreeBlock* block = free_list;
+        free_list = block->next;
+        return block;
+    }
+
+    static void operator delete(void* p, std::size_t size) {
+        if (p == nullptr)
+            return;
+
+        if (size != sizeof(T)) {
+            ::operator delete(p);
+            return;
+        }
+
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = free_list;
+        free_list = block;
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static thread_local FreeBlock* free_list;
+};
+
+template <typename T>
+thread_local typename PoolAllocated<T>::FreeBlock* PoolAllocated<T>::free_list = nullptr;
+
+} // namespace
@@ -7,8 +7,11 @@
 #include <vector>
 
 #include "common/assert.h"
+#include "common/file_util.h"
 #include "common/profiler.h"
 #include "common/profiler_reporting.h"
+#include "common/string_util.h"
+#include "common/symbols.h"
 #include "common/synchronized_wrapper.h"
 
 #if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013.
@@ -23,6 +26,13 @@ namespace Profiling {
 thread_local Timer* Timer::current_timer = nullptr;
 #endif
 
+std::atomic<bool> tracing_enabled(false);
+thread_local TraceRecorder::ThreadBuffer* TraceRecorder::thread_buffer = nullptr;
+
+void RecordTraceEvent(TraceEventType type, unsigned int category_id) {
+    GetTraceRecorder().RecordEvent(type, category_id);
+}
+
 #if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013
 QPCClock::time_point QPCClock::now() {
     static LARGE_INTEGER freq;
@@ -49,8 +59,21 @@ TimingCategory::TimingCategory(const char* name, TimingCategory* parent)
         manager.SetTimingCategoryParent(category_id, parent->category_id);
 }
 
+MemoryCounter::MemoryCounter(const char* name, Unit unit, MemoryCounter* parent)
+        : value(0) {
+
+    ProfilingManager& manager = GetProfilingManager();
+    counter_id = manager.RegisterMemoryCounter(this, name, unit);
+    if (parent != nullptr)
+        manager.SetMemoryCounterParent(counter_id, parent->counter_id);
+}
+
 ProfilingManager::ProfilingManager()
         : last_frame_end(Clock::now()), this_frame_start(Clock::now()) {
+    // Some categories are only registered on first use, while the debugger may be reading the
+    // list from another thread, so keep registrations from reallocating it in practice.
+    timing_categories.reserve(256);
+    memory_counters.reserve(64);
 }
 
 unsigned int ProfilingManager::RegisterTimingCategory(TimingCategory* category, const char* name) {
@@ -72,6 +95,27 @@ void ProfilingManager::SetTimingCategoryParent(unsigned int category, unsigned i
     timing_categories[category].parent = parent;
 }
 
+unsigned int ProfilingManager::RegisterMemoryCounter(MemoryCounter* counter, const char* name,
+                                                     MemoryCounter::Unit unit) {
+    MemoryCounterInfo info;
+    info.counter = counter;
+    info.name = name;
+    info.unit = unit;
+    info.parent = MemoryCounterInfo::NO_PARENT;
+
+    unsigned int id = (unsigned int)memory_counters.size();
+    memory_counters.push_back(std::move(info));
+
+    return id;
+}
+
+void ProfilingManager::SetMemoryCounterParent(unsigned int counter, unsigned int parent) {
+    ASSERT(counter < memory_counters.size());
+    ASSERT(parent < memory_counters.size());
+
+    memory_counters[counter].parent = parent;
+}
+
 void ProfilingManager::BeginFrame() {
     this_frame_start = Clock::now();
 }
@@ -82,6 +126,9 @@ void ProfilingManager::FinishFrame() {
     results.interframe_time = now - last_frame_end;
     results.frame_time = now - this_frame_start;
 
+    if (tracing_enabled.load(std::memory_order_relaxed))
+        RecordTraceEvent(TraceEventType::FrameEnd, 0);
+
     results.time_per_category.resize(timing_categories.size());
     for (size_t i = 0; i < timing_categories.size(); ++i) {
         results.time_per_category[i] = timing_categories[i].category->GetAccumulatedTime();
@@ -170,6 +217,399 @@ AggregatedFrameResult TimingResultsAggregator::GetAggregatedResults() const {
     return result;
 }
 
+BlockProfiler::BlockProfiler() : enabled(false), total_instructions(0) {
+}
+
+void BlockProfiler::SetEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void BlockProfiler::AddExecution(u32 address, u64 num_instructions) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto itr = blocks.find(address);
+    if (itr == blocks.end()) {
+        BlockProfileEntry entry = { address, 0, 0 };
+        itr = blocks.emplace(address, entry).first;
+    }
+
+    itr->second.executions += 1;
+    itr->second.instructions += num_instructions;
+    total_instructions += num_instructions;
+}
+
+std::vector<BlockProfileEntry> BlockProfiler::GetHottestBlocks(size_t count) const {
+    std::vector<BlockProfileEntry> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.reserve(blocks.size());
+        for (const auto& block : blocks)
+            result.push_back(block.second);
+    }
+
+    auto hotter = [](const BlockProfileEntry& a, const BlockProfileEntry& b) {
+        return a.instructions > b.instructions;
+    };
+
+    if (result.size() > count) {
+        std::partial_sort(result.begin(), result.begin() + count, result.end(), hotter);
+        result.resize(count);
+    } else {
+        std::sort(result.begin(), result.end(), hotter);
+    }
+
+    return result;
+}
+
+u64 BlockProfiler::GetTotalInstructions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_instructions;
+}
+
+void BlockProfiler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    blocks.clear();
+    total_instructions = 0;
+}
+
+SliceProfiler::SliceProfiler() : enabled(false) {
+    Clear();
+}
+
+void SliceProfiler::SetEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void SliceProfiler::AddSlice(u64 cycles, u64 events_fired, u64 idle_cycles) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (statistics.slices == 0) {
+        statistics.min_cycles = statistics.max_cycles = cycles;
+    } else {
+        statistics.min_cycles = std::min(statistics.min_cycles, cycles);
+        statistics.max_cycles = std::max(statistics.max_cycles, cycles);
+    }
+
+    statistics.slices += 1;
+    statistics.cycles += cycles;
+    statistics.events_fired += events_fired;
+    statistics.idle_cycles += idle_cycles;
+}
+
+SliceStatistics SliceProfiler::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void SliceProfiler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    statistics = SliceStatistics();
+}
+
+HLECallProfiler::HLECallProfiler() : enabled(false) {
+    Clear();
+}
+
+void HLECallProfiler::SetEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void HLECallProfiler::AddCall(const std::string& group, const char* function, u32 id, Duration time) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto itr = records.find(std::make_pair(group, id));
+    if (itr == records.end()) {
+        CallRecord record = { function, 0, Duration::zero(), 0, {} };
+        itr = records.emplace(std::make_pair(group, id), record).first;
+    }
+
+    itr->second.calls += 1;
+    itr->second.time += time;
+    itr->second.calls_this_frame += 1;
+}
+
+void HLECallProfiler::FinishFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& record : records) {
+        record.second.calls_per_frame[history_cursor] = record.second.calls_this_frame;
+        record.second.calls_this_frame = 0;
+    }
+
+    history_cursor = (history_cursor + 1) % HISTORY_FRAMES;
+    history_size = std::min(history_size + 1, HISTORY_FRAMES);
+}
+
+std::vector<HLECallEntry> HLECallProfiler::GetCalls() const {
+    std::vector<HLECallEntry> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.reserve(records.size());
+        for (const auto& record : records) {
+            const CallRecord& call = record.second;
+
+            u64 frame_calls = 0;
+            u32 max_frame_calls = 0;
+            for (size_t i = 0; i < history_size; ++i) {
+                frame_calls += call.calls_per_frame[i];
+                max_frame_calls = std::max(max_frame_calls, call.calls_per_frame[i]);
+            }
+
+            HLECallEntry entry;
+            entry.group = record.first.first;
+            entry.function = call.function;
+            entry.id = record.first.second;
+            entry.calls = call.calls;
+            entry.time = call.time;
+            entry.average_calls_per_frame = history_size == 0 ? 0.0 : (double)frame_calls / history_size;
+            entry.max_calls_per_frame = max_frame_calls;
+            result.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [](const HLECallEntry& a, const HLECallEntry& b) {
+        return a.time > b.time;
+    });
+
+    return result;
+}
+
+void HLECallProfiler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    records.clear();
+    history_cursor = 0;
+    history_size = 0;
+}
+
+TraceRecorder::TraceRecorder() : generation(0), dropped_events(0) {
+}
+
+void TraceRecorder::Start() {
+    dropped_events.store(0, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    tracing_enabled.store(true, std::memory_order_relaxed);
+}
+
+void TraceRecorder::Stop() {
+    tracing_enabled.store(false, std::memory_order_relaxed);
+}
+
+TraceRecorder::ThreadBuffer& TraceRecorder::GetThreadBuffer() {
+    if (thread_buffer == nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+        buffer->thread_id = (u32)buffers.size() + 1;
+        buffer->generation.store(0, std::memory_order_relaxed);
+        buffer->size.store(0, std::memory_order_relaxed);
+
+        thread_buffer = buffer.get();
+        buffers.push_back(std::move(buffer));
+    }
+    return *thread_buffer;
+}
+
+void TraceRecorder::SetThreadName(const char* name) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer.name = name;
+}
+
+void TraceRecorder::RecordEvent(TraceEventType type, unsigned int category_id) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+
+    const u32 current_generation = generation.load(std::memory_order_acquire);
+    if (buffer.generation.load(std::memory_order_relaxed) != current_generation) {
+        if (buffer.events == nullptr)
+            buffer.events.reset(new Event[EVENTS_PER_THREAD]);
+        buffer.size.store(0, std::memory_order_relaxed);
+        buffer.generation.store(current_generation, std::memory_order_release);
+    }
+
+    const size_t index = buffer.size.load(std::memory_order_relaxed);
+    if (index >= EVENTS_PER_THREAD) {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& event = buffer.events[index];
+    event.time = Clock::now().time_since_epoch().count();
+    event.category_id = category_id;
+    event.type = type;
+    buffer.size.store(index + 1, std::memory_order_release);
+}
+
+static std::string EscapeJSONString(const std::string& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            result += Common::StringFromFormat("\\u%04x", c);
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+PCSampler::PCSampler() : enabled(false), interval(DEFAULT_INTERVAL), walk_frame_pointers(false),
+        total_samples(0) {
+}
+
+void PCSampler::SetEnabled(bool enable, u32 interval_, bool walk_frame_pointers_) {
+    interval.store(std::max(interval_, 1u), std::memory_order_relaxed);
+    walk_frame_pointers.store(walk_frame_pointers_, std::memory_order_relaxed);
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void PCSampler::AddSample(const u32* frames, size_t num_frames) {
+    std::vector<u32> stack;
+    stack.reserve(num_frames < MAX_DEPTH ? num_frames : MAX_DEPTH);
+    for (size_t i = 0; i < num_frames && stack.size() < MAX_DEPTH; ++i) {
+        const TSymbol* symbol = Symbols::Lookup(frames[i]);
+        const u32 function = (symbol != nullptr ? symbol->address : frames[i]) & ~1u;
+        if (stack.empty() || stack.back() != function)
+            stack.push_back(function);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++stacks[std::move(stack)];
+    ++total_samples;
+}
+
+u64 PCSampler::GetTotalSamples() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_samples;
+}
+
+bool PCSampler::ExportCollapsedStacks(const std::string& filename) const {
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : stacks) {
+            const std::vector<u32>& stack = entry.first;
+            for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+                if (it != stack.rbegin())
+                    text += ';';
+
+                // Semicolons separate the frames, and the last space the count
+                const TSymbol* symbol = Symbols::Lookup(*it);
+                std::string name = symbol != nullptr ? symbol->name : Common::StringFromFormat("0x%08X", *it);
+                std::replace(name.begin(), name.end(), ';', ':');
+                std::replace(name.begin(), name.end(), ' ', '_');
+                text += name;
+            }
+            text += Common::StringFromFormat(" %llu\n", (unsigned long long)entry.second);
+        }
+    }
+
+    FileUtil::IOFile file(filename, "wb");
+    return file.IsOpen() && file.WriteBytes(text.data(), text.size()) == text.size();
+}
+
+void PCSampler::Clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stacks.clear();
+    total_samples = 0;
+}
+
+bool TraceRecorder::ExportChromeTrace(const std::string& filename) const {
+    ASSERT_MSG(!IsRecording(), "Traces can't be exported while recording");
+
+    const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
+    auto GetCategoryName = [&](unsigned int id) -> std::string {
+        return id < categories.size() ? EscapeJSONString(categories[id].name) : "Unknown";
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const u32 current_generation = generation.load(std::memory_order_acquire);
+
+    // Only buffers which recorded something in this trace are exported
+    struct ExportedBuffer {
+        const ThreadBuffer* buffer;
+        size_t size;
+    };
+    std::vector<ExportedBuffer> exported;
+    Clock::rep base_time = 0;
+    for (const auto& buffer : buffers) {
+        if (buffer->generation.load(std::memory_order_acquire) != current_generation)
+            continue;
+        const size_t size = buffer->size.load(std::memory_order_acquire);
+        if (size == 0)
+            continue;
+
+        if (exported.empty() || buffer->events[0].time < base_time)
+            base_time = buffer->events[0].time;
+        exported.push_back({ buffer.get(), size });
+    }
+
+    // Trace timestamps are in microseconds, relative to the first recorded event
+    auto ToTimestamp = [base_time](Clock::rep time) {
+        return std::chrono::duration<double, std::micro>(Duration(time - base_time)).count();
+    };
+
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Citra\"}}";
+
+    for (const ExportedBuffer& entry : exported) {
+        const ThreadBuffer& buffer = *entry.buffer;
+        if (!buffer.name.empty()) {
+            json += Common::StringFromFormat(
+                    ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    buffer.thread_id, EscapeJSONString(buffer.name).c_str());
+        }
+
+        // Timers which were already running when recording started end without having begun,
+        // and ones still running when it stopped never end. Drop the former and close the latter.
+        std::vector<unsigned int> open_scopes;
+        for (size_t i = 0; i < entry.size; ++i) {
+            const Event& event = buffer.events[i];
+            const double ts = ToTimestamp(event.time);
+
+            switch (event.type) {
+            case TraceEventType::Begin:
+                open_scopes.push_back(event.category_id);
+                json += Common::StringFromFormat(
+                        ",\n{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                        GetCategoryName(event.category_id).c_str(), ts, buffer.thread_id);
+                break;
+
+            case TraceEventType::End:
+                if (open_scopes.empty())
+                    break;
+                open_scopes.pop_back();
+                json += Common::StringFromFormat(
+                        ",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                        GetCategoryName(event.category_id).c_str(), ts, buffer.thread_id);
+                break;
+
+            case TraceEventType::FrameEnd:
+                json += Common::StringFromFormat(
+                        ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                        ts, buffer.thread_id);
+                break;
+            }
+        }
+
+        const double last_ts = ToTimestamp(buffer.events[entry.size - 1].time);
+        while (!open_scopes.empty()) {
+            json += Common::StringFromFormat(
+                    ",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                    GetCategoryName(open_scopes.back()).c_str(), last_ts, buffer.thread_id);
+            open_scopes.pop_back();
+        }
+    }
+
+    json += "\n]}\n";
+
+    FileUtil::IOFile file(filename, "wb");
+    return file.IsOpen() && file.WriteBytes(json.data(), json.size()) == json.size();
+}
+
 ProfilingManager& GetProfilingManager() {
     // Takes advantage of "magic" static initialization for race-free initialization.
     static ProfilingManager manager;
@@ -181,5 +621,30 @@ SynchronizedRef<TimingResultsAggregator> GetTimingResultsAggregator() {
     return SynchronizedRef<TimingResultsAggregator>(aggregator);
 }
 
+BlockProfiler& GetBlockProfiler() {
+    static BlockProfiler profiler;
+    return profiler;
+}
+
+SliceProfiler& GetSliceProfiler() {
+    static SliceProfiler profiler;
+    return profiler;
+}
+
+HLECallProfiler& GetHLECallProfiler() {
+    static HLECallProfiler profiler;
+    return profiler;
+}
+
+PCSampler& GetPCSampler() {
+    static PCSampler sampler;
+    return sampler;
+}
+
+TraceRecorder& GetTraceRecorder() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
 } // namespace Profiling
 } // namespace Common
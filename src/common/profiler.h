@@ -8,6 +8,7 @@
 #include <chrono>
 
 #include "common/assert.h"
+#include "common/common_types.h"
 #include "common/thread.h"
 
 namespace Common {
@@ -73,6 +74,62 @@ private:
     std::atomic<Duration::rep> accumulated_duration;
 };
 
+/**
+ * Represents an amount of memory, or a number of objects, held by a subsystem. Should be declared
+ * as a global variable next to the data it accounts for, and updated whenever that changes, so
+ * that the current values can be read at any time. Can be updated and read from any thread.
+ */
+class MemoryCounter final {
+public:
+    enum class Unit {
+        Bytes,
+        Objects,
+    };
+
+    MemoryCounter(const char* name, Unit unit = Unit::Bytes, MemoryCounter* parent = nullptr);
+
+    unsigned int GetCounterId() const {
+        return counter_id;
+    }
+
+    /// Adds a (possibly negative) amount to the counter
+    void Add(s64 amount) {
+        std::atomic_fetch_add_explicit(&value, (u64)amount, std::memory_order_relaxed);
+    }
+
+    void Set(u64 amount) {
+        value.store(amount, std::memory_order_relaxed);
+    }
+
+    /// Raises the counter to the given amount unless it is higher already, for high-water marks
+    void SetMax(u64 amount) {
+        u64 current = value.load(std::memory_order_relaxed);
+        while (current < amount && !value.compare_exchange_weak(current, amount, std::memory_order_relaxed)) {
+        }
+    }
+
+    u64 Get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    unsigned int counter_id;
+    std::atomic<u64> value;
+};
+
+/// Kinds of events recorded into traces. See TraceRecorder in profiler_reporting.h.
+enum class TraceEventType : u8 {
+    Begin,    ///< A Timer on the thread was started
+    End,      ///< A Timer on the thread was stopped
+    FrameEnd, ///< ProfilingManager finished a frame
+};
+
+/// Set while a trace is being recorded. Checked by Timers before they record trace events.
+extern std::atomic<bool> tracing_enabled;
+
+/// Records an event into the calling thread's trace buffer. Implemented by TraceRecorder.
+void RecordTraceEvent(TraceEventType type, unsigned int category_id);
+
 /**
  * Measures time elapsed between a call to Start and a call to Stop and attributes it to the given
  * TimingCategory. Start/Stop can be called multiple times on the same timer, but each call must be
@@ -96,12 +153,18 @@ public:
             previous_timer->StopTiming();
 
         StartTiming();
+
+        if (tracing_enabled.load(std::memory_order_relaxed))
+            RecordTraceEvent(TraceEventType::Begin, category.GetCategoryId());
 #endif
     }
 
     void Stop() {
 #if ENABLE_PROFILING
         ASSERT(running);
+        if (tracing_enabled.load(std::memory_order_relaxed))
+            RecordTraceEvent(TraceEventType::End, category.GetCategoryId());
+
         StopTiming();
 
         if (previous_timer != nullptr)
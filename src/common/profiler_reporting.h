@@ -4,9 +4,18 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "common/common_types.h"
 #include "common/profiler.h"
 #include "common/synchronized_wrapper.h"
 
@@ -21,6 +30,15 @@ struct TimingCategoryInfo {
     unsigned int parent;
 };
 
+struct MemoryCounterInfo {
+    static const unsigned int NO_PARENT = -1;
+
+    MemoryCounter* counter;
+    const char* name;
+    MemoryCounter::Unit unit;
+    unsigned int parent;
+};
+
 struct ProfilingFrameResult {
     /// Time since the last delivered frame
     Duration interframe_time;
@@ -43,6 +61,14 @@ public:
         return timing_categories;
     }
 
+    unsigned int RegisterMemoryCounter(MemoryCounter* counter, const char* name, MemoryCounter::Unit unit);
+    void SetMemoryCounterParent(unsigned int counter, unsigned int parent);
+
+    /// Lists the memory counters. Their current values can be read through the counter pointers.
+    const std::vector<MemoryCounterInfo>& GetMemoryCountersInfo() const {
+        return memory_counters;
+    }
+
     /// This should be called after swapping screen buffers.
     void BeginFrame();
     /// This should be called before swapping screen buffers.
@@ -55,6 +81,7 @@ public:
 
 private:
     std::vector<TimingCategoryInfo> timing_categories;
+    std::vector<MemoryCounterInfo> memory_counters;
     Clock::time_point last_frame_end;
     Clock::time_point this_frame_start;
 
@@ -98,8 +125,304 @@ public:
     std::vector<std::vector<Duration>> times_per_category;
 };
 
+struct BlockProfileEntry {
+    /// Guest address of the first instruction in the block
+    u32 address;
+    /// Number of times the block was entered
+    u64 executions;
+    /// Number of guest instructions executed inside the block, summed over all executions
+    u64 instructions;
+};
+
+/**
+ * Collects execution statistics for guest code blocks, keyed by their start address. While enabled,
+ * the CPU core reports every block it enters, and the frontend can retrieve the hottest blocks as a
+ * sorted report. Disabled by default, since it adds bookkeeping to every block dispatch.
+ */
+class BlockProfiler final {
+public:
+    BlockProfiler();
+
+    void SetEnabled(bool enable);
+
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Accounts one execution of the block at `address`, which ran for `num_instructions`.
+    void AddExecution(u32 address, u64 num_instructions);
+
+    /// Returns up to `count` blocks, sorted by decreasing number of instructions executed in them.
+    std::vector<BlockProfileEntry> GetHottestBlocks(size_t count) const;
+
+    /// Returns the total number of instructions accounted to all blocks.
+    u64 GetTotalInstructions() const;
+
+    void Clear();
+
+private:
+    std::atomic<bool> enabled;
+
+    mutable std::mutex mutex;
+    std::unordered_map<u32, BlockProfileEntry> blocks;
+    u64 total_instructions;
+};
+
+struct SliceStatistics {
+    /// Number of CPU timeslices run
+    u64 slices;
+    /// Emulated cycles run, summed over all slices
+    u64 cycles;
+    /// Shortest and longest slice, in emulated cycles
+    u64 min_cycles, max_cycles;
+    /// Number of CoreTiming events fired at the end of the slices
+    u64 events_fired;
+    /// Emulated cycles skipped by idling, summed over all slices
+    u64 idle_cycles;
+};
+
+/**
+ * Collects statistics about the timeslices CoreTiming runs the CPU for, to help tune the tradeoff
+ * between event latency and scheduling overhead. Disabled by default.
+ */
+class SliceProfiler final {
+public:
+    SliceProfiler();
+
+    void SetEnabled(bool enable);
+
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Accounts one timeslice which ran for `cycles`, of which `idle_cycles` were skipped by idling.
+    void AddSlice(u64 cycles, u64 events_fired, u64 idle_cycles);
+
+    SliceStatistics GetStatistics() const;
+
+    void Clear();
+
+private:
+    std::atomic<bool> enabled;
+
+    mutable std::mutex mutex;
+    SliceStatistics statistics;
+};
+
+struct HLECallEntry {
+    /// Port name of the service the call went to, or "SVC" for supervisor calls
+    std::string group;
+    /// Name of the called function
+    const char* function;
+    /// Command header of a service call, or number of a supervisor call
+    u32 id;
+    /// Number of calls, since recording was enabled
+    u64 calls;
+    /// Host time spent in the calls, including any calls nested in them
+    Duration time;
+    /// Average number of calls per frame over the frame history
+    double average_calls_per_frame;
+    /// Highest number of calls in a single frame of the frame history
+    u32 max_calls_per_frame;
+};
+
+/**
+ * Counts and times HLE service commands and supervisor calls, to find out which ones a title
+ * depends on the most. Next to the totals, the number of calls in each of the last few frames is
+ * kept to show how the calls are distributed over frames. Disabled by default.
+ */
+class HLECallProfiler final {
+public:
+    /// Number of frames the per-frame call counts are kept for
+    static const size_t HISTORY_FRAMES = 60;
+
+    HLECallProfiler();
+
+    void SetEnabled(bool enable);
+
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Accounts one call to `function` (identified by `group` and `id`), which took `time`.
+    void AddCall(const std::string& group, const char* function, u32 id, Duration time);
+
+    /// Closes the per-frame call counts of the current frame.
+    void FinishFrame();
+
+    /// Returns all recorded calls, sorted by decreasing time spent in them.
+    std::vector<HLECallEntry> GetCalls() const;
+
+    void Clear();
+
+private:
+    struct CallRecord {
+        const char* function;
+        u64 calls;
+        Duration time;
+        u32 calls_this_frame;
+        std::array<u32, HISTORY_FRAMES> calls_per_frame;
+    };
+
+    std::atomic<bool> enabled;
+
+    mutable std::mutex mutex;
+    std::map<std::pair<std::string, u32>, CallRecord> records;
+    /// Slot of calls_per_frame the next finished frame is stored in
+    size_t history_cursor;
+    /// Number of valid slots of calls_per_frame
+    size_t history_size;
+};
+
+/**
+ * Statistical profiler for emulated code. While it's enabled, a CoreTiming event samples the PC,
+ * the link register and optionally the chain of frame pointers every few emulated cycles. Unlike
+ * the block profiler, this needs no instrumentation in the CPU core. Samples are aggregated by the
+ * stack of functions they were taken in, as resolved through the symbol table, and can be exported
+ * for flamegraph tools. Disabled by default.
+ */
+class PCSampler final {
+public:
+    /// Default number of emulated cycles between samples, about 10000 samples per emulated second
+    static const u32 DEFAULT_INTERVAL = 26812;
+    /// Deepest stack recorded in a sample, including the PC
+    static const size_t MAX_DEPTH = 32;
+
+    PCSampler();
+
+    /**
+     * @param interval Emulated cycles between samples
+     * @param walk_frame_pointers Whether to follow the chain of frame pointers past the link
+     *                            register, which only works for code compiled with frame pointers
+     */
+    void SetEnabled(bool enable, u32 interval = DEFAULT_INTERVAL, bool walk_frame_pointers = false);
+
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    u32 GetInterval() const {
+        return interval.load(std::memory_order_relaxed);
+    }
+
+    bool ShouldWalkFramePointers() const {
+        return walk_frame_pointers.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Accounts one sample. Each address is resolved to the function containing it, and a function
+     * appearing several times in a row is only counted once, as the PC and the link register are
+     * often in the same function.
+     * @param frames Code addresses of the sample, from the PC outwards
+     */
+    void AddSample(const u32* frames, size_t num_frames);
+
+    u64 GetTotalSamples() const;
+
+    /**
+     * Writes the samples in the collapsed stack format read by flamegraph.pl and speedscope: one
+     * line per distinct stack, listing its functions from the outermost one in, separated by
+     * semicolons, followed by the number of samples. Addresses without a symbol are written in hex.
+     * Must not be called while symbols are added.
+     * @return Whether the file could be written
+     */
+    bool ExportCollapsedStacks(const std::string& filename) const;
+
+    void Clear();
+
+private:
+    std::atomic<bool> enabled;
+    std::atomic<u32> interval;
+    std::atomic<bool> walk_frame_pointers;
+
+    mutable std::mutex mutex;
+    /// Number of samples per stack of function addresses, from the innermost function out
+    std::map<std::vector<u32>, u64> stacks;
+    u64 total_samples;
+};
+
+/**
+ * Records the start and end of every timed scope along with the thread it ran on, so that the
+ * timeline of each frame can be inspected in a trace viewer, where flat per-category totals hide
+ * stalls and serialization between threads. Each thread writes into its own fixed-size buffer
+ * without taking any locks; events which don't fit into it are dropped. Disabled by default.
+ */
+class TraceRecorder final {
+public:
+    /// Number of events each thread can record in a single trace
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    TraceRecorder();
+
+    /// Discards the previous trace and starts recording a new one.
+    void Start();
+
+    /// Stops recording. The recorded trace is kept until the next call to Start().
+    void Stop();
+
+    bool IsRecording() const {
+        return tracing_enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Sets the name the calling thread is shown with in traces.
+    void SetThreadName(const char* name);
+
+    /// Records an event on the calling thread. Use Timers instead of calling this directly.
+    void RecordEvent(TraceEventType type, unsigned int category_id);
+
+    /// Returns the number of events dropped from the current trace because a buffer was full.
+    u64 GetDroppedEvents() const {
+        return dropped_events.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Writes the recorded trace in the Chrome trace event JSON format, which can be opened with
+     * chrome://tracing or Perfetto. Must not be called while recording.
+     * @return Whether the file could be written
+     */
+    bool ExportChromeTrace(const std::string& filename) const;
+
+private:
+    struct Event {
+        Clock::rep time;
+        unsigned int category_id;
+        TraceEventType type;
+    };
+
+    struct ThreadBuffer {
+        /// Thread id shown in traces
+        u32 thread_id;
+        /// Name shown in traces, protected by the recorder's mutex
+        std::string name;
+        /// Trace the events in the buffer belong to. Outdated buffers are reset by their thread.
+        std::atomic<u32> generation;
+        /// Number of valid events. Only written by the thread the buffer belongs to.
+        std::atomic<size_t> size;
+        /// Storage for EVENTS_PER_THREAD events, allocated on the first recorded event
+        std::unique_ptr<Event[]> events;
+    };
+
+    /// Returns the calling thread's buffer, creating it if necessary.
+    ThreadBuffer& GetThreadBuffer();
+
+    /// Incremented for every trace started
+    std::atomic<u32> generation;
+    std::atomic<u64> dropped_events;
+
+    /// Protects the list of buffers, which are kept for the lifetime of the process
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    static thread_local ThreadBuffer* thread_buffer;
+};
+
 ProfilingManager& GetProfilingManager();
 SynchronizedRef<TimingResultsAggregator> GetTimingResultsAggregator();
+BlockProfiler& GetBlockProfiler();
+SliceProfiler& GetSliceProfiler();
+HLECallProfiler& GetHLECallProfiler();
+PCSampler& GetPCSampler();
+TraceRecorder& GetTraceRecorder();
 
 } // namespace Profiling
 } // namespace Common
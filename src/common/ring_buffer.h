@@ -0,0 +1,81 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+namespace Common {
+
+/**
+ * Lock-free ring buffer shared by exactly one producer thread and one consumer thread. Neither
+ * side ever waits for the other: Push only stores what fits and Pop only returns what's there.
+ * @tparam T Element type, has to be trivially copyable
+ * @tparam capacity Maximum number of elements, has to be a power of two
+ */
+template <typename T, size_t capacity>
+class RingBuffer {
+    static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    RingBuffer() : read_index(0), write_index(0) {}
+
+    /**
+     * Appends elements to the ring. Must only be called by the producer.
+     * @return Number of elements appended, less than count if the ring is full
+     */
+    size_t Push(const T* data, size_t count) {
+        const size_t write = write_index.load(std::memory_order_relaxed);
+        const size_t read = read_index.load(std::memory_order_acquire);
+        count = std::min(count, capacity - (write - read));
+
+        // Copy up to the end of the storage, then wrap around
+        const size_t offset = write & (capacity - 1);
+        const size_t first = std::min(count, capacity - offset);
+        std::memcpy(&buffer[offset], data, first * sizeof(T));
+        std::memcpy(&buffer[0], data + first, (count - first) * sizeof(T));
+
+        write_index.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Removes elements from the ring. Must only be called by the consumer.
+     * @return Number of elements removed, less than max_count if the ring didn't hold enough
+     */
+    size_t Pop(T* data, size_t max_count) {
+        const size_t read = read_index.load(std::memory_order_relaxed);
+        const size_t write = write_index.load(std::memory_order_acquire);
+        const size_t count = std::min(max_count, write - read);
+
+        const size_t offset = read & (capacity - 1);
+        const size_t first = std::min(count, capacity - offset);
+        std::memcpy(data, &buffer[offset], first * sizeof(T));
+        std::memcpy(data + first, &buffer[0], (count - first) * sizeof(T));
+
+        read_index.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    /// Returns the number of elements in the ring. Only a snapshot when called from the other side.
+    size_t Size() const {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+private:
+    std::array<T, capacity> buffer;
+    /// Total number of elements popped and pushed. Only written by the consumer and producer.
+    std::atomic<size_t> read_index;
+    std::atomic<size_t> write_index;
+};
+
+} // namespace
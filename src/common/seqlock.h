@@ -0,0 +1,72 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Holds a value which one thread writes and any number of threads read, without locks. Readers
+ * retry if the value changed while they copied it, so they always see a consistent value and
+ * never hold up the writer.
+ * @tparam T Type of the value, has to be trivially copyable and a multiple of 4 bytes in size
+ */
+template <typename T>
+class SeqLock {
+    static_assert(sizeof(T) % sizeof(u32) == 0, "size of T must be a multiple of 4 bytes");
+
+public:
+    SeqLock() : sequence(0) {
+        for (auto& word : words)
+            word.store(0, std::memory_order_relaxed);
+    }
+
+    /// Replaces the value. Must only be called by one thread at a time.
+    void Write(const T& value) {
+        u32 raw[NUM_WORDS];
+        std::memcpy(raw, &value, sizeof(T));
+
+        // An odd sequence number marks a write in progress
+        const u32 seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < NUM_WORDS; ++i)
+            words[i].store(raw[i], std::memory_order_relaxed);
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /// Returns a copy of the value
+    T Read() const {
+        u32 raw[NUM_WORDS];
+        u32 seq_before, seq_after;
+        do {
+            seq_before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < NUM_WORDS; ++i)
+                raw[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            seq_after = sequence.load(std::memory_order_relaxed);
+        } while ((seq_before & 1) != 0 || seq_before != seq_after);
+
+        T value;
+        std::memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+
+private:
+    static const size_t NUM_WORDS = sizeof(T) / sizeof(u32);
+
+    std::atomic<u32> sequence;
+    std::array<std::atomic<u32>, NUM_WORDS> words;
+};
+
+} // namespace
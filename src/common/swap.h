@@ -17,12 +17,16 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstring>
+
 #if defined(_MSC_VER)
     #include <cstdlib>
-#elif defined(__linux__)
-    #include <byteswap.h>
-#elif defined(__FreeBSD__)
-    #include <sys/endian.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SWAP_SSE2
+#include <emmintrin.h>
 #endif
 
 #include "common/common_types.h"
@@ -61,29 +65,15 @@ namespace Common {
 inline u8 swap8(u8 _data) {return _data;}
 inline u32 swap24(const u8* _data) {return (_data[0] << 16) | (_data[1] << 8) | _data[2];}
 
+// Compilers turn these into a single bswap/rev instruction
 #ifdef _MSC_VER
 inline u16 swap16(u16 _data) {return _byteswap_ushort(_data);}
 inline u32 swap32(u32 _data) {return _byteswap_ulong (_data);}
 inline u64 swap64(u64 _data) {return _byteswap_uint64(_data);}
-#elif _M_ARM
-inline u16 swap16 (u16 _data) { u32 data = _data; __asm__ ("rev16 %0, %1\n" : "=l" (data) : "l" (data)); return (u16)data;}
-inline u32 swap32 (u32 _data) {__asm__ ("rev %0, %1\n" : "=l" (_data) : "l" (_data)); return _data;}
-inline u64 swap64(u64 _data) {return ((u64)swap32(_data) << 32) | swap32(_data >> 32);}
-#elif __linux__
-inline u16 swap16(u16 _data) {return bswap_16(_data);}
-inline u32 swap32(u32 _data) {return bswap_32(_data);}
-inline u64 swap64(u64 _data) {return bswap_64(_data);}
-#elif __APPLE__
-inline __attribute__((always_inline)) u16 swap16(u16 _data)
-{return (_data >> 8) | (_data << 8);}
-inline __attribute__((always_inline)) u32 swap32(u32 _data)
-{return __builtin_bswap32(_data);}
-inline __attribute__((always_inline)) u64 swap64(u64 _data)
-{return __builtin_bswap64(_data);}
-#elif __FreeBSD__
-inline u16 swap16(u16 _data) {return bswap16(_data);}
-inline u32 swap32(u32 _data) {return bswap32(_data);}
-inline u64 swap64(u64 _data) {return bswap64(_data);}
+#elif defined(__GNUC__) || defined(__clang__)
+inline u16 swap16(u16 _data) {return __builtin_bswap16(_data);}
+inline u32 swap32(u32 _data) {return __builtin_bswap32(_data);}
+inline u64 swap64(u64 _data) {return __builtin_bswap64(_data);}
 #else
 // Slow generic implementation.
 inline u16 swap16(u16 data) {return (data >> 8) | (data << 8);}
@@ -115,9 +105,73 @@ inline double swapd(double f) {
     return dat2.f;
 }
 
-inline u16 swap16(const u8* _pData) {return swap16(*(const u16*)_pData);}
-inline u32 swap32(const u8* _pData) {return swap32(*(const u32*)_pData);}
-inline u64 swap64(const u8* _pData) {return swap64(*(const u64*)_pData);}
+// The data may be unaligned, memcpy compiles down to a plain load
+inline u16 swap16(const u8* _pData) {u16 data; std::memcpy(&data, _pData, sizeof(data)); return swap16(data);}
+inline u32 swap32(const u8* _pData) {u32 data; std::memcpy(&data, _pData, sizeof(data)); return swap32(data);}
+inline u64 swap64(const u8* _pData) {u64 data; std::memcpy(&data, _pData, sizeof(data)); return swap64(data);}
+
+#ifdef SWAP_SSE2
+/// Swaps the bytes of each 16-bit lane
+inline __m128i SwapLanes16(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/// Swaps the bytes of each 32-bit lane
+inline __m128i SwapLanes32(__m128i v) {
+    v = SwapLanes16(v);
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+/// Swaps the bytes of each 64-bit lane
+inline __m128i SwapLanes64(__m128i v) {
+    v = SwapLanes16(v);
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+#endif
+
+/**
+ * Converts an array of 16-bit values between big and little endian in place, 16 bytes at a time
+ * where SSE2 is available. The array doesn't need to be aligned.
+ */
+inline void SwapBlock16(u16* data, size_t count) {
+    size_t i = 0;
+#ifdef SWAP_SSE2
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), SwapLanes16(v));
+    }
+#endif
+    for (; i < count; ++i)
+        data[i] = swap16(data[i]);
+}
+
+/// Converts an array of 32-bit values between big and little endian in place, see SwapBlock16
+inline void SwapBlock32(u32* data, size_t count) {
+    size_t i = 0;
+#ifdef SWAP_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), SwapLanes32(v));
+    }
+#endif
+    for (; i < count; ++i)
+        data[i] = swap32(data[i]);
+}
+
+/// Converts an array of 64-bit values between big and little endian in place, see SwapBlock16
+inline void SwapBlock64(u64* data, size_t count) {
+    size_t i = 0;
+#ifdef SWAP_SSE2
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), SwapLanes64(v));
+    }
+#endif
+    for (; i < count; ++i)
+        data[i] = swap64(data[i]);
+}
 
 template <int count>
 void swap(u8*);
@@ -2,12 +2,72 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "common/symbols.h"
 
 TSymbolsMap g_symbols;
 
 namespace Symbols
 {
+    /// Range of a symbol, with the Thumb bit cleared from the start address
+    struct SymbolRange
+    {
+        u32 start;
+        u32 end;
+        const TSymbol* symbol;
+    };
+
+    static const unsigned PAGE_BITS = 12;
+
+    /// Ranges of all symbols, sorted by start address. Rebuilt on the first lookup after a change.
+    static std::vector<SymbolRange> g_ranges;
+    static bool g_ranges_dirty = true;
+    /// First and one past the last index into g_ranges which a lookup in a page has to look at
+    static std::unordered_map<u32, std::pair<u32, u32>> g_page_ranges;
+
+    static void BuildRanges()
+    {
+        g_ranges.clear();
+        g_page_ranges.clear();
+        g_ranges.reserve(g_symbols.size());
+        for (const auto& entry : g_symbols)
+        {
+            const TSymbol& symbol = entry.second;
+            const u32 start = symbol.address & ~1u;
+            g_ranges.push_back({ start, start + std::max(symbol.size, 1u), &symbol });
+        }
+
+        // Clearing the Thumb bit can reorder symbols which start one byte apart
+        std::stable_sort(g_ranges.begin(), g_ranges.end(),
+                         [](const SymbolRange& a, const SymbolRange& b) { return a.start < b.start; });
+        g_ranges_dirty = false;
+    }
+
+    /// Returns the part of g_ranges holding the candidates for addresses in a page
+    static std::pair<u32, u32> GetPageRange(u32 page)
+    {
+        auto it = g_page_ranges.find(page);
+        if (it != g_page_ranges.end())
+            return it->second;
+
+        auto StartsBefore = [](u32 address, const SymbolRange& range) { return address < range.start; };
+        const u32 page_start = page << PAGE_BITS;
+        const u32 page_end = page_start + (1u << PAGE_BITS) - 1;
+
+        // The last symbol starting before the page may still reach into it
+        u32 first = (u32)(std::upper_bound(g_ranges.begin(), g_ranges.end(), page_start, StartsBefore) - g_ranges.begin());
+        if (first != 0)
+            --first;
+        const u32 last = (u32)(std::upper_bound(g_ranges.begin(), g_ranges.end(), page_end, StartsBefore) - g_ranges.begin());
+
+        const std::pair<u32, u32> page_range(first, last);
+        g_page_ranges.emplace(page, page_range);
+        return page_range;
+    }
+
     bool HasSymbol(u32 _address)
     {
         return g_symbols.find(_address) != g_symbols.end();
@@ -24,6 +84,7 @@ namespace Symbols
             symbol.type = _type;
 
             g_symbols.insert(TSymbolsPair(_address, symbol));
+            g_ranges_dirty = true;
         }
     }
 
@@ -45,13 +106,32 @@ namespace Symbols
         return GetSymbol(_address).name;
     }
 
+    const TSymbol* Lookup(u32 _address)
+    {
+        if (g_ranges_dirty)
+            BuildRanges();
+
+        const std::pair<u32, u32> page_range = GetPageRange(_address >> PAGE_BITS);
+        auto begin = g_ranges.begin() + page_range.first;
+        auto end = g_ranges.begin() + page_range.second;
+        auto it = std::upper_bound(begin, end, _address,
+                                   [](u32 address, const SymbolRange& range) { return address < range.start; });
+        if (it == begin)
+            return nullptr;
+
+        --it;
+        return _address < it->end ? it->symbol : nullptr;
+    }
+
     void Remove(u32 _address)
     {
         g_symbols.erase(_address);
+        g_ranges_dirty = true;
     }
 
     void Clear()
     {
         g_symbols.clear();
+        g_ranges_dirty = true;
     }
 }
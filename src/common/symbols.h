@@ -33,6 +33,15 @@ namespace Symbols
     void Add(u32 _address, const std::string& _name, u32 _size, u32 _type);
     TSymbol GetSymbol(u32 _address);
     const std::string GetName(u32 _address);
+
+    /**
+     * Finds the symbol whose range contains an address, like the function a PC is in. Where
+     * symbols overlap, addresses past the start of the later one only resolve to it. Lookups go through a sorted table of the symbol
+     * ranges, which is rebuilt after symbols change, and a cache of the table entries per page.
+     * @return The symbol, or nullptr if none contains the address. Only valid until the symbols
+     *         change.
+     */
+    const TSymbol* Lookup(u32 _address);
     void Remove(u32 _address);
     void Clear();
 }
@@ -2,6 +2,10 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <fstream>
+
+#include "common/string_util.h"
 #include "common/thread.h"
 
 #ifdef __APPLE__
@@ -21,6 +25,11 @@
     #include <unistd.h>
 #endif
 
+#ifdef __linux__
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+#endif
+
 namespace Common
 {
 
@@ -55,6 +64,14 @@ void SetCurrentThreadAffinity(u32 mask)
     SetThreadAffinityMask(GetCurrentThread(), mask);
 }
 
+bool SetCurrentThreadPriority(ThreadPriority priority)
+{
+    static const int priorities[] = {
+        THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL
+    };
+    return SetThreadPriority(GetCurrentThread(), priorities[(int)priority]) != 0;
+}
+
 void SwitchCurrentThread()
 {
     SwitchToThread();
@@ -117,6 +134,29 @@ void SetCurrentThreadAffinity(u32 mask)
     SetThreadAffinity(pthread_self(), mask);
 }
 
+bool SetCurrentThreadPriority(ThreadPriority priority)
+{
+#ifdef __linux__
+    // Linux threads are scheduled by their own nice value, which SCHED_OTHER ignores otherwise
+    static const int nice_values[] = { 10, 0, -10 };
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice_values[(int)priority]) == 0;
+#else
+    int policy;
+    sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+        return false;
+
+    const int min_priority = sched_get_priority_min(policy);
+    const int max_priority = sched_get_priority_max(policy);
+    switch (priority) {
+    case ThreadPriority::Low:    param.sched_priority = min_priority; break;
+    case ThreadPriority::Normal: param.sched_priority = (min_priority + max_priority) / 2; break;
+    case ThreadPriority::High:   param.sched_priority = max_priority; break;
+    }
+    return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+}
+
 #ifndef _WIN32
 void SleepCurrentThread(int ms)
 {
@@ -145,4 +185,61 @@ void SetCurrentThreadName(const char* szThreadName)
 
 #endif
 
+std::vector<HostCpu> GetHostCpuTopology()
+{
+    const unsigned num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<HostCpu> cpus;
+
+#if defined(_WIN32)
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!info.empty() && GetLogicalProcessorInformation(info.data(), &length)) {
+        std::vector<HostCpu> found(sizeof(ULONG_PTR) * 8, HostCpu{ 0, ~0u, 0 });
+        unsigned num_cores = 0, num_packages = 0;
+        for (const auto& entry : info) {
+            if (entry.Relationship != RelationProcessorCore && entry.Relationship != RelationProcessorPackage)
+                continue;
+
+            for (unsigned i = 0; i < found.size(); ++i) {
+                if (!((entry.ProcessorMask >> i) & 1))
+                    continue;
+                if (entry.Relationship == RelationProcessorCore)
+                    found[i].core = num_cores;
+                else
+                    found[i].package = num_packages;
+            }
+            if (entry.Relationship == RelationProcessorCore)
+                ++num_cores;
+            else
+                ++num_packages;
+        }
+
+        for (unsigned i = 0; i < found.size(); ++i) {
+            if (found[i].core != ~0u)
+                cpus.push_back({ i, found[i].core, found[i].package });
+        }
+    }
+#elif defined(__linux__)
+    // Offline CPUs leave gaps in the numbering, so look a bit past the number of online ones
+    for (unsigned i = 0; i < num_cpus * 2 && cpus.size() < num_cpus; ++i) {
+        const std::string path = Common::StringFromFormat("/sys/devices/system/cpu/cpu%u/topology/", i);
+        std::ifstream core_file(path + "core_id");
+        std::ifstream package_file(path + "physical_package_id");
+        unsigned core, package;
+        if (!(core_file >> core) || !(package_file >> package))
+            continue;
+
+        // Core IDs are only unique within their package
+        cpus.push_back({ i, package << 16 | core, package });
+    }
+#endif
+
+    if (cpus.empty()) {
+        for (unsigned i = 0; i < num_cpus; ++i)
+            cpus.push_back({ i, i, 0 });
+    }
+    return cpus;
+}
+
 } // namespace Common
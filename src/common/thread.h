@@ -8,6 +8,7 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
 
 #include "common/common_types.h"
 
@@ -38,6 +39,32 @@ int CurrentThreadId();
 void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask);
 void SetCurrentThreadAffinity(u32 mask);
 
+enum class ThreadPriority {
+    Low = 0,
+    Normal = 1,
+    High = 2,
+};
+
+/**
+ * Changes the scheduling priority of the calling thread relative to the other threads of the
+ * process.
+ * @return Whether the OS allowed the change, raising a priority usually takes privileges
+ */
+bool SetCurrentThreadPriority(ThreadPriority priority);
+
+/// Logical host CPU, with the physical core and package it belongs to
+struct HostCpu {
+    unsigned index;   ///< Bit of the CPU in affinity masks
+    unsigned core;    ///< Physical core, shared by SMT siblings, unique across packages
+    unsigned package; ///< Physical package (socket)
+};
+
+/**
+ * Lists the host's logical CPUs by index. Where the topology can't be queried, every CPU is
+ * reported as its own core of a single package.
+ */
+std::vector<HostCpu> GetHostCpuTopology();
+
 class Event {
 public:
     Event() : is_set(false) {}
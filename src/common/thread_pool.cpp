@@ -0,0 +1,197 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/assert.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler_reporting.h"
+#include "common/thread.h"
+#include "common/thread_pool.h"
+
+namespace Common {
+
+/// Pool and deque index of the worker running on this thread, if any
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+ThreadPool::ThreadPool(unsigned num_workers, u32 affinity_mask, ThreadPriority priority, const char* name)
+        : queued_tasks(0), running(true) {
+    for (unsigned i = 0; i <= num_workers; ++i)
+        queues.emplace_back(Common::make_unique<TaskQueue>());
+
+    for (unsigned i = 0; i < num_workers; ++i)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, i, affinity_mask, priority, name + std::to_string(i));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running = false;
+    }
+    task_available.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+
+    // Without workers, tasks which were never waited for are still queued
+    Task task;
+    while (TakeTask(queues.size() - 1, task))
+        RunTask(task);
+}
+
+size_t ThreadPool::GetLocalQueue() const {
+    return current_pool == this ? current_queue : queues.size() - 1;
+}
+
+void ThreadPool::Submit(TaskGroup& group, std::function<void()> task) {
+    ++group.pending;
+
+    TaskQueue& queue = *queues[GetLocalQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ std::move(task), &group });
+    }
+    ++queued_tasks;
+
+    // Taking the lock makes sure a worker which just found no tasks is already waiting
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    task_available.notify_one();
+}
+
+bool ThreadPool::TakeTask(size_t local_queue, Task& task) {
+    const size_t num_queues = queues.size();
+
+    // Workers run their own newest task, whose data is most likely still in their cache
+    if (local_queue != num_queues - 1) {
+        TaskQueue& queue = *queues[local_queue];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --queued_tasks;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of another thread, starting with the shared deque
+    for (size_t i = 0; i < num_queues; ++i) {
+        const size_t index = (num_queues - 1 + i) % num_queues;
+        if (index == local_queue && index != num_queues - 1)
+            continue;
+
+        TaskQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued_tasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::RunTask(Task& task) {
+    task.function();
+
+    // Decremented under the lock, so that Wait() can't return and destroy the group before the
+    // notification is done
+    TaskGroup& group = *task.group;
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (--group.pending == 0)
+        group.done.notify_all();
+}
+
+void ThreadPool::Wait(TaskGroup& group) {
+    const size_t local_queue = GetLocalQueue();
+
+    while (group.pending != 0) {
+        Task task;
+        if (TakeTask(local_queue, task)) {
+            RunTask(task);
+            continue;
+        }
+
+        // All remaining tasks of the group are running on other threads
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.done.wait(lock, [&]{ return group.pending == 0; });
+    }
+
+    // Wait for the last task to be done with the group
+    std::lock_guard<std::mutex> lock(group.mutex);
+}
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain_size,
+                             const std::function<void(size_t, size_t)>& body) {
+    grain_size = std::max<size_t>(grain_size, 1);
+    if (end - begin <= grain_size || workers.empty()) {
+        if (begin != end)
+            body(begin, end);
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t chunk = begin; chunk < end; chunk += grain_size) {
+        const size_t chunk_end = std::min(chunk + grain_size, end);
+        Submit(group, [&body, chunk, chunk_end] { body(chunk, chunk_end); });
+    }
+    Wait(group);
+}
+
+void ThreadPool::WorkerLoop(unsigned index, u32 affinity_mask, ThreadPriority priority, std::string name) {
+    Common::SetCurrentThreadName(name.c_str());
+    Common::Profiling::GetTraceRecorder().SetThreadName(name.c_str());
+    if (affinity_mask != 0)
+        Common::SetCurrentThreadAffinity(affinity_mask);
+    if (priority != ThreadPriority::Normal && !Common::SetCurrentThreadPriority(priority))
+        LOG_WARNING(Common, "Could not change the priority of %s", name.c_str());
+
+    current_pool = this;
+    current_queue = index;
+
+    while (true) {
+        Task task;
+        if (TakeTask(index, task)) {
+            RunTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        task_available.wait(lock, [this]{ return queued_tasks != 0 || !running; });
+        if (!running && queued_tasks == 0)
+            break;
+    }
+
+    current_pool = nullptr;
+}
+
+static std::unique_ptr<ThreadPool> thread_pool;
+
+void InitThreadPool(int num_workers, u32 affinity_mask, ThreadPriority priority) {
+    if (num_workers < 0 && affinity_mask != 0) {
+        // The workers are already kept off the cores of the other threads
+        num_workers = 0;
+        for (u32 mask = affinity_mask; mask != 0; mask &= mask - 1)
+            ++num_workers;
+    } else if (num_workers < 0) {
+        // The emulation thread keeps a core to itself
+        const unsigned num_cores = std::max(std::thread::hardware_concurrency(), 1u);
+        num_workers = (int)num_cores - 1;
+    }
+
+    thread_pool = Common::make_unique<ThreadPool>((unsigned)num_workers, affinity_mask, priority);
+    LOG_DEBUG(Common, "Started %d pool worker threads", num_workers);
+}
+
+void ShutdownThreadPool() {
+    thread_pool = nullptr;
+}
+
+ThreadPool& GetThreadPool() {
+    ASSERT_MSG(thread_pool != nullptr, "the thread pool hasn't been initialized");
+    return *thread_pool;
+}
+
+} // namespace Common
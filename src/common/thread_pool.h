@@ -0,0 +1,126 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/thread.h"
+
+namespace Common {
+
+/// Set of tasks which can be waited for together, see ThreadPool::Wait
+class TaskGroup : NonCopyable {
+public:
+    TaskGroup() : pending(0) {}
+
+private:
+    friend class ThreadPool;
+
+    std::atomic<size_t> pending;
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+/**
+ * Work-stealing task scheduler. Each worker owns a deque, onto which it pushes the tasks it
+ * submits and from the back of which it runs them, so nested tasks stay on the cores whose caches
+ * hold their data. Idle workers steal from the front of the other deques. Tasks submitted from
+ * outside the pool go to a shared deque which all workers steal from.
+ *
+ * Threads waiting for a task group run queued tasks instead of blocking, so the pool also makes
+ * progress without any workers, and tasks may wait for groups of their own.
+ *
+ * Tasks shouldn't block on anything but task groups, since they occupy a worker for that long.
+ * Long-running loops belong on dedicated threads.
+ */
+class ThreadPool : NonCopyable {
+public:
+    /**
+     * @param num_workers Number of worker threads, which may be 0 to run all tasks in Wait()
+     * @param affinity_mask Host CPUs the workers may run on, or 0 to leave them to the OS
+     * @param priority Scheduling priority of the workers
+     * @param name Prefix of the workers' thread names
+     */
+    ThreadPool(unsigned num_workers, u32 affinity_mask = 0,
+               ThreadPriority priority = ThreadPriority::Normal, const char* name = "Worker");
+
+    /// Finishes the queued tasks, then stops the workers
+    ~ThreadPool();
+
+    unsigned GetWorkerCount() const {
+        return (unsigned)workers.size();
+    }
+
+    /// Queues a task as part of a group
+    void Submit(TaskGroup& group, std::function<void()> task);
+
+    /// Runs queued tasks on the calling thread until all tasks of the group have finished
+    void Wait(TaskGroup& group);
+
+    /**
+     * Calls body for consecutive chunks of [begin, end) of at most grain_size elements, in
+     * parallel, and returns once all of them are done. The calling thread takes part.
+     * @param body Called as body(chunk_begin, chunk_end)
+     */
+    void ParallelFor(size_t begin, size_t end, size_t grain_size,
+                     const std::function<void(size_t, size_t)>& body);
+
+private:
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    /// Returns the index of the calling thread's deque, which is the shared one for other threads
+    size_t GetLocalQueue() const;
+
+    /// Takes a task from the given thread's own deque, or steals one from any other
+    bool TakeTask(size_t local_queue, Task& task);
+
+    /// Runs a task and marks it as finished in its group
+    void RunTask(Task& task);
+
+    void WorkerLoop(unsigned index, u32 affinity_mask, ThreadPriority priority, std::string name);
+
+    /// One deque per worker, followed by the shared one
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+
+    /// Number of tasks in all deques, which idle workers sleep on
+    std::atomic<size_t> queued_tasks;
+    std::mutex sleep_mutex;
+    std::condition_variable task_available;
+    bool running;
+};
+
+/**
+ * Creates the process-wide pool, which all parallel subsystems share so that they don't
+ * oversubscribe the host's cores.
+ * @param num_workers Number of worker threads, or a negative number for one per CPU of the affinity
+ *                    mask, or for all but one host core without a mask
+ */
+void InitThreadPool(int num_workers, u32 affinity_mask, ThreadPriority priority);
+
+void ShutdownThreadPool();
+
+/// Returns the process-wide pool, which must have been created with InitThreadPool()
+ThreadPool& GetThreadPool();
+
+} // namespace Common
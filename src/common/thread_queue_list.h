@@ -4,11 +4,18 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <deque>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include <boost/range/algorithm_ext/erase.hpp>
 
+#include "common/common_types.h"
+
 namespace Common {
 
 template<class T, unsigned int N>
@@ -22,15 +29,13 @@ struct ThreadQueueList {
     // Number of priority levels. (Valid levels are [0..NUM_QUEUES).)
     static const Priority NUM_QUEUES = N;
 
-    ThreadQueueList() {
-        first = nullptr;
-    }
+    static_assert(N <= 64, "The non-empty level bitmap only has room for 64 priority levels");
 
     // Only for debugging, returns priority level.
     Priority contains(const T& uid) {
         for (Priority i = 0; i < NUM_QUEUES; ++i) {
-            Queue& cur = queues[i];
-            if (std::find(cur.data.cbegin(), cur.data.cend(), uid) != cur.data.cend()) {
+            std::deque<T>& cur = queues[i];
+            if (std::find(cur.cbegin(), cur.cend(), uid) != cur.cend()) {
                 return i;
             }
         }
@@ -39,124 +44,98 @@ struct ThreadQueueList {
     }
 
     T get_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                return cur->data.front();
-            }
-            cur = cur->next_nonempty;
-        }
-
-        return T();
+        if (nonempty_levels == 0)
+            return T();
+        return queues[first_level(nonempty_levels)].front();
     }
 
     T pop_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
-
-        return T();
+        if (nonempty_levels == 0)
+            return T();
+        return pop_front(first_level(nonempty_levels));
     }
 
     T pop_first_better(Priority priority) {
-        Queue *cur = first;
-        Queue *stop = &queues[priority];
-        while (cur < stop) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
+        // Only consider levels with a numerically lower (i.e. better) priority
+        const u64 better_levels = nonempty_levels & ((u64(1) << priority) - 1);
+        if (better_levels == 0)
+            return T();
+        return pop_front(first_level(better_levels));
+    }
 
-        return T();
+    // Calls func with the first thread id of each non-empty priority level, in priority order.
+    // The queues must not be modified from within func.
+    template <typename Func>
+    void for_each_front(Func func) const {
+        for (u64 levels = nonempty_levels; levels != 0; levels &= levels - 1)
+            func(queues[first_level(levels)].front());
     }
 
     void push_front(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_front(thread_id);
+        queues[priority].push_front(thread_id);
+        nonempty_levels |= u64(1) << priority;
     }
 
     void push_back(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_back(thread_id);
+        queues[priority].push_back(thread_id);
+        nonempty_levels |= u64(1) << priority;
     }
 
     void move(const T& thread_id, Priority old_priority, Priority new_priority) {
         remove(old_priority, thread_id);
-        prepare(new_priority);
         push_back(new_priority, thread_id);
     }
 
     void remove(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        boost::remove_erase(cur->data, thread_id);
+        std::deque<T>& cur = queues[priority];
+        boost::remove_erase(cur, thread_id);
+        if (cur.empty())
+            nonempty_levels &= ~(u64(1) << priority);
     }
 
     void rotate(Priority priority) {
-        Queue *cur = &queues[priority];
+        std::deque<T>& cur = queues[priority];
 
-        if (cur->data.size() > 1) {
-            cur->data.push_back(std::move(cur->data.front()));
-            cur->data.pop_front();
+        if (cur.size() > 1) {
+            cur.push_back(std::move(cur.front()));
+            cur.pop_front();
         }
     }
 
     void clear() {
-        queues.fill(Queue());
-        first = nullptr;
+        queues.fill(std::deque<T>());
+        nonempty_levels = 0;
     }
 
     bool empty(Priority priority) const {
-        const Queue *cur = &queues[priority];
-        return cur->data.empty();
-    }
-
-    void prepare(Priority priority) {
-        Queue* cur = &queues[priority];
-        if (cur->next_nonempty == UnlinkedTag())
-            link(priority);
+        return queues[priority].empty();
     }
 
 private:
-    struct Queue {
-        // Points to the next active priority, skipping over ones that have never been used.
-        Queue* next_nonempty = UnlinkedTag();
-        // Double-ended queue of threads in this priority level
-        std::deque<T> data;
-    };
-
-    /// Special tag used to mark priority levels that have never been used.
-    static Queue* UnlinkedTag() {
-        return reinterpret_cast<Queue*>(1);
+    /// Returns the best (numerically lowest) priority level set in a non-zero bitmap.
+    static Priority first_level(u64 levels) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, levels);
+        return index;
+#else
+        return __builtin_ctzll(levels);
+#endif
     }
 
-    void link(Priority priority) {
-        Queue *cur = &queues[priority];
-
-        for (int i = priority - 1; i >= 0; --i) {
-            if (queues[i].next_nonempty != UnlinkedTag()) {
-                cur->next_nonempty = queues[i].next_nonempty;
-                queues[i].next_nonempty = cur;
-                return;
-            }
-        }
-
-        cur->next_nonempty = first;
-        first = cur;
+    T pop_front(Priority priority) {
+        std::deque<T>& cur = queues[priority];
+        auto tmp = std::move(cur.front());
+        cur.pop_front();
+        if (cur.empty())
+            nonempty_levels &= ~(u64(1) << priority);
+        return tmp;
     }
 
-    // The first queue that's ever been used.
-    Queue* first;
+    // Bit i is set if the queue of priority level i contains any thread ids.
+    u64 nonempty_levels = 0;
     // The priority level queues of thread ids.
-    std::array<Queue, NUM_QUEUES> queues;
+    std::array<std::deque<T>, NUM_QUEUES> queues;
 };
 
 } // namespace
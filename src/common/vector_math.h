@@ -33,6 +33,11 @@
 
 #include <cmath>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define VECTOR_MATH_SSE
+#include <emmintrin.h>
+#endif
+
 namespace Math {
 
 template<typename T> class Vec2;
@@ -527,6 +532,87 @@ Vec4<decltype(V{}*T{})> operator * (const V& f, const Vec4<T>& vec)
 
 typedef Vec4<float> Vec4f;
 
+#ifdef VECTOR_MATH_SSE
+// SSE2 versions of the most frequently used Vec4<float> and Vec4<int> operators. The members are
+// contiguous, so they can be loaded as a single vector without changing the layout (or alignment)
+// of the class. Multiplying 32-bit integers needs SSE4.1, so those keep the generic versions.
+
+template<>
+inline Vec4<float> Vec4<float>::operator +(const Vec4& other) const
+{
+    Vec4 result;
+    _mm_storeu_ps(&result.x, _mm_add_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&other.x)));
+    return result;
+}
+template<>
+inline void Vec4<float>::operator += (const Vec4& other)
+{
+    _mm_storeu_ps(&x, _mm_add_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&other.x)));
+}
+template<>
+inline Vec4<float> Vec4<float>::operator -(const Vec4& other) const
+{
+    Vec4 result;
+    _mm_storeu_ps(&result.x, _mm_sub_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&other.x)));
+    return result;
+}
+template<>
+inline void Vec4<float>::operator -= (const Vec4& other)
+{
+    _mm_storeu_ps(&x, _mm_sub_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&other.x)));
+}
+template<>
+inline Vec4<float> Vec4<float>::operator * (const Vec4& other) const
+{
+    Vec4 result;
+    _mm_storeu_ps(&result.x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_loadu_ps(&other.x)));
+    return result;
+}
+template<>
+template<>
+inline Vec4<float> Vec4<float>::operator * (const float& f) const
+{
+    Vec4 result;
+    _mm_storeu_ps(&result.x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_set1_ps(f)));
+    return result;
+}
+template<>
+template<>
+inline void Vec4<float>::operator *= (const float& f)
+{
+    _mm_storeu_ps(&x, _mm_mul_ps(_mm_loadu_ps(&x), _mm_set1_ps(f)));
+}
+
+template<>
+inline Vec4<int> Vec4<int>::operator +(const Vec4& other) const
+{
+    Vec4 result;
+    _mm_storeu_si128((__m128i*)&result.x, _mm_add_epi32(_mm_loadu_si128((const __m128i*)&x),
+                                                        _mm_loadu_si128((const __m128i*)&other.x)));
+    return result;
+}
+template<>
+inline void Vec4<int>::operator += (const Vec4& other)
+{
+    _mm_storeu_si128((__m128i*)&x, _mm_add_epi32(_mm_loadu_si128((const __m128i*)&x),
+                                                 _mm_loadu_si128((const __m128i*)&other.x)));
+}
+template<>
+inline Vec4<int> Vec4<int>::operator -(const Vec4& other) const
+{
+    Vec4 result;
+    _mm_storeu_si128((__m128i*)&result.x, _mm_sub_epi32(_mm_loadu_si128((const __m128i*)&x),
+                                                        _mm_loadu_si128((const __m128i*)&other.x)));
+    return result;
+}
+template<>
+inline void Vec4<int>::operator -= (const Vec4& other)
+{
+    _mm_storeu_si128((__m128i*)&x, _mm_sub_epi32(_mm_loadu_si128((const __m128i*)&x),
+                                                 _mm_loadu_si128((const __m128i*)&other.x)));
+}
+#endif
+
 
 template<typename T>
 static inline decltype(T{}*T{}+T{}*T{}) Dot(const Vec2<T>& a, const Vec2<T>& b)
@@ -109,14 +109,49 @@ public:
     virtual void SaveContext(Core::ThreadContext& ctx) = 0;
 
     /**
-     * Loads a CPU context
+     * Loads a CPU context. The VFP registers are only exchanged once the thread executes a VFP
+     * instruction, so the CPU keeps referring to the context until another one is loaded.
      * @param ctx Thread context to load
      */
-    virtual void LoadContext(const Core::ThreadContext& ctx) = 0;
+    virtual void LoadContext(Core::ThreadContext& ctx) = 0;
+
+    /**
+     * Writes the VFP registers held by the CPU back to the context they belong to. Must be called
+     * before thread contexts are accessed other than through SaveContext and LoadContext.
+     */
+    virtual void FlushVFPContext() = 0;
+
+    /**
+     * Makes the CPU drop all references to the given context, discarding the VFP registers it
+     * holds for it. Must be called before a context passed to LoadContext is destroyed.
+     * @param ctx Thread context to release
+     */
+    virtual void ReleaseContext(const Core::ThreadContext& ctx) = 0;
 
     /// Prepare core for thread reschedule (if needed to correctly handle state)
     virtual void PrepareReschedule() = 0;
 
+    /**
+     * Clears the exclusive monitor, making the next store-exclusive fail unless it's preceded by
+     * another load-exclusive. Like the CLREX done by the kernel, this has to happen whenever the
+     * guest code may have been interrupted between a load-exclusive and a store-exclusive.
+     */
+    virtual void ClearExclusiveState() = 0;
+
+    /// Discards all cached translations of guest code
+    virtual void ClearInstructionCache() = 0;
+
+    /**
+     * Discards cached translations of guest code in the given address range, e.g. because the
+     * memory backing it has been remapped or rewritten.
+     * @param start_address Start of the guest address range to invalidate
+     * @param length Length of the range in bytes
+     */
+    virtual void InvalidateCacheRange(u32 start_address, u32 length) = 0;
+
+    /// Saves the cached translations of the running title's code, for reuse by its next boot
+    virtual void SaveInstructionCache() = 0;
+
     /// Getter for num_instructions
     u64 GetNumInstructions() {
         return num_instructions;
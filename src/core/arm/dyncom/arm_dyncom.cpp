@@ -22,6 +22,10 @@ ARM_DynCom::ARM_DynCom(PrivilegeMode initial_mode) {
 }
 
 ARM_DynCom::~ARM_DynCom() {
+    // The translation cache is shared by all interpreter instances, don't leak stale code into the
+    // next emulation session.
+    InterpreterShutdown();
+    InterpreterClearCache();
 }
 
 void ARM_DynCom::SetPC(u32 pc) {
@@ -58,8 +62,11 @@ void ARM_DynCom::SetCP15Register(CP15Register reg, u32 value) {
 
 void ARM_DynCom::AddTicks(u64 ticks) {
     down_count -= ticks;
-    if (down_count < 0)
+    if (down_count < 0) {
+        // Event handlers act like interrupts, and may write to the memory of a reservation
+        state->UnsetExclusiveMemoryAddress();
         CoreTiming::Advance();
+    }
 }
 
 void ARM_DynCom::ExecuteInstructions(int num_instructions) {
@@ -69,12 +76,25 @@ void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     // executing one instruction at a time. Otherwise, if a block is being executed, more
     // instructions may actually be executed than specified.
     unsigned ticks_executed = InterpreterMainLoop(state.get());
+
+    // The guest is spinning until something external happens, fast-forward to the next event
+    if (state->idle_loop_detected) {
+        state->idle_loop_detected = false;
+        CoreTiming::Idle();
+    }
+
     AddTicks(ticks_executed);
 }
 
 void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) {
     memset(&context, 0, sizeof(Core::ThreadContext));
 
+    // The VFP registers held for the context are no longer part of it
+    if (state->vfp_owner == &context) {
+        state->vfp_owner = nullptr;
+        state->vfp_switch_pending = state->vfp_context != nullptr;
+    }
+
     context.cpu_registers[0] = arg;
     context.pc = entry_point;
     context.sp = stack_top;
@@ -82,31 +102,58 @@ void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 e
 }
 
 void ARM_DynCom::SaveContext(Core::ThreadContext& ctx) {
+    // The VFP registers stay in the CPU until another thread uses the VFP, see LoadContext
     memcpy(ctx.cpu_registers, state->Reg.data(), sizeof(ctx.cpu_registers));
-    memcpy(ctx.fpu_registers, state->ExtReg.data(), sizeof(ctx.fpu_registers));
 
     ctx.sp = state->Reg[13];
     ctx.lr = state->Reg[14];
     ctx.pc = state->Reg[15];
     ctx.cpsr = state->Cpsr;
-
-    ctx.fpscr = state->VFP[1];
-    ctx.fpexc = state->VFP[2];
 }
 
-void ARM_DynCom::LoadContext(const Core::ThreadContext& ctx) {
+void ARM_DynCom::LoadContext(Core::ThreadContext& ctx) {
     memcpy(state->Reg.data(), ctx.cpu_registers, sizeof(ctx.cpu_registers));
-    memcpy(state->ExtReg.data(), ctx.fpu_registers, sizeof(ctx.fpu_registers));
 
     state->Reg[13] = ctx.sp;
     state->Reg[14] = ctx.lr;
     state->Reg[15] = ctx.pc;
     state->Cpsr = ctx.cpsr;
 
-    state->VFP[1] = ctx.fpscr;
-    state->VFP[2] = ctx.fpexc;
+    // Most threads never execute a VFP instruction, so the VFP registers are only exchanged by
+    // the first one the thread executes
+    state->vfp_context = &ctx;
+    state->vfp_switch_pending = state->vfp_owner != &ctx;
+}
+
+void ARM_DynCom::FlushVFPContext() {
+    state->FlushVFPContext();
+}
+
+void ARM_DynCom::ReleaseContext(const Core::ThreadContext& ctx) {
+    if (state->vfp_owner == &ctx)
+        state->vfp_owner = nullptr;
+    if (state->vfp_context == &ctx)
+        state->vfp_context = nullptr;
+
+    state->vfp_switch_pending = state->vfp_context != nullptr && state->vfp_context != state->vfp_owner;
 }
 
 void ARM_DynCom::PrepareReschedule() {
     state->NumInstrsToExecute = 0;
 }
+
+void ARM_DynCom::ClearExclusiveState() {
+    state->UnsetExclusiveMemoryAddress();
+}
+
+void ARM_DynCom::ClearInstructionCache() {
+    InterpreterClearCache();
+}
+
+void ARM_DynCom::InvalidateCacheRange(u32 start_address, u32 length) {
+    InterpreterInvalidateCacheRange(start_address, length);
+}
+
+void ARM_DynCom::SaveInstructionCache() {
+    InterpreterSaveCache();
+}
@@ -34,9 +34,15 @@ public:
 
     void ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) override;
     void SaveContext(Core::ThreadContext& ctx) override;
-    void LoadContext(const Core::ThreadContext& ctx) override;
+    void LoadContext(Core::ThreadContext& ctx) override;
+    void FlushVFPContext() override;
+    void ReleaseContext(const Core::ThreadContext& ctx) override;
 
     void PrepareReschedule() override;
+    void ClearExclusiveState() override;
+    void ClearInstructionCache() override;
+    void InvalidateCacheRange(u32 start_address, u32 length) override;
+    void SaveInstructionCache() override;
     void ExecuteInstructions(int num_instructions) override;
 
 private:
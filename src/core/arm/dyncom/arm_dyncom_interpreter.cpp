@@ -5,13 +5,32 @@
 #define CITRA_IGNORE_EXIT(x)
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdio>
-
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/assert.h"
+#include "common/file_util.h"
+#include "common/hash.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 #include "common/profiler.h"
+#include "common/profiler_reporting.h"
+#include "common/ring_buffer.h"
+#include "common/scm_rev.h"
+#include "common/string_util.h"
+#include "common/thread.h"
 
 #include "core/memory.h"
+#include "core/memory_setup.h"
+#include "core/settings.h"
 #include "core/hle/svc.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/vm_manager.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/dyncom/arm_dyncom_dec.h"
 #include "core/arm/dyncom/arm_dyncom_interpreter.h"
@@ -24,6 +43,10 @@
 Common::Profiling::TimingCategory profile_execute("DynCom::Execute");
 Common::Profiling::TimingCategory profile_decode("DynCom::Decode");
 
+/// Highest offset into the translation cache reached so far, and size of the allocated block tables
+static Common::Profiling::MemoryCounter translation_cache_counter("DynCom Translation Cache");
+static Common::Profiling::MemoryCounter block_table_counter("DynCom Block Tables");
+
 enum {
     COND            = (1 << 0),
     NON_BRANCH      = (1 << 1),
@@ -47,7 +70,39 @@ enum {
 
 typedef unsigned int (*shtop_fp_t)(ARMul_State* cpu, unsigned int sht_oper);
 
+// Flag-setting additions and subtractions only record their operands, most of the time the flags
+// are overwritten before anything reads them. The NZCV flags in ARMul_State are only valid after
+// MaterializeFlags, which has to be called before reading or partially updating them.
+static inline void SetLazyAddFlags(ARMul_State* cpu, u32 left, u32 right, u32 carry_in) {
+    cpu->lazy_flags_left = left;
+    cpu->lazy_flags_right = right;
+    cpu->lazy_flags_carry_in = carry_in;
+    cpu->lazy_flags_pending = true;
+}
+
+static inline void MaterializeFlags(ARMul_State* cpu) {
+    if (!cpu->lazy_flags_pending)
+        return;
+
+    bool carry;
+    bool overflow;
+    u32 result = AddWithCarry(cpu->lazy_flags_left, cpu->lazy_flags_right, cpu->lazy_flags_carry_in, &carry, &overflow);
+
+    cpu->NFlag = BIT(result, 31);
+    cpu->ZFlag = result == 0;
+    cpu->CFlag = carry;
+    cpu->VFlag = overflow;
+    cpu->lazy_flags_pending = false;
+}
+
+static inline u32 GetCarryFlag(ARMul_State* cpu) {
+    MaterializeFlags(cpu);
+    return cpu->CFlag;
+}
+
 static int CondPassed(ARMul_State* cpu, unsigned int cond) {
+    MaterializeFlags(cpu);
+
     const u32 NFLAG = cpu->NFlag;
     const u32 ZFLAG = cpu->ZFlag;
     const u32 CFLAG = cpu->CFlag;
@@ -113,7 +168,7 @@ static unsigned int DPO(Immediate)(ARMul_State* cpu, unsigned int sht_oper) {
     unsigned int rotate_imm = BITS(sht_oper, 8, 11);
     unsigned int shifter_operand = ROTATE_RIGHT_32(immed_8, rotate_imm * 2);
     if (rotate_imm == 0)
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     else
         cpu->shifter_carry_out = BIT(shifter_operand, 31);
     return shifter_operand;
@@ -122,7 +177,7 @@ static unsigned int DPO(Immediate)(ARMul_State* cpu, unsigned int sht_oper) {
 static unsigned int DPO(Register)(ARMul_State* cpu, unsigned int sht_oper) {
     unsigned int rm = CHECK_READ_REG15(cpu, RM);
     unsigned int shifter_operand = rm;
-    cpu->shifter_carry_out = cpu->CFlag;
+    cpu->shifter_carry_out = GetCarryFlag(cpu);
     return shifter_operand;
 }
 
@@ -132,7 +187,7 @@ static unsigned int DPO(LogicalShiftLeftByImmediate)(ARMul_State* cpu, unsigned
     unsigned int shifter_operand;
     if (shift_imm == 0) {
         shifter_operand = rm;
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     } else {
         shifter_operand = rm << shift_imm;
         cpu->shifter_carry_out = BIT(rm, 32 - shift_imm);
@@ -146,7 +201,7 @@ static unsigned int DPO(LogicalShiftLeftByRegister)(ARMul_State* cpu, unsigned i
     unsigned int rs = CHECK_READ_REG15(cpu, RS);
     if (BITS(rs, 0, 7) == 0) {
         shifter_operand = rm;
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     } else if (BITS(rs, 0, 7) < 32) {
         shifter_operand = rm << BITS(rs, 0, 7);
         cpu->shifter_carry_out = BIT(rm, 32 - BITS(rs, 0, 7));
@@ -180,7 +235,7 @@ static unsigned int DPO(LogicalShiftRightByRegister)(ARMul_State* cpu, unsigned
     unsigned int shifter_operand;
     if (BITS(rs, 0, 7) == 0) {
         shifter_operand = rm;
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     } else if (BITS(rs, 0, 7) < 32) {
         shifter_operand = rm >> BITS(rs, 0, 7);
         cpu->shifter_carry_out = BIT(rm, BITS(rs, 0, 7) - 1);
@@ -217,7 +272,7 @@ static unsigned int DPO(ArithmeticShiftRightByRegister)(ARMul_State* cpu, unsign
     unsigned int shifter_operand;
     if (BITS(rs, 0, 7) == 0) {
         shifter_operand = rm;
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     } else if (BITS(rs, 0, 7) < 32) {
         shifter_operand = static_cast<int>(rm) >> BITS(rs, 0, 7);
         cpu->shifter_carry_out = BIT(rm, BITS(rs, 0, 7) - 1);
@@ -236,7 +291,7 @@ static unsigned int DPO(RotateRightByImmediate)(ARMul_State* cpu, unsigned int s
     unsigned int rm = CHECK_READ_REG15(cpu, RM);
     int shift_imm = BITS(sht_oper, 7, 11);
     if (shift_imm == 0) {
-        shifter_operand = (cpu->CFlag << 31) | (rm >> 1);
+        shifter_operand = (GetCarryFlag(cpu) << 31) | (rm >> 1);
         cpu->shifter_carry_out = BIT(rm, 0);
     } else {
         shifter_operand = ROTATE_RIGHT_32(rm, shift_imm);
@@ -251,7 +306,7 @@ static unsigned int DPO(RotateRightByRegister)(ARMul_State* cpu, unsigned int sh
     unsigned int shifter_operand;
     if (BITS(rs, 0, 7) == 0) {
         shifter_operand = rm;
-        cpu->shifter_carry_out = cpu->CFlag;
+        cpu->shifter_carry_out = GetCarryFlag(cpu);
     } else if (BITS(rs, 0, 4) == 0) {
         shifter_operand = rm;
         cpu->shifter_carry_out = BIT(rm, 31);
@@ -268,6 +323,13 @@ struct ldst_inst {
     unsigned int inst;
     get_addr_fp_t get_addr;
 };
+
+// Replaces the ldst_inst of a literal pool load whose value was read at translation time
+struct ldr_literal_inst {
+    unsigned int Rd;
+    u32 value;
+};
+static_assert(sizeof(ldr_literal_inst) <= sizeof(ldst_inst), "ldr_literal_inst must fit in the space of an ldst_inst");
 #define DEBUG_MSG LOG_DEBUG(Core_ARM11, "inst is %x", inst); CITRA_IGNORE_EXIT(0)
 
 #define LnSWoUB(s)   glue(LnSWoUB, s)
@@ -404,7 +466,7 @@ static void LnSWoUB(ScaledRegisterPreIndexed)(ARMul_State* cpu, unsigned int ins
         break;
     case 3:
         if (shift_imm == 0) {
-            index = (cpu->CFlag << 31) | (rm >> 1);
+            index = (GetCarryFlag(cpu) << 31) | (rm >> 1);
         } else {
             index = ROTATE_RIGHT_32(rm, shift_imm);
         }
@@ -454,7 +516,7 @@ static void LnSWoUB(ScaledRegisterPostIndexed)(ARMul_State* cpu, unsigned int in
         break;
     case 3:
         if (shift_imm == 0) {
-            index = (cpu->CFlag << 31) | (rm >> 1);
+            index = (GetCarryFlag(cpu) << 31) | (rm >> 1);
         } else {
             index = ROTATE_RIGHT_32(rm, shift_imm);
         }
@@ -670,7 +732,7 @@ static void LnSWoUB(ScaledRegisterOffset)(ARMul_State* cpu, unsigned int inst, u
         break;
     case 3:
         if (shift_imm == 0) {
-            index = (cpu->CFlag << 31) | (rm >> 1);
+            index = (GetCarryFlag(cpu) << 31) | (rm >> 1);
         } else {
             index = ROTATE_RIGHT_32(rm, shift_imm);
         }
@@ -685,6 +747,13 @@ static void LnSWoUB(ScaledRegisterOffset)(ARMul_State* cpu, unsigned int inst, u
     virt_addr = addr;
 }
 
+// Cached successor of a direct branch. A link is only followed while the code cache generation it
+// was recorded in is still current, as the block it points to may have been evicted since.
+struct block_link {
+    int ptr;
+    u32 generation;
+};
+
 struct arm_inst {
     unsigned int idx;
     unsigned int cond;
@@ -751,6 +820,10 @@ struct bbl_inst {
     int signed_immed_24;
     unsigned int next_addr;
     unsigned int jmp_addr;
+    block_link taken_link;
+    block_link not_taken_link;
+    // Set if this branch closes a loop that just polls memory (see IsIdleLoop)
+    bool idle_loop;
 };
 
 struct bx_inst {
@@ -1118,10 +1191,13 @@ struct setend_inst {
 
 struct b_2_thumb {
     unsigned int imm;
+    block_link taken_link;
 };
 struct b_cond_thumb {
     unsigned int imm;
     unsigned int cond;
+    block_link taken_link;
+    block_link not_taken_link;
 };
 
 struct bl_1_thumb {
@@ -1134,6 +1210,11 @@ struct blx_1_thumb {
     unsigned int imm;
     unsigned int instr;
 };
+// A BL prefix and suffix pair, translated into one instruction
+struct bl_thumb {
+    unsigned int imm;
+    block_link taken_link;
+};
 
 struct pkh_inst {
     unsigned int Rm;
@@ -1144,19 +1225,197 @@ struct pkh_inst {
 
 typedef arm_inst * ARM_INST_PTR;
 
-#define CACHE_BUFFER_SIZE    (64 * 1024 * 2000)
+// Precedes the first instruction of every translated block
+struct block_header {
+    // Cycles charged for running the block, see GetInstructionCost
+    unsigned int cost;
+    // Size in bytes of the translated instructions following the header
+    unsigned int size;
+};
+
+static inline const block_header* GetBlockHeader(const arm_inst* first_inst) {
+    return (const block_header*)((const char*)first_inst - sizeof(block_header));
+}
+
+// The translation cache is split into equally sized segments which are filled one after another.
+// When the last one fills up we wrap around and reuse the oldest segment, evicting every block that
+// was translated into it. This keeps the memory footprint bounded while the most recently
+// translated code stays resident.
+#define CACHE_SEGMENT_SIZE   (16 * 1024 * 1024)
+#define CACHE_SEGMENT_COUNT  8
+#define CACHE_BUFFER_SIZE    (CACHE_SEGMENT_SIZE * CACHE_SEGMENT_COUNT)
+
+// Upper bound on the space taken up by a single basic block. Blocks never cross a page boundary, so
+// there is at most one instruction per halfword of the page (in Thumb mode).
+#define MAX_BLOCK_SIZE       (2048 * 128)
+
 static char inst_buf[CACHE_BUFFER_SIZE];
 static int top = 0;
+static int current_segment = 0;
+
+/**
+ * Two-level table used to find the translation of the basic block starting at a guest address. It
+ * mirrors the layout of Memory::PageTable: the first level is indexed by guest page, and the second
+ * level, which holds the inst_buf offset of every block in the page, is only allocated once code in
+ * that page gets translated. Invalidating a page is then just a matter of freeing its entry.
+ */
+struct BlockPage {
+    // One entry per halfword, as Thumb blocks can start at any 2-byte aligned address.
+    static const size_t NUM_ENTRIES = Memory::PAGE_SIZE / 2;
+
+    BlockPage() {
+        entries.fill(-1);
+    }
+
+    /// Offset into inst_buf of the block starting at each address in the page, or -1 if none.
+    std::array<int, NUM_ENTRIES> entries;
+};
+
+static std::array<std::unique_ptr<BlockPage>, 1 << (32 - Memory::PAGE_BITS)> block_table;
+
+/// Guest pages that received blocks translated into each segment, used to find them on eviction.
+static std::array<std::vector<u32>, CACHE_SEGMENT_COUNT> segment_pages;
+
+// Incremented whenever translated blocks are discarded, invalidating all block links.
+static u32 cache_generation = 0;
+
+static inline int FindBlock(u32 addr) {
+    const BlockPage* page = block_table[addr >> Memory::PAGE_BITS].get();
+    if (page == nullptr)
+        return -1;
+    return page->entries[(addr & Memory::PAGE_MASK) >> 1];
+}
+
+static void InsertBlock(u32 addr, int ptr) {
+    const u32 page_index = addr >> Memory::PAGE_BITS;
+    std::unique_ptr<BlockPage>& page = block_table[page_index];
+    if (page == nullptr) {
+        page = Common::make_unique<BlockPage>();
+        block_table_counter.Add(sizeof(BlockPage));
+
+        // Writing to the page drops its blocks, which also ends the watch
+        Memory::WatchCodePage(addr);
+    }
+    page->entries[(addr & Memory::PAGE_MASK) >> 1] = ptr;
+
+    std::vector<u32>& pages = segment_pages[current_segment];
+    if (pages.empty() || pages.back() != page_index)
+        pages.push_back(page_index);
+}
+
+// Incremented whenever guest code may have changed, which makes speculative translations of it that
+// are still in flight stale.
+static u32 code_generation = 0;
+
+/**
+ * State of the block being translated on the speculative translator thread. That thread never
+ * touches guest memory or inst_buf: it reads the instructions from a snapshot of their page taken
+ * by the CPU thread, and translates them into a staging buffer which the CPU thread later copies
+ * into the translation cache (see PublishSpeculativeBlocks).
+ */
+struct SpeculativeTranslation {
+    const u8* page;
+    u32 page_index;
+    char* buffer;
+    unsigned int top;
+
+    void* Alloc(unsigned int size) {
+        const unsigned int start = top;
+        top += size;
+        ASSERT_MSG(top <= MAX_BLOCK_SIZE, "speculative block overflowed its staging buffer");
+        return buffer + start;
+    }
+
+    u32 Read32(u32 addr) const {
+        DEBUG_ASSERT((addr >> Memory::PAGE_BITS) == page_index);
+        u32 value;
+        std::memcpy(&value, page + (addr & Memory::PAGE_MASK), sizeof(value));
+        return value;
+    }
+};
+
+// Only set on the speculative translator thread
+static thread_local SpeculativeTranslation* speculative_translation = nullptr;
+
 static inline void *AllocBuffer(unsigned int size) {
+    if (speculative_translation != nullptr)
+        return speculative_translation->Alloc(size);
+
     int start = top;
     top += size;
-    if (top > CACHE_BUFFER_SIZE) {
-        LOG_ERROR(Core_ARM11, "inst_buf is full");
-        CITRA_IGNORE_EXIT(-1);
-    }
+    ASSERT_MSG(top <= (current_segment + 1) * CACHE_SEGMENT_SIZE, "basic block overflowed its cache segment");
     return (void *)&inst_buf[start];
 }
 
+/// Reads an instruction word for the translator. Blocks never cross a page, nor do the words read
+/// to analyze them, so a snapshot of the block's page is all a speculative translation needs.
+static inline u32 ReadCode(u32 addr) {
+    if (speculative_translation != nullptr)
+        return speculative_translation->Read32(addr);
+    return Memory::FastRead32(addr);
+}
+
+static void EvictCacheSegment(int segment) {
+    const int segment_start = segment * CACHE_SEGMENT_SIZE;
+    const int segment_end = segment_start + CACHE_SEGMENT_SIZE;
+
+    for (u32 page_index : segment_pages[segment]) {
+        BlockPage* page = block_table[page_index].get();
+        if (page == nullptr)
+            continue;
+
+        for (int& entry : page->entries) {
+            if (entry >= segment_start && entry < segment_end)
+                entry = -1;
+        }
+    }
+    segment_pages[segment].clear();
+
+    cache_generation++;
+}
+
+// Makes sure a whole basic block can be translated into the current segment, moving on to (and
+// evicting) the next one if necessary.
+static void ReserveBlockSpace() {
+    if (top + MAX_BLOCK_SIZE <= (current_segment + 1) * CACHE_SEGMENT_SIZE)
+        return;
+
+    current_segment = (current_segment + 1) % CACHE_SEGMENT_COUNT;
+    top = current_segment * CACHE_SEGMENT_SIZE;
+    EvictCacheSegment(current_segment);
+
+    LOG_DEBUG(Core_ARM11, "Translation cache wrapped around to segment %d", current_segment);
+}
+
+void InterpreterClearCache() {
+    for (auto& page : block_table)
+        page.reset();
+    block_table_counter.Set(0);
+    for (auto& pages : segment_pages)
+        pages.clear();
+
+    top = 0;
+    current_segment = 0;
+    cache_generation++;
+    code_generation++;
+}
+
+void InterpreterInvalidateCacheRange(u32 start_address, u32 length) {
+    // Blocks never cross a page boundary, so dropping every page touching the range is enough.
+    const u64 first_page = start_address >> Memory::PAGE_BITS;
+    const u64 last_page = ((u64)start_address + length + Memory::PAGE_MASK) >> Memory::PAGE_BITS;
+
+    for (u64 page_index = first_page; page_index < last_page; ++page_index) {
+        if (block_table[page_index] != nullptr) {
+            block_table[page_index].reset();
+            block_table_counter.Add(-(s64)sizeof(BlockPage));
+        }
+    }
+
+    cache_generation++;
+    code_generation++;
+}
+
 static shtop_fp_t get_shtop(unsigned int inst) {
     if (BIT(inst, 25)) {
         return DPO(Immediate);
@@ -1309,6 +1568,9 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(bbl)(unsigned int inst, int index)
 
     inst_cream->L      = BIT(inst, 24);
     inst_cream->signed_immed_24 = BIT(inst, 23) ? NEGBRANCH : POSBRANCH;
+    inst_cream->taken_link.ptr     = -1;
+    inst_cream->not_taken_link.ptr = -1;
+    inst_cream->idle_loop          = false;
 
     return inst_base;
 }
@@ -3067,6 +3329,7 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(b_2_thumb)(unsigned int tinst, int ind
     b_2_thumb *inst_cream = (b_2_thumb *)inst_base->component;
 
     inst_cream->imm = ((tinst & 0x3FF) << 1) | ((tinst & (1 << 10)) ? 0xFFFFF800 : 0);
+    inst_cream->taken_link.ptr = -1;
 
     inst_base->idx = index;
     inst_base->br  = DIRECT_BRANCH;
@@ -3081,6 +3344,8 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(b_cond_thumb)(unsigned int tinst, int
 
     inst_cream->imm  = (((tinst & 0x7F) << 1) | ((tinst & (1 << 7)) ?    0xFFFFFF00 : 0));
     inst_cream->cond = ((tinst >> 8) & 0xf);
+    inst_cream->taken_link.ptr     = -1;
+    inst_cream->not_taken_link.ptr = -1;
     inst_base->idx   = index;
     inst_base->br    = DIRECT_BRANCH;
 
@@ -3468,6 +3733,34 @@ enum {
     FETCH_FAILURE
 };
 
+static const unsigned int NUM_TRANSLATED_INSTS = sizeof(arm_instruction_trans) / sizeof(transop_fp_t);
+
+// Indices in InstLabel of the handlers which the translator substitutes for those of some
+// instructions. They follow the handlers of the translated instructions, DISPATCH, INIT_INST_LENGTH
+// and END.
+static const unsigned int FUSED_INST_BASE = NUM_TRANSLATED_INSTS + 3;
+enum : unsigned int {
+    FUSED_CMP_BBL = FUSED_INST_BASE,
+    FUSED_TST_BBL,
+    FUSED_MOV_MOV,
+    FUSED_LDR_ADD,
+    LDR_LITERAL,
+    FUSED_BL_THUMB,
+};
+
+// Translates a Thumb BL prefix and the BL suffix following it into a single instruction
+static ARM_INST_PTR TranslateThumbBLPair(u32 first, u32 second) {
+    arm_inst *inst_base = (arm_inst *)AllocBuffer(sizeof(arm_inst) + sizeof(bl_thumb));
+    bl_thumb *inst_cream = (bl_thumb *)inst_base->component;
+
+    inst_cream->imm = (((first & 0x07FF) << 12) | ((first & (1 << 10)) ? 0xFF800000 : 0)) + ((second & 0x07FF) << 1);
+    inst_cream->taken_link.ptr = -1;
+
+    inst_base->idx = FUSED_BL_THUMB;
+    inst_base->br  = DIRECT_BRANCH;
+    return inst_base;
+}
+
 static ThumbDecodeStatus DecodeThumbInstruction(u32 inst, u32 addr, u32* arm_inst, u32* inst_size, ARM_INST_PTR* ptr_inst_base) {
     // Check if in Thumb mode
     ThumbDecodeStatus ret = TranslateThumbInstruction (addr, inst, arm_inst, inst_size);
@@ -3499,6 +3792,17 @@ static ThumbDecodeStatus DecodeThumbInstruction(u32 inst, u32 addr, u32* arm_ins
             *ptr_inst_base = arm_instruction_trans[inst_index](tinstr, inst_index);
             break;
         case 30:
+            // A BL prefix directly followed by its suffix in the same page is translated as one
+            // instruction, which saves a dispatch and can be linked to its target
+            if (((addr + 2) & Memory::PAGE_MASK) != 0) {
+                u32 next_tinstr = GetThumbInstruction(ReadCode((addr + 2) & 0xFFFFFFFC), addr + 2);
+                if ((next_tinstr & 0xF800) == 0xF800) {
+                    *ptr_inst_base = TranslateThumbBLPair(tinstr, next_tinstr);
+                    *inst_size = 4;
+                    break;
+                }
+            }
+
             // For BL 1 thumb instruction
             inst_index = table_length - 3;
             *ptr_inst_base = arm_instruction_trans[inst_index](tinstr, inst_index);
@@ -3521,56 +3825,782 @@ enum {
     FETCH_EXCEPTION
 };
 
-static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
-    Common::Profiling::ScopeTimer timer_decode(profile_decode);
+// Bits tracking the condition flags alongside r0-r15 in the register masks used by IsIdleLoop
+enum : u32 {
+    FLAG_N = 1 << 16,
+    FLAG_Z = 1 << 17,
+    FLAG_C = 1 << 18,
+    FLAG_V = 1 << 19,
+    FLAGS_NZCV = FLAG_N | FLAG_Z | FLAG_C | FLAG_V,
+};
+
+/**
+ * Determines which registers and flags a loop body instruction reads and writes. Only a small set
+ * of side-effect free instructions is recognized: unconditional loads without writeback and data
+ * processing instructions that don't write the PC.
+ * @return false if the instruction isn't one that may appear in an idle loop.
+ */
+static bool GetIdleLoopInstructionEffects(u32 inst, u32& reads, u32& writes) {
+    if (BITS(inst, 28, 31) != AL)
+        return false;
+
+    const u32 rn = BITS(inst, 16, 19);
+    const u32 rd = BITS(inst, 12, 15);
+    if (rd == 15)
+        return false;
+
+    // LDR/LDRB (immediate offset, no writeback)
+    if (BITS(inst, 25, 27) == 2 && BIT(inst, 24) && !BIT(inst, 21) && BIT(inst, 20)) {
+        reads = 1 << rn;
+        writes = 1 << rd;
+        return true;
+    }
+
+    // LDRH/LDRSB/LDRSH (immediate offset, no writeback)
+    if (BITS(inst, 25, 27) == 0 && BIT(inst, 24) && BIT(inst, 22) && !BIT(inst, 21) && BIT(inst, 20) &&
+            BIT(inst, 7) && BIT(inst, 4) && BITS(inst, 5, 6) != 0) {
+        reads = 1 << rn;
+        writes = 1 << rd;
+        return true;
+    }
+
+    // LDREX/LDREXB/LDREXH. Spinning on one only re-tags the same reservation each time around.
+    if ((BITS(inst, 20, 27) == 0x19 || BITS(inst, 20, 27) == 0x1D || BITS(inst, 20, 27) == 0x1F) &&
+            BITS(inst, 0, 11) == 0xF9F) {
+        reads = 1 << rn;
+        writes = 1 << rd;
+        return true;
+    }
+
+    // Data processing, with an immediate or an immediate-shifted register operand
+    if (BITS(inst, 26, 27) == 0 && (BIT(inst, 25) || !BIT(inst, 4))) {
+        const u32 opcode = BITS(inst, 21, 24);
+        const bool set_flags = BIT(inst, 20) != 0;
+        const bool is_compare = opcode >= 8 && opcode <= 11;
+        const bool is_move = opcode == 13 || opcode == 15;
+        const bool is_logical = opcode <= 1 || opcode == 8 || opcode == 9 || opcode >= 12;
+
+        // Compare opcodes without the S bit encode MRS/MSR and other miscellaneous instructions
+        if (is_compare && !set_flags)
+            return false;
+
+        reads = is_move ? 0 : (1 << rn);
+        writes = is_compare ? 0 : (1 << rd);
+
+        if (!BIT(inst, 25)) {
+            reads |= 1 << BITS(inst, 0, 3);
+            // RRX shifts in the carry flag
+            if (BITS(inst, 5, 6) == 3 && BITS(inst, 7, 11) == 0)
+                reads |= FLAG_C;
+        }
+
+        // ADC, SBC and RSC consume the carry flag
+        if (opcode >= 5 && opcode <= 7)
+            reads |= FLAG_C;
+
+        if (set_flags)
+            writes |= is_logical ? (FLAG_N | FLAG_Z) : FLAGS_NZCV;
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Checks whether the ARM code between `start` and the branch at `branch_addr`, which jumps back to
+ * `start`, is a loop that only polls memory. Such a loop computes the same result from the same
+ * inputs on every iteration: no register or flag written in the loop is read before being written,
+ * and nothing is stored. It can't make progress until something external (e.g. a scheduled event)
+ * changes memory, so interpreting it over and over only burns host time.
+ */
+static bool IsIdleLoop(u32 start, u32 branch_addr) {
+    // Only consider tight loops, anything larger is unlikely to be a simple wait
+    static const u32 MAX_IDLE_LOOP_INSTRUCTIONS = 8;
+    if (branch_addr - start > MAX_IDLE_LOOP_INSTRUCTIONS * 4)
+        return false;
+
+    std::array<u32, MAX_IDLE_LOOP_INSTRUCTIONS> reads, writes;
+    u32 loop_writes = 0;
+    for (u32 i = 0; start + i * 4 < branch_addr; ++i) {
+        if (!GetIdleLoopInstructionEffects(ReadCode(start + i * 4), reads[i], writes[i]))
+            return false;
+        loop_writes |= writes[i];
+    }
+
+    // Reading a value before it is (re)written in the same iteration means it was produced by the
+    // previous one, as e.g. in a counting loop.
+    u32 written = 0;
+    for (u32 i = 0; start + i * 4 < branch_addr; ++i) {
+        if (reads[i] & loop_writes & ~written)
+            return false;
+        written |= writes[i];
+    }
+
+    // By now every register and flag written in the loop has been written in this iteration, so
+    // whatever the closing branch's condition depends on is computed afresh each time around.
+    return true;
+}
+
+static bool IsInstruction(const arm_inst* inst_base, transop_fp_t translate) {
+    return inst_base->idx < NUM_TRANSLATED_INSTS && arm_instruction_trans[inst_base->idx] == translate;
+}
+
+/**
+ * Checks whether literal loads from the page containing `addr` can be folded (see FoldLiteralLoad),
+ * which is the case for read-only regular memory. Looks at the address space of the current
+ * process, so it is evaluated on the CPU thread even for speculative translations.
+ */
+static bool CanFoldLiterals(u32 addr) {
+    if (Kernel::g_current_process == nullptr)
+        return false;
+    const Kernel::VMManager& address_space = *Kernel::g_current_process->address_space;
+    Kernel::VMManager::VMAHandle vma = address_space.FindVMA(addr);
+    return vma != address_space.vma_map.end() && vma->second.type != Kernel::VMAType::MMIO &&
+            ((u8)vma->second.permissions & (u8)Kernel::VMAPermission::Write) == 0;
+}
+
+/**
+ * Folds a PC-relative LDR from a literal pool into a move of the loaded value. Only literals which
+ * are in the same page as the load and in read-only memory are folded: the page's blocks are
+ * discarded when its mapping or permissions change, which are the only ways for the value to change.
+ * @param addr Address of the LDR instruction, which has to be an ARM instruction in a page for which
+ *             CanFoldLiterals holds
+ */
+static void FoldLiteralLoad(arm_inst* inst_base, u32 addr) {
+    if (!IsInstruction(inst_base, INTERPRETER_TRANSLATE(ldr)) && !IsInstruction(inst_base, INTERPRETER_TRANSLATE(ldrcond)))
+        return;
+
+    const u32 inst = ((const ldst_inst*)inst_base->component)->inst;
+
+    // LDR Rd, [PC, #+/-imm12] without writeback, and not loading the PC
+    if (BITS(inst, 24, 27) != 5 || BIT(inst, 22) || BIT(inst, 21) || BITS(inst, 16, 19) != 15 || BITS(inst, 12, 15) == 15)
+        return;
+
+    const u32 offset = BITS(inst, 0, 11);
+    const u32 literal_addr = BIT(inst, 23) ? addr + 8 + offset : addr + 8 - offset;
+    if ((literal_addr & 3) != 0 || (literal_addr >> Memory::PAGE_BITS) != (addr >> Memory::PAGE_BITS))
+        return;
+
+    ldr_literal_inst* inst_cream = (ldr_literal_inst*)inst_base->component;
+    inst_cream->Rd = BITS(inst, 12, 15);
+    inst_cream->value = ReadCode(literal_addr);
+    inst_base->idx = LDR_LITERAL;
+}
+
+/**
+ * Replaces the handler of `first` with one that also executes `second`, which follows it in the
+ * same block, if the pair is a frequent one whose fused handler saves a dispatch. The fused
+ * handlers only cover the common path, so both instructions have to be unconditional (except for
+ * the branch), leave the flags alone (except for compares) and must not write the PC.
+ */
+static void FuseInstructions(arm_inst* first, const arm_inst* second) {
+    if (first->cond != AL || first->br != NON_BRANCH)
+        return;
+
+    if (IsInstruction(second, INTERPRETER_TRANSLATE(bbl))) {
+        if (IsInstruction(first, INTERPRETER_TRANSLATE(cmp)))
+            first->idx = FUSED_CMP_BBL;
+        else if (IsInstruction(first, INTERPRETER_TRANSLATE(tst)))
+            first->idx = FUSED_TST_BBL;
+        return;
+    }
+
+    if (second->cond != AL)
+        return;
+
+    if (IsInstruction(first, INTERPRETER_TRANSLATE(mov)) && IsInstruction(second, INTERPRETER_TRANSLATE(mov))) {
+        const mov_inst* first_cream = (const mov_inst*)first->component;
+        const mov_inst* second_cream = (const mov_inst*)second->component;
+        if (!first_cream->S && first_cream->Rd != 15 && !second_cream->S && second_cream->Rd != 15)
+            first->idx = FUSED_MOV_MOV;
+        return;
+    }
+
+    if (IsInstruction(first, INTERPRETER_TRANSLATE(ldr)) && IsInstruction(second, INTERPRETER_TRANSLATE(add))) {
+        const ldst_inst* first_cream = (const ldst_inst*)first->component;
+        const add_inst* second_cream = (const add_inst*)second->component;
+        if (BITS(first_cream->inst, 12, 15) != 15 && !second_cream->S && second_cream->Rd != 15)
+            first->idx = FUSED_LDR_ADD;
+        return;
+    }
+}
+
+/**
+ * Returns the number of cycles charged for an instruction, according to the cost of its class in
+ * the settings. The costs are summed up per block at translation time, so that executing a block
+ * costs the same as executing a single instruction used to.
+ * @param inst The ARM instruction, Thumb instructions have to be translated to ARM ones first
+ */
+static unsigned int GetInstructionCost(u32 inst, const arm_inst* inst_base) {
+    if (inst_base->br != NON_BRANCH)
+        return Settings::values.branch_cost;
+
+    // LDR/STR and their byte variants
+    if (BITS(inst, 26, 27) == 1 && (!BIT(inst, 25) || !BIT(inst, 4)))
+        return Settings::values.memory_access_cost;
+
+    // LDM/STM, each transferred register is a separate access
+    if (BITS(inst, 25, 27) == 4) {
+        unsigned int num_registers = 0;
+        for (u32 list = BITS(inst, 0, 15); list != 0; list &= list - 1)
+            num_registers++;
+        return std::max(num_registers, 1u) * Settings::values.memory_access_cost;
+    }
+
+    if (BITS(inst, 25, 27) == 0 && BIT(inst, 7) && BIT(inst, 4)) {
+        // MUL/MLA/UMULL/UMLAL/SMULL/SMLAL/UMAAL
+        if (BITS(inst, 4, 7) == 9 && !BIT(inst, 24))
+            return Settings::values.multiply_cost;
+        // Halfword and doubleword loads and stores, SWP and the exclusive accesses
+        return Settings::values.memory_access_cost;
+    }
 
+    // SMLA<x><y>, SMLAW<y>, SMULW<y>, SMLAL<x><y> and SMUL<x><y>
+    if (BITS(inst, 23, 27) == 2 && !BIT(inst, 20) && BIT(inst, 7) && !BIT(inst, 4))
+        return Settings::values.multiply_cost;
+
+    // SMLAD/SMUAD/SMLSD/SMUSD/SMLALD/SMLSLD/SMMLA/SMMUL/SMMLS
+    if (BITS(inst, 23, 27) == 0xE && BIT(inst, 4) && !BIT(inst, 7))
+        return Settings::values.multiply_cost;
+
+    // VFP data processing, transfers, loads and stores
+    if (BITS(inst, 25, 27) >= 6 && BITS(inst, 24, 27) != 0xF && (BITS(inst, 8, 11) == 10 || BITS(inst, 8, 11) == 11))
+        return Settings::values.vfp_cost;
+
+    return 1;
+}
+
+/// Addresses at which a translated block can directly continue, in the same instruction set
+struct BlockExits {
+    std::array<u32, 2> addrs;
+    unsigned int count = 0;
+
+    void Add(u32 addr) {
+        addrs[count++] = addr;
+    }
+};
+
+/**
+ * Translates the basic block starting at `pc_start`, into inst_buf on the CPU thread and into the
+ * staging buffer on the speculative translator thread.
+ * @param thumb Whether the block is Thumb code
+ * @param fold_literals Whether literal loads may be folded, see CanFoldLiterals
+ * @param exits Receives the static successors of the block: the targets of its closing branch, and
+ *              the instruction following it if execution can continue there
+ * @return Header of the block, or nullptr if a speculative translation ran into an instruction
+ *         which can't be decoded
+ */
+static block_header* TranslateBlock(u32 pc_start, bool thumb, bool fold_literals, BlockExits& exits) {
     // Decode instruction, get index
     // Allocate memory and init InsCream
     // Go on next, until terminal instruction
-    // Save start addr of basicblock in CreamCache
     ARM_INST_PTR inst_base = nullptr;
     unsigned int inst, inst_size = 4;
     int idx;
     int ret = NON_BRANCH;
-    int size = 0; // instruction size of basic block
-    bb_start = top;
+    bool falls_through = false;
+    const bool speculative = speculative_translation != nullptr;
+
+    block_header* header = (block_header*)AllocBuffer(sizeof(block_header));
+    header->cost = 0;
 
-    u32 phys_addr = addr;
-    u32 pc_start = cpu->Reg[15];
+    u32 phys_addr = pc_start;
+    ARM_INST_PTR prev_inst_base = nullptr;
 
     while (ret == NON_BRANCH) {
-        inst = Memory::Read32(phys_addr & 0xFFFFFFFC);
+        inst = ReadCode(phys_addr & 0xFFFFFFFC);
 
-        size++;
         // If we are in Thumb mode, we'll translate one Thumb instruction to the corresponding ARM instruction
-        if (cpu->TFlag) {
+        if (thumb) {
             uint32_t arm_inst;
             ThumbDecodeStatus state = DecodeThumbInstruction(inst, phys_addr, &arm_inst, &inst_size, &inst_base);
 
             // We have translated the Thumb branch instruction in the Thumb decoder
             if (state == ThumbDecodeStatus::BRANCH) {
+                // Invalid branch encodings leave inst_base alone. Speculative targets can be data,
+                // which easily contains them.
+                if (speculative && inst_base == prev_inst_base)
+                    return nullptr;
+
+                // BL prefixes are translated here too, but don't end the block
+                header->cost += inst_base->br != NON_BRANCH ? Settings::values.branch_cost : 1;
                 goto translated;
             }
             inst = arm_inst;
         }
 
         if (DecodeARMInstruction(inst, &idx) == ARMDecodeStatus::FAILURE) {
+            // Only report failures in code that is actually run
+            if (speculative)
+                return nullptr;
+
             std::string disasm = ARM_Disasm::Disassemble(phys_addr, inst);
             LOG_ERROR(Core_ARM11, "Decode failure.\tPC : [0x%x]\tInstruction : %s [%x]", phys_addr, disasm.c_str(), inst);
-            LOG_ERROR(Core_ARM11, "cpsr=0x%x, cpu->TFlag=%d, r15=0x%x", cpu->Cpsr, cpu->TFlag, cpu->Reg[15]);
+            LOG_ERROR(Core_ARM11, "thumb=%d, block start=0x%x", thumb, pc_start);
             CITRA_IGNORE_EXIT(-1);
         }
         inst_base = arm_instruction_trans[idx](inst, idx);
+        header->cost += GetInstructionCost(inst, inst_base);
 translated:
+        if (!thumb && fold_literals)
+            FoldLiteralLoad(inst_base, phys_addr);
+
         phys_addr += inst_size;
 
+        if (prev_inst_base != nullptr)
+            FuseInstructions(prev_inst_base, inst_base);
+        prev_inst_base = inst_base;
+
         if ((phys_addr & 0xfff) == 0) {
+            falls_through = inst_base->br == NON_BRANCH;
             inst_base->br = END_OF_PAGE;
         }
         ret = inst_base->br;
     };
 
-    cpu->instruction_cache[pc_start] = bb_start;
+    if (!thumb && IsInstruction(inst_base, INTERPRETER_TRANSLATE(bbl))) {
+        bbl_inst* inst_cream = (bbl_inst*)inst_base->component;
+        const u32 branch_addr = phys_addr - 4;
+        const u32 target = branch_addr + 8 + inst_cream->signed_immed_24;
+
+        // Mark loops that just wait for something to change in memory, so that their execution can
+        // be cut short (see BBL_INST)
+        if (!inst_cream->L && target == pc_start && IsIdleLoop(pc_start, branch_addr)) {
+            LOG_TRACE(Core_ARM11, "Idle loop detected at 0x%08X", pc_start);
+            inst_cream->idle_loop = true;
+        }
+
+        // A call returns to the next instruction
+        exits.Add(target);
+        if (inst_base->cond != AL || inst_cream->L)
+            exits.Add(phys_addr);
+    } else if (thumb && IsInstruction(inst_base, INTERPRETER_TRANSLATE(b_2_thumb))) {
+        exits.Add(phys_addr + 2 + ((b_2_thumb*)inst_base->component)->imm);
+    } else if (thumb && IsInstruction(inst_base, INTERPRETER_TRANSLATE(b_cond_thumb))) {
+        exits.Add(phys_addr + 2 + ((b_cond_thumb*)inst_base->component)->imm);
+        exits.Add(phys_addr);
+    } else if (thumb && inst_base->idx == FUSED_BL_THUMB) {
+        exits.Add(phys_addr + ((bl_thumb*)inst_base->component)->imm);
+        exits.Add(phys_addr);
+    } else if (falls_through) {
+        exits.Add(phys_addr);
+    }
+
+    // Allocating nothing returns the end of the block
+    header->size = (unsigned int)((char*)AllocBuffer(0) - (char*)(header + 1));
+
+    return header;
+}
+
+/**
+ * Speculative translation
+ *
+ * Blocks reached through static branches from a newly translated block are likely to run soon, so
+ * they are handed to a worker thread which translates them in the background. All translation cache
+ * state (inst_buf, the block table, eviction and invalidation) stays owned by the CPU thread, which
+ * needs no locking on its lookup path: jobs travel between the threads through lock-free rings, and
+ * the CPU thread copies finished blocks into the cache and inserts them into the block table the next
+ * time a lookup misses. The targets of published blocks are speculated on in turn, following the
+ * call graph a few levels deep.
+ */
+struct SpeculationJob {
+    // Filled in by the CPU thread
+    u32 addr;
+    bool thumb;
+    bool fold_literals;
+    unsigned int depth;
+    u32 code_generation;
+    std::array<u8, Memory::PAGE_SIZE> page;
+    // Only looked at by the CPU thread, set while the job is on its way through the rings
+    bool in_flight = false;
+
+    // Filled in by the speculative translator thread
+    bool translated;
+    std::vector<char> block; ///< Block header followed by the instructions
+    BlockExits exits;
+};
+
+/// Number of blocks translated speculatively at most at any time
+static const size_t NUM_SPECULATION_JOBS = 16;
+/// How many branches away from code translated on demand blocks are speculated on
+static const unsigned int MAX_SPECULATION_DEPTH = 3;
+
+static std::array<SpeculationJob, NUM_SPECULATION_JOBS> speculation_jobs;
+/// Jobs which are neither requested nor finished, only accessed by the CPU thread
+static std::vector<SpeculationJob*> free_speculation_jobs;
+static Common::RingBuffer<SpeculationJob*, NUM_SPECULATION_JOBS> speculation_requests;
+static Common::RingBuffer<SpeculationJob*, NUM_SPECULATION_JOBS> speculation_results;
+
+static std::thread speculation_thread;
+static Common::Event speculation_event;
+static std::atomic<bool> speculation_stop;
+/// Whether the speculative translator thread is running, only accessed by the CPU thread
+static bool speculation_active = false;
+
+static void SpeculativeTranslatorLoop() {
+    std::vector<char> buffer(MAX_BLOCK_SIZE);
+    SpeculativeTranslation translation;
+    translation.buffer = buffer.data();
+    speculative_translation = &translation;
+
+    while (true) {
+        SpeculationJob* job;
+        if (speculation_requests.Pop(&job, 1) == 0) {
+            if (speculation_stop.load(std::memory_order_acquire))
+                break;
+            speculation_event.Wait();
+            continue;
+        }
+
+        translation.page = job->page.data();
+        translation.page_index = job->addr >> Memory::PAGE_BITS;
+        translation.top = 0;
+
+        job->exits.count = 0;
+        job->translated = TranslateBlock(job->addr, job->thumb, job->fold_literals, job->exits) != nullptr;
+        if (job->translated)
+            job->block.assign(buffer.data(), buffer.data() + translation.top);
+
+        // Can't fail, the ring has room for every job
+        speculation_results.Push(&job, 1);
+    }
+
+    speculative_translation = nullptr;
+}
+
+static void StartSpeculation() {
+    free_speculation_jobs.clear();
+    for (SpeculationJob& job : speculation_jobs) {
+        job.in_flight = false;
+        free_speculation_jobs.push_back(&job);
+    }
+
+    speculation_stop.store(false, std::memory_order_relaxed);
+    speculation_thread = std::thread(SpeculativeTranslatorLoop);
+    speculation_active = true;
+}
+
+/// Queues the block starting at `addr` for speculative translation, if it isn't known yet
+static void RequestSpeculation(u32 addr, bool thumb, unsigned int depth) {
+    if (!speculation_active || free_speculation_jobs.empty() || FindBlock(addr) != -1)
+        return;
+
+    // Only regular memory can be snapshotted, reading I/O registers has side effects
+    const u8* page_pointer = Memory::current_page_pointers[addr >> Memory::PAGE_BITS];
+    if (page_pointer == nullptr)
+        return;
+
+    for (const SpeculationJob& job : speculation_jobs) {
+        if (job.in_flight && job.addr == addr)
+            return;
+    }
+
+    SpeculationJob* job = free_speculation_jobs.back();
+    free_speculation_jobs.pop_back();
+
+    job->addr = addr;
+    job->thumb = thumb;
+    job->fold_literals = !thumb && CanFoldLiterals(addr);
+    job->depth = depth;
+    job->code_generation = code_generation;
+    std::memcpy(job->page.data(), page_pointer, Memory::PAGE_SIZE);
+    job->in_flight = true;
+
+    // A write to the page invalidates it and with that the snapshot
+    Memory::WatchCodePage(addr);
+
+    speculation_requests.Push(&job, 1);
+    speculation_event.Set();
+}
+
+static void RequestSpeculation(const BlockExits& exits, bool thumb, unsigned int depth) {
+    for (unsigned int i = 0; i < exits.count; ++i)
+        RequestSpeculation(exits.addrs[i], thumb, depth);
+}
+
+/**
+ * Copies the blocks finished by the speculative translator into the translation cache.
+ * @return Whether any block was added
+ */
+static bool PublishSpeculativeBlocks() {
+    bool published = false;
+
+    SpeculationJob* job;
+    while (speculation_results.Pop(&job, 1) != 0) {
+        job->in_flight = false;
+
+        // Drop blocks translated from code which has been invalidated since, or which were
+        // translated on demand in the meantime
+        if (!job->translated || job->code_generation != code_generation || FindBlock(job->addr) != -1) {
+            free_speculation_jobs.push_back(job);
+            continue;
+        }
+
+        ReserveBlockSpace();
+        char* block = (char*)AllocBuffer(job->block.size());
+        std::memcpy(block, job->block.data(), job->block.size());
+        InsertBlock(job->addr, (int)(block + sizeof(block_header) - inst_buf));
+        translation_cache_counter.SetMax(top);
+        published = true;
+
+        const BlockExits exits = job->exits;
+        const bool thumb = job->thumb;
+        const unsigned int depth = job->depth;
+        free_speculation_jobs.push_back(job);
+
+        if (depth < MAX_SPECULATION_DEPTH)
+            RequestSpeculation(exits, thumb, depth + 1);
+    }
+
+    return published;
+}
+
+/*
+ * Disk translation cache
+ *
+ * Translated blocks are plain data apart from pointers to the handlers in shtop_func and get_addr,
+ * which stay valid as long as the same build is loaded at the same address. At shutdown the blocks
+ * of the running title are written to a file of its own, grouped by guest page along with a hash of
+ * the page's contents. The next boot of the title copies the blocks of every page whose contents
+ * still match back into the translation cache, instead of translating them again as they run.
+ */
+static const u32 DISK_CACHE_MAGIC = 0x43544344; // "DCTC"
+static const u32 DISK_CACHE_VERSION = 1;
+
+struct DiskCacheHeader {
+    u32 magic;
+    u32 version;
+    /// Identifies the build which wrote the file, block layouts and handlers differ between builds
+    u64 build_id;
+    /// Address of a translation handler, so that relocated builds (e.g. with ASLR) are detected
+    u64 handler_address;
+    /// Settings baked into the blocks at translation time
+    u32 memory_access_cost;
+    u32 multiply_cost;
+    u32 vfp_cost;
+    u32 branch_cost;
+    /// Value of cache_generation when the file was written, later than that of every block link
+    u32 cache_generation;
+    u32 num_pages;
+};
+
+// Each page record is followed by its blocks, each stored as its guest address followed by the block
+// header and the translated instructions
+struct DiskCachePage {
+    u32 page_index;
+    u32 num_blocks;
+    u64 hash;
+    /// Whether literal loads were folded, which is only valid while the page stays read-only
+    u32 fold_literals;
+    u32 padding;
+};
+
+static bool disk_cache_loaded = false;
+
+static void FillDiskCacheHeader(DiskCacheHeader& header) {
+    const std::string build = std::string(Common::g_scm_rev) + __DATE__ " " __TIME__;
+
+    header.magic = DISK_CACHE_MAGIC;
+    header.version = DISK_CACHE_VERSION;
+    header.build_id = Common::ComputeHash64(build.data(), build.size());
+    header.handler_address = (u64)reinterpret_cast<uintptr_t>(arm_instruction_trans[0]);
+    header.memory_access_cost = Settings::values.memory_access_cost;
+    header.multiply_cost = Settings::values.multiply_cost;
+    header.vfp_cost = Settings::values.vfp_cost;
+    header.branch_cost = Settings::values.branch_cost;
+    header.cache_generation = cache_generation;
+    header.num_pages = 0;
+}
+
+static std::string GetDiskCachePath() {
+    const u64 program_id = Kernel::g_current_process->codeset->program_id;
+    return Common::StringFromFormat("%sdyncom/%08x%08x.bin", FileUtil::GetUserPath(D_CACHE_IDX).c_str(),
+                                    (u32)(program_id >> 32), (u32)(program_id & 0xFFFFFFFF));
+}
+
+static void LoadDiskCache() {
+    disk_cache_loaded = true;
+
+    if (Kernel::g_current_process == nullptr)
+        return;
+
+    const std::string path = GetDiskCachePath();
+    std::vector<u8> data;
+    {
+        FileUtil::IOFile file(path, "rb");
+        if (!file.IsOpen())
+            return;
+        data.resize(file.GetSize());
+        if (file.ReadBytes(data.data(), data.size()) != data.size())
+            return;
+    }
+
+    DiskCacheHeader header, expected_header;
+    FillDiskCacheHeader(expected_header);
+    if (data.size() < sizeof(header))
+        return;
+    std::memcpy(&header, data.data(), sizeof(header));
+    expected_header.cache_generation = header.cache_generation;
+    expected_header.num_pages = header.num_pages;
+    if (std::memcmp(&header, &expected_header, sizeof(header)) != 0) {
+        LOG_INFO(Core_ARM11, "Ignoring translation cache %s written by a different build or with different settings", path.c_str());
+        return;
+    }
+
+    size_t offset = sizeof(header);
+    unsigned int num_pages = 0, num_blocks = 0;
+    bool truncated = false;
+    for (u32 i = 0; i < header.num_pages && !truncated; ++i) {
+        DiskCachePage page;
+        if (data.size() - offset < sizeof(page)) {
+            truncated = true;
+            break;
+        }
+        std::memcpy(&page, &data[offset], sizeof(page));
+        offset += sizeof(page);
+
+        const u8* page_pointer = page.page_index < block_table.size() ? Memory::current_page_pointers[page.page_index] : nullptr;
+        const bool valid = page_pointer != nullptr &&
+                Common::ComputeHash64(page_pointer, Memory::PAGE_SIZE) == page.hash &&
+                (!page.fold_literals || CanFoldLiterals(page.page_index << Memory::PAGE_BITS));
+
+        for (u32 j = 0; j < page.num_blocks; ++j) {
+            u32 addr;
+            block_header block;
+            if (data.size() - offset < sizeof(addr) + sizeof(block)) {
+                truncated = true;
+                break;
+            }
+            std::memcpy(&addr, &data[offset], sizeof(addr));
+            std::memcpy(&block, &data[offset + sizeof(addr)], sizeof(block));
+            offset += sizeof(addr);
+
+            const size_t block_size = sizeof(block) + block.size;
+            if (block_size > MAX_BLOCK_SIZE || data.size() - offset < block_size) {
+                truncated = true;
+                break;
+            }
+
+            if (valid && (addr >> Memory::PAGE_BITS) == page.page_index && FindBlock(addr) == -1) {
+                ReserveBlockSpace();
+                char* dest = (char*)AllocBuffer(block_size);
+                std::memcpy(dest, &data[offset], block_size);
+                InsertBlock(addr, (int)(dest + sizeof(block_header) - inst_buf));
+                num_blocks++;
+            }
+            offset += block_size;
+        }
+        if (valid)
+            num_pages++;
+    }
+
+    if (truncated || offset != data.size())
+        LOG_WARNING(Core_ARM11, "Translation cache %s is truncated", path.c_str());
+
+    // The links between the loaded blocks refer to their locations in the cache when it was
+    // written, make sure none of them is followed
+    cache_generation = std::max(cache_generation, header.cache_generation) + 1;
+    translation_cache_counter.SetMax(top);
+
+    LOG_INFO(Core_ARM11, "Loaded %u translated blocks in %u pages from %s", num_blocks, num_pages, path.c_str());
+}
+
+void InterpreterSaveCache() {
+    if (!Settings::values.use_disk_translation_cache || Kernel::g_current_process == nullptr)
+        return;
+
+    DiskCacheHeader header;
+    FillDiskCacheHeader(header);
+
+    std::vector<u8> data(sizeof(header));
+    auto append = [&data](const void* bytes, size_t size) {
+        data.insert(data.end(), (const u8*)bytes, (const u8*)bytes + size);
+    };
+
+    for (u32 page_index = 0; page_index < block_table.size(); ++page_index) {
+        const BlockPage* page = block_table[page_index].get();
+        const u8* page_pointer = Memory::current_page_pointers[page_index];
+        if (page == nullptr || page_pointer == nullptr)
+            continue;
+
+        const size_t page_offset = data.size();
+        DiskCachePage page_record = {};
+        page_record.page_index = page_index;
+        page_record.hash = Common::ComputeHash64(page_pointer, Memory::PAGE_SIZE);
+        page_record.fold_literals = CanFoldLiterals(page_index << Memory::PAGE_BITS);
+        append(&page_record, sizeof(page_record));
+
+        for (size_t i = 0; i < BlockPage::NUM_ENTRIES; ++i) {
+            const int entry = page->entries[i];
+            if (entry == -1)
+                continue;
+
+            const u32 addr = (page_index << Memory::PAGE_BITS) | (u32)(i << 1);
+            const arm_inst* first_inst = (const arm_inst*)&inst_buf[entry];
+            append(&addr, sizeof(addr));
+            append(GetBlockHeader(first_inst), sizeof(block_header) + GetBlockHeader(first_inst)->size);
+            page_record.num_blocks++;
+        }
+
+        if (page_record.num_blocks == 0) {
+            data.resize(page_offset);
+            continue;
+        }
+        std::memcpy(&data[page_offset], &page_record, sizeof(page_record));
+        header.num_pages++;
+    }
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    // Write to a temporary file first, so that an interrupted write doesn't leave a corrupt cache
+    const std::string path = GetDiskCachePath();
+    const std::string temp_path = path + ".tmp";
+    bool written;
+    {
+        FileUtil::IOFile file;
+        written = FileUtil::CreateFullPath(path) && file.Open(temp_path, "wb") &&
+                  file.WriteBytes(data.data(), data.size()) == data.size();
+    }
+    if (!written || !FileUtil::Rename(temp_path, path)) {
+        LOG_WARNING(Core_ARM11, "Failed to write translation cache %s", path.c_str());
+        FileUtil::Delete(temp_path);
+        return;
+    }
+
+    LOG_INFO(Core_ARM11, "Saved %u pages of translated blocks to %s", header.num_pages, path.c_str());
+}
+
+void InterpreterShutdown() {
+    disk_cache_loaded = false;
+
+    if (!speculation_active)
+        return;
+
+    speculation_stop.store(true, std::memory_order_release);
+    speculation_event.Set();
+    speculation_thread.join();
+    speculation_active = false;
+
+    // Throw away whatever was still in flight
+    SpeculationJob* job;
+    while (speculation_requests.Pop(&job, 1) != 0) {}
+    while (speculation_results.Pop(&job, 1) != 0) {}
+}
+
+static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
+    Common::Profiling::ScopeTimer timer_decode(profile_decode);
+
+    const bool thumb = cpu->TFlag != 0;
+
+    ReserveBlockSpace();
+    BlockExits exits;
+    block_header* header = TranslateBlock(addr, thumb, !thumb && CanFoldLiterals(addr), exits);
+    bb_start = (int)((char*)header + sizeof(block_header) - inst_buf);
+
+    InsertBlock(addr, bb_start);
+    translation_cache_counter.SetMax(top);
+
+    RequestSpeculation(exits, thumb, 1);
 
     return KEEP_GOING;
 }
@@ -3590,6 +4620,11 @@ static int clz(unsigned int x) {
 unsigned InterpreterMainLoop(ARMul_State* cpu) {
     Common::Profiling::ScopeTimer timer_execute(profile_execute);
 
+    if (Settings::values.use_speculative_translation && !speculation_active)
+        StartSpeculation();
+    if (Settings::values.use_disk_translation_cache && !disk_cache_loaded)
+        LoadDiskCache();
+
     #undef RM
     #undef RS
 
@@ -3614,6 +4649,21 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     #define INC_PC(l)   ptr += sizeof(arm_inst) + l
     #define INC_PC_STUB ptr += sizeof(arm_inst)
 
+    // Direct branches remember which block they transferred control to, so that hot loops can chain
+    // block-to-block without looking up the instruction cache. If the branch has not been linked
+    // yet (or an interrupt is pending), we go through DISPATCH, which fills in the link afterwards.
+    #define GOTO_LINKED_BLOCK(link) \
+        if (!profile_blocks && (link).ptr != -1 && (link).generation == cache_generation && \
+                (cpu->NirqSig || (cpu->Cpsr & 0x80))) { \
+            ptr = (link).ptr; \
+            inst_base = (arm_inst *)&inst_buf[ptr]; \
+            ticks += GetBlockHeader(inst_base)->cost; \
+            GOTO_NEXT_INST; \
+        } \
+        pending_link = &(link); \
+        pending_link_generation = cache_generation; \
+        goto DISPATCH
+
 // GCC and Clang have a C++ extension to support a lookup table of labels. Otherwise, fallback to a
 // clunky switch statement.
 #if defined __GNUC__ || defined __clang__
@@ -3832,14 +4882,21 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     case 203: goto DISPATCH; \
     case 204: goto INIT_INST_LENGTH; \
     case 205: goto END; \
+    case 206: goto CMP_BBL_INST; \
+    case 207: goto TST_BBL_INST; \
+    case 208: goto MOV_MOV_INST; \
+    case 209: goto LDR_ADD_INST; \
+    case 210: goto LDR_LITERAL_INST; \
+    case 211: goto BL_THUMB; \
     }
 #endif
 
-    #define UPDATE_NFLAG(dst)    (cpu->NFlag = BIT(dst, 31) ? 1 : 0)
+    #define UPDATE_NFLAG(dst)    (MaterializeFlags(cpu), cpu->NFlag = BIT(dst, 31) ? 1 : 0)
     #define UPDATE_ZFLAG(dst)    (cpu->ZFlag = dst ? 0 : 1)
     #define UPDATE_CFLAG_WITH_SC (cpu->CFlag = cpu->shifter_carry_out)
 
-    #define SAVE_NZCVT cpu->Cpsr = (cpu->Cpsr & 0x0fffffdf) | \
+    #define SAVE_NZCVT MaterializeFlags(cpu); \
+                      cpu->Cpsr = (cpu->Cpsr & 0x0fffffdf) | \
                       (cpu->NFlag << 31) | \
                       (cpu->ZFlag << 30) | \
                       (cpu->CFlag << 29) | \
@@ -3849,7 +4906,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                        cpu->ZFlag = (cpu->Cpsr >> 30) & 1; \
                        cpu->CFlag = (cpu->Cpsr >> 29) & 1; \
                        cpu->VFlag = (cpu->Cpsr >> 28) & 1; \
-                       cpu->TFlag = (cpu->Cpsr >> 5) & 1;
+                       cpu->TFlag = (cpu->Cpsr >> 5) & 1; \
+                       cpu->lazy_flags_pending = false;
 
     #define CurrentModeHasSPSR (cpu->Mode != SYSTEM32MODE) && (cpu->Mode != USER32MODE)
     #define PC (cpu->Reg[15])
@@ -3881,18 +4939,38 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         &&LDRB_INST,&&STRB_INST,&&LDR_INST,&&LDRCOND_INST, &&STR_INST,&&CDP_INST,&&STC_INST,&&LDC_INST, &&LDREXD_INST,
         &&STREXD_INST,&&LDREXH_INST,&&STREXH_INST, &&NOP_INST, &&YIELD_INST, &&WFE_INST, &&WFI_INST, &&SEV_INST, &&SWI_INST,&&BBL_INST,
         &&B_2_THUMB, &&B_COND_THUMB,&&BL_1_THUMB, &&BL_2_THUMB, &&BLX_1_THUMB, &&DISPATCH,
-        &&INIT_INST_LENGTH,&&END
+        &&INIT_INST_LENGTH,&&END,
+
+        &&CMP_BBL_INST, &&TST_BBL_INST, &&MOV_MOV_INST, &&LDR_ADD_INST, &&LDR_LITERAL_INST, &&BL_THUMB
         };
 #endif
     arm_inst* inst_base;
     unsigned int addr;
     unsigned int num_instrs = 0;
+    // Cycles charged for the executed blocks. The instruction limit is still checked against
+    // num_instrs, as a block is charged in full as soon as it's entered.
+    unsigned int ticks = 0;
 
     int ptr;
+    block_link* pending_link = nullptr;
+    u32 pending_link_generation = 0;
+
+    // When block profiling is enabled, every block entry goes through DISPATCH (links aren't
+    // followed), where the instructions executed since the previous dispatch are accounted.
+    Common::Profiling::BlockProfiler& block_profiler = Common::Profiling::GetBlockProfiler();
+    const bool profile_blocks = block_profiler.IsEnabled();
+    bool in_profiled_block = false;
+    u32 profiled_block_pc = 0;
+    unsigned int profiled_block_start = 0;
 
     LOAD_NZCVT;
     DISPATCH:
     {
+        if (in_profiled_block) {
+            block_profiler.AddExecution(profiled_block_pc, num_instrs - profiled_block_start);
+            in_profiled_block = false;
+        }
+
         if (!cpu->NirqSig) {
             if (!(cpu->Cpsr & 0x80)) {
                 goto END;
@@ -3905,15 +4983,31 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             cpu->Reg[15] &= 0xfffffffc;
 
         // Find the cached instruction cream, otherwise translate it...
-        auto itr = cpu->instruction_cache.find(cpu->Reg[15]);
-        if (itr != cpu->instruction_cache.end()) {
-            ptr = itr->second;
-        } else {
+        ptr = FindBlock(cpu->Reg[15]);
+        if (ptr == -1 && PublishSpeculativeBlocks())
+            ptr = FindBlock(cpu->Reg[15]);
+        if (ptr == -1) {
             if (InterpreterTranslate(cpu, ptr, cpu->Reg[15]) == FETCH_EXCEPTION)
                 goto END;
         }
 
+        // Only record the link if the block containing the branch wasn't evicted by the translation
+        if (pending_link != nullptr) {
+            if (pending_link_generation == cache_generation) {
+                pending_link->ptr = ptr;
+                pending_link->generation = cache_generation;
+            }
+            pending_link = nullptr;
+        }
+
+        if (profile_blocks) {
+            in_profiled_block = true;
+            profiled_block_pc = cpu->Reg[15];
+            profiled_block_start = num_instrs;
+        }
+
         inst_base = (arm_inst *)&inst_buf[ptr];
+        ticks += GetBlockHeader(inst_base)->cost;
         GOTO_NEXT_INST;
     }
     ADC_INST:
@@ -3925,9 +5019,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(rn_val, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            const u32 left = rn_val;
+            const u32 right = SHIFTER_OPERAND;
+            const u32 carry_in = GetCarryFlag(cpu);
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -3936,10 +5031,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(adc_inst));
@@ -3960,9 +5052,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(rn_val, SHIFTER_OPERAND, 0, &carry, &overflow);
+            const u32 left = rn_val;
+            const u32 right = SHIFTER_OPERAND;
+            const u32 carry_in = 0;
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -3971,10 +5064,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(add_inst));
@@ -4022,18 +5112,24 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     }
     BBL_INST:
     {
+        bbl_inst *inst_cream = (bbl_inst *)inst_base->component;
         if ((inst_base->cond == 0xe) || CondPassed(cpu, inst_base->cond)) {
-            bbl_inst *inst_cream = (bbl_inst *)inst_base->component;
             if (inst_cream->L) {
                 LINK_RTN_ADDR;
             }
             SET_PC;
             INC_PC(sizeof(bbl_inst));
-            goto DISPATCH;
+            // Running the loop again can't change anything, so stop here and let the core skip
+            // ahead to the next event instead
+            if (inst_cream->idle_loop) {
+                cpu->idle_loop_detected = true;
+                goto END;
+            }
+            GOTO_LINKED_BLOCK(inst_cream->taken_link);
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(bbl_inst));
-        goto DISPATCH;
+        GOTO_LINKED_BLOCK(inst_cream->not_taken_link);
     }
     BIC_INST:
     {
@@ -4139,7 +5235,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             // Undefined instruction here
             cpu->NumInstrsToExecute = 0;
-            return num_instrs;
+            return ticks;
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(cdp_inst));
@@ -4175,14 +5271,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            u32 result = AddWithCarry(rn_val, SHIFTER_OPERAND, 0, &carry, &overflow);
-
-            UPDATE_NFLAG(result);
-            UPDATE_ZFLAG(result);
-            cpu->CFlag = carry;
-            cpu->VFlag = overflow;
+            SetLazyAddFlags(cpu, rn_val, SHIFTER_OPERAND, 0);
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(cmn_inst));
@@ -4198,14 +5287,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            u32 result = AddWithCarry(rn_val, ~SHIFTER_OPERAND, 1, &carry, &overflow);
-
-            UPDATE_NFLAG(result);
-            UPDATE_ZFLAG(result);
-            cpu->CFlag = carry;
-            cpu->VFlag = overflow;
+            SetLazyAddFlags(cpu, rn_val, ~SHIFTER_OPERAND, 1);
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(cmp_inst));
@@ -4464,7 +5546,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
 
-            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::Read8(addr);
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::FastRead8(addr);
 
             if (BITS(inst_cream->inst, 12, 15) == 15) {
                 INC_PC(sizeof(ldst_inst));
@@ -4482,7 +5564,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
 
-            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::Read8(addr);
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::FastRead8(addr);
 
             if (BITS(inst_cream->inst, 12, 15) == 15) {
                 INC_PC(sizeof(ldst_inst));
@@ -4541,7 +5623,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
 
             cpu->SetExclusiveMemoryAddress(read_addr);
 
-            RD = Memory::Read8(read_addr);
+            RD = Memory::FastRead8(read_addr);
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(generic_arm_inst));
                 goto DISPATCH;
@@ -4614,7 +5696,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
-            unsigned int value = Memory::Read8(addr);
+            unsigned int value = Memory::FastRead8(addr);
             if (BIT(value, 7)) {
                 value |= 0xffffff00;
             }
@@ -5179,9 +6261,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(~rn_val, SHIFTER_OPERAND, 1, &carry, &overflow);
+            const u32 left = ~rn_val;
+            const u32 right = SHIFTER_OPERAND;
+            const u32 carry_in = 1;
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -5190,10 +6273,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(rsb_inst));
@@ -5214,9 +6294,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(~rn_val, SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            const u32 left = ~rn_val;
+            const u32 right = SHIFTER_OPERAND;
+            const u32 carry_in = GetCarryFlag(cpu);
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -5225,10 +6306,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(rsc_inst));
@@ -5358,9 +6436,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(rn_val, ~SHIFTER_OPERAND, cpu->CFlag, &carry, &overflow);
+            const u32 left = rn_val;
+            const u32 right = ~SHIFTER_OPERAND;
+            const u32 carry_in = GetCarryFlag(cpu);
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -5369,10 +6448,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(sbc_inst));
@@ -5628,6 +6704,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             RDLO = BITS(rst,  0, 31);
             RDHI = BITS(rst, 32, 63);
             if (inst_cream->S) {
+                MaterializeFlags(cpu);
                 cpu->NFlag = BIT(RDHI, 31);
                 cpu->ZFlag = (RDHI == 0 && RDLO == 0);
             }
@@ -5805,6 +6882,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             RDLO = BITS(rst,  0, 31);
 
             if (inst_cream->S) {
+                MaterializeFlags(cpu);
                 cpu->NFlag = BIT(RDHI, 31);
                 cpu->ZFlag = (RDHI == 0 && RDLO == 0);
             }
@@ -6032,7 +7110,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
             unsigned int value = cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff;
-            Memory::Write8(addr, value);
+            Memory::FastWrite8(addr, value);
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(ldst_inst));
@@ -6045,7 +7123,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
             unsigned int value = cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff;
-            Memory::Write8(addr, value);
+            Memory::FastWrite8(addr, value);
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
         INC_PC(sizeof(ldst_inst));
@@ -6096,7 +7174,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
 
             if (cpu->IsExclusiveMemoryAccess(write_addr)) {
                 cpu->UnsetExclusiveMemoryAddress();
-                Memory::Write8(write_addr, cpu->Reg[inst_cream->Rm]);
+                Memory::FastWrite8(write_addr, cpu->Reg[inst_cream->Rm]);
                 RD = 0;
             } else {
                 // Failed to write due to mutex access
@@ -6196,9 +7274,10 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             if (inst_cream->Rn == 15)
                 rn_val += 2 * cpu->GetInstructionSize();
 
-            bool carry;
-            bool overflow;
-            RD = AddWithCarry(rn_val, ~SHIFTER_OPERAND, 1, &carry, &overflow);
+            const u32 left = rn_val;
+            const u32 right = ~SHIFTER_OPERAND;
+            const u32 carry_in = 1;
+            RD = left + right + carry_in;
 
             if (inst_cream->S && (inst_cream->Rd == 15)) {
                 if (CurrentModeHasSPSR) {
@@ -6207,10 +7286,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                     LOAD_NZCVT;
                 }
             } else if (inst_cream->S) {
-                UPDATE_NFLAG(RD);
-                UPDATE_ZFLAG(RD);
-                cpu->CFlag = carry;
-                cpu->VFlag = overflow;
+                SetLazyAddFlags(cpu, left, right, carry_in);
             }
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(sub_inst));
@@ -6255,8 +7331,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             swp_inst* inst_cream = (swp_inst*)inst_base->component;
             addr = RN;
-            unsigned int value = Memory::Read8(addr);
-            Memory::Write8(addr, (RM & 0xFF));
+            unsigned int value = Memory::FastRead8(addr);
+            Memory::FastWrite8(addr, (RM & 0xFF));
             RD = value;
         }
         cpu->Reg[15] += cpu->GetInstructionSize();
@@ -6658,6 +7734,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             RDHI = BITS(rst, 32, 63);
 
             if (inst_cream->S) {
+                MaterializeFlags(cpu);
                 cpu->NFlag = BIT(RDHI, 31);
                 cpu->ZFlag = (RDHI == 0 && RDLO == 0);
             }
@@ -6678,6 +7755,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             RDLO = BITS(rst,  0, 31);
 
             if (inst_cream->S) {
+                MaterializeFlags(cpu);
                 cpu->NFlag = BIT(RDHI, 31);
                 cpu->ZFlag = (RDHI == 0 && RDLO == 0);
             }
@@ -6692,19 +7770,21 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         b_2_thumb* inst_cream = (b_2_thumb*)inst_base->component;
         cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
         INC_PC(sizeof(b_2_thumb));
-        goto DISPATCH;
+        GOTO_LINKED_BLOCK(inst_cream->taken_link);
     }
     B_COND_THUMB:
     {
         b_cond_thumb* inst_cream = (b_cond_thumb*)inst_base->component;
 
-        if(CondPassed(cpu, inst_cream->cond))
+        if(CondPassed(cpu, inst_cream->cond)) {
             cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
-        else
-            cpu->Reg[15] += 2;
+            INC_PC(sizeof(b_cond_thumb));
+            GOTO_LINKED_BLOCK(inst_cream->taken_link);
+        }
 
+        cpu->Reg[15] += 2;
         INC_PC(sizeof(b_cond_thumb));
-        goto DISPATCH;
+        GOTO_LINKED_BLOCK(inst_cream->not_taken_link);
     }
     BL_1_THUMB:
     {
@@ -6724,6 +7804,14 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         INC_PC(sizeof(bl_2_thumb));
         goto DISPATCH;
     }
+    BL_THUMB:
+    {
+        bl_thumb* inst_cream = (bl_thumb*)inst_base->component;
+        cpu->Reg[14] = (cpu->Reg[15] + 4) | 1;
+        cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
+        INC_PC(sizeof(bl_thumb));
+        GOTO_LINKED_BLOCK(inst_cream->taken_link);
+    }
     BLX_1_THUMB:
     {
         // BLX 1 for armv5t and above
@@ -6956,15 +8044,107 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     #include "core/arm/skyeye_common/vfp/vfpinstr.cpp"
     #undef VFP_INTERPRETER_IMPL
 
+    // Fused instruction pairs (see FuseInstructions). The first instruction is unconditional, and
+    // the second one follows it directly without going through GOTO_NEXT_INST.
+    #define FETCH_FUSED_INST inst_base = (arm_inst *)&inst_buf[ptr]; \
+                             num_instrs++
+
+    CMP_BBL_INST:
+    {
+        cmp_inst* const inst_cream = (cmp_inst*)inst_base->component;
+
+        u32 rn_val = RN;
+        if (inst_cream->Rn == 15)
+            rn_val += 2 * cpu->GetInstructionSize();
+
+        SetLazyAddFlags(cpu, rn_val, ~SHIFTER_OPERAND, 1);
+
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(cmp_inst));
+        FETCH_FUSED_INST;
+        goto BBL_INST;
+    }
+    TST_BBL_INST:
+    {
+        tst_inst* const inst_cream = (tst_inst*)inst_base->component;
+
+        u32 lop = RN;
+        u32 rop = SHIFTER_OPERAND;
+
+        if (inst_cream->Rn == 15)
+            lop += cpu->GetInstructionSize() * 2;
+
+        u32 result = lop & rop;
+
+        UPDATE_NFLAG(result);
+        UPDATE_ZFLAG(result);
+        UPDATE_CFLAG_WITH_SC;
+
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(tst_inst));
+        FETCH_FUSED_INST;
+        goto BBL_INST;
+    }
+    MOV_MOV_INST:
+    {
+        mov_inst* inst_cream = (mov_inst*)inst_base->component;
+        RD = SHIFTER_OPERAND;
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(mov_inst));
+        FETCH_FUSED_INST;
+
+        inst_cream = (mov_inst*)inst_base->component;
+        RD = SHIFTER_OPERAND;
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(mov_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    LDR_ADD_INST:
+    {
+        ldst_inst* const ldr_cream = (ldst_inst*)inst_base->component;
+        ldr_cream->get_addr(cpu, ldr_cream->inst, addr);
+        cpu->Reg[BITS(ldr_cream->inst, 12, 15)] = cpu->ReadMemory32(addr);
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(ldst_inst));
+        FETCH_FUSED_INST;
+
+        add_inst* const inst_cream = (add_inst*)inst_base->component;
+        u32 rn_val = RN;
+        if (inst_cream->Rn == 15)
+            rn_val += 2 * cpu->GetInstructionSize();
+        RD = rn_val + SHIFTER_OPERAND;
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(add_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+
+    // Literal pool load folded at translation time (see FoldLiteralLoad)
+    LDR_LITERAL_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldr_literal_inst* const inst_cream = (ldr_literal_inst*)inst_base->component;
+            cpu->Reg[inst_cream->Rd] = inst_cream->value;
+        }
+        cpu->Reg[15] += cpu->GetInstructionSize();
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+
     END:
     {
+        if (in_profiled_block)
+            block_profiler.AddExecution(profiled_block_pc, num_instrs - profiled_block_start);
+
         SAVE_NZCVT;
         cpu->NumInstrsToExecute = 0;
-        return num_instrs;
+        return ticks;
     }
     INIT_INST_LENGTH:
     {
         cpu->NumInstrsToExecute = 0;
-        return num_instrs;
+        return ticks;
     }
 }
@@ -4,6 +4,20 @@
 
 #pragma once
 
+#include "common/common_types.h"
+
 struct ARMul_State;
 
 unsigned InterpreterMainLoop(ARMul_State* state);
+
+/// Discards every translated block.
+void InterpreterClearCache();
+
+/// Writes the translated blocks of the running title to its disk translation cache, if enabled.
+void InterpreterSaveCache();
+
+/// Stops the speculative translator thread, if it runs. It is started again by the next InterpreterMainLoop.
+void InterpreterShutdown();
+
+/// Discards the translated blocks overlapping the guest address range [start_address, start_address + length).
+void InterpreterInvalidateCacheRange(u32 start_address, u32 length);
@@ -2,13 +2,30 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
 #include "common/swap.h"
 #include "common/logging/log.h"
+#include "core/core.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
 #include "core/arm/skyeye_common/armstate.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
 
+// The interpreter touches these fields for nearly every instruction, keep them within the first
+// two cache lines of the state
+static_assert(std::is_standard_layout<ARMul_State>::value, "ARMul_State layout can't be checked");
+static_assert(offsetof(ARMul_State, Reg) == 0 &&
+              offsetof(ARMul_State, Mode) + sizeof(u32) <= 128,
+              "The hot fields of ARMul_State must come first");
+static_assert(offsetof(ARMul_State, Reg_firq) > offsetof(ARMul_State, Mode) &&
+              offsetof(ARMul_State, Spsr) > offsetof(ARMul_State, Mode) &&
+              offsetof(ARMul_State, CP15) > offsetof(ARMul_State, Mode) &&
+              offsetof(ARMul_State, ExtReg) > offsetof(ARMul_State, Mode),
+              "The cold fields of ARMul_State must come after the hot ones");
+
 ARMul_State::ARMul_State(PrivilegeMode initial_mode)
 {
     Reset();
@@ -107,6 +124,9 @@ void ARMul_State::ChangePrivilegeMode(u32 new_mode)
 void ARMul_State::Reset()
 {
     VFPInit(this);
+    vfp_owner = nullptr;
+    vfp_context = nullptr;
+    vfp_switch_pending = false;
 
     // Set stack pointer to the top of the stack
     Reg[13] = 0x10000000;
@@ -116,6 +136,8 @@ void ARMul_State::Reset()
     Mode = SVC32MODE;
     Bank = SVCBANK;
 
+    lazy_flags_pending = false;
+
     ResetMPCoreCP15Registers();
 
     NresetSig = HIGH;
@@ -126,6 +148,31 @@ void ARMul_State::Reset()
 
     NumInstrs = 0;
     Emulate = RUN;
+    idle_loop_detected = false;
+}
+
+void ARMul_State::SwitchVFPContext()
+{
+    FlushVFPContext();
+
+    std::memcpy(ExtReg.data(), vfp_context->fpu_registers, sizeof(vfp_context->fpu_registers));
+    VFP[VFP_FPSCR] = vfp_context->fpscr;
+    VFP[VFP_FPEXC] = vfp_context->fpexc;
+
+    vfp_owner = vfp_context;
+    vfp_switch_pending = false;
+}
+
+void ARMul_State::FlushVFPContext()
+{
+    if (vfp_owner != nullptr) {
+        std::memcpy(vfp_owner->fpu_registers, ExtReg.data(), sizeof(vfp_owner->fpu_registers));
+        vfp_owner->fpscr = VFP[VFP_FPSCR];
+        vfp_owner->fpexc = VFP[VFP_FPEXC];
+        vfp_owner = nullptr;
+    }
+
+    vfp_switch_pending = vfp_context != nullptr;
 }
 
 // Resets certain MPCore CP15 values to their ARM-defined reset values.
@@ -186,61 +233,6 @@ void ARMul_State::ResetMPCoreCP15Registers()
     CP15[CP15_TLB_DEBUG_CONTROL] = 0x00000000;
 }
 
-u16 ARMul_State::ReadMemory16(u32 address) const
-{
-    u16 data = Memory::Read16(address);
-
-    if (InBigEndianMode())
-        data = Common::swap16(data);
-
-    return data;
-}
-
-u32 ARMul_State::ReadMemory32(u32 address) const
-{
-    u32 data = Memory::Read32(address);
-
-    if (InBigEndianMode())
-        data = Common::swap32(data);
-
-    return data;
-}
-
-u64 ARMul_State::ReadMemory64(u32 address) const
-{
-    u64 data = Memory::Read64(address);
-
-    if (InBigEndianMode())
-        data = Common::swap64(data);
-
-    return data;
-}
-
-void ARMul_State::WriteMemory16(u32 address, u16 data)
-{
-    if (InBigEndianMode())
-        data = Common::swap16(data);
-
-    Memory::Write16(address, data);
-}
-
-void ARMul_State::WriteMemory32(u32 address, u32 data)
-{
-    if (InBigEndianMode())
-        data = Common::swap32(data);
-
-    Memory::Write32(address, data);
-}
-
-void ARMul_State::WriteMemory64(u32 address, u64 data)
-{
-    if (InBigEndianMode())
-        data = Common::swap64(data);
-
-    Memory::Write64(address, data);
-}
-
-
 // Reads from the CP15 registers. Used with implementation of the MRC instruction.
 // Note that since the 3DS does not have the hypervisor extensions, these registers
 // are not implemented.
@@ -18,11 +18,16 @@
 #pragma once
 
 #include <array>
-#include <unordered_map>
 
 #include "common/common_types.h"
+#include "common/swap.h"
+#include "core/memory.h"
 #include "core/arm/skyeye_common/arm_regformat.h"
 
+namespace Core {
+struct ThreadContext;
+}
+
 // Signal levels
 enum {
     LOW     = 0,
@@ -152,13 +157,37 @@ public:
     void Reset();
 
     // Reads/writes data in big/little endian format based on the
-    // state of the E (endian) bit in the APSR.
-    u16 ReadMemory16(u32 address) const;
-    u32 ReadMemory32(u32 address) const;
-    u64 ReadMemory64(u32 address) const;
-    void WriteMemory16(u32 address, u16 data);
-    void WriteMemory32(u32 address, u32 data);
-    void WriteMemory64(u32 address, u64 data);
+    // state of the E (endian) bit in the APSR. These are defined inline
+    // so that the common case of an access to regular memory doesn't
+    // require any calls from the interpreter.
+    u16 ReadMemory16(u32 address) const {
+        u16 data = Memory::FastRead16(address);
+        return InBigEndianMode() ? Common::swap16(data) : data;
+    }
+    u32 ReadMemory32(u32 address) const {
+        u32 data = Memory::FastRead32(address);
+        return InBigEndianMode() ? Common::swap32(data) : data;
+    }
+    u64 ReadMemory64(u32 address) const {
+        u64 data = Memory::FastRead64(address);
+        return InBigEndianMode() ? Common::swap64(data) : data;
+    }
+    void WriteMemory16(u32 address, u16 data) {
+        Memory::FastWrite16(address, InBigEndianMode() ? Common::swap16(data) : data);
+    }
+    void WriteMemory32(u32 address, u32 data) {
+        Memory::FastWrite32(address, InBigEndianMode() ? Common::swap32(data) : data);
+    }
+    void WriteMemory64(u32 address, u64 data) {
+        Memory::FastWrite64(address, InBigEndianMode() ? Common::swap64(data) : data);
+    }
+
+    // Lazy VFP context switching. Writes the VFP registers back to the context owning them and
+    // loads the ones of the running thread's context. Called by the first VFP instruction
+    // executed after a context switch, see vfp_switch_pending.
+    void SwitchVFPContext();
+    // Writes the VFP registers back to the context owning them, leaving all contexts up to date
+    void FlushVFPContext();
 
     u32 ReadCP15Register(u32 crn, u32 opcode_1, u32 crm, u32 opcode_2) const;
     void WriteCP15Register(u32 value, u32 crn, u32 opcode_1, u32 crm, u32 opcode_2);
@@ -191,7 +220,44 @@ public:
         return TFlag ? 2 : 4;
     }
 
+    // The fields read or written by nearly every interpreted instruction come first, so that they
+    // share the first two cache lines of the state (see the layout check in armstate.cpp). The
+    // banked registers, CP15 and the VFP registers are only touched by mode switches and by the
+    // instructions using them.
+
     std::array<u32, 16> Reg;      // The current register file
+    u32 Cpsr;    // The current PSR
+
+    u32 NFlag, ZFlag, CFlag, VFlag, IFFlags; // Dummy flags for speed
+    u32 TFlag; // Thumb state
+    unsigned int shifter_carry_out;
+
+    // Operands of the last flag-setting addition or subtraction. The interpreter computes the NZCV
+    // flags from them only once something reads the flags, see MaterializeFlags.
+    u32 lazy_flags_left;
+    u32 lazy_flags_right;
+    u32 lazy_flags_carry_in;
+    bool lazy_flags_pending;
+
+    // Set by the interpreter when it stopped in a loop that only waits for memory to change
+    bool idle_loop_detected;
+
+    unsigned NumInstrsToExecute;
+    u32 Spsr_copy;
+    u32 Mode;          // The current mode
+
+    u32 Bank;          // The current register bank
+    u32 Emulate; // To start and stop emulation
+    u32 phys_pc;
+
+    // Only accessed through the exclusive memory access functions above. They are public so that
+    // the state stays standard-layout, which the layout check relies on.
+    u32 exclusive_tag; // The address for which the local monitor is in exclusive access mode
+    u32 exclusive_result;
+    bool exclusive_state;
+
+    unsigned long long NumInstrs; // The number of instructions executed
+
     std::array<u32, 2> Reg_usr;
     std::array<u32, 2> Reg_svc;   // R13_SVC R14_SVC
     std::array<u32, 2> Reg_abort; // R13_ABORT R14_ABORT
@@ -209,21 +275,12 @@ public:
     // and only 32 singleword registers are accessible (S0-S31).
     std::array<u32, 64> ExtReg;
 
-    u32 Emulate; // To start and stop emulation
-    u32 Cpsr;    // The current PSR
-    u32 Spsr_copy;
-    u32 phys_pc;
-
-    u32 Mode;          // The current mode
-    u32 Bank;          // The current register bank
-
-    u32 NFlag, ZFlag, CFlag, VFlag, IFFlags; // Dummy flags for speed
-    unsigned int shifter_carry_out;
-
-    u32 TFlag; // Thumb state
-
-    unsigned long long NumInstrs; // The number of instructions executed
-    unsigned NumInstrsToExecute;
+    // The VFP registers above belong to vfp_owner, which isn't necessarily the context of the
+    // running thread (vfp_context): most threads never touch the VFP, so its registers are only
+    // switched when a thread actually executes a VFP instruction (vfp_switch_pending).
+    Core::ThreadContext* vfp_owner;
+    Core::ThreadContext* vfp_context;
+    bool vfp_switch_pending;
 
     unsigned NresetSig; // Reset the processor
     unsigned NfiqSig;
@@ -234,10 +291,6 @@ public:
     unsigned bigendSig;
     unsigned syscallSig;
 
-    // TODO(bunnei): Move this cache to a better place - it should be per codeset (likely per
-    // process for our purposes), not per ARMul_State (which tracks CPU core state).
-    std::unordered_map<u32, int> instruction_cache;
-
 private:
     void ResetMPCoreCP15Registers();
 
@@ -245,8 +298,4 @@ private:
     // This is the smallest granule allowed by the v7 spec, and is coincidentally just large enough to
     // support LDR/STREXD.
     static const u32 RESERVATION_GRANULE_MASK = 0xFFFFFFF8;
-
-    u32 exclusive_tag; // The address for which the local monitor is in exclusive access mode
-    u32 exclusive_result;
-    bool exclusive_state;
 };
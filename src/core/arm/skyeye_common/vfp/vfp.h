@@ -23,7 +23,8 @@
 #include "core/arm/skyeye_common/vfp/vfp_helper.h" /* for references to cdp SoftFloat functions */
 
 #define VFP_DEBUG_UNTESTED(x) LOG_TRACE(Core_ARM11, "in func %s, " #x " untested\n", __FUNCTION__);
-#define CHECK_VFP_ENABLED
+// Switches the VFP registers over to the running thread's context if they still hold another one's
+#define CHECK_VFP_ENABLED do { if (cpu->vfp_switch_pending) cpu->SwitchVFPContext(); } while (0)
 #define CHECK_VFP_CDP_RET vfp_raise_exceptions(cpu, ret, inst_cream->instr, cpu->VFP[VFP_FPSCR]);
 
 void VFPInit(ARMul_State* state);
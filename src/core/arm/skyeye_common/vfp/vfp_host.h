@@ -0,0 +1,124 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstring>
+
+#include "common/common_types.h"
+#include "core/arm/skyeye_common/vfp/asm_vfp.h"
+
+// Fast path which executes VFP arithmetic on the host FPU instead of the soft-float routines.
+//
+// The host computes the same IEEE results as the VFP as long as the operands and the result are
+// normal numbers or zeros and rounding is to nearest, so those are the only cases it handles.
+// Everything else (NaNs, infinities, denormals, overflow and underflow) falls back to the
+// soft-float path, which means the flush-to-zero and default NaN modes never affect a result of
+// the fast path. Inexactness is the only exception left to track, and the host reports it in its
+// status flags for free.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VFP_HOST_FPU
+#endif
+
+#ifdef VFP_HOST_FPU
+
+enum VFPHostOp {
+    VFP_HOST_ADD,
+    VFP_HOST_MUL,
+    VFP_HOST_DIV
+};
+
+// MXCSR with all exceptions masked, round to nearest and no flush-to-zero or denormals-are-zero
+#define VFP_HOST_MXCSR 0x1F80
+#define VFP_HOST_MXCSR_FLAGS_MASK 0x3F
+#define VFP_HOST_MXCSR_INEXACT 0x20
+
+// Returns whether the FPSCR configuration allows using the fast path
+static inline bool vfp_host_enabled(u32 fpscr)
+{
+    return (fpscr & FPSCR_RMODE_MASK) == FPSCR_ROUND_NEAREST;
+}
+
+// Returns whether a single-precision operand is a normal number or a zero
+static inline bool vfp_host_single_operand_ok(u32 v)
+{
+    u32 exponent = (v >> 23) & 0xff;
+    return (exponent != 0 && exponent != 0xff) || (v & 0x7fffffff) == 0;
+}
+
+// Returns whether a double-precision operand is a normal number or a zero
+static inline bool vfp_host_double_operand_ok(u64 v)
+{
+    u64 exponent = (v >> 52) & 0x7ff;
+    return (exponent != 0 && exponent != 0x7ff) || (v & 0x7fffffffffffffffULL) == 0;
+}
+
+// Like the operand checks, but also rejects results with the smallest normal exponent: the VFP
+// detects underflow before rounding, so those may have raised it even if the host didn't.
+static inline bool vfp_host_single_result_ok(u32 v)
+{
+    u32 exponent = (v >> 23) & 0xff;
+    return (exponent > 1 && exponent != 0xff) || (v & 0x7fffffff) == 0;
+}
+
+static inline bool vfp_host_double_result_ok(u64 v)
+{
+    u64 exponent = (v >> 52) & 0x7ff;
+    return (exponent > 1 && exponent != 0x7ff) || (v & 0x7fffffffffffffffULL) == 0;
+}
+
+template <typename T>
+static inline T vfp_host_compute(VFPHostOp op, T n, T m)
+{
+    switch (op) {
+    case VFP_HOST_ADD:
+        return n + m;
+    case VFP_HOST_MUL:
+        return n * m;
+    case VFP_HOST_DIV:
+    default:
+        return n / m;
+    }
+}
+
+// Sets up the host FPU for the fast path and returns the MXCSR to restore afterwards
+static inline u32 vfp_host_begin()
+{
+    u32 csr = _mm_getcsr();
+    _mm_setcsr(VFP_HOST_MXCSR);
+    return csr;
+}
+
+// Restores the MXCSR and returns the status flags raised since vfp_host_begin
+static inline u32 vfp_host_end(u32 csr)
+{
+    u32 flags = _mm_getcsr() & VFP_HOST_MXCSR_FLAGS_MASK;
+    _mm_setcsr(csr);
+    return flags;
+}
+
+// Returns whether the host raised no status flag other than inexact, which the fast path requires
+static inline bool vfp_host_flags_ok(u32 flags)
+{
+    return (flags & ~VFP_HOST_MXCSR_INEXACT) == 0;
+}
+
+// Converts the host status flags to the cumulative FPSCR exception bits
+static inline u32 vfp_host_exceptions(u32 flags)
+{
+    return (flags & VFP_HOST_MXCSR_INEXACT) ? FPSCR_IXC : 0;
+}
+
+template <typename To, typename From>
+static inline To vfp_host_bit_cast(From value)
+{
+    static_assert(sizeof(To) == sizeof(From), "Sizes don't match");
+    To result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+#endif
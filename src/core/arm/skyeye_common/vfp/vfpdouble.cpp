@@ -54,6 +54,7 @@
 #include "common/logging/log.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
 #include "core/arm/skyeye_common/vfp/vfp_helper.h"
+#include "core/arm/skyeye_common/vfp/vfp_host.h"
 #include "core/arm/skyeye_common/vfp/asm_vfp.h"
 
 static struct vfp_double vfp_double_default_qnan = {
@@ -891,12 +892,78 @@ vfp_double_multiply(struct vfp_double *vdd, struct vfp_double *vdn,
 #define NEG_MULTIPLY	(1 << 0)
 #define NEG_SUBTRACT	(1 << 1)
 
+#ifdef VFP_HOST_FPU
+/*
+ * Computes dd = n op m on the host FPU, see vfp_host.h.
+ * Returns false if the soft-float path has to compute it instead.
+ */
+static bool vfp_double_host_op(ARMul_State* state, int dd, u64 n, u64 m, u32 fpscr, VFPHostOp op, u32* exceptions)
+{
+    if (!vfp_host_enabled(fpscr) || !vfp_host_double_operand_ok(n) || !vfp_host_double_operand_ok(m))
+        return false;
+
+    u32 csr = vfp_host_begin();
+    volatile double hn = vfp_host_bit_cast<double>(n);
+    volatile double hm = vfp_host_bit_cast<double>(m);
+    volatile double hd = vfp_host_compute<double>(op, hn, hm);
+    u32 flags = vfp_host_end(csr);
+
+    u64 d = vfp_host_bit_cast<u64>((double)hd);
+    if (!vfp_host_flags_ok(flags) || !vfp_host_double_result_ok(d))
+        return false;
+
+    vfp_put_double(state, d, dd);
+    *exceptions = vfp_host_exceptions(flags);
+    return true;
+}
+
+/*
+ * Computes dd = (+/-dd) + (+/-(n * m)) on the host FPU, rounding the product before adding it like
+ * the VFP does. Returns false if the soft-float path has to compute it instead.
+ */
+static bool vfp_double_host_multiply_accumulate(ARMul_State* state, int dd, u64 n, u64 m, u32 fpscr, u32 negate, u32* exceptions)
+{
+    u64 d = vfp_get_double(state, dd);
+
+    if (!vfp_host_enabled(fpscr) || !vfp_host_double_operand_ok(n) ||
+        !vfp_host_double_operand_ok(m) || !vfp_host_double_operand_ok(d))
+        return false;
+
+    if (negate & NEG_MULTIPLY)
+        n = vfp_double_packed_negate(n);
+    if (negate & NEG_SUBTRACT)
+        d = vfp_double_packed_negate(d);
+
+    u32 csr = vfp_host_begin();
+    volatile double hn = vfp_host_bit_cast<double>(n);
+    volatile double hm = vfp_host_bit_cast<double>(m);
+    volatile double hp = hn * hm;
+    volatile double hd = vfp_host_bit_cast<double>(d) + hp;
+    u32 flags = vfp_host_end(csr);
+
+    // The product has to be checked as well, since it would have been flushed if it was denormal
+    u64 p = vfp_host_bit_cast<u64>((double)hp);
+    u64 result = vfp_host_bit_cast<u64>((double)hd);
+    if (!vfp_host_flags_ok(flags) || !vfp_host_double_result_ok(p) || !vfp_host_double_result_ok(result))
+        return false;
+
+    vfp_put_double(state, result, dd);
+    *exceptions = vfp_host_exceptions(flags);
+    return true;
+}
+#endif
+
 static u32
 vfp_double_multiply_accumulate(ARMul_State* state, int dd, int dn, int dm, u32 fpscr, u32 negate, const char *func)
 {
     struct vfp_double vdd, vdp, vdn, vdm;
     u32 exceptions;
 
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_multiply_accumulate(state, dd, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, negate, &exceptions))
+        return exceptions;
+#endif
+
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     if (vdn.exponent == 0 && vdn.significand)
         vfp_double_normalise_denormal(&vdn);
@@ -970,6 +1037,10 @@ static u32 vfp_double_fmul(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
     u32 exceptions;
 
     LOG_TRACE(Core_ARM11, "In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_op(state, dd, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, VFP_HOST_MUL, &exceptions))
+        return exceptions;
+#endif
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     if (vdn.exponent == 0 && vdn.significand)
         vfp_double_normalise_denormal(&vdn);
@@ -991,6 +1062,12 @@ static u32 vfp_double_fnmul(ARMul_State* state, int dd, int dn, int dm, u32 fpsc
     u32 exceptions;
 
     LOG_TRACE(Core_ARM11, "In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_op(state, dd, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, VFP_HOST_MUL, &exceptions)) {
+        vfp_put_double(state, vfp_double_packed_negate(vfp_get_double(state, dd)), dd);
+        return exceptions;
+    }
+#endif
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     if (vdn.exponent == 0 && vdn.significand)
         vfp_double_normalise_denormal(&vdn);
@@ -1014,6 +1091,10 @@ static u32 vfp_double_fadd(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
     u32 exceptions;
 
     LOG_TRACE(Core_ARM11, "In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_op(state, dd, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, VFP_HOST_ADD, &exceptions))
+        return exceptions;
+#endif
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     if (vdn.exponent == 0 && vdn.significand)
         vfp_double_normalise_denormal(&vdn);
@@ -1036,6 +1117,10 @@ static u32 vfp_double_fsub(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
     u32 exceptions;
 
     LOG_TRACE(Core_ARM11, "In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_op(state, dd, vfp_get_double(state, dn), vfp_double_packed_negate(vfp_get_double(state, dm)), fpscr, VFP_HOST_ADD, &exceptions))
+        return exceptions;
+#endif
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     if (vdn.exponent == 0 && vdn.significand)
         vfp_double_normalise_denormal(&vdn);
@@ -1064,6 +1149,10 @@ static u32 vfp_double_fdiv(ARMul_State* state, int dd, int dn, int dm, u32 fpscr
     int tm, tn;
 
     LOG_TRACE(Core_ARM11, "In %s\n", __FUNCTION__);
+#ifdef VFP_HOST_FPU
+    if (vfp_double_host_op(state, dd, vfp_get_double(state, dn), vfp_get_double(state, dm), fpscr, VFP_HOST_DIV, &exceptions))
+        return exceptions;
+#endif
     vfp_double_unpack(&vdn, vfp_get_double(state, dn), &fpscr);
     vfp_double_unpack(&vdm, vfp_get_double(state, dm), &fpscr);
 
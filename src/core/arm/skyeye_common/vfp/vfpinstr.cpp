@@ -1149,6 +1149,7 @@ VMRS_INST:
                 cpu->ZFlag = (cpu->VFP[VFP_FPSCR] >> 30) & 1;
                 cpu->CFlag = (cpu->VFP[VFP_FPSCR] >> 29) & 1;
                 cpu->VFlag = (cpu->VFP[VFP_FPSCR] >> 28) & 1;
+                cpu->lazy_flags_pending = false;
             }
         }
         else if (reg == 0)
@@ -58,6 +58,7 @@
 #include "common/logging/log.h"
 
 #include "core/arm/skyeye_common/vfp/vfp_helper.h"
+#include "core/arm/skyeye_common/vfp/vfp_host.h"
 #include "core/arm/skyeye_common/vfp/asm_vfp.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
 
@@ -920,6 +921,67 @@ vfp_single_multiply(struct vfp_single *vsd, struct vfp_single *vsn, struct vfp_s
 #define NEG_MULTIPLY	(1 << 0)
 #define NEG_SUBTRACT	(1 << 1)
 
+#ifdef VFP_HOST_FPU
+/*
+ * Computes sd = n op m on the host FPU, see vfp_host.h.
+ * Returns false if the soft-float path has to compute it instead.
+ */
+static bool vfp_single_host_op(ARMul_State* state, int sd, u32 n, u32 m, u32 fpscr, VFPHostOp op, u32* exceptions)
+{
+    if (!vfp_host_enabled(fpscr) || !vfp_host_single_operand_ok(n) || !vfp_host_single_operand_ok(m))
+        return false;
+
+    u32 csr = vfp_host_begin();
+    volatile float hn = vfp_host_bit_cast<float>(n);
+    volatile float hm = vfp_host_bit_cast<float>(m);
+    volatile float hd = vfp_host_compute<float>(op, hn, hm);
+    u32 flags = vfp_host_end(csr);
+
+    u32 d = vfp_host_bit_cast<u32>((float)hd);
+    if (!vfp_host_flags_ok(flags) || !vfp_host_single_result_ok(d))
+        return false;
+
+    vfp_put_float(state, d, sd);
+    *exceptions = vfp_host_exceptions(flags);
+    return true;
+}
+
+/*
+ * Computes sd = (+/-sd) + (+/-(n * m)) on the host FPU, rounding the product before adding it like
+ * the VFP does. Returns false if the soft-float path has to compute it instead.
+ */
+static bool vfp_single_host_multiply_accumulate(ARMul_State* state, int sd, u32 n, u32 m, u32 fpscr, u32 negate, u32* exceptions)
+{
+    u32 d = vfp_get_float(state, sd);
+
+    if (!vfp_host_enabled(fpscr) || !vfp_host_single_operand_ok(n) ||
+        !vfp_host_single_operand_ok(m) || !vfp_host_single_operand_ok(d))
+        return false;
+
+    if (negate & NEG_MULTIPLY)
+        n = vfp_single_packed_negate(n);
+    if (negate & NEG_SUBTRACT)
+        d = vfp_single_packed_negate(d);
+
+    u32 csr = vfp_host_begin();
+    volatile float hn = vfp_host_bit_cast<float>(n);
+    volatile float hm = vfp_host_bit_cast<float>(m);
+    volatile float hp = hn * hm;
+    volatile float hd = vfp_host_bit_cast<float>(d) + hp;
+    u32 flags = vfp_host_end(csr);
+
+    // The product has to be checked as well, since it would have been flushed if it was denormal
+    u32 p = vfp_host_bit_cast<u32>((float)hp);
+    u32 result = vfp_host_bit_cast<u32>((float)hd);
+    if (!vfp_host_flags_ok(flags) || !vfp_host_single_result_ok(p) || !vfp_host_single_result_ok(result))
+        return false;
+
+    vfp_put_float(state, result, sd);
+    *exceptions = vfp_host_exceptions(flags);
+    return true;
+}
+#endif
+
 static u32
 vfp_single_multiply_accumulate(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr, u32 negate, const char *func)
 {
@@ -927,6 +989,11 @@ vfp_single_multiply_accumulate(ARMul_State* state, int sd, int sn, s32 m, u32 fp
     u32 exceptions;
     s32 v;
 
+#ifdef VFP_HOST_FPU
+    if (vfp_single_host_multiply_accumulate(state, sd, vfp_get_float(state, sn), m, fpscr, negate, &exceptions))
+        return exceptions;
+#endif
+
     v = vfp_get_float(state, sn);
     LOG_TRACE(Core_ARM11, "s%u = %08x", sn, v);
     vfp_single_unpack(&vsn, v, &fpscr);
@@ -1008,6 +1075,11 @@ static u32 vfp_single_fmul(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
     LOG_TRACE(Core_ARM11, "s%u = %08x", sn, n);
 
+#ifdef VFP_HOST_FPU
+    if (vfp_single_host_op(state, sd, n, m, fpscr, VFP_HOST_MUL, &exceptions))
+        return exceptions;
+#endif
+
     vfp_single_unpack(&vsn, n, &fpscr);
     if (vsn.exponent == 0 && vsn.significand)
         vfp_single_normalise_denormal(&vsn);
@@ -1031,6 +1103,13 @@ static u32 vfp_single_fnmul(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr
 
     LOG_TRACE(Core_ARM11, "s%u = %08x", sn, n);
 
+#ifdef VFP_HOST_FPU
+    if (vfp_single_host_op(state, sd, n, m, fpscr, VFP_HOST_MUL, &exceptions)) {
+        vfp_put_float(state, vfp_single_packed_negate(vfp_get_float(state, sd)), sd);
+        return exceptions;
+    }
+#endif
+
     vfp_single_unpack(&vsn, n, &fpscr);
     if (vsn.exponent == 0 && vsn.significand)
         vfp_single_normalise_denormal(&vsn);
@@ -1055,6 +1134,11 @@ static u32 vfp_single_fadd(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
     LOG_TRACE(Core_ARM11, "s%u = %08x", sn, n);
 
+#ifdef VFP_HOST_FPU
+    if (vfp_single_host_op(state, sd, n, m, fpscr, VFP_HOST_ADD, &exceptions))
+        return exceptions;
+#endif
+
     /*
      * Unpack and normalise denormals.
      */
@@ -1098,6 +1182,11 @@ static u32 vfp_single_fdiv(ARMul_State* state, int sd, int sn, s32 m, u32 fpscr)
 
     LOG_TRACE(Core_ARM11, "s%u = %08x", sn, n);
 
+#ifdef VFP_HOST_FPU
+    if (vfp_single_host_op(state, sd, n, m, fpscr, VFP_HOST_DIV, &exceptions))
+        return exceptions;
+#endif
+
     vfp_single_unpack(&vsn, n, &fpscr);
     vfp_single_unpack(&vsm, m, &fpscr);
 
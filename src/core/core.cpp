@@ -6,12 +6,17 @@
 
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/frame_limiter.h"
+#include "core/run_ahead.h"
+#include "core/settings.h"
 
 #include "core/arm/arm_interface.h"
 #include "core/arm/dyncom/arm_dyncom.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/thread.h"
+#include "core/hw/gpu.h"
 #include "core/hw/hw.h"
+#include "core/memory.h"
 
 namespace Core {
 
@@ -24,7 +29,7 @@ void RunLoop(int tight_loop) {
     // instead advance to the next event and try to yield to the next thread
     if (Kernel::GetCurrentThread() == nullptr) {
         LOG_TRACE(Core_ARM11, "Idling");
-        CoreTiming::Idle();
+        CoreTiming::Idle((int)FrameLimiter::SleepWhileIdle(CoreTiming::GetIdleLength()));
         CoreTiming::Advance();
         HLE::Reschedule(__func__);
     } else {
@@ -37,6 +42,24 @@ void RunLoop(int tight_loop) {
     }
 }
 
+void RunFrames(unsigned num_frames, const std::atomic<bool>& running) {
+    if (Settings::values.run_ahead_frames > 0) {
+        for (unsigned i = 0; i < num_frames && running.load(std::memory_order_relaxed); ++i) {
+            RunAhead::RunFrame(running);
+            if (Memory::HasWatchpointHit())
+                break;
+        }
+        return;
+    }
+
+    const u64 end_frame = GPU::GetFrameCount() + num_frames;
+    while (GPU::GetFrameCount() < end_frame && running.load(std::memory_order_relaxed)) {
+        RunLoop();
+        if (Memory::HasWatchpointHit())
+            break;
+    }
+}
+
 /// Step the CPU one instruction
 void SingleStep() {
     RunLoop(1);
@@ -64,6 +87,8 @@ int Init() {
 void Shutdown() {
     delete g_app_core;
     delete g_sys_core;
+    g_app_core = nullptr;
+    g_sys_core = nullptr;
 
     LOG_DEBUG(Core, "Shutdown OK");
 }
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "common/common_types.h"
 
 class ARM_Interface;
@@ -41,6 +43,16 @@ void Start();
  */
 void RunLoop(int tight_loop=1000);
 
+/**
+ * Runs the core CPU loop until the emulated GPU has started the given number of frames, so that
+ * frontends only need to check their own state once per frame.
+ * @param num_frames Number of VBlanks to run up to
+ * @param running Checked after every RunLoop, returns early once this is cleared by another thread
+ * @note Also returns early when a memory watchpoint has been hit, see Memory::PopWatchpointHit
+ * @note Runs ahead of each frame if Settings::values.run_ahead_frames is set, see RunAhead
+ */
+void RunFrames(unsigned num_frames, const std::atomic<bool>& running);
+
 /// Step the CPU one instruction
 void SingleStep();
 
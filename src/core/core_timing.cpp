@@ -2,23 +2,30 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <vector>
 
 #include "common/chunk_file.h"
 #include "common/logging/log.h"
+#include "common/profiler_reporting.h"
 #include "common/string_util.h"
 
 #include "core/arm/arm_interface.h"
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/settings.h"
 
 int g_clock_rate_arm11 = 268123480;
 
 // is this really necessary?
 #define INITIAL_SLICE_LENGTH 20000
 #define MAX_SLICE_LENGTH 100000000
+// Lower bound for the configurable slice length cap, to keep the scheduling overhead sane
+#define MIN_SLICE_LENGTH_CAP 1000
 
 namespace CoreTiming
 {
@@ -35,25 +42,60 @@ struct EventType
 
 static std::vector<EventType> event_types;
 
-struct BaseEvent
+/// An event posted from another thread, waiting to be moved into the main queue
+struct ThreadsafeEvent
 {
     s64 time;
     u64 userdata;
     int type;
+    ThreadsafeEvent* next;
+    std::atomic<bool> in_use; ///< Set while a pooled event is owned by a producer or the queue
 };
 
-typedef LinkedListItem<BaseEvent> Event;
+/// An event in the main queue
+struct QueuedEvent
+{
+    s64 time;
+    u64 order; ///< Insertion order, so that events scheduled for the same time fire in FIFO order
+    u64 userdata;
+    int type;
+    u32 slot;  ///< Index into event_slots, used to find this event from its handle
+};
 
-static Event* first;
-static Event* ts_first;
-static Event* ts_last;
+/**
+ * Tracks where a scheduled event currently sits in the queue. Handles refer to a slot plus the
+ * slot's generation at scheduling time, so a handle goes stale as soon as its event fires or
+ * is removed and the slot can be reused safely.
+ */
+struct EventSlot
+{
+    u32 generation;
+    u32 queue_index;
+};
 
-// event pools
-static Event* event_pool = nullptr;
-static Event* event_ts_pool = nullptr;
-static int allocated_ts_events = 0;
-// Optimization to skip MoveEvents when possible.
-static std::atomic<bool> has_ts_events(false);
+/// Binary min-heap of pending events, ordered by (time, order)
+static std::vector<QueuedEvent> event_queue;
+static std::vector<EventSlot> event_slots;
+static std::vector<u32> free_slots;
+static u64 next_event_order;
+
+/**
+ * Events posted by other threads are pushed onto a lock-free stack, which the CPU thread takes
+ * over as a whole in MoveEvents. Producers only ever push and the consumer only ever swaps the
+ * head out, so the stack is not subject to ABA problems.
+ */
+static std::atomic<ThreadsafeEvent*> ts_head(nullptr);
+
+/// Number of preallocated threadsafe events. Posting only falls back to the heap if all of
+/// these are queued at once.
+static const size_t TS_EVENT_POOL_SIZE = 256;
+static std::array<ThreadsafeEvent, TS_EVENT_POOL_SIZE> ts_event_pool;
+static std::atomic<size_t> ts_pool_cursor(0);
+
+/// Lets the idle CPU thread sleep until another thread schedules an event
+static std::mutex ts_wait_mutex;
+static std::condition_variable ts_event_posted;
+static std::atomic<bool> ts_waiting(false);
 
 int g_slice_length;
 
@@ -62,7 +104,9 @@ static s64 idled_cycles;
 static s64 last_global_time_ticks;
 static s64 last_global_time_us;
 
-static std::recursive_mutex external_event_section;
+// Statistics for the slice profiler
+static u64 events_fired_in_slice;
+static s64 idled_cycles_at_slice_start;
 
 // Warning: not included in save state.
 using AdvanceCallback = void(int cycles_executed);
@@ -97,35 +141,142 @@ u64 GetGlobalTimeUs() {
     return last_global_time_us + us_since_last;
 }
 
-static Event* GetNewEvent() {
-    if (!event_pool)
-        return new Event;
+static bool IsPooledTsEvent(const ThreadsafeEvent* event) {
+    return event >= ts_event_pool.data() && event < ts_event_pool.data() + TS_EVENT_POOL_SIZE;
+}
+
+static ThreadsafeEvent* GetNewTsEvent() {
+    // Claim a free pool entry, starting the search at a rotating position so that concurrent
+    // producers rarely contend for the same entry
+    for (size_t i = 0; i < TS_EVENT_POOL_SIZE; ++i) {
+        size_t index = ts_pool_cursor.fetch_add(1, std::memory_order_relaxed) % TS_EVENT_POOL_SIZE;
+        ThreadsafeEvent& event = ts_event_pool[index];
+        if (!event.in_use.load(std::memory_order_relaxed) &&
+            !event.in_use.exchange(true, std::memory_order_acquire))
+            return &event;
+    }
 
-    Event* event = event_pool;
-    event_pool = event->next;
-    return event;
+    return new ThreadsafeEvent;
 }
 
-static Event* GetNewTsEvent() {
-    allocated_ts_events++;
+static void FreeTsEvent(ThreadsafeEvent* event) {
+    if (IsPooledTsEvent(event))
+        event->in_use.store(false, std::memory_order_release);
+    else
+        delete event;
+}
 
-    if (!event_ts_pool)
-        return new Event;
+static u32 AllocateSlot() {
+    if (free_slots.empty()) {
+        event_slots.push_back({ 1, 0 });
+        return (u32)event_slots.size() - 1;
+    }
+
+    u32 slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+}
+
+static void ReleaseSlot(u32 slot) {
+    // Invalidate any outstanding handles to this slot
+    event_slots[slot].generation++;
+    if (event_slots[slot].generation == 0)
+        event_slots[slot].generation = 1;
+    free_slots.push_back(slot);
+}
 
-    Event* event = event_ts_pool;
-    event_ts_pool = event->next;
-    return event;
+static EventHandle MakeHandle(u32 slot) {
+    return ((u64)event_slots[slot].generation << 32) | slot;
 }
 
-static void FreeEvent(Event* event) {
-    event->next = event_pool;
-    event_pool = event;
+/// Returns true if the given handle refers to an event which is still in the queue
+static bool IsHandleValid(EventHandle handle, u32* slot) {
+    *slot = (u32)handle;
+    return handle != 0 && *slot < event_slots.size() &&
+           event_slots[*slot].generation == (u32)(handle >> 32);
 }
 
-static void FreeTsEvent(Event* event) {
-    event->next = event_ts_pool;
-    event_ts_pool = event;
-    allocated_ts_events--;
+static bool FiresBefore(const QueuedEvent& a, const QueuedEvent& b) {
+    return a.time < b.time || (a.time == b.time && a.order < b.order);
+}
+
+static void PlaceEvent(size_t index, const QueuedEvent& event) {
+    event_queue[index] = event;
+    event_slots[event.slot].queue_index = (u32)index;
+}
+
+static void SiftUp(size_t index) {
+    const QueuedEvent event = event_queue[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!FiresBefore(event, event_queue[parent]))
+            break;
+        PlaceEvent(index, event_queue[parent]);
+        index = parent;
+    }
+    PlaceEvent(index, event);
+}
+
+static void SiftDown(size_t index) {
+    const QueuedEvent event = event_queue[index];
+    const size_t size = event_queue.size();
+    while (true) {
+        size_t child = index * 2 + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && FiresBefore(event_queue[child + 1], event_queue[child]))
+            child++;
+        if (!FiresBefore(event_queue[child], event))
+            break;
+        PlaceEvent(index, event_queue[child]);
+        index = child;
+    }
+    PlaceEvent(index, event);
+}
+
+/// Removes the event at the given position in the queue in O(log n)
+static void RemoveEventAt(size_t index) {
+    ReleaseSlot(event_queue[index].slot);
+
+    const QueuedEvent last = event_queue.back();
+    event_queue.pop_back();
+    if (index < event_queue.size()) {
+        PlaceEvent(index, last);
+        SiftUp(index);
+        SiftDown(event_slots[last.slot].queue_index);
+    }
+}
+
+/**
+ * Removes every queued event matching the predicate in O(n) and restores the heap.
+ * @param latest_time Set to the time of the latest removed event, if any were removed
+ * @returns True if any events were removed
+ */
+template <typename Predicate>
+static bool RemoveEventsIf(Predicate predicate, s64* latest_time = nullptr) {
+    bool removed = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < event_queue.size(); ++i) {
+        const QueuedEvent& event = event_queue[i];
+        if (predicate(event)) {
+            if (latest_time && (!removed || event.time > *latest_time))
+                *latest_time = event.time;
+            removed = true;
+            ReleaseSlot(event.slot);
+        } else {
+            event_queue[kept++] = event;
+        }
+    }
+
+    if (!removed)
+        return false;
+
+    event_queue.resize(kept);
+    for (size_t i = 0; i < kept; ++i)
+        event_slots[event_queue[i].slot].queue_index = (u32)i;
+    for (size_t i = kept / 2; i-- > 0;)
+        SiftDown(i);
+    return true;
 }
 
 int RegisterEvent(const char* name, TimedCallback callback) {
@@ -146,7 +297,7 @@ void RestoreRegisterEvent(int event_type, const char* name, TimedCallback callba
 }
 
 void UnregisterAllEvents() {
-    if (first)
+    if (!event_queue.empty())
         LOG_ERROR(Core_Timing, "Cannot unregister events with events pending");
     event_types.clear();
 }
@@ -158,16 +309,18 @@ void Init() {
     idled_cycles = 0;
     last_global_time_ticks = 0;
     last_global_time_us = 0;
-    has_ts_events = 0;
+    events_fired_in_slice = 0;
+    idled_cycles_at_slice_start = 0;
     mhz_change_callbacks.clear();
 
-    first = nullptr;
-    ts_first = nullptr;
-    ts_last = nullptr;
+    event_queue.clear();
+    event_slots.clear();
+    free_slots.clear();
+    next_event_order = 0;
 
-    event_pool = nullptr;
-    event_ts_pool = nullptr;
-    allocated_ts_events = 0;
+    ts_head = nullptr;
+    for (ThreadsafeEvent& event : ts_event_pool)
+        event.in_use = false;
 
     advance_callback = nullptr;
 }
@@ -177,18 +330,9 @@ void Shutdown() {
     ClearPendingEvents();
     UnregisterAllEvents();
 
-    while (event_pool) {
-        Event* event = event_pool;
-        event_pool = event->next;
-        delete event;
-    }
-
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    while (event_ts_pool) {
-        Event* event = event_ts_pool;
-        event_ts_pool = event->next;
-        delete event;
-    }
+    std::vector<QueuedEvent>().swap(event_queue);
+    std::vector<EventSlot>().swap(event_slots);
+    std::vector<u32>().swap(free_slots);
 }
 
 u64 GetTicks() {
@@ -203,19 +347,32 @@ u64 GetIdleTicks() {
 // This is to be called when outside threads, such as the graphics thread, wants to
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userdata) {
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    Event* new_event = GetNewTsEvent();
+    ThreadsafeEvent* new_event = GetNewTsEvent();
     new_event->time = GetTicks() + cycles_into_future;
     new_event->type = event_type;
-    new_event->next = 0;
     new_event->userdata = userdata;
-    if (!ts_first)
-        ts_first = new_event;
-    if (ts_last)
-        ts_last->next = new_event;
-    ts_last = new_event;
 
-    has_ts_events = true;
+    new_event->next = ts_head.load(std::memory_order_relaxed);
+    while (!ts_head.compare_exchange_weak(new_event->next, new_event,
+            std::memory_order_release, std::memory_order_relaxed)) {
+    }
+
+    // Orders the push before the check, against the opposite order in WaitForThreadsafeEvent
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ts_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(ts_wait_mutex);
+        ts_event_posted.notify_one();
+    }
+}
+
+bool WaitForThreadsafeEvent(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(ts_wait_mutex);
+    ts_waiting.store(true, std::memory_order_seq_cst);
+    const bool posted = ts_event_posted.wait_until(lock, deadline, [] {
+        return ts_head.load(std::memory_order_seq_cst) != nullptr;
+    });
+    ts_waiting.store(false, std::memory_order_relaxed);
+    return posted;
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
@@ -223,7 +380,6 @@ void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userda
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata) {
     if (false) //Core::IsCPUThread())
     {
-        std::lock_guard<std::recursive_mutex> lock(external_event_section);
         event_types[event_type].callback(userdata, 0);
     }
     else
@@ -231,115 +387,67 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata) {
 }
 
 void ClearPendingEvents() {
-    while (first) {
-        Event* event = first->next;
-        FreeEvent(first);
-        first = event;
-    }
-}
-
-static void AddEventToQueue(Event* new_event) {
-    Event* prev_event = nullptr;
-    Event** next_event = &first;
-    for (;;) {
-        Event*& next = *next_event;
-        if (!next || new_event->time < next->time) {
-            new_event->next = next;
-            next = new_event;
-            break;
-        }
-        prev_event = next;
-        next_event = &prev_event->next;
+    for (const QueuedEvent& event : event_queue)
+        ReleaseSlot(event.slot);
+    event_queue.clear();
+}
+
+static EventHandle AddEventToQueue(s64 time, int event_type, u64 userdata) {
+    QueuedEvent new_event;
+    new_event.time = time;
+    new_event.order = next_event_order++;
+    new_event.userdata = userdata;
+    new_event.type = event_type;
+    new_event.slot = AllocateSlot();
+
+    event_queue.push_back(new_event);
+    SiftUp(event_queue.size() - 1);
+    return MakeHandle(new_event.slot);
+}
+
+/// Ends the current slice early if the given time lies before its end
+static void ClampSliceEnd(s64 time) {
+    s64 remaining = std::max<s64>(time - (s64)GetTicks(), 0);
+    s64 cut = Core::g_app_core->down_count - remaining;
+    if (cut > 0) {
+        // Keep GetTicks() unchanged by shortening the slice and the downcount together
+        g_slice_length -= (int)cut;
+        Core::g_app_core->down_count -= cut;
     }
 }
 
-void ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata) {
-    Event* new_event = GetNewEvent();
-    new_event->userdata = userdata;
-    new_event->type = event_type;
-    new_event->time = GetTicks() + cycles_into_future;
-    AddEventToQueue(new_event);
+EventHandle ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata) {
+    s64 time = GetTicks() + cycles_into_future;
+    if (Settings::values.use_deterministic_timeslices)
+        ClampSliceEnd(time);
+    return AddEventToQueue(time, event_type, userdata);
 }
 
 s64 UnscheduleEvent(int event_type, u64 userdata) {
-    s64 result = 0;
-    if (!first)
-        return result;
-    while (first) {
-        if (first->type == event_type && first->userdata == userdata) {
-            result = first->time - GetTicks();
-
-            Event* next = first->next;
-            FreeEvent(first);
-            first = next;
-        } else {
-            break;
-        }
-    }
-    if (!first)
-        return result;
+    s64 latest_time;
+    if (!RemoveEventsIf([&](const QueuedEvent& event) {
+            return event.type == event_type && event.userdata == userdata;
+        }, &latest_time))
+        return 0;
 
-    Event* prev_event = first;
-    Event* ptr = prev_event->next;
-
-    while (ptr) {
-        if (ptr->type == event_type && ptr->userdata == userdata) {
-            result = ptr->time - GetTicks();
+    return latest_time - GetTicks();
+}
 
-            prev_event->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev_event->next;
-        } else {
-            prev_event = ptr;
-            ptr = ptr->next;
-        }
-    }
+s64 UnscheduleEvent(EventHandle handle) {
+    u32 slot;
+    if (!IsHandleValid(handle, &slot))
+        return 0;
 
+    size_t index = event_slots[slot].queue_index;
+    s64 result = event_queue[index].time - GetTicks();
+    RemoveEventAt(index);
     return result;
 }
 
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata) {
-    s64 result = 0;
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    if (!ts_first)
-        return result;
-
-    while (ts_first) {
-        if (ts_first->type == event_type && ts_first->userdata == userdata) {
-            result = ts_first->time - GetTicks();
-
-            Event* next = ts_first->next;
-            FreeTsEvent(ts_first);
-            ts_first = next;
-        } else {
-            break;
-        }
-    }
-
-    if (!ts_first)
-    {
-        ts_last = nullptr;
-        return result;
-    }
-
-    Event* prev_event = ts_first;
-    Event* next = prev_event->next;
-    while (next) {
-        if (next->type == event_type && next->userdata == userdata) {
-            result = next->time - GetTicks();
-
-            prev_event->next = next->next;
-            if (next == ts_last)
-                ts_last = prev_event;
-            FreeTsEvent(next);
-            next = prev_event->next;
-        } else {
-            prev_event = next;
-            next = next->next;
-        }
-    }
-
-    return result;
+    // Threadsafe events can only be removed by the CPU thread once they're in the main queue
+    MoveEvents();
+    return UnscheduleEvent(event_type, userdata);
 }
 
 // Warning: not included in save state.
@@ -352,79 +460,17 @@ void RegisterMHzChangeCallback(MHzChangeCallback callback) {
 }
 
 bool IsScheduled(int event_type) {
-    if (!first)
-        return false;
-    Event* event = first;
-    while (event) {
-        if (event->type == event_type)
-            return true;
-        event = event->next;
-    }
-    return false;
+    return std::any_of(event_queue.begin(), event_queue.end(),
+        [&](const QueuedEvent& event) { return event.type == event_type; });
 }
 
 void RemoveEvent(int event_type) {
-    if (!first)
-        return;
-    while (first) {
-        if (first->type == event_type) {
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        } else {
-            break;
-        }
-    }
-    if (!first)
-        return;
-    Event* prev = first;
-    Event* next = prev->next;
-    while (next) {
-        if (next->type == event_type) {
-            prev->next = next->next;
-            FreeEvent(next);
-            next = prev->next;
-        } else {
-            prev = next;
-            next = next->next;
-        }
-    }
+    RemoveEventsIf([&](const QueuedEvent& event) { return event.type == event_type; });
 }
 
 void RemoveThreadsafeEvent(int event_type) {
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    if (!ts_first)
-        return;
-
-    while (ts_first) {
-        if (ts_first->type == event_type) {
-            Event* next = ts_first->next;
-            FreeTsEvent(ts_first);
-            ts_first = next;
-        } else {
-            break;
-        }
-    }
-
-    if (!ts_first) {
-        ts_last = nullptr;
-        return;
-    }
-
-    Event* prev = ts_first;
-    Event* next = prev->next;
-    while (next) {
-        if (next->type == event_type) {
-            prev->next = next->next;
-            if (next == ts_last)
-                ts_last = prev;
-            FreeTsEvent(next);
-            next = prev->next;
-        } else {
-            prev = next;
-            next = next->next;
-        }
-    }
+    MoveEvents();
+    RemoveEvent(event_type);
 }
 
 void RemoveAllEvents(int event_type) {
@@ -434,37 +480,34 @@ void RemoveAllEvents(int event_type) {
 
 // This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents() {
-    while (first) {
-        if (first->time <= (s64)GetTicks()) {
-            Event* evt = first;
-            first = first->next;
-            event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
-            FreeEvent(evt);
-        } else {
-            break;
-        }
+    while (!event_queue.empty() && event_queue.front().time <= (s64)GetTicks()) {
+        // Pop the event before running it, since the callback may modify the queue
+        const QueuedEvent evt = event_queue.front();
+        RemoveEventAt(0);
+        event_types[evt.type].callback(evt.userdata, (int)(GetTicks() - evt.time));
+        events_fired_in_slice++;
     }
 }
 
 void MoveEvents() {
-    has_ts_events = false;
+    ThreadsafeEvent* event = ts_head.exchange(nullptr, std::memory_order_acquire);
 
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    // Move events from async queue into main queue
-    while (ts_first) {
-        Event* next = ts_first->next;
-        AddEventToQueue(ts_first);
-        ts_first = next;
+    // The stack holds the newest event first, reverse it so that events posted for the same time
+    // are queued in the order they were posted
+    ThreadsafeEvent* oldest = nullptr;
+    while (event) {
+        ThreadsafeEvent* next = event->next;
+        event->next = oldest;
+        oldest = event;
+        event = next;
     }
-    ts_last = nullptr;
-
-    // Move free events to threadsafe pool
-    while (allocated_ts_events > 0 && event_pool) {
-        Event* event = event_pool;
-        event_pool = event->next;
-        event->next = event_ts_pool;
-        event_ts_pool = event;
-        allocated_ts_events--;
+
+    // Move events from async queue into main queue
+    while (oldest) {
+        ThreadsafeEvent* next = oldest->next;
+        AddEventToQueue(oldest->time, oldest->type, oldest->userdata);
+        FreeTsEvent(oldest);
+        oldest = next;
     }
 }
 
@@ -482,18 +525,38 @@ void Advance() {
     global_timer += cycles_executed;
     Core::g_app_core->down_count = g_slice_length;
 
-    if (has_ts_events)
+    // Optimization to skip MoveEvents when possible.
+    if (ts_head.load(std::memory_order_relaxed))
         MoveEvents();
     ProcessFifoWaitEvents();
 
-    if (!first) {
+    auto& slice_profiler = Common::Profiling::GetSliceProfiler();
+    if (slice_profiler.IsEnabled()) {
+        slice_profiler.AddSlice(cycles_executed, events_fired_in_slice,
+                idled_cycles - idled_cycles_at_slice_start);
+    }
+    events_fired_in_slice = 0;
+    idled_cycles_at_slice_start = idled_cycles;
+
+    if (Settings::values.use_deterministic_timeslices) {
+        // Run exactly until the next event, but no longer than the configured cap
+        s64 target = std::max(std::min(Settings::values.max_slice_length, MAX_SLICE_LENGTH),
+                MIN_SLICE_LENGTH_CAP);
+        if (!event_queue.empty())
+            target = std::min(target, event_queue.front().time - global_timer);
+
+        // Note that events can eat cycles as well.
+        const int diff = (int)target - g_slice_length;
+        g_slice_length += diff;
+        Core::g_app_core->down_count += diff;
+    } else if (event_queue.empty()) {
         if (g_slice_length < 10000) {
             g_slice_length += 10000;
             Core::g_app_core->down_count += g_slice_length;
         }
     } else {
         // Note that events can eat cycles as well.
-        int target = (int)(first->time - global_timer);
+        int target = (int)(event_queue.front().time - global_timer);
         if (target > MAX_SLICE_LENGTH)
             target = MAX_SLICE_LENGTH;
 
@@ -506,21 +569,19 @@ void Advance() {
 }
 
 void LogPendingEvents() {
-    Event* event = first;
-    while (event) {
-        //LOG_TRACE(Core_Timing, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, next->time, next->type);
-        event = event->next;
+    for (const QueuedEvent& event : event_queue) {
+        //LOG_TRACE(Core_Timing, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, event.time, event.type);
     }
 }
 
-void Idle(int max_idle) {
+s64 GetIdleLength(s64 max_idle) {
     s64 cycles_down = Core::g_app_core->down_count;
     if (max_idle != 0 && cycles_down > max_idle)
         cycles_down = max_idle;
 
-    if (first && cycles_down > 0) {
+    if (!event_queue.empty() && cycles_down > 0) {
         s64 cycles_executed = g_slice_length - Core::g_app_core->down_count;
-        s64 cycles_next_event = first->time - global_timer;
+        s64 cycles_next_event = event_queue.front().time - global_timer;
 
         if (cycles_next_event < cycles_executed + cycles_down) {
             cycles_down = cycles_next_event - cycles_executed;
@@ -529,6 +590,11 @@ void Idle(int max_idle) {
                 cycles_down = 0;
         }
     }
+    return cycles_down;
+}
+
+void Idle(int max_idle) {
+    const s64 cycles_down = GetIdleLength(max_idle);
 
     LOG_TRACE(Core_Timing, "Idle for %i cycles! (%f ms)", cycles_down, cycles_down / (float)(g_clock_rate_arm11 * 0.001f));
 
@@ -539,21 +605,61 @@ void Idle(int max_idle) {
 }
 
 std::string GetScheduledEventsSummary() {
-    Event* event = first;
+    // The heap is only partially ordered, so sort a copy to list the events in firing order
+    std::vector<QueuedEvent> events = event_queue;
+    std::sort(events.begin(), events.end(), FiresBefore);
+
     std::string text = "Scheduled events\n";
     text.reserve(1000);
-    while (event) {
-        unsigned int t = event->type;
+    for (const QueuedEvent& event : events) {
+        unsigned int t = event.type;
         if (t >= event_types.size())
             LOG_ERROR(Core_Timing, "Invalid event type"); // %i", t);
-        const char* name = event_types[event->type].name;
+        const char* name = event_types[event.type].name;
         if (!name)
             name = "[unknown]";
-        text += Common::StringFromFormat("%s : %i %08x%08x\n", name, (int)event->time,
-                (u32)(event->userdata >> 32), (u32)(event->userdata));
-        event = event->next;
+        text += Common::StringFromFormat("%s : %i %08x%08x\n", name, (int)event.time,
+                (u32)(event.userdata >> 32), (u32)(event.userdata));
     }
     return text;
 }
 
+void DoState(PointerWrap& p) {
+    auto s = p.Section("CoreTiming", 1);
+    if (!s)
+        return;
+
+    u32 num_event_types = static_cast<u32>(event_types.size());
+    p.Do(num_event_types);
+    if (num_event_types != event_types.size()) {
+        LOG_ERROR(Core_Timing, "Save state has %u event types instead of %u", num_event_types, (u32)event_types.size());
+        p.SetError(PointerWrap::ERROR_FAILURE);
+        return;
+    }
+    for (const EventType& type : event_types) {
+        std::string name = type.name != nullptr ? type.name : "";
+        std::string saved_name = name;
+        p.Do(saved_name);
+        if (saved_name != name) {
+            LOG_ERROR(Core_Timing, "Save state has event type %s instead of %s", saved_name.c_str(), name.c_str());
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+    }
+
+    p.Do(g_clock_rate_arm11);
+    p.Do(g_slice_length);
+    p.Do(Core::g_app_core->down_count);
+    p.Do(global_timer);
+    p.Do(idled_cycles);
+    p.Do(last_global_time_ticks);
+    p.Do(last_global_time_us);
+
+    // The slots are stored as they are, so that handles held by other subsystems stay valid
+    p.Do(event_queue);
+    p.Do(event_slots);
+    p.Do(free_slots);
+    p.Do(next_event_order);
+}
+
 } // namespace
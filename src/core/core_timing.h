@@ -19,10 +19,13 @@
 // inside callback:
 //   ScheduleEvent(periodInCycles - cycles_late, callback, "whatever")
 
+#include <chrono>
 #include <functional>
 
 #include "common/common_types.h"
 
+class PointerWrap;
+
 extern int g_clock_rate_arm11;
 
 inline s64 msToCycles(int ms) {
@@ -69,6 +72,9 @@ void Shutdown();
 typedef void(*MHzChangeCallback)();
 typedef std::function<void(u64 userdata, int cycles_late)> TimedCallback;
 
+/// Identifies a single scheduled event. Zero is never a valid handle.
+typedef u64 EventHandle;
+
 u64 GetTicks();
 u64 GetIdleTicks();
 u64 GetGlobalTimeUs();
@@ -93,12 +99,19 @@ void UnregisterAllEvents();
  * @param cycles_into_future The number of cycles after which this event will be fired
  * @param event_type The event type to fire, as returned from RegisterEvent
  * @param userdata Optional parameter to pass to the callback when fired
+ * @returns A handle which can be used to unschedule this particular event
  */
-void ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata = 0);
+EventHandle ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata = 0);
 
 void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userdata = 0);
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
 
+/**
+ * Blocks the CPU thread until another thread schedules an event, or until the deadline passes.
+ * @returns Whether an event was scheduled, which may have happened before the call
+ */
+bool WaitForThreadsafeEvent(std::chrono::steady_clock::time_point deadline);
+
 /**
  * Unschedules an event with the specified type and userdata
  * @param event_type The type of event to unschedule, as returned from RegisterEvent
@@ -107,6 +120,14 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
  */
 s64 UnscheduleEvent(int event_type, u64 userdata);
 
+/**
+ * Unschedules the event identified by the given handle in O(log n). Does nothing if the event
+ * has already fired or been unscheduled.
+ * @param handle The handle returned from ScheduleEvent
+ * @returns The remaining ticks until the event would have fired, or 0 if it is not pending
+ */
+s64 UnscheduleEvent(EventHandle handle);
+
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata);
 
 void RemoveEvent(int event_type);
@@ -119,6 +140,9 @@ void MoveEvents();
 void ProcessFifoWaitEvents();
 void ForceCheck();
 
+/// Returns the number of cycles Idle() would skip: up to the next event, within the current slice.
+s64 GetIdleLength(s64 max_idle = 0);
+
 /// Pretend that the main CPU has executed enough cycles to reach the next event.
 void Idle(int maxIdle = 0);
 
@@ -137,4 +161,11 @@ void SetClockFrequencyMHz(int cpu_mhz);
 int GetClockFrequencyMHz();
 extern int g_slice_length;
 
+/**
+ * Saves or restores the clock and the queue of scheduled events. Events are stored by type index,
+ * so a state can only be restored by a build registering the same event types in the same order.
+ * Threadsafe events have to be moved into the queue (see MoveEvents) beforehand.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
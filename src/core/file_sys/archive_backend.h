@@ -53,6 +53,8 @@ public:
 
     const std::string AsString() const;
     const std::u16string AsU16Str() const;
+    /// Returns the string of a Wchar path as it is stored, without converting or copying it
+    const std::u16string& GetU16Str() const { return u16str; }
     const std::vector<u8> AsBinary() const;
 
 private:
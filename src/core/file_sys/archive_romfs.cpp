@@ -11,6 +11,7 @@
 
 #include "core/file_sys/archive_romfs.h"
 #include "core/file_sys/ivfc_archive.h"
+#include "core/settings.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // FileSys namespace
@@ -18,14 +19,30 @@
 namespace FileSys {
 
 ArchiveFactory_RomFS::ArchiveFactory_RomFS(Loader::AppLoader& app_loader) {
-    // Load the RomFS from the app
+    // Load the RomFS from the app, preferring a memory mapping over reading the file
+    if (Loader::ResultStatus::Success == app_loader.MapRomFS(romfs_mapping, data_offset, data_size))
+        return;
+
     if (Loader::ResultStatus::Success != app_loader.ReadRomFS(romfs_file, data_offset, data_size)) {
         LOG_ERROR(Service_FS, "Unable to read RomFS!");
+        return;
+    }
+
+    if (Settings::values.romfs_cache_size > 0) {
+        romfs_cache = std::make_shared<IVFCBlockCache>(romfs_file, data_offset, data_size,
+                (size_t)Settings::values.romfs_cache_size * 1024 * 1024);
     }
 }
 
 ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_RomFS::Open(const Path& path) {
-    auto archive = Common::make_unique<IVFCArchive>(romfs_file, data_offset, data_size);
+    std::unique_ptr<ArchiveBackend> archive;
+    if (romfs_mapping != nullptr) {
+        archive = Common::make_unique<IVFCArchive>(romfs_mapping, data_offset, data_size);
+    } else if (romfs_cache != nullptr) {
+        archive = Common::make_unique<IVFCArchive>(romfs_cache, data_size);
+    } else {
+        archive = Common::make_unique<IVFCArchive>(romfs_file, data_offset, data_size);
+    }
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
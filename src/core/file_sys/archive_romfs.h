@@ -11,6 +11,7 @@
 #include "common/common_types.h"
 
 #include "core/file_sys/archive_backend.h"
+#include "core/file_sys/ivfc_block_cache.h"
 #include "core/hle/result.h"
 #include "core/loader/loader.h"
 
@@ -30,6 +31,8 @@ public:
 
 private:
     std::shared_ptr<FileUtil::IOFile> romfs_file;
+    std::shared_ptr<FileUtil::MappedFile> romfs_mapping;
+    std::shared_ptr<IVFCBlockCache> romfs_cache;
     u64 data_offset;
     u64 data_size;
 };
@@ -65,6 +65,7 @@ ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_SystemSaveData::Open(c
 
 ResultCode ArchiveFactory_SystemSaveData::Format(const Path& path) {
     std::string fullpath = GetSystemSaveDataPath(base_path, path);
+    DiskArchive::CloseCachedFiles(fullpath);
     FileUtil::DeleteDirRecursively(fullpath);
     FileUtil::CreateFullPath(fullpath);
     return RESULT_SUCCESS;
@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <list>
 
 #include "common/common_types.h"
 #include "common/file_util.h"
@@ -11,12 +13,86 @@
 #include "common/make_unique.h"
 
 #include "core/file_sys/disk_archive.h"
+#include "core/settings.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // FileSys namespace
 
 namespace FileSys {
 
+/// Maximum number of host files kept open after the application closed them
+static const size_t MAX_CACHED_FILES = 8;
+
+/// Maximum number of resolved paths remembered per archive
+static const size_t MAX_RESOLVED_PATHS = 256;
+
+/// Files larger than this are written through even if writes are buffered
+static const u64 MAX_BUFFERED_FILE_SIZE = 16 * 1024 * 1024;
+
+/// Open files whose writes are being buffered
+static std::vector<const DiskFile*> buffered_files;
+
+struct CachedFile {
+    std::string path;
+    std::string mode_string;
+    std::unique_ptr<FileUtil::IOFile> file;
+};
+
+/**
+ * Host files closed by the application, most recently closed first. This is shared by all
+ * archives, so that deleting a file through one of them closes it for all others.
+ */
+static std::list<CachedFile> cached_files;
+
+/// Takes a cached host file which was opened with the given mode, or returns nullptr
+static std::unique_ptr<FileUtil::IOFile> TakeCachedFile(const std::string& path, const std::string& mode_string) {
+    for (auto it = cached_files.begin(); it != cached_files.end(); ++it) {
+        if (it->path == path && it->mode_string == mode_string) {
+            std::unique_ptr<FileUtil::IOFile> file = std::move(it->file);
+            cached_files.erase(it);
+            return file;
+        }
+    }
+    return nullptr;
+}
+
+static void CacheFile(const std::string& path, const std::string& mode_string, std::unique_ptr<FileUtil::IOFile> file) {
+    if (cached_files.size() >= MAX_CACHED_FILES)
+        cached_files.pop_back();
+
+    CachedFile entry;
+    entry.path = path;
+    entry.mode_string = mode_string;
+    entry.file = std::move(file);
+    cached_files.push_front(std::move(entry));
+}
+
+void DiskArchive::CloseCachedFiles(const std::string& host_path) {
+    cached_files.remove_if([&](const CachedFile& entry) {
+        return entry.path.compare(0, host_path.size(), host_path) == 0;
+    });
+}
+
+void DiskArchive::FlushBufferedFiles() {
+    for (const DiskFile* file : buffered_files)
+        file->CommitBuffer();
+}
+
+const std::string& DiskArchive::ResolvePath(const Path& path) const {
+    if (path.GetType() != Wchar) {
+        resolved_path = mount_point + path.AsString();
+        return resolved_path;
+    }
+
+    auto it = resolved_paths.find(path.GetU16Str());
+    if (it != resolved_paths.end())
+        return it->second;
+
+    if (resolved_paths.size() >= MAX_RESOLVED_PATHS)
+        resolved_paths.clear();
+    return resolved_paths.emplace(path.GetU16Str(), mount_point + path.AsString()).first->second;
+}
+
 std::unique_ptr<FileBackend> DiskArchive::OpenFile(const Path& path, const Mode mode) const {
     LOG_DEBUG(Service_FS, "called path=%s mode=%01X", path.DebugStr().c_str(), mode.hex);
     auto file = Common::make_unique<DiskFile>(*this, path, mode);
@@ -26,19 +102,27 @@ std::unique_ptr<FileBackend> DiskArchive::OpenFile(const Path& path, const Mode
 }
 
 bool DiskArchive::DeleteFile(const Path& path) const {
-    return FileUtil::Delete(mount_point + path.AsString());
+    const std::string& full_path = ResolvePath(path);
+    CloseCachedFiles(full_path);
+    return FileUtil::Delete(full_path);
 }
 
 bool DiskArchive::RenameFile(const Path& src_path, const Path& dest_path) const {
-    return FileUtil::Rename(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
+    const std::string src_full_path = ResolvePath(src_path);
+    const std::string dest_full_path = ResolvePath(dest_path);
+    CloseCachedFiles(src_full_path);
+    CloseCachedFiles(dest_full_path);
+    return FileUtil::Rename(src_full_path, dest_full_path);
 }
 
 bool DiskArchive::DeleteDirectory(const Path& path) const {
-    return FileUtil::DeleteDir(mount_point + path.AsString());
+    const std::string& full_path = ResolvePath(path);
+    CloseCachedFiles(full_path);
+    return FileUtil::DeleteDir(full_path);
 }
 
 ResultCode DiskArchive::CreateFile(const FileSys::Path& path, u32 size) const {
-    std::string full_path = mount_point + path.AsString();
+    const std::string full_path = ResolvePath(path);
 
     if (FileUtil::Exists(full_path))
         return ResultCode(ErrorDescription::AlreadyExists, ErrorModule::FS, ErrorSummary::NothingHappened, ErrorLevel::Info);
@@ -59,11 +143,15 @@ ResultCode DiskArchive::CreateFile(const FileSys::Path& path, u32 size) const {
 
 
 bool DiskArchive::CreateDirectory(const Path& path) const {
-    return FileUtil::CreateDir(mount_point + path.AsString());
+    return FileUtil::CreateDir(ResolvePath(path));
 }
 
 bool DiskArchive::RenameDirectory(const Path& src_path, const Path& dest_path) const {
-    return FileUtil::Rename(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
+    const std::string src_full_path = ResolvePath(src_path);
+    const std::string dest_full_path = ResolvePath(dest_path);
+    CloseCachedFiles(src_full_path);
+    CloseCachedFiles(dest_full_path);
+    return FileUtil::Rename(src_full_path, dest_full_path);
 }
 
 std::unique_ptr<DirectoryBackend> DiskArchive::OpenDirectory(const Path& path) const {
@@ -80,17 +168,17 @@ DiskFile::DiskFile(const DiskArchive& archive, const Path& path, const Mode mode
     // TODO(Link Mauve): normalize path into an absolute path without "..", it can currently bypass
     // the root directory we set while opening the archive.
     // For example, opening /../../etc/passwd can give the emulated program your users list.
-    this->path = archive.mount_point + path.AsString();
+    this->path = archive.ResolvePath(path);
     this->mode.hex = mode.hex;
 }
 
-bool DiskFile::Open() {
-    if (!mode.create_flag && !FileUtil::Exists(path)) {
-        LOG_ERROR(Service_FS, "Non-existing file %s can't be open without mode create.", path.c_str());
-        return false;
-    }
+DiskFile::~DiskFile() {
+    if (write_buffer != nullptr)
+        Close();
+}
 
-    std::string mode_string;
+bool DiskFile::Open() {
+    mode_string.clear();
     if (mode.create_flag)
         mode_string = "w+";
     else if (mode.write_flag)
@@ -101,35 +189,176 @@ bool DiskFile::Open() {
     // Open the file in binary mode, to avoid problems with CR/LF on Windows systems
     mode_string += "b";
 
+    if (mode.create_flag) {
+        // Opening it truncates the file, which must not happen through a cached descriptor
+        DiskArchive::CloseCachedFiles(path);
+    } else if (Settings::values.buffer_file_writes && mode.write_flag) {
+        if (!FileUtil::Exists(path)) {
+            LOG_ERROR(Service_FS, "Non-existing file %s can't be open without mode create.", path.c_str());
+            return false;
+        }
+        if (OpenBuffered())
+            return true;
+    } else {
+        file = TakeCachedFile(path, mode_string);
+        if (file != nullptr)
+            return true;
+
+        if (!FileUtil::Exists(path)) {
+            LOG_ERROR(Service_FS, "Non-existing file %s can't be open without mode create.", path.c_str());
+            return false;
+        }
+    }
+
     file = Common::make_unique<FileUtil::IOFile>(path, mode_string.c_str());
+
+    // The file is empty after being created, so there's nothing to read into the buffer
+    if (mode.create_flag && Settings::values.buffer_file_writes && file->IsOpen()) {
+        file->Close();
+        write_buffer = Common::make_unique<WriteBuffer>();
+        buffered_files.push_back(this);
+    }
+    return true;
+}
+
+bool DiskFile::OpenBuffered() {
+    const u64 size = FileUtil::GetSize(path);
+    if (size > MAX_BUFFERED_FILE_SIZE)
+        return false;
+
+    auto buffer = Common::make_unique<WriteBuffer>();
+    buffer->data.resize(static_cast<size_t>(size));
+
+    FileUtil::IOFile host_file(path, "rb");
+    if (!host_file.IsOpen() || host_file.ReadBytes(buffer->data.data(), buffer->data.size()) != buffer->data.size())
+        return false;
+
+    file = Common::make_unique<FileUtil::IOFile>();
+    write_buffer = std::move(buffer);
+    buffered_files.push_back(this);
+    return true;
+}
+
+bool DiskFile::CommitBuffer() const {
+    if (!write_buffer->dirty)
+        return true;
+
+    const std::string temp_path = path + ".tmp";
+    bool written;
+    {
+        FileUtil::IOFile temp_file(temp_path, "wb");
+        const std::vector<u8>& data = write_buffer->data;
+        written = temp_file.IsOpen() && temp_file.WriteBytes(data.data(), data.size()) == data.size();
+    }
+
+    if (!written || !FileUtil::Replace(temp_path, path)) {
+        LOG_ERROR(Service_FS, "Failed to write buffered file %s", path.c_str());
+        FileUtil::Delete(temp_path);
+        return false;
+    }
+
+    // Cached descriptors still refer to the replaced file
+    DiskArchive::CloseCachedFiles(path);
+    write_buffer->dirty = false;
     return true;
 }
 
 size_t DiskFile::Read(const u64 offset, const size_t length, u8* buffer) const {
-    file->Seek(offset, SEEK_SET);
-    return file->ReadBytes(buffer, length);
+    if (write_buffer != nullptr) {
+        const std::vector<u8>& data = write_buffer->data;
+        if (offset >= data.size())
+            return 0;
+
+        const size_t read = std::min<size_t>(length, data.size() - static_cast<size_t>(offset));
+        std::memcpy(buffer, data.data() + offset, read);
+        return read;
+    }
+
+    return file->ReadBytesAt(buffer, length, offset);
 }
 
 size_t DiskFile::Write(const u64 offset, const size_t length, const bool flush, const u8* buffer) const {
-    file->Seek(offset, SEEK_SET);
-    size_t written = file->WriteBytes(buffer, length);
+    if (write_buffer != nullptr) {
+        std::vector<u8>& data = write_buffer->data;
+        if (offset + length > data.size()) {
+            if (offset + length > MAX_BUFFERED_FILE_SIZE) {
+                // Too large to keep buffering, continue writing to the file on disk
+                if (!CommitBuffer())
+                    return 0;
+                RemoveFromBufferedFiles();
+                file = Common::make_unique<FileUtil::IOFile>(path, "r+b");
+                return Write(offset, length, flush, buffer);
+            }
+            data.resize(static_cast<size_t>(offset + length));
+        }
+
+        std::memcpy(data.data() + offset, buffer, length);
+        write_buffer->dirty = true;
+        if (flush)
+            CommitBuffer();
+        return length;
+    }
+
+    size_t written = file->WriteBytesAt(buffer, length, offset);
     if (flush)
         file->Flush();
     return written;
 }
 
 u64 DiskFile::GetSize() const {
+    if (write_buffer != nullptr)
+        return write_buffer->data.size();
     return file->GetSize();
 }
 
 bool DiskFile::SetSize(const u64 size) const {
+    if (write_buffer != nullptr && size <= MAX_BUFFERED_FILE_SIZE) {
+        write_buffer->data.resize(static_cast<size_t>(size));
+        write_buffer->dirty = true;
+        return true;
+    }
+
+    if (write_buffer != nullptr) {
+        if (!CommitBuffer())
+            return false;
+        RemoveFromBufferedFiles();
+        file = Common::make_unique<FileUtil::IOFile>(path, "r+b");
+    }
+
     file->Resize(size);
     file->Flush();
     return true;
 }
 
+void DiskFile::Flush() const {
+    if (write_buffer != nullptr)
+        CommitBuffer();
+    else
+        file->Flush();
+}
+
+void DiskFile::RemoveFromBufferedFiles() const {
+    buffered_files.erase(std::remove(buffered_files.begin(), buffered_files.end(), this), buffered_files.end());
+    write_buffer = nullptr;
+}
+
 bool DiskFile::Close() const {
-    return file->Close();
+    if (write_buffer != nullptr) {
+        const bool committed = CommitBuffer();
+        RemoveFromBufferedFiles();
+        return committed;
+    }
+
+    // Files opened with the create flag are truncated when they're opened again, so those can't
+    // be reused
+    if (mode.create_flag || !file->IsOpen())
+        return file->Close();
+
+    if (!file->Flush())
+        return false;
+    CacheFile(path, mode_string, std::move(file));
+    file = Common::make_unique<FileUtil::IOFile>();
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -138,22 +367,23 @@ DiskDirectory::DiskDirectory(const DiskArchive& archive, const Path& path) {
     // TODO(Link Mauve): normalize path into an absolute path without "..", it can currently bypass
     // the root directory we set while opening the archive.
     // For example, opening /../../usr/bin can give the emulated program your installed programs.
-    this->path = archive.mount_point + path.AsString();
+    this->path = archive.ResolvePath(path);
 }
 
 bool DiskDirectory::Open() {
     if (!FileUtil::IsDirectory(path))
         return false;
-    FileUtil::ScanDirectoryTree(path, directory);
-    children_iterator = directory.children.begin();
-    return true;
+    iterator = Common::make_unique<FileUtil::DirectoryIterator>(path);
+    return iterator->IsOpen();
 }
 
 u32 DiskDirectory::Read(const u32 count, Entry* entries) {
     u32 entries_read = 0;
+    if (iterator == nullptr)
+        return entries_read;
 
-    while (entries_read < count && children_iterator != directory.children.cend()) {
-        const FileUtil::FSTEntry& file = *children_iterator;
+    FileUtil::FSTEntry file;
+    while (entries_read < count && iterator->Next(file)) {
         const std::string& filename = file.virtualName;
         Entry& entry = entries[entries_read];
 
@@ -180,7 +410,6 @@ u32 DiskDirectory::Read(const u32 count, Entry* entries) {
         entry.is_archive = !file.isDirectory;
 
         ++entries_read;
-        ++children_iterator;
     }
     return entries_read;
 }
@@ -7,6 +7,7 @@
 #include <cstddef>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "common/common_types.h"
@@ -31,6 +32,18 @@ class DiskArchive : public ArchiveBackend {
 public:
     DiskArchive(const std::string& mount_point_) : mount_point(mount_point_) {}
 
+    /**
+     * Closes the files which are kept open after being closed by the emulated application (see
+     * DiskFile::Close). Has to be called before files are deleted, renamed or formatted by
+     * other means than a DiskArchive, so that they aren't opened through stale descriptors.
+     * @param host_path Host path of the files, or of a directory containing them. If empty,
+     *                  all files are closed.
+     */
+    static void CloseCachedFiles(const std::string& host_path);
+
+    /// Writes the contents of all files with buffered writes to disk (see DiskFile)
+    static void FlushBufferedFiles();
+
     virtual std::string GetName() const override { return "DiskArchive: " + mount_point; }
 
     std::unique_ptr<FileBackend> OpenFile(const Path& path, const Mode mode) const override;
@@ -46,29 +59,65 @@ protected:
     friend class DiskFile;
     friend class DiskDirectory;
 
+    /// Returns the host path of a path in the archive
+    const std::string& ResolvePath(const Path& path) const;
+
     std::string mount_point;
+
+private:
+    /// Host paths of the Wchar paths resolved so far, to skip their conversion to UTF-8
+    mutable std::unordered_map<std::u16string, std::string> resolved_paths;
+    /// Return value of ResolvePath for other path types
+    mutable std::string resolved_path;
 };
 
+/**
+ * File in a DiskArchive. With Settings::values.buffer_file_writes, files opened for writing are
+ * read into memory and only written back when they're closed or flushed, as well as periodically
+ * by DiskArchive::FlushBufferedFiles. They're written to a temporary file which then replaces the
+ * original, so a file on disk is never left partially written.
+ */
 class DiskFile : public FileBackend {
 public:
     DiskFile();
     DiskFile(const DiskArchive& archive, const Path& path, const Mode mode);
+    ~DiskFile() override;
 
     bool Open() override;
     size_t Read(u64 offset, size_t length, u8* buffer) const override;
     size_t Write(u64 offset, size_t length, bool flush, const u8* buffer) const override;
     u64 GetSize() const override;
     bool SetSize(u64 size) const override;
+    /// Keeps the host file open for a while, in case the application opens it again
     bool Close() const override;
-
-    void Flush() const override {
-        file->Flush();
-    }
+    void Flush() const override;
 
 protected:
+    friend class DiskArchive;
+
+    /// Contents of a file whose writes are buffered
+    struct WriteBuffer {
+        std::vector<u8> data;
+        /// Whether the data differs from the file on disk
+        bool dirty = false;
+    };
+
+    /// Reads the whole file into a write buffer, returns false if it is too large to be buffered
+    bool OpenBuffered();
+
+    /// Writes the buffered data back to disk if it changed
+    bool CommitBuffer() const;
+
+    /// Stops buffering writes, after the buffer was committed
+    void RemoveFromBufferedFiles() const;
+
+
     std::string path;
     Mode mode;
-    std::unique_ptr<FileUtil::IOFile> file;
+    /// Mode string the host file was opened with
+    std::string mode_string;
+    mutable std::unique_ptr<FileUtil::IOFile> file;
+    mutable std::unique_ptr<WriteBuffer> write_buffer;
 };
 
 class DiskDirectory : public DirectoryBackend {
@@ -89,12 +138,13 @@ public:
 
 protected:
     std::string path;
-    u32 total_entries_in_directory;
-    FileUtil::FSTEntry directory;
 
-    // We need to remember the last entry we returned, so a subsequent call to Read will continue
-    // from the next one.  This iterator will always point to the next unread entry.
-    std::vector<FileUtil::FSTEntry>::iterator children_iterator;
+    /**
+     * Host directory being read. Entries are pulled from it as the application reads them, so a
+     * subsequent call to Read continues from the next one without the directory being scanned
+     * up front.
+     */
+    std::unique_ptr<FileUtil::DirectoryIterator> iterator;
 };
 
 } // namespace FileSys
@@ -5,9 +5,12 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 
 #include "common/common_types.h"
 
+#include "core/memory.h"
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // FileSys namespace
 
@@ -33,6 +36,26 @@ public:
      */
     virtual size_t Read(u64 offset, size_t length, u8* buffer) const = 0;
 
+    /**
+     * Read data from the file into several buffers, filling each one before moving on to the next
+     * @param offset Offset in bytes to start reading data from
+     * @param spans Buffers to read data into, for example the host memory backing a guest buffer
+     * @return Number of bytes read
+     */
+    virtual size_t ReadScatter(u64 offset, const std::vector<Memory::HostSpan>& spans) const {
+        size_t total = 0;
+        for (const Memory::HostSpan& span : spans) {
+            size_t read = Read(offset + total, span.size, span.pointer);
+            // Errors are reported as a length larger than the requested one
+            if (read > span.size)
+                break;
+            total += read;
+            if (read < span.size)
+                break;
+        }
+        return total;
+    }
+
     /**
      * Write data to the file
      * @param offset Offset in bytes to start writing data to
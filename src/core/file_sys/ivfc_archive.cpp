@@ -2,6 +2,7 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
@@ -21,6 +22,10 @@ std::string IVFCArchive::GetName() const {
 }
 
 std::unique_ptr<FileBackend> IVFCArchive::OpenFile(const Path& path, const Mode mode) const {
+    if (romfs_mapping != nullptr)
+        return Common::make_unique<IVFCFile>(romfs_mapping, data_offset, data_size);
+    if (romfs_cache != nullptr)
+        return Common::make_unique<IVFCFile>(romfs_cache, data_size);
     return Common::make_unique<IVFCFile>(romfs_file, data_offset, data_size);
 }
 
@@ -63,10 +68,19 @@ std::unique_ptr<DirectoryBackend> IVFCArchive::OpenDirectory(const Path& path) c
 
 size_t IVFCFile::Read(const u64 offset, const size_t length, u8* buffer) const {
     LOG_TRACE(Service_FS, "called offset=%llu, length=%d", offset, length);
-    romfs_file->Seek(data_offset + offset, SEEK_SET);
+    if (offset >= data_size)
+        return 0;
     size_t read_length = (size_t)std::min((u64)length, data_size - offset);
 
-    return romfs_file->ReadBytes(buffer, read_length);
+    if (romfs_mapping != nullptr) {
+        std::memcpy(buffer, romfs_mapping->GetData() + data_offset + offset, read_length);
+        return read_length;
+    }
+
+    if (romfs_cache != nullptr)
+        return romfs_cache->Read(offset, read_length, buffer);
+
+    return romfs_file->ReadBytesAt(buffer, read_length, data_offset + offset);
 }
 
 size_t IVFCFile::Write(const u64 offset, const size_t length, const bool flush, const u8* buffer) const {
@@ -15,6 +15,7 @@
 #include "core/file_sys/archive_backend.h"
 #include "core/file_sys/directory_backend.h"
 #include "core/file_sys/file_backend.h"
+#include "core/file_sys/ivfc_block_cache.h"
 #include "core/hle/result.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -26,11 +27,18 @@ namespace FileSys {
  * Helper which implements an interface to deal with IVFC images used in some archives
  * This should be subclassed by concrete archive types, which will provide the
  * input data (load the raw IVFC archive) and override any required methods
+ *
+ * The image is either read from a file, from a block cache in front of the file, or from a memory
+ * mapping of the file, which avoids a host read call for every access.
  */
 class IVFCArchive : public ArchiveBackend {
 public:
     IVFCArchive(std::shared_ptr<FileUtil::IOFile> file, u64 offset, u64 size)
         : romfs_file(file), data_offset(offset), data_size(size) {}
+    IVFCArchive(std::shared_ptr<FileUtil::MappedFile> mapping, u64 offset, u64 size)
+        : romfs_mapping(mapping), data_offset(offset), data_size(size) {}
+    IVFCArchive(std::shared_ptr<IVFCBlockCache> cache, u64 size)
+        : romfs_cache(cache), data_offset(0), data_size(size) {}
 
     std::string GetName() const override;
 
@@ -45,6 +53,8 @@ public:
 
 protected:
     std::shared_ptr<FileUtil::IOFile> romfs_file;
+    std::shared_ptr<FileUtil::MappedFile> romfs_mapping;
+    std::shared_ptr<IVFCBlockCache> romfs_cache;
     u64 data_offset;
     u64 data_size;
 };
@@ -53,6 +63,10 @@ class IVFCFile : public FileBackend {
 public:
     IVFCFile(std::shared_ptr<FileUtil::IOFile> file, u64 offset, u64 size)
         : romfs_file(file), data_offset(offset), data_size(size) {}
+    IVFCFile(std::shared_ptr<FileUtil::MappedFile> mapping, u64 offset, u64 size)
+        : romfs_mapping(mapping), data_offset(offset), data_size(size) {}
+    IVFCFile(std::shared_ptr<IVFCBlockCache> cache, u64 size)
+        : romfs_cache(cache), data_offset(0), data_size(size) {}
 
     bool Open() override { return true; }
     size_t Read(u64 offset, size_t length, u8* buffer) const override;
@@ -64,6 +78,8 @@ public:
 
 private:
     std::shared_ptr<FileUtil::IOFile> romfs_file;
+    std::shared_ptr<FileUtil::MappedFile> romfs_mapping;
+    std::shared_ptr<IVFCBlockCache> romfs_cache;
     u64 data_offset;
     u64 data_size;
 };
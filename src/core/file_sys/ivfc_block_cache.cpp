@@ -0,0 +1,141 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/thread.h"
+
+#include "core/file_sys/ivfc_block_cache.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+IVFCBlockCache::IVFCBlockCache(std::shared_ptr<FileUtil::IOFile> file, u64 offset, u64 size, size_t max_size)
+        : file(file), data_offset(offset), data_size(size) {
+    // Keep at least the blocks of a read and its prefetched successors
+    max_blocks = std::max(max_size / BLOCK_SIZE, PREFETCH_BLOCKS + 2);
+    prefetch_thread = std::thread(&IVFCBlockCache::PrefetchLoop, this);
+}
+
+IVFCBlockCache::~IVFCBlockCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        prefetch_running = false;
+    }
+    prefetch_requested.notify_one();
+    prefetch_thread.join();
+}
+
+size_t IVFCBlockCache::Read(u64 offset, size_t length, u8* buffer) {
+    size_t read_length = (size_t)std::min((u64)length, data_size - offset);
+    if (read_length == 0)
+        return 0;
+
+    const u64 first_block = offset / BLOCK_SIZE;
+    const u64 last_block = (offset + read_length - 1) / BLOCK_SIZE;
+    const u64 num_blocks = (data_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        bool sequential = offset == last_read_end;
+        last_read_end = offset + read_length;
+
+        if (sequential) {
+            for (u64 index = last_block + 1; index <= last_block + PREFETCH_BLOCKS && index < num_blocks; ++index) {
+                if (blocks.count(index) == 0 && prefetch_pending.insert(index).second)
+                    prefetch_queue.push_back(index);
+            }
+            prefetch_requested.notify_one();
+        }
+    }
+
+    size_t done = 0;
+    for (u64 index = first_block; index <= last_block; ++index) {
+        BlockPtr block = GetBlock(index);
+        if (block == nullptr)
+            break;
+
+        size_t block_offset = (size_t)(offset + done - index * BLOCK_SIZE);
+        size_t copy_length = std::min(read_length - done, block->size() - block_offset);
+        std::memcpy(buffer + done, block->data() + block_offset, copy_length);
+        done += copy_length;
+    }
+    return done;
+}
+
+IVFCBlockCache::BlockPtr IVFCBlockCache::GetBlock(u64 index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto itr = blocks.find(index);
+        if (itr != blocks.end()) {
+            lru_order.splice(lru_order.begin(), lru_order, itr->second.lru_position);
+            return itr->second.data;
+        }
+    }
+
+    // Read outside of the lock, so that other threads can hit the cache in the meantime. If two
+    // threads miss the same block, it is simply read twice.
+    BlockPtr data = LoadBlock(index);
+    if (data != nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        InsertBlock(index, data);
+    }
+    return data;
+}
+
+IVFCBlockCache::BlockPtr IVFCBlockCache::LoadBlock(u64 index) const {
+    const u64 block_start = index * BLOCK_SIZE;
+    const size_t block_length = (size_t)std::min((u64)BLOCK_SIZE, data_size - block_start);
+
+    auto data = std::make_shared<std::vector<u8>>(block_length);
+    if (file->ReadBytesAt(data->data(), block_length, data_offset + block_start) != block_length)
+        return nullptr;
+    return data;
+}
+
+void IVFCBlockCache::InsertBlock(u64 index, BlockPtr data) {
+    auto itr = blocks.find(index);
+    if (itr != blocks.end()) {
+        lru_order.splice(lru_order.begin(), lru_order, itr->second.lru_position);
+        return;
+    }
+
+    while (blocks.size() >= max_blocks) {
+        blocks.erase(lru_order.back());
+        lru_order.pop_back();
+    }
+
+    lru_order.push_front(index);
+    blocks.emplace(index, CachedBlock{ std::move(data), lru_order.begin() });
+}
+
+void IVFCBlockCache::PrefetchLoop() {
+    Common::SetCurrentThreadName("RomFSPrefetch");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        prefetch_requested.wait(lock, [this]{ return !prefetch_queue.empty() || !prefetch_running; });
+        if (!prefetch_running)
+            break;
+
+        u64 index = prefetch_queue.front();
+        prefetch_queue.pop_front();
+
+        if (blocks.count(index) == 0) {
+            lock.unlock();
+            BlockPtr data = LoadBlock(index);
+            lock.lock();
+
+            if (data != nullptr)
+                InsertBlock(index, std::move(data));
+        }
+        prefetch_pending.erase(index);
+    }
+}
+
+} // namespace FileSys
@@ -0,0 +1,91 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+/**
+ * Least-recently-used cache of fixed-size blocks of an IVFC image stored in a file, shared by all
+ * files opened from the image. Titles tend to stream their RomFS in small sequential chunks, so
+ * reads continuing where the previous one ended make a background thread fetch the next blocks
+ * before they are requested. Can be used from multiple threads at once.
+ */
+class IVFCBlockCache {
+public:
+    static const size_t BLOCK_SIZE = 0x10000;
+
+    /// Number of blocks fetched ahead of a sequential read
+    static const size_t PREFETCH_BLOCKS = 4;
+
+    /**
+     * @param file File containing the image
+     * @param offset Offset of the image in the file
+     * @param size Size of the image
+     * @param max_size Number of bytes the cached blocks may take up in total
+     */
+    IVFCBlockCache(std::shared_ptr<FileUtil::IOFile> file, u64 offset, u64 size, size_t max_size);
+    ~IVFCBlockCache();
+
+    /// Reads from the image at the given offset, which must be inside the image.
+    size_t Read(u64 offset, size_t length, u8* buffer);
+
+private:
+    typedef std::shared_ptr<const std::vector<u8>> BlockPtr;
+
+    struct CachedBlock {
+        BlockPtr data;
+        /// Position in lru_order
+        std::list<u64>::iterator lru_position;
+    };
+
+    /// Returns the given block, reading it from the file if it isn't cached
+    BlockPtr GetBlock(u64 index);
+
+    /// Reads the given block from the file, without holding the mutex
+    BlockPtr LoadBlock(u64 index) const;
+
+    /// Adds a block to the cache, evicting the least recently used ones if full. Needs the mutex.
+    void InsertBlock(u64 index, BlockPtr data);
+
+    void PrefetchLoop();
+
+    std::shared_ptr<FileUtil::IOFile> file;
+    u64 data_offset;
+    u64 data_size;
+    size_t max_blocks;
+
+    std::mutex mutex;
+    std::unordered_map<u64, CachedBlock> blocks;
+    /// Block indices, most recently used first
+    std::list<u64> lru_order;
+    /// End of the last read, to detect sequential access
+    u64 last_read_end = 0;
+
+    std::thread prefetch_thread;
+    std::condition_variable prefetch_requested;
+    std::deque<u64> prefetch_queue;
+    /// Blocks queued or being read for prefetching
+    std::unordered_set<u64> prefetch_pending;
+    bool prefetch_running = true;
+};
+
+} // namespace FileSys
@@ -0,0 +1,108 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "common/common_types.h"
+
+#include "core/core_timing.h"
+#include "core/frame_limiter.h"
+#include "core/settings.h"
+
+namespace FrameLimiter {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::microseconds;
+
+/// Largest lag of emulated time behind host time which the limiter tries to make up for
+static const microseconds MAX_LAG(100000);
+/// Remaining wait time below which the limiter spins instead of sleeping
+static const microseconds SPIN_THRESHOLD(2000);
+/// Lag which causes frames to be skipped, about one frame at 60 Hz
+static const microseconds SKIP_THRESHOLD(16667);
+/// Maximum number of frames skipped in a row
+static const int MAX_CONSECUTIVE_SKIPS = 4;
+
+static Clock::time_point host_base;
+static u64 ticks_base;
+static int consecutive_skips;
+
+static void ResetBase() {
+    host_base = Clock::now();
+    ticks_base = CoreTiming::GetTicks();
+}
+
+/// Returns the emulated time elapsed since the reference point
+static microseconds EmulatedElapsed() {
+    return microseconds(cyclesToUs(static_cast<s64>(CoreTiming::GetTicks() - ticks_base)));
+}
+
+/// Returns the host time elapsed since the reference point
+static microseconds HostElapsed() {
+    return std::chrono::duration_cast<microseconds>(Clock::now() - host_base);
+}
+
+void Init() {
+    ResetBase();
+    consecutive_skips = 0;
+}
+
+void DoFrameLimiting() {
+    microseconds emulated = EmulatedElapsed();
+    microseconds host = HostElapsed();
+
+    if (emulated > host) {
+        if (!Settings::values.use_frame_limit) {
+            // Keep the reference recent, so that enabling the limit later doesn't stall emulation
+            ResetBase();
+            return;
+        }
+
+        Clock::time_point target = host_base + emulated;
+        microseconds remaining = emulated - host;
+        if (remaining > SPIN_THRESHOLD)
+            std::this_thread::sleep_for(remaining - SPIN_THRESHOLD);
+
+        while (Clock::now() < target)
+            std::this_thread::yield();
+    } else if (host - emulated > MAX_LAG) {
+        // Too far behind to catch up without running noticeably fast for a while
+        ResetBase();
+    }
+}
+
+s64 SleepWhileIdle(s64 cycles_to_event) {
+    if (!Settings::values.use_frame_limit || !Settings::values.use_idle_sleep || cycles_to_event <= 0)
+        return cycles_to_event;
+
+    const microseconds emulated = EmulatedElapsed();
+    const Clock::time_point deadline = host_base + emulated + microseconds(cyclesToUs(cycles_to_event));
+
+    // Short waits aren't worth a sleep, DoFrameLimiting makes up for them at the end of the frame
+    if (deadline - Clock::now() < SPIN_THRESHOLD)
+        return cycles_to_event;
+
+    if (!CoreTiming::WaitForThreadsafeEvent(deadline))
+        return cycles_to_event;
+
+    // Idle at least a cycle, since Idle() treats 0 as no limit
+    const s64 slept = usToCycles(static_cast<s64>((HostElapsed() - emulated).count()));
+    return std::max<s64>(std::min(slept, cycles_to_event), 1);
+}
+
+bool ShouldSkipFrame() {
+    bool behind = HostElapsed() - EmulatedElapsed() > SKIP_THRESHOLD;
+
+    if (!behind || consecutive_skips >= MAX_CONSECUTIVE_SKIPS) {
+        consecutive_skips = 0;
+        return false;
+    }
+
+    ++consecutive_skips;
+    return true;
+}
+
+} // namespace
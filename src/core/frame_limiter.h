@@ -0,0 +1,42 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Paces emulation against host time.
+ *
+ * Emulated time, as given by the CoreTiming tick count, is compared to the host time elapsed
+ * since a common starting point. When emulation is ahead, the limiter waits until the host
+ * catches up: sleeping for most of the time, then spinning for the last stretch, since sleeps are
+ * only accurate to about a scheduler tick. When emulation has fallen too far behind to catch up
+ * (e.g. after being paused), the starting point is moved instead of fast-forwarding.
+ */
+namespace FrameLimiter {
+
+/// Resets the reference point to the current host and emulated time
+void Init();
+
+/// Waits until the host has caught up with emulated time, if the speed limit is enabled
+void DoFrameLimiting();
+
+/**
+ * Called while no emulated thread can run. If the speed limit and Settings::values.use_idle_sleep
+ * are enabled, sleeps until the host reaches the emulated time of the next event, or until another
+ * thread schedules an event.
+ * @param cycles_to_event Number of cycles up to the next event
+ * @return Number of cycles to idle for, which is less than cycles_to_event if the sleep was cut
+ *         short, so that the new event isn't handled later than the host time it arrived at
+ */
+s64 SleepWhileIdle(s64 cycles_to_event);
+
+/**
+ * Decides whether rendering of the next frame should be skipped because emulation is falling
+ * behind. A frame is always rendered after a few consecutive skips, so the screen keeps updating.
+ */
+bool ShouldSkipFrame();
+
+} // namespace
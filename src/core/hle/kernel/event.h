@@ -5,13 +5,14 @@
 #pragma once
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/svc.h"
 
 namespace Kernel {
 
-class Event final : public WaitObject {
+class Event final : public WaitObject, public Common::PoolAllocated<Event> {
 public:
     /**
      * Creates an event
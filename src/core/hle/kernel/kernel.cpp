@@ -5,7 +5,9 @@
 #include <algorithm>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
+#include "common/profiler.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/resource_limit.h"
@@ -16,8 +18,37 @@
 namespace Kernel {
 
 unsigned int Object::next_object_id;
+unsigned int Object::num_live_objects;
 HandleTable g_handle_table;
 
+using Common::Profiling::MemoryCounter;
+
+static MemoryCounter object_counter("Kernel Objects", MemoryCounter::Unit::Objects);
+
+/// Live objects of each type, indexed by HandleType
+static MemoryCounter object_type_counters[] = {
+    { "Other",            MemoryCounter::Unit::Objects, &object_counter },
+    { "Ports",            MemoryCounter::Unit::Objects, &object_counter },
+    { "Sessions",         MemoryCounter::Unit::Objects, &object_counter },
+    { "Events",           MemoryCounter::Unit::Objects, &object_counter },
+    { "Mutexes",          MemoryCounter::Unit::Objects, &object_counter },
+    { "Shared Memory",    MemoryCounter::Unit::Objects, &object_counter },
+    { "Redirections",     MemoryCounter::Unit::Objects, &object_counter },
+    { "Threads",          MemoryCounter::Unit::Objects, &object_counter },
+    { "Processes",        MemoryCounter::Unit::Objects, &object_counter },
+    { "Address Arbiters", MemoryCounter::Unit::Objects, &object_counter },
+    { "Semaphores",       MemoryCounter::Unit::Objects, &object_counter },
+    { "Timers",           MemoryCounter::Unit::Objects, &object_counter },
+    { "Resource Limits",  MemoryCounter::Unit::Objects, &object_counter },
+    { "Code Sets",        MemoryCounter::Unit::Objects, &object_counter },
+};
+
+void Object::AccountLiveObject(HandleType type, int delta) {
+    const size_t index = (size_t)type < ARRAY_SIZE(object_type_counters) ? (size_t)type : 0;
+    object_type_counters[index].Add(delta);
+    object_counter.Add(delta);
+}
+
 void WaitObject::AddWaitingThread(SharedPtr<Thread> thread) {
     auto itr = std::find(waiting_threads.begin(), waiting_threads.end(), thread);
     if (itr == waiting_threads.end())
@@ -109,6 +140,19 @@ SharedPtr<Object> HandleTable::GetGeneric(Handle handle) const {
     return objects[GetSlot(handle)];
 }
 
+Object* HandleTable::GetGenericRaw(Handle handle) const {
+    if (handle == CurrentThread) {
+        return GetCurrentThread();
+    } else if (handle == CurrentProcess) {
+        return g_current_process.get();
+    }
+
+    if (!IsValid(handle)) {
+        return nullptr;
+    }
+    return objects[GetSlot(handle)].get();
+}
+
 void HandleTable::Clear() {
     for (u16 i = 0; i < MAX_COUNT; ++i) {
         generations[i] = i + 1;
@@ -138,4 +182,36 @@ void Shutdown() {
     g_current_process = nullptr;
 }
 
+void DoState(PointerWrap& p) {
+    auto s = p.Section("Kernel", 1);
+    if (!s)
+        return;
+
+    // Kernel objects aren't serialized, so no object may have been created since the state was saved
+    // CoreTiming events refer to kernel objects by pointer, so none may have been destroyed either
+    unsigned int next_object_id = Object::next_object_id;
+    p.Do(next_object_id);
+    unsigned int num_live_objects = Object::num_live_objects;
+    p.Do(num_live_objects);
+
+    // The application's code and data segments are backed by its code set rather than the arena.
+    // The image is mapped into the address space, so it can only be overwritten in place.
+    u8* code_memory = g_current_process != nullptr ? g_current_process->codeset->GetImage() : nullptr;
+    const size_t current_code_size = code_memory != nullptr ? g_current_process->codeset->GetImageSize() : 0;
+    u32 code_size = static_cast<u32>(current_code_size);
+    p.Do(code_size);
+
+    if (next_object_id != Object::next_object_id || num_live_objects != Object::num_live_objects ||
+        code_size != current_code_size) {
+        LOG_ERROR(Kernel, "Save state was made with different kernel objects");
+        p.SetError(PointerWrap::ERROR_FAILURE);
+        return;
+    }
+
+    ThreadingDoState(p);
+
+    if (code_memory != nullptr)
+        p.DoVoid(code_memory, code_size);
+}
+
 } // namespace
@@ -14,6 +14,8 @@
 
 #include "common/common_types.h"
 
+class PointerWrap;
+
 #include "core/hle/hle.h"
 #include "core/hle/result.h"
 
@@ -56,7 +58,8 @@ enum {
 
 class Object : NonCopyable {
 public:
-    virtual ~Object() {}
+    Object() { ++num_live_objects; }
+    virtual ~Object() { --num_live_objects; }
 
     /// Returns a unique identifier for the object. For debugging purposes only.
     unsigned int GetObjectId() const { return object_id; }
@@ -93,22 +96,32 @@ public:
 
 public:
     static unsigned int next_object_id;
+    /// Number of kernel objects which currently exist
+    static unsigned int num_live_objects;
 
 private:
     friend void intrusive_ptr_add_ref(Object*);
     friend void intrusive_ptr_release(Object*);
 
+    /**
+     * Updates the memory counter of live objects of the given type. Objects are accounted from
+     * their first reference on, when their dynamic type is known, until the last one is dropped.
+     */
+    static void AccountLiveObject(HandleType type, int delta);
+
     unsigned int ref_count = 0;
     unsigned int object_id = next_object_id++;
 };
 
 // Special functions used by boost::instrusive_ptr to do automatic ref-counting
 inline void intrusive_ptr_add_ref(Object* object) {
-    ++object->ref_count;
+    if (object->ref_count++ == 0)
+        Object::AccountLiveObject(object->GetHandleType(), 1);
 }
 
 inline void intrusive_ptr_release(Object* object) {
     if (--object->ref_count == 0) {
+        Object::AccountLiveObject(object->GetHandleType(), -1);
         delete object;
     }
 }
@@ -234,6 +247,41 @@ public:
         return nullptr;
     }
 
+    /**
+     * Looks up a handle without taking a reference to the object. The returned pointer is only
+     * valid as long as the handle stays open, so this is meant for lookups whose result doesn't
+     * outlive the current SVC and which can't close the handle in the meantime.
+     * @return Pointer to the looked-up object, or `nullptr` if the handle is not valid.
+     */
+    Object* GetGenericRaw(Handle handle) const;
+
+    /**
+     * Borrowing variant of Get(). See GetGenericRaw() for when it's safe to use.
+     * @return Pointer to the looked-up object, or `nullptr` if the handle is not valid or its
+     *         type differs from the handle type `T::HANDLE_TYPE`.
+     */
+    template <class T>
+    T* GetRaw(Handle handle) const {
+        Object* object = GetGenericRaw(handle);
+        if (object != nullptr && object->GetHandleType() == T::HANDLE_TYPE) {
+            return static_cast<T*>(object);
+        }
+        return nullptr;
+    }
+
+    /**
+     * Borrowing variant of GetWaitObject(). See GetGenericRaw() for when it's safe to use.
+     * @return Pointer to the looked-up object, or `nullptr` if the handle is not valid or it is
+     *         not a waitable object.
+     */
+    WaitObject* GetWaitObjectRaw(Handle handle) const {
+        Object* object = GetGenericRaw(handle);
+        if (object != nullptr && object->IsWaitable()) {
+            return static_cast<WaitObject*>(object);
+        }
+        return nullptr;
+    }
+
     /// Closes all handles held in this table.
     void Clear();
 
@@ -274,4 +322,10 @@ void Init();
 /// Shutdown the kernel
 void Shutdown();
 
+/**
+ * Saves or restores the kernel state which can be restored without recreating kernel objects,
+ * after checking that the objects are the same ones the state was saved with.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -7,6 +7,7 @@
 #include <string>
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
 #include "core/hle/kernel/kernel.h"
 
@@ -14,7 +15,7 @@ namespace Kernel {
 
 class Thread;
 
-class Mutex final : public WaitObject {
+class Mutex final : public WaitObject, public Common::PoolAllocated<Mutex> {
 public:
     /**
      * Creates a mutex.
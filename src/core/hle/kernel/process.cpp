@@ -4,6 +4,7 @@
 
 #include "common/assert.h"
 #include "common/common_funcs.h"
+#include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
 
@@ -13,6 +14,7 @@
 #include "core/hle/kernel/vm_manager.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
+#include "core/memory_setup.h"
 
 namespace Kernel {
 
@@ -28,6 +30,18 @@ SharedPtr<CodeSet> CodeSet::Create(std::string name, u64 program_id) {
 CodeSet::CodeSet() {}
 CodeSet::~CodeSet() {}
 
+u8* CodeSet::GetImage() const {
+    if (mapped_image != nullptr)
+        return mapped_image->GetWritableData();
+    return memory != nullptr ? memory->data() : nullptr;
+}
+
+size_t CodeSet::GetImageSize() const {
+    if (mapped_image != nullptr)
+        return static_cast<size_t>(mapped_image->GetSize());
+    return memory != nullptr ? memory->size() : 0;
+}
+
 u32 Process::next_process_id;
 
 SharedPtr<Process> Process::Create(SharedPtr<CodeSet> code_set) {
@@ -103,9 +117,15 @@ void Process::ParseKernelCaps(const u32* kernel_caps, size_t len) {
 }
 
 void Process::Run(s32 main_thread_priority, u32 stack_size) {
+    // The main thread starts running in this process' address space
+    Memory::SetCurrentPageTable(address_space->GetPageTable());
+
     auto MapSegment = [&](CodeSet::Segment& segment, VMAPermission permissions, MemoryState memory_state) {
-        auto vma = address_space->MapMemoryBlock(segment.addr, codeset->memory,
-                segment.offset, segment.size, memory_state).Unwrap();
+        auto vma = codeset->mapped_image != nullptr
+                ? address_space->MapBackingMemory(segment.addr, codeset->GetImage() + segment.offset,
+                                                  segment.size, memory_state).Unwrap()
+                : address_space->MapMemoryBlock(segment.addr, codeset->memory,
+                                                segment.offset, segment.size, memory_state).Unwrap();
         address_space->Reprotect(vma, permissions);
     };
 
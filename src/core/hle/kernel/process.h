@@ -16,6 +16,10 @@
 
 #include "core/hle/kernel/kernel.h"
 
+namespace FileUtil {
+class MappedFile;
+}
+
 namespace Kernel {
 
 struct AddressMapping {
@@ -65,6 +69,12 @@ struct CodeSet final : public Object {
     u64 program_id;
 
     std::shared_ptr<std::vector<u8>> memory;
+    /// Copy-on-write mapping of a cached image file, which backs the segments instead of `memory` if set
+    std::shared_ptr<FileUtil::MappedFile> mapped_image;
+
+    /// Returns the memory backing the segments, which their offsets are relative to
+    u8* GetImage() const;
+    size_t GetImageSize() const;
 
     struct Segment {
         size_t offset = 0;
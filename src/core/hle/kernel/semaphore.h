@@ -8,12 +8,13 @@
 #include <string>
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
 #include "core/hle/kernel/kernel.h"
 
 namespace Kernel {
 
-class Semaphore final : public WaitObject {
+class Semaphore final : public WaitObject, public Common::PoolAllocated<Semaphore> {
 public:
     /**
      * Creates a semaphore.
@@ -3,10 +3,13 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <array>
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 #include "common/math_util.h"
@@ -19,10 +22,12 @@
 #include "core/hle/hle.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/process.h"
+#include "core/hle/kernel/vm_manager.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hle/kernel/mutex.h"
 #include "core/hle/result.h"
 #include "core/memory.h"
+#include "core/memory_setup.h"
 
 namespace Kernel {
 
@@ -37,10 +42,6 @@ void Thread::Acquire() {
     ASSERT_MSG(!ShouldWait(), "object unavailable!");
 }
 
-// TODO(yuriks): This can be removed if Thread objects are explicitly pooled in the future, allowing
-//               us to simply use a pool index or similar.
-static Kernel::HandleTable wakeup_callback_handle_table;
-
 // Lists all thread ids that aren't deleted/etc.
 static std::vector<SharedPtr<Thread>> thread_list;
 
@@ -49,6 +50,9 @@ static Common::ThreadQueueList<Thread*, THREADPRIO_LOWEST+1> ready_queue;
 
 static Thread* current_thread;
 
+/// Threads waiting on each arbitration address, in the order they started waiting
+static std::unordered_map<VAddr, std::vector<Thread*>> arbiter_waiters;
+
 // The first available thread id at startup
 static u32 next_thread_id;
 
@@ -61,7 +65,12 @@ inline static u32 const NewThreadId() {
 }
 
 Thread::Thread() {}
-Thread::~Thread() {}
+Thread::~Thread() {
+    CoreTiming::UnscheduleEvent(wakeup_event);
+
+    if (Core::g_app_core != nullptr)
+        Core::g_app_core->ReleaseContext(context);
+}
 
 Thread* GetCurrentThread() {
     return current_thread;
@@ -77,18 +86,35 @@ static bool CheckWait_WaitObject(const Thread* thread, WaitObject* wait_object)
     if (thread->status != THREADSTATUS_WAIT_SYNCH)
         return false;
 
-    auto itr = std::find(thread->wait_objects.begin(), thread->wait_objects.end(), wait_object);
-    return itr != thread->wait_objects.end();
+    auto end = thread->wait_objects.begin() + thread->num_wait_objects;
+    return std::find(thread->wait_objects.begin(), end, wait_object) != end;
 }
 
 /**
- * Check if the specified thread is waiting on the specified address to be arbitrated
- * @param thread The thread to test
- * @param wait_address The address to test against
- * @return True if the thread is waiting, false otherwise
+ * Stops a thread from waiting on the objects of its last WaitSynchronization call
+ * @param thread The thread whose wait objects should be released
  */
-static bool CheckWait_AddressArbiter(const Thread* thread, VAddr wait_address) {
-    return thread->status == THREADSTATUS_WAIT_ARB && wait_address == thread->wait_address;
+static void ReleaseWaitObjects(Thread* thread) {
+    for (size_t i = 0; i < thread->num_wait_objects; ++i) {
+        thread->wait_objects[i]->RemoveWaitingThread(thread);
+        thread->wait_objects[i] = nullptr;
+    }
+    thread->num_wait_objects = 0;
+}
+
+/**
+ * Removes a thread in THREADSTATUS_WAIT_ARB from the wait list of its arbitration address
+ * @param thread The thread to remove
+ */
+static void RemoveArbiterWaiter(Thread* thread) {
+    auto itr = arbiter_waiters.find(thread->wait_address);
+    if (itr == arbiter_waiters.end())
+        return;
+
+    std::vector<Thread*>& waiters = itr->second;
+    waiters.erase(std::remove(waiters.begin(), waiters.end(), thread), waiters.end());
+    if (waiters.empty())
+        arbiter_waiters.erase(itr);
 }
 
 void Thread::Stop() {
@@ -96,14 +122,15 @@ void Thread::Stop() {
     ReleaseThreadMutexes(this);
 
     // Cancel any outstanding wakeup events for this thread
-    CoreTiming::UnscheduleEvent(ThreadWakeupEventType, callback_handle);
-    wakeup_callback_handle_table.Close(callback_handle);
-    callback_handle = 0;
+    CoreTiming::UnscheduleEvent(wakeup_event);
+    wakeup_event = 0;
 
     // Clean up thread from ready queue
     // This is only needed when the thread is termintated forcefully (SVC TerminateProcess)
     if (status == THREADSTATUS_READY){
         ready_queue.remove(current_priority, this);
+    } else if (status == THREADSTATUS_WAIT_ARB) {
+        RemoveArbiterWaiter(this);
     }
 
     status = THREADSTATUS_DEAD;
@@ -111,10 +138,7 @@ void Thread::Stop() {
     WakeupAllWaitingThreads();
 
     // Clean up any dangling references in objects that this thread was waiting for
-    for (auto& wait_object : wait_objects) {
-        wait_object->RemoveWaitingThread(this);
-    }
-    wait_objects.clear();
+    ReleaseWaitObjects(this);
 
     Kernel::g_current_process->used_tls_slots[tls_index] = false;
 
@@ -122,58 +146,59 @@ void Thread::Stop() {
 }
 
 Thread* ArbitrateHighestPriorityThread(u32 address) {
-    Thread* highest_priority_thread = nullptr;
-    s32 priority = THREADPRIO_LOWEST;
-
-    // Iterate through threads, find highest priority thread that is waiting to be arbitrated...
-    for (auto& thread : thread_list) {
-        if (!CheckWait_AddressArbiter(thread.get(), address))
-            continue;
+    auto itr = arbiter_waiters.find(address);
+    if (itr == arbiter_waiters.end())
+        return nullptr;
 
-        if (thread == nullptr)
-            continue;
+    // Priorities may have changed since the threads started waiting, so look for the highest one
+    // now. Among equal priorities, the thread which has been waiting the longest is picked.
+    const std::vector<Thread*>& waiters = itr->second;
+    Thread* highest_priority_thread = *std::min_element(waiters.begin(), waiters.end(),
+            [](const Thread* a, const Thread* b) { return a->current_priority < b->current_priority; });
 
-        if(thread->current_priority <= priority) {
-            highest_priority_thread = thread.get();
-            priority = thread->current_priority;
-        }
-    }
-
-    // If a thread was arbitrated, resume it
-    if (nullptr != highest_priority_thread) {
-        highest_priority_thread->ResumeFromWait();
-    }
+    // Resuming the thread also removes it from the wait list
+    highest_priority_thread->ResumeFromWait();
 
     return highest_priority_thread;
 }
 
 void ArbitrateAllThreads(u32 address) {
-    // Resume all threads found to be waiting on the address
-    for (auto& thread : thread_list) {
-        if (CheckWait_AddressArbiter(thread.get(), address))
-            thread->ResumeFromWait();
-    }
+    auto itr = arbiter_waiters.find(address);
+    if (itr == arbiter_waiters.end())
+        return;
+
+    // Resume all threads found to be waiting on the address. The list is taken out of the map
+    // first, since resuming each thread would otherwise modify it while it's being iterated.
+    std::vector<Thread*> waiters = std::move(itr->second);
+    arbiter_waiters.erase(itr);
+
+    for (Thread* thread : waiters)
+        thread->ResumeFromWait();
 }
 
 /// Boost low priority threads (temporarily) that have been starved
 static void PriorityBoostStarvedThreads() {
-    u64 current_ticks = CoreTiming::GetTicks();
-
-    for (auto& thread : thread_list) {
-        // TODO(bunnei): Threads that have been waiting to be scheduled for `boost_ticks` (or
-        // longer) will have their priority temporarily adjusted to 1 higher than the highest
-        // priority thread to prevent thread starvation. This general behavior has been verified
-        // on hardware. However, this is almost certainly not perfect, and the real CTR OS scheduler
-        // should probably be reversed to verify this.
-
-        const u64 boost_timeout = 2000000;  // Boost threads that have been ready for > this long
-
-        u64 delta = current_ticks - thread->last_running_ticks;
-
-        if (thread->status == THREADSTATUS_READY && delta > boost_timeout) {
-            const s32 priority = std::max(ready_queue.get_first()->current_priority - 1, 0);
-            thread->BoostPriority(priority);
-        }
+    // TODO(bunnei): Threads that have been waiting to be scheduled for `boost_ticks` (or
+    // longer) will have their priority temporarily adjusted to 1 higher than the highest
+    // priority thread to prevent thread starvation. This general behavior has been verified
+    // on hardware. However, this is almost certainly not perfect, and the real CTR OS scheduler
+    // should probably be reversed to verify this.
+
+    const u64 boost_timeout = 2000000;  // Boost threads that have been ready for > this long
+    const u64 current_ticks = CoreTiming::GetTicks();
+
+    // Threads mostly join the back of their priority level, so the one at the front is the one
+    // which has been ready the longest. Only those need to be checked, instead of every thread.
+    std::array<Thread*, THREADPRIO_LOWEST + 1> starved_threads;
+    size_t num_starved = 0;
+    ready_queue.for_each_front([&](Thread* thread) {
+        if (current_ticks - thread->ready_ticks > boost_timeout)
+            starved_threads[num_starved++] = thread;
+    });
+
+    for (size_t i = 0; i < num_starved; ++i) {
+        const s32 priority = std::max(ready_queue.get_first()->current_priority - 1, 0);
+        starved_threads[i]->BoostPriority(priority);
     }
 }
 
@@ -194,6 +219,7 @@ static void SwitchContext(Thread* new_thread) {
             // yielding execution (i.e. an event triggered, system core time-sliced, etc)
             ready_queue.push_front(previous_thread->current_priority, previous_thread);
             previous_thread->status = THREADSTATUS_READY;
+            previous_thread->ready_ticks = previous_thread->last_running_ticks;
         }
     }
 
@@ -202,10 +228,18 @@ static void SwitchContext(Thread* new_thread) {
         DEBUG_ASSERT_MSG(new_thread->status == THREADSTATUS_READY, "Thread must be ready to become running.");
 
         // Cancel any outstanding wakeup events for this thread
-        CoreTiming::UnscheduleEvent(ThreadWakeupEventType, new_thread->callback_handle);
+        CoreTiming::UnscheduleEvent(new_thread->wakeup_event);
+        new_thread->wakeup_event = 0;
 
         current_thread = new_thread;
 
+        // Switch to the address space of the new thread's process
+        if (new_thread->owner_process != nullptr && new_thread->owner_process != g_current_process) {
+            g_current_process = new_thread->owner_process;
+            Memory::SetCurrentPageTable(g_current_process->address_space->GetPageTable());
+            Core::g_app_core->ClearInstructionCache();
+        }
+
         // If the thread was waited by a svcWaitSynch call, step back PC by one instruction to rerun
         // the SVC when the thread wakes up. This is necessary to ensure that the thread can acquire
         // the requested wait object(s) before continuing.
@@ -219,11 +253,7 @@ static void SwitchContext(Thread* new_thread) {
 
         // Clean up the thread's wait_objects, they'll be restored if needed during
         // the svcWaitSynchronization call
-        for (int i = 0; i < new_thread->wait_objects.size(); ++i) {
-            SharedPtr<WaitObject> object = new_thread->wait_objects[i];
-            object->RemoveWaitingThread(new_thread);
-        }
-        new_thread->wait_objects.clear();
+        ReleaseWaitObjects(new_thread);
 
         ready_queue.remove(new_thread->current_priority, new_thread);
         new_thread->status = THREADSTATUS_RUNNING;
@@ -232,6 +262,8 @@ static void SwitchContext(Thread* new_thread) {
         new_thread->current_priority = new_thread->nominal_priority;
 
         Core::g_app_core->LoadContext(new_thread->context);
+        // A reservation made by the previous thread must not let a store of the new one succeed
+        Core::g_app_core->ClearExclusiveState();
         Core::g_app_core->SetCP15Register(CP15_THREAD_URO, new_thread->GetTLSAddress());
     } else {
         current_thread = nullptr;
@@ -268,11 +300,29 @@ void WaitCurrentThread_Sleep() {
     HLE::Reschedule(__func__);
 }
 
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all) {
+bool YieldCurrentThread() {
+    Thread* thread = GetCurrentThread();
+    const Thread* next = ready_queue.get_first();
+    if (next == nullptr || next->current_priority > thread->current_priority)
+        return false;
+
+    ready_queue.push_back(thread->current_priority, thread);
+    thread->status = THREADSTATUS_READY;
+    thread->ready_ticks = CoreTiming::GetTicks();
+
+    HLE::Reschedule(__func__);
+    return true;
+}
+
+void WaitCurrentThread_WaitSynchronization(WaitObject* const* wait_objects, size_t num_wait_objects,
+                                           bool wait_set_output, bool wait_all) {
+    ASSERT(num_wait_objects <= MAX_WAIT_OBJECTS);
+
     Thread* thread = GetCurrentThread();
     thread->wait_set_output = wait_set_output;
     thread->wait_all = wait_all;
-    thread->wait_objects = std::move(wait_objects);
+    std::copy(wait_objects, wait_objects + num_wait_objects, thread->wait_objects.begin());
+    thread->num_wait_objects = num_wait_objects;
     thread->waitsynch_waited = true;
     thread->status = THREADSTATUS_WAIT_SYNCH;
 }
@@ -281,19 +331,16 @@ void WaitCurrentThread_ArbitrateAddress(VAddr wait_address) {
     Thread* thread = GetCurrentThread();
     thread->wait_address = wait_address;
     thread->status = THREADSTATUS_WAIT_ARB;
+    arbiter_waiters[wait_address].push_back(thread);
 }
 
 /**
  * Callback that will wake up the thread it was scheduled for
- * @param thread_handle The handle of the thread that's been awoken
+ * @param thread_pointer Pointer to the thread that's been awoken
  * @param cycles_late The number of CPU cycles that have passed since the desired wakeup time
  */
-static void ThreadWakeupCallback(u64 thread_handle, int cycles_late) {
-    SharedPtr<Thread> thread = wakeup_callback_handle_table.Get<Thread>((Handle)thread_handle);
-    if (thread == nullptr) {
-        LOG_CRITICAL(Kernel, "Callback fired for invalid thread %08X", (Handle)thread_handle);
-        return;
-    }
+static void ThreadWakeupCallback(u64 thread_pointer, int cycles_late) {
+    SharedPtr<Thread> thread = reinterpret_cast<Thread*>(static_cast<uintptr_t>(thread_pointer));
 
     thread->waitsynch_waited = false;
 
@@ -313,14 +360,20 @@ void Thread::WakeAfterDelay(s64 nanoseconds) {
     if (nanoseconds == -1)
         return;
 
+    // A thread can only be woken up by one timeout at a time
+    CoreTiming::UnscheduleEvent(wakeup_event);
+
     u64 microseconds = nanoseconds / 1000;
-    CoreTiming::ScheduleEvent(usToCycles(microseconds), ThreadWakeupEventType, callback_handle);
+    wakeup_event = CoreTiming::ScheduleEvent(usToCycles(microseconds), ThreadWakeupEventType, reinterpret_cast<uintptr_t>(this));
 }
 
 void Thread::ResumeFromWait() {
     switch (status) {
-        case THREADSTATUS_WAIT_SYNCH:
         case THREADSTATUS_WAIT_ARB:
+            RemoveArbiterWaiter(this);
+            break;
+
+        case THREADSTATUS_WAIT_SYNCH:
         case THREADSTATUS_WAIT_SLEEP:
             break;
 
@@ -342,6 +395,7 @@ void Thread::ResumeFromWait() {
 
     ready_queue.push_back(current_priority, this);
     status = THREADSTATUS_READY;
+    ready_ticks = CoreTiming::GetTicks();
 }
 
 /**
@@ -384,7 +438,6 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     SharedPtr<Thread> thread(new Thread);
 
     thread_list.push_back(thread);
-    ready_queue.prepare(priority);
 
     thread->thread_id = NewThreadId();
     thread->status = THREADSTATUS_DORMANT;
@@ -392,13 +445,14 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     thread->stack_top = stack_top;
     thread->nominal_priority = thread->current_priority = priority;
     thread->last_running_ticks = CoreTiming::GetTicks();
+    thread->ready_ticks = thread->last_running_ticks;
     thread->processor_id = processor_id;
     thread->wait_set_output = false;
     thread->wait_all = false;
-    thread->wait_objects.clear();
+    thread->num_wait_objects = 0;
     thread->wait_address = 0;
     thread->name = std::move(name);
-    thread->callback_handle = wakeup_callback_handle_table.Create(thread).MoveFrom();
+    thread->wakeup_event = 0;
     thread->owner_process = g_current_process;
     thread->tls_index = -1;
     thread->waitsynch_waited = false;
@@ -421,6 +475,7 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
 
     ready_queue.push_back(thread->current_priority, thread.get());
     thread->status = THREADSTATUS_READY;
+    thread->ready_ticks = CoreTiming::GetTicks();
 
     HLE::Reschedule(__func__);
 
@@ -447,8 +502,6 @@ void Thread::SetPriority(s32 priority) {
     // If thread was ready, adjust queues
     if (status == THREADSTATUS_READY)
         ready_queue.move(this, current_priority, priority);
-    else
-        ready_queue.prepare(priority);
 
     nominal_priority = current_priority = priority;
 }
@@ -524,6 +577,53 @@ void ThreadingShutdown() {
     }
     thread_list.clear();
     ready_queue.clear();
+    arbiter_waiters.clear();
+}
+
+/// Reads a value which has to match the one in the emulator, failing the load if it doesn't
+template <typename T>
+static void DoExpected(PointerWrap& p, T value, const char* what) {
+    T saved = value;
+    p.Do(saved);
+    if (saved != value) {
+        LOG_ERROR(Kernel, "Save state doesn't match the running threads (%s differs)", what);
+        p.SetError(PointerWrap::ERROR_FAILURE);
+    }
+}
+
+void ThreadingDoState(PointerWrap& p) {
+    auto s = p.Section("Threading", 1);
+    if (!s)
+        return;
+
+    DoExpected(p, static_cast<u32>(thread_list.size()), "number of threads");
+    DoExpected(p, current_thread != nullptr ? current_thread->thread_id : 0, "current thread");
+    for (const auto& thread : thread_list) {
+        DoExpected(p, thread->thread_id, "thread ID");
+        DoExpected(p, thread->status, "thread status");
+        DoExpected(p, thread->current_priority, "thread priority");
+    }
+    if (p.error == PointerWrap::ERROR_FAILURE)
+        return;
+
+    // The running thread's context lives in the CPU until the next reschedule, and the VFP
+    // registers of the last thread which used them until another one does
+    if (current_thread != nullptr && p.GetMode() != PointerWrap::MODE_READ)
+        Core::g_app_core->SaveContext(current_thread->context);
+    Core::g_app_core->FlushVFPContext();
+
+    for (const auto& thread : thread_list) {
+        p.Do(thread->context);
+        p.Do(thread->last_running_ticks);
+        p.Do(thread->ready_ticks);
+        p.Do(thread->waitsynch_waited);
+        p.Do(thread->wait_address);
+        p.Do(thread->wait_all);
+        p.Do(thread->wait_set_output);
+    }
+
+    if (current_thread != nullptr && p.GetMode() == PointerWrap::MODE_READ)
+        Core::g_app_core->LoadContext(current_thread->context);
 }
 
 } // namespace
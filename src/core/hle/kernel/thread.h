@@ -4,14 +4,17 @@
 
 #pragma once
 
+#include <array>
 #include <string>
 #include <vector>
 
 #include <boost/container/flat_set.hpp>
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
 #include "core/core.h"
+#include "core/core_timing.h"
 
 #include "core/hle/hle.h"
 #include "core/hle/kernel/kernel.h"
@@ -44,10 +47,13 @@ enum ThreadStatus {
 
 namespace Kernel {
 
+/// Maximum number of objects a thread can wait on at once, as limited by WaitSynchronizationN
+const size_t MAX_WAIT_OBJECTS = 256;
+
 class Mutex;
 class Process;
 
-class Thread final : public WaitObject {
+class Thread final : public WaitObject, public Common::PoolAllocated<Thread> {
 public:
     /**
      * Creates and returns a new thread. The new thread is immediately scheduled
@@ -142,6 +148,7 @@ public:
     s32 current_priority;   ///< Current thread priority, can be temporarily changed
 
     u64 last_running_ticks; ///< CPU tick when thread was last running
+    u64 ready_ticks;        ///< CPU tick when thread was last put in the ready queue
 
     s32 processor_id;
 
@@ -153,15 +160,18 @@ public:
     boost::container::flat_set<SharedPtr<Mutex>> held_mutexes;
 
     SharedPtr<Process> owner_process; ///< Process that owns this thread
-    std::vector<SharedPtr<WaitObject>> wait_objects; ///< Objects that the thread is waiting on
+    /// Objects that the thread is waiting on. Only the first `num_wait_objects` entries are used.
+    std::array<SharedPtr<WaitObject>, MAX_WAIT_OBJECTS> wait_objects;
+    size_t num_wait_objects;
     VAddr wait_address;     ///< If waiting on an AddressArbiter, this is the arbitration address
     bool wait_all;          ///< True if the thread is waiting on all objects before resuming
     bool wait_set_output;   ///< True if the output parameter should be set on thread wakeup
 
     std::string name;
 
-    /// Handle used as userdata to reference this object when inserting into the CoreTiming queue.
-    Handle callback_handle;
+    /// Pending CoreTiming event which will wake this thread up, if any. Its userdata points to the
+    /// thread, so it's unscheduled when the thread stops.
+    CoreTiming::EventHandle wakeup_event;
 
 private:
     Thread();
@@ -203,13 +213,23 @@ Thread* GetCurrentThread();
  */
 void WaitCurrentThread_Sleep();
 
+/**
+ * Moves the current thread to the back of its priority level and reschedules, without scheduling
+ * a wakeup event. Only done if another thread of the same or a higher priority is ready, since
+ * lower priority threads only get to run while the current one waits.
+ * @return Whether the thread yielded
+ */
+bool YieldCurrentThread();
+
 /**
  * Waits the current thread from a WaitSynchronization call
  * @param wait_objects Kernel objects that we are waiting on
+ * @param num_wait_objects Number of objects in `wait_objects`, at most MAX_WAIT_OBJECTS
  * @param wait_set_output If true, set the output parameter on thread wakeup (for WaitSynchronizationN only)
  * @param wait_all If true, wait on all objects before resuming (for WaitSynchronizationN only)
  */
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all);
+void WaitCurrentThread_WaitSynchronization(WaitObject* const* wait_objects, size_t num_wait_objects,
+                                           bool wait_set_output, bool wait_all);
 
 /**
  * Waits the current thread from an ArbitrateAddress call
@@ -227,4 +247,12 @@ void ThreadingInit();
  */
 void ThreadingShutdown();
 
+/**
+ * Saves or restores the CPU contexts and timestamps of the threads. The set of threads and their
+ * scheduling states aren't restored but checked, since wait lists and the ready queue can't be
+ * rebuilt from a save state. A state therefore only loads while the same threads are in the
+ * same states as when it was saved.
+ */
+void ThreadingDoState(PointerWrap& p);
+
 } // namespace
@@ -14,12 +14,11 @@ namespace Kernel {
 
 /// The event type of the generic timer callback event
 static int timer_callback_event_type;
-// TODO(yuriks): This can be removed if Timer objects are explicitly pooled in the future, allowing
-//               us to simply use a pool index or similar.
-static Kernel::HandleTable timer_callback_handle_table;
 
 Timer::Timer() {}
-Timer::~Timer() {}
+Timer::~Timer() {
+    CoreTiming::UnscheduleEvent(timer_event);
+}
 
 SharedPtr<Timer> Timer::Create(ResetType reset_type, std::string name) {
     SharedPtr<Timer> timer(new Timer);
@@ -29,7 +28,7 @@ SharedPtr<Timer> Timer::Create(ResetType reset_type, std::string name) {
     timer->name = std::move(name);
     timer->initial_delay = 0;
     timer->interval_delay = 0;
-    timer->callback_handle = timer_callback_handle_table.Create(timer).MoveFrom();
+    timer->timer_event = 0;
 
     return timer;
 }
@@ -50,14 +49,15 @@ void Timer::Set(s64 initial, s64 interval) {
     interval_delay = interval;
 
     u64 initial_microseconds = initial / 1000;
-    CoreTiming::ScheduleEvent(usToCycles(initial_microseconds),
-            timer_callback_event_type, callback_handle);
+    timer_event = CoreTiming::ScheduleEvent(usToCycles(initial_microseconds),
+            timer_callback_event_type, reinterpret_cast<uintptr_t>(this));
 
     HLE::Reschedule(__func__);
 }
 
 void Timer::Cancel() {
-    CoreTiming::UnscheduleEvent(timer_callback_event_type, callback_handle);
+    CoreTiming::UnscheduleEvent(timer_event);
+    timer_event = 0;
 
     HLE::Reschedule(__func__);
 }
@@ -67,15 +67,11 @@ void Timer::Clear() {
 }
 
 /// The timer callback event, called when a timer is fired
-static void TimerCallback(u64 timer_handle, int cycles_late) {
-    SharedPtr<Timer> timer = timer_callback_handle_table.Get<Timer>(static_cast<Handle>(timer_handle));
-
-    if (timer == nullptr) {
-        LOG_CRITICAL(Kernel, "Callback fired for invalid timer %08lX", timer_handle);
-        return;
-    }
+static void TimerCallback(u64 timer_pointer, int cycles_late) {
+    // Keeps the timer alive even if waking up the threads releases their references to it
+    SharedPtr<Timer> timer = reinterpret_cast<Timer*>(static_cast<uintptr_t>(timer_pointer));
 
-    LOG_TRACE(Kernel, "Timer %u fired", timer_handle);
+    LOG_TRACE(Kernel, "Timer %u fired", timer->GetObjectId());
 
     timer->signaled = true;
 
@@ -88,13 +84,14 @@ static void TimerCallback(u64 timer_handle, int cycles_late) {
     if (timer->interval_delay != 0) {
         // Reschedule the timer with the interval delay
         u64 interval_microseconds = timer->interval_delay / 1000;
-        CoreTiming::ScheduleEvent(usToCycles(interval_microseconds) - cycles_late,
-                timer_callback_event_type, timer_handle);
+        timer->timer_event = CoreTiming::ScheduleEvent(usToCycles(interval_microseconds) - cycles_late,
+                timer_callback_event_type, timer_pointer);
+    } else {
+        timer->timer_event = 0;
     }
 }
 
 void TimersInit() {
-    timer_callback_handle_table.Clear();
     timer_callback_event_type = CoreTiming::RegisterEvent("TimerCallback", TimerCallback);
 }
 
@@ -5,13 +5,15 @@
 #pragma once
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
+#include "core/core_timing.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/svc.h"
 
 namespace Kernel {
 
-class Timer final : public WaitObject {
+class Timer final : public WaitObject, public Common::PoolAllocated<Timer> {
 public:
     /**
      * Creates a timer
@@ -35,6 +37,10 @@ public:
     u64 initial_delay;                      ///< The delay until the timer fires for the first time
     u64 interval_delay;                     ///< The delay until the timer fires after the first time
 
+    /// The pending CoreTiming event which fires the timer. Its userdata points to the timer, so
+    /// the event is unscheduled when the timer is destroyed.
+    CoreTiming::EventHandle timer_event;
+
     bool ShouldWait() override;
     void Acquire() override;
 
@@ -51,9 +57,6 @@ public:
 private:
     Timer();
     ~Timer() override;
-
-    /// Handle used as userdata to reference this object when inserting into the CoreTiming queue.
-    Handle callback_handle;
 };
 
 /// Initializes the required variables for timers
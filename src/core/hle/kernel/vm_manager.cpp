@@ -5,12 +5,19 @@
 #include <iterator>
 
 #include "common/assert.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
 
+#include "core/core.h"
+#include "core/arm/arm_interface.h"
 #include "core/hle/kernel/vm_manager.h"
 #include "core/memory_setup.h"
 
 namespace Kernel {
 
+/// Size of the memory mapped into the address spaces of all processes, including MMIO
+static Common::Profiling::MemoryCounter mapped_memory_counter("Mapped Memory");
+
 bool VirtualMemoryArea::CanBeMergedWith(const VirtualMemoryArea& next) const {
     ASSERT(base + size == next.base);
     if (permissions != next.permissions ||
@@ -31,16 +38,22 @@ bool VirtualMemoryArea::CanBeMergedWith(const VirtualMemoryArea& next) const {
     return true;
 }
 
-VMManager::VMManager() {
+VMManager::VMManager() : page_table(Common::make_unique<Memory::PageTable>()) {
     Reset();
 }
 
 VMManager::~VMManager() {
+    // Don't leave the accessors pointing into a page table that is about to be freed
+    if (Memory::GetCurrentPageTable() == page_table.get())
+        Memory::SetCurrentPageTable(nullptr);
+
     Reset();
 }
 
 void VMManager::Reset() {
+    AccountMapping(-(s64)mapped_size);
     vma_map.clear();
+    last_found_vma = vma_map.end();
 
     // Initialize the map with a single free region covering the entire managed space.
     VirtualMemoryArea initial_vma;
@@ -51,7 +64,14 @@ void VMManager::Reset() {
 }
 
 VMManager::VMAHandle VMManager::FindVMA(VAddr target) const {
-    return std::prev(vma_map.upper_bound(target));
+    // VMAs are only resized in place when splitting or merging, so the bounds are checked again
+    if (last_found_vma != vma_map.end() && target >= last_found_vma->second.base &&
+        target - last_found_vma->second.base < last_found_vma->second.size) {
+        return last_found_vma;
+    }
+
+    last_found_vma = std::prev(vma_map.upper_bound(target));
+    return last_found_vma;
 }
 
 ResultVal<VMManager::VMAHandle> VMManager::MapMemoryBlock(VAddr target,
@@ -70,6 +90,7 @@ ResultVal<VMManager::VMAHandle> VMManager::MapMemoryBlock(VAddr target,
     final_vma.backing_block = block;
     final_vma.offset = offset;
     UpdatePageTableForVMA(final_vma);
+    AccountMapping(size);
 
     return MakeResult<VMAHandle>(MergeAdjacent(vma_handle));
 }
@@ -87,6 +108,7 @@ ResultVal<VMManager::VMAHandle> VMManager::MapBackingMemory(VAddr target, u8 * m
     final_vma.meminfo_state = state;
     final_vma.backing_memory = memory;
     UpdatePageTableForVMA(final_vma);
+    AccountMapping(size);
 
     return MakeResult<VMAHandle>(MergeAdjacent(vma_handle));
 }
@@ -102,6 +124,7 @@ ResultVal<VMManager::VMAHandle> VMManager::MapMMIO(VAddr target, PAddr paddr, u3
     final_vma.meminfo_state = state;
     final_vma.paddr = paddr;
     UpdatePageTableForVMA(final_vma);
+    AccountMapping(size);
 
     return MakeResult<VMAHandle>(MergeAdjacent(vma_handle));
 }
@@ -110,6 +133,8 @@ void VMManager::Unmap(VMAHandle vma_handle) {
     VMAIter iter = StripIterConstness(vma_handle);
 
     VirtualMemoryArea& vma = iter->second;
+    if (vma.type != VMAType::Free)
+        AccountMapping(-(s64)vma.size);
     vma.type = VMAType::Free;
     vma.permissions = VMAPermission::None;
     vma.meminfo_state = MemoryState::Free;
@@ -144,6 +169,11 @@ void VMManager::LogLayout() const {
     }
 }
 
+void VMManager::AccountMapping(s64 size) {
+    mapped_size += size;
+    mapped_memory_counter.Add(size);
+}
+
 VMManager::VMAIter VMManager::StripIterConstness(const VMAHandle & iter) {
     // This uses a neat C++ trick to convert a const_iterator to a regular iterator, given
     // non-const access to its container.
@@ -225,6 +255,8 @@ VMManager::VMAIter VMManager::MergeAdjacent(VMAIter iter) {
     VMAIter next_vma = std::next(iter);
     if (next_vma != vma_map.end() && iter->second.CanBeMergedWith(next_vma->second)) {
         iter->second.size += next_vma->second.size;
+        if (last_found_vma == next_vma)
+            last_found_vma = vma_map.end();
         vma_map.erase(next_vma);
     }
 
@@ -232,6 +264,8 @@ VMManager::VMAIter VMManager::MergeAdjacent(VMAIter iter) {
         VMAIter prev_vma = std::prev(iter);
         if (prev_vma->second.CanBeMergedWith(iter->second)) {
             prev_vma->second.size += iter->second.size;
+            if (last_found_vma == iter)
+                last_found_vma = vma_map.end();
             vma_map.erase(iter);
             iter = prev_vma;
         }
@@ -243,19 +277,22 @@ VMManager::VMAIter VMManager::MergeAdjacent(VMAIter iter) {
 void VMManager::UpdatePageTableForVMA(const VirtualMemoryArea& vma) {
     switch (vma.type) {
     case VMAType::Free:
-        Memory::UnmapRegion(vma.base, vma.size);
+        Memory::UnmapRegion(*page_table, vma.base, vma.size);
         break;
     case VMAType::AllocatedMemoryBlock:
-        Memory::MapMemoryRegion(vma.base, vma.size, vma.backing_block->data() + vma.offset);
+        Memory::MapMemoryRegion(*page_table, vma.base, vma.size, vma.backing_block->data() + vma.offset);
         break;
     case VMAType::BackingMemory:
-        Memory::MapMemoryRegion(vma.base, vma.size, vma.backing_memory);
+        Memory::MapMemoryRegion(*page_table, vma.base, vma.size, vma.backing_memory);
         break;
     case VMAType::MMIO:
-        // TODO(yuriks): Add support for MMIO handlers.
-        Memory::MapIoRegion(vma.base, vma.size);
+        Memory::MapIoRegion(*page_table, vma.base, vma.size, vma.paddr);
         break;
     }
+
+    // Any code previously translated from this range no longer reflects what is mapped there
+    if (Core::g_app_core != nullptr && Memory::GetCurrentPageTable() == page_table.get())
+        Core::g_app_core->InvalidateCacheRange(vma.base, vma.size);
 }
 
 }
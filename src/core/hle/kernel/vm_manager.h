@@ -9,9 +9,14 @@
 #include <vector>
 
 #include "common/common_types.h"
+#include "common/pool_allocator.h"
 
 #include "core/hle/result.h"
 
+namespace Memory {
+struct PageTable;
+}
+
 namespace Kernel {
 
 enum class VMAType : u8 {
@@ -102,7 +107,6 @@ struct VirtualMemoryArea {
  *  - http://duartes.org/gustavo/blog/post/page-cache-the-affair-between-memory-and-files/
  */
 class VMManager final {
-    // TODO(yuriks): Make page tables switchable to support multiple VMManagers
 public:
     /**
      * The maximum amount of address space managed by the kernel. Addresses above this are never used.
@@ -115,9 +119,10 @@ public:
      * VMA. It must always be modified by splitting or merging VMAs, so that the invariant
      * `elem.base + elem.size == next.base` is preserved, and mergeable regions must always be
      * merged when possible so that no two similar and adjacent regions exist that have not been
-     * merged.
+     * merged. Its nodes come from a pool, as heap-heavy applications split and merge VMAs a lot.
      */
-    std::map<VAddr, VirtualMemoryArea> vma_map;
+    std::map<VAddr, VirtualMemoryArea, std::less<VAddr>,
+             Common::NodePoolAllocator<std::pair<const VAddr, VirtualMemoryArea>>> vma_map;
     using VMAHandle = decltype(vma_map)::const_iterator;
 
     VMManager();
@@ -126,7 +131,10 @@ public:
     /// Clears the address space map, re-initializing with a single free area.
     void Reset();
 
-    /// Finds the VMA in which the given address is included in, or `vma_map.end()`.
+    /**
+     * Finds the VMA in which the given address is included in, or `vma_map.end()`. Consecutive
+     * lookups tend to hit the same VMA, so the last one found is checked before searching the map.
+     */
     VMAHandle FindVMA(VAddr target) const;
 
     // TODO(yuriks): Should these functions actually return the handle?
@@ -172,6 +180,11 @@ public:
     /// Dumps the address space layout to the log, for debugging
     void LogLayout() const;
 
+    /// Returns the page table backing this address space, to be activated on context switches.
+    Memory::PageTable* GetPageTable() const {
+        return page_table.get();
+    }
+
 private:
     using VMAIter = decltype(vma_map)::iterator;
 
@@ -196,6 +209,18 @@ private:
      */
     VMAIter MergeAdjacent(VMAIter vma);
 
+    /// VMA returned by the last FindVMA call, or `vma_map.end()`. Reset whenever a VMA is erased.
+    mutable VMAHandle last_found_vma;
+
+    /// Page table which mirrors `vma_map`, kept up to date by UpdatePageTableForVMA.
+    std::unique_ptr<Memory::PageTable> page_table;
+
+    /// Total size of the VMAs which aren't free, accounted to the "Mapped Memory" memory counter
+    u64 mapped_size = 0;
+
+    /// Accounts a VMA that was just mapped (positive size) or is about to be unmapped (negative size)
+    void AccountMapping(s64 size);
+
     /// Updates the pages corresponding to this VMA so they match the VMA's attributes.
     void UpdatePageTableForVMA(const VirtualMemoryArea& vma);
 };
@@ -2,9 +2,12 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <memory>
+
 #include "common/common_paths.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 
 #include "core/hle/applets/applet.h"
 #include "core/hle/service/service.h"
@@ -37,7 +40,8 @@ static Kernel::SharedPtr<Kernel::Mutex> lock;
 static Kernel::SharedPtr<Kernel::Event> notification_event; ///< APT notification event
 static Kernel::SharedPtr<Kernel::Event> parameter_event; ///< APT parameter event
 
-static std::vector<u8> shared_font;
+/// The shared font file, mapped read-only so that its pages are only read in once they're copied
+static std::unique_ptr<FileUtil::MappedFile> shared_font;
 
 static u32 cpu_percent; ///< CPU time available to the running application
 
@@ -74,11 +78,11 @@ void Initialize(Service::Interface* self) {
 void GetSharedFont(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    if (!shared_font.empty()) {
+    if (shared_font != nullptr) {
         // TODO(bunnei): This function shouldn't copy the shared font every time it's called.
         // Instead, it should probably map the shared font as RO memory. We don't currently have
         // an easy way to do this, but the copy should be sufficient for now.
-        memcpy(Memory::GetPointer(SHARED_FONT_VADDR), shared_font.data(), shared_font.size());
+        memcpy(Memory::GetPointer(SHARED_FONT_VADDR), shared_font->GetData(), (size_t)shared_font->GetSize());
 
         cmd_buff[0] = IPC::MakeHeader(0x44, 2, 2);
         cmd_buff[1] = RESULT_SUCCESS.raw; // No error
@@ -391,23 +395,19 @@ void Init() {
     // a homebrew app to do this: https://github.com/citra-emu/3dsutils. Put the resulting file
     // "shared_font.bin" in the Citra "sysdata" directory.
 
-    shared_font.clear();
     std::string filepath = FileUtil::GetUserPath(D_SYSDATA_IDX) + SHARED_FONT;
 
     FileUtil::CreateFullPath(filepath); // Create path if not already created
-    FileUtil::IOFile file(filepath, "rb");
-
-    if (file.IsOpen()) {
-        // Read shared font data
-        shared_font.resize((size_t)file.GetSize());
-        file.ReadBytes(shared_font.data(), (size_t)file.GetSize());
+    shared_font = Common::make_unique<FileUtil::MappedFile>(filepath);
 
+    if (shared_font->IsOpen() && shared_font->GetSize() <= 3 * 1024 * 1024) {
         // Create shared font memory object
         using Kernel::MemoryPermission;
         shared_font_mem = Kernel::SharedMemory::Create(3 * 1024 * 1024, // 3MB
                 MemoryPermission::ReadWrite, MemoryPermission::Read, "APT_U:shared_font_mem");
     } else {
         LOG_WARNING(Service_APT, "Unable to load shared font: %s", filepath.c_str());
+        shared_font = nullptr;
         shared_font_mem = nullptr;
     }
 
@@ -424,7 +424,7 @@ void Init() {
 }
 
 void Shutdown() {
-    shared_font.clear();
+    shared_font = nullptr;
     shared_font_mem = nullptr;
     lock = nullptr;
     notification_event = nullptr;
@@ -2,12 +2,18 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
+#include <mutex>
 #include <system_error>
+#include <thread>
 #include <type_traits>
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <boost/container/flat_map.hpp>
 
@@ -16,21 +22,26 @@
 #include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
+#include "common/thread.h"
 
+#include "core/core_timing.h"
 #include "core/file_sys/archive_backend.h"
 #include "core/file_sys/archive_extsavedata.h"
 #include "core/file_sys/archive_savedata.h"
 #include "core/file_sys/archive_savedatacheck.h"
 #include "core/file_sys/archive_sdmc.h"
 #include "core/file_sys/archive_systemsavedata.h"
+#include "core/file_sys/disk_archive.h"
 #include "core/file_sys/directory_backend.h"
 #include "core/file_sys/file_backend.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/thread.h"
 #include "core/hle/service/service.h"
 #include "core/hle/service/fs/archive.h"
 #include "core/hle/service/fs/fs_user.h"
 #include "core/hle/result.h"
 #include "core/memory.h"
+#include "core/settings.h"
 
 // Specializes std::hash for ArchiveIdCode, so that we can use it in std::unordered_map.
 // Workaroung for libstdc++ bug: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=60970
@@ -85,14 +96,203 @@ enum class DirectoryCommand : u32 {
     Close           = 0x08020000,
 };
 
+// With use_async_fs, large reads are performed by a pool of I/O threads while the emulated system
+// keeps running. The requesting guest thread sleeps until a CoreTiming event, scheduled after the
+// estimated media latency, copies the data into guest memory, fills in the reply and wakes it up.
+// Other commands on the same file first wait for its pending reads, so the backends only ever see
+// concurrent reads.
+
+/// Reads shorter than this are performed synchronously, since the round trip would cost more
+static const u32 ASYNC_READ_MIN_LENGTH = 0x4000;
+
+static const size_t NUM_IO_THREADS = 2;
+
+/**
+ * Rough cost of reading from the game card or SD card, in ARM11 cycles: an access latency of about
+ * 100 us plus a transfer rate of about 10 MB/s.
+ */
+static const s64 MEDIA_ACCESS_CYCLES = 26800;
+static const s64 MEDIA_CYCLES_PER_KB = 27400;
+
+struct AsyncRead {
+    Kernel::SharedPtr<File> file;
+    Kernel::SharedPtr<Kernel::Thread> thread;
+    u64 offset;
+    u32 length;
+    VAddr address;
+
+    /// Filled by the I/O thread
+    std::vector<u8> data;
+    size_t read;
+    /// Set by the I/O thread once data and read are valid, protected by io_mutex
+    bool done;
+};
+
+static std::vector<std::thread> io_threads;
+static std::mutex io_mutex;
+static std::condition_variable io_requested;
+static std::condition_variable io_finished;
+/// Reads waiting for an I/O thread, protected by io_mutex
+static std::deque<AsyncRead*> io_queue;
+static bool io_threads_running = false;
+
+/// Reads which haven't been completed yet, keyed by the userdata of their completion event
+static std::unordered_map<u64, std::unique_ptr<AsyncRead>> async_reads;
+static u64 next_async_read_id = 0;
+static int async_read_event_type = -1;
+
+static void IOThreadLoop() {
+    Common::SetCurrentThreadName("FSIOThread");
+
+    std::unique_lock<std::mutex> lock(io_mutex);
+    while (true) {
+        io_requested.wait(lock, []{ return !io_queue.empty() || !io_threads_running; });
+        if (io_queue.empty())
+            break;
+
+        AsyncRead* request = io_queue.front();
+        io_queue.pop_front();
+
+        lock.unlock();
+        request->data.resize(request->length);
+        request->read = request->file->backend->Read(request->offset, request->length, request->data.data());
+        lock.lock();
+
+        request->done = true;
+        io_finished.notify_all();
+    }
+}
+
+/// Waits for the given read to be performed, and delivers its result to the requesting thread
+static void CompleteAsyncRead(u64 id) {
+    auto itr = async_reads.find(id);
+    if (itr == async_reads.end())
+        return;
+    std::unique_ptr<AsyncRead> request = std::move(itr->second);
+    async_reads.erase(itr);
+
+    {
+        // The host may be slower than the estimated media latency
+        std::unique_lock<std::mutex> lock(io_mutex);
+        io_finished.wait(lock, [&]{ return request->done; });
+    }
+
+    request->file->pending_async_reads--;
+
+    // The thread may have been stopped in the meantime
+    Kernel::Thread* thread = request->thread.get();
+    if (thread->status != THREADSTATUS_WAIT_SLEEP)
+        return;
+
+    if (request->read <= request->length)
+        Memory::WriteBlock(request->address, request->data.data(), request->read);
+
+    u32* cmd_buff = (u32*)Memory::GetPointer(thread->GetTLSAddress() + Kernel::kCommandHeaderOffset);
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+    cmd_buff[2] = static_cast<u32>(request->read);
+
+    thread->ResumeFromWait();
+    HLE::Reschedule(__func__);
+}
+
+static void AsyncReadCallback(u64 userdata, int cycles_late) {
+    CompleteAsyncRead(userdata);
+}
+
+/// Interval at which buffered writes to disk archive files are written back
+static const s64 FLUSH_BUFFERED_WRITES_INTERVAL_US = 1000000;
+
+static int flush_buffered_writes_event_type = -1;
+
+static void FlushBufferedWritesCallback(u64 userdata, int cycles_late) {
+    FileSys::DiskArchive::FlushBufferedFiles();
+    CoreTiming::ScheduleEvent(usToCycles(FLUSH_BUFFERED_WRITES_INTERVAL_US) - cycles_late,
+                              flush_buffered_writes_event_type);
+}
+
+/// Completes all pending reads from the given file right away
+static void CompleteAsyncReads(File* file) {
+    if (file->pending_async_reads == 0)
+        return;
+
+    std::vector<u64> ids;
+    for (const auto& request : async_reads) {
+        if (request.second->file == file)
+            ids.push_back(request.first);
+    }
+
+    for (u64 id : ids) {
+        CoreTiming::UnscheduleEvent(async_read_event_type, id);
+        CompleteAsyncRead(id);
+    }
+}
+
+/// Hands a read to the I/O threads and puts the current thread to sleep until it completes
+static void StartAsyncRead(File* file, u64 offset, u32 length, VAddr address) {
+    if (io_threads.empty()) {
+        io_threads_running = true;
+        for (size_t i = 0; i < NUM_IO_THREADS; ++i)
+            io_threads.emplace_back(IOThreadLoop);
+    }
+
+    std::unique_ptr<AsyncRead> request(new AsyncRead);
+    request->file = file;
+    request->thread = Kernel::GetCurrentThread();
+    request->offset = offset;
+    request->length = length;
+    request->address = address;
+    request->read = 0;
+    request->done = false;
+
+    {
+        std::lock_guard<std::mutex> lock(io_mutex);
+        io_queue.push_back(request.get());
+    }
+    io_requested.notify_one();
+
+    file->pending_async_reads++;
+
+    const u64 id = next_async_read_id++;
+    async_reads.emplace(id, std::move(request));
+
+    s64 cycles = MEDIA_ACCESS_CYCLES + (s64)length * MEDIA_CYCLES_PER_KB / 1024;
+    CoreTiming::ScheduleEvent(cycles, async_read_event_type, id);
+
+    Kernel::WaitCurrentThread_Sleep();
+}
+
+/// Stops the I/O threads after they have performed all queued reads, and drops pending results
+static void ShutdownAsyncReads() {
+    if (!io_threads.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(io_mutex);
+            io_threads_running = false;
+        }
+        io_requested.notify_all();
+        for (auto& thread : io_threads)
+            thread.join();
+        io_threads.clear();
+    }
+
+    for (const auto& request : async_reads)
+        CoreTiming::UnscheduleEvent(async_read_event_type, request.first);
+    async_reads.clear();
+}
+
 File::File(std::unique_ptr<FileSys::FileBackend>&& backend, const FileSys::Path & path)
-    : path(path), priority(0), backend(std::move(backend)) {}
+    : path(path), priority(0), backend(std::move(backend)), pending_async_reads(0) {}
 
 File::~File() {}
 
 ResultVal<bool> File::SyncRequest() {
     u32* cmd_buff = Kernel::GetCommandBuffer();
     FileCommand cmd = static_cast<FileCommand>(cmd_buff[0]);
+
+    // Commands are performed in order, and the backends must not be used by several threads at once
+    // except for reads
+    if (cmd != FileCommand::Read)
+        CompleteAsyncReads(this);
+
     switch (cmd) {
 
         // Read from file...
@@ -103,7 +303,26 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[5];
             LOG_TRACE(Service_FS, "Read %s %s: offset=0x%llx length=%d address=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address);
-            cmd_buff[2] = static_cast<u32>(backend->Read(offset, length, Memory::GetPointer(address)));
+            // Run-ahead snapshots can't see the I/O threads' writes, see SaveState::CaptureSnapshot
+            if (Settings::values.use_async_fs && Settings::values.run_ahead_frames == 0 &&
+                    length >= ASYNC_READ_MIN_LENGTH) {
+                // The reply is written once the read completes
+                StartAsyncRead(this, offset, length, address);
+                return MakeResult<bool>(false);
+            }
+
+            // Read straight into the guest buffer if it is regular memory
+            std::vector<Memory::HostSpan> spans;
+            if (Memory::GetHostSpansForWrite(address, length, spans)) {
+                cmd_buff[2] = static_cast<u32>(backend->ReadScatter(offset, spans));
+                break;
+            }
+
+            std::vector<u8> data(length);
+            size_t read = backend->Read(offset, length, data.data());
+            if (read <= length)
+                Memory::WriteBlock(address, data.data(), read);
+            cmd_buff[2] = static_cast<u32>(read);
             break;
         }
 
@@ -116,7 +335,9 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[6];
             LOG_TRACE(Service_FS, "Write %s %s: offset=0x%llx length=%d address=0x%x, flush=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address, flush);
-            cmd_buff[2] = static_cast<u32>(backend->Write(offset, length, flush != 0, Memory::GetPointer(address)));
+            std::vector<u8> data(length);
+            Memory::ReadBlock(address, data.data(), length);
+            cmd_buff[2] = static_cast<u32>(backend->Write(offset, length, flush != 0, data.data()));
             break;
         }
 
@@ -199,12 +420,14 @@ ResultVal<bool> Directory::SyncRequest() {
         {
             u32 count = cmd_buff[1];
             u32 address = cmd_buff[3];
-            auto entries = reinterpret_cast<FileSys::Entry*>(Memory::GetPointer(address));
+            std::vector<FileSys::Entry> entries(count);
             LOG_TRACE(Service_FS, "Read %s %s: count=%d",
                 GetTypeName().c_str(), GetName().c_str(), count);
 
             // Number of entries actually read
-            cmd_buff[2] = backend->Read(count, entries);
+            u32 read = backend->Read(count, entries.data());
+            Memory::WriteBlock(address, entries.data(), std::min(read, count) * sizeof(FileSys::Entry));
+            cmd_buff[2] = read;
             break;
         }
 
@@ -466,6 +689,7 @@ ResultCode DeleteExtSaveData(MediaType media_type, u32 high, u32 low) {
     // Delete all directories (/user, /boss) and the icon file.
     std::string base_path = FileSys::GetExtDataContainerPath(media_type_directory, media_type == MediaType::NAND);
     std::string extsavedata_path = FileSys::GetExtSaveDataPath(base_path, path);
+    FileSys::DiskArchive::CloseCachedFiles(extsavedata_path);
     if (!FileUtil::DeleteDirRecursively(extsavedata_path))
         return ResultCode(-1); // TODO(Subv): Find the right error code
     return RESULT_SUCCESS;
@@ -478,6 +702,7 @@ ResultCode DeleteSystemSaveData(u32 high, u32 low) {
     std::string nand_directory = FileUtil::GetUserPath(D_NAND_IDX);
     std::string base_path = FileSys::GetSystemSaveDataContainerPath(nand_directory);
     std::string systemsavedata_path = FileSys::GetSystemSaveDataPath(base_path, path);
+    FileSys::DiskArchive::CloseCachedFiles(systemsavedata_path);
     if (!FileUtil::DeleteDirRecursively(systemsavedata_path))
         return ResultCode(-1); // TODO(Subv): Find the right error code
     return RESULT_SUCCESS;
@@ -499,6 +724,13 @@ ResultCode CreateSystemSaveData(u32 high, u32 low) {
 void ArchiveInit() {
     next_handle = 1;
 
+    async_read_event_type = CoreTiming::RegisterEvent("FS::AsyncReadCallback", AsyncReadCallback);
+    // Registered regardless of the setting, so the event types of save states still match
+    flush_buffered_writes_event_type = CoreTiming::RegisterEvent("FS::FlushBufferedWrites",
+                                                                 FlushBufferedWritesCallback);
+    if (Settings::values.buffer_file_writes)
+        CoreTiming::ScheduleEvent(usToCycles(FLUSH_BUFFERED_WRITES_INTERVAL_US), flush_buffered_writes_event_type);
+
     AddService(new FS::Interface);
 
     // TODO(Subv): Add the other archive types (see here for the known types:
@@ -539,8 +771,11 @@ void ArchiveInit() {
 
 /// Shutdown archives
 void ArchiveShutdown() {
+    ShutdownAsyncReads();
+    FileSys::DiskArchive::FlushBufferedFiles();
     handle_map.clear();
     id_code_map.clear();
+    FileSys::DiskArchive::CloseCachedFiles("");
 }
 
 } // namespace FS
@@ -57,6 +57,7 @@ public:
     FileSys::Path path; ///< Path of the file
     u32 priority; ///< Priority of the file. TODO(Subv): Find out what this means
     std::unique_ptr<FileSys::FileBackend> backend; ///< File backend interface
+    u32 pending_async_reads; ///< Number of reads from the file still performed by an I/O thread
 };
 
 class Directory : public Kernel::Session {
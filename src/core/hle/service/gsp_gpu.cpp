@@ -2,8 +2,12 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <deque>
+#include <vector>
+
 #include "common/bit_field.h"
 
+#include "core/core_timing.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
 #include "core/hle/kernel/event.h"
@@ -14,8 +18,11 @@
 #include "core/hw/lcd.h"
 
 #include "video_core/gpu_debugger.h"
+#include "video_core/gpu_thread.h"
 #include "video_core/debug_utils/debug_utils.h"
+#include "video_core/rasterizer.h"
 #include "video_core/renderer_base.h"
+#include "video_core/texture_cache.h"
 #include "video_core/video_core.h"
 
 #include "gsp_gpu.h"
@@ -38,6 +45,20 @@ Kernel::SharedPtr<Kernel::SharedMemory> g_shared_memory;
 /// Thread index into interrupt relay queue
 u32 g_thread_id = 0;
 
+/// Nesting depth of the current interrupt batch, 0 if interrupts are signaled right away
+static unsigned interrupt_batch_depth = 0;
+/// Whether an interrupt was raised during the current batch
+static bool interrupt_batch_pending = false;
+
+struct QueuedCommand {
+    Command command;
+    u32 thread_id;
+};
+
+/// GX commands taken from the command buffers, which the GPU hasn't executed yet
+static std::deque<QueuedCommand> command_queue;
+static int command_event_type = -1;
+
 /// Gets a pointer to a thread command buffer in GSP shared memory
 static inline u8* GetCommandBuffer(u32 thread_id) {
     return g_shared_memory->GetPointer(0x800 + (thread_id * sizeof(CommandBuffer)));
@@ -94,13 +115,7 @@ static void WriteHWRegs(u32 base_address, u32 size_in_bytes, const u32* data) {
     if (!CheckWriteParameters(base_address, size_in_bytes))
         return;
 
-    while (size_in_bytes > 0) {
-        HW::Write<u32>(base_address + REGS_BEGIN, *data);
-
-        size_in_bytes -= 4;
-        ++data;
-        base_address += 4;
-    }
+    HW::WriteBlock(base_address + REGS_BEGIN, data, size_in_bytes / 4);
 }
 
 /**
@@ -118,9 +133,10 @@ static void WriteHWRegs(Service::Interface* self) {
     u32 reg_addr = cmd_buff[1];
     u32 size = cmd_buff[2];
 
-    u32* src = (u32*)Memory::GetPointer(cmd_buff[4]);
+    std::vector<u32> src((size + 3) / 4);
+    Memory::ReadBlock(cmd_buff[4], src.data(), size);
 
-    WriteHWRegs(reg_addr, size, src);
+    WriteHWRegs(reg_addr, size, src.data());
 }
 
 /**
@@ -137,22 +153,15 @@ static void WriteHWRegsWithMask(u32 base_address, u32 size_in_bytes, const u32*
     if (!CheckWriteParameters(base_address, size_in_bytes))
         return;
 
-    while (size_in_bytes > 0) {
-        const u32 reg_address = base_address + REGS_BEGIN;
-
-        u32 reg_value;
-        HW::Read<u32>(reg_value, reg_address);
-
-        // Update the current value of the register only for set mask bits
-        reg_value = (reg_value & ~*masks) | (*data | *masks);
+    const u32 count = size_in_bytes / 4;
+    std::vector<u32> reg_values(count);
+    HW::ReadBlock(base_address + REGS_BEGIN, reg_values.data(), count);
 
-        HW::Write<u32>(reg_address, reg_value);
+    // Update the current value of the register only for set mask bits
+    for (u32 i = 0; i < count; ++i)
+        reg_values[i] = (reg_values[i] & ~masks[i]) | (data[i] | masks[i]);
 
-        size_in_bytes -= 4;
-        ++data;
-        ++masks;
-        base_address += 4;
-    }
+    HW::WriteBlock(base_address + REGS_BEGIN, reg_values.data(), count);
 }
 
 /**
@@ -171,10 +180,12 @@ static void WriteHWRegsWithMask(Service::Interface* self) {
     u32 reg_addr = cmd_buff[1];
     u32 size = cmd_buff[2];
 
-    u32* src_data = (u32*)Memory::GetPointer(cmd_buff[4]);
-    u32* mask_data = (u32*)Memory::GetPointer(cmd_buff[6]);
+    std::vector<u32> src_data((size + 3) / 4);
+    std::vector<u32> mask_data((size + 3) / 4);
+    Memory::ReadBlock(cmd_buff[4], src_data.data(), size);
+    Memory::ReadBlock(cmd_buff[6], mask_data.data(), size);
 
-    WriteHWRegsWithMask(reg_addr, size, src_data, mask_data);
+    WriteHWRegsWithMask(reg_addr, size, src_data.data(), mask_data.data());
 }
 
 /// Read a GSP GPU hardware register
@@ -195,15 +206,11 @@ static void ReadHWRegs(Service::Interface* self) {
         return;
     }
 
-    u32* dst = (u32*)Memory::GetPointer(cmd_buff[0x41]);
-
-    while (size > 0) {
-        HW::Read<u32>(*dst, reg_addr + REGS_BEGIN);
+    std::vector<u32> data(size / 4);
+    for (size_t i = 0; i < data.size(); ++i)
+        HW::Read<u32>(data[i], reg_addr + REGS_BEGIN + (u32)i * 4);
 
-        size -= 4;
-        ++dst;
-        reg_addr += 4;
-    }
+    Memory::WriteBlock(cmd_buff[0x41], data.data(), size);
 }
 
 void SetBufferSwap(u32 screen_id, const FrameBufferInfo& info) {
@@ -271,7 +278,10 @@ static void FlushDataCache(Service::Interface* self) {
     u32 size    = cmd_buff[2];
     u32 process = cmd_buff[4];
 
+    GPUThread::Synchronize();
     VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::VirtualToPhysicalAddress(address), size);
+    Pica::TextureCache::NotifyFlush(Memory::VirtualToPhysicalAddress(address), size);
+    Pica::Rasterizer::NotifyFlush(Memory::VirtualToPhysicalAddress(address), size);
 
     // TODO(purpasmart96): Verify return header on HW
 
@@ -281,6 +291,35 @@ static void FlushDataCache(Service::Interface* self) {
               address, size, process);
 }
 
+/**
+ * GSP_GPU::InvalidateDataCache service function
+ *
+ * Called by applications before reading memory written by the GPU. The hardware rasterizer keeps
+ * rendering results in host textures, so write back any which overlap the region.
+ *
+ *  Inputs:
+ *      1 : Address
+ *      2 : Size
+ *      3 : Value 0, some descriptor for the KProcess Handle
+ *      4 : KProcess handle
+ *  Outputs:
+ *      1 : Result of function, 0 on success, otherwise error code
+ */
+static void InvalidateDataCache(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+    u32 address = cmd_buff[1];
+    u32 size    = cmd_buff[2];
+    u32 process = cmd_buff[4];
+
+    GPUThread::Synchronize();
+    VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(Memory::VirtualToPhysicalAddress(address), size);
+
+    cmd_buff[1] = RESULT_SUCCESS.raw; // No error
+
+    LOG_DEBUG(Service_GSP, "(STUBBED) called address=0x%08X, size=0x%08X, process=0x%08X",
+              address, size, process);
+}
+
 /**
  * GSP_GPU::RegisterInterruptRelayQueue service function
  *  Inputs:
@@ -347,9 +386,28 @@ void SignalInterrupt(InterruptId interrupt_id) {
             }
         }
     }
+
+    if (interrupt_batch_depth != 0) {
+        interrupt_batch_pending = true;
+        return;
+    }
     g_interrupt_event->Signal();
 }
 
+void BeginInterruptBatch() {
+    ++interrupt_batch_depth;
+}
+
+void EndInterruptBatch() {
+    DEBUG_ASSERT_MSG(interrupt_batch_depth != 0, "Unbalanced interrupt batch");
+    if (--interrupt_batch_depth != 0 || !interrupt_batch_pending)
+        return;
+
+    interrupt_batch_pending = false;
+    if (g_interrupt_event != nullptr)
+        g_interrupt_event->Signal();
+}
+
 /// Executes the next GSP command
 static void ExecuteCommand(const Command& command, u32 thread_id) {
     // Utility function to convert register ID to address
@@ -361,16 +419,21 @@ static void ExecuteCommand(const Command& command, u32 thread_id) {
 
     // GX request DMA - typically used for copying memory from GSP heap to VRAM
     case CommandId::REQUEST_DMA:
+        GPUThread::Synchronize();
+
         VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(Memory::VirtualToPhysicalAddress(command.dma_request.source_address),
                                                             command.dma_request.size);
 
-        memcpy(Memory::GetPointer(command.dma_request.dest_address),
-               Memory::GetPointer(command.dma_request.source_address),
-               command.dma_request.size);
+        Memory::CopyBlock(command.dma_request.dest_address, command.dma_request.source_address,
+                          command.dma_request.size);
         SignalInterrupt(InterruptId::DMA);
 
         VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address),
                                                           command.dma_request.size);
+        Pica::TextureCache::NotifyFlush(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address),
+                                        command.dma_request.size);
+        Pica::Rasterizer::NotifyFlush(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address),
+                                      command.dma_request.size);
         break;
 
     // ctrulib homebrew sends all relevant command list data with this command,
@@ -488,7 +551,80 @@ static void SetLcdForceBlack(Service::Interface* self) {
     cmd_buff[1] = RESULT_SUCCESS.raw;
 }
 
-/// This triggers handling of the GX command written to the command buffer in shared memory.
+/**
+ * Rough number of ARM11 cycles the GPU takes to execute a GX command, used to pace the command
+ * queue. Copies are assumed to move about 2 bytes per cycle and fills about 8, while command lists
+ * are charged per command word, since the cost of their draws isn't known in advance.
+ */
+static s64 EstimateCommandCycles(const Command& command) {
+    static const s64 BASE_CYCLES = 1000;
+
+    switch (command.id) {
+    case CommandId::REQUEST_DMA:
+        return BASE_CYCLES + command.dma_request.size / 2;
+
+    case CommandId::SET_COMMAND_LIST_LAST:
+        return BASE_CYCLES + command.set_command_list_last.size;
+
+    case CommandId::SET_MEMORY_FILL:
+    {
+        auto& params = command.memory_fill;
+        s64 size = 0;
+        if (params.start1 != 0 && params.end1 > params.start1)
+            size += params.end1 - params.start1;
+        if (params.start2 != 0 && params.end2 > params.start2)
+            size += params.end2 - params.start2;
+        return BASE_CYCLES + size / 8;
+    }
+
+    case CommandId::SET_DISPLAY_TRANSFER:
+    {
+        // The sizes are packed as (height << 16) | width, assume 4 bytes per pixel
+        u32 size = command.image_copy.out_buffer_size;
+        return BASE_CYCLES + (s64)(size & 0xFFFF) * (size >> 16) * 4 / 2;
+    }
+
+    default:
+        return BASE_CYCLES;
+    }
+}
+
+/**
+ * Executes the command at the head of the queue once the GPU is estimated to be done with it.
+ * When the event fired late, the commands which would have completed in the meantime are executed
+ * as well, and the interrupts of the whole batch are signaled together.
+ */
+static void CommandCallback(u64 userdata, int cycles_late) {
+    BeginInterruptBatch();
+
+    s64 budget = cycles_late;
+    while (!command_queue.empty()) {
+        QueuedCommand queued = command_queue.front();
+        command_queue.pop_front();
+
+        g_debugger.GXCommandProcessed((u8*)&queued.command);
+        ExecuteCommand(queued.command, queued.thread_id);
+
+        if (command_queue.empty())
+            break;
+
+        budget -= EstimateCommandCycles(command_queue.front().command);
+        if (budget < 0) {
+            CoreTiming::ScheduleEvent(-budget, command_event_type);
+            break;
+        }
+    }
+
+    // Command lists processed by the GPU thread in the meantime interrupt along with the batch
+    GPUThread::DeliverInterrupts();
+
+    EndInterruptBatch();
+}
+
+/**
+ * This triggers handling of the GX command written to the command buffer in shared memory. The
+ * commands are moved to the command queue, which the GPU works through in the background.
+ */
 static void TriggerCmdReqQueue(Service::Interface* self) {
     // Iterate through each thread's command queue...
     for (unsigned thread_id = 0; thread_id < 0x4; ++thread_id) {
@@ -496,16 +632,16 @@ static void TriggerCmdReqQueue(Service::Interface* self) {
 
         // Iterate through each command...
         for (unsigned i = 0; i < command_buffer->number_commands; ++i) {
-            g_debugger.GXCommandProcessed((u8*)&command_buffer->commands[i]);
-
-            // Decode and execute command
-            ExecuteCommand(command_buffer->commands[i], thread_id);
+            command_queue.push_back({ command_buffer->commands[i], thread_id });
 
-            // Indicates that command has completed
+            // Indicates that command has been accepted
             command_buffer->number_commands = command_buffer->number_commands - 1;
         }
     }
 
+    if (!command_queue.empty() && !CoreTiming::IsScheduled(command_event_type))
+        CoreTiming::ScheduleEvent(EstimateCommandCycles(command_queue.front().command), command_event_type);
+
     u32* cmd_buff = Kernel::GetCommandBuffer();
     cmd_buff[1] = 0; // No error
 }
@@ -565,7 +701,7 @@ const Interface::FunctionInfo FunctionTable[] = {
     {0x00060082, nullptr,                       "SetCommandList"},
     {0x000700C2, nullptr,                       "RequestDma"},
     {0x00080082, FlushDataCache,                "FlushDataCache"},
-    {0x00090082, nullptr,                       "InvalidateDataCache"},
+    {0x00090082, InvalidateDataCache,           "InvalidateDataCache"},
     {0x000A0044, nullptr,                       "RegisterInterruptEvents"},
     {0x000B0040, SetLcdForceBlack,              "SetLcdForceBlack"},
     {0x000C0000, TriggerCmdReqQueue,            "TriggerCmdReqQueue"},
@@ -596,6 +732,11 @@ const Interface::FunctionInfo FunctionTable[] = {
 Interface::Interface() {
     Register(FunctionTable);
 
+    command_queue.clear();
+    interrupt_batch_depth = 0;
+    interrupt_batch_pending = false;
+    command_event_type = CoreTiming::RegisterEvent("GSP_GPU::CommandCallback", CommandCallback);
+
     g_interrupt_event = nullptr;
 
     using Kernel::MemoryPermission;
@@ -606,6 +747,7 @@ Interface::Interface() {
 }
 
 Interface::~Interface() {
+    command_queue.clear();
     g_interrupt_event = nullptr;
     g_shared_memory = nullptr;
 }
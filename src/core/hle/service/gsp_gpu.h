@@ -174,6 +174,16 @@ public:
  */
 void SignalInterrupt(InterruptId interrupt_id);
 
+/**
+ * Starts a batch of interrupts: until the matching EndInterruptBatch call, interrupts are only
+ * written to the relay queues, and the GSP event is signaled once at the end of the batch. Saves
+ * the application a wakeup per interrupt when several are raised at once. Batches may be nested.
+ */
+void BeginInterruptBatch();
+
+/// Ends a batch started by BeginInterruptBatch, signaling the GSP event if any interrupt was raised
+void EndInterruptBatch();
+
 void SetBufferSwap(u32 screen_id, const FrameBufferInfo& info);
 
 /**
@@ -2,6 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
 #include "common/logging/log.h"
 #include "common/emu_window.h"
 
@@ -35,6 +37,18 @@ static Kernel::SharedPtr<Kernel::Event> event_debug_pad;
 static u32 next_pad_index;
 static u32 next_touch_index;
 
+/// Number of entries in the pad and touch histories
+static const u32 NUM_HISTORY_ENTRIES = 8;
+
+/// Input state of the last sample which differed from the one before
+static EmuWindow::InputState last_input;
+/// Number of samples in a row which had the state in last_input
+static u32 unchanged_samples;
+
+static int update_event_type = -1;
+/// Cycles between two samples of the input state
+static s64 update_interval;
+
 const std::array<Service::HID::PadState, Settings::NativeInput::NUM_INPUTS> pad_mapping = {
     Service::HID::PAD_A, Service::HID::PAD_B, Service::HID::PAD_X, Service::HID::PAD_Y,
     Service::HID::PAD_L, Service::HID::PAD_R, Service::HID::PAD_ZL, Service::HID::PAD_ZR,
@@ -58,64 +72,90 @@ const std::array<Service::HID::PadState, Settings::NativeInput::NUM_INPUTS> pad_
 //     * Set PadData.current_state.circle_left = 1 if current PadEntry.circle_pad_x <= -41
 //     * Set PadData.current_state.circle_right = 1 if current PadEntry.circle_pad_y <= -41
 
+/// Returns whether two samples of the input have the same state
+static bool IsSameInput(const EmuWindow::InputState& a, const EmuWindow::InputState& b) {
+    return a.pad_state.hex == b.pad_state.hex && a.touch_x == b.touch_x && a.touch_y == b.touch_y &&
+           a.touch_pressed == b.touch_pressed;
+}
+
 void Update() {
     SharedMem* mem = reinterpret_cast<SharedMem*>(shared_mem->GetPointer());
-    const PadState state = VideoCore::g_emu_window->GetPadState();
+    const EmuWindow::InputState input = VideoCore::g_emu_window->GetInputState();
+    const PadState state = input.pad_state;
 
     if (mem == nullptr) {
         LOG_DEBUG(Service_HID, "Cannot update HID prior to mapping shared memory!");
         return;
     }
 
-    mem->pad.current_state.hex = state.hex;
+    // Once an unchanged state has been written to every entry, all entries hold that state with no
+    // deltas, so further samples of it only need to advance the indices
+    const bool same_input = unchanged_samples != 0 && IsSameInput(input, last_input);
+    const bool uniform = same_input && unchanged_samples >= NUM_HISTORY_ENTRIES;
+    if (same_input) {
+        unchanged_samples++;
+    } else {
+        unchanged_samples = 1;
+        last_input.pad_state.hex = input.pad_state.hex;
+        last_input.touch_x = input.touch_x;
+        last_input.touch_y = input.touch_y;
+        last_input.touch_pressed = input.touch_pressed;
+    }
+
+    // The fields are written in the order of the shared memory layout
     mem->pad.index = next_pad_index;
-    next_touch_index = (next_touch_index + 1) % mem->pad.entries.size();
+    next_pad_index = (next_pad_index + 1) % mem->pad.entries.size();
 
-    // Get the previous Pad state
-    u32 last_entry_index = (mem->pad.index - 1) % mem->pad.entries.size();
-    PadState old_state = mem->pad.entries[last_entry_index].current_state;
+    // If we just updated index 0, provide a new timestamp
+    if (mem->pad.index == 0) {
+        mem->pad.index_reset_ticks_previous = mem->pad.index_reset_ticks;
+        mem->pad.index_reset_ticks = (s64)CoreTiming::GetTicks();
+    }
 
-    // Compute bitmask with 1s for bits different from the old state
-    PadState changed = { { (state.hex ^ old_state.hex) } };
+    if (!uniform) {
+        mem->pad.current_state.hex = state.hex;
 
-    // Get the current Pad entry
-    PadDataEntry* pad_entry = &mem->pad.entries[mem->pad.index];
+        // Get the previous Pad state
+        u32 last_entry_index = (mem->pad.index - 1) % mem->pad.entries.size();
+        PadState old_state = mem->pad.entries[last_entry_index].current_state;
 
-    // Update entry properties
-    pad_entry->current_state.hex = state.hex;
-    pad_entry->delta_additions.hex = changed.hex & state.hex;
-    pad_entry->delta_removals.hex = changed.hex & old_state.hex;;
+        // Compute bitmask with 1s for bits different from the old state
+        PadState changed = { { (state.hex ^ old_state.hex) } };
 
-    // Set circle Pad
-    pad_entry->circle_pad_x = state.circle_left  ? -MAX_CIRCLEPAD_POS :
-                              state.circle_right ?  MAX_CIRCLEPAD_POS : 0x0;
-    pad_entry->circle_pad_y = state.circle_down  ? -MAX_CIRCLEPAD_POS :
-                              state.circle_up    ?  MAX_CIRCLEPAD_POS : 0x0;
+        // Get the current Pad entry
+        PadDataEntry* pad_entry = &mem->pad.entries[mem->pad.index];
 
-    // If we just updated index 0, provide a new timestamp
-    if (mem->pad.index == 0) {
-        mem->pad.index_reset_ticks_previous = mem->pad.index_reset_ticks;
-        mem->pad.index_reset_ticks = (s64)CoreTiming::GetTicks();
+        // Update entry properties
+        pad_entry->current_state.hex = state.hex;
+        pad_entry->delta_additions.hex = changed.hex & state.hex;
+        pad_entry->delta_removals.hex = changed.hex & old_state.hex;
+
+        // Set circle Pad
+        pad_entry->circle_pad_x = state.circle_left  ? -MAX_CIRCLEPAD_POS :
+                                  state.circle_right ?  MAX_CIRCLEPAD_POS : 0x0;
+        pad_entry->circle_pad_y = state.circle_down  ? -MAX_CIRCLEPAD_POS :
+                                  state.circle_up    ?  MAX_CIRCLEPAD_POS : 0x0;
     }
 
     mem->touch.index = next_touch_index;
     next_touch_index = (next_touch_index + 1) % mem->touch.entries.size();
 
-    // Get the current touch entry
-    TouchDataEntry* touch_entry = &mem->touch.entries[mem->touch.index];
-    bool pressed = false;
-
-    std::tie(touch_entry->x, touch_entry->y, pressed) = VideoCore::g_emu_window->GetTouchState();
-    touch_entry->valid = pressed ? 1 : 0;
+    // If we just updated index 0, provide a new timestamp
+    if (mem->touch.index == 0) {
+        mem->touch.index_reset_ticks_previous = mem->touch.index_reset_ticks;
+        mem->touch.index_reset_ticks = (s64)CoreTiming::GetTicks();
+    }
 
     // TODO(bunnei): We're not doing anything with offset 0xA8 + 0x18 of HID SharedMemory, which
     // supposedly is "Touch-screen entry, which contains the raw coordinate data prior to being
     // converted to pixel coordinates." (http://3dbrew.org/wiki/HID_Shared_Memory#Offset_0xA8).
 
-    // If we just updated index 0, provide a new timestamp
-    if (mem->touch.index == 0) {
-        mem->touch.index_reset_ticks_previous = mem->touch.index_reset_ticks;
-        mem->touch.index_reset_ticks = (s64)CoreTiming::GetTicks();
+    if (!uniform) {
+        // Get the current touch entry
+        TouchDataEntry* touch_entry = &mem->touch.entries[mem->touch.index];
+        touch_entry->x = input.touch_x;
+        touch_entry->y = input.touch_y;
+        touch_entry->valid = input.touch_pressed ? 1 : 0;
     }
 
     // Signal both handles when there's an update to Pad or touch
@@ -123,6 +163,13 @@ void Update() {
     event_pad_or_touch_2->Signal();
 }
 
+static void UpdateCallback(u64 userdata, int cycles_late) {
+    Update();
+
+    // Reschedule recurrent event
+    CoreTiming::ScheduleEvent(update_interval - cycles_late, update_event_type);
+}
+
 void GetIPCHandles(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
@@ -200,6 +247,7 @@ void Init() {
 
     next_pad_index = 0;
     next_touch_index = 0;
+    unchanged_samples = 0;
 
     // Create event handles
     event_pad_or_touch_1 = Event::Create(RESETTYPE_ONESHOT, "HID:EventPadOrTouch1");
@@ -207,6 +255,12 @@ void Init() {
     event_accelerometer  = Event::Create(RESETTYPE_ONESHOT, "HID:EventAccelerometer");
     event_gyroscope      = Event::Create(RESETTYPE_ONESHOT, "HID:EventGyroscope");
     event_debug_pad      = Event::Create(RESETTYPE_ONESHOT, "HID:EventDebugPad");
+
+    // The input is sampled independently of the emulated screen refresh
+    int polling_rate = std::max(1, std::min(Settings::values.input_polling_rate, 1000));
+    update_interval = g_clock_rate_arm11 / polling_rate;
+    update_event_type = CoreTiming::RegisterEvent("HID::UpdateCallback", UpdateCallback);
+    CoreTiming::ScheduleEvent(update_interval, update_event_type);
 }
 
 void Shutdown() {
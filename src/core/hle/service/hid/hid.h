@@ -222,7 +222,7 @@ void DisableGyroscopeLow(Interface* self);
  */
 void GetSoundVolume(Interface* self);
 
-/// Checks for user input updates
+/// Samples the input state into the HID shared memory, which happens at the configured polling rate
 void Update();
 
 /// Initialize HID service
@@ -2,9 +2,19 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstring>
+#include <list>
+#include <vector>
+
+#include "common/hash.h"
 #include "common/logging/log.h"
 
+#include "core/core.h"
+#include "core/memory.h"
+#include "core/arm/arm_interface.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/vm_manager.h"
 #include "core/hle/service/ldr_ro.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -12,6 +22,272 @@
 
 namespace LDR_RO {
 
+/// Offset of the CRO header, which follows the hashes of the CRO
+static const u32 CRO_HEADER_OFFSET = 0x80;
+static const u32 CRO_HEADER_SIZE = 0x138;
+
+/// Indices of the u32 fields of the CRO header used to load it
+enum CROHeaderField : u32 {
+    Magic = 0,
+    NameOffset = 1,
+    /// First of the (offset, size) pairs, which span until InternalRelocationNum
+    CodeOffset = 12,
+    SegmentTableOffset = 18,
+    SegmentNum = 19,
+    InternalRelocationTableOffset = 42,
+    InternalRelocationNum = 43,
+    StaticRelocationTableOffset = 44,
+};
+
+enum class CROSegmentType : u32 {
+    Code = 0,
+    ROData = 1,
+    Data = 2,
+    BSS = 3,
+};
+
+struct CROSegment {
+    u32 offset;
+    u32 size;
+    CROSegmentType type;
+};
+static_assert(sizeof(CROSegment) == 12, "CROSegment has incorrect size");
+
+/// Relocation of a target in one segment against an address in another one of the same CRO
+struct CROInternalRelocation {
+    /// Bits 0-3: segment index, bits 4-31: offset into the segment
+    u32 target_position;
+    u8 type;
+    u8 symbol_segment;
+    u8 unknown[2];
+    u32 addend;
+};
+static_assert(sizeof(CROInternalRelocation) == 12, "CROInternalRelocation has incorrect size");
+
+enum RelocationType : u8 {
+    R_ARM_NONE = 0,
+    R_ARM_ABS32 = 2,
+    R_ARM_REL32 = 3,
+    R_ARM_CALL = 28,
+    R_ARM_JUMP24 = 29,
+    R_ARM_TARGET1 = 38,
+    R_ARM_PREL31 = 42,
+};
+
+/// A CRO after relocation, ready to be written to the addresses it was loaded at
+struct RelocatedCRO {
+    u64 image_hash;
+    VAddr cro_address;
+    VAddr data_address;
+    VAddr bss_address;
+
+    std::vector<u8> image;
+    std::vector<u8> data;
+    std::vector<u8> bss;
+    /// Code segments, as (address, size), which need to be invalidated in the instruction cache
+    std::vector<std::pair<VAddr, u32>> code_ranges;
+};
+
+/**
+ * Recently relocated CROs, most recently used first. Applications tend to reload the same modules
+ * at the same addresses on every scene transition, in which case the relocated images can just be
+ * copied back instead of processing the relocation tables again.
+ */
+static std::list<RelocatedCRO> relocated_cros;
+static const size_t MAX_RELOCATED_CROS = 8;
+
+static u32 ReadU32(const std::vector<u8>& buffer, u32 offset) {
+    u32 value;
+    std::memcpy(&value, &buffer[offset], sizeof(value));
+    return value;
+}
+
+static void WriteU32(std::vector<u8>& buffer, u32 offset, u32 value) {
+    std::memcpy(&buffer[offset], &value, sizeof(value));
+}
+
+static u32 GetHeaderField(const std::vector<u8>& image, CROHeaderField field) {
+    return ReadU32(image, CRO_HEADER_OFFSET + field * 4);
+}
+
+/// Checks that `count` entries of `entry_size` bytes at `offset` fit within `size` bytes
+static bool IsTableInBounds(u32 offset, u32 count, u32 entry_size, size_t size) {
+    return offset <= size && count <= (size - offset) / entry_size;
+}
+
+/// Host buffer holding the contents of a segment while it's being relocated
+struct SegmentView {
+    std::vector<u8>* buffer;
+    /// Offset of the segment in `buffer`
+    u32 buffer_offset;
+    /// Address the segment is loaded at
+    VAddr address;
+    u32 size;
+};
+
+/// Applies a relocation to the word at `target` in a host buffer, which is loaded at `target_address`
+static bool ApplyRelocation(std::vector<u8>& buffer, u32 target, VAddr target_address, u8 type, u32 symbol_address) {
+    switch (type) {
+    case R_ARM_NONE:
+        return true;
+
+    case R_ARM_ABS32:
+    case R_ARM_TARGET1:
+        WriteU32(buffer, target, symbol_address);
+        return true;
+
+    case R_ARM_REL32:
+        WriteU32(buffer, target, symbol_address - target_address);
+        return true;
+
+    case R_ARM_CALL:
+    case R_ARM_JUMP24: {
+        // The PC reads two instructions ahead of the branch
+        u32 offset = (symbol_address - target_address - 8) >> 2;
+        WriteU32(buffer, target, (ReadU32(buffer, target) & 0xFF000000) | (offset & 0x00FFFFFF));
+        return true;
+    }
+
+    case R_ARM_PREL31:
+        WriteU32(buffer, target, (ReadU32(buffer, target) & 0x80000000) | ((symbol_address - target_address) & 0x7FFFFFFF));
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * Rebases the header and the segment table of a CRO to the addresses it is loaded at, and applies
+ * its internal relocations. All work happens on host buffers, so that the result can be written
+ * to emulated memory in a few block copies.
+ * @note The symbol tables aren't rebased and imports aren't resolved, as linking CROs against
+ *       each other isn't implemented yet.
+ */
+static ResultCode RelocateCRO(RelocatedCRO& cro, u32 data_size, u32 bss_size) {
+    static const ResultCode ERR_INVALID_CRO(ErrorDescription::InvalidAddress, ErrorModule::LDR,
+            ErrorSummary::InvalidArgument, ErrorLevel::Permanent);
+
+    std::vector<u8>& image = cro.image;
+
+    const u32 segment_table = GetHeaderField(image, SegmentTableOffset);
+    const u32 num_segments = GetHeaderField(image, SegmentNum);
+    if (!IsTableInBounds(segment_table, num_segments, sizeof(CROSegment), image.size()) || num_segments > 16) {
+        LOG_ERROR(Service_LDR, "Segment table of CRO is out of bounds");
+        return ERR_INVALID_CRO;
+    }
+
+    std::vector<CROSegment> segments(num_segments);
+    std::memcpy(segments.data(), &image[segment_table], num_segments * sizeof(CROSegment));
+
+    cro.data.assign(data_size, 0);
+    cro.bss.assign(bss_size, 0);
+
+    std::vector<SegmentView> views(num_segments);
+    for (u32 i = 0; i < num_segments; ++i) {
+        CROSegment& segment = segments[i];
+        SegmentView& view = views[i];
+        view.size = segment.size;
+
+        switch (segment.type) {
+        case CROSegmentType::Data:
+            // The data segment is placed in a buffer supplied by the application
+            if (segment.size > data_size || !IsTableInBounds(segment.offset, segment.size, 1, image.size())) {
+                LOG_ERROR(Service_LDR, "Data segment of CRO doesn't fit its buffer");
+                return ERR_INVALID_CRO;
+            }
+            std::memcpy(cro.data.data(), &image[segment.offset], segment.size);
+            view.buffer = &cro.data;
+            view.buffer_offset = 0;
+            segment.offset = cro.data_address;
+            break;
+
+        case CROSegmentType::BSS:
+            if (segment.size > bss_size) {
+                LOG_ERROR(Service_LDR, "BSS segment of CRO doesn't fit its buffer");
+                return ERR_INVALID_CRO;
+            }
+            view.buffer = &cro.bss;
+            view.buffer_offset = 0;
+            segment.offset = cro.bss_address;
+            break;
+
+        default:
+            if (!IsTableInBounds(segment.offset, segment.size, 1, image.size())) {
+                LOG_ERROR(Service_LDR, "Segment %u of CRO is out of bounds", i);
+                return ERR_INVALID_CRO;
+            }
+            view.buffer = &image;
+            view.buffer_offset = segment.offset;
+            segment.offset += cro.cro_address;
+            if (segment.type == CROSegmentType::Code && segment.size != 0)
+                cro.code_ranges.emplace_back(segment.offset, segment.size);
+            break;
+        }
+        view.address = segment.offset;
+    }
+
+    // Relocations are applied against the rebased segments, in one pass over the table
+    const u32 relocation_table = GetHeaderField(image, InternalRelocationTableOffset);
+    const u32 num_relocations = GetHeaderField(image, InternalRelocationNum);
+    if (!IsTableInBounds(relocation_table, num_relocations, sizeof(CROInternalRelocation), image.size())) {
+        LOG_ERROR(Service_LDR, "Internal relocation table of CRO is out of bounds");
+        return ERR_INVALID_CRO;
+    }
+
+    std::vector<CROInternalRelocation> relocations(num_relocations);
+    std::memcpy(relocations.data(), &image[relocation_table], num_relocations * sizeof(CROInternalRelocation));
+
+    for (const CROInternalRelocation& relocation : relocations) {
+        const u32 target_segment = relocation.target_position & 0xF;
+        const u32 target_offset = relocation.target_position >> 4;
+        if (target_segment >= num_segments || relocation.symbol_segment >= num_segments) {
+            LOG_ERROR(Service_LDR, "Relocation references invalid segment");
+            return ERR_INVALID_CRO;
+        }
+
+        const SegmentView& target = views[target_segment];
+        if (target_offset > target.size || target.size - target_offset < sizeof(u32)) {
+            LOG_ERROR(Service_LDR, "Relocation target 0x%08X is out of bounds", relocation.target_position);
+            return ERR_INVALID_CRO;
+        }
+
+        const u32 symbol_address = segments[relocation.symbol_segment].offset + relocation.addend;
+        if (!ApplyRelocation(*target.buffer, target.buffer_offset + target_offset, target.address + target_offset,
+                             relocation.type, symbol_address)) {
+            LOG_ERROR(Service_LDR, "Unimplemented relocation type %u", relocation.type);
+        }
+    }
+
+    std::memcpy(&image[segment_table], segments.data(), num_segments * sizeof(CROSegment));
+
+    // Offsets in the header become addresses in the loaded module
+    const u32 name_offset = GetHeaderField(image, NameOffset);
+    WriteU32(image, CRO_HEADER_OFFSET + NameOffset * 4, name_offset + cro.cro_address);
+    for (u32 field = CodeOffset; field <= StaticRelocationTableOffset; field += 2) {
+        const u32 offset_position = CRO_HEADER_OFFSET + field * 4;
+        const u32 offset = ReadU32(image, offset_position);
+        if (offset != 0)
+            WriteU32(image, offset_position, offset + cro.cro_address);
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/// Returns the cached relocation of an image with the given buffers, moving it to the front
+static RelocatedCRO* FindRelocatedCRO(u64 image_hash, size_t image_size, VAddr cro_address,
+                                      VAddr data_address, u32 data_size, VAddr bss_address, u32 bss_size) {
+    for (auto it = relocated_cros.begin(); it != relocated_cros.end(); ++it) {
+        if (it->image_hash == image_hash && it->image.size() == image_size && it->cro_address == cro_address &&
+            it->data_address == data_address && it->data.size() == data_size &&
+            it->bss_address == bss_address && it->bss.size() == bss_size) {
+            relocated_cros.splice(relocated_cros.begin(), relocated_cros, it);
+            return &relocated_cros.front();
+        }
+    }
+    return nullptr;
+}
+
 /**
  * LDR_RO::Initialize service function
  *  Inputs:
@@ -74,11 +350,119 @@ static void LoadCRR(Service::Interface* self) {
                 crs_buffer_ptr, crs_size, value, process);
 }
 
+/**
+ * LDR_RO::LoadExeCRO service function
+ *  Inputs:
+ *      1 : CRO buffer pointer
+ *      2 : Address where the CRO will be mapped
+ *      3 : CRO size
+ *      4 : .data segment buffer pointer
+ *      5 : Value, must be zero
+ *      6 : .data segment buffer size
+ *      7 : .bss segment buffer pointer
+ *      8 : .bss segment buffer size
+ *      9 : Whether to automatically link imports
+ *     10 : Fix level
+ *     11 : CRR address
+ *     13 : KProcess handle
+ *  Outputs:
+ *      0 : Return header
+ *      1 : Result of function, 0 on success, otherwise error code
+ *      2 : Size of the loaded CRO
+ */
+static void LoadExeCRO(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+    VAddr cro_buffer_ptr = cmd_buff[1];
+    VAddr cro_address    = cmd_buff[2];
+    u32 cro_size         = cmd_buff[3];
+    VAddr data_address   = cmd_buff[4];
+    u32 data_size        = cmd_buff[6];
+    VAddr bss_address    = cmd_buff[7];
+    u32 bss_size         = cmd_buff[8];
+    bool auto_link       = cmd_buff[9] != 0;
+
+    cmd_buff[2] = 0;
+
+    if ((cro_buffer_ptr | cro_address | cro_size) & (Memory::PAGE_SIZE - 1) || cro_size < CRO_HEADER_OFFSET + CRO_HEADER_SIZE) {
+        LOG_ERROR(Service_LDR, "Misaligned CRO buffer 0x%08X (size 0x%08X) or address 0x%08X",
+                  cro_buffer_ptr, cro_size, cro_address);
+        cmd_buff[1] = ResultCode(ErrorDescription::MisalignedAddress, ErrorModule::LDR,
+                                 ErrorSummary::InvalidArgument, ErrorLevel::Permanent).raw;
+        return;
+    }
+
+    // The buffer is mapped at the requested address, just like the RO module remaps it on hardware
+    std::vector<Memory::HostSpan> spans;
+    if (!Memory::GetHostSpansForWrite(cro_buffer_ptr, cro_size, spans) || spans.size() != 1) {
+        LOG_ERROR(Service_LDR, "CRO buffer 0x%08X isn't backed by contiguous memory", cro_buffer_ptr);
+        cmd_buff[1] = ResultCode(ErrorDescription::InvalidAddress, ErrorModule::LDR,
+                                 ErrorSummary::InvalidArgument, ErrorLevel::Permanent).raw;
+        return;
+    }
+    u8* cro_memory = spans[0].pointer;
+
+    std::vector<u8> image(cro_memory, cro_memory + cro_size);
+    if (std::memcmp(&image[CRO_HEADER_OFFSET], "CRO0", 4) != 0) {
+        LOG_ERROR(Service_LDR, "Buffer 0x%08X doesn't contain a CRO", cro_buffer_ptr);
+        cmd_buff[1] = ResultCode(ErrorDescription::InvalidAddress, ErrorModule::LDR,
+                                 ErrorSummary::InvalidArgument, ErrorLevel::Permanent).raw;
+        return;
+    }
+
+    const u64 image_hash = Common::ComputeHash64(image.data(), image.size());
+    RelocatedCRO* cro = FindRelocatedCRO(image_hash, image.size(), cro_address, data_address, data_size,
+                                         bss_address, bss_size);
+    if (cro == nullptr) {
+        RelocatedCRO relocated;
+        relocated.image_hash = image_hash;
+        relocated.cro_address = cro_address;
+        relocated.data_address = data_address;
+        relocated.bss_address = bss_address;
+        relocated.image = std::move(image);
+
+        ResultCode result = RelocateCRO(relocated, data_size, bss_size);
+        if (result.IsError()) {
+            cmd_buff[1] = result.raw;
+            return;
+        }
+
+        relocated_cros.push_front(std::move(relocated));
+        if (relocated_cros.size() > MAX_RELOCATED_CROS)
+            relocated_cros.pop_back();
+        cro = &relocated_cros.front();
+    }
+
+    ResultVal<Kernel::VMManager::VMAHandle> mapping = Kernel::g_current_process->address_space->MapBackingMemory(
+            cro_address, cro_memory, cro_size, Kernel::MemoryState::Code);
+    if (mapping.Failed()) {
+        LOG_ERROR(Service_LDR, "Failed to map CRO at 0x%08X", cro_address);
+        cmd_buff[1] = mapping.Code().raw;
+        return;
+    }
+
+    std::memcpy(cro_memory, cro->image.data(), cro_size);
+    Memory::WriteBlock(data_address, cro->data.data(), cro->data.size());
+    Memory::WriteBlock(bss_address, cro->bss.data(), cro->bss.size());
+
+    // Only the relocated code is stale, the rest of the instruction cache stays valid
+    for (const auto& range : cro->code_ranges)
+        Core::g_app_core->InvalidateCacheRange(range.first, range.second);
+
+    if (auto_link)
+        LOG_WARNING(Service_LDR, "Linking imports of CROs is unimplemented");
+
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+    cmd_buff[2] = cro_size;
+
+    LOG_DEBUG(Service_LDR, "Loaded CRO from 0x%08X at 0x%08X (size 0x%08X), data=0x%08X, bss=0x%08X",
+              cro_buffer_ptr, cro_address, cro_size, data_address, bss_address);
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x000100C2, Initialize,            "Initialize"},
     {0x00020082, LoadCRR,               "LoadCRR"},
     {0x00030042, nullptr,               "UnloadCCR"},
-    {0x000402C2, nullptr,               "LoadExeCRO"},
+    {0x000402C2, LoadExeCRO,            "LoadExeCRO"},
     {0x000500C2, nullptr,               "LoadCROSymbols"},
     {0x00060042, nullptr,               "CRO_Load?"},
     {0x00070042, nullptr,               "LoadCROSymbols"},
@@ -2,7 +2,12 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <initializer_list>
+
+#include "common/assert.h"
 #include "common/logging/log.h"
+#include "common/profiler_reporting.h"
 #include "common/string_util.h"
 
 #include "core/hle/service/service.h"
@@ -59,37 +64,97 @@ static std::string MakeFunctionString(const char* name, const char* port_name, c
     return function_string;
 }
 
+Interface::FunctionEntry* Interface::FindFunction(u32 header) {
+    // Command headers are mostly dense in their upper half, so try the direct table first
+    const u32 index = header >> 16;
+    if (index < m_functions_by_index.size()) {
+        FunctionEntry* entry = m_functions_by_index[index];
+        if (entry != nullptr && entry->info.id == header)
+            return entry;
+    }
+
+    auto itr = m_functions.find(header);
+    return itr != m_functions.end() ? &itr->second : nullptr;
+}
+
 ResultVal<bool> Interface::SyncRequest() {
     u32* cmd_buff = Kernel::GetCommandBuffer();
-    auto itr = m_functions.find(cmd_buff[0]);
+    FunctionEntry* entry = FindFunction(cmd_buff[0]);
 
-    if (itr == m_functions.end() || itr->second.func == nullptr) {
-        std::string function_name = (itr == m_functions.end()) ? Common::StringFromFormat("0x%08X", cmd_buff[0]) : itr->second.name;
+    if (entry == nullptr || entry->info.func == nullptr) {
+        std::string function_name = (entry == nullptr) ? Common::StringFromFormat("0x%08X", cmd_buff[0]) : entry->info.name;
         LOG_ERROR(Service, "unknown / unimplemented %s", MakeFunctionString(function_name.c_str(), GetPortName().c_str(), cmd_buff).c_str());
 
         // TODO(bunnei): Hack - ignore error
         cmd_buff[1] = 0;
         return MakeResult<bool>(false);
     } else {
-        LOG_TRACE(Service, "%s", MakeFunctionString(itr->second.name, GetPortName().c_str(), cmd_buff).c_str());
+        LOG_TRACE(Service, "%s", MakeFunctionString(entry->info.name, GetPortName().c_str(), cmd_buff).c_str());
     }
 
-    itr->second.func(this);
+    auto start = Common::Profiling::Clock::now();
+    entry->info.func(this);
+    auto time = std::chrono::duration_cast<Common::Profiling::Duration>(Common::Profiling::Clock::now() - start);
+    entry->time += time;
+    ++entry->call_count;
+
+    auto& call_profiler = Common::Profiling::GetHLECallProfiler();
+    if (call_profiler.IsEnabled())
+        call_profiler.AddCall(GetPortName(), entry->info.name, entry->info.id, time);
 
     return MakeResult<bool>(false); // TODO: Implement return from actual function
 }
 
+std::vector<Interface::FunctionStatistics> Interface::GetFunctionStatistics() const {
+    std::vector<FunctionStatistics> statistics;
+    for (const auto& function : m_functions) {
+        const FunctionEntry& entry = function.second;
+        if (entry.call_count != 0)
+            statistics.push_back({ entry.info.id, entry.info.name, entry.call_count, entry.time });
+    }
+    return statistics;
+}
+
 void Interface::Register(const FunctionInfo* functions, size_t n) {
-    m_functions.reserve(n);
+    m_functions.reserve(m_functions.size() + n);
     for (size_t i = 0; i < n; ++i) {
         // Usually this array is sorted by id already, so hint to instead at the end
-        m_functions.emplace_hint(m_functions.cend(), functions[i].id, functions[i]);
+        FunctionEntry entry = { functions[i], 0, Common::Profiling::Duration::zero() };
+        m_functions.emplace_hint(m_functions.cend(), functions[i].id, entry);
+    }
+
+    // Inserting may have moved the entries, so the direct table is rebuilt from scratch. Where
+    // several headers share a command index, the first one is put in the table.
+    m_functions_by_index.clear();
+    for (auto& function : m_functions) {
+        const u32 index = function.first >> 16;
+        if (index > MAX_DIRECT_COMMAND_INDEX)
+            continue;
+
+        if (index >= m_functions_by_index.size())
+            m_functions_by_index.resize(index + 1, nullptr);
+        if (m_functions_by_index[index] == nullptr)
+            m_functions_by_index[index] = &function.second;
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Module interface
 
+/**
+ * Module whose Init() is deferred until the application first asks for one of its services, since
+ * many applications never use it. Its Init() must not register CoreTiming events, which save states
+ * expect in the same order in every session, and no other module may use its state.
+ */
+struct LazyModule {
+    std::vector<std::string> port_names; ///< Services the module's Init() adds
+    void (*init)();
+    void (*shutdown)();
+    bool initialized;
+};
+
+static std::vector<LazyModule> lazy_modules;
+
 static void AddNamedPort(Interface* interface_) {
     g_kernel_named_ports.emplace(interface_->GetPortName(), interface_);
 }
@@ -98,24 +163,53 @@ void AddService(Interface* interface_) {
     g_srv_services.emplace(interface_->GetPortName(), interface_);
 }
 
+static void AddLazyModule(std::initializer_list<const char*> port_names, void (*init)(), void (*shutdown)()) {
+    lazy_modules.push_back({ std::vector<std::string>(port_names.begin(), port_names.end()), init, shutdown, false });
+}
+
+Kernel::SharedPtr<Interface> GetService(const std::string& port_name) {
+    auto it = g_srv_services.find(port_name);
+    if (it != g_srv_services.end())
+        return it->second;
+
+    for (LazyModule& module : lazy_modules) {
+        if (module.initialized ||
+            std::find(module.port_names.begin(), module.port_names.end(), port_name) == module.port_names.end())
+            continue;
+
+        LOG_DEBUG(Service, "initializing the module of %s", port_name.c_str());
+        module.init();
+        module.initialized = true;
+        for (const std::string& name : module.port_names)
+            DEBUG_ASSERT_MSG(g_srv_services.count(name) != 0, "%s wasn't added by its module", name.c_str());
+
+        it = g_srv_services.find(port_name);
+        return it != g_srv_services.end() ? it->second : nullptr;
+    }
+    return nullptr;
+}
+
 /// Initialize ServiceManager
 void Init() {
     AddNamedPort(new SRV::Interface);
     AddNamedPort(new ERR_F::Interface);
 
+    // Modules registering CoreTiming events or used by other modules are initialized right away.
+    // Every application uses APT, whose applets also register an event.
     Service::FS::ArchiveInit();
-    Service::AM::Init();
     Service::APT::Init();
-    Service::BOSS::Init();
-    Service::CAM::Init();
-    Service::CECD::Init();
-    Service::CFG::Init();
-    Service::FRD::Init();
     Service::HID::Init();
-    Service::IR::Init();
-    Service::NEWS::Init();
-    Service::NIM::Init();
-    Service::PTM::Init();
+
+    AddLazyModule({ "am:app", "am:net", "am:sys" }, Service::AM::Init, Service::AM::Shutdown);
+    AddLazyModule({ "boss:P", "boss:U" }, Service::BOSS::Init, Service::BOSS::Shutdown);
+    AddLazyModule({ "cam:c", "cam:q", "cam:s", "cam:u" }, Service::CAM::Init, Service::CAM::Shutdown);
+    AddLazyModule({ "cecd:s", "cecd:u" }, Service::CECD::Init, Service::CECD::Shutdown);
+    AddLazyModule({ "cfg:i", "cfg:s", "cfg:u" }, Service::CFG::Init, Service::CFG::Shutdown);
+    AddLazyModule({ "frd:a", "frd:u" }, Service::FRD::Init, Service::FRD::Shutdown);
+    AddLazyModule({ "ir:rst", "ir:u", "ir:USER" }, Service::IR::Init, Service::IR::Shutdown);
+    AddLazyModule({ "news:s", "news:u" }, Service::NEWS::Init, Service::NEWS::Shutdown);
+    AddLazyModule({ "nim:aoc", "nim:s", "nim:u" }, Service::NIM::Init, Service::NIM::Shutdown);
+    AddLazyModule({ "ptm:play", "ptm:sysm", "ptm:u" }, Service::PTM::Init, Service::PTM::Shutdown);
 
     AddService(new AC_U::Interface);
     AddService(new ACT_U::Interface);
@@ -139,19 +233,14 @@ void Init() {
 
 /// Shutdown ServiceManager
 void Shutdown() {
+    for (auto module = lazy_modules.rbegin(); module != lazy_modules.rend(); ++module) {
+        if (module->initialized)
+            module->shutdown();
+    }
+    lazy_modules.clear();
 
-    Service::PTM::Shutdown();
-    Service::NIM::Shutdown();
-    Service::NEWS::Shutdown();
-    Service::IR::Shutdown();
     Service::HID::Shutdown();
-    Service::FRD::Shutdown();
-    Service::CFG::Shutdown();
-    Service::CECD::Shutdown();
-    Service::CAM::Shutdown();
-    Service::BOSS::Shutdown();
     Service::APT::Shutdown();
-    Service::AM::Shutdown();
     Service::FS::ArchiveShutdown();
 
     g_srv_services.clear();
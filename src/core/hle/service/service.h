@@ -7,10 +7,12 @@
 #include <cstddef>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/container/flat_map.hpp>
 
 #include "common/common_types.h"
+#include "common/profiler.h"
 
 #include "core/hle/kernel/session.h"
 #include "core/hle/result.h"
@@ -48,6 +50,17 @@ public:
 
     ResultVal<bool> SyncRequest() override;
 
+    /// Usage counters of a registered function
+    struct FunctionStatistics {
+        u32         id;
+        const char* name;
+        u64         call_count;             ///< Number of times the function was called
+        Common::Profiling::Duration time;   ///< Host time spent in the function, summed over all calls
+    };
+
+    /// Returns the statistics of all registered functions which have been called at least once.
+    std::vector<FunctionStatistics> GetFunctionStatistics() const;
+
 protected:
 
     /**
@@ -61,8 +74,25 @@ protected:
     void Register(const FunctionInfo* functions, size_t n);
 
 private:
-    boost::container::flat_map<u32, FunctionInfo> m_functions;
+    struct FunctionEntry {
+        FunctionInfo info;
+        u64 call_count;
+        Common::Profiling::Duration time;
+    };
 
+    /// Command indices (bits 16-31 of the header) up to this value are looked up directly
+    static const u32 MAX_DIRECT_COMMAND_INDEX = 0x400;
+
+    /// Finds the entry of the function with the given command header, or returns nullptr.
+    FunctionEntry* FindFunction(u32 header);
+
+    boost::container::flat_map<u32, FunctionEntry> m_functions;
+
+    /**
+     * Entries of m_functions indexed by command index. Headers sharing an index with another one,
+     * or with an index above MAX_DIRECT_COMMAND_INDEX, are only found through the map.
+     */
+    std::vector<FunctionEntry*> m_functions_by_index;
 };
 
 /// Initialize ServiceManager
@@ -79,4 +109,11 @@ extern std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_srv_servi
 /// Adds a service to the services table
 void AddService(Interface* interface_);
 
+/**
+ * Looks up a service registered with "srv:", initializing the module which provides it if it's
+ * the first time the service is asked for.
+ * @return The service, or nullptr if no module provides it
+ */
+Kernel::SharedPtr<Interface> GetService(const std::string& port_name);
+
 } // namespace
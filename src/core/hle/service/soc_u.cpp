@@ -3,16 +3,25 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "common/assert.h"
 #include "common/bit_field.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 #include "common/scope_exit.h"
+#include "common/thread.h"
 
+#include "core/core_timing.h"
+#include "core/hle/hle.h"
 #include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
 #include "core/hle/result.h"
 #include "core/hle/service/soc_u.h"
 #include "core/memory.h"
@@ -153,7 +162,7 @@ static int TranslateError(int error) {
 /// Holds information about a particular socket
 struct SocketHolder {
     u32 socket_fd; ///< The socket descriptor
-    bool blocking; ///< Whether the socket is blocking or not, it is only read on Windows.
+    bool blocking; ///< Whether the guest expects the socket to block, the host socket never does
 };
 
 /// Structure to represent the 3ds' pollfd structure, which is different than most implementations
@@ -297,11 +306,314 @@ union CTRSockAddr {
 /// Holds info about the currently open sockets
 static std::unordered_map<u32, SocketHolder> open_sockets;
 
+// The host sockets are always nonblocking, so the emulation thread never blocks in a socket call.
+// When an operation on a socket which the guest considers blocking (or a Poll with a timeout) has
+// to wait, the calling thread is put to sleep and the awaited events are handed to the reactor
+// thread, which polls all of them at once. Once they occur, it schedules a threadsafe event which
+// retries the operation on the emulation thread, fills in the reply and wakes the thread up.
+
+/// How an operation is being attempted
+enum class Attempt {
+    First,    ///< From the service call
+    Ready,    ///< After the reactor saw one of the awaited events, which may be spurious
+    TimedOut, ///< After the wait ended without an event, the operation has to complete now
+};
+
+/**
+ * Performs a socket operation described by a command buffer, without blocking the host.
+ * @return False if the operation has to wait for its sockets, the reply isn't written in that case
+ */
+using SocketOp = bool (*)(u32* cmd_buffer, Attempt attempt);
+
+/// Events awaited by a sleeping thread
+struct SocketWait {
+    u64 id;
+    std::vector<pollfd> fds;
+    bool has_deadline;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+struct PendingSocketOp {
+    Kernel::SharedPtr<Kernel::Thread> thread;
+    SocketOp op;
+    /// Socket the operation is performed on, or SOCKET_ERROR_VALUE for Poll
+    u32 socket_handle;
+    SocketWait wait;
+};
+
+/// Operations of sleeping threads, keyed by the id of their wait. Only used on the emulation thread.
+static std::unordered_map<u64, PendingSocketOp> pending_ops;
+static u64 next_wait_id = 0;
+static int socket_ready_event_type = -1;
+
+static std::thread reactor_thread;
+static std::mutex reactor_mutex;
+/// Waits polled by the reactor, protected by reactor_mutex
+static std::vector<SocketWait> reactor_waits;
+static bool reactor_running = false;
+/// Loopback socket connected to itself, written to in order to interrupt the reactor's poll
+static u32 wakeup_socket = static_cast<u32>(SOCKET_ERROR_VALUE);
+
+/// Returns whether a nonblocking call failed with the given error because it would have blocked
+static bool WouldBlock(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+/// Returns whether a nonblocking connect failed with the given error because it's in progress
+static bool ConnectInProgress(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EINPROGRESS;
+#endif
+}
+
+/// Returns whether an operation which failed with the given error has to wait for the socket
+static bool ShouldWait(u32 socket_handle, int error, Attempt attempt) {
+    if (attempt == Attempt::TimedOut || !WouldBlock(error))
+        return false;
+
+    auto iter = open_sockets.find(socket_handle);
+    return iter != open_sockets.end() && iter->second.blocking;
+}
+
+static void SetHostNonBlocking(u32 socket_fd) {
+#ifdef _WIN32
+    unsigned long nonblocking = 1;
+    ioctlsocket(socket_fd, FIONBIO, &nonblocking);
+#else
+    int flags = ::fcntl(socket_fd, F_GETFL, 0);
+    if (flags != SOCKET_ERROR_VALUE)
+        ::fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static u32 CreateWakeupSocket() {
+    u32 socket_fd = static_cast<u32>(::socket(AF_INET, SOCK_DGRAM, 0));
+    if ((s32)socket_fd == SOCKET_ERROR_VALUE)
+        return socket_fd;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+
+    if (::bind(socket_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::getsockname(socket_fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0 ||
+        ::connect(socket_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        closesocket(socket_fd);
+        return static_cast<u32>(SOCKET_ERROR_VALUE);
+    }
+
+    SetHostNonBlocking(socket_fd);
+    return socket_fd;
+}
+
+static void SignalReactor() {
+    char byte = 0;
+    ::send(wakeup_socket, &byte, 1, 0);
+}
+
+static void ReactorLoop() {
+    Common::SetCurrentThreadName("SocketReactor");
+
+    // Kept around so polling doesn't allocate once they are large enough
+    std::vector<pollfd> poll_fds;
+    std::vector<std::pair<u64, size_t>> wait_sizes;
+
+    std::unique_lock<std::mutex> lock(reactor_mutex);
+    while (reactor_running) {
+        poll_fds.clear();
+        wait_sizes.clear();
+
+        pollfd wakeup = {};
+        wakeup.fd = wakeup_socket;
+        wakeup.events = POLLIN;
+        poll_fds.push_back(wakeup);
+
+        auto now = std::chrono::steady_clock::now();
+        int timeout = -1;
+        for (const SocketWait& wait : reactor_waits) {
+            poll_fds.insert(poll_fds.end(), wait.fds.begin(), wait.fds.end());
+            wait_sizes.emplace_back(wait.id, wait.fds.size());
+
+            if (wait.has_deadline) {
+                // Rounded up, so the deadline has passed when poll returns
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        wait.deadline - now + std::chrono::microseconds(999)).count();
+                int wait_timeout = static_cast<int>(std::max<decltype(remaining)>(remaining, 0));
+                if (timeout < 0 || wait_timeout < timeout)
+                    timeout = wait_timeout;
+            }
+        }
+
+        lock.unlock();
+        ::poll(poll_fds.data(), static_cast<unsigned>(poll_fds.size()), timeout);
+        lock.lock();
+
+        if (poll_fds[0].revents != 0) {
+            char buffer[64];
+            while (::recv(wakeup_socket, buffer, sizeof(buffer), 0) > 0) {}
+        }
+
+        now = std::chrono::steady_clock::now();
+        auto fd = poll_fds.begin() + 1;
+        for (const auto& wait_size : wait_sizes) {
+            bool ready = std::any_of(fd, fd + wait_size.second, [](const pollfd& poll_fd) { return poll_fd.revents != 0; });
+            fd += wait_size.second;
+
+            // The wait may have been cancelled while polling
+            auto wait = std::find_if(reactor_waits.begin(), reactor_waits.end(),
+                                     [&](const SocketWait& wait) { return wait.id == wait_size.first; });
+            if (wait == reactor_waits.end())
+                continue;
+
+            bool timed_out = !ready && wait->has_deadline && now >= wait->deadline;
+            if (!ready && !timed_out)
+                continue;
+
+            reactor_waits.erase(wait);
+            CoreTiming::ScheduleEvent_Threadsafe(0, socket_ready_event_type, (wait_size.first << 1) | (timed_out ? 1 : 0));
+        }
+    }
+}
+
+/// Starts the reactor thread if it isn't running yet
+static bool StartReactor() {
+    if (reactor_thread.joinable())
+        return true;
+
+    wakeup_socket = CreateWakeupSocket();
+    if ((s32)wakeup_socket == SOCKET_ERROR_VALUE) {
+        LOG_ERROR(Service_SOC, "Failed to create the wakeup socket of the reactor, blocking calls will block the emulation");
+        return false;
+    }
+
+    reactor_running = true;
+    reactor_thread = std::thread(ReactorLoop);
+    return true;
+}
+
+static void StopReactor() {
+    if (!reactor_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(reactor_mutex);
+        reactor_running = false;
+        reactor_waits.clear();
+    }
+    SignalReactor();
+    reactor_thread.join();
+
+    closesocket(wakeup_socket);
+    wakeup_socket = static_cast<u32>(SOCKET_ERROR_VALUE);
+}
+
+static void AddReactorWait(const SocketWait& wait) {
+    {
+        std::lock_guard<std::mutex> lock(reactor_mutex);
+        reactor_waits.push_back(wait);
+    }
+    SignalReactor();
+}
+
+/// Retries the operation of a sleeping thread, and wakes the thread up if it completes
+static void CompleteSocketOp(u64 id, Attempt attempt) {
+    auto itr = pending_ops.find(id);
+    if (itr == pending_ops.end())
+        return;
+    PendingSocketOp& pending = itr->second;
+
+    // The thread may have been stopped in the meantime
+    Kernel::Thread* thread = pending.thread.get();
+    if (thread->status != THREADSTATUS_WAIT_SLEEP) {
+        pending_ops.erase(itr);
+        return;
+    }
+
+    u32* cmd_buffer = (u32*)Memory::GetPointer(thread->GetTLSAddress() + Kernel::kCommandHeaderOffset);
+    if (!pending.op(cmd_buffer, attempt)) {
+        // Another thread was faster, or the event was spurious
+        AddReactorWait(pending.wait);
+        return;
+    }
+
+    pending_ops.erase(itr);
+    thread->ResumeFromWait();
+    HLE::Reschedule(__func__);
+}
+
+static void SocketReadyCallback(u64 userdata, int cycles_late) {
+    CompleteSocketOp(userdata >> 1, (userdata & 1) ? Attempt::TimedOut : Attempt::Ready);
+}
+
+/// Completes the given operations right away, e.g. because their sockets were closed
+static void CompleteSocketOps(const std::vector<u64>& ids) {
+    {
+        std::lock_guard<std::mutex> lock(reactor_mutex);
+        reactor_waits.erase(std::remove_if(reactor_waits.begin(), reactor_waits.end(), [&](const SocketWait& wait) {
+            return std::find(ids.begin(), ids.end(), wait.id) != ids.end();
+        }), reactor_waits.end());
+    }
+
+    for (u64 id : ids)
+        CompleteSocketOp(id, Attempt::TimedOut);
+}
+
+/**
+ * Puts the current thread to sleep until one of the given events occurs, then retries the
+ * operation it couldn't complete. The wait ends after timeout milliseconds unless it's negative.
+ */
+static void SleepUntilReady(SocketOp op, u32 socket_handle, std::vector<pollfd> fds, int timeout) {
+    PendingSocketOp pending;
+    pending.thread = Kernel::GetCurrentThread();
+    pending.op = op;
+    pending.socket_handle = socket_handle;
+    pending.wait.id = next_wait_id++;
+    pending.wait.fds = std::move(fds);
+    pending.wait.has_deadline = timeout >= 0;
+    if (pending.wait.has_deadline)
+        pending.wait.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    if (!StartReactor()) {
+        ::poll(pending.wait.fds.data(), static_cast<unsigned>(pending.wait.fds.size()), timeout);
+        op(Kernel::GetCommandBuffer(), Attempt::TimedOut);
+        return;
+    }
+
+    AddReactorWait(pending.wait);
+    pending_ops.emplace(pending.wait.id, std::move(pending));
+
+    Kernel::WaitCurrentThread_Sleep();
+}
+
+/// Performs an operation on the socket in cmd_buffer[1], waiting for the given events if it blocks
+static void PerformSocketOp(SocketOp op, short events) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    u32 socket_handle = cmd_buffer[1];
+
+    if (op(cmd_buffer, Attempt::First))
+        return;
+
+    pollfd fd = {};
+    fd.fd = socket_handle;
+    fd.events = events;
+    SleepUntilReady(op, socket_handle, { fd }, -1);
+}
+
 /// Close all open sockets
 static void CleanupSockets() {
+    StopReactor();
     for (auto sock : open_sockets)
         closesocket(sock.second.socket_fd);
     open_sockets.clear();
+    pending_ops.clear();
 }
 
 static void Socket(Service::Interface* self) {
@@ -328,13 +640,15 @@ static void Socket(Service::Interface* self) {
 
     u32 socket_handle = static_cast<u32>(::socket(domain, type, protocol));
 
-    if ((s32)socket_handle != SOCKET_ERROR_VALUE)
-        open_sockets[socket_handle] = { socket_handle, true };
-
     int result = 0;
     if ((s32)socket_handle == SOCKET_ERROR_VALUE)
         result = TranslateError(GET_ERRNO);
 
+    if ((s32)socket_handle != SOCKET_ERROR_VALUE) {
+        SetHostNonBlocking(socket_handle);
+        open_sockets[socket_handle] = { socket_handle, true };
+    }
+
     cmd_buffer[0] = IPC::MakeHeader(2, 2, 0);
     cmd_buffer[1] = result;
     cmd_buffer[2] = socket_handle;
@@ -377,54 +691,20 @@ static void Fcntl(Service::Interface* self) {
             cmd_buffer[2] = posix_ret;
     });
 
+    // The host socket is always nonblocking, only the mode expected by the guest is tracked
+    auto iter = open_sockets.find(socket_handle);
+    if (iter == open_sockets.end()) {
+        result = TranslateError(ERRNO(EBADF));
+        posix_ret = -1;
+        return;
+    }
+
     if (ctr_cmd == 3) { // F_GETFL
-#ifdef _WIN32
-        posix_ret = 0;
-        auto iter = open_sockets.find(socket_handle);
-        if (iter != open_sockets.end() && iter->second.blocking == false)
-            posix_ret |= 4; // O_NONBLOCK
-#else
-        int ret = ::fcntl(socket_handle, F_GETFL, 0);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
         posix_ret = 0;
-        if (ret & O_NONBLOCK)
+        if (!iter->second.blocking)
             posix_ret |= 4; // O_NONBLOCK
-#endif
     } else if (ctr_cmd == 4) { // F_SETFL
-#ifdef _WIN32
-        unsigned long tmp = (ctr_arg & 4 /* O_NONBLOCK */) ? 1 : 0;
-        int ret = ioctlsocket(socket_handle, FIONBIO, &tmp);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-        auto iter = open_sockets.find(socket_handle);
-        if (iter != open_sockets.end())
-            iter->second.blocking = (tmp == 0);
-#else
-        int flags = ::fcntl(socket_handle, F_GETFL, 0);
-        if (flags == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-
-        flags &= ~O_NONBLOCK;
-        if (ctr_arg & 4) // O_NONBLOCK
-            flags |= O_NONBLOCK;
-
-        int ret = ::fcntl(socket_handle, F_SETFL, flags);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-#endif
+        iter->second.blocking = (ctr_arg & 4 /* O_NONBLOCK */) == 0;
     } else {
         LOG_ERROR(Service_SOC, "Unsupported command (%d) in fcntl call", ctr_cmd);
         result = TranslateError(EINVAL); // TODO: Find the correct error
@@ -448,24 +728,23 @@ static void Listen(Service::Interface* self) {
     cmd_buffer[2] = ret;
 }
 
-static void Accept(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static bool AcceptImpl(u32* cmd_buffer, Attempt attempt) {
     u32 socket_handle = cmd_buffer[1];
     socklen_t max_addr_len = static_cast<socklen_t>(cmd_buffer[2]);
     sockaddr addr;
     socklen_t addr_len = sizeof(addr);
     u32 ret = static_cast<u32>(::accept(socket_handle, &addr, &addr_len));
 
-    if ((s32)ret != SOCKET_ERROR_VALUE)
-        open_sockets[ret] = { ret, true };
-
     int result = 0;
     if ((s32)ret == SOCKET_ERROR_VALUE) {
-        result = TranslateError(GET_ERRNO);
+        int error = GET_ERRNO;
+        if (ShouldWait(socket_handle, error, attempt))
+            return false;
+        result = TranslateError(error);
     } else {
+        SetHostNonBlocking(ret);
+        open_sockets[ret] = { ret, true };
+
         CTRSockAddr ctr_addr = CTRSockAddr::FromPlatform(addr);
         Memory::WriteBlock(cmd_buffer[0x104 >> 2], (const u8*)&ctr_addr, max_addr_len);
     }
@@ -474,6 +753,11 @@ static void Accept(Service::Interface* self) {
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
     cmd_buffer[3] = IPC::StaticBufferDesc(static_cast<u32>(max_addr_len), 0);
+    return true;
+}
+
+static void Accept(Service::Interface* self) {
+    PerformSocketOp(AcceptImpl, POLLIN);
 }
 
 static void GetHostId(Service::Interface* self) {
@@ -509,73 +793,101 @@ static void Close(Service::Interface* self) {
 
     cmd_buffer[2] = ret;
     cmd_buffer[1] = result;
+
+    // Threads blocked on the socket fail now that it's gone
+    std::vector<u64> ids;
+    for (const auto& pending : pending_ops) {
+        if (pending.second.socket_handle == socket_handle)
+            ids.push_back(pending.first);
+    }
+    if (!ids.empty())
+        CompleteSocketOps(ids);
 }
 
-static void SendTo(Service::Interface* self) {
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static bool SendToImpl(u32* cmd_buffer, Attempt attempt) {
     u32 socket_handle = cmd_buffer[1];
     u32 len = cmd_buffer[2];
     u32 flags = cmd_buffer[3];
     u32 addr_len = cmd_buffer[4];
 
-    u8* input_buff = Memory::GetPointer(cmd_buffer[8]);
-    CTRSockAddr* ctr_dest_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[10]));
-
-    if (ctr_dest_addr == nullptr) {
+    if (Memory::GetPointer(cmd_buffer[10]) == nullptr) {
         cmd_buffer[1] = -1; // TODO(Subv): Find the right error code
-        return;
+        return true;
     }
 
+    std::vector<u8> input_buff(len);
+    Memory::ReadBlock(cmd_buffer[8], input_buff.data(), len);
+
     int ret = -1;
     if (addr_len > 0) {
-        sockaddr dest_addr = CTRSockAddr::ToPlatform(*ctr_dest_addr);
-        ret = ::sendto(socket_handle, (const char*)input_buff, len, flags, &dest_addr, sizeof(dest_addr));
+        CTRSockAddr ctr_dest_addr;
+        Memory::ReadBlock(cmd_buffer[10], &ctr_dest_addr, sizeof(ctr_dest_addr));
+        sockaddr dest_addr = CTRSockAddr::ToPlatform(ctr_dest_addr);
+        ret = ::sendto(socket_handle, (const char*)input_buff.data(), len, flags, &dest_addr, sizeof(dest_addr));
     } else {
-        ret = ::sendto(socket_handle, (const char*)input_buff, len, flags, nullptr, 0);
+        ret = ::sendto(socket_handle, (const char*)input_buff.data(), len, flags, nullptr, 0);
     }
 
     int result = 0;
-    if (ret == SOCKET_ERROR_VALUE)
-        result = TranslateError(GET_ERRNO);
+    if (ret == SOCKET_ERROR_VALUE) {
+        int error = GET_ERRNO;
+        if (ShouldWait(socket_handle, error, attempt))
+            return false;
+        result = TranslateError(error);
+    }
 
     cmd_buffer[2] = ret;
     cmd_buffer[1] = result;
+    return true;
 }
 
-static void RecvFrom(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static void SendTo(Service::Interface* self) {
+    PerformSocketOp(SendToImpl, POLLOUT);
+}
+
+static bool RecvFromImpl(u32* cmd_buffer, Attempt attempt) {
     u32 socket_handle = cmd_buffer[1];
     u32 len = cmd_buffer[2];
     u32 flags = cmd_buffer[3];
     socklen_t addr_len = static_cast<socklen_t>(cmd_buffer[4]);
 
-    u8* output_buff = Memory::GetPointer(cmd_buffer[0x104 >> 2]);
+    std::vector<u8> output_buff(len);
     sockaddr src_addr;
     socklen_t src_addr_len = sizeof(src_addr);
-    int ret = ::recvfrom(socket_handle, (char*)output_buff, len, flags, &src_addr, &src_addr_len);
-
-    if (cmd_buffer[0x1A0 >> 2] != 0) {
-        CTRSockAddr* ctr_src_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[0x1A0 >> 2]));
-        *ctr_src_addr = CTRSockAddr::FromPlatform(src_addr);
-    }
+    int ret = ::recvfrom(socket_handle, (char*)output_buff.data(), len, flags, &src_addr, &src_addr_len);
 
     int result = 0;
     int total_received = ret;
     if (ret == SOCKET_ERROR_VALUE) {
-        result = TranslateError(GET_ERRNO);
+        int error = GET_ERRNO;
+        if (ShouldWait(socket_handle, error, attempt))
+            return false;
+        result = TranslateError(error);
         total_received = 0;
     }
 
+    if (ret > 0)
+        Memory::WriteBlock(cmd_buffer[0x104 >> 2], output_buff.data(), ret);
+
+    if (cmd_buffer[0x1A0 >> 2] != 0) {
+        CTRSockAddr ctr_src_addr = CTRSockAddr::FromPlatform(src_addr);
+        Memory::WriteBlock(cmd_buffer[0x1A0 >> 2], &ctr_src_addr, sizeof(ctr_src_addr));
+    }
+
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
     cmd_buffer[3] = total_received;
+    return true;
 }
 
-static void Poll(Service::Interface* self) {
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static void RecvFrom(Service::Interface* self) {
+    PerformSocketOp(RecvFromImpl, POLLIN);
+}
+
+/// Platform pollfds of the current Poll call, kept around so polling doesn't allocate
+static std::vector<pollfd> platform_pollfds;
+
+static bool PollImpl(u32* cmd_buffer, Attempt attempt) {
     u32 nfds = cmd_buffer[1];
     int timeout = cmd_buffer[2];
     CTRPollFD* input_fds = reinterpret_cast<CTRPollFD*>(Memory::GetPointer(cmd_buffer[6]));
@@ -583,17 +895,18 @@ static void Poll(Service::Interface* self) {
 
     // The 3ds_pollfd and the pollfd structures may be different (Windows/Linux have different sizes)
     // so we have to copy the data
-    pollfd* platform_pollfd = new pollfd[nfds];
+    platform_pollfds.resize(nfds);
     for (unsigned current_fds = 0; current_fds < nfds; ++current_fds)
-        platform_pollfd[current_fds] = CTRPollFD::ToPlatform(input_fds[current_fds]);
+        platform_pollfds[current_fds] = CTRPollFD::ToPlatform(input_fds[current_fds]);
 
-    int ret = ::poll(platform_pollfd, nfds, timeout);
+    // Waiting for the timeout is up to the reactor
+    int ret = ::poll(platform_pollfds.data(), nfds, 0);
+    if (ret == 0 && timeout != 0 && attempt != Attempt::TimedOut)
+        return false;
 
     // Now update the output pollfd structure
     for (unsigned current_fds = 0; current_fds < nfds; ++current_fds)
-        output_fds[current_fds] = CTRPollFD::FromPlatform(platform_pollfd[current_fds]);
-
-    delete[] platform_pollfd;
+        output_fds[current_fds] = CTRPollFD::FromPlatform(platform_pollfds[current_fds]);
 
     int result = 0;
     if (ret == SOCKET_ERROR_VALUE)
@@ -601,6 +914,18 @@ static void Poll(Service::Interface* self) {
 
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
+    return true;
+}
+
+static void Poll(Service::Interface* self) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    int timeout = cmd_buffer[2];
+
+    if (PollImpl(cmd_buffer, Attempt::First))
+        return;
+
+    // platform_pollfds still holds the descriptors of this call
+    SleepUntilReady(PollImpl, static_cast<u32>(SOCKET_ERROR_VALUE), platform_pollfds, timeout);
 }
 
 static void GetSockName(Service::Interface* self) {
@@ -668,29 +993,52 @@ static void GetPeerName(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
-static void Connect(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static bool ConnectImpl(u32* cmd_buffer, Attempt attempt) {
     u32 socket_handle = cmd_buffer[1];
-    socklen_t len = cmd_buffer[2];
 
-    CTRSockAddr* ctr_input_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[6]));
-    if (ctr_input_addr == nullptr) {
-        cmd_buffer[1] = -1; // TODO(Subv): Verify error
-        return;
+    int ret = 0;
+    int error = 0;
+    if (attempt == Attempt::First) {
+        CTRSockAddr* ctr_input_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[6]));
+        if (ctr_input_addr == nullptr) {
+            cmd_buffer[1] = -1; // TODO(Subv): Verify error
+            return true;
+        }
+
+        sockaddr input_addr = CTRSockAddr::ToPlatform(*ctr_input_addr);
+        ret = ::connect(socket_handle, &input_addr, sizeof(input_addr));
+        if (ret != 0) {
+            error = GET_ERRNO;
+            // The connection is established in the background, blocking sockets wait for it
+            auto iter = open_sockets.find(socket_handle);
+            if (ConnectInProgress(error) && iter != open_sockets.end() && iter->second.blocking)
+                return false;
+        }
+    } else {
+        // The socket became writable (or was closed), fetch the outcome of the connection attempt
+        int socket_error = 0;
+        socklen_t socket_error_len = sizeof(socket_error);
+        ret = ::getsockopt(socket_handle, SOL_SOCKET, SO_ERROR, (char*)&socket_error, &socket_error_len);
+        if (ret != 0) {
+            error = GET_ERRNO;
+        } else if (socket_error != 0) {
+            ret = SOCKET_ERROR_VALUE;
+            error = socket_error;
+        }
     }
 
-    sockaddr input_addr = CTRSockAddr::ToPlatform(*ctr_input_addr);
-    int ret = ::connect(socket_handle, &input_addr, sizeof(input_addr));
     int result = 0;
     if (ret != 0)
-        result = TranslateError(GET_ERRNO);
+        result = TranslateError(error);
 
     cmd_buffer[0] = IPC::MakeHeader(6, 2, 0);
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
+    return true;
+}
+
+static void Connect(Service::Interface* self) {
+    PerformSocketOp(ConnectImpl, POLLOUT);
 }
 
 static void InitializeSockets(Service::Interface* self) {
@@ -707,6 +1055,16 @@ static void InitializeSockets(Service::Interface* self) {
 
 static void ShutdownSockets(Service::Interface* self) {
     // TODO(Subv): Implement
+
+    // Threads blocked on the sockets fail once they are closed
+    std::vector<u64> ids;
+    for (const auto& pending : pending_ops)
+        ids.push_back(pending.first);
+    for (auto sock : open_sockets)
+        closesocket(sock.second.socket_fd);
+    open_sockets.clear();
+    CompleteSocketOps(ids);
+
     CleanupSockets();
 
 #ifdef _WIN32
@@ -755,6 +1113,8 @@ const Interface::FunctionInfo FunctionTable[] = {
 // Interface class
 
 Interface::Interface() {
+    socket_ready_event_type = CoreTiming::RegisterEvent("SOC_U::SocketReadyCallback", SocketReadyCallback);
+
     Register(FunctionTable);
 }
 
@@ -2,17 +2,25 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <thread>
 
 #include "common/logging/log.h"
+#include "common/thread.h"
 
+#include "core/core_timing.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/event.h"
 #include "core/hle/service/y2r_u.h"
 #include "core/hw/y2r.h"
 #include "core/mem_map.h"
+#include "core/settings.h"
 
+#include "video_core/rasterizer.h"
 #include "video_core/renderer_base.h"
+#include "video_core/texture_cache.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
 
@@ -37,6 +45,78 @@ static_assert(sizeof(ConversionParameters) == 12, "ConversionParameters struct h
 static Kernel::SharedPtr<Kernel::Event> completion_event;
 static ConversionConfiguration conversion;
 
+/**
+ * Rough cost of a conversion on hardware, in ARM11 cycles per output pixel. With this, a 400x240
+ * video frame takes about 1.5 ms, which is what the completion event is delayed by in async mode.
+ */
+static const s64 CONVERSION_CYCLES_PER_PIXEL = 4;
+
+// Asynchronous conversions are performed by a worker thread on a copy of the configuration and
+// are completed by a CoreTiming event on the CPU thread, which also signals completion_event.
+
+static std::thread conversion_worker;
+static std::mutex conversion_mutex;
+static std::condition_variable conversion_requested;
+static std::condition_variable conversion_finished;
+/// Configuration of the conversion performed by the worker, only touched while it isn't running
+static ConversionConfiguration async_conversion;
+/// Set by the CPU thread to hand async_conversion to the worker, cleared by the worker once done
+static bool conversion_pending = false;
+static bool worker_running = false;
+
+/// Output address of async_conversion before it was performed, since converting advances it
+static VAddr async_dst_address;
+
+/// Set from StartConversion until the completion event has been signaled
+static bool conversion_busy = false;
+static int conversion_event_type = -1;
+
+static void ConversionWorkerLoop() {
+    Common::SetCurrentThreadName("Y2R");
+
+    std::unique_lock<std::mutex> lock(conversion_mutex);
+    while (true) {
+        conversion_requested.wait(lock, []{ return conversion_pending || !worker_running; });
+        if (!conversion_pending)
+            break;
+
+        lock.unlock();
+        HW::Y2R::PerformConversion(async_conversion);
+        lock.lock();
+
+        conversion_pending = false;
+        conversion_finished.notify_all();
+    }
+}
+
+/// Blocks until the worker has finished the conversion handed to it, if any
+static void WaitForAsyncConversion() {
+    std::unique_lock<std::mutex> lock(conversion_mutex);
+    conversion_finished.wait(lock, []{ return !conversion_pending; });
+}
+
+/// Makes the result of a finished conversion visible to the rest of the system
+static void NotifyConversionOutput(const ConversionConfiguration& cvt, VAddr dst_address) {
+    // dst_image_size would seem to be perfect for this, but it doesn't include the gap :(
+    u32 total_output_size = cvt.input_lines * (cvt.dst.transfer_unit + cvt.dst.gap);
+    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(
+        Memory::VirtualToPhysicalAddress(dst_address), total_output_size);
+    Pica::TextureCache::NotifyFlush(
+        Memory::VirtualToPhysicalAddress(dst_address), total_output_size);
+    Pica::Rasterizer::NotifyFlush(
+        Memory::VirtualToPhysicalAddress(dst_address), total_output_size);
+}
+
+static void ConversionCompletedCallback(u64 userdata, int cycles_late) {
+    // The host may be slower than the estimated hardware latency
+    WaitForAsyncConversion();
+
+    NotifyConversionOutput(async_conversion, async_dst_address);
+
+    conversion_busy = false;
+    completion_event->Signal();
+}
+
 static const CoefficientSet standard_coefficients[4] = {
     {{ 0x100, 0x166, 0xB6, 0x58, 0x1C5, -0x166F, 0x10EE, -0x1C5B }}, // ITU_Rec601
     {{ 0x100, 0x193, 0x77, 0x2F, 0x1DB, -0x1933,  0xA7C, -0x1D51 }}, // ITU_Rec709
@@ -263,13 +343,41 @@ static void SetAlpha(Service::Interface* self) {
 static void StartConversion(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    HW::Y2R::PerformConversion(conversion);
+    // A conversion started while another one is running replaces it
+    if (conversion_busy) {
+        WaitForAsyncConversion();
+        CoreTiming::UnscheduleEvent(conversion_event_type, 0);
+        NotifyConversionOutput(async_conversion, async_dst_address);
+        conversion_busy = false;
+    }
 
-    // dst_image_size would seem to be perfect for this, but it doesn't include the gap :(
-    u32 total_output_size = conversion.input_lines *
-        (conversion.dst.transfer_unit + conversion.dst.gap);
-    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(
-        Memory::VirtualToPhysicalAddress(conversion.dst.address), total_output_size);
+    // Run-ahead snapshots can't see the worker's writes, see SaveState::CaptureSnapshot
+    if (Settings::values.use_async_y2r && Settings::values.run_ahead_frames == 0) {
+        if (!conversion_worker.joinable()) {
+            worker_running = true;
+            conversion_worker = std::thread(ConversionWorkerLoop);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(conversion_mutex);
+            async_conversion = conversion;
+            async_dst_address = conversion.dst.address;
+            conversion_pending = true;
+        }
+        conversion_requested.notify_one();
+
+        s64 cycles = (s64)conversion.input_line_width * conversion.input_lines * CONVERSION_CYCLES_PER_PIXEL;
+        CoreTiming::ScheduleEvent(cycles, conversion_event_type);
+        conversion_busy = true;
+
+        LOG_DEBUG(Service_Y2R, "called, converting asynchronously");
+        cmd_buff[1] = RESULT_SUCCESS.raw;
+        return;
+    }
+
+    VAddr dst_address = conversion.dst.address;
+    HW::Y2R::PerformConversion(conversion);
+    NotifyConversionOutput(conversion, dst_address);
 
     LOG_DEBUG(Service_Y2R, "called");
     completion_event->Signal();
@@ -280,6 +388,14 @@ static void StartConversion(Service::Interface* self) {
 static void StopConversion(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
+    if (conversion_busy) {
+        // The worker can't be interrupted, so the conversion is finished without signaling completion
+        WaitForAsyncConversion();
+        CoreTiming::UnscheduleEvent(conversion_event_type, 0);
+        NotifyConversionOutput(async_conversion, async_dst_address);
+        conversion_busy = false;
+    }
+
     cmd_buff[0] = IPC::MakeHeader(0x27, 1, 0);
     cmd_buff[1] = RESULT_SUCCESS.raw;
     LOG_DEBUG(Service_Y2R, "called");
@@ -295,7 +411,7 @@ static void IsBusyConversion(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
     cmd_buff[1] = RESULT_SUCCESS.raw;
-    cmd_buff[2] = 0; // StartConversion always finishes immediately
+    cmd_buff[2] = conversion_busy ? 1 : 0;
     LOG_DEBUG(Service_Y2R, "called");
 }
 
@@ -407,10 +523,26 @@ Interface::Interface() {
     completion_event = Kernel::Event::Create(RESETTYPE_ONESHOT, "Y2R:Completed");
     std::memset(&conversion, 0, sizeof(conversion));
 
+    conversion_busy = false;
+    conversion_event_type = CoreTiming::RegisterEvent("Y2R_U::ConversionCompletedCallback", ConversionCompletedCallback);
+
     Register(FunctionTable);
 }
 
 Interface::~Interface() {
+    if (conversion_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(conversion_mutex);
+            worker_running = false;
+        }
+        conversion_requested.notify_one();
+        conversion_worker.join();
+    }
+
+    if (conversion_busy)
+        CoreTiming::UnscheduleEvent(conversion_event_type, 0);
+    conversion_busy = false;
+
     completion_event = nullptr;
 }
 
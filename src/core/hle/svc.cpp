@@ -2,10 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <array>
 #include <map>
+#include <memory>
 
 #include "common/logging/log.h"
 #include "common/profiler.h"
+#include "common/profiler_reporting.h"
 #include "common/string_util.h"
 #include "common/symbols.h"
 
@@ -122,7 +125,7 @@ static ResultCode ConnectToPort(Handle* out_handle, const char* port_name) {
 
 /// Synchronize to an OS service
 static ResultCode SendSyncRequest(Handle handle) {
-    SharedPtr<Kernel::Session> session = Kernel::g_handle_table.Get<Kernel::Session>(handle);
+    Kernel::Session* session = Kernel::g_handle_table.GetRaw<Kernel::Session>(handle);
     if (session == nullptr) {
         return ERR_INVALID_HANDLE;
     }
@@ -140,7 +143,7 @@ static ResultCode CloseHandle(Handle handle) {
 
 /// Wait for a handle to synchronize, timeout after the specified nanoseconds
 static ResultCode WaitSynchronization1(Handle handle, s64 nano_seconds) {
-    auto object = Kernel::g_handle_table.GetWaitObject(handle);
+    Kernel::WaitObject* object = Kernel::g_handle_table.GetWaitObjectRaw(handle);
     Kernel::Thread* thread = Kernel::GetCurrentThread();
 
     thread->waitsynch_waited = false;
@@ -157,7 +160,7 @@ static ResultCode WaitSynchronization1(Handle handle, s64 nano_seconds) {
     if (object->ShouldWait()) {
 
         object->AddWaitingThread(thread);
-        Kernel::WaitCurrentThread_WaitSynchronization({ object }, false, false);
+        Kernel::WaitCurrentThread_WaitSynchronization(&object, 1, false, false);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
         thread->WakeAfterDelay(nano_seconds);
@@ -188,20 +191,27 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     ASSERT_MSG(out != nullptr, "invalid output pointer specified!");
 
     // Check if 'handle_count' is invalid
-    if (handle_count < 0)
+    if (handle_count < 0 || handle_count > (s32)Kernel::MAX_WAIT_OBJECTS)
         return ResultCode(ErrorDescription::OutOfRange, ErrorModule::OS, ErrorSummary::InvalidArgument, ErrorLevel::Usage);
 
+    // Look up every handle once. The handle table keeps the objects alive for the duration of the
+    // SVC, so borrowed pointers are enough and no references have to be taken.
+    std::array<Kernel::WaitObject*, Kernel::MAX_WAIT_OBJECTS> objects;
+    for (int i = 0; i < handle_count; ++i) {
+        objects[i] = Kernel::g_handle_table.GetWaitObjectRaw(handles[i]);
+        if (objects[i] == nullptr)
+            return ERR_INVALID_HANDLE;
+    }
+
     // If 'handle_count' is non-zero, iterate through each handle and wait the current thread if
     // necessary
     if (handle_count != 0) {
         bool selected = false; // True once an object has been selected
 
-        Kernel::SharedPtr<Kernel::WaitObject> wait_object;
+        Kernel::WaitObject* wait_object = nullptr;
 
         for (int i = 0; i < handle_count; ++i) {
-            auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
-            if (object == nullptr)
-                return ERR_INVALID_HANDLE;
+            Kernel::WaitObject* object = objects[i];
 
             // Check if the current thread should wait on this object...
             if (object->ShouldWait()) {
@@ -235,16 +245,10 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     if (wait_thread) {
 
         // Actually wait the current thread on each object if we decided to wait...
-        std::vector<SharedPtr<Kernel::WaitObject>> wait_objects;
-        wait_objects.reserve(handle_count);
+        for (int i = 0; i < handle_count; ++i)
+            objects[i]->AddWaitingThread(Kernel::GetCurrentThread());
 
-        for (int i = 0; i < handle_count; ++i) {
-            auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
-            object->AddWaitingThread(Kernel::GetCurrentThread());
-            wait_objects.push_back(object);
-        }
-
-        Kernel::WaitCurrentThread_WaitSynchronization(std::move(wait_objects), true, wait_all);
+        Kernel::WaitCurrentThread_WaitSynchronization(objects.data(), handle_count, true, wait_all);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
         Kernel::GetCurrentThread()->WakeAfterDelay(nano_seconds);
@@ -255,7 +259,7 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
 
     // Acquire objects if we did not wait...
     for (int i = 0; i < handle_count; ++i) {
-        auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
+        Kernel::WaitObject* object = objects[i];
 
         // Acquire the object if it is not waiting...
         if (!object->ShouldWait()) {
@@ -292,7 +296,7 @@ static ResultCode ArbitrateAddress(Handle handle, u32 address, u32 type, u32 val
     LOG_TRACE(Kernel_SVC, "called handle=0x%08X, address=0x%08X, type=0x%08X, value=0x%08X", handle,
         address, type, value);
 
-    SharedPtr<AddressArbiter> arbiter = Kernel::g_handle_table.Get<AddressArbiter>(handle);
+    AddressArbiter* arbiter = Kernel::g_handle_table.GetRaw<AddressArbiter>(handle);
     if (arbiter == nullptr)
         return ERR_INVALID_HANDLE;
 
@@ -454,7 +458,7 @@ static ResultCode ReleaseMutex(Handle handle) {
 
     LOG_TRACE(Kernel_SVC, "called handle=0x%08X", handle);
 
-    SharedPtr<Mutex> mutex = Kernel::g_handle_table.Get<Mutex>(handle);
+    Mutex* mutex = Kernel::g_handle_table.GetRaw<Mutex>(handle);
     if (mutex == nullptr)
         return ERR_INVALID_HANDLE;
 
@@ -521,7 +525,7 @@ static ResultCode ReleaseSemaphore(s32* count, Handle handle, s32 release_count)
 
     LOG_TRACE(Kernel_SVC, "called release_count=%d, handle=0x%08X", release_count, handle);
 
-    SharedPtr<Semaphore> semaphore = Kernel::g_handle_table.Get<Semaphore>(handle);
+    Semaphore* semaphore = Kernel::g_handle_table.GetRaw<Semaphore>(handle);
     if (semaphore == nullptr)
         return ERR_INVALID_HANDLE;
 
@@ -581,7 +585,7 @@ static ResultCode SignalEvent(Handle handle) {
     using Kernel::Event;
     LOG_TRACE(Kernel_SVC, "called event=0x%08X", handle);
 
-    SharedPtr<Event> evt = Kernel::g_handle_table.Get<Kernel::Event>(handle);
+    Event* evt = Kernel::g_handle_table.GetRaw<Kernel::Event>(handle);
     if (evt == nullptr)
         return ERR_INVALID_HANDLE;
 
@@ -595,7 +599,7 @@ static ResultCode ClearEvent(Handle handle) {
     using Kernel::Event;
     LOG_TRACE(Kernel_SVC, "called event=0x%08X", handle);
 
-    SharedPtr<Event> evt = Kernel::g_handle_table.Get<Kernel::Event>(handle);
+    Event* evt = Kernel::g_handle_table.GetRaw<Kernel::Event>(handle);
     if (evt == nullptr)
         return ERR_INVALID_HANDLE;
 
@@ -663,6 +667,11 @@ static ResultCode CancelTimer(Handle handle) {
 static void SleepThread(s64 nanoseconds) {
     LOG_TRACE(Kernel_SVC, "called nanoseconds=%lld", nanoseconds);
 
+    // Games spin on zero sleeps to yield, which doesn't need a wakeup event if another thread can
+    // take over right away
+    if (nanoseconds == 0 && Kernel::YieldCurrentThread())
+        return;
+
     // Sleep current thread and check for next thread to schedule
     Kernel::WaitCurrentThread_Sleep();
 
@@ -833,6 +842,16 @@ static const FunctionDef SVC_Table[] = {
 
 Common::Profiling::TimingCategory profiler_svc("SVC Calls");
 
+/// Per-SVC child categories of profiler_svc, indexed by SVC number and created on first use
+static std::array<std::unique_ptr<Common::Profiling::TimingCategory>, ARRAY_SIZE(SVC_Table)> svc_categories;
+
+static Common::Profiling::TimingCategory& GetSVCCategory(u32 func_num) {
+    auto& category = svc_categories[func_num];
+    if (category == nullptr)
+        category.reset(new Common::Profiling::TimingCategory(SVC_Table[func_num].name, &profiler_svc));
+    return *category;
+}
+
 static const FunctionDef* GetSVCInfo(u32 func_num) {
     if (func_num >= ARRAY_SIZE(SVC_Table)) {
         LOG_ERROR(Kernel_SVC, "unknown svc=0x%02X", func_num);
@@ -847,11 +866,26 @@ void CallSVC(u32 immediate) {
     const FunctionDef* info = GetSVCInfo(immediate);
     if (info) {
         if (info->func) {
-            info->func();
+            // Time spent inside the handler is accounted to its own category, leaving only the
+            // dispatch overhead and unimplemented SVCs in profiler_svc itself.
+            Common::Profiling::ScopeTimer timer_func(GetSVCCategory(immediate));
+
+            auto& call_profiler = Common::Profiling::GetHLECallProfiler();
+            if (call_profiler.IsEnabled()) {
+                auto start = Common::Profiling::Clock::now();
+                info->func();
+                call_profiler.AddCall("SVC", info->name, immediate,
+                        std::chrono::duration_cast<Common::Profiling::Duration>(Common::Profiling::Clock::now() - start));
+            } else {
+                info->func();
+            }
         } else {
             LOG_ERROR(Kernel_SVC, "unimplemented SVC function %s(..)", info->name);
         }
     }
+
+    // The handler, or the services it called, may have written to the reserved memory
+    Core::g_app_core->ClearExclusiveState();
 }
 
 } // namespace
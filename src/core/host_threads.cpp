@@ -0,0 +1,125 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "common/logging/log.h"
+
+#include "core/host_threads.h"
+#include "core/settings.h"
+
+namespace HostThreads {
+
+static const size_t NUM_ROLES = (size_t)Role::NumRoles;
+
+static const char* const role_names[NUM_ROLES] = { "emulation", "GPU", "present", "worker" };
+
+static std::array<u32, NUM_ROLES> affinity_masks = {};
+static std::array<Common::ThreadPriority, NUM_ROLES> priorities = {{
+    Common::ThreadPriority::Normal, Common::ThreadPriority::Normal,
+    Common::ThreadPriority::Normal, Common::ThreadPriority::Normal,
+}};
+
+/**
+ * Keeps all threads on the package of the first host CPU, so that they share its last-level cache
+ * and memory. The emulation, GPU and present threads each get a physical core of their own, while
+ * there are enough of them, and the pool's workers get the remaining ones. Roles which don't get a
+ * core of their own run on the workers' cores.
+ */
+static std::array<u32, NUM_ROLES> ComputeAutoMasks() {
+    std::array<u32, NUM_ROLES> masks = {};
+
+    const std::vector<Common::HostCpu> cpus = Common::GetHostCpuTopology();
+    const unsigned package = cpus.front().package;
+
+    // Affinity masks only reach the CPUs with indices below 32
+    std::vector<unsigned> cores;
+    for (const Common::HostCpu& cpu : cpus) {
+        if (cpu.package == package && cpu.index < 32 &&
+            std::find(cores.begin(), cores.end(), cpu.core) == cores.end())
+            cores.push_back(cpu.core);
+    }
+
+    // With a single core there is nothing to keep apart
+    if (cores.size() < 2)
+        return masks;
+
+    auto GetCoreMask = [&cpus](unsigned core) {
+        u32 mask = 0;
+        for (const Common::HostCpu& cpu : cpus) {
+            if (cpu.core == core && cpu.index < 32)
+                mask |= 1u << cpu.index;
+        }
+        return mask;
+    };
+
+    // Dedicated cores are taken from the end of the package, operating systems tend to handle most
+    // interrupts on the first one. The workers always keep at least one core.
+    size_t num_free_cores = cores.size();
+    auto TakeCore = [&]() -> u32 {
+        return num_free_cores > 1 ? GetCoreMask(cores[--num_free_cores]) : 0;
+    };
+
+    masks[(size_t)Role::Emulation] = TakeCore();
+    if (Settings::values.use_gpu_thread)
+        masks[(size_t)Role::GPU] = TakeCore();
+    if (Settings::values.use_present_thread)
+        masks[(size_t)Role::Present] = TakeCore();
+
+    u32 worker_mask = 0;
+    for (size_t i = 0; i < num_free_cores; ++i)
+        worker_mask |= GetCoreMask(cores[i]);
+
+    for (u32& mask : masks) {
+        if (mask == 0)
+            mask = worker_mask;
+    }
+    return masks;
+}
+
+void Init() {
+    const int mask_settings[NUM_ROLES] = {
+        Settings::values.emu_thread_affinity_mask, Settings::values.gpu_thread_affinity_mask,
+        Settings::values.present_thread_affinity_mask, Settings::values.worker_affinity_mask,
+    };
+    const int priority_settings[NUM_ROLES] = {
+        Settings::values.emu_thread_priority, Settings::values.gpu_thread_priority,
+        Settings::values.present_thread_priority, Settings::values.worker_thread_priority,
+    };
+
+    std::array<u32, NUM_ROLES> auto_masks = {};
+    if (Settings::values.use_auto_thread_affinity)
+        auto_masks = ComputeAutoMasks();
+
+    for (size_t i = 0; i < NUM_ROLES; ++i) {
+        // Explicit masks take precedence over the automatic placement
+        affinity_masks[i] = mask_settings[i] != 0 ? (u32)mask_settings[i] : auto_masks[i];
+        priorities[i] = (Common::ThreadPriority)std::min(std::max(priority_settings[i], 0), 2);
+
+        LOG_INFO(Core, "Host %s threads: affinity mask 0x%08X, priority %d", role_names[i],
+                 affinity_masks[i], (int)priorities[i]);
+    }
+}
+
+u32 GetAffinityMask(Role role) {
+    return affinity_masks[(size_t)role];
+}
+
+Common::ThreadPriority GetPriority(Role role) {
+    return priorities[(size_t)role];
+}
+
+void ApplyToCurrentThread(Role role) {
+    const u32 mask = GetAffinityMask(role);
+    if (mask != 0)
+        Common::SetCurrentThreadAffinity(mask);
+
+    const Common::ThreadPriority priority = GetPriority(role);
+    if (priority != Common::ThreadPriority::Normal && !Common::SetCurrentThreadPriority(priority))
+        LOG_WARNING(Core, "Could not change the priority of the %s thread", role_names[(size_t)role]);
+}
+
+} // namespace
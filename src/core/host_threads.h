@@ -0,0 +1,40 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+#include "common/thread.h"
+
+/**
+ * Places the emulator's threads on the host's CPUs. Each thread role has an affinity mask and a
+ * priority from the settings, and the threads apply those of their role when they start.
+ */
+namespace HostThreads {
+
+enum class Role {
+    Emulation = 0, ///< Runs the emulated CPU, and the GPU unless it has a thread of its own
+    GPU = 1,       ///< Processes the PICA command lists, see Settings::values.use_gpu_thread
+    Present = 2,   ///< Presents finished frames, see Settings::values.use_present_thread
+    Worker = 3,    ///< Worker of the process-wide thread pool
+
+    NumRoles
+};
+
+/**
+ * Decides the affinity mask and the priority of every role from the settings, placing the roles
+ * automatically if Settings::values.use_auto_thread_affinity is set. Called by System::Init
+ * before any of the threads start.
+ */
+void Init();
+
+/// Returns the host CPUs threads of a role may run on, or 0 if they are left to the OS
+u32 GetAffinityMask(Role role);
+
+Common::ThreadPriority GetPriority(Role role);
+
+/// Applies the affinity mask and the priority of a role to the calling thread
+void ApplyToCurrentThread(Role role);
+
+} // namespace
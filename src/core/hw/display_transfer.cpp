@@ -0,0 +1,191 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/color.h"
+#include "common/logging/log.h"
+#include "common/vector_math.h"
+
+#include "core/hw/display_transfer.h"
+
+#include "video_core/utils.h"
+
+namespace GPU {
+
+namespace DisplayTransfer {
+
+using PixelFormat = Regs::PixelFormat;
+
+template <PixelFormat format>
+struct PixelTraits;
+
+template <>
+struct PixelTraits<PixelFormat::RGBA8> {
+    static const u32 bytes = 4;
+    static Math::Vec4<u8> Decode(const u8* bytes) { return Color::DecodeRGBA8(bytes); }
+    static void Encode(const Math::Vec4<u8>& color, u8* bytes) { Color::EncodeRGBA8(color, bytes); }
+};
+
+template <>
+struct PixelTraits<PixelFormat::RGB8> {
+    static const u32 bytes = 3;
+    static Math::Vec4<u8> Decode(const u8* bytes) { return Color::DecodeRGB8(bytes); }
+    static void Encode(const Math::Vec4<u8>& color, u8* bytes) { Color::EncodeRGB8(color, bytes); }
+};
+
+template <>
+struct PixelTraits<PixelFormat::RGB565> {
+    static const u32 bytes = 2;
+    static Math::Vec4<u8> Decode(const u8* bytes) { return Color::DecodeRGB565(bytes); }
+    static void Encode(const Math::Vec4<u8>& color, u8* bytes) { Color::EncodeRGB565(color, bytes); }
+};
+
+template <>
+struct PixelTraits<PixelFormat::RGB5A1> {
+    static const u32 bytes = 2;
+    static Math::Vec4<u8> Decode(const u8* bytes) { return Color::DecodeRGB5A1(bytes); }
+    static void Encode(const Math::Vec4<u8>& color, u8* bytes) { Color::EncodeRGB5A1(color, bytes); }
+};
+
+template <>
+struct PixelTraits<PixelFormat::RGBA4> {
+    static const u32 bytes = 2;
+    static Math::Vec4<u8> Decode(const u8* bytes) { return Color::DecodeRGBA4(bytes); }
+    static void Encode(const Math::Vec4<u8>& color, u8* bytes) { Color::EncodeRGBA4(color, bytes); }
+};
+
+/// Returns the offset of the given column from the start of its row of tiles, excluding the row's Morton bits
+static inline u32 TiledColumnOffset(u32 x, u32 bytes_per_pixel) {
+    return VideoCore::GetMortonOffset(x, 0, bytes_per_pixel);
+}
+
+/// Returns the offset of the given row's first pixel, i.e. the start of its row of tiles plus its Morton bits
+static inline u32 TiledRowOffset(u32 y, u32 bytes_per_pixel, u32 stride) {
+    return VideoCore::GetMortonOffset(0, y, bytes_per_pixel) + (y & ~7) * stride;
+}
+
+template <PixelFormat input_format, PixelFormat output_format, bool input_tiled, bool output_tiled,
+          bool horizontal_scale, bool vertical_scale>
+static void TransferKernel(const Config& config, const u8* src, u8* dst) {
+    using In = PixelTraits<input_format>;
+    using Out = PixelTraits<output_format>;
+
+    // Decoding and encoding a pixel in the same format reproduces its bytes, so these are copies
+    const bool is_copy = input_format == output_format && !horizontal_scale && !vertical_scale;
+
+    const u32 input_stride = config.input_width * In::bytes;
+    const u32 output_stride = config.output_width * Out::bytes;
+
+    for (u32 y = 0; y < config.output_height; ++y) {
+        const u32 input_y = y << vertical_scale;
+        const u32 output_y = config.flip_vertically ? config.output_height - y - 1 : y;
+
+        const u8* src_row = src + (input_tiled ? TiledRowOffset(input_y, In::bytes, input_stride)
+                                               : input_y * input_stride);
+        u8* dst_row = dst + (output_tiled ? TiledRowOffset(output_y, Out::bytes, output_stride)
+                                          : output_y * output_stride);
+
+        if (is_copy && !input_tiled && !output_tiled) {
+            std::memcpy(dst_row, src_row, output_stride);
+            continue;
+        }
+
+        for (u32 x = 0; x < config.output_width; ++x) {
+            const u32 input_x = x << horizontal_scale;
+
+            const u8* src_pixel = src_row + (input_tiled ? TiledColumnOffset(input_x, In::bytes)
+                                                         : input_x * In::bytes);
+            u8* dst_pixel = dst_row + (output_tiled ? TiledColumnOffset(x, Out::bytes)
+                                                    : x * Out::bytes);
+
+            if (is_copy) {
+                std::memcpy(dst_pixel, src_pixel, Out::bytes);
+                continue;
+            }
+
+            // Scaling is only supported for tiled input, where the pixels of each 2x2 block are
+            // stored next to each other in Morton order
+            Math::Vec4<u8> color = In::Decode(src_pixel);
+            if (vertical_scale) {
+                Math::Vec4<u8> pixel1 = In::Decode(src_pixel + 1 * In::bytes);
+                Math::Vec4<u8> pixel2 = In::Decode(src_pixel + 2 * In::bytes);
+                Math::Vec4<u8> pixel3 = In::Decode(src_pixel + 3 * In::bytes);
+                color = (((color + pixel1) + (pixel2 + pixel3)) / 4).Cast<u8>();
+            } else if (horizontal_scale) {
+                Math::Vec4<u8> pixel = In::Decode(src_pixel + In::bytes);
+                color = ((color + pixel) / 2).Cast<u8>();
+            }
+
+            Out::Encode(color, dst_pixel);
+        }
+    }
+}
+
+using KernelFunc = void (*)(const Config& config, const u8* src, u8* dst);
+
+template <PixelFormat input_format, bool input_tiled, bool output_tiled, bool horizontal_scale, bool vertical_scale>
+static KernelFunc SelectKernel(PixelFormat output_format) {
+#define KERNEL(format) &TransferKernel<input_format, format, input_tiled, output_tiled, horizontal_scale, vertical_scale>
+    switch (output_format) {
+    case PixelFormat::RGBA8:  return KERNEL(PixelFormat::RGBA8);
+    case PixelFormat::RGB8:   return KERNEL(PixelFormat::RGB8);
+    case PixelFormat::RGB565: return KERNEL(PixelFormat::RGB565);
+    case PixelFormat::RGB5A1: return KERNEL(PixelFormat::RGB5A1);
+    case PixelFormat::RGBA4:  return KERNEL(PixelFormat::RGBA4);
+    default:
+        LOG_ERROR(HW_GPU, "Unknown destination framebuffer format %x", (u32)output_format);
+        return nullptr;
+    }
+#undef KERNEL
+}
+
+template <bool input_tiled, bool output_tiled, bool horizontal_scale, bool vertical_scale>
+static KernelFunc SelectKernel(PixelFormat input_format, PixelFormat output_format) {
+#define SELECT(format) SelectKernel<format, input_tiled, output_tiled, horizontal_scale, vertical_scale>(output_format)
+    switch (input_format) {
+    case PixelFormat::RGBA8:  return SELECT(PixelFormat::RGBA8);
+    case PixelFormat::RGB8:   return SELECT(PixelFormat::RGB8);
+    case PixelFormat::RGB565: return SELECT(PixelFormat::RGB565);
+    case PixelFormat::RGB5A1: return SELECT(PixelFormat::RGB5A1);
+    case PixelFormat::RGBA4:  return SELECT(PixelFormat::RGBA4);
+    default:
+        LOG_ERROR(HW_GPU, "Unknown source framebuffer format %x", (u32)input_format);
+        return nullptr;
+    }
+#undef SELECT
+}
+
+static KernelFunc SelectKernel(const Config& config) {
+    if (config.input_tiled) {
+        if (config.vertical_scale) {
+            return config.output_tiled ? SelectKernel<true, true, true, true>(config.input_format, config.output_format)
+                                       : SelectKernel<true, false, true, true>(config.input_format, config.output_format);
+        } else if (config.horizontal_scale) {
+            return config.output_tiled ? SelectKernel<true, true, true, false>(config.input_format, config.output_format)
+                                       : SelectKernel<true, false, true, false>(config.input_format, config.output_format);
+        } else {
+            return config.output_tiled ? SelectKernel<true, true, false, false>(config.input_format, config.output_format)
+                                       : SelectKernel<true, false, false, false>(config.input_format, config.output_format);
+        }
+    }
+
+    if (config.horizontal_scale || config.vertical_scale) {
+        LOG_CRITICAL(HW_GPU, "Scaling is only implemented on tiled input");
+        return nullptr;
+    }
+
+    return config.output_tiled ? SelectKernel<false, true, false, false>(config.input_format, config.output_format)
+                               : SelectKernel<false, false, false, false>(config.input_format, config.output_format);
+}
+
+void Perform(const Config& config, const u8* src, u8* dst) {
+    KernelFunc kernel = SelectKernel(config);
+    if (kernel != nullptr)
+        kernel(config, src, dst);
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,49 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "core/hw/gpu.h"
+
+namespace GPU {
+
+/**
+ * Converts images between the tiled framebuffer layout and the linear display layout.
+ *
+ * Each combination of input format, output format, tiling direction and scaling mode is handled
+ * by its own instantiation of a kernel template, so per-pixel work is reduced to the address
+ * computation and the format conversion for exactly the formats involved.
+ */
+namespace DisplayTransfer {
+
+struct Config {
+    Regs::PixelFormat input_format;
+    Regs::PixelFormat output_format;
+
+    u32 input_width;
+
+    /// Dimensions of the output image after scaling
+    u32 output_width;
+    u32 output_height;
+
+    bool input_tiled;
+    bool output_tiled;
+    bool flip_vertically;
+
+    /// Whether each output pixel averages two horizontally and/or vertically adjacent input pixels
+    bool horizontal_scale;
+    bool vertical_scale;
+};
+
+/**
+ * Converts the input image into the output image as described by the given configuration.
+ * Scaling is only supported for tiled input.
+ */
+void Perform(const Config& config, const u8* src, u8* dst);
+
+} // namespace
+
+} // namespace
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <type_traits>
 
+#include "common/chunk_file.h"
 #include "common/color.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
@@ -13,6 +14,7 @@
 #include "core/settings.h"
 #include "core/memory.h"
 #include "core/core_timing.h"
+#include "core/frame_limiter.h"
 
 #include "core/hle/service/gsp_gpu.h"
 #include "core/hle/service/dsp_dsp.h"
@@ -20,12 +22,17 @@
 
 #include "core/hw/hw.h"
 #include "core/hw/gpu.h"
+#include "core/hw/display_transfer.h"
+#include "core/hw/memory_fill.h"
 
 #include "core/tracer/recorder.h"
 
 #include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
 #include "video_core/hwrasterizer_base.h"
+#include "video_core/rasterizer.h"
 #include "video_core/renderer_base.h"
+#include "video_core/texture_cache.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
 
@@ -47,6 +54,11 @@ static u64 frame_count;
 /// True if the last frame was skipped
 static bool last_skip_frame;
 
+/// Decisions of the VBlanks while they are overridden, see OverrideVBlank()
+static bool vblank_overridden = false;
+static bool override_present;
+static bool override_skip_next;
+
 template <typename T>
 inline void Read(T &var, const u32 raw_addr) {
     u32 addr = raw_addr - HW::VADDR_GPU;
@@ -61,29 +73,6 @@ inline void Read(T &var, const u32 raw_addr) {
     var = g_regs[addr / 4];
 }
 
-static Math::Vec4<u8> DecodePixel(Regs::PixelFormat input_format, const u8* src_pixel) {
-    switch (input_format) {
-    case Regs::PixelFormat::RGBA8:
-        return Color::DecodeRGBA8(src_pixel);
-
-    case Regs::PixelFormat::RGB8:
-        return Color::DecodeRGB8(src_pixel);
-
-    case Regs::PixelFormat::RGB565:
-        return Color::DecodeRGB565(src_pixel);
-
-    case Regs::PixelFormat::RGB5A1:
-        return Color::DecodeRGB5A1(src_pixel);
-
-    case Regs::PixelFormat::RGBA4:
-        return Color::DecodeRGBA4(src_pixel);
-
-    default:
-        LOG_ERROR(HW_GPU, "Unknown source framebuffer format %x", input_format);
-        return {0, 0, 0, 0};
-    }
-}
-
 template <typename T>
 inline void Write(u32 addr, const T data) {
     addr -= HW::VADDR_GPU;
@@ -107,25 +96,39 @@ inline void Write(u32 addr, const T data) {
         auto& config = g_regs.memory_fill_config[is_second_filler];
 
         if (config.trigger) {
+            // Wait for in-flight rendering, which may target the filled region
+            GPUThread::Synchronize();
+
             if (config.address_start) { // Some games pass invalid values here
                 u8* start = Memory::GetPhysicalPointer(config.GetStartAddress());
                 u8* end = Memory::GetPhysicalPointer(config.GetEndAddress());
 
+                // Bytes of a single fill value, as they end up in memory
+                u8 value[4];
+                u32 value_size;
                 if (config.fill_24bit) {
-                    // fill with 24-bit values
-                    for (u8* ptr = start; ptr < end; ptr += 3) {
-                        ptr[0] = config.value_24bit_r;
-                        ptr[1] = config.value_24bit_g;
-                        ptr[2] = config.value_24bit_b;
-                    }
+                    value[0] = config.value_24bit_r;
+                    value[1] = config.value_24bit_g;
+                    value[2] = config.value_24bit_b;
+                    value_size = 3;
                 } else if (config.fill_32bit) {
-                    // fill with 32-bit values
-                    for (u32* ptr = (u32*)start; ptr < (u32*)end; ++ptr)
-                        *ptr = config.value_32bit;
+                    u32 value_32bit = config.value_32bit;
+                    memcpy(value, &value_32bit, sizeof(u32));
+                    value_size = 4;
                 } else {
-                    // fill with 16-bit values
-                    for (u16* ptr = (u16*)start; ptr < (u16*)end; ++ptr)
-                        *ptr = config.value_16bit;
+                    u16 value_16bit = config.value_16bit;
+                    memcpy(value, &value_16bit, sizeof(u16));
+                    value_size = 2;
+                }
+
+                // The hardware rasterizer clears framebuffers it holds in place, and may defer fills of
+                // other regions until they are used next
+                bool accelerated = Settings::values.use_hw_renderer &&
+                    VideoCore::g_renderer->hw_rasterizer->AccelerateFill(config.GetStartAddress(), config.GetEndAddress(), value, value_size);
+
+                if (!accelerated) {
+                    Memory::SnapshotPhysicalRegion(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+                    MemoryFill::Fill(start, end, value, value_size);
                 }
 
                 LOG_TRACE(HW_GPU, "MemoryFill from 0x%08x to 0x%08x", config.GetStartAddress(), config.GetEndAddress());
@@ -136,7 +139,12 @@ inline void Write(u32 addr, const T data) {
                     GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PSC1);
                 }
 
-                VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+                if (!accelerated) {
+                    Memory::RecordPhysicalWrite(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+                    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+                }
+                Pica::TextureCache::NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+                Pica::Rasterizer::NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
             }
 
             // Reset "trigger" flag and set the "finish" flag
@@ -151,6 +159,8 @@ inline void Write(u32 addr, const T data) {
     {
         const auto& config = g_regs.display_transfer_config;
         if (config.trigger & 1) {
+            // The transfer source is usually a framebuffer which is still being rendered to
+            GPUThread::Synchronize();
 
             if (Pica::g_debug_context)
                 Pica::g_debug_context->OnEvent(Pica::DebugContext::Event::IncomingDisplayTransfer, nullptr);
@@ -180,11 +190,12 @@ inline void Write(u32 addr, const T data) {
             u32 input_size = config.input_width * config.input_height * GPU::Regs::BytesPerPixel(config.input_format);
             u32 output_size = output_width * output_height * GPU::Regs::BytesPerPixel(config.output_format);
 
-            VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(config.GetPhysicalInputAddress(), input_size);
-
             if (config.raw_copy) {
+                VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(config.GetPhysicalInputAddress(), input_size);
+
                 // Raw copies do not perform color conversion nor tiled->linear / linear->tiled conversions
                 // TODO(Subv): Verify if raw copies perform scaling
+                Memory::SnapshotPhysicalRegion(config.GetPhysicalOutputAddress(), output_size);
                 memcpy(dst_pointer, src_pointer, output_size);
 
                 LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), output format: %x, flags 0x%08X, Raw copy",
@@ -195,106 +206,48 @@ inline void Write(u32 addr, const T data) {
 
                 GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
 
+                Memory::RecordPhysicalWrite(config.GetPhysicalOutputAddress(), output_size);
                 VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+                Pica::TextureCache::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+                Pica::Rasterizer::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
                 break;
             }
 
-            for (u32 y = 0; y < output_height; ++y) {
-                for (u32 x = 0; x < output_width; ++x) {
-                    Math::Vec4<u8> src_color;
-
-                    // Calculate the [x,y] position of the input image
-                    // based on the current output position and the scale
-                    u32 input_x = x << horizontal_scale;
-                    u32 input_y = y << vertical_scale;
-
-                    if (config.flip_vertically) {
-                        // Flip the y value of the output data,
-                        // we do this after calculating the [x,y] position of the input image
-                        // to account for the scaling options.
-                        y = output_height - y - 1;
-                    }
-
-                    u32 dst_bytes_per_pixel = GPU::Regs::BytesPerPixel(config.output_format);
-                    u32 src_bytes_per_pixel = GPU::Regs::BytesPerPixel(config.input_format);
-                    u32 src_offset;
-                    u32 dst_offset;
-
-                    if (config.output_tiled) {
-                        if (!config.dont_swizzle) {
-                            // Interpret the input as linear and the output as tiled
-                            u32 coarse_y = y & ~7;
-                            u32 stride = output_width * dst_bytes_per_pixel;
-
-                            src_offset = (input_x + input_y * config.input_width) * src_bytes_per_pixel;
-                            dst_offset = VideoCore::GetMortonOffset(x, y, dst_bytes_per_pixel) + coarse_y * stride;
-                        } else {
-                           // Both input and output are linear
-                            src_offset = (input_x + input_y * config.input_width) * src_bytes_per_pixel;
-                            dst_offset = (x + y * output_width) * dst_bytes_per_pixel;
-                        }
-                    } else {
-                        if (!config.dont_swizzle) {
-                            // Interpret the input as tiled and the output as linear
-                            u32 coarse_y = input_y & ~7;
-                            u32 stride = config.input_width * src_bytes_per_pixel;
-
-                            src_offset = VideoCore::GetMortonOffset(input_x, input_y, src_bytes_per_pixel) + coarse_y * stride;
-                            dst_offset = (x + y * output_width) * dst_bytes_per_pixel;
-                        } else {
-                            // Both input and output are tiled
-                            u32 out_coarse_y = y & ~7;
-                            u32 out_stride = output_width * dst_bytes_per_pixel;
-
-                            u32 in_coarse_y = input_y & ~7;
-                            u32 in_stride = config.input_width * src_bytes_per_pixel;
-
-                            src_offset = VideoCore::GetMortonOffset(input_x, input_y, src_bytes_per_pixel) + in_coarse_y * in_stride;
-                            dst_offset = VideoCore::GetMortonOffset(x, y, dst_bytes_per_pixel) + out_coarse_y * out_stride;
-                        }
-                    }
-
-                    const u8* src_pixel = src_pointer + src_offset;
-                    src_color = DecodePixel(config.input_format, src_pixel);
-                    if (config.scaling == config.ScaleX) {
-                        Math::Vec4<u8> pixel = DecodePixel(config.input_format, src_pixel + src_bytes_per_pixel);
-                        src_color = ((src_color + pixel) / 2).Cast<u8>();
-                    } else if (config.scaling == config.ScaleXY) {
-                        Math::Vec4<u8> pixel1 = DecodePixel(config.input_format, src_pixel + 1 * src_bytes_per_pixel);
-                        Math::Vec4<u8> pixel2 = DecodePixel(config.input_format, src_pixel + 2 * src_bytes_per_pixel);
-                        Math::Vec4<u8> pixel3 = DecodePixel(config.input_format, src_pixel + 3 * src_bytes_per_pixel);
-                        src_color = (((src_color + pixel1) + (pixel2 + pixel3)) / 4).Cast<u8>();
-                    }
-
-                    u8* dst_pixel = dst_pointer + dst_offset;
-                    switch (config.output_format) {
-                    case Regs::PixelFormat::RGBA8:
-                        Color::EncodeRGBA8(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB8:
-                        Color::EncodeRGB8(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB565:
-                        Color::EncodeRGB565(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB5A1:
-                        Color::EncodeRGB5A1(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGBA4:
-                        Color::EncodeRGBA4(src_color, dst_pixel);
-                        break;
-
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown destination framebuffer format %x", config.output_format.Value());
-                        break;
-                    }
-                }
+            DisplayTransfer::Config transfer;
+            transfer.input_format = config.input_format;
+            transfer.output_format = config.output_format;
+            transfer.input_width = config.input_width;
+            transfer.output_width = output_width;
+            transfer.output_height = output_height;
+            // output_tiled selects linear->tiled conversion, dont_swizzle keeps the input layout
+            transfer.input_tiled = !config.output_tiled;
+            transfer.output_tiled = config.output_tiled != config.dont_swizzle;
+            transfer.flip_vertically = config.flip_vertically;
+            transfer.horizontal_scale = horizontal_scale;
+            transfer.vertical_scale = vertical_scale;
+
+            // Transfers between framebuffers held by the hardware rasterizer don't need a readback
+            if (Settings::values.use_hw_renderer &&
+                VideoCore::g_renderer->hw_rasterizer->AccelerateDisplayTransfer(transfer, config.GetPhysicalInputAddress(), config.GetPhysicalOutputAddress())) {
+
+                LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x(%ux%u)-> 0x%08x(%ux%u), dst format %x, flags 0x%08X, accelerated",
+                          config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
+                          config.GetPhysicalOutputAddress(), output_width, output_height,
+                          config.output_format.Value(), config.flags);
+
+                g_regs.display_transfer_config.trigger = 0;
+                GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
+
+                Pica::TextureCache::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+                Pica::Rasterizer::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+                break;
             }
 
+            VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(config.GetPhysicalInputAddress(), input_size);
+
+            Memory::SnapshotPhysicalRegion(config.GetPhysicalOutputAddress(), output_size);
+            DisplayTransfer::Perform(transfer, src_pointer, dst_pointer);
+
             LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), dst format %x, flags 0x%08X",
                       config.output_height * output_width * GPU::Regs::BytesPerPixel(config.output_format),
                       config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
@@ -304,7 +257,10 @@ inline void Write(u32 addr, const T data) {
             g_regs.display_transfer_config.trigger = 0;
             GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
 
+            Memory::RecordPhysicalWrite(config.GetPhysicalOutputAddress(), output_size);
             VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+            Pica::TextureCache::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+            Pica::Rasterizer::NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
         }
         break;
     }
@@ -321,7 +277,7 @@ inline void Write(u32 addr, const T data) {
                 Pica::g_debug_context->recorder->MemoryAccessed((u8*)buffer, config.size * sizeof(u32), config.GetPhysicalAddress());
             }
 
-            Pica::CommandProcessor::ProcessCommandList(buffer, config.size);
+            GPUThread::ProcessCommandList(buffer, config.size);
 
             g_regs.command_processor_config.trigger = 0;
         }
@@ -352,11 +308,78 @@ template void Write<u32>(u32 addr, const u32 data);
 template void Write<u16>(u32 addr, const u16 data);
 template void Write<u8>(u32 addr, const u8 data);
 
+/// Returns whether writing the register with the given index has side effects, see Write
+static bool IsTriggerRegister(u32 index) {
+    switch (index) {
+    case GPU_REG_INDEX_WORKAROUND(memory_fill_config[0].trigger, 0x00004 + 0x3):
+    case GPU_REG_INDEX_WORKAROUND(memory_fill_config[1].trigger, 0x00008 + 0x3):
+    case GPU_REG_INDEX(display_transfer_config.trigger):
+    case GPU_REG_INDEX(command_processor_config.trigger):
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+void WriteBlock(u32 addr, const u32* data, u32 count) {
+    u32 index = (addr - HW::VADDR_GPU) / 4;
+
+    // The tracer records every single register write, and out of range writes get logged by Write
+    if ((addr & 3) != 0 || index > Regs::NumIds() || count > Regs::NumIds() - index ||
+        (Pica::g_debug_context && Pica::g_debug_context->recorder)) {
+        for (u32 i = 0; i < count; ++i)
+            Write<u32>(addr + 4 * i, data[i]);
+        return;
+    }
+
+    // Copy the runs of plain registers in one go, and dispatch the triggers in between in order
+    const u32 end = index + count;
+    while (index < end) {
+        u32 run_end = index;
+        while (run_end < end && !IsTriggerRegister(run_end))
+            ++run_end;
+
+        std::memcpy(&g_regs[index], data, (run_end - index) * sizeof(u32));
+        data += run_end - index;
+        index = run_end;
+
+        if (index < end) {
+            Write<u32>(HW::VADDR_GPU + 4 * index, *data);
+            ++data;
+            ++index;
+        }
+    }
+}
+
+void ReadBlock(u32 addr, u32* data, u32 count) {
+    u32 index = (addr - HW::VADDR_GPU) / 4;
+
+    if ((addr & 3) != 0 || index > Regs::NumIds() || count > Regs::NumIds() - index) {
+        for (u32 i = 0; i < count; ++i)
+            Read<u32>(data[i], addr + 4 * i);
+        return;
+    }
+
+    std::memcpy(data, &g_regs[index], count * sizeof(u32));
+}
+
 /// Update hardware
 static void VBlankCallback(u64 userdata, int cycles_late) {
     frame_count++;
     last_skip_frame = g_skip_frame;
-    g_skip_frame = (frame_count & Settings::values.frame_skip) != 0;
+
+    bool dynamic_frame_skip = Settings::values.use_dynamic_frame_skip && Settings::values.frame_skip == 0;
+    if (vblank_overridden) {
+        g_skip_frame = override_skip_next;
+    } else if (dynamic_frame_skip) {
+        g_skip_frame = FrameLimiter::ShouldSkipFrame();
+    } else {
+        g_skip_frame = (frame_count & Settings::values.frame_skip) != 0;
+    }
+
+    // Finish the frame's rendering before presenting it
+    GPUThread::Synchronize();
 
     // Swap buffers based on the frameskip mode, which is a little bit tricky. When
     // a frame is being skipped, nothing is being rendered to the internal framebuffer(s).
@@ -364,31 +387,56 @@ static void VBlankCallback(u64 userdata, int cycles_late) {
     //  - If frameskip == 0 (disabled), always swap buffers
     //  - If frameskip == 1, swap buffers every other frame (starting from the first frame)
     //  - If frameskip > 1, swap buffers every frameskip^n frames (starting from the second frame)
-    if ((((Settings::values.frame_skip != 1) ^ last_skip_frame) && last_skip_frame != g_skip_frame) ||
+    //  - With dynamic frameskip, swap buffers whenever the last frame was rendered
+    //  - With an override, swap buffers when told to
+    if (vblank_overridden) {
+        if (override_present)
+            VideoCore::g_renderer->SwapBuffers();
+    } else if (dynamic_frame_skip) {
+        if (!last_skip_frame)
+            VideoCore::g_renderer->SwapBuffers();
+    } else if ((((Settings::values.frame_skip != 1) ^ last_skip_frame) && last_skip_frame != g_skip_frame) ||
             Settings::values.frame_skip == 0) {
         VideoCore::g_renderer->SwapBuffers();
     }
 
+    // Hidden frames run as fast as possible, the shown ones make up for them
+    if (!vblank_overridden || override_present)
+        FrameLimiter::DoFrameLimiting();
+
     // Signal to GSP that GPU interrupt has occurred
     // TODO(yuriks): hwtest to determine if PDC0 is for the Top screen and PDC1 for the Sub
     // screen, or if both use the same interrupts and these two instead determine the
     // beginning and end of the VBlank period. If needed, split the interrupt firing into
     // two different intervals.
+    GSP_GPU::BeginInterruptBatch();
     GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC0);
     GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC1);
+    GSP_GPU::EndInterruptBatch();
 
     // TODO(bunnei): Fake a DSP interrupt on each frame. This does not belong here, but
     // until we can emulate DSP interrupts, this is probably the only reasonable place to do
     // this. Certain games expect this to be periodically signaled.
     DSP_DSP::SignalInterrupt();
 
-    // Check for user input updates
-    Service::HID::Update();
-
     // Reschedule recurrent event
     CoreTiming::ScheduleEvent(frame_ticks - cycles_late, vblank_event);
 }
 
+u64 GetFrameCount() {
+    return frame_count;
+}
+
+void OverrideVBlank(bool present, bool skip_next) {
+    vblank_overridden = true;
+    override_present = present;
+    override_skip_next = skip_next;
+}
+
+void ClearVBlankOverride() {
+    vblank_overridden = false;
+}
+
 /// Initialize hardware
 void Init() {
     memset(&g_regs, 0, sizeof(g_regs));
@@ -423,6 +471,8 @@ void Init() {
     g_skip_frame = false;
     frame_count = 0;
 
+    FrameLimiter::Init();
+
     vblank_event = CoreTiming::RegisterEvent("GPU::VBlankCallback", VBlankCallback);
     CoreTiming::ScheduleEvent(frame_ticks, vblank_event);
 
@@ -434,4 +484,13 @@ void Shutdown() {
     LOG_DEBUG(HW_GPU, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    auto s = p.Section("GPU", 1);
+    if (!s)
+        return;
+
+    p.DoVoid(&g_regs, sizeof(g_regs));
+    p.Do(frame_count);
+}
+
 } // namespace
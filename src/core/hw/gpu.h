@@ -12,6 +12,8 @@
 #include "common/common_funcs.h"
 #include "common/common_types.h"
 
+class PointerWrap;
+
 namespace GPU {
 
 // Returns index corresponding to the Regs member labeled by field_name
@@ -298,11 +300,40 @@ void Read(T &var, const u32 addr);
 template <typename T>
 void Write(u32 addr, const T data);
 
+/**
+ * Writes a block of consecutive registers. Registers without side effects are copied in bulk,
+ * only the ones which trigger an operation are dispatched through Write.
+ * @param addr Virtual address of the first register
+ * @param data Values to write
+ * @param count Number of registers to write
+ */
+void WriteBlock(u32 addr, const u32* data, u32 count);
+
+/// Reads a block of consecutive registers, starting at the given virtual address
+void ReadBlock(u32 addr, u32* data, u32 count);
+
+/// Returns the number of frames started (i.e. VBlanks signalled) since the GPU was initialized
+u64 GetFrameCount();
+
+/**
+ * Takes the decisions of the following VBlanks out of the frame skipping settings, for frames
+ * which are emulated without being shown (see RunAhead). Lasts until ClearVBlankOverride().
+ * @param present Whether the frame ending at the VBlank is presented and paced by the frame limiter
+ * @param skip_next Whether the frame starting at the VBlank is skipped instead of being rendered
+ */
+void OverrideVBlank(bool present, bool skip_next);
+
+/// Returns the VBlanks to the frame skipping settings
+void ClearVBlankOverride();
+
 /// Initialize hardware
 void Init();
 
 /// Shutdown hardware
 void Shutdown();
 
+/// Saves or restores the register state
+void DoState(PointerWrap& p);
+
 
 } // namespace
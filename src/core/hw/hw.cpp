@@ -8,65 +8,76 @@
 #include "core/hw/hw.h"
 #include "core/hw/gpu.h"
 #include "core/hw/lcd.h"
+#include "core/mem_map.h"
+#include "core/mmio.h"
+
+#include "video_core/gpu_thread.h"
 
 namespace HW {
 
+/// Forwards accesses to a device's templated Read/Write functions, as provided by `Device`
+template <typename Device>
+class DeviceRegion final : public Memory::MMIORegion {
+public:
+    u8 Read8(VAddr addr) override { return Read<u8>(addr); }
+    u16 Read16(VAddr addr) override { return Read<u16>(addr); }
+    u32 Read32(VAddr addr) override { return Read<u32>(addr); }
+    u64 Read64(VAddr addr) override { return Read<u64>(addr); }
+
+    void Write8(VAddr addr, u8 data) override { Device::Write(addr, data); }
+    void Write16(VAddr addr, u16 data) override { Device::Write(addr, data); }
+    void Write32(VAddr addr, u32 data) override { Device::Write(addr, data); }
+    void Write64(VAddr addr, u64 data) override { Device::Write(addr, data); }
+
+private:
+    template <typename T>
+    static T Read(VAddr addr) {
+        T value = 0;
+        Device::Read(value, addr);
+        return value;
+    }
+};
+
+struct GPUDevice {
+    template <typename T>
+    static void Read(T& var, u32 addr) { GPU::Read(var, addr); }
+    template <typename T>
+    static void Write(u32 addr, T data) { GPU::Write(addr, data); }
+};
+
+struct LCDDevice {
+    template <typename T>
+    static void Read(T& var, u32 addr) { LCD::Read(var, addr); }
+    template <typename T>
+    static void Write(u32 addr, T data) { LCD::Write(addr, data); }
+};
+
+static DeviceRegion<GPUDevice> gpu_region;
+static DeviceRegion<LCDDevice> lcd_region;
+
+/// Size of the GPU register block (0x1EF00000-0x1EF10000)
+static const u32 GPU_REGION_SIZE = 0x10000;
+/// Size of the LCD register block
+static const u32 LCD_REGION_SIZE = 0x1000;
+
 template <typename T>
 inline void Read(T &var, const u32 addr) {
-    switch (addr & 0xFFFFF000) {
-    case VADDR_GPU:
-    case VADDR_GPU + 0x1000:
-    case VADDR_GPU + 0x2000:
-    case VADDR_GPU + 0x3000:
-    case VADDR_GPU + 0x4000:
-    case VADDR_GPU + 0x5000:
-    case VADDR_GPU + 0x6000:
-    case VADDR_GPU + 0x7000:
-    case VADDR_GPU + 0x8000:
-    case VADDR_GPU + 0x9000:
-    case VADDR_GPU + 0xA000:
-    case VADDR_GPU + 0xB000:
-    case VADDR_GPU + 0xC000:
-    case VADDR_GPU + 0xD000:
-    case VADDR_GPU + 0xE000:
-    case VADDR_GPU + 0xF000:
-        GPU::Read(var, addr);
-        break;
-    case VADDR_LCD:
-        LCD::Read(var, addr);
-        break;
-    default:
+    Memory::MMIORegion* handler = Memory::GetMMIOHandler(Memory::VirtualToPhysicalAddress(addr));
+    if (handler == nullptr) {
         LOG_ERROR(HW_Memory, "unknown Read%lu @ 0x%08X", sizeof(var) * 8, addr);
+        return;
     }
+    Memory::ReadMMIO(handler, addr, var);
 }
 
 template <typename T>
 inline void Write(u32 addr, const T data) {
-    switch (addr & 0xFFFFF000) {
-    case VADDR_GPU:
-    case VADDR_GPU + 0x1000:
-    case VADDR_GPU + 0x2000:
-    case VADDR_GPU + 0x3000:
-    case VADDR_GPU + 0x4000:
-    case VADDR_GPU + 0x5000:
-    case VADDR_GPU + 0x6000:
-    case VADDR_GPU + 0x7000:
-    case VADDR_GPU + 0x8000:
-    case VADDR_GPU + 0x9000:
-    case VADDR_GPU + 0xA000:
-    case VADDR_GPU + 0xB000:
-    case VADDR_GPU + 0xC000:
-    case VADDR_GPU + 0xD000:
-    case VADDR_GPU + 0xE000:
-    case VADDR_GPU + 0xF000:
-        GPU::Write(addr, data);
-        break;
-    case VADDR_LCD:
-        LCD::Write(addr, data);
-        break;
-    default:
+    Memory::MMIORegion* handler = Memory::GetMMIOHandler(Memory::VirtualToPhysicalAddress(addr));
+    if (handler == nullptr) {
         LOG_ERROR(HW_Memory, "unknown Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32)data, addr);
+        return;
     }
+    Memory::WriteMMIO(handler, addr, data);
 }
 
 // Explicitly instantiate template functions because we aren't defining this in the header:
@@ -81,22 +92,61 @@ template void Write<u32>(u32 addr, const u32 data);
 template void Write<u16>(u32 addr, const u16 data);
 template void Write<u8>(u32 addr, const u8 data);
 
+/// Returns whether a block of registers lies entirely within the GPU registers
+static bool IsGPUBlock(u32 addr, u32 count) {
+    return addr >= VADDR_GPU && addr - VADDR_GPU <= GPU_REGION_SIZE &&
+           count <= (GPU_REGION_SIZE - (addr - VADDR_GPU)) / 4;
+}
+
+void WriteBlock(u32 addr, const u32* data, u32 count) {
+    if (IsGPUBlock(addr, count)) {
+        GPU::WriteBlock(addr, data, count);
+        return;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+        Write<u32>(addr + 4 * i, data[i]);
+}
+
+void ReadBlock(u32 addr, u32* data, u32 count) {
+    if (IsGPUBlock(addr, count)) {
+        GPU::ReadBlock(addr, data, count);
+        return;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+        Read<u32>(data[i], addr + 4 * i);
+}
+
 /// Update hardware
 void Update() {
+    // Signal interrupts raised by the GPU thread since the last update
+    GPUThread::DeliverInterrupts();
 }
 
 /// Initialize hardware
 void Init() {
     GPU::Init();
     LCD::Init();
+
+    Memory::RegisterMMIO(Memory::VirtualToPhysicalAddress(VADDR_GPU), GPU_REGION_SIZE, &gpu_region);
+    Memory::RegisterMMIO(Memory::VirtualToPhysicalAddress(VADDR_LCD), LCD_REGION_SIZE, &lcd_region);
     LOG_DEBUG(HW, "initialized OK");
 }
 
 /// Shutdown hardware
 void Shutdown() {
+    Memory::RegisterMMIO(Memory::VirtualToPhysicalAddress(VADDR_GPU), GPU_REGION_SIZE, nullptr);
+    Memory::RegisterMMIO(Memory::VirtualToPhysicalAddress(VADDR_LCD), LCD_REGION_SIZE, nullptr);
+
     GPU::Shutdown();
     LCD::Shutdown();
     LOG_DEBUG(HW, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    GPU::DoState(p);
+    LCD::DoState(p);
+}
+
 }
@@ -6,6 +6,8 @@
 
 #include "common/common_types.h"
 
+class PointerWrap;
+
 namespace HW {
 
 /// Beginnings of IO register regions, in the user VA space.
@@ -38,6 +40,18 @@ void Read(T &var, const u32 addr);
 template <typename T>
 void Write(u32 addr, const T data);
 
+/**
+ * Writes a block of consecutive 32-bit registers. Blocks within the GPU registers only dispatch
+ * the registers with side effects, see GPU::WriteBlock.
+ * @param addr Virtual address of the first register
+ * @param data Values to write
+ * @param count Number of registers to write
+ */
+void WriteBlock(u32 addr, const u32* data, u32 count);
+
+/// Reads a block of consecutive 32-bit registers, starting at the given virtual address
+void ReadBlock(u32 addr, u32* data, u32 count);
+
 /// Update hardware
 void Update();
 
@@ -47,4 +61,7 @@ void Init();
 /// Shutdown hardware
 void Shutdown();
 
+/// Saves or restores the state of the emulated hardware
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -4,6 +4,7 @@
 
 #include <cstring>
 
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 
@@ -75,4 +76,12 @@ void Shutdown() {
     LOG_DEBUG(HW_LCD, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    auto s = p.Section("LCD", 1);
+    if (!s)
+        return;
+
+    p.DoVoid(&g_regs, sizeof(g_regs));
+}
+
 } // namespace
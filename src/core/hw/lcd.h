@@ -11,6 +11,8 @@
 #include "common/common_funcs.h"
 #include "common/common_types.h"
 
+class PointerWrap;
+
 #define LCD_REG_INDEX(field_name) (offsetof(LCD::Regs, field_name) / sizeof(u32))
 
 namespace LCD {
@@ -87,4 +89,7 @@ void Init();
 /// Shutdown hardware
 void Shutdown();
 
+/// Saves or restores the register state
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -0,0 +1,67 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/assert.h"
+
+#include "core/hw/memory_fill.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MEMORY_FILL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace GPU {
+
+namespace MemoryFill {
+
+/// Smallest size which holds a whole number of 16-, 24- and 32-bit values as well as of 16-byte vectors
+static const size_t PATTERN_SIZE = 48;
+
+void Fill(u8* start, u8* end, const u8* value, u32 value_size, u32 phase) {
+    ASSERT(value_size >= 2 && value_size <= 4);
+
+    if (end <= start)
+        return;
+
+    u8* ptr = start;
+    size_t remaining = end - start;
+
+#ifdef MEMORY_FILL_SSE2
+    // Store the first few bytes one at a time so that the bulk of the stores is aligned
+    size_t head = std::min<size_t>((16 - reinterpret_cast<uintptr_t>(ptr) % 16) % 16, remaining);
+    for (size_t i = 0; i < head; ++i)
+        *ptr++ = value[(phase + i) % value_size];
+    phase += static_cast<u32>(head);
+    remaining -= head;
+#endif
+
+    u8 pattern[PATTERN_SIZE];
+    for (size_t i = 0; i < PATTERN_SIZE; ++i)
+        pattern[i] = value[(phase + i) % value_size];
+
+#ifdef MEMORY_FILL_SSE2
+    const __m128i pattern0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    const __m128i pattern1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 16));
+    const __m128i pattern2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 32));
+
+    for (; remaining >= PATTERN_SIZE; remaining -= PATTERN_SIZE, ptr += PATTERN_SIZE) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(ptr), pattern0);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ptr + 16), pattern1);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ptr + 32), pattern2);
+    }
+#else
+    for (; remaining >= PATTERN_SIZE; remaining -= PATTERN_SIZE, ptr += PATTERN_SIZE)
+        std::memcpy(ptr, pattern, PATTERN_SIZE);
+#endif
+
+    // The tail continues the pattern from its start, since whole patterns have been stored so far
+    std::memcpy(ptr, pattern, remaining);
+}
+
+} // namespace
+
+} // namespace
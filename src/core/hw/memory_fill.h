@@ -0,0 +1,25 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace GPU {
+
+namespace MemoryFill {
+
+/**
+ * Fills a memory region with a repeating 16-, 24- or 32-bit value using wide stores.
+ * @param start Pointer to the first byte to fill
+ * @param end Pointer past the last byte to fill
+ * @param value Bytes of a single fill value as they are stored in memory
+ * @param value_size Number of bytes in the fill value (2, 3 or 4)
+ * @param phase Index of the value byte stored at `start`, used when filling a part of a larger fill
+ */
+void Fill(u8* start, u8* end, const u8* value, u32 value_size, u32 phase = 0);
+
+} // namespace
+
+} // namespace
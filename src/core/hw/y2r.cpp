@@ -5,7 +5,7 @@
 #include <algorithm>
 #include <array>
 #include <cstddef>
-#include <memory>
+#include <cstring>
 
 #include "common/assert.h"
 #include "common/color.h"
@@ -17,6 +17,11 @@
 #include "core/hw/y2r.h"
 #include "core/memory.h"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define Y2R_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace HW {
 namespace Y2R {
 
@@ -26,43 +31,162 @@ static const size_t MAX_TILES = 1024 / 8;
 static const size_t TILE_SIZE = 8 * 8;
 using ImageTile = std::array<u32, TILE_SIZE>;
 
+// Scratch buffers are sized for the largest strip and kept between conversions, since video
+// playback converts a frame every few milliseconds.
+
+/// Buffer used as a CDMA source/target, holding one strip of 4 bytes per pixel at most.
+static std::array<u32, MAX_TILES * TILE_SIZE> data_buffer;
+/// Intermediate storage for decoded 8x8 image tiles. Always stored as RGB32.
+static std::array<ImageTile, MAX_TILES> tiles;
+/// Output of the final format conversion, before it's split into transfer units.
+static std::array<u8, MAX_TILES * TILE_SIZE * 4> send_buffer;
+
+/// Reads the YUV components of a single pixel from the strip's input buffers.
+template <InputFormat input_format>
+static void LoadYUV(const u8* input_Y, const u8* input_U, const u8* input_V,
+        unsigned int width, unsigned int x, unsigned int y, s32& Y, s32& U, s32& V) {
+
+    switch (input_format) {
+    case InputFormat::YUV422_Indiv8:
+    case InputFormat::YUV422_Indiv16:
+        Y = input_Y[y * width + x];
+        U = input_U[(y * width + x) / 2];
+        V = input_V[(y * width + x) / 2];
+        break;
+    case InputFormat::YUV420_Indiv8:
+    case InputFormat::YUV420_Indiv16:
+        Y = input_Y[y * width + x];
+        U = input_U[((y / 2) * width + x) / 2];
+        V = input_V[((y / 2) * width + x) / 2];
+        break;
+    case InputFormat::YUYV422_Interleaved:
+        Y = input_Y[(y * width + x) * 2];
+        U = input_Y[(y * width + (x / 2) * 2) * 2 + 1];
+        V = input_Y[(y * width + (x / 2) * 2) * 2 + 3];
+        break;
+    }
+}
+
+#ifdef Y2R_SSE2
+
+/// Reads the YUV components of 8 horizontally adjacent pixels, as 16-bit lanes.
+template <InputFormat input_format>
+static void LoadYUV8(const u8* input_Y, const u8* input_U, const u8* input_V,
+        unsigned int width, unsigned int x, unsigned int y, __m128i& Y, __m128i& U, __m128i& V) {
+
+    const __m128i zero = _mm_setzero_si128();
+
+    switch (input_format) {
+    case InputFormat::YUV422_Indiv8:
+    case InputFormat::YUV422_Indiv16:
+    case InputFormat::YUV420_Indiv8:
+    case InputFormat::YUV420_Indiv16:
+    {
+        // 16-bit formats have already been narrowed to 8 bits when receiving the data
+        bool is_420 = input_format == InputFormat::YUV420_Indiv8 || input_format == InputFormat::YUV420_Indiv16;
+        unsigned int chroma_offset = ((is_420 ? y / 2 : y) * width + x) / 2;
+
+        s32 raw_U, raw_V;
+        std::memcpy(&raw_U, input_U + chroma_offset, sizeof(s32));
+        std::memcpy(&raw_V, input_V + chroma_offset, sizeof(s32));
+
+        Y = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input_Y + y * width + x)), zero);
+
+        // Each chroma sample covers two pixels
+        __m128i U8 = _mm_cvtsi32_si128(raw_U);
+        __m128i V8 = _mm_cvtsi32_si128(raw_V);
+        U = _mm_unpacklo_epi8(_mm_unpacklo_epi8(U8, U8), zero);
+        V = _mm_unpacklo_epi8(_mm_unpacklo_epi8(V8, V8), zero);
+        break;
+    }
+    case InputFormat::YUYV422_Interleaved:
+    {
+        // Y0 U0 Y1 V0 Y2 U1 Y3 V1 ...
+        __m128i YUYV = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_Y + (y * width + x) * 2));
+        Y = _mm_and_si128(YUYV, _mm_set1_epi16(0xFF));
+
+        __m128i UV = _mm_srli_epi16(YUYV, 8);
+        U = _mm_shufflehi_epi16(_mm_shufflelo_epi16(UV, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        V = _mm_shufflehi_epi16(_mm_shufflelo_epi16(UV, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        break;
+    }
+    }
+}
+
+/// Applies the final bias, rounding and scaling to 4 lanes of a color component
+static __m128i FinishComponent(__m128i value, s32 bias) {
+    return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(value, 3), _mm_set1_epi32(bias)), 5);
+}
+
+/// Packs two sets of 4 lanes of a color component into 8 bytes, clamping them to [0, 255]
+static __m128i PackComponent(__m128i lo, __m128i hi) {
+    __m128i packed = _mm_packs_epi32(lo, hi);
+    return _mm_packus_epi16(packed, packed);
+}
+
+#endif // Y2R_SSE2
+
 /// Converts a image strip from the source YUV format into individual 8x8 RGB32 tiles.
-static void ConvertYUVToRGB(InputFormat input_format,
-        const u8* input_Y, const u8* input_U, const u8* input_V, ImageTile output[],
+template <InputFormat input_format>
+static void ConvertYUVToRGB(const u8* input_Y, const u8* input_U, const u8* input_V, ImageTile output[],
         unsigned int width, unsigned int height, const CoefficientSet& coefficients) {
 
+    auto& c = coefficients;
+    const s32 rounding_offset = 0x18;
+
+#ifdef Y2R_SSE2
+    // Same computation as below, for one tile row at a time. Pairs of 16-bit components are
+    // multiplied by pairs of coefficients and summed into 32 bits, which is exact for these ranges.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coef_Y_V = _mm_set_epi16(c[1], c[0], c[1], c[0], c[1], c[0], c[1], c[0]);
+    const __m128i coef_Y_U = _mm_set_epi16(c[4], c[0], c[4], c[0], c[4], c[0], c[4], c[0]);
+    const __m128i coef_Y = _mm_set_epi16(0, c[0], 0, c[0], 0, c[0], 0, c[0]);
+    const __m128i coef_U_V = _mm_set_epi16(c[2], c[3], c[2], c[3], c[2], c[3], c[2], c[3]);
+
+    for (unsigned int y = 0; y < height; ++y) {
+        for (unsigned int x = 0; x < width; x += 8) {
+            __m128i Y, U, V;
+            LoadYUV8<input_format>(input_Y, input_U, input_V, width, x, y, Y, U, V);
+
+            __m128i YV_lo = _mm_unpacklo_epi16(Y, V), YV_hi = _mm_unpackhi_epi16(Y, V);
+            __m128i YU_lo = _mm_unpacklo_epi16(Y, U), YU_hi = _mm_unpackhi_epi16(Y, U);
+            __m128i UV_lo = _mm_unpacklo_epi16(U, V), UV_hi = _mm_unpackhi_epi16(U, V);
+            __m128i Y_lo = _mm_unpacklo_epi16(Y, zero), Y_hi = _mm_unpackhi_epi16(Y, zero);
+
+            __m128i r_lo = _mm_madd_epi16(YV_lo, coef_Y_V), r_hi = _mm_madd_epi16(YV_hi, coef_Y_V);
+            __m128i b_lo = _mm_madd_epi16(YU_lo, coef_Y_U), b_hi = _mm_madd_epi16(YU_hi, coef_Y_U);
+            __m128i g_lo = _mm_sub_epi32(_mm_madd_epi16(Y_lo, coef_Y), _mm_madd_epi16(UV_lo, coef_U_V));
+            __m128i g_hi = _mm_sub_epi32(_mm_madd_epi16(Y_hi, coef_Y), _mm_madd_epi16(UV_hi, coef_U_V));
+
+            __m128i r = PackComponent(FinishComponent(r_lo, c[5] + rounding_offset),
+                                      FinishComponent(r_hi, c[5] + rounding_offset));
+            __m128i g = PackComponent(FinishComponent(g_lo, c[6] + rounding_offset),
+                                      FinishComponent(g_hi, c[6] + rounding_offset));
+            __m128i b = PackComponent(FinishComponent(b_lo, c[7] + rounding_offset),
+                                      FinishComponent(b_hi, c[7] + rounding_offset));
+
+            // Assemble (r << 24) | (g << 16) | (b << 8)
+            __m128i b_shifted = _mm_unpacklo_epi8(zero, b);
+            __m128i gr = _mm_unpacklo_epi8(g, r);
+
+            __m128i* out = reinterpret_cast<__m128i*>(&output[x / 8][y * 8]);
+            _mm_storeu_si128(out, _mm_unpacklo_epi16(b_shifted, gr));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(b_shifted, gr));
+        }
+    }
+#else
     for (unsigned int y = 0; y < height; ++y) {
         for (unsigned int x = 0; x < width; ++x) {
             s32 Y, U, V;
-            switch (input_format) {
-            case InputFormat::YUV422_Indiv8:
-            case InputFormat::YUV422_Indiv16:
-                Y = input_Y[y * width + x];
-                U = input_U[(y * width + x) / 2];
-                V = input_V[(y * width + x) / 2];
-                break;
-            case InputFormat::YUV420_Indiv8:
-            case InputFormat::YUV420_Indiv16:
-                Y = input_Y[y * width + x];
-                U = input_U[((y / 2) * width + x) / 2];
-                V = input_V[((y / 2) * width + x) / 2];
-                break;
-            case InputFormat::YUYV422_Interleaved:
-                Y = input_Y[(y * width + x) * 2];
-                U = input_Y[(y * width + (x / 2) * 2) * 2 + 1];
-                V = input_Y[(y * width + (x / 2) * 2) * 2 + 3];
-                break;
-            }
+            LoadYUV<input_format>(input_Y, input_U, input_V, width, x, y, Y, U, V);
 
             // This conversion process is bit-exact with hardware, as far as could be tested.
-            auto& c = coefficients;
             s32 cY = c[0]*Y;
 
             s32 r = cY          + c[1]*V;
             s32 g = cY - c[3]*U - c[2]*V;
             s32 b = cY + c[4]*U;
 
-            const s32 rounding_offset = 0x18;
             r = (r >> 3) + c[5] + rounding_offset;
             g = (g >> 3) + c[6] + rounding_offset;
             b = (b >> 3) + c[7] + rounding_offset;
@@ -77,23 +201,45 @@ static void ConvertYUVToRGB(InputFormat input_format,
                    ((u32)Clamp(b >> 5, 0, 0xFF) << 8);
         }
     }
+#endif
+}
+
+using ConvertFunc = void (*)(const u8*, const u8*, const u8*, ImageTile[], unsigned int, unsigned int, const CoefficientSet&);
+
+static ConvertFunc GetConvertFunc(InputFormat input_format) {
+    switch (input_format) {
+    case InputFormat::YUV422_Indiv8:       return ConvertYUVToRGB<InputFormat::YUV422_Indiv8>;
+    case InputFormat::YUV420_Indiv8:       return ConvertYUVToRGB<InputFormat::YUV420_Indiv8>;
+    case InputFormat::YUV422_Indiv16:      return ConvertYUVToRGB<InputFormat::YUV422_Indiv16>;
+    case InputFormat::YUV420_Indiv16:      return ConvertYUVToRGB<InputFormat::YUV420_Indiv16>;
+    case InputFormat::YUYV422_Interleaved: return ConvertYUVToRGB<InputFormat::YUYV422_Interleaved>;
+    }
+    UNREACHABLE();
 }
 
 /// Simulates an incoming CDMA transfer. The N parameter is used to automatically convert 16-bit formats to 8-bit.
 template <size_t N>
 static void ReceiveData(u8* output, ConversionBuffer& buf, size_t amount_of_data) {
-    const u8* input = Memory::GetPointer(buf.address);
-
     size_t output_unit = buf.transfer_unit / N;
     ASSERT(amount_of_data % output_unit == 0);
 
     while (amount_of_data > 0) {
-        for (size_t i = 0; i < output_unit; ++i) {
-            output[i] = input[i * N];
+        if (N == 1) {
+            Memory::ReadBlock(buf.address, output, output_unit);
+        } else {
+            // Read the unit in chunks and keep the low byte of each sample
+            std::array<u8, 256 * N> chunk;
+            for (size_t done = 0; done < output_unit;) {
+                size_t count = std::min(output_unit - done, chunk.size() / N);
+                Memory::ReadBlock(static_cast<VAddr>(buf.address + done * N), chunk.data(), count * N);
+                for (size_t i = 0; i < count; ++i) {
+                    output[done + i] = chunk[i * N];
+                }
+                done += count;
+            }
         }
 
         output += output_unit;
-        input += buf.transfer_unit + buf.gap;
 
         buf.address += buf.transfer_unit + buf.gap;
         buf.image_size -= buf.transfer_unit;
@@ -102,47 +248,64 @@ static void ReceiveData(u8* output, ConversionBuffer& buf, size_t amount_of_data
 }
 
 /// Convert intermediate RGB32 format to the final output format while simulating an outgoing CDMA transfer.
-static void SendData(const u32* input, ConversionBuffer& buf, int amount_of_data,
-        OutputFormat output_format, u8 alpha) {
-
-    u8* output = Memory::GetPointer(buf.address);
-
-    while (amount_of_data > 0) {
-        u8* unit_end = output + buf.transfer_unit;
-        while (output < unit_end) {
-            u32 color = *input++;
-            Math::Vec4<u8> col_vec{
-                (u8)(color >> 24), (u8)(color >> 16), (u8)(color >> 8), alpha
-            };
-
-            switch (output_format) {
-            case OutputFormat::RGBA8:
-                Color::EncodeRGBA8(col_vec, output);
-                output += 4;
-                break;
-            case OutputFormat::RGB8:
-                Color::EncodeRGB8(col_vec, output);
-                output += 3;
-                break;
-            case OutputFormat::RGB5A1:
-                Color::EncodeRGB5A1(col_vec, output);
-                output += 2;
-                break;
-            case OutputFormat::RGB565:
-                Color::EncodeRGB565(col_vec, output);
-                output += 2;
-                break;
-            }
-
-            amount_of_data -= 1;
+template <OutputFormat output_format>
+static void SendData(const u32* input, ConversionBuffer& buf, int amount_of_data, u8 alpha) {
+    // Encode the pixels contiguously, then write them out one transfer unit at a time
+    u8* output = send_buffer.data();
+    for (int i = 0; i < amount_of_data; ++i) {
+        u32 color = *input++;
+
+        switch (output_format) {
+        case OutputFormat::RGBA8:
+        {
+            // The intermediate format already has RGBA8's layout, minus the alpha
+            u32_le value = color | alpha;
+            std::memcpy(output, &value, sizeof(value));
+            output += 4;
+            break;
+        }
+        case OutputFormat::RGB8:
+            output[0] = (u8)(color >> 8);
+            output[1] = (u8)(color >> 16);
+            output[2] = (u8)(color >> 24);
+            output += 3;
+            break;
+        case OutputFormat::RGB5A1:
+            Color::EncodeRGB5A1({ (u8)(color >> 24), (u8)(color >> 16), (u8)(color >> 8), alpha }, output);
+            output += 2;
+            break;
+        case OutputFormat::RGB565:
+            Color::EncodeRGB565({ (u8)(color >> 24), (u8)(color >> 16), (u8)(color >> 8), alpha }, output);
+            output += 2;
+            break;
         }
+    }
 
-        output += buf.gap;
+    const u8* data = send_buffer.data();
+    size_t remaining = output - send_buffer.data();
+    while (remaining > 0) {
+        size_t amount = std::min<size_t>(buf.transfer_unit, remaining);
+        Memory::WriteBlock(buf.address, data, amount);
+
+        data += amount;
+        remaining -= amount;
         buf.address += buf.transfer_unit + buf.gap;
         buf.image_size -= buf.transfer_unit;
     }
 }
 
+using SendFunc = void (*)(const u32*, ConversionBuffer&, int, u8);
+
+static SendFunc GetSendFunc(OutputFormat output_format) {
+    switch (output_format) {
+    case OutputFormat::RGBA8:  return SendData<OutputFormat::RGBA8>;
+    case OutputFormat::RGB8:   return SendData<OutputFormat::RGB8>;
+    case OutputFormat::RGB5A1: return SendData<OutputFormat::RGB5A1>;
+    case OutputFormat::RGB565: return SendData<OutputFormat::RGB565>;
+    }
+    UNREACHABLE();
+}
+
 static const u8 linear_lut[64] = {
      0,  1,  2,  3,  4,  5,  6,  7,
      8,  9, 10, 11, 12, 13, 14, 15,
@@ -261,12 +424,12 @@ void PerformConversion(ConversionConfiguration& cvt) {
     size_t num_tiles = cvt.input_line_width / 8;
     ASSERT(num_tiles < MAX_TILES);
 
-    // Buffer used as a CDMA source/target.
-    std::unique_ptr<u8[]> data_buffer(new u8[cvt.input_line_width * 8 * 4]);
-    // Intermediate storage for decoded 8x8 image tiles. Always stored as RGB32.
-    std::unique_ptr<ImageTile[]> tiles(new ImageTile[num_tiles]);
     ImageTile tmp_tile;
 
+    // Formats are dispatched once per conversion rather than once per pixel
+    ConvertFunc convert = GetConvertFunc(cvt.input_format);
+    SendFunc send = GetSendFunc(cvt.output_format);
+
     // LUT used to remap writes to a tile. Used to allow linear or swizzled output without
     // requiring two different code paths.
     const u8* tile_remap;
@@ -283,7 +446,7 @@ void PerformConversion(ConversionConfiguration& cvt) {
         // Total size in pixels of incoming data required for this strip.
         const size_t row_data_size = row_height * cvt.input_line_width;
 
-        u8* input_Y = data_buffer.get();
+        u8* input_Y = reinterpret_cast<u8*>(data_buffer.data());
         u8* input_U = input_Y + 8 * cvt.input_line_width;
         u8* input_V = input_U + 8 * cvt.input_line_width / 2;
 
@@ -315,12 +478,9 @@ void PerformConversion(ConversionConfiguration& cvt) {
             break;
         }
 
-        // Note(yuriks): If additional optimization is required, input_format can be moved to a
-        // template parameter, so that its dispatch can be moved to outside the inner loop.
-        ConvertYUVToRGB(cvt.input_format, input_Y, input_U, input_V, tiles.get(),
-                cvt.input_line_width, row_height, cvt.coefficients);
+        convert(input_Y, input_U, input_V, tiles.data(), cvt.input_line_width, row_height, cvt.coefficients);
 
-        u32* output_buffer = reinterpret_cast<u32*>(data_buffer.get());
+        u32* output_buffer = data_buffer.data();
 
         for (int i = 0; i < num_tiles; ++i) {
             int image_strip_width, output_stride;
@@ -362,9 +522,7 @@ void PerformConversion(ConversionConfiguration& cvt) {
             }
         }
 
-        // Note(yuriks): If additional optimization is required, output_format can be moved to a
-        // template parameter, so that its dispatch can be moved to outside the inner loop.
-        SendData(reinterpret_cast<u32*>(data_buffer.get()), cvt.dst, (int)row_data_size, cvt.output_format, (u8)cvt.alpha);
+        send(data_buffer.data(), cvt.dst, (int)row_data_size, (u8)cvt.alpha);
     }
 }
 
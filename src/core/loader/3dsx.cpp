@@ -3,6 +3,8 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <functional>
+#include <thread>
 #include <vector>
 
 #include "common/logging/log.h"
@@ -47,7 +49,6 @@ enum THREEDSX_Error {
     ERROR_ALLOC = 3
 };
 
-static const u32 RELOCBUFSIZE = 512;
 static const unsigned int NUM_SEGMENTS = 3;
 
 // File header
@@ -101,6 +102,70 @@ static u32 TranslateAddr(u32 addr, const THREEloadinfo *loadinfo, u32* offsets)
     return loadinfo->seg_addrs[2] + addr - offsets[1];
 }
 
+/// Consecutive words of the image which are patched by the same relocation table
+struct RelocationRun {
+    /// Index of the first word in the image
+    u32 start;
+    u32 count;
+    /// Whether the words are patched with relative instead of absolute addresses
+    bool relative;
+};
+
+/// Runs with fewer words in total than this are patched on the loading thread alone
+static const u32 MIN_PARALLEL_RELOCATIONS = 0x10000;
+
+/// Patches the words of the given runs of the image
+static void ApplyRelocationRuns(const RelocationRun* begin, const RelocationRun* end, std::vector<u8>& program_image,
+                                const THREEloadinfo& loadinfo, u32* offsets) {
+    u32* words = reinterpret_cast<u32*>(program_image.data());
+    for (const RelocationRun* run = begin; run != end; ++run) {
+        for (u32 pos = run->start; pos < run->start + run->count; ++pos) {
+            u32 addr = TranslateAddr(words[pos], &loadinfo, offsets);
+            u32 in_addr = pos * 4;
+            words[pos] = run->relative ? static_cast<u32>(addr - in_addr) : addr;
+        }
+    }
+}
+
+/**
+ * Patches the words of all runs. Each word is patched by a single relocation, so the runs are
+ * split into chunks of about the same number of words, which are patched by separate threads.
+ */
+static void ApplyRelocations(const std::vector<RelocationRun>& runs, std::vector<u8>& program_image,
+                             const THREEloadinfo& loadinfo, u32* offsets) {
+    u64 total_words = 0;
+    for (const RelocationRun& run : runs)
+        total_words += run.count;
+
+    const unsigned num_threads = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+    if (num_threads == 1 || total_words < MIN_PARALLEL_RELOCATIONS) {
+        ApplyRelocationRuns(runs.data(), runs.data() + runs.size(), program_image, loadinfo, offsets);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    const u64 words_per_chunk = (total_words + num_threads - 1) / num_threads;
+    const RelocationRun* chunk_begin = runs.data();
+    const RelocationRun* const runs_end = runs.data() + runs.size();
+    while (chunk_begin != runs_end) {
+        const RelocationRun* chunk_end = chunk_begin;
+        u64 chunk_words = 0;
+        while (chunk_end != runs_end && chunk_words < words_per_chunk)
+            chunk_words += (chunk_end++)->count;
+
+        // The last chunk is patched by the loading thread itself
+        if (chunk_end == runs_end)
+            ApplyRelocationRuns(chunk_begin, chunk_end, program_image, loadinfo, offsets);
+        else
+            workers.emplace_back(ApplyRelocationRuns, chunk_begin, chunk_end, std::ref(program_image),
+                                 std::cref(loadinfo), offsets);
+        chunk_begin = chunk_end;
+    }
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
 using Kernel::SharedPtr;
 using Kernel::CodeSet;
 
@@ -123,7 +188,11 @@ static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr, Shared
     loadinfo.seg_sizes[2] = (hdr.data_seg_size + 0xFFF) &~0xFFF;
     u32 offsets[2] = { loadinfo.seg_sizes[0], loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] };
     u32 n_reloc_tables = hdr.reloc_hdr_size / sizeof(u32);
-    std::vector<u8> program_image(loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] + loadinfo.seg_sizes[2]);
+
+    // The segments are read straight into the memory of the CodeSet
+    SharedPtr<CodeSet> code_set = CodeSet::Create("", 0);
+    code_set->memory = std::make_shared<std::vector<u8>>(loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] + loadinfo.seg_sizes[2]);
+    std::vector<u8>& program_image = *code_set->memory;
 
     loadinfo.seg_addrs[0] = base_addr;
     loadinfo.seg_addrs[1] = loadinfo.seg_addrs[0] + loadinfo.seg_sizes[0];
@@ -154,8 +223,13 @@ static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr, Shared
     // BSS clear
     memset((char*)loadinfo.seg_ptrs[2] + hdr.data_seg_size - hdr.bss_size, 0, hdr.bss_size);
 
-    // Relocate the segments
+    // Relocate the segments. The tables are decoded into runs of words first, which is cheap, and
+    // the runs are then patched in parallel.
+    std::vector<RelocationRun> runs;
     for (unsigned int current_segment = 0; current_segment < NUM_SEGMENTS; ++current_segment) {
+        u32 pos = static_cast<u32>(loadinfo.seg_ptrs[current_segment] - program_image.data()) / 4;
+        const u32 end_pos = pos + (loadinfo.seg_sizes[current_segment] / 4);
+
         for (unsigned current_segment_reloc_table = 0; current_segment_reloc_table < n_reloc_tables; current_segment_reloc_table++) {
             u32 n_relocs = relocs[current_segment * n_reloc_tables + current_segment_reloc_table];
             if (current_segment_reloc_table >= 2) {
@@ -163,50 +237,28 @@ static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr, Shared
                 file.Seek(n_relocs*sizeof(THREEDSX_Reloc), SEEK_CUR);
                 continue;
             }
-            THREEDSX_Reloc reloc_table[RELOCBUFSIZE];
-
-            u32* pos = (u32*)loadinfo.seg_ptrs[current_segment];
-            const u32* end_pos = pos + (loadinfo.seg_sizes[current_segment] / 4);
-
-            while (n_relocs) {
-                u32 remaining = std::min(RELOCBUFSIZE, n_relocs);
-                n_relocs -= remaining;
-
-                if (file.ReadBytes(reloc_table, remaining * sizeof(THREEDSX_Reloc)) != remaining * sizeof(THREEDSX_Reloc))
-                    return ERROR_READ;
-
-                for (unsigned current_inprogress = 0; current_inprogress < remaining && pos < end_pos; current_inprogress++) {
-                    const auto& table = reloc_table[current_inprogress];
-                    LOG_TRACE(Loader, "(t=%d,skip=%u,patch=%u)\n", current_segment_reloc_table,
-                              (u32)table.skip, (u32)table.patch);
-                    pos += table.skip;
-                    s32 num_patches = table.patch;
-                    while (0 < num_patches && pos < end_pos) {
-                        u32 in_addr = (u8*)pos - program_image.data();
-                        u32 addr = TranslateAddr(*pos, &loadinfo, offsets);
-                        LOG_TRACE(Loader, "Patching %08X <-- rel(%08X,%d) (%08X)\n",
-                                  base_addr + in_addr, addr, current_segment_reloc_table, *pos);
-                        switch (current_segment_reloc_table) {
-                        case 0:
-                            *pos = (addr);
-                            break;
-                        case 1:
-                            *pos = static_cast<u32>(addr - in_addr);
-                            break;
-                        default:
-                            break; //this should never happen
-                        }
-                        pos++;
-                        num_patches--;
-                    }
-                }
+
+            std::vector<THREEDSX_Reloc> reloc_table(n_relocs);
+            if (file.ReadBytes(reloc_table.data(), n_relocs * sizeof(THREEDSX_Reloc)) != n_relocs * sizeof(THREEDSX_Reloc))
+                return ERROR_READ;
+
+            // Each table starts patching from the beginning of its segment
+            u32 table_pos = pos;
+            for (const THREEDSX_Reloc& table : reloc_table) {
+                if (table_pos >= end_pos)
+                    break;
+                table_pos = std::min(table_pos + table.skip, end_pos);
+                u32 num_patches = std::min<u32>(table.patch, end_pos - table_pos);
+                if (num_patches != 0)
+                    runs.push_back({ table_pos, num_patches, current_segment_reloc_table == 1 });
+                table_pos += num_patches;
             }
         }
     }
 
-    // Create the CodeSet
-    SharedPtr<CodeSet> code_set = CodeSet::Create("", 0);
+    ApplyRelocations(runs, program_image, loadinfo, offsets);
 
+    // Fill in the CodeSet
     code_set->code.offset = loadinfo.seg_ptrs[0] - program_image.data();
     code_set->code.addr   = loadinfo.seg_addrs[0];
     code_set->code.size   = loadinfo.seg_sizes[0];
@@ -220,7 +272,6 @@ static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr, Shared
     code_set->data.size   = loadinfo.seg_sizes[2];
 
     code_set->entrypoint = code_set->code.addr;
-    code_set->memory = std::make_shared<std::vector<u8>>(std::move(program_image));
 
     LOG_DEBUG(Loader, "code size:   0x%X", loadinfo.seg_sizes[0]);
     LOG_DEBUG(Loader, "rodata size: 0x%X", loadinfo.seg_sizes[1]);
@@ -2,9 +2,11 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "common/common_types.h"
 #include "common/file_util.h"
@@ -179,51 +181,51 @@ struct Elf32_Rel {
 
 typedef int SectionID;
 
+/**
+ * Reads an ELF from an open file. Only the headers are read up front: segments are read straight
+ * into the memory of the CodeSet, and sections only when they are needed, so that large sections
+ * that aren't loaded (e.g. debug info) are never read.
+ */
 class ElfReader {
 private:
-    char *base;
-    u32 *base32;
+    FileUtil::IOFile& file;
 
-    Elf32_Ehdr *header;
-    Elf32_Phdr *segments;
-    Elf32_Shdr *sections;
+    Elf32_Ehdr header;
+    std::vector<Elf32_Phdr> segments;
+    std::vector<Elf32_Shdr> sections;
+    /// Contents of the section holding the section names
+    std::vector<char> section_names;
 
-    u32 *sectionAddrs;
+    bool valid;
     bool relocate;
     u32 entryPoint;
 
+    /// Reads `size` bytes at `offset` of the file
+    bool ReadAt(u32 offset, void* dest, size_t size) {
+        return file.Seek(offset, SEEK_SET) && file.ReadBytes(dest, size) == size;
+    }
+
 public:
-    ElfReader(void *ptr);
+    ElfReader(FileUtil::IOFile& file);
 
-    u32 Read32(int off) const { return base32[off >> 2]; }
+    bool IsValid() const { return valid; }
 
     // Quick accessors
-    ElfType GetType() const { return (ElfType)(header->e_type); }
-    ElfMachine GetMachine() const { return (ElfMachine)(header->e_machine); }
+    ElfType GetType() const { return (ElfType)(header.e_type); }
+    ElfMachine GetMachine() const { return (ElfMachine)(header.e_machine); }
     u32 GetEntryPoint() const { return entryPoint; }
-    u32 GetFlags() const { return (u32)(header->e_flags); }
+    u32 GetFlags() const { return (u32)(header.e_flags); }
     SharedPtr<CodeSet> LoadInto(u32 vaddr);
     bool LoadSymbols();
 
-    int GetNumSegments() const { return (int)(header->e_phnum); }
-    int GetNumSections() const { return (int)(header->e_shnum); }
-    const u8 *GetPtr(int offset) const { return (u8*)base + offset; }
+    int GetNumSegments() const { return (int)(header.e_phnum); }
+    int GetNumSections() const { return (int)(header.e_shnum); }
     const char *GetSectionName(int section) const;
-    const u8 *GetSectionDataPtr(int section) const {
-        if (section < 0 || section >= header->e_shnum)
-            return nullptr;
-        if (sections[section].sh_type != SHT_NOBITS)
-            return GetPtr(sections[section].sh_offset);
-        else
-            return nullptr;
-    }
+    /// Reads the contents of a section, returns an empty vector if it has none
+    std::vector<u8> ReadSectionData(int section);
     bool IsCodeSection(int section) const {
         return sections[section].sh_type == SHT_PROGBITS;
     }
-    const u8 *GetSegmentPtr(int segment) {
-        return GetPtr(segments[segment].p_offset);
-    }
-    u32 GetSectionAddr(SectionID section) const { return sectionAddrs[section]; }
     unsigned int GetSectionSize(SectionID section) const { return sections[section].sh_size; }
     SectionID GetSectionByName(const char *name, int firstSection = 0) const; //-1 for not found
 
@@ -232,37 +234,58 @@ public:
     }
 };
 
-ElfReader::ElfReader(void *ptr) {
-    base = (char*)ptr;
-    base32 = (u32*)ptr;
-    header = (Elf32_Ehdr*)ptr;
+ElfReader::ElfReader(FileUtil::IOFile& file) : file(file), valid(false), relocate(false) {
+    if (!ReadAt(0, &header, sizeof(header)))
+        return;
+
+    segments.resize(header.e_phnum);
+    if (!segments.empty() && !ReadAt(header.e_phoff, segments.data(), segments.size() * sizeof(Elf32_Phdr)))
+        return;
 
-    segments = (Elf32_Phdr*)(base + header->e_phoff);
-    sections = (Elf32_Shdr*)(base + header->e_shoff);
+    sections.resize(header.e_shnum);
+    if (!sections.empty() && !ReadAt(header.e_shoff, sections.data(), sections.size() * sizeof(Elf32_Shdr)))
+        return;
 
-    entryPoint = header->e_entry;
+    if (header.e_shstrndx < sections.size()) {
+        std::vector<u8> names = ReadSectionData(header.e_shstrndx);
+        section_names.assign(names.begin(), names.end());
+        // Guards against unterminated names at the end of the section
+        section_names.push_back('\0');
+    }
+
+    entryPoint = header.e_entry;
+    valid = true;
 
     LoadSymbols();
 }
 
+std::vector<u8> ElfReader::ReadSectionData(int section) {
+    std::vector<u8> data;
+    if (section < 0 || section >= header.e_shnum || sections[section].sh_type == SHT_NOBITS)
+        return data;
+
+    data.resize(sections[section].sh_size);
+    if (!ReadAt(sections[section].sh_offset, data.data(), data.size()))
+        data.clear();
+    return data;
+}
+
 const char *ElfReader::GetSectionName(int section) const {
     if (sections[section].sh_type == SHT_NULL)
         return nullptr;
 
-    int name_offset = sections[section].sh_name;
-    const char* ptr = (char*)GetSectionDataPtr(header->e_shstrndx);
-
-    if (ptr)
-        return ptr + name_offset;
+    u32 name_offset = sections[section].sh_name;
+    if (name_offset >= section_names.size())
+        return nullptr;
 
-    return nullptr;
+    return &section_names[name_offset];
 }
 
 SharedPtr<CodeSet> ElfReader::LoadInto(u32 vaddr) {
-    LOG_DEBUG(Loader, "String section: %i", header->e_shstrndx);
+    LOG_DEBUG(Loader, "String section: %i", header.e_shstrndx);
 
     // Should we relocate?
-    relocate = (header->e_type != ET_EXEC);
+    relocate = (header.e_type != ET_EXEC);
 
     if (relocate) {
         LOG_DEBUG(Loader, "Relocatable module");
@@ -270,26 +293,25 @@ SharedPtr<CodeSet> ElfReader::LoadInto(u32 vaddr) {
     } else {
         LOG_DEBUG(Loader, "Prerelocated executable");
     }
-    LOG_DEBUG(Loader, "%i segments:", header->e_phnum);
+    LOG_DEBUG(Loader, "%i segments:", header.e_phnum);
 
     // First pass : Get the bits into RAM
     u32 base_addr = relocate ? vaddr : 0;
 
     u32 total_image_size = 0;
-    for (unsigned int i = 0; i < header->e_phnum; ++i) {
-        Elf32_Phdr* p = &segments[i];
-        if (p->p_type == PT_LOAD) {
-            total_image_size += (p->p_memsz + 0xFFF) & ~0xFFF;
+    for (const Elf32_Phdr& p : segments) {
+        if (p.p_type == PT_LOAD) {
+            total_image_size += (p.p_memsz + 0xFFF) & ~0xFFF;
         }
     }
 
-    std::vector<u8> program_image(total_image_size);
-    size_t current_image_position = 0;
-
     SharedPtr<CodeSet> codeset = CodeSet::Create("", 0);
+    codeset->memory = std::make_shared<std::vector<u8>>(total_image_size);
+    std::vector<u8>& program_image = *codeset->memory;
+    size_t current_image_position = 0;
 
-    for (unsigned int i = 0; i < header->e_phnum; ++i) {
-        Elf32_Phdr* p = &segments[i];
+    for (unsigned int i = 0; i < header.e_phnum; ++i) {
+        const Elf32_Phdr* p = &segments[i];
         LOG_DEBUG(Loader, "Type: %i Vaddr: %08X Filesz: %8X Memsz: %8X ", p->p_type, p->p_vaddr,
                   p->p_filesz, p->p_memsz);
 
@@ -319,13 +341,16 @@ SharedPtr<CodeSet> ElfReader::LoadInto(u32 vaddr) {
             codeset_segment->addr = segment_addr;
             codeset_segment->size = aligned_size;
 
-            memcpy(&program_image[current_image_position], GetSegmentPtr(i), p->p_filesz);
+            u32 file_size = std::min(p->p_filesz, p->p_memsz);
+            if (file_size != 0 && !ReadAt(p->p_offset, &program_image[current_image_position], file_size)) {
+                LOG_ERROR(Loader, "Failed to read ELF segment id %u", i);
+                return nullptr;
+            }
             current_image_position += aligned_size;
         }
     }
 
-    codeset->entrypoint = base_addr + header->e_entry;
-    codeset->memory = std::make_shared<std::vector<u8>>(std::move(program_image));
+    codeset->entrypoint = base_addr + header.e_entry;
 
     LOG_DEBUG(Loader, "Done loading.");
 
@@ -333,7 +358,7 @@ SharedPtr<CodeSet> ElfReader::LoadInto(u32 vaddr) {
 }
 
 SectionID ElfReader::GetSectionByName(const char *name, int firstSection) const {
-    for (int i = firstSection; i < header->e_shnum; i++) {
+    for (int i = firstSection; i < header.e_shnum; i++) {
         const char *secname = GetSectionName(i);
 
         if (secname != nullptr && strcmp(name, secname) == 0)
@@ -346,20 +371,21 @@ bool ElfReader::LoadSymbols() {
     bool hasSymbols = false;
     SectionID sec = GetSectionByName(".symtab");
     if (sec != -1) {
-        int stringSection = sections[sec].sh_link;
-        const char *stringBase = (const char *)GetSectionDataPtr(stringSection);
+        std::vector<u8> strings = ReadSectionData(sections[sec].sh_link);
+        std::vector<u8> symbols = ReadSectionData(sec);
+        strings.push_back('\0');
 
         //We have a symbol table!
-        Elf32_Sym* symtab = (Elf32_Sym *)(GetSectionDataPtr(sec));
-        unsigned int numSymbols = sections[sec].sh_size / sizeof(Elf32_Sym);
+        const Elf32_Sym* symtab = reinterpret_cast<const Elf32_Sym*>(symbols.data());
+        unsigned int numSymbols = symbols.size() / sizeof(Elf32_Sym);
         for (unsigned sym = 0; sym < numSymbols; sym++) {
             int size = symtab[sym].st_size;
-            if (size == 0)
+            if (size == 0 || symtab[sym].st_name >= strings.size())
                 continue;
 
             int type = symtab[sym].st_info & 0xF;
 
-            const char *name = stringBase + symtab[sym].st_name;
+            const char *name = reinterpret_cast<const char*>(&strings[symtab[sym].st_name]);
 
             Symbols::Add(symtab[sym].st_value, name, size, type);
 
@@ -394,16 +420,13 @@ ResultStatus AppLoader_ELF::Load() {
     if (!file.IsOpen())
         return ResultStatus::Error;
 
-    // Reset read pointer in case this file has been read before.
-    file.Seek(0, SEEK_SET);
-
-    size_t size = file.GetSize();
-    std::unique_ptr<u8[]> buffer(new u8[size]);
-    if (file.ReadBytes(&buffer[0], size) != size)
+    ElfReader elf_reader(file);
+    if (!elf_reader.IsValid())
         return ResultStatus::Error;
 
-    ElfReader elf_reader(&buffer[0]);
     SharedPtr<CodeSet> codeset = elf_reader.LoadInto(Memory::PROCESS_IMAGE_VADDR);
+    if (codeset == nullptr)
+        return ResultStatus::Error;
     codeset->name = filename;
 
     Kernel::g_current_process = Kernel::Process::Create(std::move(codeset));
@@ -48,12 +48,7 @@ static FileType IdentifyFile(FileUtil::IOFile& file) {
     return FileType::Unknown;
 }
 
-/**
- * Guess the type of a bootable file from its extension
- * @param extension String extension of bootable file
- * @return FileType of file
- */
-static FileType GuessFromExtension(const std::string& extension_) {
+FileType GuessFromExtension(const std::string& extension_) {
     std::string extension = Common::ToLower(extension_);
 
     if (extension == ".elf" || extension == ".axf")
@@ -71,7 +66,7 @@ static FileType GuessFromExtension(const std::string& extension_) {
     return FileType::Unknown;
 }
 
-static const char* GetFileTypeString(FileType type) {
+const char* GetFileTypeString(FileType type) {
     switch (type) {
     case FileType::CCI:
         return "NCSD";
@@ -89,15 +84,15 @@ static const char* GetFileTypeString(FileType type) {
     return "unknown";
 }
 
-ResultStatus LoadFile(const std::string& filename) {
-    FileUtil::IOFile file(filename, "rb");
-    if (!file.IsOpen()) {
-        LOG_ERROR(Loader, "Failed to load file %s", filename.c_str());
-        return ResultStatus::Error;
-    }
-
-    std::string filename_filename, filename_extension;
-    Common::SplitPath(filename, nullptr, &filename_filename, &filename_extension);
+/**
+ * Identifies the type of an open bootable file, falling back to its extension
+ * @param file open file
+ * @param filename String filename of file
+ * @return FileType of file
+ */
+static FileType IdentifyFile(FileUtil::IOFile& file, const std::string& filename) {
+    std::string filename_extension;
+    Common::SplitPath(filename, nullptr, nullptr, &filename_extension);
 
     FileType type = IdentifyFile(file);
     FileType filename_type = GuessFromExtension(filename_extension);
@@ -107,44 +102,69 @@ ResultStatus LoadFile(const std::string& filename) {
         if (FileType::Unknown == type)
             type = filename_type;
     }
+    return type;
+}
 
-    LOG_INFO(Loader, "Loading file %s as %s...", filename.c_str(), GetFileTypeString(type));
+FileType IdentifyFile(const std::string& filename) {
+    FileUtil::IOFile file(filename, "rb");
+    if (!file.IsOpen())
+        return FileType::Error;
+
+    return IdentifyFile(file, filename);
+}
+
+std::unique_ptr<AppLoader> GetLoader(FileUtil::IOFile&& file, FileType type, const std::string& filename) {
+    std::string filename_filename;
+    Common::SplitPath(filename, nullptr, &filename_filename, nullptr);
 
     switch (type) {
 
     //3DSX file format...
     case FileType::THREEDSX:
-        return AppLoader_THREEDSX(std::move(file), filename_filename).Load();
+        return Common::make_unique<AppLoader_THREEDSX>(std::move(file), filename_filename);
 
     // Standard ELF file format...
     case FileType::ELF:
-        return AppLoader_ELF(std::move(file), filename_filename).Load();
+        return Common::make_unique<AppLoader_ELF>(std::move(file), filename_filename);
 
     // NCCH/NCSD container formats...
     case FileType::CXI:
     case FileType::CCI:
-    {
-        AppLoader_NCCH app_loader(std::move(file), filename);
-
-        // Load application and RomFS
-        if (ResultStatus::Success == app_loader.Load()) {
-            Service::FS::RegisterArchiveType(Common::make_unique<FileSys::ArchiveFactory_RomFS>(app_loader), Service::FS::ArchiveIdCode::RomFS);
-            return ResultStatus::Success;
-        }
-        break;
+        return Common::make_unique<AppLoader_NCCH>(std::move(file), filename);
+
+    default:
+        return nullptr;
     }
+}
 
-    // Error occurred durring IdentifyFile...
-    case FileType::Error:
+ResultStatus LoadFile(const std::string& filename) {
+    FileUtil::IOFile file(filename, "rb");
+    if (!file.IsOpen()) {
+        LOG_ERROR(Loader, "Failed to load file %s", filename.c_str());
+        return ResultStatus::Error;
+    }
 
-    // IdentifyFile could know identify file type...
-    case FileType::Unknown:
-    {
+    FileType type = IdentifyFile(file, filename);
+
+    // Error occurred durring IdentifyFile, or IdentifyFile couldn't identify the file type...
+    if (FileType::Error == type || FileType::Unknown == type) {
         LOG_CRITICAL(Loader, "File %s is of unknown type.", filename.c_str());
         return ResultStatus::ErrorInvalidFormat;
     }
-    }
-    return ResultStatus::Error;
+
+    LOG_INFO(Loader, "Loading file %s as %s...", filename.c_str(), GetFileTypeString(type));
+
+    std::unique_ptr<AppLoader> app_loader = GetLoader(std::move(file), type, filename);
+    if (app_loader == nullptr)
+        return ResultStatus::Error;
+
+    ResultStatus result = app_loader->Load();
+
+    // NCCH/NCSD containers also make their RomFS available
+    if (ResultStatus::Success == result && (FileType::CXI == type || FileType::CCI == type))
+        Service::FS::RegisterArchiveType(Common::make_unique<FileSys::ArchiveFactory_RomFS>(*app_loader), Service::FS::ArchiveIdCode::RomFS);
+
+    return result;
 }
 
 } // namespace Loader
@@ -97,6 +97,16 @@ public:
         return ResultStatus::ErrorNotImplemented;
     }
 
+    /**
+     * Get the program ID of the application. Unlike other functions, this doesn't require the
+     * application to be loaded, so that it can be used to list titles.
+     * @param out_program_id Reference to store the program ID into
+     * @return ResultStatus result of function
+     */
+    virtual ResultStatus ReadProgramId(u64& out_program_id) {
+        return ResultStatus::ErrorNotImplemented;
+    }
+
     /**
      * Get the RomFS of the application
      * Since the RomFS can be huge, we return a file reference instead of copying to a buffer
@@ -109,6 +119,18 @@ public:
         return ResultStatus::ErrorNotImplemented;
     }
 
+    /**
+     * Get the RomFS of the application as a memory mapping of the file containing it, which is
+     * cheaper to read from than a file. Callers should fall back to ReadRomFS if this fails.
+     * @param romfs_mapping The mapping of the file containing the RomFS
+     * @param offset The offset the romfs begins on
+     * @param size The size of the romfs
+     * @return ResultStatus result of function
+     */
+    virtual ResultStatus MapRomFS(std::shared_ptr<FileUtil::MappedFile>& romfs_mapping, u64& offset, u64& size) {
+        return ResultStatus::ErrorNotImplemented;
+    }
+
 protected:
     FileUtil::IOFile file;
     bool is_loaded = false;
@@ -120,6 +142,37 @@ protected:
  */
 extern const std::initializer_list<Kernel::AddressMapping> default_address_mappings;
 
+/**
+ * Identifies the type of a bootable file from its contents, or from its extension if the
+ * contents aren't recognized
+ * @param filename String filename of bootable file
+ * @return FileType of file, FileType::Error if it can't be opened
+ */
+FileType IdentifyFile(const std::string& filename);
+
+/**
+ * Guess the type of a bootable file from its extension
+ * @param extension String extension of bootable file, including the dot
+ * @return FileType of file
+ */
+FileType GuessFromExtension(const std::string& extension);
+
+/**
+ * Returns the name of a file type, for display in logs and game lists
+ * @param type FileType to get the name of
+ */
+const char* GetFileTypeString(FileType type);
+
+/**
+ * Creates the loader for a bootable file of the given type, without loading it. Icons, banners
+ * and program IDs can be read from loaders which haven't been loaded.
+ * @param file Open file, which is moved into the loader
+ * @param type FileType of file, as returned by IdentifyFile
+ * @param filename String filename of bootable file
+ * @return The loader, or nullptr if the type can't be loaded
+ */
+std::unique_ptr<AppLoader> GetLoader(FileUtil::IOFile&& file, FileType type, const std::string& filename);
+
 /**
  * Identifies and loads a bootable file
  * @param filename String filename of bootable file
@@ -3,8 +3,14 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
 #include <cstring>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "common/logging/log.h"
 #include "common/make_unique.h"
@@ -15,6 +21,7 @@
 #include "core/hle/kernel/resource_limit.h"
 #include "core/loader/ncch.h"
 #include "core/memory.h"
+#include "core/title_profile.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Loader namespace
@@ -24,43 +31,181 @@ namespace Loader {
 static const int kMaxSections = 8;        ///< Maximum number of sections (files) in an ExeFs
 static const int kBlockSize   = 0x200;    ///< Size of ExeFS blocks (in bytes)
 
+/// Size of the chunks in which compressed sections are read while they are being decompressed
+static const u32 kCodeReadChunkSize = 0x40000;
+
+/// Largest amount of input consumed by one LZSS control byte and the 8 tokens it describes
+static const u32 kLZSSMaxGroupInput = 1 + 8 * 2;
+/// Largest amount of output produced by one control byte (8 back-references of 18 bytes)
+static const u32 kLZSSMaxGroupOutput = 8 * 18;
+/// Largest distance (minus one) between a back-reference and its source
+static const u32 kLZSSMaxBackReference = 0xFFF + 2;
+
+/**
+ * Reads a section from a file into a buffer in chunks, starting with the last one. Since LZSS
+ * data is decompressed from the end to the start, this lets decompression of the part which was
+ * already read overlap with the read of the rest. Sections which fit in one chunk are read right
+ * away on the calling thread.
+ */
+class BackwardSectionReader {
+public:
+    BackwardSectionReader(FileUtil::IOFile& file, u64 file_offset, u8* dest, u32 size)
+            : file(file), file_offset(file_offset), dest(dest), size(size), ready_offset(size) {
+        if (size <= kCodeReadChunkSize) {
+            if (file.ReadBytesAt(dest, size, file_offset) == size)
+                ready_offset = 0;
+            else
+                failed = true;
+        } else {
+            thread = std::thread(&BackwardSectionReader::ReadLoop, this);
+        }
+    }
+
+    ~BackwardSectionReader() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                cancelled = true;
+            }
+            thread.join();
+        }
+    }
+
+    /**
+     * Blocks until the part of the section from the given offset to its end has been read.
+     * @return False if the data couldn't be read
+     */
+    bool WaitFor(u32 offset) {
+        std::unique_lock<std::mutex> lock(mutex);
+        chunk_read.wait(lock, [&]{ return ready_offset <= offset || failed; });
+        return ready_offset <= offset;
+    }
+
+private:
+    void ReadLoop() {
+        u32 position = size;
+        while (position != 0) {
+            u32 length = std::min(position, kCodeReadChunkSize);
+            bool success = file.ReadBytesAt(dest + position - length, length,
+                                            file_offset + position - length) == length;
+            position -= length;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (success)
+                    ready_offset = position;
+                else
+                    failed = true;
+                if (!success || cancelled)
+                    position = 0;
+            }
+            chunk_read.notify_one();
+        }
+    }
+
+    FileUtil::IOFile& file;
+    u64 file_offset;
+    u8* dest;
+    u32 size;
+
+    std::mutex mutex;
+    std::condition_variable chunk_read;
+    u32 ready_offset;       ///< Offset from which on the section has been read (guarded by mutex)
+    bool failed = false;    ///< Set if a read failed (guarded by mutex)
+    bool cancelled = false; ///< Set if the reader is destroyed before it finished (guarded by mutex)
+    std::thread thread;
+};
+
 /**
  * Get the decompressed size of an LZSS compressed ExeFS file
- * @param buffer Buffer of compressed file
+ * @param footer Last 4 bytes of the compressed file
  * @param size Size of compressed buffer
  * @return Size of decompressed buffer
  */
-static u32 LZSS_GetDecompressedSize(const u8* buffer, u32 size) {
-    u32 offset_size = *(u32*)(buffer + size - 4);
-    return offset_size + size;
+static u32 LZSS_GetDecompressedSize(u32_le footer, u32 size) {
+    return footer + size;
 }
 
 /**
- * Decompress ExeFS file (compressed with LZSS)
- * @param compressed Compressed buffer
- * @param compressed_size Size of compressed buffer
- * @param decompressed Decompressed buffer
+ * Copies a back-reference, which may overlap the data it refers to, in pieces no larger than the
+ * distance between source and destination. This avoids a byte-wise copy for all but the closest
+ * references, each piece being copied from output produced before it.
+ * @param out_end End of the destination, the data is written to the `size` bytes before it
+ * @param distance Distance from the destination to the source of each byte
+ * @param size Number of bytes to copy
+ */
+static inline void LZSS_CopyBackReference(u8* out_end, u32 distance, u32 size) {
+    while (size != 0) {
+        u32 piece = std::min(size, distance);
+        out_end -= piece;
+        memcpy(out_end, out_end + distance, piece);
+        size -= piece;
+    }
+}
+
+/**
+ * Decompress ExeFS file (compressed with LZSS) in place. The compressed data sits at the start of
+ * the buffer, and is decompressed from its end to its start into the end of the buffer, like the
+ * 3DS does it. The output never overtakes input which hasn't been consumed yet in valid data.
+ * @param buffer Buffer holding the compressed file, decompressed_size bytes long
+ * @param compressed_size Size of compressed file
  * @param decompressed_size Size of decompressed buffer
+ * @param input Reader filling in the compressed file, which is waited for as input is required
  * @return True on success, otherwise false
  */
-static bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decompressed, u32 decompressed_size) {
-    const u8* footer = compressed + compressed_size - 8;
-    u32 buffer_top_and_bottom = *reinterpret_cast<const u32*>(footer);
-    u32 out = decompressed_size;
-    u32 index = compressed_size - ((buffer_top_and_bottom >> 24) & 0xFF);
-    u32 stop_index = compressed_size - (buffer_top_and_bottom & 0xFFFFFF);
+static bool LZSS_Decompress(u8* buffer, u32 compressed_size, u32 decompressed_size,
+                            BackwardSectionReader& input) {
+    if (compressed_size < 8 || !input.WaitFor(compressed_size - 8))
+        return false;
 
-    memset(decompressed, 0, decompressed_size);
-    memcpy(decompressed, compressed, compressed_size);
+    u32 buffer_top_and_bottom = *reinterpret_cast<const u32_le*>(buffer + compressed_size - 8);
+    u32 top = (buffer_top_and_bottom >> 24) & 0xFF;
+    u32 bottom = buffer_top_and_bottom & 0xFFFFFF;
+    if (top > bottom || bottom > compressed_size)
+        return false;
+
+    u32 out = decompressed_size;
+    u32 index = compressed_size - top;
+    u32 stop_index = compressed_size - bottom;
+    u32 ready_index = compressed_size - 8;
 
     while (index > stop_index) {
-       u8 control = compressed[--index];
+        // Make sure all input the next control byte may refer to has been read
+        u32 group_start = std::max(index, stop_index + kLZSSMaxGroupInput) - kLZSSMaxGroupInput;
+        if (group_start < ready_index) {
+            if (!input.WaitFor(group_start))
+                return false;
+            ready_index = group_start;
+        }
+
+        u8 control = buffer[--index];
+
+        // If no token of this group can run out of input or output, or reach beyond the end of
+        // the buffer or over unconsumed input, skip the bounds checks
+        if (index >= stop_index + kLZSSMaxGroupInput - 1 &&
+            out >= index + kLZSSMaxGroupOutput &&
+            decompressed_size - out > kLZSSMaxBackReference) {
+
+            for (unsigned i = 0; i < 8; i++) {
+                if (control & 0x80) {
+                    index -= 2;
+                    u32 segment_offset = buffer[index] | (buffer[index + 1] << 8);
+                    u32 segment_size = ((segment_offset >> 12) & 15) + 3;
+                    segment_offset = (segment_offset & 0x0FFF) + 2;
+
+                    LZSS_CopyBackReference(buffer + out, segment_offset + 1, segment_size);
+                    out -= segment_size;
+                } else {
+                    buffer[--out] = buffer[--index];
+                }
+                control <<= 1;
+            }
+            continue;
+        }
 
         for (unsigned i = 0; i < 8; i++) {
             if (index <= stop_index)
                 break;
-            if (index <= 0)
-                break;
             if (out <= 0)
                 break;
 
@@ -70,33 +215,31 @@ static bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decom
                     return false;
                 index -= 2;
 
-                u32 segment_offset = compressed[index] | (compressed[index + 1] << 8);
+                u32 segment_offset = buffer[index] | (buffer[index + 1] << 8);
                 u32 segment_size = ((segment_offset >> 12) & 15) + 3;
                 segment_offset &= 0x0FFF;
                 segment_offset += 2;
 
-                // Check if compression is out of bounds
-                if (out < segment_size)
+                // Check if compression is out of bounds, or would overwrite unconsumed input
+                if (out < segment_size || out - segment_size < index)
+                    return false;
+                if (out + segment_offset >= decompressed_size)
                     return false;
 
-                for (unsigned j = 0; j < segment_size; j++) {
-                    // Check if compression is out of bounds
-                    if (out + segment_offset >= decompressed_size)
-                        return false;
-
-                    u8 data = decompressed[out + segment_offset];
-                    decompressed[--out] = data;
-                }
+                LZSS_CopyBackReference(buffer + out, segment_offset + 1, segment_size);
+                out -= segment_size;
             } else {
-                // Check if compression is out of bounds
-                if (out < 1)
+                // Check if compression is out of bounds, or would overwrite unconsumed input
+                if (out < index)
                     return false;
-                decompressed[--out] = compressed[--index];
+                buffer[--out] = buffer[--index];
             }
             control <<= 1;
         }
     }
-    return true;
+
+    // The uncompressed start of the file stays where it is, it only has to be read completely
+    return input.WaitFor(0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -124,12 +267,59 @@ ResultStatus AppLoader_NCCH::LoadExec() {
     if (!is_loaded)
         return ResultStatus::ErrorNotLoaded;
 
-    std::vector<u8> code;
-    if (ResultStatus::Success == ReadCode(code)) {
+    const auto& codeset_info = exheader_header.codeset_info;
+
+    // TODO(yuriks): Not sure if the bss size is added to the page-aligned .data size or just
+    //               to the regular size. Playing it safe for now.
+    u32 bss_page_size = (codeset_info.bss_size + 0xFFF) & ~0xFFF;
+
+    // Instances of the same title share the pages of the cached image through the OS page cache,
+    // only the pages each of them writes to are copied. The image is only decompressed if it
+    // isn't cached yet.
+    const std::string image_cache_path = GetCodeImageCachePath();
+    std::shared_ptr<FileUtil::MappedFile> mapped_image;
+    if (!image_cache_path.empty() && FileUtil::Exists(image_cache_path)) {
+        mapped_image = std::make_shared<FileUtil::MappedFile>(image_cache_path, true);
+        if (!mapped_image->IsOpen() || mapped_image->GetSize() < bss_page_size)
+            mapped_image = nullptr;
+    }
+
+    // Allocate the process memory at its final size up front, so that .code is decompressed
+    // straight into it and appending the bss doesn't reallocate and copy the whole image.
+    auto memory = std::make_shared<std::vector<u8>>();
+    ResultStatus code_result = ResultStatus::Success;
+    if (mapped_image == nullptr) {
+        try {
+            memory->reserve((codeset_info.text.num_max_pages + codeset_info.ro.num_max_pages +
+                             codeset_info.data.num_max_pages) * Memory::PAGE_SIZE + bss_page_size);
+        } catch (std::bad_alloc&) {
+            return ResultStatus::ErrorMemoryAllocationFailed;
+        }
+
+        code_result = ReadCode(*memory);
+        if (code_result == ResultStatus::Success) {
+            memory->resize(memory->size() + bss_page_size, 0);
+
+            if (!image_cache_path.empty())
+                mapped_image = CacheCodeImage(image_cache_path, *memory);
+            if (mapped_image != nullptr)
+                memory = nullptr;
+        }
+    }
+
+    if (ResultStatus::Success == code_result) {
         std::string process_name = Common::StringFromFixedZeroTerminatedBuffer(
                 (const char*)exheader_header.codeset_info.name, 8);
         u64 program_id = *reinterpret_cast<u64_le const*>(&ncch_header.program_id[0]);
 
+        // The profile was applied before the subsystems initialized, with the program ID which
+        // the frontend read through ReadProgramId
+        const u64 profile_program_id = TitleProfile::GetProgramId();
+        if (profile_program_id != 0 && profile_program_id != program_id) {
+            LOG_WARNING(Loader, "Running %016" PRIX64 " with the title profile of %016" PRIX64,
+                        program_id, profile_program_id);
+        }
+
         SharedPtr<CodeSet> codeset = CodeSet::Create(process_name, program_id);
 
         codeset->code.offset = 0;
@@ -140,17 +330,13 @@ ResultStatus AppLoader_NCCH::LoadExec() {
         codeset->rodata.addr = exheader_header.codeset_info.ro.address;
         codeset->rodata.size = exheader_header.codeset_info.ro.num_max_pages * Memory::PAGE_SIZE;
 
-        // TODO(yuriks): Not sure if the bss size is added to the page-aligned .data size or just
-        //               to the regular size. Playing it safe for now.
-        u32 bss_page_size = (exheader_header.codeset_info.bss_size + 0xFFF) & ~0xFFF;
-        code.resize(code.size() + bss_page_size, 0);
-
         codeset->data.offset = codeset->rodata.offset + codeset->rodata.size;
         codeset->data.addr = exheader_header.codeset_info.data.address;
         codeset->data.size = exheader_header.codeset_info.data.num_max_pages * Memory::PAGE_SIZE + bss_page_size;
 
         codeset->entrypoint = codeset->code.addr;
-        codeset->memory = std::make_shared<std::vector<u8>>(std::move(code));
+        codeset->memory = std::move(memory);
+        codeset->mapped_image = std::move(mapped_image);
 
         Kernel::g_current_process = Kernel::Process::Create(std::move(codeset));
 
@@ -171,9 +357,56 @@ ResultStatus AppLoader_NCCH::LoadExec() {
     return ResultStatus::Error;
 }
 
+std::string AppLoader_NCCH::GetCodeImageCachePath() const {
+    for (unsigned section_number = 0; section_number < kMaxSections; section_number++) {
+        if (strcmp(exefs_header.section[section_number].name, ".code") != 0)
+            continue;
+
+        // The section hashes are stored in reverse order
+        const u8* hash = exefs_header.hashes[kMaxSections - 1 - section_number];
+        if (std::all_of(hash, hash + 0x20, [](u8 byte) { return byte == 0; }))
+            return "";
+
+        std::string name;
+        for (int i = 0; i < 0x20; ++i)
+            name += Common::StringFromFormat("%02x", hash[i]);
+        return FileUtil::GetUserPath(D_CACHE_IDX) + "code/" + name + ".bin";
+    }
+    return "";
+}
+
+std::shared_ptr<FileUtil::MappedFile> AppLoader_NCCH::CacheCodeImage(const std::string& path, const std::vector<u8>& image) {
+    if (!FileUtil::CreateFullPath(path))
+        return nullptr;
+
+    // Other instances may be writing the same image at the same time, so each writes to its own
+    // temporary file and only complete files get renamed into place.
+    const size_t unique_id = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                             static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    const std::string temp_path = path + Common::StringFromFormat(".%08x.tmp", static_cast<u32>(unique_id));
+
+    bool written;
+    {
+        FileUtil::IOFile file(temp_path, "wb");
+        written = file.IsOpen() && file.WriteBytes(image.data(), image.size()) == image.size();
+    }
+
+    if (!written || !FileUtil::Rename(temp_path, path)) {
+        LOG_WARNING(Loader, "Failed to write code image cache %s", path.c_str());
+        FileUtil::Delete(temp_path);
+        return nullptr;
+    }
+
+    auto mapping = std::make_shared<FileUtil::MappedFile>(path, true);
+    if (!mapping->IsOpen() || mapping->GetSize() != image.size())
+        return nullptr;
+    return mapping;
+}
+
 ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>& buffer) {
-    if (!file.IsOpen())
-        return ResultStatus::Error;
+    ResultStatus result = LoadHeaders();
+    if (ResultStatus::Success != result)
+        return result;
 
     LOG_DEBUG(Loader, "%d sections:", kMaxSections);
     // Iterate through the ExeFs archive until we find the .code file...
@@ -189,21 +422,24 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
             file.Seek(section_offset, SEEK_SET);
 
             if (is_compressed) {
-                // Section is compressed, read compressed .code section...
-                std::unique_ptr<u8[]> temp_buffer;
+                // Section is compressed, the decompressed size is in the last word of it...
+                u32_le footer;
+                if (section.size < 8)
+                    return ResultStatus::ErrorInvalidFormat;
+                if (file.ReadBytesAt(&footer, sizeof(footer), section_offset + section.size - 4) != sizeof(footer))
+                    return ResultStatus::Error;
+
+                u32 decompressed_size = LZSS_GetDecompressedSize(footer, section.size);
                 try {
-                    temp_buffer.reset(new u8[section.size]);
+                    buffer.resize(decompressed_size);
                 } catch (std::bad_alloc&) {
                     return ResultStatus::ErrorMemoryAllocationFailed;
                 }
 
-                if (file.ReadBytes(&temp_buffer[0], section.size) != section.size)
-                    return ResultStatus::Error;
-
-                // Decompress .code section...
-                u32 decompressed_size = LZSS_GetDecompressedSize(&temp_buffer[0], section.size);
-                buffer.resize(decompressed_size);
-                if (!LZSS_Decompress(&temp_buffer[0], section.size, &buffer[0], decompressed_size))
+                // Read compressed .code section into the buffer and decompress it in place, while
+                // the rest of it is still being read
+                BackwardSectionReader reader(file, section_offset, &buffer[0], section.size);
+                if (!LZSS_Decompress(&buffer[0], section.size, decompressed_size, reader))
                     return ResultStatus::ErrorInvalidFormat;
             } else {
                 // Section is uncompressed...
@@ -217,9 +453,9 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
     return ResultStatus::ErrorNotUsed;
 }
 
-ResultStatus AppLoader_NCCH::Load() {
-    if (is_loaded)
-        return ResultStatus::ErrorAlreadyLoaded;
+ResultStatus AppLoader_NCCH::LoadHeaders() {
+    if (headers_loaded)
+        return ResultStatus::Success;
 
     if (!file.IsOpen())
         return ResultStatus::Error;
@@ -278,6 +514,18 @@ ResultStatus AppLoader_NCCH::Load() {
     if (file.ReadBytes(&exefs_header, sizeof(ExeFs_Header)) != sizeof(ExeFs_Header))
         return ResultStatus::Error;
 
+    headers_loaded = true;
+    return ResultStatus::Success;
+}
+
+ResultStatus AppLoader_NCCH::Load() {
+    if (is_loaded)
+        return ResultStatus::ErrorAlreadyLoaded;
+
+    ResultStatus result = LoadHeaders();
+    if (ResultStatus::Success != result)
+        return result;
+
     is_loaded = true; // Set state to loaded
 
     return LoadExec(); // Load the executable into memory for booting
@@ -287,6 +535,15 @@ ResultStatus AppLoader_NCCH::ReadCode(std::vector<u8>& buffer) {
     return LoadSectionExeFS(".code", buffer);
 }
 
+ResultStatus AppLoader_NCCH::ReadProgramId(u64& out_program_id) {
+    ResultStatus result = LoadHeaders();
+    if (ResultStatus::Success != result)
+        return result;
+
+    out_program_id = *reinterpret_cast<u64_le const*>(&ncch_header.program_id[0]);
+    return ResultStatus::Success;
+}
+
 ResultStatus AppLoader_NCCH::ReadIcon(std::vector<u8>& buffer) {
     return LoadSectionExeFS("icon", buffer);
 }
@@ -299,9 +556,10 @@ ResultStatus AppLoader_NCCH::ReadLogo(std::vector<u8>& buffer) {
     return LoadSectionExeFS("logo", buffer);
 }
 
-ResultStatus AppLoader_NCCH::ReadRomFS(std::shared_ptr<FileUtil::IOFile>& romfs_file, u64& offset, u64& size) {
-    if (!file.IsOpen())
-        return ResultStatus::Error;
+ResultStatus AppLoader_NCCH::GetRomFSRange(u64& offset, u64& size) {
+    ResultStatus result = LoadHeaders();
+    if (ResultStatus::Success != result)
+        return result;
 
     // Check if the NCCH has a RomFS...
     if (ncch_header.romfs_offset != 0 && ncch_header.romfs_size != 0) {
@@ -314,11 +572,6 @@ ResultStatus AppLoader_NCCH::ReadRomFS(std::shared_ptr<FileUtil::IOFile>& romfs_
         if (file.GetSize () < romfs_offset + romfs_size)
             return ResultStatus::Error;
 
-        // We reopen the file, to allow its position to be independent from file's
-        romfs_file = std::make_shared<FileUtil::IOFile>(filepath, "rb");
-        if (!romfs_file->IsOpen())
-            return ResultStatus::Error;
-
         offset = romfs_offset;
         size = romfs_size;
 
@@ -328,4 +581,30 @@ ResultStatus AppLoader_NCCH::ReadRomFS(std::shared_ptr<FileUtil::IOFile>& romfs_
     return ResultStatus::ErrorNotUsed;
 }
 
+ResultStatus AppLoader_NCCH::ReadRomFS(std::shared_ptr<FileUtil::IOFile>& romfs_file, u64& offset, u64& size) {
+    ResultStatus result = GetRomFSRange(offset, size);
+    if (result != ResultStatus::Success)
+        return result;
+
+    // We reopen the file, to allow its position to be independent from file's
+    romfs_file = std::make_shared<FileUtil::IOFile>(filepath, "rb");
+    if (!romfs_file->IsOpen())
+        return ResultStatus::Error;
+
+    return ResultStatus::Success;
+}
+
+ResultStatus AppLoader_NCCH::MapRomFS(std::shared_ptr<FileUtil::MappedFile>& romfs_mapping, u64& offset, u64& size) {
+    ResultStatus result = GetRomFSRange(offset, size);
+    if (result != ResultStatus::Success)
+        return result;
+
+    auto mapping = std::make_shared<FileUtil::MappedFile>(filepath);
+    if (!mapping->IsOpen() || mapping->GetSize() < offset + size)
+        return ResultStatus::Error;
+
+    romfs_mapping = std::move(mapping);
+    return ResultStatus::Success;
+}
+
 } // namespace Loader
@@ -207,6 +207,13 @@ public:
      */
     ResultStatus ReadLogo(std::vector<u8>& buffer) override;
 
+    /**
+     * Get the program ID of the application
+     * @param out_program_id Reference to store the program ID into
+     * @return ResultStatus result of function
+     */
+    ResultStatus ReadProgramId(u64& out_program_id) override;
+
     /**
      * Get the RomFS of the application
      * @param buffer Reference to buffer to store data
@@ -214,8 +221,31 @@ public:
      */
     ResultStatus ReadRomFS(std::shared_ptr<FileUtil::IOFile>& romfs_file, u64& offset, u64& size) override;
 
+    /**
+     * Get the RomFS of the application as a memory mapping of the NCCH file
+     * @param romfs_mapping The mapping of the NCCH file
+     * @param offset The offset the romfs begins on
+     * @param size The size of the romfs
+     * @return ResultStatus result of function
+     */
+    ResultStatus MapRomFS(std::shared_ptr<FileUtil::MappedFile>& romfs_mapping, u64& offset, u64& size) override;
+
 private:
 
+    /**
+     * Locates the RomFS in the NCCH file
+     * @param offset The offset the romfs begins on
+     * @param size The size of the romfs
+     * @return ResultStatus result of function
+     */
+    ResultStatus GetRomFSRange(u64& offset, u64& size);
+
+    /**
+     * Reads the NCCH, ExHeader and ExeFS headers, if that hasn't happened yet
+     * @return ResultStatus result of function
+     */
+    ResultStatus LoadHeaders();
+
     /**
      * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.)
      * @param name Name of section to read out of NCCH file
@@ -230,6 +260,21 @@ private:
      */
     ResultStatus LoadExec();
 
+    /**
+     * Returns the path of the file caching the decompressed code set image, which is named after
+     * the ExeFS hash of the .code section. Returns an empty string if the .code section or its hash is missing.
+     */
+    std::string GetCodeImageCachePath() const;
+
+    /**
+     * Writes a code set image to the cache, and maps the written file
+     * @param path Path of the cache file
+     * @param image Decompressed .code section, followed by the zero-filled bss
+     * @return Copy-on-write mapping of the file, or nullptr if it couldn't be written
+     */
+    static std::shared_ptr<FileUtil::MappedFile> CacheCodeImage(const std::string& path, const std::vector<u8>& image);
+
+    bool            headers_loaded = false;
     bool            is_compressed = false;
 
     u32             entry_point = 0;
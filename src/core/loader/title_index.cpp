@@ -0,0 +1,347 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <unordered_set>
+
+#include "common/common_paths.h"
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+#include "common/swap.h"
+#include "common/thread.h"
+
+#include "core/loader/title_index.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loader namespace
+
+namespace Loader {
+
+/// Identifies the cache file, and its layout version, which is bumped whenever the layout changes
+static const u32 INDEX_MAGIC = MakeMagic('C', 'T', 'I', 'X');
+static const u32 INDEX_VERSION = 1;
+
+// Layout of the SMDH found in the icon section of titles, as far as the index needs it
+static const u32 SMDH_TITLES_OFFSET = 0x8;
+static const u32 SMDH_TITLE_SIZE = 0x200;           ///< Short title, long title and publisher
+static const u32 SMDH_SHORT_TITLE_LENGTH = 0x40;    ///< In UTF-16 code units
+static const u32 SMDH_LANGUAGE_ENGLISH = 1;
+static const u32 SMDH_LARGE_ICON_OFFSET = 0x24C0;
+static const u32 SMDH_LARGE_ICON_SIZE = 48 * 48 * 2;
+
+/**
+ * Fills in the title and icon of a TitleInfo from the SMDH in the icon section of a title
+ * @param smdh Contents of the icon section
+ * @param info TitleInfo to fill in
+ */
+static void ParseSMDH(const std::vector<u8>& smdh, TitleInfo& info) {
+    if (smdh.size() < SMDH_LARGE_ICON_OFFSET + SMDH_LARGE_ICON_SIZE ||
+        MakeMagic('S', 'M', 'D', 'H') != *reinterpret_cast<const u32_le*>(smdh.data())) {
+        LOG_WARNING(Loader, "%s has an invalid icon", info.path.c_str());
+        return;
+    }
+
+    const u8* short_title = &smdh[SMDH_TITLES_OFFSET + SMDH_LANGUAGE_ENGLISH * SMDH_TITLE_SIZE];
+    std::u16string title;
+    for (unsigned i = 0; i < SMDH_SHORT_TITLE_LENGTH; ++i) {
+        char16_t c = *reinterpret_cast<const u16_le*>(short_title + i * 2);
+        if (c == 0)
+            break;
+        title.push_back(c);
+    }
+    if (!title.empty())
+        info.title = Common::UTF16ToUTF8(title);
+
+    info.icon.assign(smdh.begin() + SMDH_LARGE_ICON_OFFSET,
+                     smdh.begin() + SMDH_LARGE_ICON_OFFSET + SMDH_LARGE_ICON_SIZE);
+}
+
+/**
+ * Parses the metadata of a file. The path, file size and modification time have to be filled in
+ * already. Files which aren't bootable are marked by a type of FileType::Unknown or Error.
+ * @param info TitleInfo to fill in
+ */
+static void ReadTitleInfo(TitleInfo& info) {
+    Common::SplitPath(info.path, nullptr, &info.title, nullptr);
+
+    info.type = IdentifyFile(info.path);
+    std::unique_ptr<AppLoader> loader = GetLoader(FileUtil::IOFile(info.path, "rb"), info.type, info.path);
+    if (loader == nullptr)
+        return;
+
+    u64 program_id;
+    if (ResultStatus::Success == loader->ReadProgramId(program_id))
+        info.program_id = program_id;
+
+    std::vector<u8> smdh;
+    if (ResultStatus::Success == loader->ReadIcon(smdh))
+        ParseSMDH(smdh, info);
+}
+
+/// Returns whether a TitleInfo describes a bootable file
+static bool IsBootable(const TitleInfo& info) {
+    return FileType::Unknown != info.type && FileType::Error != info.type;
+}
+
+// Helpers for (de)serializing the index. The cache file is native-endian, it is only ever read
+// on the machine which wrote it.
+
+template <typename T>
+static void Write(std::vector<u8>& buffer, const T& value) {
+    const u8* bytes = reinterpret_cast<const u8*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+static void WriteBytes(std::vector<u8>& buffer, const void* data, u32 size) {
+    Write(buffer, size);
+    const u8* bytes = static_cast<const u8*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+/// Reads values from a cache file in memory, failing on reads past its end
+class CacheReader {
+public:
+    explicit CacheReader(const std::vector<u8>& buffer) : buffer(buffer) { }
+
+    template <typename T>
+    bool Read(T& value) {
+        if (buffer.size() - position < sizeof(T))
+            return false;
+        std::memcpy(&value, &buffer[position], sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    template <typename Container>
+    bool ReadBytes(Container& container) {
+        u32 size;
+        if (!Read(size) || buffer.size() - position < size)
+            return false;
+        container.assign(buffer.begin() + position, buffer.begin() + position + size);
+        position += size;
+        return true;
+    }
+
+private:
+    const std::vector<u8>& buffer;
+    size_t position = 0;
+};
+
+TitleIndex::TitleIndex(const std::string& cache_path) : cache_path(cache_path), stop_scan(false) {
+    LoadCache();
+}
+
+TitleIndex::~TitleIndex() {
+    StopScan();
+    Save();
+}
+
+bool TitleIndex::Lookup(const std::string& path, TitleInfo& info) {
+    if (!FileUtil::Exists(path) || FileUtil::IsDirectory(path))
+        return false;
+
+    u64 file_size = FileUtil::GetSize(path);
+    u64 modification_time = FileUtil::GetModificationTime(path);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it != entries.end() && it->second.file_size == file_size &&
+            it->second.modification_time == modification_time) {
+            info = it->second;
+            return IsBootable(info);
+        }
+    }
+
+    // Parse the file without holding the lock, so other lookups don't have to wait for it
+    TitleInfo parsed;
+    parsed.path = path;
+    parsed.file_size = file_size;
+    parsed.modification_time = modification_time;
+    ReadTitleInfo(parsed);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[path] = parsed;
+        dirty = true;
+    }
+
+    info = std::move(parsed);
+    return IsBootable(info);
+}
+
+std::vector<TitleInfo> TitleIndex::GetTitles() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<TitleInfo> titles;
+    for (const auto& entry : entries) {
+        if (IsBootable(entry.second))
+            titles.push_back(entry.second);
+    }
+    return titles;
+}
+
+void TitleIndex::StartScan(const std::string& directory, bool recursive, ScanCallback callback,
+                           ScanFinishedCallback finished_callback) {
+    StopScan();
+
+    stop_scan = false;
+    scanner = std::thread(&TitleIndex::ScanLoop, this, directory, recursive,
+                          std::move(callback), std::move(finished_callback));
+}
+
+void TitleIndex::StopScan() {
+    if (!scanner.joinable())
+        return;
+
+    stop_scan = true;
+    scanner.join();
+}
+
+/**
+ * Collects the paths of the files in a scanned directory tree
+ * @param entry Directory to collect the files of
+ * @param recursive Whether to collect the files of subdirectories, too
+ * @param paths Vector to append the paths to
+ */
+static void CollectFiles(const FileUtil::FSTEntry& entry, bool recursive, std::vector<std::string>& paths) {
+    for (const auto& child : entry.children) {
+        if (!child.isDirectory)
+            paths.push_back(child.physicalName);
+        else if (recursive)
+            CollectFiles(child, recursive, paths);
+    }
+}
+
+void TitleIndex::ScanLoop(std::string directory, bool recursive, ScanCallback callback,
+                          ScanFinishedCallback finished_callback) {
+    Common::SetCurrentThreadName("TitleScanner");
+
+    FileUtil::FSTEntry root;
+    FileUtil::ScanDirectoryTree(directory, root);
+
+    std::vector<std::string> paths;
+    CollectFiles(root, recursive, paths);
+
+    std::unordered_set<std::string> found;
+    for (const auto& path : paths) {
+        if (stop_scan)
+            break;
+
+        std::string extension;
+        Common::SplitPath(path, nullptr, nullptr, &extension);
+        if (FileType::Unknown == GuessFromExtension(extension))
+            continue;
+
+        found.insert(path);
+
+        TitleInfo info;
+        if (Lookup(path, info) && callback)
+            callback(path);
+    }
+
+    // Forget about files which were removed from the directory, unless the scan was incomplete
+    if (!stop_scan) {
+        std::string prefix = directory + DIR_SEP;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end();) {
+            const std::string& path = it->first;
+            bool in_directory = path.compare(0, prefix.size(), prefix) == 0 &&
+                                (recursive || path.find(DIR_SEP_CHR, prefix.size()) == std::string::npos);
+            if (in_directory && found.count(path) == 0) {
+                it = entries.erase(it);
+                dirty = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    Save();
+
+    if (finished_callback)
+        finished_callback();
+}
+
+bool TitleIndex::LoadCache() {
+    std::vector<u8> buffer;
+    {
+        FileUtil::IOFile file(cache_path, "rb");
+        if (!file.IsOpen())
+            return false;
+
+        buffer.resize(file.GetSize());
+        if (buffer.empty() || file.ReadBytes(buffer.data(), buffer.size()) != buffer.size())
+            return false;
+    }
+
+    CacheReader reader(buffer);
+
+    u32 magic, version, num_entries;
+    if (!reader.Read(magic) || !reader.Read(version) || !reader.Read(num_entries) ||
+        INDEX_MAGIC != magic || INDEX_VERSION != version) {
+        LOG_WARNING(Loader, "Ignoring outdated title index %s", cache_path.c_str());
+        return false;
+    }
+
+    std::unordered_map<std::string, TitleInfo> loaded_entries;
+    for (u32 i = 0; i < num_entries; ++i) {
+        TitleInfo info;
+        u32 type;
+        if (!reader.ReadBytes(info.path) || !reader.Read(info.file_size) ||
+            !reader.Read(info.modification_time) || !reader.Read(type) ||
+            !reader.Read(info.program_id) || !reader.ReadBytes(info.title) ||
+            !reader.ReadBytes(info.icon)) {
+            LOG_ERROR(Loader, "Title index %s is corrupted", cache_path.c_str());
+            return false;
+        }
+        info.type = static_cast<FileType>(type);
+
+        std::string path = info.path;
+        loaded_entries.emplace(std::move(path), std::move(info));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries = std::move(loaded_entries);
+    dirty = false;
+
+    LOG_DEBUG(Loader, "Loaded %u entries from title index %s", num_entries, cache_path.c_str());
+    return true;
+}
+
+bool TitleIndex::Save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!dirty)
+        return true;
+
+    std::vector<u8> buffer;
+    Write(buffer, INDEX_MAGIC);
+    Write(buffer, INDEX_VERSION);
+    Write(buffer, static_cast<u32>(entries.size()));
+
+    for (const auto& entry : entries) {
+        const TitleInfo& info = entry.second;
+        WriteBytes(buffer, info.path.data(), static_cast<u32>(info.path.size()));
+        Write(buffer, info.file_size);
+        Write(buffer, info.modification_time);
+        Write(buffer, static_cast<u32>(info.type));
+        Write(buffer, info.program_id);
+        WriteBytes(buffer, info.title.data(), static_cast<u32>(info.title.size()));
+        WriteBytes(buffer, info.icon.data(), static_cast<u32>(info.icon.size()));
+    }
+
+    FileUtil::CreateFullPath(cache_path);
+    FileUtil::IOFile file(cache_path, "wb");
+    if (!file.IsOpen() || file.WriteBytes(buffer.data(), buffer.size()) != buffer.size()) {
+        LOG_ERROR(Loader, "Failed to write title index %s", cache_path.c_str());
+        return false;
+    }
+
+    dirty = false;
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,105 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/loader/loader.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Loader namespace
+
+namespace Loader {
+
+/// Metadata of a bootable file, as shown in game lists
+struct TitleInfo {
+    std::string path;
+    u64 file_size = 0;
+    u64 modification_time = 0;   ///< In seconds since the epoch
+
+    FileType type = FileType::Unknown;
+    u64 program_id = 0;          ///< 0 if the file format doesn't have one
+    std::string title;           ///< English short title from the icon, or the file name
+    std::vector<u8> icon;        ///< Large (48x48) icon in the SMDH's tiled RGB565 format, if any
+};
+
+/**
+ * Cache of title metadata, keyed by path and invalidated by file size and modification time.
+ * Files are only opened and parsed when they aren't in the index yet or changed since they were
+ * indexed, so game lists don't have to parse every header when they are populated. The index is
+ * persisted to disk, and a directory can be scanned for titles on a background thread.
+ * All functions are thread-safe.
+ */
+class TitleIndex final {
+public:
+    /// Called from the scanner thread for each title found, with the path of its file
+    using ScanCallback = std::function<void(const std::string& path)>;
+    /// Called from the scanner thread once a scan finished or was stopped
+    using ScanFinishedCallback = std::function<void()>;
+
+    /**
+     * @param cache_path Path of the file the index is persisted to. The index is loaded from it
+     *                   if it exists.
+     */
+    explicit TitleIndex(const std::string& cache_path);
+
+    /// Stops the scanner and saves the index if it changed
+    ~TitleIndex();
+
+    /**
+     * Looks up the metadata of a file, parsing the file if it isn't indexed or is out-of-date.
+     * @param path Path of the file
+     * @param info Reference to store the metadata into
+     * @return True if the file is a bootable file of a known type
+     */
+    bool Lookup(const std::string& path, TitleInfo& info);
+
+    /// Returns the metadata of all indexed bootable files
+    std::vector<TitleInfo> GetTitles() const;
+
+    /**
+     * Starts scanning a directory for bootable files on a background thread, indexing each of
+     * them. Indexed files which aren't found in the directory are removed from the index. The
+     * index is saved once the scan is done. A scan which is still running is stopped first.
+     * @param directory Directory to scan
+     * @param recursive Whether to scan subdirectories, too
+     * @param callback Called for each bootable file found
+     * @param finished_callback Called once the scan is done
+     */
+    void StartScan(const std::string& directory, bool recursive, ScanCallback callback,
+                   ScanFinishedCallback finished_callback);
+
+    /// Stops the running scan, if any, and waits for the scanner thread
+    void StopScan();
+
+    /// Saves the index to its cache file if it changed since it was loaded or last saved
+    bool Save();
+
+private:
+    /// Loads the index from its cache file, replacing the current entries
+    bool LoadCache();
+
+    void ScanLoop(std::string directory, bool recursive, ScanCallback callback,
+                  ScanFinishedCallback finished_callback);
+
+    std::string cache_path;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, TitleInfo> entries; ///< Guarded by mutex
+    bool dirty = false;                                 ///< Guarded by mutex
+
+    std::thread scanner;
+    std::atomic<bool> stop_scan;
+};
+
+} // namespace
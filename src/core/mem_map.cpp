@@ -3,12 +3,13 @@
 // Refer to the license.txt file included.
 
 #include <map>
-#include <memory>
 #include <utility>
-#include <vector>
 
+#include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
+#include "common/memory_util.h"
 
 #include "core/hle/config_mem.h"
 #include "core/hle/kernel/vm_manager.h"
@@ -27,17 +28,18 @@ namespace {
 struct MemoryArea {
     u32 base;
     u32 size;
+    PAddr paddr; ///< Physical address the area is visible at, or 0 if it has none
     const char* name;
 };
 
-// We don't declare the IO regions in here since its handled by other means.
+// The IO registers aren't declared in here since they are mapped as MMIO instead.
 static MemoryArea memory_areas[] = {
-    {HEAP_VADDR,          HEAP_SIZE,              "Heap"},          // Application heap (main memory)
-    {SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE,     "Shared Memory"}, // Shared memory
-    {LINEAR_HEAP_VADDR,   LINEAR_HEAP_SIZE,       "Linear Heap"},   // Linear heap (main memory)
-    {VRAM_VADDR,          VRAM_SIZE,              "VRAM"},          // Video memory (VRAM)
-    {DSP_RAM_VADDR,       DSP_RAM_SIZE,           "DSP RAM"},       // DSP memory
-    {TLS_AREA_VADDR,      TLS_AREA_SIZE,          "TLS Area"},      // TLS memory
+    {HEAP_VADDR,          HEAP_SIZE,          0,             "Heap"},          // Application heap (main memory)
+    {SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE, 0,             "Shared Memory"}, // Shared memory
+    {LINEAR_HEAP_VADDR,   LINEAR_HEAP_SIZE,   FCRAM_PADDR,   "Linear Heap"},   // Linear heap (main memory)
+    {VRAM_VADDR,          VRAM_SIZE,          VRAM_PADDR,    "VRAM"},          // Video memory (VRAM)
+    {DSP_RAM_VADDR,       DSP_RAM_SIZE,       DSP_RAM_PADDR, "DSP RAM"},       // DSP memory
+    {TLS_AREA_VADDR,      TLS_AREA_SIZE,      0,             "TLS Area"},      // TLS memory
 };
 
 /// Represents a block of memory mapped by ControlMemory/MapMemoryBlock
@@ -54,11 +56,28 @@ struct MemoryBlock {
     const u32 GetVirtualAddress() const{
         return base_address + address;
     }
+
+    void DoState(PointerWrap& p) {
+        p.Do(handle);
+        p.Do(base_address);
+        p.Do(address);
+        p.Do(size);
+        p.Do(operation);
+        p.Do(permissions);
+    }
 };
 
 static std::map<u32, MemoryBlock> heap_map;
 static std::map<u32, MemoryBlock> heap_linear_map;
 
+/**
+ * Single huge page backed allocation holding all of the memory_areas back to back, so guest
+ * accesses to FCRAM, VRAM and DSP RAM cause as few host TLB misses as possible. Every legacy
+ * address space maps the same arena, since there is only ever one application process.
+ */
+static u8* arena = nullptr;
+static size_t arena_size = 0;
+
 }
 
 u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions) {
@@ -133,17 +152,37 @@ VAddr PhysicalToVirtualAddress(const PAddr addr) {
 
 void Init() {
     InitMemoryMap();
+
+    arena_size = 0;
+    for (const MemoryArea& area : memory_areas)
+        arena_size += area.size;
+
+    arena = static_cast<u8*>(AllocateLargeMemoryPages(arena_size));
+    ASSERT_MSG(arena != nullptr, "failed to allocate the emulated memory");
+
+    // The physical view of the arena never changes, so it only has to be set up once
+    u8* area_memory = arena;
+    for (const MemoryArea& area : memory_areas) {
+        if (area.paddr != 0)
+            MapPhysicalRegion(area.paddr, area.size, area_memory);
+        area_memory += area.size;
+    }
+
     LOG_DEBUG(HW_Memory, "initialized OK");
 }
 
 void InitLegacyAddressSpace(Kernel::VMManager& address_space) {
     using namespace Kernel;
 
-    for (MemoryArea& area : memory_areas) {
-        auto block = std::make_shared<std::vector<u8>>(area.size);
-        address_space.MapMemoryBlock(area.base, std::move(block), 0, area.size, MemoryState::Private).Unwrap();
+    u8* area_memory = arena;
+    for (const MemoryArea& area : memory_areas) {
+        address_space.MapBackingMemory(area.base, area_memory, area.size, MemoryState::Private).Unwrap();
+        area_memory += area.size;
     }
 
+    // Only the part of the IO area below VRAM is actually used by devices
+    address_space.MapMMIO(IO_AREA_VADDR, IO_AREA_PADDR, VRAM_VADDR - IO_AREA_VADDR, MemoryState::IO).Unwrap();
+
     auto cfg_mem_vma = address_space.MapBackingMemory(CONFIG_MEMORY_VADDR,
             (u8*)&ConfigMem::config_mem, CONFIG_MEMORY_SIZE, MemoryState::Shared).MoveFrom();
     address_space.Reprotect(cfg_mem_vma, VMAPermission::Read);
@@ -154,10 +193,39 @@ void InitLegacyAddressSpace(Kernel::VMManager& address_space) {
 }
 
 void Shutdown() {
+    for (const MemoryArea& area : memory_areas) {
+        if (area.paddr != 0)
+            MapPhysicalRegion(area.paddr, area.size, nullptr);
+    }
+
+    FreeLargeMemoryPages(arena, arena_size);
+    arena = nullptr;
+    arena_size = 0;
+
     heap_map.clear();
     heap_linear_map.clear();
 
     LOG_DEBUG(HW_Memory, "shutdown OK");
 }
 
+u8* GetArena() {
+    return arena;
+}
+
+size_t GetArenaSize() {
+    return arena_size;
+}
+
+void DoState(PointerWrap& p) {
+    auto s = p.Section("Memory", 2);
+    if (!s)
+        return;
+
+    p.Do(heap_map);
+    p.Do(heap_linear_map);
+
+    p.DoVoid(&ConfigMem::config_mem, sizeof(ConfigMem::config_mem));
+    p.DoVoid(&SharedPage::shared_page, sizeof(SharedPage::shared_page));
+}
+
 } // namespace
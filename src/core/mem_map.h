@@ -4,8 +4,12 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "common/common_types.h"
 
+class PointerWrap;
+
 namespace Kernel {
 class VMManager;
 }
@@ -16,6 +20,16 @@ void Init();
 void InitLegacyAddressSpace(Kernel::VMManager& address_space);
 void Shutdown();
 
+/**
+ * Returns the host memory backing all of the emulated memory areas, in one contiguous block.
+ * Save states store the arena page by page, next to the state saved by DoState.
+ */
+u8* GetArena();
+size_t GetArenaSize();
+
+/// Saves or restores the heap block bookkeeping and the kernel's shared pages
+void DoState(PointerWrap& p);
+
 /**
  * Maps a block of memory on the heap
  * @param size Size of block in bytes
@@ -2,93 +2,282 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
 
 #include "common/assert.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
+#include "common/memory_util.h"
 #include "common/swap.h"
 
+#include "core/core.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
 #include "core/memory_setup.h"
+#include "core/mmio.h"
+#include "core/arm/arm_interface.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MEMORY_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace Memory {
 
-enum class PageType {
-    /// Page is unmapped and should cause an access error.
-    Unmapped,
-    /// Page is mapped to regular memory. This is the only type you can get pointers to.
-    Memory,
-    /// Page is mapped to a I/O region. Writing and reading to this page is handled by functions.
-    Special,
+PageTable::PageTable() {
+    // Freshly allocated pages read as zero, which is exactly the state of an empty table (null
+    // pointers, zero stamps, Unmapped attributes and no code), so nothing needs to be touched here.
+    allocation = AllocateMemoryPages(ALLOCATION_SIZE);
+    ASSERT_MSG(allocation != nullptr, "failed to allocate page table");
+
+    u8* data = static_cast<u8*>(allocation);
+    pointers = reinterpret_cast<u8**>(data);
+    write_pointers = pointers + NUM_ENTRIES;
+    mmio_handlers = reinterpret_cast<MMIORegion**>(write_pointers + NUM_ENTRIES);
+    write_stamps = reinterpret_cast<u32*>(mmio_handlers + NUM_ENTRIES);
+    attributes = reinterpret_cast<PageType*>(write_stamps + NUM_ENTRIES);
+    code_pages = reinterpret_cast<bool*>(attributes + NUM_ENTRIES);
+}
+
+PageTable::~PageTable() {
+    FreeMemoryPages(allocation, ALLOCATION_SIZE);
+}
+
+/// Page table with nothing mapped, active while no process is running
+static PageTable* empty_page_table = nullptr;
+/// Currently active page table
+static PageTable* current_page_table = nullptr;
+
+u8** current_page_pointers = nullptr;
+u8** current_page_write_pointers = nullptr;
+
+/// Host pointers backing each physical page, or null for pages without memory behind them
+static u8** physical_pointers = nullptr;
+
+/// Incremented whenever a write to a tracked page is detected. Shared by all page tables.
+static u32 write_stamp = 0;
+
+struct Watchpoint {
+    VAddr address;
+    u32 size;
+    WatchpointType type;
 };
 
+static std::vector<Watchpoint> watchpoints;
+/// Memory backing the pages of the active address space which are marked as watched
+static std::unordered_map<u32, u8*> watched_pages;
+
+static bool watchpoint_hit_pending = false;
+static WatchpointHit pending_watchpoint_hit;
+
+/// Registered I/O handlers, indexed by physical page inside the IO area
+static std::array<MMIORegion*, IO_AREA_SIZE / PAGE_SIZE> io_handlers;
+
+void RegisterMMIO(PAddr base, u32 size, MMIORegion* handler) {
+    ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
+    ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
+    ASSERT_MSG(base >= IO_AREA_PADDR && base + size <= IO_AREA_PADDR_END,
+               "MMIO range %08X-%08X outside of the IO area", base, base + size);
+
+    auto first = io_handlers.begin() + (base - IO_AREA_PADDR) / PAGE_SIZE;
+    std::fill(first, first + size / PAGE_SIZE, handler);
+}
+
+MMIORegion* GetMMIOHandler(PAddr addr) {
+    if (addr < IO_AREA_PADDR || addr >= IO_AREA_PADDR_END)
+        return nullptr;
+    return io_handlers[(addr - IO_AREA_PADDR) / PAGE_SIZE];
+}
+
+/// Fills `count` page pointers with consecutive pages of `memory`, or with null if it is null
+static void FillPagePointers(u8** pointers, u32 count, u8* memory) {
+    if (memory == nullptr) {
+        std::fill(pointers, pointers + count, nullptr);
+        return;
+    }
+
+    u32 page = 0;
+#ifdef MEMORY_SSE2
+    // Two pointers per store, moving both on by two pages every time
+    __m128i values = _mm_set_epi64x(reinterpret_cast<s64>(memory + PAGE_SIZE), reinterpret_cast<s64>(memory));
+    const __m128i step = _mm_set1_epi64x(2 * PAGE_SIZE);
+    for (; page + 2 <= count; page += 2) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pointers + page), values);
+        values = _mm_add_epi64(values, step);
+    }
+#endif
+    for (; page != count; ++page)
+        pointers[page] = memory + static_cast<size_t>(page) * PAGE_SIZE;
+}
+
 /**
- * A (reasonably) fast way of allowing switchable and remmapable process address spaces. It loosely
- * mimics the way a real CPU page table works, but instead is optimized for minimal decoding and
- * fetching requirements when acessing. In the usual case of an access to regular memory, it only
- * requires an indexed fetch and a check for NULL.
+ * Points the given range of pages at consecutive pages of `memory`. Each array is filled in one
+ * pass, and all pages get the same write stamp, so that large mappings are cheap to update.
  */
-struct PageTable {
-    static const size_t NUM_ENTRIES = 1 << (32 - PAGE_BITS);
-
-    /**
-     * Array of memory pointers backing each page. An entry can only be non-null if the
-     * corresponding entry in the `attributes` array is of type `Memory`.
-     */
-    std::array<u8*, NUM_ENTRIES> pointers;
-
-    /**
-     * Array of fine grained page attributes. If it is set to any value other than `Memory`, then
-     * the corresponding entry in `pointer` MUST be set to null.
-     */
-    std::array<PageType, NUM_ENTRIES> attributes;
-};
+static void FillPages(PageTable& page_table, u32 begin, u32 end, u8* memory, PageType type) {
+    std::fill(page_table.attributes + begin, page_table.attributes + end, type);
+    std::fill(page_table.mmio_handlers + begin, page_table.mmio_handlers + end, nullptr);
+    std::fill(page_table.write_stamps + begin, page_table.write_stamps + end, ++write_stamp);
+    std::fill(page_table.code_pages + begin, page_table.code_pages + end, false);
+    FillPagePointers(page_table.pointers + begin, end - begin, memory);
+    FillPagePointers(page_table.write_pointers + begin, end - begin, memory);
+}
 
-/// Singular page table used for the singleton process
-static PageTable main_page_table;
-/// Currently active page table
-static PageTable* current_page_table = &main_page_table;
+/// Restores the fast path of the watched pages of the active address space
+static void UnwatchPages() {
+    for (const auto& page : watched_pages) {
+        // Pages remapped since they were watched already have their new pointers
+        if (current_page_table->attributes[page.first] != PageType::Watched)
+            continue;
+
+        current_page_table->attributes[page.first] = PageType::Memory;
+        current_page_table->pointers[page.first] = page.second;
+        // Let the next write take the slow path, in case the page's writes are being tracked
+        current_page_table->write_pointers[page.first] = nullptr;
+    }
+    watched_pages.clear();
+}
 
-static void MapPages(u32 base, u32 size, u8* memory, PageType type) {
-    LOG_DEBUG(HW_Memory, "Mapping %p onto %08X-%08X", memory, base * PAGE_SIZE, (base + size) * PAGE_SIZE);
+/// Marks the pages of the active address space overlapping a watchpoint as watched
+static void WatchPages() {
+    for (const Watchpoint& watchpoint : watchpoints) {
+        const u32 first_page = watchpoint.address >> PAGE_BITS;
+        const u32 last_page = (u32)std::min<u64>(((u64)watchpoint.address + watchpoint.size - 1) >> PAGE_BITS,
+                                                 PageTable::NUM_ENTRIES - 1);
+
+        for (u32 page = first_page; page <= last_page; ++page) {
+            if (current_page_table->attributes[page] != PageType::Memory)
+                continue;
+
+            watched_pages.emplace(page, current_page_table->pointers[page]);
+            current_page_table->attributes[page] = PageType::Watched;
+            current_page_table->pointers[page] = nullptr;
+            current_page_table->write_pointers[page] = nullptr;
+        }
+    }
+}
 
-    u32 end = base + size;
+static void RefreshWatchedPages() {
+    UnwatchPages();
+    WatchPages();
+}
+
+static u8* GetWatchedPagePointer(u32 page_index) {
+    return watched_pages.at(page_index);
+}
 
-    while (base != end) {
-        ASSERT_MSG(base < PageTable::NUM_ENTRIES, "out of range mapping at %08X", base);
+/// Logs accesses overlapping a watchpoint and stops the CPU at them
+static void CheckWatchpoints(VAddr address, u32 size, bool write) {
+    const u8 access_type = (u8)(write ? WatchpointType::Write : WatchpointType::Read);
+
+    for (const Watchpoint& watchpoint : watchpoints) {
+        if (((u8)watchpoint.type & access_type) == 0 ||
+                (u64)address + size <= watchpoint.address ||
+                address >= (u64)watchpoint.address + watchpoint.size)
+            continue;
+
+        const u32 pc = Core::g_app_core != nullptr ? Core::g_app_core->GetPC() : 0;
+        LOG_INFO(HW_Memory, "Watchpoint hit: %s of %u bytes @ 0x%08X (pc = 0x%08X)",
+                 write ? "write" : "read", size, address, pc);
+
+        if (!watchpoint_hit_pending) {
+            pending_watchpoint_hit = { address, size, write, pc };
+            watchpoint_hit_pending = true;
+        }
+        if (Core::g_app_core != nullptr)
+            Core::g_app_core->PrepareReschedule();
+        return;
+    }
+}
 
-        current_page_table->attributes[base] = type;
-        current_page_table->pointers[base] = memory;
+static void MapPages(PageTable& page_table, u32 base, u32 size, u8* memory, PageType type) {
+    LOG_DEBUG(HW_Memory, "Mapping %p onto %08X-%08X", memory, base * PAGE_SIZE, (base + size) * PAGE_SIZE);
 
-        base += 1;
-        if (memory != nullptr)
-            memory += PAGE_SIZE;
+    u32 end = base + size;
+    ASSERT_MSG(end <= PageTable::NUM_ENTRIES, "out of range mapping at %08X", base);
+
+    if (type != PageType::Unmapped) {
+        FillPages(page_table, base, end, memory, type);
+    } else {
+        // Leave pages which are already unmapped alone, so that unmapping large free regions
+        // doesn't force the untouched parts of the table into memory
+        while (base != end) {
+            while (base != end && page_table.attributes[base] == PageType::Unmapped)
+                ++base;
+            if (base == end)
+                break;
+
+            u32 run_end = base;
+            while (run_end != end && page_table.attributes[run_end] != PageType::Unmapped)
+                ++run_end;
+
+            FillPages(page_table, base, run_end, nullptr, PageType::Unmapped);
+            base = run_end;
+        }
     }
+
+    // The remapped pages may have been watched, or may need to be now
+    if (&page_table == current_page_table && !watchpoints.empty())
+        RefreshWatchedPages();
 }
 
 void InitMemoryMap() {
-    main_page_table.pointers.fill(nullptr);
-    main_page_table.attributes.fill(PageType::Unmapped);
+    if (empty_page_table == nullptr)
+        empty_page_table = new PageTable;
+    if (physical_pointers == nullptr) {
+        // Lazily backed like the page tables, so only the parts covering memory use any space
+        physical_pointers = static_cast<u8**>(AllocateMemoryPages(PageTable::NUM_ENTRIES * sizeof(u8*)));
+        ASSERT_MSG(physical_pointers != nullptr, "failed to allocate physical page table");
+    }
+    SetCurrentPageTable(nullptr);
+}
+
+void SetCurrentPageTable(PageTable* page_table) {
+    // Watchpoints follow the active address space
+    if (current_page_table != nullptr)
+        UnwatchPages();
+
+    current_page_table = page_table != nullptr ? page_table : empty_page_table;
+    current_page_pointers = current_page_table->pointers;
+    current_page_write_pointers = current_page_table->write_pointers;
+
+    WatchPages();
 }
 
-void MapMemoryRegion(VAddr base, u32 size, u8* target) {
+PageTable* GetCurrentPageTable() {
+    return current_page_table != empty_page_table ? current_page_table : nullptr;
+}
+
+void MapMemoryRegion(PageTable& page_table, VAddr base, u32 size, u8* target) {
+    ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
+    ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
+    MapPages(page_table, base / PAGE_SIZE, size / PAGE_SIZE, target, PageType::Memory);
+}
+
+void MapIoRegion(PageTable& page_table, VAddr base, u32 size, PAddr paddr) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, target, PageType::Memory);
+    MapPages(page_table, base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Special);
+
+    for (u32 offset = 0; offset < size; offset += PAGE_SIZE)
+        page_table.mmio_handlers[(base + offset) / PAGE_SIZE] = GetMMIOHandler(paddr + offset);
 }
 
-void MapIoRegion(VAddr base, u32 size) {
+void MapPhysicalRegion(PAddr base, u32 size, u8* target) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Special);
+
+    FillPagePointers(physical_pointers + base / PAGE_SIZE, size / PAGE_SIZE, target);
 }
 
-void UnmapRegion(VAddr base, u32 size) {
+void UnmapRegion(PageTable& page_table, VAddr base, u32 size) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Unmapped);
+    MapPages(page_table, base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Unmapped);
 }
 
 template <typename T>
@@ -105,22 +294,102 @@ T Read(const VAddr vaddr) {
         return 0;
     case PageType::Memory:
         ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
-    case PageType::Special:
-        LOG_ERROR(HW_Memory, "I/O reads aren't implemented yet @ %08X", vaddr);
+    case PageType::Special: {
+        MMIORegion* handler = current_page_table->mmio_handlers[vaddr >> PAGE_BITS];
+        if (handler != nullptr) {
+            T value;
+            ReadMMIO(handler, vaddr, value);
+            return value;
+        }
+        LOG_ERROR(HW_Memory, "unhandled I/O Read%lu @ 0x%08X", sizeof(T) * 8, vaddr);
         return 0;
+    }
+    case PageType::Watched:
+        CheckWatchpoints(vaddr, sizeof(T), false);
+        return *reinterpret_cast<const T*>(GetWatchedPagePointer(vaddr >> PAGE_BITS) + (vaddr & PAGE_MASK));
     default:
         UNREACHABLE();
     }
 }
 
+/// Arena page copied into the snapshot, and the pages it was copied for
+struct SnapshotPage {
+    size_t arena_offset;
+    u32 page_index;  ///< Page of the active address space
+    PAddr paddr;     ///< Physical address of the page, or 0 for the heap
+};
+
+static bool snapshot_active = false;
+static std::vector<SnapshotPage> snapshot_pages;
+/// Contents of the snapshot_pages, in the same order
+static std::vector<u8> snapshot_data;
+/// One plus the index into snapshot_pages of each page of the arena, or 0 if it hasn't been copied
+static std::vector<u32> snapshot_slots;
+
+/// Returns the physical address of a page of the address space, or 0 if it has none
+static PAddr GetPagePhysicalAddress(u32 page_index) {
+    const VAddr vaddr = page_index << PAGE_BITS;
+    if ((vaddr >= LINEAR_HEAP_VADDR && vaddr < LINEAR_HEAP_VADDR_END) ||
+            (vaddr >= VRAM_VADDR && vaddr < VRAM_VADDR_END) ||
+            (vaddr >= DSP_RAM_VADDR && vaddr < DSP_RAM_VADDR_END))
+        return VirtualToPhysicalAddress(vaddr);
+    return 0;
+}
+
+/// Copies a page of the arena into the snapshot, unless it's already there or outside of the arena
+static void CopyPageToSnapshot(const u8* page_memory, u32 page_index) {
+    const u8* arena = GetArena();
+    if (page_memory < arena || page_memory >= arena + GetArenaSize())
+        return;
+
+    const size_t arena_offset = page_memory - arena;
+    u32& slot = snapshot_slots[arena_offset / PAGE_SIZE];
+    if (slot != 0)
+        return;
+
+    snapshot_pages.push_back({ arena_offset, page_index, GetPagePhysicalAddress(page_index) });
+    slot = static_cast<u32>(snapshot_pages.size());
+    snapshot_data.insert(snapshot_data.end(), page_memory, page_memory + PAGE_SIZE);
+}
+
+/**
+ * Records the first write to a page whose writes are being tracked, and lets any further ones take
+ * the fast path until tracking is requested again. Watched pages stay on the slow path, and record
+ * every write.
+ */
+static void RecordTrackedWrite(u32 page_index) {
+    if (snapshot_active) {
+        const bool watched = current_page_table->attributes[page_index] == PageType::Watched;
+        CopyPageToSnapshot(watched ? GetWatchedPagePointer(page_index) : current_page_table->pointers[page_index],
+                           page_index);
+    }
+
+    current_page_table->write_stamps[page_index] = ++write_stamp;
+    current_page_table->write_pointers[page_index] = current_page_table->pointers[page_index];
+
+    // Code translated from the page may be about to change
+    if (current_page_table->code_pages[page_index]) {
+        current_page_table->code_pages[page_index] = false;
+        if (Core::g_app_core != nullptr)
+            Core::g_app_core->InvalidateCacheRange(page_index << PAGE_BITS, PAGE_SIZE);
+    }
+}
+
 template <typename T>
 void Write(const VAddr vaddr, const T data) {
-    u8* page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
+    u8* page_pointer = current_page_table->write_pointers[vaddr >> PAGE_BITS];
     if (page_pointer) {
         *reinterpret_cast<T*>(page_pointer + (vaddr & PAGE_MASK)) = data;
         return;
     }
 
+    page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
+    if (page_pointer) {
+        RecordTrackedWrite(vaddr >> PAGE_BITS);
+        *reinterpret_cast<T*>(page_pointer + (vaddr & PAGE_MASK)) = data;
+        return;
+    }
+
     PageType type = current_page_table->attributes[vaddr >> PAGE_BITS];
     switch (type) {
     case PageType::Unmapped:
@@ -128,8 +397,19 @@ void Write(const VAddr vaddr, const T data) {
         return;
     case PageType::Memory:
         ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
-    case PageType::Special:
-        LOG_ERROR(HW_Memory, "I/O writes aren't implemented yet @ %08X", vaddr);
+    case PageType::Special: {
+        MMIORegion* handler = current_page_table->mmio_handlers[vaddr >> PAGE_BITS];
+        if (handler != nullptr) {
+            WriteMMIO(handler, vaddr, data);
+            return;
+        }
+        LOG_ERROR(HW_Memory, "unhandled I/O Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32) data, vaddr);
+        return;
+    }
+    case PageType::Watched:
+        CheckWatchpoints(vaddr, sizeof(T), true);
+        RecordTrackedWrite(vaddr >> PAGE_BITS);
+        *reinterpret_cast<T*>(GetWatchedPagePointer(vaddr >> PAGE_BITS) + (vaddr & PAGE_MASK)) = data;
         return;
     default:
         UNREACHABLE();
@@ -139,15 +419,186 @@ void Write(const VAddr vaddr, const T data) {
 u8* GetPointer(const VAddr vaddr) {
     u8* page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
     if (page_pointer) {
+        // The caller may write through the pointer
+        if (snapshot_active)
+            CopyPageToSnapshot(page_pointer, vaddr >> PAGE_BITS);
         return page_pointer + (vaddr & PAGE_MASK);
     }
 
+    // Accesses through the pointer aren't checked against the watchpoints
+    if (current_page_table->attributes[vaddr >> PAGE_BITS] == PageType::Watched) {
+        if (snapshot_active)
+            CopyPageToSnapshot(GetWatchedPagePointer(vaddr >> PAGE_BITS), vaddr >> PAGE_BITS);
+        return GetWatchedPagePointer(vaddr >> PAGE_BITS) + (vaddr & PAGE_MASK);
+    }
+
     LOG_ERROR(HW_Memory, "unknown GetPointer @ 0x%08x", vaddr);
     return nullptr;
 }
 
+bool IsValidVirtualAddress(const VAddr vaddr) {
+    return current_page_table->pointers[vaddr >> PAGE_BITS] != nullptr ||
+           current_page_table->attributes[vaddr >> PAGE_BITS] == PageType::Watched;
+}
+
 u8* GetPhysicalPointer(PAddr address) {
-    return GetPointer(PhysicalToVirtualAddress(address));
+    u8* page_pointer = physical_pointers[address >> PAGE_BITS];
+    if (page_pointer) {
+        return page_pointer + (address & PAGE_MASK);
+    }
+
+    LOG_ERROR(HW_Memory, "unknown GetPhysicalPointer @ 0x%08X", address);
+    return nullptr;
+}
+
+void TrackPhysicalWrites(PAddr address, u32 size) {
+    if (size == 0)
+        return;
+
+    const VAddr vaddr = PhysicalToVirtualAddress(address);
+    for (u32 page = vaddr >> PAGE_BITS; page <= (vaddr + size - 1) >> PAGE_BITS; ++page) {
+        if (current_page_table->attributes[page] == PageType::Memory)
+            current_page_table->write_pointers[page] = nullptr;
+    }
+}
+
+void WatchCodePage(VAddr address) {
+    const u32 page = address >> PAGE_BITS;
+    const PageType type = current_page_table->attributes[page];
+    if (type == PageType::Memory || type == PageType::Watched) {
+        current_page_table->code_pages[page] = true;
+        current_page_table->write_pointers[page] = nullptr;
+    }
+}
+
+void AddWatchpoint(VAddr address, u32 size, WatchpointType type) {
+    ASSERT_MSG(size != 0, "empty watchpoint @ %08X", address);
+    watchpoints.push_back({ address, size, type });
+    RefreshWatchedPages();
+}
+
+void RemoveWatchpoint(VAddr address, u32 size) {
+    watchpoints.erase(std::remove_if(watchpoints.begin(), watchpoints.end(), [&](const Watchpoint& watchpoint) {
+        return watchpoint.address == address && watchpoint.size == size;
+    }), watchpoints.end());
+    RefreshWatchedPages();
+}
+
+void ClearWatchpoints() {
+    watchpoints.clear();
+    UnwatchPages();
+    watchpoint_hit_pending = false;
+}
+
+bool HasWatchpointHit() {
+    return watchpoint_hit_pending;
+}
+
+bool PopWatchpointHit(WatchpointHit& hit) {
+    if (!watchpoint_hit_pending)
+        return false;
+    hit = pending_watchpoint_hit;
+    watchpoint_hit_pending = false;
+    return true;
+}
+
+u32 GetWriteStamp() {
+    return write_stamp;
+}
+
+bool PhysicalWrittenSince(PAddr address, u32 size, u32 stamp) {
+    if (size == 0)
+        return false;
+
+    const VAddr vaddr = PhysicalToVirtualAddress(address);
+    for (u32 page = vaddr >> PAGE_BITS; page <= (vaddr + size - 1) >> PAGE_BITS; ++page) {
+        if (current_page_table->write_stamps[page] > stamp)
+            return true;
+    }
+    return false;
+}
+
+void RecordPhysicalWrite(PAddr address, u32 size) {
+    if (size == 0)
+        return;
+
+    const VAddr vaddr = PhysicalToVirtualAddress(address);
+    const u32 stamp = ++write_stamp;
+    for (u32 page = vaddr >> PAGE_BITS; page <= (vaddr + size - 1) >> PAGE_BITS; ++page)
+        current_page_table->write_stamps[page] = stamp;
+}
+
+void BeginSnapshot() {
+    EndSnapshot();
+    snapshot_slots.resize(GetArenaSize() / PAGE_SIZE);
+    snapshot_active = true;
+
+    // Sends the next CPU write to each page through RecordTrackedWrite, which copies the page
+    for (size_t page = 0; page < PageTable::NUM_ENTRIES; ++page) {
+        if (current_page_table->attributes[page] == PageType::Memory)
+            current_page_table->write_pointers[page] = nullptr;
+    }
+}
+
+void SnapshotPhysicalRegion(PAddr address, u32 size) {
+    if (!snapshot_active || size == 0)
+        return;
+
+    for (u32 page = address >> PAGE_BITS; page <= (address + size - 1) >> PAGE_BITS; ++page) {
+        const u8* page_memory = physical_pointers[page];
+        if (page_memory != nullptr)
+            CopyPageToSnapshot(page_memory, PhysicalToVirtualAddress(page << PAGE_BITS) >> PAGE_BITS);
+    }
+}
+
+u32 RestoreSnapshot(std::vector<PhysicalRegion>& changed_regions) {
+    u8* arena = GetArena();
+    const u32 stamp = ++write_stamp;
+    u32 num_changed = 0;
+
+    for (size_t i = 0; i < snapshot_pages.size(); ++i) {
+        u8* page_memory = arena + snapshot_pages[i].arena_offset;
+        const u8* contents = &snapshot_data[i * PAGE_SIZE];
+        if (std::memcmp(page_memory, contents, PAGE_SIZE) == 0)
+            continue;
+
+        std::memcpy(page_memory, contents, PAGE_SIZE);
+        ++num_changed;
+
+        const PAddr paddr = snapshot_pages[i].paddr;
+        if (paddr != 0) {
+            if (!changed_regions.empty() && changed_regions.back().address + changed_regions.back().size == paddr)
+                changed_regions.back().size += PAGE_SIZE;
+            else
+                changed_regions.push_back({ paddr, PAGE_SIZE });
+        }
+
+        // Caches which loaded the page since the snapshot began hold the contents it's losing
+        const u32 page_index = snapshot_pages[i].page_index;
+        current_page_table->write_stamps[page_index] = stamp;
+        if (current_page_table->code_pages[page_index]) {
+            current_page_table->code_pages[page_index] = false;
+            if (Core::g_app_core != nullptr)
+                Core::g_app_core->InvalidateCacheRange(page_index << PAGE_BITS, PAGE_SIZE);
+        }
+    }
+
+    EndSnapshot();
+    return num_changed;
+}
+
+void EndSnapshot() {
+    for (const SnapshotPage& page : snapshot_pages)
+        snapshot_slots[page.arena_offset / PAGE_SIZE] = 0;
+
+    // The buffers keep their capacity, since the next snapshot is likely to copy as many pages
+    snapshot_pages.clear();
+    snapshot_data.clear();
+    snapshot_active = false;
+}
+
+size_t GetSnapshotSize() {
+    return snapshot_data.size();
 }
 
 u8 Read8(const VAddr addr) {
@@ -182,20 +633,189 @@ void Write64(const VAddr addr, const u64 data) {
     Write<u64_le>(addr, data);
 }
 
-void WriteBlock(const VAddr addr, const u8* data, const size_t size) {
-    u32 offset = 0;
-    while (offset < (size & ~3)) {
-        Write32(addr + offset, *(u32*)&data[offset]);
-        offset += 4;
+/**
+ * Calls `func(vaddr, page, page_offset, amount)` for each page-sized span of the given range, in
+ * ascending order. Addresses wrap around at the end of the address space.
+ */
+template <typename Func>
+static void WalkBlock(const VAddr start_addr, const size_t size, Func func) {
+    size_t remaining_size = size;
+    u32 page_index = start_addr >> PAGE_BITS;
+    u32 page_offset = start_addr & PAGE_MASK;
+    size_t block_offset = 0;
+
+    while (remaining_size > 0) {
+        const size_t copy_amount = std::min<size_t>(PAGE_SIZE - page_offset, remaining_size);
+        func(block_offset, page_index, page_offset, copy_amount);
+
+        page_index = (page_index + 1) % PageTable::NUM_ENTRIES;
+        page_offset = 0;
+        block_offset += copy_amount;
+        remaining_size -= copy_amount;
     }
+}
 
-    if (size & 2) {
-        Write16(addr + offset, *(u16*)&data[offset]);
-        offset += 2;
+/// Returns a pointer to the given page for a block write, recording the write if it's tracked.
+static u8* GetPageForWrite(const u32 page_index) {
+    u8* page_pointer = current_page_table->write_pointers[page_index];
+    if (page_pointer == nullptr) {
+        page_pointer = current_page_table->pointers[page_index];
+        if (page_pointer != nullptr)
+            RecordTrackedWrite(page_index);
     }
+    return page_pointer;
+}
+
+void ReadBlock(const VAddr src_addr, void* dest_buffer, const size_t size) {
+    u8* dest = static_cast<u8*>(dest_buffer);
+
+    WalkBlock(src_addr, size, [&](size_t offset, u32 page_index, u32 page_offset, size_t amount) {
+        const u8* page_pointer = current_page_table->pointers[page_index];
+        if (page_pointer != nullptr) {
+            std::memcpy(dest + offset, page_pointer + page_offset, amount);
+            return;
+        }
+
+        const VAddr vaddr = (page_index << PAGE_BITS) + page_offset;
+        switch (current_page_table->attributes[page_index]) {
+        case PageType::Unmapped:
+            LOG_ERROR(HW_Memory, "unmapped ReadBlock @ 0x%08X (start address = 0x%08X, size = %u)",
+                      vaddr, src_addr, (u32)size);
+            break;
+        case PageType::Memory:
+            ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
+        case PageType::Special: {
+            MMIORegion* handler = current_page_table->mmio_handlers[page_index];
+            if (handler == nullptr) {
+                LOG_ERROR(HW_Memory, "unhandled I/O ReadBlock @ 0x%08X (start address = 0x%08X, size = %u)",
+                          vaddr, src_addr, (u32)size);
+                break;
+            }
+            // Registers are accessed with words where possible, since most devices only decode those
+            for (size_t i = 0; i < amount;) {
+                if (((vaddr + i) & 3) == 0 && amount - i >= 4) {
+                    u32 value = handler->Read32(vaddr + (u32)i);
+                    std::memcpy(dest + offset + i, &value, sizeof(value));
+                    i += 4;
+                } else {
+                    dest[offset + i] = handler->Read8(vaddr + (u32)i);
+                    i += 1;
+                }
+            }
+            return;
+        }
+        case PageType::Watched:
+            CheckWatchpoints(vaddr, (u32)amount, false);
+            std::memcpy(dest + offset, GetWatchedPagePointer(page_index) + page_offset, amount);
+            return;
+        default:
+            UNREACHABLE();
+        }
+        std::memset(dest + offset, 0, amount);
+    });
+}
+
+/// Writes to each span of the given range with `func(page_pointer, offset, amount)`
+template <typename Func>
+static void WriteBlockWith(const VAddr dest_addr, const size_t size, const char* name, Func func) {
+    WalkBlock(dest_addr, size, [&](size_t offset, u32 page_index, u32 page_offset, size_t amount) {
+        u8* page_pointer = GetPageForWrite(page_index);
+        if (page_pointer != nullptr) {
+            func(page_pointer + page_offset, offset, amount);
+            return;
+        }
+
+        const VAddr vaddr = (page_index << PAGE_BITS) + page_offset;
+        switch (current_page_table->attributes[page_index]) {
+        case PageType::Unmapped:
+            LOG_ERROR(HW_Memory, "unmapped %s @ 0x%08X (start address = 0x%08X, size = %u)",
+                      name, vaddr, dest_addr, (u32)size);
+            break;
+        case PageType::Memory:
+            ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
+        case PageType::Special: {
+            MMIORegion* handler = current_page_table->mmio_handlers[page_index];
+            if (handler == nullptr) {
+                LOG_ERROR(HW_Memory, "unhandled I/O %s @ 0x%08X (start address = 0x%08X, size = %u)",
+                          name, vaddr, dest_addr, (u32)size);
+                break;
+            }
+            // Produce the data in a staging buffer, then hand it to the device word by word
+            std::array<u8, PAGE_SIZE> staging;
+            func(staging.data(), offset, amount);
+            for (size_t i = 0; i < amount;) {
+                if (((vaddr + i) & 3) == 0 && amount - i >= 4) {
+                    u32 value;
+                    std::memcpy(&value, staging.data() + i, sizeof(value));
+                    handler->Write32(vaddr + (u32)i, value);
+                    i += 4;
+                } else {
+                    handler->Write8(vaddr + (u32)i, staging[i]);
+                    i += 1;
+                }
+            }
+            break;
+        }
+        case PageType::Watched:
+            CheckWatchpoints(vaddr, (u32)amount, true);
+            RecordTrackedWrite(page_index);
+            func(GetWatchedPagePointer(page_index) + page_offset, offset, amount);
+            break;
+        default:
+            UNREACHABLE();
+        }
+    });
+}
 
-    if (size & 1)
-        Write8(addr + offset, data[offset]);
+void WriteBlock(const VAddr dest_addr, const void* src_buffer, const size_t size) {
+    const u8* src = static_cast<const u8*>(src_buffer);
+    WriteBlockWith(dest_addr, size, "WriteBlock", [&](u8* dest, size_t offset, size_t amount) {
+        std::memcpy(dest, src + offset, amount);
+    });
+}
+
+bool GetHostSpansForWrite(const VAddr dest_addr, const size_t size, std::vector<HostSpan>& spans) {
+    bool all_memory = true;
+    WalkBlock(dest_addr, size, [&](size_t offset, u32 page_index, u32 page_offset, size_t amount) {
+        if (current_page_table->pointers[page_index] == nullptr)
+            all_memory = false;
+    });
+    if (!all_memory)
+        return false;
+
+    spans.clear();
+    WalkBlock(dest_addr, size, [&](size_t offset, u32 page_index, u32 page_offset, size_t amount) {
+        u8* pointer = GetPageForWrite(page_index) + page_offset;
+        if (!spans.empty() && spans.back().pointer + spans.back().size == pointer) {
+            spans.back().size += amount;
+        } else {
+            spans.push_back({ pointer, amount });
+        }
+    });
+    return true;
+}
+
+void ZeroBlock(const VAddr dest_addr, const size_t size) {
+    WriteBlockWith(dest_addr, size, "ZeroBlock", [](u8* dest, size_t offset, size_t amount) {
+        std::memset(dest, 0, amount);
+    });
+}
+
+void CopyBlock(const VAddr dest_addr, const VAddr src_addr, const size_t size) {
+    // Copy through a bounce buffer one page at a time. This handles unmapped pages on either side
+    // and keeps overlapping copies correct, as long as the copy direction matches the overlap.
+    std::array<u8, PAGE_SIZE> buffer;
+
+    const bool backwards = dest_addr > src_addr && dest_addr - src_addr < size;
+    size_t copied = 0;
+    while (copied < size) {
+        const size_t amount = std::min<size_t>(PAGE_SIZE, size - copied);
+        const size_t offset = backwards ? size - copied - amount : copied;
+
+        ReadBlock(static_cast<VAddr>(src_addr + offset), buffer.data(), amount);
+        WriteBlock(static_cast<VAddr>(dest_addr + offset), buffer.data(), amount);
+        copied += amount;
+    }
 }
 
 } // namespace
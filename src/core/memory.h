@@ -5,8 +5,10 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 
 #include "common/common_types.h"
+#include "common/swap.h"
 
 namespace Memory {
 
@@ -117,15 +119,232 @@ void Write16(VAddr addr, u16 data);
 void Write32(VAddr addr, u32 data);
 void Write64(VAddr addr, u64 data);
 
-void WriteBlock(VAddr addr, const u8* data, size_t size);
+/*
+ * Block accessors. These walk the page table once per page and copy each contiguous span with a
+ * single memcpy, instead of going through the scalar accessors byte by byte. Like the scalar
+ * accessors, they log unmapped and I/O accesses, with reads from such pages returning zeroes.
+ */
+
+/// Copies `size` bytes of emulated memory starting at `src_addr` into `dest_buffer`.
+void ReadBlock(VAddr src_addr, void* dest_buffer, size_t size);
+/// Copies `size` bytes from `src_buffer` into emulated memory starting at `dest_addr`.
+void WriteBlock(VAddr dest_addr, const void* src_buffer, size_t size);
+/// Fills `size` bytes of emulated memory starting at `dest_addr` with zeroes.
+void ZeroBlock(VAddr dest_addr, size_t size);
+/// Copies `size` bytes within emulated memory. The two ranges may overlap.
+void CopyBlock(VAddr dest_addr, VAddr src_addr, size_t size);
+
+/// Host memory backing a part of an emulated memory range
+struct HostSpan {
+    u8* pointer;
+    size_t size;
+};
+
+/**
+ * Collects the host memory backing `size` bytes of emulated memory starting at `dest_addr`, so that
+ * it can be filled without a staging copy. Pages which are contiguous on the host are merged into a
+ * single span. The pages are recorded as written, like with WriteBlock.
+ * @return False, without recording anything, if part of the range isn't regular memory
+ */
+bool GetHostSpansForWrite(VAddr dest_addr, size_t size, std::vector<HostSpan>& spans);
+
+/**
+ * Host pointers to the memory backing each page of the currently active address space. Entries for
+ * pages that aren't mapped to regular memory are null. Exposed only to allow the accessors below to
+ * be inlined; use the functions in memory_setup.h to change mappings.
+ */
+extern u8** current_page_pointers;
+
+/// Like current_page_pointers, but also null for pages whose writes are being tracked
+extern u8** current_page_write_pointers;
+
+template <typename T>
+inline bool TryFastRead(const VAddr addr, T& value) {
+    const u8* page_pointer = current_page_pointers[addr / PAGE_SIZE];
+    if (page_pointer == nullptr)
+        return false;
+    value = *reinterpret_cast<const T*>(page_pointer + (addr & (PAGE_SIZE - 1)));
+    return true;
+}
+
+template <typename T>
+inline bool TryFastWrite(const VAddr addr, const T value) {
+    u8* page_pointer = current_page_write_pointers[addr / PAGE_SIZE];
+    if (page_pointer == nullptr)
+        return false;
+    *reinterpret_cast<T*>(page_pointer + (addr & (PAGE_SIZE - 1))) = value;
+    return true;
+}
+
+/*
+ * Inlinable variants of the memory accessors, meant for hot paths such as the CPU interpreter.
+ * Accesses to regular memory are resolved with a single page table lookup at the call site, while
+ * everything else (unmapped or I/O pages) goes through the out-of-line functions above.
+ */
+
+inline u8 FastRead8(const VAddr addr) {
+    u8 value;
+    return TryFastRead(addr, value) ? value : Read8(addr);
+}
+
+inline u16 FastRead16(const VAddr addr) {
+    u16_le value;
+    return TryFastRead(addr, value) ? value : Read16(addr);
+}
+
+inline u32 FastRead32(const VAddr addr) {
+    u32_le value;
+    return TryFastRead(addr, value) ? value : Read32(addr);
+}
+
+inline u64 FastRead64(const VAddr addr) {
+    u64_le value;
+    return TryFastRead(addr, value) ? value : Read64(addr);
+}
+
+inline void FastWrite8(const VAddr addr, const u8 data) {
+    if (!TryFastWrite(addr, data))
+        Write8(addr, data);
+}
+
+inline void FastWrite16(const VAddr addr, const u16 data) {
+    if (!TryFastWrite<u16_le>(addr, data))
+        Write16(addr, data);
+}
+
+inline void FastWrite32(const VAddr addr, const u32 data) {
+    if (!TryFastWrite<u32_le>(addr, data))
+        Write32(addr, data);
+}
+
+inline void FastWrite64(const VAddr addr, const u64 data) {
+    if (!TryFastWrite<u64_le>(addr, data))
+        Write64(addr, data);
+}
 
 u8* GetPointer(VAddr virtual_address);
 
+/// Returns whether GetPointer() can access an address, without logging an error if it can't
+bool IsValidVirtualAddress(VAddr virtual_address);
+
 /**
- * Gets a pointer to the memory region beginning at the specified physical address.
- *
- * @note This is currently implemented using PhysicalToVirtualAddress().
+ * Gets a pointer to the memory region beginning at the specified physical address. This is a
+ * single lookup in a table indexed by physical page, so it's cheap enough for per-vertex use.
  */
 u8* GetPhysicalPointer(PAddr address);
 
+/**
+ * Starts tracking CPU writes to the pages overlapping the given physical memory region. The first
+ * write to each tracked page after this call is recorded (see PhysicalWrittenSince) and ends the
+ * tracking of that page.
+ *
+ * @note Only writes through the Read/Write accessors are detected. Code writing through pointers
+ *       obtained from GetPointer() (DMAs, HLE services) has to notify interested parties itself.
+ */
+void TrackPhysicalWrites(PAddr address, u32 size);
+
+/**
+ * Starts watching CPU writes to the page of the active address space containing the given address,
+ * which guest code has been translated from. The first write to the page discards the translations
+ * of its code (see ARM_Interface::InvalidateCacheRange) and ends the watch, so that self-modifying
+ * code is picked up without having to flush the whole cache.
+ *
+ * @note Like TrackPhysicalWrites, this only detects writes through the Read/Write accessors.
+ */
+void WatchCodePage(VAddr address);
+
+/// Kinds of accesses which trigger a watchpoint
+enum class WatchpointType : u8 {
+    Read = 1 << 0,
+    Write = 1 << 1,
+    ReadWrite = Read | Write,
+};
+
+/// Access which triggered a watchpoint
+struct WatchpointHit {
+    VAddr address;
+    u32 size;
+    bool write;
+    /// Program counter of the application core at the time of the access
+    u32 pc;
+};
+
+/**
+ * Adds a watchpoint on a virtual address range, which applies to whichever address space is
+ * active. The pages overlapping watchpoints are marked as PageType::Watched, so that accesses to
+ * them take the slow path, where they are checked against the exact ranges. Accesses to other
+ * pages are as fast as without watchpoints.
+ *
+ * A hit is logged and stops the current CPU timeslice, see PopWatchpointHit. Like the other
+ * debugging functions, this must not be called while the CPU is running.
+ *
+ * @note Only accesses through the Read/Write and block accessors are detected, not the ones made
+ *       through pointers obtained from GetPointer().
+ */
+void AddWatchpoint(VAddr address, u32 size, WatchpointType type);
+
+/// Removes the watchpoints added with the given address and size
+void RemoveWatchpoint(VAddr address, u32 size);
+
+void ClearWatchpoints();
+
+/// Checks whether a watchpoint has been hit since the last call to PopWatchpointHit()
+bool HasWatchpointHit();
+
+/**
+ * Retrieves the first watchpoint hit since the last call, if any.
+ * @return Whether a watchpoint has been hit
+ */
+bool PopWatchpointHit(WatchpointHit& hit);
+
+/// Returns a stamp which can be passed to PhysicalWrittenSince() to check for later writes
+u32 GetWriteStamp();
+
+/**
+ * Checks whether any tracked page overlapping the given physical memory region has been written
+ * to (or remapped) since the given stamp was obtained from GetWriteStamp().
+ */
+bool PhysicalWrittenSince(PAddr address, u32 size, u32 stamp);
+
+/**
+ * Records a write to the given physical memory region which was made through a host pointer, e.g.
+ * by an emulated device, so that PhysicalWrittenSince() reports it like a tracked CPU write.
+ */
+void RecordPhysicalWrite(PAddr address, u32 size);
+
+/**
+ * Starts a snapshot of the memory arena (see GetArena), which RestoreSnapshot() rolls the memory
+ * back to. Pages are copied the first time they are about to change rather than up front: until
+ * then, CPU writes to every page of the active address space take the slow path, like writes to
+ * tracked pages. Starting a snapshot discards the previous one.
+ *
+ * @note Writes through host pointers aren't seen. The page of every GetPointer() lookup is copied,
+ *       but devices writing whole regions have to call SnapshotPhysicalRegion() first.
+ */
+void BeginSnapshot();
+
+/// Copies the pages overlapping the given physical region into the current snapshot, if any
+void SnapshotPhysicalRegion(PAddr address, u32 size);
+
+/// Region of physical memory, see RestoreSnapshot()
+struct PhysicalRegion {
+    PAddr address;
+    u32 size;
+};
+
+/**
+ * Copies the pages of the current snapshot back into the arena and ends it. Pages which changed
+ * since the snapshot began are recorded as written, see PhysicalWrittenSince().
+ * @param changed_regions Receives the physical regions which changed, for the caches of devices
+ *                        which don't check the write stamps
+ * @return Number of pages which changed, including the ones without a physical address
+ */
+u32 RestoreSnapshot(std::vector<PhysicalRegion>& changed_regions);
+
+/// Ends the current snapshot, if any, leaving the memory as it is
+void EndSnapshot();
+
+/// Returns the number of bytes copied into the current snapshot so far
+size_t GetSnapshotSize();
+
 }
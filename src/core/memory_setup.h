@@ -10,27 +10,126 @@
 
 namespace Memory {
 
+class MMIORegion;
+
 const u32 PAGE_MASK = PAGE_SIZE - 1;
 const int PAGE_BITS = 12;
 
+enum class PageType : u8 {
+    /// Page is unmapped and should cause an access error.
+    Unmapped,
+    /// Page is mapped to regular memory. This is the only type you can get pointers to.
+    Memory,
+    /// Page is mapped to a I/O region. Writing and reading to this page is handled by functions.
+    Special,
+    /**
+     * Page is mapped to regular memory overlapping a watchpoint. Its pointers are null, so that
+     * all accesses take the slow path where they are checked against the watchpoints.
+     */
+    Watched,
+};
+
+/**
+ * A (reasonably) fast way of allowing switchable and remmapable process address spaces. It loosely
+ * mimics the way a real CPU page table works, but instead is optimized for minimal decoding and
+ * fetching requirements when acessing. In the usual case of an access to regular memory, it only
+ * requires an indexed fetch and a check for NULL.
+ *
+ * Each address space owns one of these. The arrays cover the whole 32-bit address space but are
+ * allocated as zero-filled virtual memory, so only the parts describing mapped regions are ever
+ * backed by physical memory.
+ */
+struct PageTable : NonCopyable {
+    static const size_t NUM_ENTRIES = 1 << (32 - PAGE_BITS);
+
+    PageTable();
+    ~PageTable();
+
+    /**
+     * Array of memory pointers backing each page. An entry can only be non-null if the
+     * corresponding entry in the `attributes` array is of type `Memory`.
+     */
+    u8** pointers;
+
+    /**
+     * Array of memory pointers used for writes. These match `pointers`, except for pages whose
+     * writes are being tracked, which are null so that writes to them take the slow path.
+     */
+    u8** write_pointers;
+
+    /**
+     * Array of I/O handlers for each page. An entry can only be non-null if the corresponding
+     * entry in the `attributes` array is of type `Special`.
+     */
+    MMIORegion** mmio_handlers;
+
+    /**
+     * Value of the global write stamp at the last detected write to (or remapping of) each page,
+     * or zero if none happened yet.
+     */
+    u32* write_stamps;
+
+    /**
+     * Array of fine grained page attributes. If it is set to any value other than `Memory`, then
+     * the corresponding entry in `pointer` MUST be set to null.
+     */
+    PageType* attributes;
+
+    /**
+     * Whether guest code has been translated from each page since its last write, in which case
+     * its writes are tracked so that the translations can be discarded (see WatchCodePage).
+     */
+    bool* code_pages;
+
+private:
+    static const size_t ALLOCATION_SIZE =
+            NUM_ENTRIES * (3 * sizeof(u8*) + sizeof(u32) + sizeof(PageType) + sizeof(bool));
+
+    void* allocation;
+};
+
 void InitMemoryMap();
 
 /**
- * Maps an allocated buffer onto a region of the emulated process address space.
+ * Switches the active address space, which all memory accessors operate on.
+ * @param page_table The page table to activate, or nullptr to activate an empty address space
+ */
+void SetCurrentPageTable(PageTable* page_table);
+
+/// Returns the active page table, or nullptr if the empty address space is active.
+PageTable* GetCurrentPageTable();
+
+/**
+ * Maps an allocated buffer onto a region of an emulated process address space.
  *
+ * @param page_table The page table of the address space to map into.
  * @param base The address to start mapping at. Must be page-aligned.
  * @param size The amount of bytes to map. Must be page-aligned.
  * @param target Buffer with the memory backing the mapping. Must be of length at least `size`.
  */
-void MapMemoryRegion(VAddr base, u32 size, u8* target);
+void MapMemoryRegion(PageTable& page_table, VAddr base, u32 size, u8* target);
 
 /**
- * Maps a region of the emulated process address space as a IO region.
- * @note Currently this can only be used to mark a region as being IO, since actual memory-mapped
- *       IO isn't yet supported.
+ * Maps a region of an emulated process address space as a IO region. Each page is connected to
+ * the handler registered for the matching physical page, if any (see RegisterMMIO).
+ *
+ * @param page_table The page table of the address space to map into.
+ * @param base The address to start mapping at. Must be page-aligned.
+ * @param size The amount of bytes to map. Must be page-aligned.
+ * @param paddr The physical address of the I/O range being mapped.
  */
-void MapIoRegion(VAddr base, u32 size);
+void MapIoRegion(PageTable& page_table, VAddr base, u32 size, PAddr paddr);
+
+void UnmapRegion(PageTable& page_table, VAddr base, u32 size);
 
-void UnmapRegion(VAddr base, u32 size);
+/**
+ * Sets the host memory backing a range of physical memory, as used by GetPhysicalPointer. Unlike
+ * the virtual mappings this is shared by all address spaces.
+ *
+ * @param base The physical address to start mapping at. Must be page-aligned.
+ * @param size The amount of bytes to map. Must be page-aligned.
+ * @param target Buffer with the memory backing the range, or nullptr to unmap it.
+ */
+void MapPhysicalRegion(PAddr base, u32 size, u8* target);
 
 }
@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace Memory {
+
+/**
+ * Handles accesses to a range of memory-mapped I/O registers. Handlers are registered for a
+ * physical range with RegisterMMIO() and are then reached through the page tables of the address
+ * spaces which map that range, so the address passed to them is the one used for the access.
+ */
+class MMIORegion {
+public:
+    virtual ~MMIORegion() {}
+
+    virtual u8 Read8(VAddr addr) = 0;
+    virtual u16 Read16(VAddr addr) = 0;
+    virtual u32 Read32(VAddr addr) = 0;
+    virtual u64 Read64(VAddr addr) = 0;
+
+    virtual void Write8(VAddr addr, u8 data) = 0;
+    virtual void Write16(VAddr addr, u16 data) = 0;
+    virtual void Write32(VAddr addr, u32 data) = 0;
+    virtual void Write64(VAddr addr, u64 data) = 0;
+};
+
+/// Helpers for dispatching a templated access to the handler function of the matching size.
+inline void ReadMMIO(MMIORegion* handler, VAddr addr, u8& var) { var = handler->Read8(addr); }
+inline void ReadMMIO(MMIORegion* handler, VAddr addr, u16& var) { var = handler->Read16(addr); }
+inline void ReadMMIO(MMIORegion* handler, VAddr addr, u32& var) { var = handler->Read32(addr); }
+inline void ReadMMIO(MMIORegion* handler, VAddr addr, u64& var) { var = handler->Read64(addr); }
+
+inline void WriteMMIO(MMIORegion* handler, VAddr addr, u8 data) { handler->Write8(addr, data); }
+inline void WriteMMIO(MMIORegion* handler, VAddr addr, u16 data) { handler->Write16(addr, data); }
+inline void WriteMMIO(MMIORegion* handler, VAddr addr, u32 data) { handler->Write32(addr, data); }
+inline void WriteMMIO(MMIORegion* handler, VAddr addr, u64 data) { handler->Write64(addr, data); }
+
+/**
+ * Registers a handler for a physical I/O range. This must happen before the range is mapped into
+ * an address space, since the handler is looked up once at mapping time.
+ * @param base Physical base address of the range. Must be page-aligned and inside the IO area.
+ * @param size Size of the range in bytes. Must be page-aligned.
+ * @param handler Handler for the range, or nullptr to remove the current one. Not owned.
+ */
+void RegisterMMIO(PAddr base, u32 size, MMIORegion* handler);
+
+/// Returns the handler registered for the given physical address, or nullptr if there is none.
+MMIORegion* GetMMIOHandler(PAddr addr);
+
+} // namespace
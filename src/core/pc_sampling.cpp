@@ -0,0 +1,94 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/profiler_reporting.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/memory.h"
+#include "core/pc_sampling.h"
+#include "core/arm/arm_interface.h"
+#include "core/arm/skyeye_common/armstate.h"
+#include "core/hle/kernel/thread.h"
+
+namespace PCSampling {
+
+using Common::Profiling::PCSampler;
+
+static int sample_event_type = -1;
+
+/// Largest distance of a frame from the stack pointer, to keep a bad frame pointer from going astray
+static const u32 MAX_FRAME_DISTANCE = 0x100000;
+
+static bool ReadStackWord(VAddr address, u32& value) {
+    if ((address & 3) != 0 || !Memory::IsValidVirtualAddress(address))
+        return false;
+    std::memcpy(&value, Memory::GetPointer(address), sizeof(value));
+    return true;
+}
+
+/**
+ * Follows the frame pointer chain in the layout generated for ARM code by GCC, where the frame
+ * pointer (r11) points at the saved return address and the caller's frame pointer lies below it.
+ * Thumb code keeps its frame pointer elsewhere, so the chain is only followed from ARM code.
+ * @return Number of return addresses stored into frames
+ */
+static size_t WalkFramePointers(u32* frames, size_t max_frames) {
+    if ((Core::g_app_core->GetCPSR() & TBIT) != 0)
+        return 0;
+
+    const u32 sp = Core::g_app_core->GetReg(13);
+    u32 fp = Core::g_app_core->GetReg(11);
+
+    size_t num_frames = 0;
+    while (num_frames < max_frames && fp >= sp + 4 && fp - sp < MAX_FRAME_DISTANCE) {
+        u32 return_address, caller_fp;
+        if (!ReadStackWord(fp, return_address) || !ReadStackWord(fp - 4, caller_fp) || return_address == 0)
+            break;
+
+        frames[num_frames++] = return_address;
+
+        // Frames of callers lie further up the stack
+        if (caller_fp <= fp)
+            break;
+        fp = caller_fp;
+    }
+    return num_frames;
+}
+
+static void SampleCallback(u64 userdata, int cycles_late) {
+    PCSampler& sampler = Common::Profiling::GetPCSampler();
+    if (!sampler.IsEnabled()) {
+        CoreTiming::ScheduleEvent(g_clock_rate_arm11 / 60, sample_event_type);
+        return;
+    }
+
+    // Idle time is left out, since no guest code runs
+    if (Kernel::GetCurrentThread() != nullptr) {
+        u32 frames[PCSampler::MAX_DEPTH];
+        size_t num_frames = 0;
+        frames[num_frames++] = Core::g_app_core->GetPC();
+        frames[num_frames++] = Core::g_app_core->GetReg(14);
+        if (sampler.ShouldWalkFramePointers())
+            num_frames += WalkFramePointers(frames + num_frames, PCSampler::MAX_DEPTH - num_frames);
+
+        sampler.AddSample(frames, num_frames);
+    }
+
+    CoreTiming::ScheduleEvent(std::max<s64>((s64)sampler.GetInterval() - cycles_late, 1), sample_event_type);
+}
+
+void Init() {
+    sample_event_type = CoreTiming::RegisterEvent("PCSampling::SampleCallback", SampleCallback);
+    CoreTiming::ScheduleEvent(g_clock_rate_arm11 / 60, sample_event_type);
+}
+
+void Shutdown() {
+    CoreTiming::RemoveEvent(sample_event_type);
+}
+
+} // namespace
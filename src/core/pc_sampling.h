@@ -0,0 +1,18 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+/**
+ * Takes the samples of Common::Profiling::PCSampler from a CoreTiming event. While the sampler is
+ * disabled, the event only checks about once per frame whether it has been enabled.
+ */
+namespace PCSampling {
+
+/// Registers and schedules the sampling event. Must be called after CoreTiming::Init().
+void Init();
+
+void Shutdown();
+
+} // namespace
@@ -0,0 +1,86 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+
+#include "audio_core/audio_core.h"
+
+#include "common/logging/log.h"
+#include "common/profiler.h"
+
+#include "core/core.h"
+#include "core/memory.h"
+#include "core/run_ahead.h"
+#include "core/savestate.h"
+#include "core/settings.h"
+#include "core/hw/gpu.h"
+
+namespace RunAhead {
+
+/// Wall time of the frames emulated ahead, including the time of the categories they contain
+static Common::Profiling::TimingCategory ahead_frames_category("Run-Ahead Frames");
+static Common::Profiling::TimingCategory snapshot_category("Run-Ahead Snapshots");
+
+static Common::Profiling::MemoryCounter snapshot_counter("Run-Ahead Snapshot");
+
+/// Number of failed restores in a row, to only log the first of them
+static unsigned failed_restores = 0;
+
+/// Runs the CPU up to the next VBlank, returning false if it stopped early
+static bool RunToVBlank(const std::atomic<bool>& running) {
+    const u64 end_frame = GPU::GetFrameCount() + 1;
+    while (GPU::GetFrameCount() < end_frame) {
+        if (!running.load(std::memory_order_relaxed))
+            return false;
+        Core::RunLoop();
+        if (Memory::HasWatchpointHit())
+            return false;
+    }
+    return true;
+}
+
+void RunFrame(const std::atomic<bool>& running) {
+    const unsigned num_frames = static_cast<unsigned>(Settings::values.run_ahead_frames);
+
+    // The game's own frame is rendered, since it may read the results back, but never shown. The
+    // VBlank ending each frame decides whether the one after it is rendered: only the last one is.
+    GPU::OverrideVBlank(false, num_frames > 1);
+    bool reached_vblank = RunToVBlank(running);
+
+    bool captured = false;
+    if (reached_vblank) {
+        Common::Profiling::ScopeTimer timer(snapshot_category);
+        captured = SaveState::CaptureSnapshot();
+    }
+
+    if (captured) {
+        const auto ahead_start = std::chrono::steady_clock::now();
+        AudioCore::SetMuted(true);
+
+        for (unsigned frame = 1; frame <= num_frames && reached_vblank; ++frame) {
+            // The game's next frame is rendered after the rollback, so the last skip_next is false
+            GPU::OverrideVBlank(frame == num_frames, frame + 1 < num_frames);
+            reached_vblank = RunToVBlank(running);
+        }
+
+        AudioCore::SetMuted(false);
+        ahead_frames_category.AddTime(std::chrono::duration_cast<Common::Profiling::Duration>(
+                std::chrono::steady_clock::now() - ahead_start));
+    }
+
+    GPU::ClearVBlankOverride();
+    if (!captured)
+        return;
+
+    Common::Profiling::ScopeTimer timer(snapshot_category);
+    snapshot_counter.Set(Memory::GetSnapshotSize());
+    if (SaveState::RestoreSnapshot()) {
+        failed_restores = 0;
+    } else if (failed_restores++ == 0) {
+        // Emulation carries on from the frame shown, which is only a few frames of game time lost
+        LOG_WARNING(Core, "Could not roll back after running ahead, kernel objects changed in the meantime");
+    }
+}
+
+} // namespace
@@ -0,0 +1,29 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+
+/**
+ * Hides input latency by showing frames from the future. Each frame of the game is emulated with
+ * its rendering hidden, then a snapshot is captured (see SaveState::CaptureSnapshot) and the next
+ * Settings::values.run_ahead_frames frames are emulated with the current input. The last of them
+ * is shown, and the system is rolled back to the snapshot for the next frame. Games which take a
+ * few frames to react to input thus show the reaction that many frames earlier.
+ *
+ * The frames in between are skipped rather than rendered, and the audio of all frames emulated
+ * ahead is muted, so it's only played once. Their cost shows up in the profiler as the
+ * "Run-Ahead Frames" category, which overlaps the categories of the work done in them, and as
+ * "Run-Ahead Snapshots".
+ */
+namespace RunAhead {
+
+/**
+ * Emulates the next frame and runs ahead from it.
+ * @param running Checked after every RunLoop, returns early once this is cleared by another thread
+ */
+void RunFrame(const std::atomic<bool>& running);
+
+} // namespace
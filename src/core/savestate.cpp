@@ -0,0 +1,464 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common/chunk_file.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/swap.h"
+#include "common/thread.h"
+
+#include "core/arm/arm_interface.h"
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/savestate.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hw/hw.h"
+
+#include "video_core/gpu_thread.h"
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/pica.h"
+#include "video_core/rasterizer.h"
+#include "video_core/renderer_base.h"
+#include "video_core/texture_cache.h"
+#include "video_core/video_core.h"
+
+namespace SaveState {
+
+/// Identifies save state files, and the version of their layout
+static const u32 STATE_MAGIC = 'C' | ('S' << 8) | ('S' << 16) | ('T' << 24);
+static const u32 STATE_VERSION = 2;
+
+/// Number of incremental states which may be chained, to catch cyclic parent references
+static const unsigned MAX_CHAIN_LENGTH = 4096;
+
+enum class Compression : u32 {
+    None,
+    Zstd,
+};
+
+#ifdef HAVE_ZSTD
+/// zstd level used for save states. Low levels compress hundreds of megabytes per second.
+static const int COMPRESSION_LEVEL = 1;
+#endif
+
+/**
+ * Header of a state file. It's followed by the path of the parent state (parent_path_size bytes,
+ * empty for full states) and then by the possibly compressed payload, which consists of:
+ * - u64 size of the device state, followed by the device state in PointerWrap format
+ * - u32 number of memory pages stored, followed by their page indices into the memory arena
+ *   (u32 each) and then by the contents of the pages
+ * Full states store all pages which aren't filled with zeroes, incremental ones all pages which
+ * differ from their parent.
+ */
+struct FileHeader {
+    u32_le magic;
+    u32_le version;
+    u32_le compression;
+    u32_le parent_path_size;
+    u64_le payload_size;   ///< Size of the payload after decompression
+    u64_le stored_size;    ///< Size of the payload as stored in the file
+};
+static_assert(sizeof(FileHeader) == 32, "FileHeader has incorrect size");
+
+/// Thread compressing and writing the last captured state
+static std::thread writer;
+
+/**
+ * Hashes of the memory pages at the time the last state was saved or loaded, and that state's
+ * path. Incremental states store the pages whose hashes changed. Empty if there's no last state.
+ */
+static std::vector<u64> page_hashes;
+static std::string last_state_path;
+
+/// Device state of the last snapshot, whose memory pages are held by Memory::BeginSnapshot
+static std::vector<u8> snapshot_state;
+static bool snapshot_captured = false;
+
+/**
+ * Saves or restores everything in a save state except for the memory pages. The kernel comes
+ * first, since it checks whether the state can be loaded at all before anything is restored.
+ */
+static void DoState(PointerWrap& p) {
+    Kernel::DoState(p);
+    CoreTiming::DoState(p);
+    Memory::DoState(p);
+    HW::DoState(p);
+    Pica::DoState(p);
+}
+
+static u32 GetNumPages() {
+    return static_cast<u32>(Memory::GetArenaSize() / Memory::PAGE_SIZE);
+}
+
+static u64 HashPage(const u8* page) {
+    return Common::ComputeHash64(page, Memory::PAGE_SIZE);
+}
+
+/// Hashes every page of the memory arena
+static std::vector<u64> HashPages() {
+    const u8* arena = Memory::GetArena();
+    std::vector<u64> hashes(GetNumPages());
+    for (u32 i = 0; i < hashes.size(); ++i)
+        hashes[i] = HashPage(arena + i * Memory::PAGE_SIZE);
+    return hashes;
+}
+
+template <typename T>
+static void Append(std::vector<u8>& buffer, const T& value) {
+    const u8* bytes = reinterpret_cast<const u8*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+static void WriteStateFile(std::string filename, std::string parent_path, std::vector<u8> payload) {
+    Common::SetCurrentThreadName("SaveStateWriter");
+
+    FileHeader header = {};
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.compression = static_cast<u32>(Compression::None);
+    header.parent_path_size = static_cast<u32>(parent_path.size());
+    header.payload_size = payload.size();
+
+    const u8* data = payload.data();
+    size_t data_size = payload.size();
+
+#ifdef HAVE_ZSTD
+    std::vector<u8> compressed(ZSTD_compressBound(payload.size()));
+    size_t compressed_size = ZSTD_compress(compressed.data(), compressed.size(), payload.data(), payload.size(),
+                                           COMPRESSION_LEVEL);
+    if (!ZSTD_isError(compressed_size)) {
+        header.compression = static_cast<u32>(Compression::Zstd);
+        data = compressed.data();
+        data_size = compressed_size;
+    } else {
+        LOG_WARNING(Core, "Failed to compress save state: %s", ZSTD_getErrorName(compressed_size));
+    }
+#endif
+
+    header.stored_size = data_size;
+
+    FileUtil::IOFile file(filename, "wb");
+    if (!file.IsOpen() || !file.WriteObject(header) ||
+        file.WriteBytes(parent_path.data(), parent_path.size()) != parent_path.size() ||
+        file.WriteBytes(data, data_size) != data_size) {
+        LOG_ERROR(Core, "Failed to write save state %s", filename.c_str());
+        return;
+    }
+
+    LOG_INFO(Core, "Saved state to %s (%zu bytes, %zu stored)", filename.c_str(), payload.size(), data_size);
+}
+
+void WaitForSave() {
+    if (writer.joinable())
+        writer.join();
+}
+
+static bool SaveState(const std::string& filename, bool incremental) {
+    // Only one state is written at a time, which also bounds the memory held by pending states
+    WaitForSave();
+
+    // Command lists in flight and events posted by other threads are part of the state
+    GPUThread::Synchronize();
+    CoreTiming::MoveEvents();
+
+    u8* ptr = nullptr;
+    PointerWrap measure(&ptr, PointerWrap::MODE_MEASURE);
+    DoState(measure);
+    const u64 device_state_size = reinterpret_cast<size_t>(ptr);
+
+    // Pages are compared by hash rather than by tracking writes, since the GPU, DMAs and HLE
+    // services write to memory through host pointers, and the heap has no physical address
+    incremental = incremental && !page_hashes.empty();
+    std::vector<u64> hashes = HashPages();
+    const u64 zero_page_hash = HashPage(std::vector<u8>(Memory::PAGE_SIZE).data());
+
+    std::vector<u32> stored_pages;
+    for (u32 i = 0; i < hashes.size(); ++i) {
+        if (incremental ? hashes[i] != page_hashes[i] : hashes[i] != zero_page_hash)
+            stored_pages.push_back(i);
+    }
+
+    std::vector<u8> payload;
+    payload.reserve(sizeof(u64) + device_state_size + sizeof(u32) +
+                    stored_pages.size() * (sizeof(u32) + Memory::PAGE_SIZE));
+
+    Append(payload, device_state_size);
+    payload.resize(payload.size() + device_state_size);
+    ptr = &payload[sizeof(u64)];
+    PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+    DoState(p);
+
+    if (p.error == PointerWrap::ERROR_FAILURE || ptr != payload.data() + payload.size()) {
+        LOG_ERROR(Core, "Failed to capture the emulation state");
+        return false;
+    }
+
+    Append(payload, static_cast<u32>(stored_pages.size()));
+    for (u32 page : stored_pages)
+        Append(payload, page);
+
+    const u8* arena = Memory::GetArena();
+    for (u32 page : stored_pages) {
+        const u8* data = arena + page * Memory::PAGE_SIZE;
+        payload.insert(payload.end(), data, data + Memory::PAGE_SIZE);
+    }
+
+    LOG_DEBUG(Core, "Captured %s state with %zu of %zu memory pages", incremental ? "an incremental" : "a full",
+              stored_pages.size(), hashes.size());
+
+    writer = std::thread(WriteStateFile, filename, incremental ? last_state_path : std::string(),
+                         std::move(payload));
+
+    page_hashes = std::move(hashes);
+    last_state_path = filename;
+    return true;
+}
+
+bool Save(const std::string& filename) {
+    return SaveState(filename, false);
+}
+
+bool SaveIncremental(const std::string& filename) {
+    return SaveState(filename, true);
+}
+
+/// Decompressed payload of a state file, and where its parts are
+struct StateFile {
+    std::string parent_path;
+    std::vector<u8> payload;
+
+    const u8* device_state;
+    size_t device_state_size;
+    u32 num_pages;
+    const u8* page_indices;  ///< Unaligned array of num_pages u32s
+    const u8* pages;
+};
+
+/// Locates the parts of the payload of a state file, checking that they are in bounds
+static bool LocateParts(StateFile& state) {
+    const std::vector<u8>& payload = state.payload;
+
+    u64 device_state_size;
+    if (payload.size() < sizeof(u64))
+        return false;
+    std::memcpy(&device_state_size, payload.data(), sizeof(u64));
+
+    u32 num_pages;
+    if (payload.size() - sizeof(u64) < device_state_size ||
+        payload.size() - sizeof(u64) - device_state_size < sizeof(u32))
+        return false;
+    std::memcpy(&num_pages, &payload[sizeof(u64) + device_state_size], sizeof(u32));
+
+    if (num_pages > GetNumPages() ||
+        payload.size() - sizeof(u64) - device_state_size - sizeof(u32) != num_pages * (sizeof(u32) + (u64)Memory::PAGE_SIZE))
+        return false;
+
+    state.device_state = &payload[sizeof(u64)];
+    state.device_state_size = static_cast<size_t>(device_state_size);
+    state.num_pages = num_pages;
+    state.page_indices = state.device_state + device_state_size + sizeof(u32);
+    state.pages = state.page_indices + num_pages * sizeof(u32);
+
+    for (u32 i = 0; i < num_pages; ++i) {
+        u32 page;
+        std::memcpy(&page, state.page_indices + i * sizeof(u32), sizeof(u32));
+        if (page >= GetNumPages())
+            return false;
+    }
+    return true;
+}
+
+static bool ReadStateFile(const std::string& filename, StateFile& state) {
+    FileUtil::IOFile file(filename, "rb");
+    FileHeader header;
+    if (!file.IsOpen() || !file.ReadArray(&header, 1)) {
+        LOG_ERROR(Core, "Failed to open save state %s", filename.c_str());
+        return false;
+    }
+
+    if (header.magic != STATE_MAGIC || header.version != STATE_VERSION) {
+        LOG_ERROR(Core, "%s is not a supported save state", filename.c_str());
+        return false;
+    }
+
+    if (file.GetSize() - sizeof(header) != header.parent_path_size + header.stored_size) {
+        LOG_ERROR(Core, "Save state %s is truncated", filename.c_str());
+        return false;
+    }
+
+    state.parent_path.resize(header.parent_path_size);
+    std::vector<u8> stored(static_cast<size_t>(header.stored_size));
+    if (file.ReadBytes(&state.parent_path[0], state.parent_path.size()) != state.parent_path.size() ||
+        file.ReadBytes(stored.data(), stored.size()) != stored.size()) {
+        LOG_ERROR(Core, "Failed to read save state %s", filename.c_str());
+        return false;
+    }
+
+    switch (static_cast<Compression>(static_cast<u32>(header.compression))) {
+    case Compression::None:
+        state.payload = std::move(stored);
+        break;
+
+    case Compression::Zstd:
+    {
+#ifdef HAVE_ZSTD
+        state.payload.resize(static_cast<size_t>(header.payload_size));
+        size_t result = ZSTD_decompress(state.payload.data(), state.payload.size(), stored.data(), stored.size());
+        if (ZSTD_isError(result) || result != state.payload.size()) {
+            LOG_ERROR(Core, "Failed to decompress save state %s", filename.c_str());
+            return false;
+        }
+        break;
+#else
+        LOG_ERROR(Core, "Save state %s is compressed, but Citra was built without zstd", filename.c_str());
+        return false;
+#endif
+    }
+
+    default:
+        LOG_ERROR(Core, "Save state %s uses an unknown compression method", filename.c_str());
+        return false;
+    }
+
+    if (state.payload.size() != header.payload_size || !LocateParts(state)) {
+        LOG_ERROR(Core, "Save state %s is corrupted", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Load(const std::string& filename) {
+    WaitForSave();
+
+    // Read the whole chain of states up front, so nothing is restored unless all of them are fine
+    std::vector<StateFile> chain;
+    std::string path = filename;
+    while (true) {
+        if (chain.size() == MAX_CHAIN_LENGTH) {
+            LOG_ERROR(Core, "Save state %s has too many parents", filename.c_str());
+            return false;
+        }
+
+        chain.emplace_back();
+        if (!ReadStateFile(path, chain.back()))
+            return false;
+        if (chain.back().parent_path.empty())
+            break;
+        path = chain.back().parent_path;
+    }
+
+    // Nothing may access the emulated hardware while it's being restored
+    GPUThread::Synchronize();
+
+    const StateFile& state = chain.front();
+    u8* ptr = const_cast<u8*>(state.device_state);
+    PointerWrap p(&ptr, PointerWrap::MODE_READ);
+    DoState(p);
+
+    if (p.error == PointerWrap::ERROR_FAILURE || ptr != state.device_state + state.device_state_size) {
+        LOG_ERROR(Core, "Failed to load save state %s", filename.c_str());
+        return false;
+    }
+
+    // Pages are applied starting from the full state at the root of the chain
+    u8* arena = Memory::GetArena();
+    std::memset(arena, 0, Memory::GetArenaSize());
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        for (u32 i = 0; i < it->num_pages; ++i) {
+            u32 page;
+            std::memcpy(&page, it->page_indices + i * sizeof(u32), sizeof(u32));
+            std::memcpy(arena + page * Memory::PAGE_SIZE, it->pages + i * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+        }
+    }
+
+    // Code, textures and framebuffers may have changed behind the back of the caches
+    Memory::RecordPhysicalWrite(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+    Memory::RecordPhysicalWrite(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    Core::g_app_core->ClearInstructionCache();
+    VideoCore::g_renderer->hw_rasterizer->Reset();
+
+    // Later incremental states are based on the loaded one
+    page_hashes = HashPages();
+    last_state_path = filename;
+
+    LOG_INFO(Core, "Loaded state from %s (%zu states in its chain)", filename.c_str(), chain.size());
+    return true;
+}
+
+bool CaptureSnapshot() {
+    snapshot_captured = false;
+
+    GPUThread::Synchronize();
+    CoreTiming::MoveEvents();
+    // Rendering results which the rasterizer hasn't written back yet are part of the snapshot
+    VideoCore::g_renderer->hw_rasterizer->CommitFramebuffer();
+
+    u8* ptr = nullptr;
+    PointerWrap measure(&ptr, PointerWrap::MODE_MEASURE);
+    DoState(measure);
+
+    // The buffer keeps its capacity, so snapshots are only allocated once
+    snapshot_state.resize(reinterpret_cast<size_t>(ptr));
+    ptr = snapshot_state.data();
+    PointerWrap p(&ptr, PointerWrap::MODE_WRITE);
+    DoState(p);
+
+    if (p.error == PointerWrap::ERROR_FAILURE || ptr != snapshot_state.data() + snapshot_state.size()) {
+        LOG_ERROR(Core, "Failed to capture the emulation state");
+        Memory::EndSnapshot();
+        return false;
+    }
+
+    // The GPU and the DSP write to their memories through host pointers, so those are copied now
+    Memory::BeginSnapshot();
+    Memory::SnapshotPhysicalRegion(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+    Memory::SnapshotPhysicalRegion(Memory::DSP_RAM_PADDR, Memory::DSP_RAM_SIZE);
+
+    snapshot_captured = true;
+    return true;
+}
+
+bool RestoreSnapshot() {
+    if (!snapshot_captured)
+        return false;
+    snapshot_captured = false;
+
+    GPUThread::Synchronize();
+
+    u8* ptr = snapshot_state.data();
+    PointerWrap p(&ptr, PointerWrap::MODE_READ);
+    DoState(p);
+
+    if (p.error == PointerWrap::ERROR_FAILURE || ptr != snapshot_state.data() + snapshot_state.size()) {
+        Memory::EndSnapshot();
+        return false;
+    }
+
+    std::vector<Memory::PhysicalRegion> changed_regions;
+    Memory::RestoreSnapshot(changed_regions);
+
+    // Unlike Load(), this keeps the rasterizer's caches, and only drops what the restore changed
+    HWRasterizer& rasterizer = *VideoCore::g_renderer->hw_rasterizer;
+    for (const Memory::PhysicalRegion& region : changed_regions) {
+        rasterizer.NotifyFlush(region.address, region.size);
+        Pica::TextureCache::NotifyFlush(region.address, region.size);
+        Pica::Rasterizer::NotifyFlush(region.address, region.size);
+    }
+    rasterizer.NotifyStateRestored();
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,67 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+namespace SaveState {
+
+/**
+ * Captures the state of the emulated system and writes it to a file. Only capturing the state
+ * happens on the calling thread: it's compressed and written to disk by a background thread, so
+ * emulation can continue right away.
+ * @note Must be called from the emulation thread while the CPU isn't running.
+ * @param filename Path of the file to write the state to
+ * @return False if the state couldn't be captured. Write errors are only logged.
+ */
+bool Save(const std::string& filename);
+
+/**
+ * Like Save(), but only stores the memory pages which changed since the state last saved or
+ * loaded in this session. That state's file becomes the parent of the new one, and has to be kept
+ * at the same path for the new state to load. Saves a full state if there's no previous state.
+ * @param filename Path of the file to write the state to
+ * @return False if the state couldn't be captured. Write errors are only logged.
+ */
+bool SaveIncremental(const std::string& filename);
+
+/**
+ * Restores the state of the emulated system from a file. The memory of incremental states is
+ * restored from the chain of their parents.
+ * @note Kernel objects aren't part of save states. A state is rejected unless the kernel objects
+ *       and the scheduling states of the threads are still the same as when it was saved, i.e. it
+ *       can be restored in the session which saved it, as long as no objects were created or
+ *       destroyed since.
+ * @note Must be called from the emulation thread while the CPU isn't running.
+ * @param filename Path of the file to load the state from
+ * @return False if the state couldn't be loaded
+ */
+bool Load(const std::string& filename);
+
+/// Waits until the state being written by Save(), if any, is on disk
+void WaitForSave();
+
+/**
+ * Captures the state of the emulated system in host memory, for RestoreSnapshot() to roll back
+ * to. Much cheaper than Save(): memory pages are only copied once they are about to change (see
+ * Memory::BeginSnapshot), so its cost grows with the memory written until the snapshot is
+ * restored. Capturing a snapshot discards the previous one.
+ * @note Writes by the asynchronous Y2R and file system workers aren't seen, so those have to be
+ *       turned off while snapshots are in use.
+ * @note Must be called from the emulation thread while the CPU isn't running.
+ * @return False if the state couldn't be captured
+ */
+bool CaptureSnapshot();
+
+/**
+ * Rolls the emulated system back to the last snapshot, which is used up by this. Like Load(), this
+ * fails if kernel objects were created or destroyed since the snapshot was captured, in which case
+ * emulation carries on from the current state.
+ * @note Must be called from the emulation thread while the CPU isn't running.
+ * @return False if there is no snapshot, or if it couldn't be restored
+ */
+bool RestoreSnapshot();
+
+} // namespace
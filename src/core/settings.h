@@ -41,18 +41,58 @@ static const std::array<Values, NUM_INPUTS> All = {
 struct Values {
     // Controls
     std::array<int, NativeInput::NUM_INPUTS> input_mappings;
+    int input_polling_rate;
 
     // Core
     int frame_skip;
+    bool use_frame_limit;
+    bool use_idle_sleep;
+    bool use_dynamic_frame_skip;
+    int run_ahead_frames;
+    bool use_async_y2r;
+    bool use_async_fs;
+    bool use_deterministic_timeslices;
+    int max_slice_length;
+    int memory_access_cost;
+    int multiply_cost;
+    int vfp_cost;
+    int branch_cost;
+    bool use_speculative_translation;
+    bool use_disk_translation_cache;
+    int worker_threads;
+    int worker_affinity_mask;
+    bool use_auto_thread_affinity;
+    int emu_thread_affinity_mask;
+    int gpu_thread_affinity_mask;
+    int present_thread_affinity_mask;
+    int emu_thread_priority;
+    int gpu_thread_priority;
+    int present_thread_priority;
+    int worker_thread_priority;
 
     // Data Storage
     bool use_virtual_sd;
+    int romfs_cache_size;
+    bool buffer_file_writes;
 
     // System Region
     int region_value;
 
     // Renderer
     bool use_hw_renderer;
+    bool use_hw_vertex_shader;
+    bool use_gpu_thread;
+    bool use_present_thread;
+    bool use_command_list_cache;
+    int resolution_factor;
+    int rasterizer_threads;
+    int texture_cache_size;
+    bool use_compressed_textures;
+    std::string texture_pack_path;
+    bool profile_gpu;
+    bool show_perf_overlay;
+    std::string frame_capture_path;
+    int frame_capture_format;
 
     float bg_red;
     float bg_green;
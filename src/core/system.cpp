@@ -2,36 +2,70 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/assert.h"
+#include "common/thread_pool.h"
+
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/host_threads.h"
 #include "core/mem_map.h"
+#include "core/pc_sampling.h"
+#include "core/savestate.h"
+#include "core/settings.h"
 #include "core/system.h"
+#include "core/title_profile.h"
+#include "core/arm/arm_interface.h"
 #include "core/hw/hw.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/kernel.h"
 
+#include "audio_core/audio_core.h"
+
 #include "video_core/video_core.h"
 
 namespace System {
 
+static bool initialized = false;
+
 void Init(EmuWindow* emu_window) {
+    ASSERT_MSG(!initialized, "Only one emulated system can run per process");
+    initialized = true;
+
+    HostThreads::Init();
+    Common::InitThreadPool(Settings::values.worker_threads,
+                           HostThreads::GetAffinityMask(HostThreads::Role::Worker),
+                           HostThreads::GetPriority(HostThreads::Role::Worker));
     Core::Init();
     CoreTiming::Init();
+    PCSampling::Init();
     Memory::Init();
     HW::Init();
     Kernel::Init();
     HLE::Init();
     VideoCore::Init(emu_window);
+    AudioCore::Init();
 }
 
 void Shutdown() {
+    SaveState::WaitForSave();
+
+    // The cache is validated against the emulated memory, which is gone once the kernel shuts down
+    if (Core::g_app_core != nullptr)
+        Core::g_app_core->SaveInstructionCache();
+
+    AudioCore::Shutdown();
     VideoCore::Shutdown();
     HLE::Shutdown();
     Kernel::Shutdown();
     HW::Shutdown();
     Memory::Shutdown();
+    PCSampling::Shutdown();
     CoreTiming::Shutdown();
     Core::Shutdown();
+    Common::ShutdownThreadPool();
+
+    TitleProfile::Restore();
+    initialized = false;
 }
 
 } // namespace
@@ -6,8 +6,14 @@
 
 class EmuWindow;
 
+/**
+ * The emulated system. Its subsystems keep their state in globals (the CPU core, the kernel's
+ * handle table, the memory page table, the GPU and Pica registers, the renderer, ...), so there
+ * can only be one instance of it per process.
+ */
 namespace System {
 
+/// Initializes all subsystems. Must not be called again before Shutdown().
 void Init(EmuWindow* emu_window);
 void Shutdown();
 
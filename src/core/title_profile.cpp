@@ -0,0 +1,126 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cinttypes>
+#include <memory>
+
+#include <inih/cpp/INIReader.h>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "core/settings.h"
+#include "core/title_profile.h"
+#include "core/loader/loader.h"
+
+#include "video_core/video_core.h"
+
+namespace TitleProfile {
+
+static u64 applied_program_id = 0;
+
+/// Settings as configured by the frontend, while a profile overrides them
+static Settings::Values configured_values;
+static bool configured_hw_renderer;
+
+static void OverrideInteger(const INIReader& profile, const char* section, const char* name, int& value) {
+    value = (int)profile.GetInteger(section, name, value);
+}
+
+static void OverrideBoolean(const INIReader& profile, const char* section, const char* name, bool& value) {
+    value = profile.GetBoolean(section, name, value);
+}
+
+/// Overrides the settings which the profile contains, all of which are performance options
+static void ReadOverrides(const INIReader& profile, Settings::Values& values) {
+    // Core
+    OverrideInteger(profile, "Core", "frame_skip", values.frame_skip);
+    OverrideBoolean(profile, "Core", "use_frame_limit", values.use_frame_limit);
+    OverrideBoolean(profile, "Core", "use_idle_sleep", values.use_idle_sleep);
+    OverrideBoolean(profile, "Core", "use_dynamic_frame_skip", values.use_dynamic_frame_skip);
+    OverrideInteger(profile, "Core", "run_ahead_frames", values.run_ahead_frames);
+    OverrideBoolean(profile, "Core", "use_async_y2r", values.use_async_y2r);
+    OverrideBoolean(profile, "Core", "use_async_fs", values.use_async_fs);
+    OverrideBoolean(profile, "Core", "use_deterministic_timeslices", values.use_deterministic_timeslices);
+    OverrideInteger(profile, "Core", "max_slice_length", values.max_slice_length);
+    OverrideInteger(profile, "Core", "memory_access_cost", values.memory_access_cost);
+    OverrideInteger(profile, "Core", "multiply_cost", values.multiply_cost);
+    OverrideInteger(profile, "Core", "vfp_cost", values.vfp_cost);
+    OverrideInteger(profile, "Core", "branch_cost", values.branch_cost);
+    OverrideBoolean(profile, "Core", "use_speculative_translation", values.use_speculative_translation);
+    OverrideBoolean(profile, "Core", "use_disk_translation_cache", values.use_disk_translation_cache);
+    OverrideInteger(profile, "Core", "worker_threads", values.worker_threads);
+
+    // Renderer
+    OverrideBoolean(profile, "Renderer", "use_hw_renderer", values.use_hw_renderer);
+    OverrideBoolean(profile, "Renderer", "use_hw_vertex_shader", values.use_hw_vertex_shader);
+    OverrideBoolean(profile, "Renderer", "use_gpu_thread", values.use_gpu_thread);
+    OverrideBoolean(profile, "Renderer", "use_present_thread", values.use_present_thread);
+    OverrideBoolean(profile, "Renderer", "use_command_list_cache", values.use_command_list_cache);
+    OverrideInteger(profile, "Renderer", "resolution_factor", values.resolution_factor);
+    OverrideInteger(profile, "Renderer", "rasterizer_threads", values.rasterizer_threads);
+    OverrideInteger(profile, "Renderer", "texture_cache_size", values.texture_cache_size);
+    OverrideBoolean(profile, "Renderer", "use_compressed_textures", values.use_compressed_textures);
+    values.texture_pack_path = profile.Get("Renderer", "texture_pack_path", values.texture_pack_path);
+
+    // Data Storage
+    OverrideInteger(profile, "Data Storage", "romfs_cache_size", values.romfs_cache_size);
+    OverrideBoolean(profile, "Data Storage", "buffer_file_writes", values.buffer_file_writes);
+}
+
+bool ApplyForFile(const std::string& filename) {
+    Loader::FileType type = Loader::IdentifyFile(filename);
+    std::unique_ptr<Loader::AppLoader> loader = Loader::GetLoader(FileUtil::IOFile(filename, "rb"), type, filename);
+    if (loader == nullptr)
+        return false;
+
+    // Homebrew formats don't have a program ID, and boot with the configured settings
+    u64 program_id;
+    if (Loader::ResultStatus::Success != loader->ReadProgramId(program_id))
+        return false;
+
+    return Apply(program_id);
+}
+
+bool Apply(u64 program_id) {
+    Restore();
+
+    const std::string path = Common::StringFromFormat("%s%016" PRIX64 ".ini",
+            FileUtil::GetUserPath(D_GAMECONFIG_IDX).c_str(), program_id);
+    if (!FileUtil::Exists(path))
+        return false;
+
+    INIReader profile(path);
+    if (profile.ParseError() != 0) {
+        LOG_ERROR(Config, "Failed to parse title profile %s (error %d)", path.c_str(), profile.ParseError());
+        return false;
+    }
+
+    configured_values = Settings::values;
+    configured_hw_renderer = VideoCore::g_hw_renderer_enabled;
+
+    ReadOverrides(profile, Settings::values);
+    if (Settings::values.use_hw_renderer != configured_values.use_hw_renderer)
+        VideoCore::g_hw_renderer_enabled = Settings::values.use_hw_renderer;
+
+    applied_program_id = program_id;
+    LOG_INFO(Config, "Applied title profile %s", path.c_str());
+    return true;
+}
+
+void Restore() {
+    if (applied_program_id == 0)
+        return;
+
+    Settings::values = configured_values;
+    VideoCore::g_hw_renderer_enabled = configured_hw_renderer;
+    applied_program_id = 0;
+}
+
+u64 GetProgramId() {
+    return applied_program_id;
+}
+
+} // namespace
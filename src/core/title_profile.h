@@ -0,0 +1,41 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Per-title overrides of the performance settings, since which of them help differs a lot between
+ * titles. A profile is an ini file named after the program ID, <game_config>/<016X program ID>.ini,
+ * with the same sections and keys as the frontend's config. Only the keys it contains override
+ * Settings::values, everything else keeps the configured value.
+ *
+ * Profiles are applied by the frontends before System::Init, since most settings are only read
+ * while the subsystems initialize. System::Shutdown restores the configured settings, so that the
+ * next title boots with them and the frontend never saves the overrides to its config.
+ */
+namespace TitleProfile {
+
+/**
+ * Reads the program ID of a bootable file and applies its profile, if there is one.
+ * @return Whether a profile has been applied
+ */
+bool ApplyForFile(const std::string& filename);
+
+/**
+ * Applies the profile of a program ID, if there is one.
+ * @return Whether a profile has been applied
+ */
+bool Apply(u64 program_id);
+
+/// Restores the settings overridden by the applied profile, if any
+void Restore();
+
+/// Returns the program ID of the applied profile, or 0 if none is applied
+u64 GetProgramId();
+
+} // namespace
@@ -17,8 +17,12 @@ struct CTHeader {
         return "CiTr";
     }
 
+    /**
+     * Version 2 added compression of memory loads (see CTMemoryLoad). Files without compressed
+     * memory loads are still written as version 1, since they are identical to it.
+     */
     static uint32_t ExpectedVersion() {
-        return 1;
+        return 2;
     }
 
     char magic[4];
@@ -70,7 +74,10 @@ struct CTMemoryLoad {
     uint32_t file_offset;
     uint32_t size;
     uint32_t physical_address;
-    uint32_t pad;
+
+    // Size of the zstd frame stored at file_offset, which decompresses to size bytes.
+    // 0 if the data is stored uncompressed. Always 0 (padding) in version 1.
+    uint32_t compressed_size;
 };
 
 struct CTRegisterWrite {
@@ -0,0 +1,242 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common/logging/log.h"
+
+#include "core/memory.h"
+#include "core/hw/gpu.h"
+#include "core/hw/hw.h"
+#include "core/hw/lcd.h"
+
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/pica.h"
+#include "video_core/rasterizer.h"
+#include "video_core/renderer_base.h"
+#include "video_core/texture_cache.h"
+#include "video_core/vertex_shader.h"
+#include "video_core/video_core.h"
+
+#include "player.h"
+
+namespace CiTrace {
+
+Player::Player(const std::string& filename) : file(filename) {
+    if (!file.IsOpen()) {
+        LOG_ERROR(HW_GPU, "Failed to open CiTrace %s", filename.c_str());
+        return;
+    }
+
+    if (file.GetSize() < sizeof(header)) {
+        LOG_ERROR(HW_GPU, "CiTrace %s is truncated", filename.c_str());
+        return;
+    }
+    std::memcpy(&header, file.GetData(), sizeof(header));
+
+    if (std::memcmp(header.magic, CTHeader::ExpectedMagicWord(), sizeof(header.magic)) != 0 ||
+        header.version > CTHeader::ExpectedVersion()) {
+        LOG_ERROR(HW_GPU, "%s is not a supported CiTrace (version %u)", filename.c_str(), header.version);
+        return;
+    }
+
+    if (header.stream_offset > file.GetSize() ||
+        (file.GetSize() - header.stream_offset) / sizeof(CTStreamElement) < header.stream_size) {
+        LOG_ERROR(HW_GPU, "Stream of CiTrace %s is out of bounds", filename.c_str());
+        return;
+    }
+    stream = reinterpret_cast<const CTStreamElement*>(file.GetData() + header.stream_offset);
+
+    num_frames = static_cast<unsigned>(std::count_if(stream, stream + header.stream_size,
+            [](const CTStreamElement& element) { return element.type == FrameMarker; }));
+
+    valid = true;
+}
+
+const u32* Player::GetSection(u32 offset, u32 size) const {
+    if (offset > file.GetSize() || (file.GetSize() - offset) / sizeof(u32) < size)
+        return nullptr;
+    return reinterpret_cast<const u32*>(file.GetData() + offset);
+}
+
+/// Copies up to `size` words of a section of the initial state to `dest`, which holds `max_size` words
+static void CopySection(const u32* section, u32 size, void* dest, size_t max_size) {
+    if (section != nullptr)
+        std::memcpy(dest, section, std::min<size_t>(size, max_size) * sizeof(u32));
+}
+
+void Player::ApplyInitialState() {
+    const auto& initial = header.initial_state_offsets;
+
+    CopySection(GetSection(initial.gpu_registers, initial.gpu_registers_size), initial.gpu_registers_size,
+                &GPU::g_regs, sizeof(GPU::g_regs) / sizeof(u32));
+    CopySection(GetSection(initial.lcd_registers, initial.lcd_registers_size), initial.lcd_registers_size,
+                &LCD::g_regs, sizeof(LCD::g_regs) / sizeof(u32));
+    CopySection(GetSection(initial.pica_registers, initial.pica_registers_size), initial.pica_registers_size,
+                &Pica::g_state.regs, sizeof(Pica::g_state.regs) / sizeof(u32));
+    Pica::Rasterizer::InvalidateDrawState();
+
+    auto& vs = Pica::g_state.vs;
+    CopySection(GetSection(initial.vs_program_binary, initial.vs_program_binary_size),
+                initial.vs_program_binary_size, vs.program_code.data(), vs.program_code.size());
+    CopySection(GetSection(initial.vs_swizzle_data, initial.vs_swizzle_data_size),
+                initial.vs_swizzle_data_size, vs.swizzle_data.data(), vs.swizzle_data.size());
+
+    // Attributes and uniforms are stored as 24-bit floats, with four components per vector
+    const u32* default_attributes = GetSection(initial.default_attributes, initial.default_attributes_size);
+    if (default_attributes != nullptr) {
+        for (u32 i = 0; i < initial.default_attributes_size / 4 && i < 16; ++i) {
+            for (unsigned comp = 0; comp < 4; ++comp)
+                vs.default_attributes[i][comp] = Pica::float24::FromRawFloat24(default_attributes[4 * i + comp]);
+        }
+    }
+
+    const u32* float_uniforms = GetSection(initial.vs_float_uniforms, initial.vs_float_uniforms_size);
+    if (float_uniforms != nullptr) {
+        for (u32 i = 0; i < initial.vs_float_uniforms_size / 4 && i < sizeof(vs.uniforms.f) / sizeof(vs.uniforms.f[0]); ++i) {
+            for (unsigned comp = 0; comp < 4; ++comp)
+                vs.uniforms.f[i][comp] = Pica::float24::FromRawFloat24(float_uniforms[4 * i + comp]);
+        }
+    }
+
+    // The boolean uniforms are only stored in their register
+    for (unsigned i = 0; i < 16; ++i)
+        vs.uniforms.b[i] = (Pica::g_state.regs.vs.bool_uniforms.Value() & (1 << i)) != 0;
+
+    auto& gs = Pica::g_state.gs;
+    CopySection(GetSection(initial.gs_program_binary, initial.gs_program_binary_size),
+                initial.gs_program_binary_size, gs.program_code.data(), gs.program_code.size());
+    CopySection(GetSection(initial.gs_swizzle_data, initial.gs_swizzle_data_size),
+                initial.gs_swizzle_data_size, gs.swizzle_data.data(), gs.swizzle_data.size());
+
+    const u32* gs_float_uniforms = GetSection(initial.gs_float_uniforms, initial.gs_float_uniforms_size);
+    if (gs_float_uniforms != nullptr) {
+        for (u32 i = 0; i < initial.gs_float_uniforms_size / 4 && i < sizeof(gs.uniforms.f) / sizeof(gs.uniforms.f[0]); ++i) {
+            for (unsigned comp = 0; comp < 4; ++comp)
+                gs.uniforms.f[i][comp] = Pica::float24::FromRawFloat24(gs_float_uniforms[4 * i + comp]);
+        }
+    }
+
+    for (unsigned i = 0; i < 16; ++i)
+        gs.uniforms.b[i] = (Pica::g_state.regs.gs.bool_uniforms.Value() & (1 << i)) != 0;
+
+    Pica::VertexShader::InvalidateDecodedProgram();
+
+    // All state changed behind the back of the rasterizers and their caches
+    VideoCore::g_renderer->hw_rasterizer->Reset();
+    Pica::TextureCache::FullFlush();
+}
+
+void Player::ApplyMemoryLoad(const CTMemoryLoad& load) {
+    if (load.size == 0)
+        return;
+
+    // The recorded regions are contiguous in host memory, since they were captured from a single pointer
+    u8* dest = Memory::GetPhysicalPointer(load.physical_address);
+    if (dest == nullptr || Memory::GetPhysicalPointer(load.physical_address + load.size - 1) != dest + load.size - 1) {
+        LOG_ERROR(HW_GPU, "Skipping memory load to unmapped region 0x%08X (size 0x%X)",
+                  load.physical_address, load.size);
+        return;
+    }
+
+    const u32 stored_size = load.compressed_size != 0 ? load.compressed_size : load.size;
+    if (load.file_offset > file.GetSize() || file.GetSize() - load.file_offset < stored_size) {
+        LOG_ERROR(HW_GPU, "Skipping out-of-bounds memory load at offset 0x%08X", load.file_offset);
+        return;
+    }
+    const u8* data = file.GetData() + load.file_offset;
+
+    if (load.compressed_size == 0) {
+        std::memcpy(dest, data, load.size);
+    } else {
+#ifdef HAVE_ZSTD
+        size_t result = ZSTD_decompress(dest, load.size, data, load.compressed_size);
+        if (ZSTD_isError(result) || result != load.size) {
+            LOG_ERROR(HW_GPU, "Failed to decompress memory load to 0x%08X", load.physical_address);
+            return;
+        }
+#else
+        LOG_ERROR(HW_GPU, "Skipping compressed memory load, Citra was built without zstd");
+        return;
+#endif
+    }
+
+    // Same as a cache flush by the application
+    Memory::RecordPhysicalWrite(load.physical_address, load.size);
+    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(load.physical_address, load.size);
+    Pica::TextureCache::NotifyFlush(load.physical_address, load.size);
+    Pica::Rasterizer::NotifyFlush(load.physical_address, load.size);
+}
+
+void Player::ApplyRegisterWrite(const CTRegisterWrite& write) {
+    if (write.physical_address < Memory::IO_AREA_PADDR || write.physical_address >= Memory::IO_AREA_PADDR_END) {
+        LOG_ERROR(HW_GPU, "Skipping register write to non-IO address 0x%08X", write.physical_address);
+        return;
+    }
+
+    // The recorder stores the physical addresses of the registers, the handlers expect virtual ones
+    const u32 addr = write.physical_address - Memory::IO_AREA_PADDR + Memory::IO_AREA_VADDR;
+
+    switch (write.size) {
+    case CTRegisterWrite::SIZE_8:
+        HW::Write<u8>(addr, static_cast<u8>(write.value));
+        break;
+    case CTRegisterWrite::SIZE_16:
+        HW::Write<u16>(addr, static_cast<u16>(write.value));
+        break;
+    case CTRegisterWrite::SIZE_32:
+        HW::Write<u32>(addr, static_cast<u32>(write.value));
+        break;
+    case CTRegisterWrite::SIZE_64:
+        HW::Write<u64>(addr, write.value);
+        break;
+    default:
+        LOG_ERROR(HW_GPU, "Skipping register write of unknown size 0x%X", write.size);
+        break;
+    }
+}
+
+void Player::Reset() {
+    if (!valid)
+        return;
+
+    ApplyInitialState();
+    position = 0;
+}
+
+bool Player::PlayFrame() {
+    if (!valid)
+        return false;
+
+    while (position < header.stream_size) {
+        const CTStreamElement& element = stream[position++];
+
+        switch (element.type) {
+        case FrameMarker:
+            VideoCore::g_renderer->SwapBuffers();
+            return true;
+
+        case MemoryLoad:
+            ApplyMemoryLoad(element.memory_load);
+            break;
+
+        case RegisterWrite:
+            ApplyRegisterWrite(element.register_write);
+            break;
+
+        default:
+            LOG_ERROR(HW_GPU, "Unknown stream element type 0x%X", element.type);
+            break;
+        }
+    }
+
+    return false;
+}
+
+} // namespace
@@ -0,0 +1,60 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+#include "citrace.h"
+
+namespace CiTrace {
+
+/**
+ * Replays a CiTrace recording on the emulated GPU, without running any guest code. Register
+ * writes go through the regular MMIO handlers, so command lists, memory fills and display
+ * transfers are processed by whichever rasterizer the emulator is configured to use.
+ * @note The emulated memory and hardware need to be initialized (see System::Init) before playing.
+ */
+class Player {
+public:
+    /// Maps the given recording. Check IsValid() to find out whether it could be parsed.
+    explicit Player(const std::string& filename);
+
+    bool IsValid() const { return valid; }
+
+    /// Returns the number of frames in the recording
+    unsigned GetNumFrames() const { return num_frames; }
+
+    /// Loads the GPU state at the start of the recording and moves back to the start of the stream
+    void Reset();
+
+    /**
+     * Replays the stream up to and including the next frame marker.
+     * @return False if the end of the stream was reached before a complete frame was played
+     */
+    bool PlayFrame();
+
+private:
+    void ApplyInitialState();
+    void ApplyMemoryLoad(const CTMemoryLoad& load);
+    void ApplyRegisterWrite(const CTRegisterWrite& write);
+
+    /// Returns the initial state section at the given offset, or nullptr if it's out of bounds
+    const u32* GetSection(u32 offset, u32 size) const;
+
+    FileUtil::MappedFile file;
+    bool valid = false;
+
+    CTHeader header;
+    const CTStreamElement* stream = nullptr;
+    unsigned num_frames = 0;
+
+    /// Index of the next stream element to replay
+    u32 position = 0;
+};
+
+} // namespace
@@ -2,28 +2,39 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <cstring>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "common/assert.h"
 #include "common/file_util.h"
+#include "common/hash.h"
 #include "common/logging/log.h"
+#include "common/profiler.h"
 
 #include "recorder.h"
 
 namespace CiTrace {
 
-Recorder::Recorder(const InitialState& initial_state) : initial_state(initial_state) {
+/// Size of the chunks in which the recording is written to its temporary files
+static const size_t CHUNK_SIZE = 1024 * 1024;
 
-}
+/// Number of full chunks which may wait for the writer thread before recording blocks
+static const size_t MAX_QUEUED_CHUNKS = 8;
 
-void Recorder::Finish(const std::string& filename) {
-    // Setup CiTrace header
-    CTHeader header;
-    std::memcpy(header.magic, CTHeader::ExpectedMagicWord(), 4);
-    header.version = CTHeader::ExpectedVersion();
-    header.header_size = sizeof(CTHeader);
+/// Size of the stream and memory contents recorded so far, which are spooled to temporary files
+static Common::Profiling::MemoryCounter recording_counter("CiTrace Recording");
 
-    // Calculate file offsets
+#ifdef HAVE_ZSTD
+/// zstd level used for memory contents. Low levels keep up with recording in real time.
+static const int MEMORY_COMPRESSION_LEVEL = 3;
+#endif
+
+/// Fills in the header fields describing the layout of the initial state, which precedes the stream
+static void SetupInitialStateOffsets(CTHeader& header, const Recorder::InitialState& initial_state) {
     auto& initial = header.initial_state_offsets;
 
     initial.gpu_registers_size      = initial_state.gpu_registers.size();
@@ -36,11 +47,10 @@ void Recorder::Finish(const std::string& filename) {
     initial.gs_program_binary_size  = initial_state.gs_program_binary.size();
     initial.gs_swizzle_data_size    = initial_state.gs_swizzle_data.size();
     initial.gs_float_uniforms_size  = initial_state.gs_float_uniforms.size();
-    header.stream_size              = stream.size();
 
     initial.gpu_registers      = sizeof(header);
     initial.lcd_registers      = initial.gpu_registers      + initial.gpu_registers_size * sizeof(u32);
-    initial.pica_registers     = initial.lcd_registers      + initial.lcd_registers_size * sizeof(u32);;
+    initial.pica_registers     = initial.lcd_registers      + initial.lcd_registers_size * sizeof(u32);
     initial.default_attributes = initial.pica_registers     + initial.pica_registers_size * sizeof(u32);
     initial.vs_program_binary  = initial.default_attributes + initial.default_attributes_size * sizeof(u32);
     initial.vs_swizzle_data    = initial.vs_program_binary  + initial.vs_program_binary_size * sizeof(u32);
@@ -48,28 +58,149 @@ void Recorder::Finish(const std::string& filename) {
     initial.gs_program_binary  = initial.vs_float_uniforms  + initial.vs_float_uniforms_size * sizeof(u32);
     initial.gs_swizzle_data    = initial.gs_program_binary  + initial.gs_program_binary_size * sizeof(u32);
     initial.gs_float_uniforms  = initial.gs_swizzle_data    + initial.gs_swizzle_data_size * sizeof(u32);
-    header.stream_offset       = initial.gs_float_uniforms  + initial.gs_float_uniforms_size * sizeof(u32);
+}
+
+Recorder::Recorder(const InitialState& initial_state, bool compress_memory)
+        : initial_state(initial_state), compress_memory(compress_memory) {
+#ifndef HAVE_ZSTD
+    if (compress_memory)
+        LOG_WARNING(HW_GPU, "Built without zstd, the CiTrace will not be compressed");
+    this->compress_memory = false;
+#endif
+
+    // The extra data is stored right after the initial state, so its file offsets are known now
+    CTHeader header;
+    SetupInitialStateOffsets(header, initial_state);
+    extra_data_offset = header.initial_state_offsets.gs_float_uniforms +
+                        header.initial_state_offsets.gs_float_uniforms_size * sizeof(u32);
+
+    const std::string& cache_dir = FileUtil::GetUserPath(D_CACHE_IDX);
+    FileUtil::CreateFullPath(cache_dir);
+    extra_data.path = cache_dir + "citrace_extra_data.tmp";
+    stream.path = cache_dir + "citrace_stream.tmp";
+
+    for (Spool* spool : { &extra_data, &stream }) {
+        spool->file = FileUtil::IOFile(spool->path, "w+b");
+        if (!spool->file.IsOpen()) {
+            LOG_ERROR(HW_GPU, "Failed to create %s, the CiTrace will be incomplete", spool->path.c_str());
+            write_failed = true;
+        }
+        spool->chunk.reserve(CHUNK_SIZE);
+    }
 
-    // Iterate through stream elements, update relevant stream element data
-    for (auto& stream_element : stream) {
-        switch (stream_element.data.type) {
-        case MemoryLoad:
+    writer = std::thread(&Recorder::WriterLoop, this);
+}
+
+Recorder::~Recorder() {
+    StopWriter();
+
+    for (Spool* spool : { &extra_data, &stream }) {
+        spool->file.Close();
+        FileUtil::Delete(spool->path);
+        recording_counter.Add(-(s64)spool->size);
+    }
+}
+
+void Recorder::Append(Spool& spool, const void* data, size_t size) {
+    const u8* bytes = static_cast<const u8*>(data);
+    spool.size += size;
+    recording_counter.Add(size);
+
+    while (size != 0) {
+        size_t length = std::min(size, CHUNK_SIZE - spool.chunk.size());
+        spool.chunk.insert(spool.chunk.end(), bytes, bytes + length);
+        bytes += length;
+        size -= length;
+
+        if (spool.chunk.size() == CHUNK_SIZE)
+            SubmitChunk(spool);
+    }
+}
+
+void Recorder::SubmitChunk(Spool& spool) {
+    if (spool.chunk.empty())
+        return;
+
+    std::vector<u8> chunk;
+    chunk.reserve(CHUNK_SIZE);
+    std::swap(chunk, spool.chunk);
+
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_changed.wait(lock, [this]{ return queue.size() < MAX_QUEUED_CHUNKS; });
+        queue.emplace_back(&spool, std::move(chunk));
+    }
+    queue_changed.notify_all();
+}
+
+void Recorder::StopWriter() {
+    if (!writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stop_writer = true;
+    }
+    queue_changed.notify_all();
+    writer.join();
+}
+
+void Recorder::WriterLoop() {
+    while (true) {
+        std::pair<Spool*, std::vector<u8>> chunk;
         {
-            auto& file_offset = memory_regions[stream_element.hash];
-            if (!stream_element.uses_existing_data) {
-                file_offset = header.stream_offset;
-            }
-            stream_element.data.memory_load.file_offset = file_offset;
-            break;
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this]{ return !queue.empty() || stop_writer; });
+            if (queue.empty())
+                return;
+
+            chunk = std::move(queue.front());
+            queue.pop_front();
         }
+        queue_changed.notify_all();
+
+        FileUtil::IOFile& file = chunk.first->file;
+        if (file.IsOpen() && file.WriteBytes(chunk.second.data(), chunk.second.size()) != chunk.second.size()) {
+            LOG_ERROR(HW_GPU, "Failed to write to %s", chunk.first->path.c_str());
+            file.Close();
 
-        default:
-            // Other commands don't use any extra data
-            DEBUG_ASSERT(stream_element.extra_data.size() == 0);
-            break;
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            write_failed = true;
         }
-        header.stream_offset += stream_element.extra_data.size();
     }
+}
+
+/// Appends the contents of a temporary file to the output file
+static bool CopySpool(FileUtil::IOFile& spool, u64 size, FileUtil::IOFile& file) {
+    std::vector<u8> buffer(CHUNK_SIZE);
+
+    spool.Seek(0, SEEK_SET);
+    while (size != 0) {
+        size_t length = static_cast<size_t>(std::min<u64>(size, buffer.size()));
+        if (spool.ReadBytes(buffer.data(), length) != length || file.WriteBytes(buffer.data(), length) != length)
+            return false;
+        size -= length;
+    }
+    return true;
+}
+
+void Recorder::Finish(const std::string& filename) {
+    // Setup CiTrace header
+    CTHeader header;
+    std::memcpy(header.magic, CTHeader::ExpectedMagicWord(), 4);
+    header.version = any_compressed ? CTHeader::ExpectedVersion() : 1;
+    header.header_size = sizeof(CTHeader);
+
+    // Calculate file offsets
+    SetupInitialStateOffsets(header, initial_state);
+    auto& initial = header.initial_state_offsets;
+    header.stream_size   = stream_size;
+    header.stream_offset = extra_data_offset + extra_data.size;
+
+    // Write out the remaining chunks. The temporary files are complete after this.
+    SubmitChunk(extra_data);
+    SubmitChunk(stream);
+    StopWriter();
 
     try {
         // Open file and write header
@@ -119,64 +250,82 @@ void Recorder::Finish(const std::string& filename) {
         if (written != initial_state.gs_float_uniforms.size() || file.Tell() != initial.gs_float_uniforms + sizeof(u32) * initial.gs_float_uniforms_size)
             throw "Failed to write geometry shader float uniforms";
 
-        // Iterate through stream elements, write "extra data"
-        for (const auto& stream_element : stream) {
-            if (stream_element.extra_data.size() == 0)
-                continue;
+        if (write_failed)
+            throw "Failed to write temporary files while recording";
 
-            written = file.WriteBytes(stream_element.extra_data.data(), stream_element.extra_data.size());
-            if (written != stream_element.extra_data.size())
-                throw "Failed to write extra data";
-        }
+        // Copy the extra data and the stream elements recorded into the temporary files
+        if (!CopySpool(extra_data.file, extra_data.size, file))
+            throw "Failed to write extra data";
 
         if (file.Tell() != header.stream_offset)
             throw "Unexpected end of extra data";
 
-        // Write actual stream elements
-        for (const auto& stream_element : stream) {
-            if (1 != file.WriteObject(stream_element.data))
-                throw "Failed to write stream element";
-        }
+        if (!CopySpool(stream.file, stream.size, file))
+            throw "Failed to write stream elements";
     } catch(const char* str) {
         LOG_ERROR(HW_GPU, "Writing CiTrace file failed: %s", str);
     }
 }
 
 void Recorder::FrameFinished() {
-    stream.push_back( { FrameMarker } );
+    CTStreamElement element = { FrameMarker };
+    Append(stream, &element, sizeof(element));
+    ++stream_size;
 }
 
 void Recorder::MemoryAccessed(const u8* data, u32 size, u32 physical_address) {
-    StreamElement element = { MemoryLoad };
-    element.data.memory_load.size = size;
-    element.data.memory_load.physical_address = physical_address;
+    CTStreamElement element = { MemoryLoad };
+    element.memory_load.size = size;
+    element.memory_load.physical_address = physical_address;
 
     // Compute hash over given memory region to check if the contents are already stored internally
-    boost::crc_32_type result;
-    result.process_bytes(data, size);
-    element.hash = result.checksum();
-
-    element.uses_existing_data = (memory_regions.find(element.hash) != memory_regions.end());
-    if (!element.uses_existing_data) {
-        element.extra_data.resize(size);
-        memcpy(element.extra_data.data(), data, size);
-        memory_regions.insert({element.hash, 0}); // file offset will be initialized in Finish()
+    MemoryRegionKey key(Common::ComputeHash64(data, size), size);
+
+    auto it = memory_regions.find(key);
+    if (it != memory_regions.end()) {
+        element.memory_load.file_offset = it->second.first;
+        element.memory_load.compressed_size = it->second.second;
+    } else {
+        element.memory_load.file_offset = static_cast<u32>(extra_data_offset + extra_data.size);
+
+#ifdef HAVE_ZSTD
+        if (compress_memory) {
+            compression_buffer.resize(ZSTD_compressBound(size));
+            size_t compressed_size = ZSTD_compress(compression_buffer.data(), compression_buffer.size(),
+                                                   data, size, MEMORY_COMPRESSION_LEVEL);
+
+            // Store incompressible data as it is
+            if (!ZSTD_isError(compressed_size) && compressed_size < size) {
+                element.memory_load.compressed_size = static_cast<u32>(compressed_size);
+                any_compressed = true;
+            }
+        }
+#endif
+
+        if (element.memory_load.compressed_size != 0)
+            Append(extra_data, compression_buffer.data(), element.memory_load.compressed_size);
+        else
+            Append(extra_data, data, size);
+
+        memory_regions.insert({ key, { element.memory_load.file_offset, element.memory_load.compressed_size } });
     }
 
-    stream.push_back(element);
+    Append(stream, &element, sizeof(element));
+    ++stream_size;
 }
 
 template<typename T>
 void Recorder::RegisterWritten(u32 physical_address, T value) {
-    StreamElement element = { RegisterWrite };
-    element.data.register_write.size = (sizeof(T) == 1) ? CTRegisterWrite::SIZE_8
-                                     : (sizeof(T) == 2) ? CTRegisterWrite::SIZE_16
-                                     : (sizeof(T) == 4) ? CTRegisterWrite::SIZE_32
-                                     :                    CTRegisterWrite::SIZE_64;
-    element.data.register_write.physical_address = physical_address;
-    element.data.register_write.value = value;
-
-    stream.push_back(element);
+    CTStreamElement element = { RegisterWrite };
+    element.register_write.size = (sizeof(T) == 1) ? CTRegisterWrite::SIZE_8
+                                : (sizeof(T) == 2) ? CTRegisterWrite::SIZE_16
+                                : (sizeof(T) == 4) ? CTRegisterWrite::SIZE_32
+                                :                    CTRegisterWrite::SIZE_64;
+    element.register_write.physical_address = physical_address;
+    element.register_write.value = value;
+
+    Append(stream, &element, sizeof(element));
+    ++stream_size;
 }
 
 template void Recorder::RegisterWritten(u32,u8);
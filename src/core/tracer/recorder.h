@@ -4,12 +4,17 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include <boost/crc.hpp>
-
 #include "common/common_types.h"
+#include "common/file_util.h"
 
 #include "citrace.h"
 
@@ -31,11 +36,17 @@ public:
     };
 
     /**
-     * Recorder constructor
+     * Recorder constructor. Recording starts right away, with the recorded data being written to
+     * temporary files as it comes in, so that memory usage doesn't grow with the recording.
      * @param default_attributes Pointer to an array of 32-bit-aligned 24-bit floating point values.
      * @param vs_float_uniforms Pointer to an array of 32-bit-aligned 24-bit floating point values.
+     * @param compress_memory Whether to compress the memory contents stored in the recording.
+     *                        Ignored if Citra was built without zstd.
      */
-    Recorder(const InitialState& initial_state);
+    Recorder(const InitialState& initial_state, bool compress_memory = false);
+
+    /// Stops recording and discards the recording, unless it has been saved with Finish()
+    ~Recorder();
 
     /// Finish recording of this Citrace and save it using the given filename.
     void Finish(const std::string& filename);
@@ -58,33 +69,76 @@ public:
     void RegisterWritten(u32 physical_address, T value);
 
 private:
+    /**
+     * Temporary file which a part of the recording is appended to while recording. Data is
+     * collected in chunks, which are written to the file by the writer thread.
+     */
+    struct Spool {
+        std::string path;
+        FileUtil::IOFile file;
+
+        /// Chunk currently being filled by the recording thread
+        std::vector<u8> chunk;
+
+        /// Total number of bytes appended to the spool
+        u64 size = 0;
+    };
+
+    /// Appends data to a spool, handing the current chunk to the writer thread once it is full
+    void Append(Spool& spool, const void* data, size_t size);
+
+    /// Hands the current chunk of a spool to the writer thread, waiting if it is too far behind
+    void SubmitChunk(Spool& spool);
+
+    /// Waits for the writer thread to write all chunks and stops it
+    void StopWriter();
+
+    void WriterLoop();
+
     // Initial state of recording start
     InitialState initial_state;
 
-    // Command stream
-    struct StreamElement {
-        CTStreamElement data;
+    /// Memory loaded by the GPU, appended in the order it will appear in the output file
+    Spool extra_data;
+    /// Stream elements (CTStreamElement), with their file offsets already resolved
+    Spool stream;
 
-        /**
-          * Extra data to store along "core" data.
-          * This is e.g. used for data used in MemoryUpdates.
-          */
-        std::vector<u8> extra_data;
+    /// File offset at which the extra data starts, right after the initial state
+    u32 extra_data_offset;
 
-        /// Optional CRC hash (e.g. for hashing memory regions)
-        boost::crc_32_type::value_type hash;
+    /// Number of stream elements recorded
+    u32 stream_size = 0;
 
-        /// If true, refer to data already written to the output file instead of extra_data
-        bool uses_existing_data;
-    };
+    std::thread writer;
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    /// Full chunks waiting to be written, with the spool they belong to (guarded by queue_mutex)
+    std::deque<std::pair<Spool*, std::vector<u8>>> queue;
+    bool stop_writer = false;   ///< Guarded by queue_mutex
+    bool write_failed = false;  ///< Guarded by queue_mutex
 
-    std::vector<StreamElement> stream;
+    /// Whether memory contents are compressed, and if any of them were stored compressed
+    bool compress_memory;
+    bool any_compressed = false;
+
+    /// Buffer for compressed memory contents, kept around to avoid reallocating it for each load
+    std::vector<u8> compression_buffer;
+
+    /// Identifies memory contents by their 64-bit hash and their size
+    using MemoryRegionKey = std::pair<u64 /*hash*/, u32 /*size*/>;
+
+    struct MemoryRegionKeyHash {
+        size_t operator()(const MemoryRegionKey& key) const {
+            return static_cast<size_t>(key.first ^ key.second);
+        }
+    };
 
     /**
-     * Internal cache which maps hashes of memory contents to file offsets at which those memory
-     * contents are stored.
+     * Internal cache which maps memory contents to the file offsets and compressed sizes with
+     * which those memory contents are stored.
      */
-    std::unordered_map<boost::crc_32_type::value_type /*hash*/, u32 /*file_offset*/> memory_regions;
+    std::unordered_map<MemoryRegionKey, std::pair<u32 /*file_offset*/, u32 /*compressed_size*/>,
+                       MemoryRegionKeyHash> memory_regions;
 };
 
 } // namespace
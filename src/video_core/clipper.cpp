@@ -47,50 +47,50 @@ private:
     Math::Vec4<float24> bias;
 };
 
-static void InitScreenCoordinates(OutputVertex& vtx)
-{
-    struct {
-        float24 halfsize_x;
-        float24 offset_x;
-        float24 halfsize_y;
-        float24 offset_y;
-        float24 zscale;
-        float24 offset_z;
-    } viewport;
-
-    const auto& regs = g_state.regs;
-    viewport.halfsize_x = float24::FromRawFloat24(regs.viewport_size_x);
-    viewport.halfsize_y = float24::FromRawFloat24(regs.viewport_size_y);
-    viewport.offset_x   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.x));
-    viewport.offset_y   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.y));
-    viewport.zscale     = float24::FromRawFloat24(regs.viewport_depth_range);
-    viewport.offset_z   = float24::FromRawFloat24(regs.viewport_depth_far_plane);
+using Viewport = Rasterizer::DrawState::Viewport;
+
+/// Screen space x and y coordinates of the given clip space position, given 1/w
+static Math::Vec2<float24> ScreenXY(const Viewport& viewport, const Math::Vec4<float24>& pos, float24 inv_w) {
+    return Math::MakeVec((pos.x * inv_w + float24::FromFloat32(1.0)) * viewport.halfsize_x + viewport.offset_x,
+                         (pos.y * inv_w + float24::FromFloat32(1.0)) * viewport.halfsize_y + viewport.offset_y);
+}
 
+static void InitScreenCoordinates(const Viewport& viewport, OutputVertex& vtx)
+{
     float24 inv_w = float24::FromFloat32(1.f) / vtx.pos.w;
+    Math::Vec2<float24> screen_xy = ScreenXY(viewport, vtx.pos, inv_w);
+
     vtx.color *= inv_w;
     vtx.tc0 *= inv_w;
     vtx.tc1 *= inv_w;
     vtx.tc2 *= inv_w;
     vtx.pos.w = inv_w;
 
-    vtx.screenpos[0] = (vtx.pos.x * inv_w + float24::FromFloat32(1.0)) * viewport.halfsize_x + viewport.offset_x;
-    vtx.screenpos[1] = (vtx.pos.y * inv_w + float24::FromFloat32(1.0)) * viewport.halfsize_y + viewport.offset_y;
+    vtx.screenpos[0] = screen_xy.x;
+    vtx.screenpos[1] = screen_xy.y;
     vtx.screenpos[2] = viewport.offset_z + vtx.pos.z * inv_w * viewport.zscale;
 }
 
+/**
+ * Size of the guard band in pixels. Triangles within it don't need to be clipped against the
+ * x and y planes, since the rasterizer limits drawing to the viewport anyway. Rasterizer
+ * coordinates are unsigned and its edge functions have to fit into 32 bits, so the band starts
+ * at the screen origin and is limited to the maximum framebuffer size.
+ */
+static const float GUARD_BAND_SIZE = 1024.f;
+
+/// Returns true if the vertex, which must have a positive w, ends up within the guard band
+static bool IsInGuardBand(const Viewport& viewport, const OutputVertex& vtx) {
+    // Computed exactly like InitScreenCoordinates, so rounding can't take it out of the band later
+    Math::Vec2<float24> screen_xy = ScreenXY(viewport, vtx.pos, float24::FromFloat32(1.f) / vtx.pos.w);
+    float x = screen_xy.x.ToFloat32();
+    float y = screen_xy.y.ToFloat32();
+    return x >= 0.f && x < GUARD_BAND_SIZE && y >= 0.f && y < GUARD_BAND_SIZE;
+}
+
 void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
     using boost::container::static_vector;
 
-    // Clipping a planar n-gon against a plane will remove at least 1 vertex and introduces 2 at
-    // the new edge (or less in degenerate cases). As such, we can say that each clipping plane
-    // introduces at most 1 new vertex to the polygon. Since we start with a triangle and have a
-    // fixed 6 clipping planes, the maximum number of vertices of the clipped polygon is 3 + 6 = 9.
-    static const size_t MAX_VERTICES = 9;
-    static_vector<OutputVertex, MAX_VERTICES> buffer_a = { v0, v1, v2 };
-    static_vector<OutputVertex, MAX_VERTICES> buffer_b;
-    auto* output_list = &buffer_a;
-    auto* input_list  = &buffer_b;
-
     // NOTE: We clip against a w=epsilon plane to guarantee that the output has a positive w value.
     // TODO: Not sure if this is a valid approach. Also should probably instead use the smallest
     //       epsilon possible within float24 accuracy.
@@ -107,6 +107,53 @@ void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
         { Math::MakeVec( f0,  f0,  f0, -f1), Math::Vec4<float24>(f0, f0, f0, EPSILON) }, // w = EPSILON
     }};
 
+    /// Edges which can't be left to the guard band: z = 0, z = -w and w = EPSILON
+    static const u32 DEPTH_AND_W_EDGES = 0x70;
+
+    // Bit i is set if the vertex lies outside of clipping_edges[i]
+    auto GetOutcode = [](const OutputVertex& vertex) {
+        u32 outcode = 0;
+        for (size_t i = 0; i < clipping_edges.size(); ++i) {
+            if (clipping_edges[i].IsOutSide(vertex))
+                outcode |= 1 << i;
+        }
+        return outcode;
+    };
+
+    const u32 outcode0 = GetOutcode(v0);
+    const u32 outcode1 = GetOutcode(v1);
+    const u32 outcode2 = GetOutcode(v2);
+
+    // Triangles entirely outside of any one edge would be clipped away completely
+    if ((outcode0 & outcode1 & outcode2) != 0)
+        return;
+
+    const Viewport& viewport = Rasterizer::GetDrawState().viewport;
+
+    // Triangles entirely inside the view volume, which is the common case, are passed on as is.
+    // So are triangles which only leave it through the x and y planes but stay in the guard band.
+    const u32 outcodes = outcode0 | outcode1 | outcode2;
+    if (outcodes == 0 || ((outcodes & DEPTH_AND_W_EDGES) == 0 && IsInGuardBand(viewport, v0) &&
+                          IsInGuardBand(viewport, v1) && IsInGuardBand(viewport, v2))) {
+        OutputVertex vtx0 = v0, vtx1 = v1, vtx2 = v2;
+        InitScreenCoordinates(viewport, vtx0);
+        InitScreenCoordinates(viewport, vtx1);
+        InitScreenCoordinates(viewport, vtx2);
+
+        Rasterizer::ProcessTriangle(vtx0, vtx1, vtx2);
+        return;
+    }
+
+    // Clipping a planar n-gon against a plane will remove at least 1 vertex and introduces 2 at
+    // the new edge (or less in degenerate cases). As such, we can say that each clipping plane
+    // introduces at most 1 new vertex to the polygon. Since we start with a triangle and have a
+    // fixed 7 clipping planes, the maximum number of vertices of the clipped polygon is 3 + 7 = 10.
+    static const size_t MAX_VERTICES = 10;
+    static_vector<OutputVertex, MAX_VERTICES> buffer_a = { v0, v1, v2 };
+    static_vector<OutputVertex, MAX_VERTICES> buffer_b;
+    auto* output_list = &buffer_a;
+    auto* input_list  = &buffer_b;
+
     // TODO: If one vertex lies outside one of the depth clipping planes, some platforms (e.g. Wii)
     //       drop the whole primitive instead of clipping the primitive properly. We should test if
     //       this happens on the 3DS, too.
@@ -139,15 +186,15 @@ void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
             return;
     }
 
-    InitScreenCoordinates((*output_list)[0]);
-    InitScreenCoordinates((*output_list)[1]);
+    InitScreenCoordinates(viewport, (*output_list)[0]);
+    InitScreenCoordinates(viewport, (*output_list)[1]);
 
     for (size_t i = 0; i < output_list->size() - 2; i ++) {
         OutputVertex& vtx0 = (*output_list)[0];
         OutputVertex& vtx1 = (*output_list)[i+1];
         OutputVertex& vtx2 = (*output_list)[i+2];
 
-        InitScreenCoordinates(vtx2);
+        InitScreenCoordinates(viewport, vtx2);
 
         LOG_TRACE(Render_Software,
                   "Triangle %lu/%lu at position (%.3f, %.3f, %.3f, %.3f), "
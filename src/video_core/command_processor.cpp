@@ -2,9 +2,14 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <boost/range/algorithm/fill.hpp>
+#include <array>
+#include <unordered_map>
+#include <vector>
 
+#include "common/assert.h"
+#include "common/hash.h"
 #include "common/profiler.h"
+#include "common/thread_pool.h"
 
 #include "core/hle/service/gsp_gpu.h"
 #include "core/hw/gpu.h"
@@ -14,10 +19,13 @@
 
 #include "clipper.h"
 #include "command_processor.h"
+#include "gpu_thread.h"
 #include "math.h"
 #include "pica.h"
 #include "primitive_assembly.h"
+#include "rasterizer.h"
 #include "renderer_base.h"
+#include "vertex_loader.h"
 #include "vertex_shader.h"
 #include "video_core.h"
 
@@ -35,6 +43,214 @@ static u32 default_attr_write_buffer[3];
 
 Common::Profiling::TimingCategory category_drawing("Drawing");
 
+static DrawCallback draw_callback;
+
+/// Set when a command buffer trigger replaces the command list being processed
+static bool command_list_jumped = false;
+
+/// Number of shaded vertices kept in the post-transform vertex cache
+static const unsigned int VERTEX_CACHE_SIZE = 32;
+
+struct VertexCacheEntry {
+    static const u32 INVALID_INDEX = 0xFFFFFFFF;
+
+    /// Vertex index the cached output belongs to, or INVALID_INDEX if the entry is empty
+    u32 index;
+    VertexShader::OutputVertex output;
+};
+
+static std::array<VertexCacheEntry, VERTEX_CACHE_SIZE> vertex_cache;
+
+/// Vertex of the current draw which has been added to the hardware rasterizer's batch
+struct HWVertexEntry {
+    u32 index;
+    u32 batch_index;
+};
+
+/// Lets repeated indices of an indexed draw refer to the same vertex in the hardware rasterizer's batch
+static std::array<HWVertexEntry, VERTEX_CACHE_SIZE> hw_vertex_cache;
+
+/// Maximum number of vertices loaded up front for an indexed draw
+static const u32 MAX_PREFETCHED_VERTICES = 2048;
+
+/// Input vertices of the index range used by the current draw, if it was loaded up front
+static std::vector<VertexShader::InputVertex> prefetched_vertices;
+
+/// Draws with at least this many vertices are shaded in parallel on the thread pool
+static const u32 MIN_PARALLEL_SHADING_VERTICES = 512;
+
+/// Input and shaded vertices of a draw which is shaded in parallel, indexed relative to its first vertex
+static std::vector<VertexShader::InputVertex> parallel_inputs;
+static std::vector<VertexShader::OutputVertex> post_transform_vertices;
+
+/**
+ * Shades the given range of vertices on the thread pool, and stores the results in
+ * post_transform_vertices. Vertices are independent until primitive assembly, so they can be
+ * shaded in any order.
+ * @param inputs Input vertices of the range, or nullptr to load them from the vertex arrays
+ */
+static void ShadeVerticesInParallel(const VertexLoader& loader, u32 first, u32 count,
+                                    const VertexShader::InputVertex* inputs) {
+    const auto& regs = g_state.regs;
+    const int num_attributes = regs.vertex_attributes.GetNumTotalAttributes();
+
+    if (inputs == nullptr)
+        parallel_inputs.resize(count);
+    post_transform_vertices.resize(count);
+
+    // Workers only read the decoded program, so it must be decoded up front
+    VertexShader::PrepareDecodedProgram();
+
+    // Several chunks per thread balance the load if some vertices take longer branches
+    Common::ThreadPool& pool = Common::GetThreadPool();
+    size_t chunk_size = std::max<size_t>(64, count / ((pool.GetWorkerCount() + 1) * 4));
+    chunk_size = (chunk_size + VertexShader::BATCH_SIZE - 1) / VertexShader::BATCH_SIZE * VertexShader::BATCH_SIZE;
+
+    pool.ParallelFor(0, count, chunk_size, [&](size_t begin, size_t end) {
+        const VertexShader::InputVertex* chunk_inputs = inputs + begin;
+        if (inputs == nullptr) {
+            loader.LoadVertices(first + (u32)begin, (u32)(end - begin), &parallel_inputs[begin]);
+            chunk_inputs = &parallel_inputs[begin];
+        }
+
+        for (size_t batch = begin; batch < end; batch += VertexShader::BATCH_SIZE) {
+            const int batch_size = (int)std::min<size_t>(VertexShader::BATCH_SIZE, end - batch);
+            VertexShader::RunShaderBatch(chunk_inputs + (batch - begin), &post_transform_vertices[batch],
+                                         batch_size, num_attributes, regs.vs, g_state.vs);
+        }
+    });
+}
+
+/// Passes a triangle emitted by the geometry shader on to the rasterizer
+static void SubmitEmittedTriangle(VertexShader::OutputVertex& v0, VertexShader::OutputVertex& v1,
+                                  VertexShader::OutputVertex& v2) {
+    if (Settings::values.use_hw_renderer) {
+        auto& hw_rasterizer = VideoCore::g_renderer->hw_rasterizer;
+        const u32 i0 = hw_rasterizer->AddVertex(v0);
+        const u32 i1 = hw_rasterizer->AddVertex(v1);
+        const u32 i2 = hw_rasterizer->AddVertex(v2);
+        hw_rasterizer->AddIndexedTriangle(i0, i1, i2);
+    } else {
+        Clipper::ProcessTriangle(v0, v1, v2);
+    }
+}
+
+/**
+ * Shades the vertices of a draw with the geometry shader enabled. The output registers written by
+ * the vertex shader are appended to the geometry shader's input buffer, one attribute each, and
+ * the geometry shader runs whenever the buffer is full. Both stages run in batches.
+ * @param load_vertex Called as load_vertex(vertex, input) to load the attributes of a vertex
+ */
+template <typename LoadVertex>
+static void ShadeGeometry(bool is_indexed, const u8* index_address_8, const u16* index_address_16, bool index_u16,
+                          const LoadVertex& load_vertex) {
+    const auto& regs = g_state.regs;
+
+    if (regs.gs_config.mode != Regs::GSConfig::Mode::Point) {
+        LOG_ERROR(HW_GPU, "Unimplemented geometry shader mode %u", (unsigned)regs.gs_config.mode.Value());
+        return;
+    }
+
+    const int num_vs_attributes = regs.vertex_attributes.GetNumTotalAttributes();
+    const int num_gs_attributes = regs.gs.input_buffer_config.max_input_attribute_index + 1;
+    const u32 vs_output_mask = regs.vs.output_mask;
+    const VertexShader::TriangleHandler triangle_handler = SubmitEmittedTriangle;
+
+    VertexShader::InputVertex gs_inputs[VertexShader::BATCH_SIZE];
+    int num_invocations = 0;
+    int num_buffered_attributes = 0;
+
+    for (unsigned int batch_start = 0; batch_start < regs.num_vertices; batch_start += VertexShader::BATCH_SIZE) {
+        const int batch_size = (int)std::min<unsigned int>(VertexShader::BATCH_SIZE, regs.num_vertices - batch_start);
+
+        VertexShader::InputVertex vs_inputs[VertexShader::BATCH_SIZE];
+        for (int i = 0; i < batch_size; ++i) {
+            const unsigned int index = batch_start + i;
+            unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+            load_vertex(vertex, vs_inputs[i]);
+        }
+
+        VertexShader::OutputRegisters vs_outputs[VertexShader::BATCH_SIZE];
+        VertexShader::RunShaderBatch(vs_inputs, vs_outputs, batch_size, num_vs_attributes, regs.vs, g_state.vs);
+
+        for (int i = 0; i < batch_size; ++i) {
+            for (int reg = 0; reg < 16; ++reg) {
+                if ((vs_output_mask & (1 << reg)) == 0)
+                    continue;
+
+                gs_inputs[num_invocations].attr[num_buffered_attributes] = vs_outputs[i].value[reg];
+                if (++num_buffered_attributes < num_gs_attributes)
+                    continue;
+
+                num_buffered_attributes = 0;
+                if (++num_invocations == VertexShader::BATCH_SIZE) {
+                    VertexShader::RunGeometryShaderBatch(gs_inputs, num_invocations, num_gs_attributes, triangle_handler);
+                    num_invocations = 0;
+                }
+            }
+        }
+    }
+
+    // Attributes left over in the input buffer never fill it, so they don't start an invocation
+    if (num_invocations != 0)
+        VertexShader::RunGeometryShaderBatch(gs_inputs, num_invocations, num_gs_attributes, triangle_handler);
+}
+
+/// Returns whether the given shader register belongs to the geometry shader unit rather than the vertex shader one
+static inline bool IsGeometryShaderReg(u32 id) {
+    return id < PICA_REG_INDEX(vs);
+}
+
+/// Appends a word to the uniform FIFO of a shader unit, and writes the uniform once all of its words have arrived
+static void WriteUniformWord(Regs::ShaderConfig& config, State::ShaderSetup& setup, u32 value) {
+    auto& uniform_setup = config.uniform_setup;
+
+    // TODO: Does actual hardware indeed keep an intermediate buffer or does
+    //       it directly write the values?
+    uniform_write_buffer[float_regs_counter++] = value;
+
+    // Uniforms are written in a packed format such that four float24 values are encoded in
+    // three 32-bit numbers. We write to internal memory once a full such vector is
+    // written.
+    if ((float_regs_counter >= 4 && uniform_setup.IsFloat32()) ||
+        (float_regs_counter >= 3 && !uniform_setup.IsFloat32())) {
+        float_regs_counter = 0;
+
+        auto& uniform = setup.uniforms.f[uniform_setup.index];
+
+        if (uniform_setup.index > 95) {
+            LOG_ERROR(HW_GPU, "Invalid uniform index %d", (int)uniform_setup.index);
+            return;
+        }
+
+        // NOTE: The destination component order indeed is "backwards"
+        if (uniform_setup.IsFloat32()) {
+            for (auto i : {0,1,2,3})
+                uniform[3 - i] = float24::FromFloat32(*(float*)(&uniform_write_buffer[i]));
+        } else {
+            // TODO: Untested
+            uniform.w = float24::FromRawFloat24(uniform_write_buffer[0] >> 8);
+            uniform.z = float24::FromRawFloat24(((uniform_write_buffer[0] & 0xFF)<<16) | ((uniform_write_buffer[1] >> 16) & 0xFFFF));
+            uniform.y = float24::FromRawFloat24(((uniform_write_buffer[1] & 0xFFFF)<<8) | ((uniform_write_buffer[2] >> 24) & 0xFF));
+            uniform.x = float24::FromRawFloat24(uniform_write_buffer[2] & 0xFFFFFF);
+        }
+
+        LOG_TRACE(HW_GPU, "Set uniform %x to (%f %f %f %f)", (int)uniform_setup.index,
+                  uniform.x.ToFloat32(), uniform.y.ToFloat32(), uniform.z.ToFloat32(),
+                  uniform.w.ToFloat32());
+
+        // TODO: Verify that this actually modifies the register!
+        uniform_setup.index = uniform_setup.index + 1;
+    }
+}
+
+/**
+ * Applies a register write from a command list.
+ * @tparam Debug Whether to run the debugging hooks (debugger events, CiTrace recording, Pica
+ *               tracing, geometry dumps and TEV logging). The release path is compiled without
+ *               any of their checks.
+ */
+template <bool Debug>
 static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
     auto& regs = g_state.regs;
 
@@ -47,17 +263,29 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
 
     // TODO: Figure out how register masking acts on e.g. vs.uniform_setup.set_value
     u32 old_value = regs[id];
-    regs[id] = (old_value & ~mask) | (value & mask);
+    u32 new_value = (old_value & ~mask) | (value & mask);
 
-    if (g_debug_context)
-        g_debug_context->OnEvent(DebugContext::Event::PicaCommandLoaded, reinterpret_cast<void*>(&id));
+    // Draws queued by the hardware rasterizer must be submitted with the state they were issued in
+    if (new_value != old_value)
+        VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanging(id);
 
-    DebugUtils::OnPicaRegWrite(id, regs[id]);
+    regs[id] = new_value;
+
+    if (Debug) {
+        if (g_debug_context)
+            g_debug_context->OnEvent(DebugContext::Event::PicaCommandLoaded, reinterpret_cast<void*>(&id));
+
+        DebugUtils::OnPicaRegWrite(id, regs[id]);
+    }
 
     switch(id) {
         // Trigger IRQ
         case PICA_REG_INDEX(trigger_irq):
-            GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
+            if (GPUThread::IsGPUThread()) {
+                GPUThread::DeferP3DInterrupt();
+            } else {
+                GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
+            }
             break;
 
         // Load default vertex input attributes
@@ -107,6 +335,7 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
             u32* head_ptr = (u32*)Memory::GetPhysicalPointer(regs.command_buffer.GetPhysicalAddress(index));
             g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = head_ptr;
             g_state.cmd_list.length = regs.command_buffer.GetSize(index) / sizeof(u32);
+            command_list_jumped = true;
             break;
         }
 
@@ -115,43 +344,28 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
         case PICA_REG_INDEX(trigger_draw_indexed):
         {
             Common::Profiling::ScopeTimer scope_timer(category_drawing);
+            const auto draw_start = draw_callback ? Common::Profiling::Clock::now()
+                                                  : Common::Profiling::Clock::time_point();
 
-#if PICA_LOG_TEV
-            DebugUtils::DumpTevStageConfig(regs.GetTevStages());
-#endif
+            if (Debug && PICA_LOG_TEV)
+                DebugUtils::DumpTevStageConfig(regs.GetTevStages());
 
-            if (g_debug_context)
+            if (Debug && g_debug_context)
                 g_debug_context->OnEvent(DebugContext::Event::IncomingPrimitiveBatch, nullptr);
 
-            const auto& attribute_config = regs.vertex_attributes;
-            const u32 base_address = attribute_config.GetPhysicalBaseAddress();
+            // Whether the debugger is recording a CiTrace, which needs to know the accessed memory
+            const bool record_accesses = Debug && g_debug_context && g_debug_context->recorder;
+            const bool dump_geometry = Debug && PICA_DUMP_GEOMETRY;
 
-            // Information about internal vertex attributes
-            u32 vertex_attribute_sources[16];
-            boost::fill(vertex_attribute_sources, 0xdeadbeef);
-            u32 vertex_attribute_strides[16] = {};
-            Regs::VertexAttributeFormat vertex_attribute_formats[16] = {};
+            if (!Settings::values.use_hw_renderer)
+                Rasterizer::BeginDraw();
 
-            u32 vertex_attribute_elements[16] = {};
-            u32 vertex_attribute_element_size[16] = {};
+            const auto& attribute_config = regs.vertex_attributes;
+            const u32 base_address = attribute_config.GetPhysicalBaseAddress();
 
             // Setup attribute data from loaders
-            for (int loader = 0; loader < 12; ++loader) {
-                const auto& loader_config = attribute_config.attribute_loaders[loader];
-
-                u32 load_address = base_address + loader_config.data_offset;
-
-                // TODO: What happens if a loader overwrites a previous one's data?
-                for (unsigned component = 0; component < loader_config.component_count; ++component) {
-                    u32 attribute_index = loader_config.GetComponent(component);
-                    vertex_attribute_sources[attribute_index] = load_address;
-                    vertex_attribute_strides[attribute_index] = static_cast<u32>(loader_config.byte_count);
-                    vertex_attribute_formats[attribute_index] = attribute_config.GetFormat(attribute_index);
-                    vertex_attribute_elements[attribute_index] = attribute_config.GetNumElements(attribute_index);
-                    vertex_attribute_element_size[attribute_index] = attribute_config.GetElementSizeInBytes(attribute_index);
-                    load_address += attribute_config.GetStride(attribute_index);
-                }
-            }
+            VertexLoader loader;
+            loader.Setup(regs);
 
             // Load vertices
             bool is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
@@ -161,21 +375,19 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
             const u16* index_address_16 = (u16*)index_address_8;
             bool index_u16 = index_info.format != 0;
 
-#if PICA_DUMP_GEOMETRY
             DebugUtils::GeometryDumper geometry_dumper;
             PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(regs.triangle_topology.Value());
-#endif
             PrimitiveAssembler<VertexShader::OutputVertex> primitive_assembler(regs.triangle_topology.Value());
+            PrimitiveAssembler<u32> hw_primitive_assembler(regs.triangle_topology.Value());
 
-            if (g_debug_context) {
+            if (record_accesses) {
                 for (int i = 0; i < 3; ++i) {
                     const auto texture = regs.GetTextures()[i];
                     if (!texture.enabled)
                         continue;
 
                     u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
-                    if (g_debug_context && Pica::g_debug_context->recorder)
-                        g_debug_context->recorder->MemoryAccessed(texture_data, Pica::Regs::NibblesPerPixel(texture.format) * texture.config.width / 2 * texture.config.height, texture.config.GetPhysicalAddress());
+                    g_debug_context->recorder->MemoryAccessed(texture_data, Pica::Regs::NibblesPerPixel(texture.format) * texture.config.width / 2 * texture.config.height, texture.config.GetPhysicalAddress());
                 }
             }
 
@@ -206,144 +418,291 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
                 std::map<u32, u32> ranges;
             } memory_accesses;
 
-            for (unsigned int index = 0; index < regs.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+            // Indexed draws frequently reference the same vertex several times, so shaded vertices
+            // are kept in a small direct-mapped cache keyed by vertex index. The cache is only
+            // valid for the current draw, since attribute data and shader state may change.
+            // Geometry dumping needs to see every input vertex, so it bypasses the cache.
+            const bool use_vertex_cache = is_indexed && !dump_geometry;
+            if (use_vertex_cache) {
+                for (auto& entry : vertex_cache)
+                    entry.index = VertexCacheEntry::INVALID_INDEX;
+            }
 
-                if (is_indexed) {
-                    // TODO: Implement some sort of vertex cache!
-                    if (g_debug_context && Pica::g_debug_context->recorder) {
-                        int size = index_u16 ? 2 : 1;
-                        memory_accesses.AddAccess(base_address + index_info.offset + size * index, size);
-                    }
+            // Indexed draws usually reference a compact range of vertices. If the range isn't much
+            // larger than the number of indices, all of its vertices are loaded in one go, which
+            // reads the vertex arrays sequentially instead of jumping around for each index.
+            u32 min_index = 0;
+            bool use_prefetched_vertices = false;
+            if (is_indexed && regs.num_vertices != 0) {
+                min_index = 0xFFFFFFFF;
+                u32 max_index = 0;
+                for (unsigned int index = 0; index < regs.num_vertices; ++index) {
+                    const u32 vertex = index_u16 ? index_address_16[index] : index_address_8[index];
+                    min_index = std::min(min_index, vertex);
+                    max_index = std::max(max_index, vertex);
                 }
 
-                // Initialize data for the current vertex
-                VertexShader::InputVertex input;
-
-                for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
-                    if (vertex_attribute_elements[i] != 0) {
-                        // Default attribute values set if array elements have < 4 components. This
-                        // is *not* carried over from the default attribute settings even if they're
-                        // enabled for this attribute.
-                        static const float24 zero = float24::FromFloat32(0.0f);
-                        static const float24 one = float24::FromFloat32(1.0f);
-                        input.attr[i] = Math::Vec4<float24>(zero, zero, zero, one);
-
-                        // Load per-vertex data from the loader arrays
-                        for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                            u32 source_addr = vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i];
-                            const u8* srcdata = Memory::GetPhysicalPointer(source_addr);
-
-                            if (g_debug_context && Pica::g_debug_context->recorder) {
-                                memory_accesses.AddAccess(source_addr,
-                                    (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::FLOAT) ? 4
-                                    : (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? 2 : 1);
-                            }
+                const u32 range_size = max_index - min_index + 1;
+                if (range_size <= MAX_PREFETCHED_VERTICES && range_size <= 2 * regs.num_vertices) {
+                    prefetched_vertices.resize(range_size);
+                    loader.LoadVertices(min_index, range_size, prefetched_vertices.data());
+                    use_prefetched_vertices = true;
+                }
 
-                            const float srcval = (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
-                                (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
-                                *(float*)srcdata;
-
-                            input.attr[i][comp] = float24::FromFloat32(srcval);
-                            LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
-                                comp, i, vertex, index,
-                                attribute_config.GetPhysicalBaseAddress(),
-                                vertex_attribute_sources[i] - base_address,
-                                vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i],
-                                input.attr[i][comp].ToFloat32());
-                        }
-                    } else if (attribute_config.IsDefaultAttribute(i)) {
-                        // Load the default attribute if we're configured to do so
-                        input.attr[i] = g_state.vs.default_attributes[i];
-                        LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x (index %x): (%f, %f, %f, %f)",
-                                  i, vertex, index,
-                                  input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
-                                  input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
-                    } else {
-                        // TODO(yuriks): In this case, no data gets loaded and the vertex remains
-                        //              with the last value it had. This isn't currently maintained
-                        //              as global state, however, and so won't work in Cita yet.
-                    }
+                if (record_accesses) {
+                    const u32 index_size = index_u16 ? 2 : 1;
+                    memory_accesses.AddAccess(base_address + index_info.offset, index_size * regs.num_vertices);
                 }
+            }
 
-                if (g_debug_context)
-                    g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
+            // Loads the attributes of the given vertex and passes them to the debugging features
+            auto load_vertex = [&](unsigned int vertex, VertexShader::InputVertex& input) {
+                if (use_prefetched_vertices) {
+                    input = prefetched_vertices[vertex - min_index];
+                } else {
+                    loader.LoadVertex(vertex, input);
+                }
 
-#if PICA_DUMP_GEOMETRY
-                // NOTE: When dumping geometry, we simply assume that the first input attribute
-                //       corresponds to the position for now.
-                DebugUtils::GeometryDumper::Vertex dumped_vertex = {
-                    input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
-                };
-                using namespace std::placeholders;
-                dumping_primitive_assembler.SubmitVertex(dumped_vertex,
-                                                         std::bind(&DebugUtils::GeometryDumper::AddTriangle,
-                                                                   &geometry_dumper, _1, _2, _3));
-#endif
-
-                // Send to vertex shader
-                VertexShader::OutputVertex output = VertexShader::RunShader(input, attribute_config.GetNumTotalAttributes(), g_state.regs.vs, g_state.vs);
+                if (record_accesses) {
+                    loader.ForEachMemoryAccess(vertex, [&](u32 address, u32 size) {
+                        memory_accesses.AddAccess(address, size);
+                    });
+                }
 
-                if (is_indexed) {
-                    // TODO: Add processed vertex to vertex cache!
+                if (Debug && g_debug_context)
+                    g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
+
+                if (dump_geometry) {
+                    // NOTE: When dumping geometry, we simply assume that the first input attribute
+                    //       corresponds to the position for now.
+                    DebugUtils::GeometryDumper::Vertex dumped_vertex = {
+                        input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
+                    };
+                    dumping_primitive_assembler.SubmitVertex(dumped_vertex,
+                        [&geometry_dumper](DebugUtils::GeometryDumper::Vertex& v0,
+                                           DebugUtils::GeometryDumper::Vertex& v1,
+                                           DebugUtils::GeometryDumper::Vertex& v2) {
+                            geometry_dumper.AddTriangle(v0, v1, v2);
+                        });
                 }
+            };
+
+            // With the geometry shader enabled, it assembles the triangles from the vertex shader's outputs
+            const bool use_geometry_shader = regs.geometry_stage_config.geometry_shader_mode == 2;
+
+            // The hardware renderer may be able to run the vertex shader on the host GPU, in which
+            // case triangles are assembled from the vertices as they were loaded
+            const bool host_shading = !use_geometry_shader && Settings::values.use_hw_renderer &&
+                                      VideoCore::g_renderer->hw_rasterizer->BeginHostShadedDraw();
 
+            // Batch indices of the previous draw's vertices are meaningless by now
+            if (Settings::values.use_hw_renderer && is_indexed) {
+                for (HWVertexEntry& entry : hw_vertex_cache)
+                    entry.index = VertexCacheEntry::INVALID_INDEX;
+            }
+
+            // Passes a shaded vertex on to primitive assembly
+            auto submit_vertex = [&](unsigned int vertex, VertexShader::OutputVertex& output) {
                 if (Settings::values.use_hw_renderer) {
-                    // Send to hardware renderer
-                    static auto AddHWTriangle = [](const Pica::VertexShader::OutputVertex& v0,
-                                                   const Pica::VertexShader::OutputVertex& v1,
-                                                   const Pica::VertexShader::OutputVertex& v2) {
-                        VideoCore::g_renderer->hw_rasterizer->AddTriangle(v0, v1, v2);
-                    };
+                    // Send to hardware renderer, which receives each vertex once and assembles
+                    // triangles from their indices in its batch
+                    u32 batch_index;
+                    HWVertexEntry& entry = hw_vertex_cache[vertex % VERTEX_CACHE_SIZE];
+                    if (is_indexed && entry.index == vertex) {
+                        batch_index = entry.batch_index;
+                    } else {
+                        batch_index = VideoCore::g_renderer->hw_rasterizer->AddVertex(output);
+                        entry.index = vertex;
+                        entry.batch_index = batch_index;
+                    }
 
-                    primitive_assembler.SubmitVertex(output, AddHWTriangle);
+                    hw_primitive_assembler.SubmitVertex(batch_index, [](u32& v0, u32& v1, u32& v2) {
+                        VideoCore::g_renderer->hw_rasterizer->AddIndexedTriangle(v0, v1, v2);
+                    });
                 } else {
                     // Send to triangle clipper
-                    primitive_assembler.SubmitVertex(output, Clipper::ProcessTriangle);
+                    primitive_assembler.SubmitVertex(output, [](VertexShader::OutputVertex& v0,
+                                                                VertexShader::OutputVertex& v1,
+                                                                VertexShader::OutputVertex& v2) {
+                        Clipper::ProcessTriangle(v0, v1, v2);
+                    });
+                }
+            };
+
+            // Large draws are shaded in parallel, unless the debugging features need to see the
+            // vertices in order or the indices are too scattered to shade their whole range
+            const bool parallel_shading = !host_shading && !use_geometry_shader &&
+                                          !(Debug && g_debug_context) && !dump_geometry &&
+                                          regs.num_vertices >= MIN_PARALLEL_SHADING_VERTICES &&
+                                          (!is_indexed || use_prefetched_vertices) &&
+                                          Common::GetThreadPool().GetWorkerCount() != 0;
+
+            if (host_shading) {
+                PrimitiveAssembler<VertexShader::InputVertex> input_primitive_assembler(regs.triangle_topology.Value());
+
+                for (unsigned int index = 0; index < regs.num_vertices; ++index) {
+                    unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+
+                    VertexShader::InputVertex input;
+                    load_vertex(vertex, input);
+
+                    input_primitive_assembler.SubmitVertex(input, [](VertexShader::InputVertex& v0,
+                                                                     VertexShader::InputVertex& v1,
+                                                                     VertexShader::InputVertex& v2) {
+                        VideoCore::g_renderer->hw_rasterizer->AddUnshadedTriangle(v0, v1, v2);
+                    });
+                }
+            } else if (use_geometry_shader) {
+                ShadeGeometry(is_indexed, index_address_8, index_address_16, index_u16, load_vertex);
+            } else if (parallel_shading) {
+                if (is_indexed) {
+                    ShadeVerticesInParallel(loader, min_index, (u32)prefetched_vertices.size(),
+                                            prefetched_vertices.data());
+                } else {
+                    ShadeVerticesInParallel(loader, 0, regs.num_vertices, nullptr);
+                }
+
+                // Primitive assembly depends on the order of the vertices, so it stays serial
+                for (unsigned int index = 0; index < regs.num_vertices; ++index) {
+                    unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+                    submit_vertex(vertex, post_transform_vertices[vertex - min_index]);
+                }
+            } else {
+                for (unsigned int batch_start = 0; batch_start < regs.num_vertices; batch_start += VertexShader::BATCH_SIZE)
+                {
+                    // Vertices are shaded in batches, which amortizes shader instruction decoding. Within
+                    // each batch, cache hits are resolved first, and the remaining vertices are loaded
+                    // and sent to the vertex shader together.
+                    const unsigned int batch_size = std::min<unsigned int>(VertexShader::BATCH_SIZE, regs.num_vertices - batch_start);
+
+                    VertexShader::InputVertex shader_inputs[VertexShader::BATCH_SIZE];
+                    VertexShader::OutputVertex shader_outputs[VertexShader::BATCH_SIZE];
+                    int num_shaded = 0;
+
+                    unsigned int batch_vertices[VertexShader::BATCH_SIZE];
+                    VertexShader::OutputVertex batch_outputs[VertexShader::BATCH_SIZE];
+                    // Index into shader_outputs for each vertex of the batch, or -1 for vertex cache hits
+                    int shader_slots[VertexShader::BATCH_SIZE];
+
+                    for (unsigned int batch_index = 0; batch_index < batch_size; ++batch_index) {
+                        const unsigned int index = batch_start + batch_index;
+                        unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+                        batch_vertices[batch_index] = vertex;
+
+                        int& shader_slot = shader_slots[batch_index];
+
+                        if (use_vertex_cache) {
+                            // Copy cache hits right away, since storing the batch's results may evict them
+                            const VertexCacheEntry& cache_entry = vertex_cache[vertex % VERTEX_CACHE_SIZE];
+                            if (cache_entry.index == vertex) {
+                                batch_outputs[batch_index] = cache_entry.output;
+                                shader_slot = -1;
+                                continue;
+                            }
+
+                            // Vertices repeated within the batch only need to be shaded once
+                            unsigned int previous = 0;
+                            while (previous < batch_index && (batch_vertices[previous] != vertex || shader_slots[previous] == -1))
+                                ++previous;
+
+                            if (previous != batch_index) {
+                                shader_slot = shader_slots[previous];
+                                continue;
+                            }
+                        }
+
+                        // Initialize data for the current vertex
+                        shader_slot = num_shaded++;
+                        load_vertex(vertex, shader_inputs[shader_slot]);
+                    }
+
+                    // Send to vertex shader
+                    if (num_shaded != 0) {
+                        VertexShader::RunShaderBatch(shader_inputs, shader_outputs, num_shaded,
+                                                     attribute_config.GetNumTotalAttributes(), g_state.regs.vs, g_state.vs);
+                    }
+
+                    for (unsigned int batch_index = 0; batch_index < batch_size; ++batch_index) {
+                        const int shader_slot = shader_slots[batch_index];
+                        if (shader_slot != -1) {
+                            batch_outputs[batch_index] = shader_outputs[shader_slot];
+
+                            if (use_vertex_cache) {
+                                VertexCacheEntry& cache_entry = vertex_cache[batch_vertices[batch_index] % VERTEX_CACHE_SIZE];
+                                cache_entry.index = batch_vertices[batch_index];
+                                cache_entry.output = batch_outputs[batch_index];
+                            }
+                        }
+
+                        submit_vertex(batch_vertices[batch_index], batch_outputs[batch_index]);
+                    }
                 }
             }
 
-            for (auto& range : memory_accesses.ranges) {
-                g_debug_context->recorder->MemoryAccessed(Memory::GetPhysicalPointer(range.first),
-                                                          range.second, range.first);
+            if (record_accesses) {
+                for (auto& range : memory_accesses.ranges) {
+                    g_debug_context->recorder->MemoryAccessed(Memory::GetPhysicalPointer(range.first),
+                                                              range.second, range.first);
+                }
             }
 
             if (Settings::values.use_hw_renderer) {
                 VideoCore::g_renderer->hw_rasterizer->DrawTriangles();
+            } else {
+                Rasterizer::FlushTriangles();
             }
 
-#if PICA_DUMP_GEOMETRY
-            geometry_dumper.Dump();
-#endif
+            if (dump_geometry)
+                geometry_dumper.Dump();
 
-            if (g_debug_context) {
+            if (Debug && g_debug_context)
                 g_debug_context->OnEvent(DebugContext::Event::FinishedPrimitiveBatch, nullptr);
-            }
+
+            if (draw_callback)
+                draw_callback(Common::Profiling::Clock::now() - draw_start);
 
             break;
         }
 
+        case PICA_REG_INDEX(gs.bool_uniforms):
         case PICA_REG_INDEX(vs.bool_uniforms):
+        {
+            const bool is_gs = IsGeometryShaderReg(id);
+            const auto& config = is_gs ? regs.gs : regs.vs;
+            auto& setup = is_gs ? g_state.gs : g_state.vs;
             for (unsigned i = 0; i < 16; ++i)
-                g_state.vs.uniforms.b[i] = (regs.vs.bool_uniforms.Value() & (1 << i)) != 0;
+                setup.uniforms.b[i] = (config.bool_uniforms.Value() & (1 << i)) != 0;
 
             break;
+        }
 
+        case PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[0], 0x281):
+        case PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[1], 0x282):
+        case PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[2], 0x283):
+        case PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[3], 0x284):
         case PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[0], 0x2b1):
         case PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[1], 0x2b2):
         case PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[2], 0x2b3):
         case PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[3], 0x2b4):
         {
-            int index = (id - PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[0], 0x2b1));
-            auto values = regs.vs.int_uniforms[index];
-            g_state.vs.uniforms.i[index] = Math::Vec4<u8>(values.x, values.y, values.z, values.w);
+            const bool is_gs = IsGeometryShaderReg(id);
+            int index = (id - (is_gs ? PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[0], 0x281)
+                                     : PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[0], 0x2b1)));
+            auto values = (is_gs ? regs.gs : regs.vs).int_uniforms[index];
+            (is_gs ? g_state.gs : g_state.vs).uniforms.i[index] = Math::Vec4<u8>(values.x, values.y, values.z, values.w);
             LOG_TRACE(HW_GPU, "Set integer uniform %d to %02x %02x %02x %02x",
                       index, values.x.Value(), values.y.Value(), values.z.Value(), values.w.Value());
             break;
         }
 
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[0], 0x291):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[1], 0x292):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[2], 0x293):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[3], 0x294):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[4], 0x295):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[5], 0x296):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[6], 0x297):
+        case PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[7], 0x298):
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[0], 0x2c1):
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[1], 0x2c2):
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[2], 0x2c3):
@@ -352,50 +711,22 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[5], 0x2c6):
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[6], 0x2c7):
         case PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[7], 0x2c8):
-        {
-            auto& uniform_setup = regs.vs.uniform_setup;
-
-            // TODO: Does actual hardware indeed keep an intermediate buffer or does
-            //       it directly write the values?
-            uniform_write_buffer[float_regs_counter++] = value;
-
-            // Uniforms are written in a packed format such that four float24 values are encoded in
-            // three 32-bit numbers. We write to internal memory once a full such vector is
-            // written.
-            if ((float_regs_counter >= 4 && uniform_setup.IsFloat32()) ||
-                (float_regs_counter >= 3 && !uniform_setup.IsFloat32())) {
-                float_regs_counter = 0;
-
-                auto& uniform = g_state.vs.uniforms.f[uniform_setup.index];
-
-                if (uniform_setup.index > 95) {
-                    LOG_ERROR(HW_GPU, "Invalid VS uniform index %d", (int)uniform_setup.index);
-                    break;
-                }
-
-                // NOTE: The destination component order indeed is "backwards"
-                if (uniform_setup.IsFloat32()) {
-                    for (auto i : {0,1,2,3})
-                        uniform[3 - i] = float24::FromFloat32(*(float*)(&uniform_write_buffer[i]));
-                } else {
-                    // TODO: Untested
-                    uniform.w = float24::FromRawFloat24(uniform_write_buffer[0] >> 8);
-                    uniform.z = float24::FromRawFloat24(((uniform_write_buffer[0] & 0xFF)<<16) | ((uniform_write_buffer[1] >> 16) & 0xFFFF));
-                    uniform.y = float24::FromRawFloat24(((uniform_write_buffer[1] & 0xFFFF)<<8) | ((uniform_write_buffer[2] >> 24) & 0xFF));
-                    uniform.x = float24::FromRawFloat24(uniform_write_buffer[2] & 0xFFFFFF);
-                }
-
-                LOG_TRACE(HW_GPU, "Set uniform %x to (%f %f %f %f)", (int)uniform_setup.index,
-                          uniform.x.ToFloat32(), uniform.y.ToFloat32(), uniform.z.ToFloat32(),
-                          uniform.w.ToFloat32());
-
-                // TODO: Verify that this actually modifies the register!
-                uniform_setup.index = uniform_setup.index + 1;
+            if (IsGeometryShaderReg(id)) {
+                WriteUniformWord(regs.gs, g_state.gs, value);
+            } else {
+                WriteUniformWord(regs.vs, g_state.vs, value);
             }
             break;
-        }
 
         // Load shader program code
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[0], 0x29c):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[1], 0x29d):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[2], 0x29e):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[3], 0x29f):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[4], 0x2a0):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[5], 0x2a1):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[6], 0x2a2):
+        case PICA_REG_INDEX_WORKAROUND(gs.program.set_word[7], 0x2a3):
         case PICA_REG_INDEX_WORKAROUND(vs.program.set_word[0], 0x2cc):
         case PICA_REG_INDEX_WORKAROUND(vs.program.set_word[1], 0x2cd):
         case PICA_REG_INDEX_WORKAROUND(vs.program.set_word[2], 0x2ce):
@@ -405,12 +736,23 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
         case PICA_REG_INDEX_WORKAROUND(vs.program.set_word[6], 0x2d2):
         case PICA_REG_INDEX_WORKAROUND(vs.program.set_word[7], 0x2d3):
         {
-            g_state.vs.program_code[regs.vs.program.offset] = value;
-            regs.vs.program.offset++;
+            auto& config = IsGeometryShaderReg(id) ? regs.gs : regs.vs;
+            auto& setup = IsGeometryShaderReg(id) ? g_state.gs : g_state.vs;
+            setup.program_code[config.program.offset] = value;
+            config.program.offset++;
+            VertexShader::InvalidateDecodedProgram();
             break;
         }
 
         // Load swizzle pattern data
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[0], 0x2a6):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[1], 0x2a7):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[2], 0x2a8):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[3], 0x2a9):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[4], 0x2aa):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[5], 0x2ab):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[6], 0x2ac):
+        case PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[7], 0x2ad):
         case PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[0], 0x2d6):
         case PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[1], 0x2d7):
         case PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[2], 0x2d8):
@@ -420,8 +762,11 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
         case PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[6], 0x2dc):
         case PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[7], 0x2dd):
         {
-            g_state.vs.swizzle_data[regs.vs.swizzle_patterns.offset] = value;
-            regs.vs.swizzle_patterns.offset++;
+            auto& config = IsGeometryShaderReg(id) ? regs.gs : regs.vs;
+            auto& setup = IsGeometryShaderReg(id) ? g_state.gs : g_state.vs;
+            setup.swizzle_data[config.swizzle_patterns.offset] = value;
+            config.swizzle_patterns.offset++;
+            VertexShader::InvalidateDecodedProgram();
             break;
         }
 
@@ -429,24 +774,225 @@ static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
             break;
     }
 
-    VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
+    // Writes which leave the register unchanged don't affect the state of either rasterizer
+    if (regs[id] != old_value) {
+        VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
+        Rasterizer::NotifyRegisterChanged(id);
+    }
 
-    if (g_debug_context)
+    if (Debug && g_debug_context)
         g_debug_context->OnEvent(DebugContext::Event::PicaCommandProcessed, reinterpret_cast<void*>(&id));
 }
 
-void ProcessCommandList(const u32* list, u32 size) {
+/// How the release path of the command processor handles writes to a register
+enum class RegClass : u8 {
+    State,       ///< Only stores the value, which the rasterizers are notified about
+    Special,     ///< Has side effects, which are applied by the full WritePicaReg dispatch
+    UniformFifo, ///< uniform_setup.set_value of either shader unit, appends to the float uniform FIFO
+    ProgramFifo, ///< program.set_word of either shader unit, appends to the shader program code
+    SwizzleFifo, ///< swizzle_patterns.set_word of either shader unit, appends to the swizzle pattern data
+};
+
+static std::array<RegClass, sizeof(Regs) / sizeof(u32)> BuildRegClasses() {
+    std::array<RegClass, sizeof(Regs) / sizeof(u32)> classes;
+    classes.fill(RegClass::State);
+
+    // Every register handled by the switch in WritePicaReg has to be listed here
+    classes[PICA_REG_INDEX(trigger_irq)] = RegClass::Special;
+    for (u32 i = 0; i < 3; ++i)
+        classes[PICA_REG_INDEX_WORKAROUND(vs_default_attributes_setup.set_value[0], 0x233) + i] = RegClass::Special;
+    for (u32 i = 0; i < 2; ++i)
+        classes[PICA_REG_INDEX_WORKAROUND(command_buffer.trigger[0], 0x23c) + i] = RegClass::Special;
+    classes[PICA_REG_INDEX(trigger_draw)] = RegClass::Special;
+    classes[PICA_REG_INDEX(trigger_draw_indexed)] = RegClass::Special;
+    classes[PICA_REG_INDEX(gs.bool_uniforms)] = RegClass::Special;
+    classes[PICA_REG_INDEX(vs.bool_uniforms)] = RegClass::Special;
+    for (u32 i = 0; i < 4; ++i) {
+        classes[PICA_REG_INDEX_WORKAROUND(gs.int_uniforms[0], 0x281) + i] = RegClass::Special;
+        classes[PICA_REG_INDEX_WORKAROUND(vs.int_uniforms[0], 0x2b1) + i] = RegClass::Special;
+    }
+    for (u32 i = 0; i < 8; ++i) {
+        classes[PICA_REG_INDEX_WORKAROUND(gs.uniform_setup.set_value[0], 0x291) + i] = RegClass::UniformFifo;
+        classes[PICA_REG_INDEX_WORKAROUND(gs.program.set_word[0], 0x29c) + i] = RegClass::ProgramFifo;
+        classes[PICA_REG_INDEX_WORKAROUND(gs.swizzle_patterns.set_word[0], 0x2a6) + i] = RegClass::SwizzleFifo;
+        classes[PICA_REG_INDEX_WORKAROUND(vs.uniform_setup.set_value[0], 0x2c1) + i] = RegClass::UniformFifo;
+        classes[PICA_REG_INDEX_WORKAROUND(vs.program.set_word[0], 0x2cc) + i] = RegClass::ProgramFifo;
+        classes[PICA_REG_INDEX_WORKAROUND(vs.swizzle_patterns.set_word[0], 0x2d6) + i] = RegClass::SwizzleFifo;
+    }
+    return classes;
+}
+
+static const std::array<RegClass, sizeof(Regs) / sizeof(u32)> reg_classes = BuildRegClasses();
+
+static inline RegClass GetRegClass(u32 id) {
+    // Out of range writes are reported by WritePicaReg
+    return id < reg_classes.size() ? reg_classes[id] : RegClass::Special;
+}
+
+/// Release path of WritePicaReg for registers of RegClass::State
+static inline void WriteStateReg(u32 id, u32 value, u32 mask) {
+    auto& regs = g_state.regs;
+
+    u32 old_value = regs[id];
+    u32 new_value = (old_value & ~mask) | (value & mask);
+    if (new_value == old_value)
+        return;
+
+    VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanging(id);
+    regs[id] = new_value;
+    VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
+    Rasterizer::NotifyRegisterChanged(id);
+}
+
+/**
+ * Release path for a command which writes all of its words to the same FIFO register, which is
+ * how uniforms and shaders are uploaded. The words are appended in one loop, and the register
+ * itself, which ends up holding the last word, is only updated once.
+ * @param first_word Data word preceding the command header
+ * @param extra_words The num_extra data words following the command header
+ */
+static void WriteFifoRun(RegClass reg_class, u32 id, u32 first_word, const u32* extra_words,
+                         u32 num_extra, u32 mask) {
+    auto& regs = g_state.regs;
+
+    const u32 last_word = num_extra != 0 ? extra_words[num_extra - 1] : first_word;
+    const u32 old_value = regs[id];
+    const u32 new_value = (old_value & ~mask) | (last_word & mask);
+    if (new_value != old_value)
+        VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanging(id);
+    regs[id] = new_value;
+
+    auto& config = IsGeometryShaderReg(id) ? regs.gs : regs.vs;
+    auto& setup = IsGeometryShaderReg(id) ? g_state.gs : g_state.vs;
+
+    switch (reg_class) {
+    case RegClass::UniformFifo:
+        WriteUniformWord(config, setup, first_word);
+        for (u32 i = 0; i < num_extra; ++i)
+            WriteUniformWord(config, setup, extra_words[i]);
+        break;
+
+    case RegClass::ProgramFifo:
+    {
+        u32 offset = config.program.offset;
+        setup.program_code[offset++] = first_word;
+        for (u32 i = 0; i < num_extra; ++i)
+            setup.program_code[offset++] = extra_words[i];
+        config.program.offset = offset;
+        VertexShader::InvalidateDecodedProgram();
+        break;
+    }
+
+    case RegClass::SwizzleFifo:
+    {
+        u32 offset = config.swizzle_patterns.offset;
+        setup.swizzle_data[offset++] = first_word;
+        for (u32 i = 0; i < num_extra; ++i)
+            setup.swizzle_data[offset++] = extra_words[i];
+        config.swizzle_patterns.offset = offset;
+        VertexShader::InvalidateDecodedProgram();
+        break;
+    }
+
+    default:
+        UNREACHABLE();
+    }
+
+    if (new_value != old_value) {
+        VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
+        Rasterizer::NotifyRegisterChanged(id);
+    }
+}
+
+/// Register write command of a command list, with its header decoded
+struct DecodedCommand {
+    u32 id;
+    u32 mask;
+    /// Offset of the command's first data word in the list, which precedes its header
+    u32 offset;
+    /// Number of data words following the header
+    u32 num_extra;
+    bool group;
+    RegClass reg_class;
+};
+
+/// Expands a 4-bit mask to 4-byte mask, e.g. 0b0101 -> 0x00FF00FF
+static const u32 expand_bits_to_bytes[] = {
+    0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
+    0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
+    0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff,
+    0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff
+};
+
+/// Decodes the command of a list at the given offset, and advances the offset past it
+static inline DecodedCommand DecodeCommand(const u32* list, u32& offset) {
+    // Commands are aligned to 8 bytes
+    offset = (offset + 1) & ~1u;
+
+    const CommandHeader header = { list[offset + 1] };
+    DecodedCommand command;
+    command.id = header.cmd_id;
+    command.mask = expand_bits_to_bytes[header.parameter_mask];
+    command.offset = offset;
+    command.num_extra = header.extra_data_length;
+    command.group = header.group_commands != 0;
+    command.reg_class = GetRegClass(command.id);
+
+    offset += 2 + command.num_extra;
+    return command;
+}
+
+/// Release path for the register writes of a command, whose data words are read from the given list
+static void ExecuteCommand(const DecodedCommand& command, const u32* list) {
+    const u32 value = list[command.offset];
+    const u32* extra_words = list + command.offset + 2;
+
+    // While skipping a frame, WritePicaReg drops everything but IRQ triggers
+    if (GPU::g_skip_frame) {
+        WritePicaReg<false>(command.id, value, command.mask);
+        for (u32 i = 0; i < command.num_extra; ++i)
+            WritePicaReg<false>(command.id + (command.group ? i + 1 : 0), extra_words[i], command.mask);
+        return;
+    }
+
+    if (!command.group && command.num_extra != 0 &&
+        command.reg_class != RegClass::State && command.reg_class != RegClass::Special) {
+        WriteFifoRun(command.reg_class, command.id, value, extra_words, command.num_extra, command.mask);
+        return;
+    }
+
+    // Most writes only set up state for the next draw, only triggers need the full dispatch
+    if (command.reg_class == RegClass::State) {
+        WriteStateReg(command.id, value, command.mask);
+    } else {
+        WritePicaReg<false>(command.id, value, command.mask);
+    }
+
+    for (u32 i = 0; i < command.num_extra; ++i) {
+        u32 id = command.id + (command.group ? i + 1 : 0);
+        if (GetRegClass(id) == RegClass::State) {
+            WriteStateReg(id, extra_words[i], command.mask);
+        } else {
+            WritePicaReg<false>(id, extra_words[i], command.mask);
+        }
+    }
+}
+
+template <bool Debug>
+static void ProcessCommandListImpl(const u32* list, u32 size) {
     g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = list;
     g_state.cmd_list.length = size / sizeof(u32);
 
     while (g_state.cmd_list.current_ptr < g_state.cmd_list.head_ptr + g_state.cmd_list.length) {
-        // Expand a 4-bit mask to 4-byte mask, e.g. 0b0101 -> 0x00FF00FF
-        static const u32 expand_bits_to_bytes[] = {
-            0x00000000, 0x000000ff, 0x0000ff00, 0x0000ffff,
-            0x00ff0000, 0x00ff00ff, 0x00ffff00, 0x00ffffff,
-            0xff000000, 0xff0000ff, 0xff00ff00, 0xff00ffff,
-            0xffff0000, 0xffff00ff, 0xffffff00, 0xffffffff
-        };
+        if (!Debug) {
+            // Command buffer jumps replace the list, so its data words are read from the current one
+            const u32* head_ptr = g_state.cmd_list.head_ptr;
+            u32 offset = static_cast<u32>(g_state.cmd_list.current_ptr - head_ptr);
+            const DecodedCommand command = DecodeCommand(head_ptr, offset);
+            g_state.cmd_list.current_ptr = head_ptr + offset;
+            ExecuteCommand(command, head_ptr);
+            continue;
+        }
 
         // Align read pointer to 8 bytes
         if ((g_state.cmd_list.head_ptr - g_state.cmd_list.current_ptr) % 2 != 0)
@@ -457,15 +1003,127 @@ void ProcessCommandList(const u32* list, u32 size) {
         const u32 write_mask = expand_bits_to_bytes[header.parameter_mask];
         u32 cmd = header.cmd_id;
 
-        WritePicaReg(cmd, value, write_mask);
+        WritePicaReg<Debug>(cmd, value, write_mask);
 
         for (unsigned i = 0; i < header.extra_data_length; ++i) {
             u32 cmd = header.cmd_id + (header.group_commands ? i + 1 : 0);
-            WritePicaReg(cmd, *g_state.cmd_list.current_ptr++, write_mask);
-         }
+            WritePicaReg<Debug>(cmd, *g_state.cmd_list.current_ptr++, write_mask);
+        }
     }
 }
 
+/// Maximum number of command lists kept decoded, after which the cache starts over
+static const size_t MAX_CACHED_COMMAND_LISTS = 1024;
+
+struct CachedCommandList {
+    u32 length;
+    /// Whether all commands lie within the list. Lists which read past their end are never replayed.
+    bool replayable;
+    std::vector<DecodedCommand> commands;
+};
+
+/// Decoded command lists by the hash of their contents
+static std::unordered_map<u64, CachedCommandList> command_list_cache;
+static Common::Profiling::MemoryCounter command_list_cache_counter("Command List Cache");
+static CommandListCacheStats command_list_cache_stats;
+
+/// Returns the decoded commands of a list, decoding and caching them if it hasn't been seen before
+static const CachedCommandList& GetCachedCommandList(const u32* list, u32 length) {
+    const u64 hash = Common::ComputeHash64(list, length * sizeof(u32), length);
+    auto it = command_list_cache.find(hash);
+    if (it != command_list_cache.end() && it->second.length == length) {
+        ++command_list_cache_stats.hits;
+        return it->second;
+    }
+    ++command_list_cache_stats.misses;
+
+    if (command_list_cache.size() >= MAX_CACHED_COMMAND_LISTS) {
+        command_list_cache.clear();
+        command_list_cache_counter.Set(0);
+    }
+
+    CachedCommandList& cached = command_list_cache[hash];
+    command_list_cache_counter.Add(-(s64)(cached.commands.capacity() * sizeof(DecodedCommand)));
+    cached.length = length;
+    cached.replayable = true;
+    cached.commands.clear();
+    for (u32 offset = 0; offset < length;) {
+        cached.commands.push_back(DecodeCommand(list, offset));
+        if (offset > length) {
+            cached.replayable = false;
+            break;
+        }
+    }
+    cached.commands.shrink_to_fit();
+    command_list_cache_counter.Add(cached.commands.capacity() * sizeof(DecodedCommand));
+    return cached;
+}
+
+/**
+ * Release path which replays the decoded commands of lists that have been processed before. Titles
+ * tend to submit the same lists every frame, e.g. for static UI.
+ */
+static void ProcessCachedCommandList(const u32* list, u32 size) {
+    g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = list;
+    g_state.cmd_list.length = size / sizeof(u32);
+
+    while (true) {
+        const u32* head_ptr = g_state.cmd_list.head_ptr;
+        const u32 length = g_state.cmd_list.length;
+        const CachedCommandList& cached = GetCachedCommandList(head_ptr, length);
+        if (!cached.replayable) {
+            ProcessCommandListImpl<false>(head_ptr, length * sizeof(u32));
+            return;
+        }
+
+        command_list_jumped = false;
+        for (const DecodedCommand& command : cached.commands) {
+            ExecuteCommand(command, head_ptr);
+            if (command_list_jumped)
+                break;
+        }
+
+        // Continue with the list jumped to, if any
+        if (!command_list_jumped) {
+            g_state.cmd_list.current_ptr = head_ptr + length;
+            return;
+        }
+    }
+}
+
+void ProcessCommandList(const u32* list, u32 size) {
+    // Checked once per command list rather than for every register write and vertex. A debugger
+    // attached while a list is being processed only sees the lists submitted after it.
+    if (g_debug_context || DebugUtils::IsPicaTracing() || PICA_DUMP_GEOMETRY || PICA_LOG_TEV) {
+        ProcessCommandListImpl<true>(list, size);
+    } else if (Settings::values.use_command_list_cache) {
+        ProcessCachedCommandList(list, size);
+    } else {
+        ProcessCommandListImpl<false>(list, size);
+    }
+}
+
+CommandListCacheStats GetCommandListCacheStats() {
+    return command_list_cache_stats;
+}
+
+void Shutdown() {
+    const CommandListCacheStats& stats = command_list_cache_stats;
+    if (stats.hits + stats.misses != 0) {
+        LOG_INFO(HW_GPU, "Command list cache: %llu hits, %llu misses (%.1f%% hit rate)",
+                 (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                 100.0 * stats.hits / (stats.hits + stats.misses));
+    }
+
+    command_list_cache.clear();
+    command_list_cache_counter.Set(0);
+    command_list_cache_stats = CommandListCacheStats();
+}
+
+void SetDrawCallback(DrawCallback callback) {
+    draw_callback = std::move(callback);
+}
+
 } // namespace
 
 } // namespace
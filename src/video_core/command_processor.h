@@ -4,10 +4,12 @@
 
 #pragma once
 
+#include <functional>
 #include <type_traits>
 
 #include "common/bit_field.h"
 #include "common/common_types.h"
+#include "common/profiler.h"
 
 namespace Pica {
 
@@ -37,6 +39,27 @@ static_assert(sizeof(CommandHeader) == sizeof(u32), "CommandHeader has incorrect
 
 void ProcessCommandList(const u32* list, u32 size);
 
+/// Lookups of command lists in the cache enabled by Settings::values.use_command_list_cache
+struct CommandListCacheStats {
+    u64 hits = 0;
+    u64 misses = 0;
+};
+
+/// Returns the cache lookups since the emulated system was started
+CommandListCacheStats GetCommandListCacheStats();
+
+/// Logs the command list cache's hit rate and clears it
+void Shutdown();
+
+/// Called with the host time taken by each draw call
+using DrawCallback = std::function<void(Common::Profiling::Duration)>;
+
+/**
+ * Sets a function to be called after each draw call, e.g. by benchmarks timing single draws.
+ * Must not be changed while command lists are being processed. Pass nullptr to remove it.
+ */
+void SetDrawCallback(DrawCallback callback);
+
 } // namespace
 
 } // namespace
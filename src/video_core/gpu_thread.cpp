@@ -0,0 +1,153 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "common/logging/log.h"
+#include "common/profiler_reporting.h"
+#include "common/thread.h"
+
+#include "core/host_threads.h"
+#include "core/hle/service/gsp_gpu.h"
+#include "core/settings.h"
+
+#include "debug_utils/debug_utils.h"
+
+#include "command_processor.h"
+#include "gpu_thread.h"
+
+namespace GPUThread {
+
+/// Number of command lists which may be in flight before the CPU thread has to wait
+static const size_t RING_SIZE = 16;
+
+/// Copies of the submitted command lists. Slot `i % RING_SIZE` holds the i-th submission.
+static std::array<std::vector<u32>, RING_SIZE> ring;
+
+/// Total number of command lists processed by the worker (only written by the worker)
+static size_t read_index = 0;
+/// Total number of command lists submitted by the CPU thread (only written by the CPU thread)
+static size_t write_index = 0;
+
+static std::mutex ring_mutex;
+static std::condition_variable work_available;
+static std::condition_variable work_done;
+
+static std::thread worker;
+static bool running = false;
+
+/// Number of P3D interrupts raised by the worker which have not been signaled yet
+static std::atomic<u32> pending_p3d_interrupts(0);
+
+static void WorkerLoop() {
+    Common::SetCurrentThreadName("GPUThread");
+    Common::Profiling::GetTraceRecorder().SetThreadName("GPU");
+    HostThreads::ApplyToCurrentThread(HostThreads::Role::GPU);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(ring_mutex);
+            work_available.wait(lock, []{ return read_index != write_index || !running; });
+            if (read_index == write_index)
+                break;
+        }
+
+        // The producer doesn't touch this slot until read_index moves past it
+        const std::vector<u32>& list = ring[read_index % RING_SIZE];
+        Pica::CommandProcessor::ProcessCommandList(list.data(), list.size() * sizeof(u32));
+
+        {
+            std::lock_guard<std::mutex> lock(ring_mutex);
+            ++read_index;
+        }
+        work_done.notify_all();
+    }
+}
+
+void Init() {
+    read_index = write_index = 0;
+    pending_p3d_interrupts = 0;
+
+    if (!Settings::values.use_gpu_thread)
+        return;
+
+    running = true;
+    worker = std::thread(WorkerLoop);
+
+    LOG_DEBUG(HW_GPU, "GPU thread started");
+}
+
+void Shutdown() {
+    if (!worker.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        running = false;
+    }
+    work_available.notify_one();
+    worker.join();
+
+    pending_p3d_interrupts = 0;
+    for (auto& list : ring)
+        std::vector<u32>().swap(list);
+
+    LOG_DEBUG(HW_GPU, "GPU thread stopped");
+}
+
+void ProcessCommandList(const u32* list, u32 size) {
+    // The hardware rasterizer needs the emulation thread's GL context, and debugger
+    // breakpoints expect to be hit on the emulation thread, so fall back to inline processing.
+    if (!worker.joinable() || Settings::values.use_hw_renderer || Pica::g_debug_context) {
+        Synchronize();
+        Pica::CommandProcessor::ProcessCommandList(list, size);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(ring_mutex);
+        work_done.wait(lock, []{ return write_index - read_index < RING_SIZE; });
+    }
+
+    // Copy the list, since the application may reuse the buffer before the worker reaches it
+    ring[write_index % RING_SIZE].assign(list, list + size / sizeof(u32));
+
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ++write_index;
+    }
+    work_available.notify_one();
+}
+
+void Synchronize() {
+    if (worker.joinable()) {
+        std::unique_lock<std::mutex> lock(ring_mutex);
+        work_done.wait(lock, []{ return read_index == write_index; });
+    }
+
+    DeliverInterrupts();
+}
+
+bool IsGPUThread() {
+    return worker.joinable() && std::this_thread::get_id() == worker.get_id();
+}
+
+void DeferP3DInterrupt() {
+    ++pending_p3d_interrupts;
+}
+
+void DeliverInterrupts() {
+    u32 count = pending_p3d_interrupts.exchange(0);
+    if (count == 0)
+        return;
+
+    GSP_GPU::BeginInterruptBatch();
+    for (; count != 0; --count)
+        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
+    GSP_GPU::EndInterruptBatch();
+}
+
+} // namespace
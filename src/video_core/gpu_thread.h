@@ -0,0 +1,48 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Optional worker thread which processes Pica command lists asynchronously to the emulated CPU.
+ *
+ * Command lists are copied into a single-producer/single-consumer ring when the CPU kicks them
+ * off, and are executed in order on the worker. Anything which reads or writes memory that may
+ * be touched by the GPU (display transfers, memory fills, DMAs, cache flushes, buffer swaps)
+ * must call Synchronize() first. Interrupts raised by the worker are deferred and delivered on
+ * the CPU thread, since the kernel is not thread-safe.
+ *
+ * The worker is only used with the software rasterizer; the hardware rasterizer's GL context
+ * belongs to the emulation thread, so command lists are processed inline while it is enabled.
+ */
+namespace GPUThread {
+
+/// Starts the worker thread if it is enabled in the settings
+void Init();
+
+/// Drains all pending work and stops the worker thread
+void Shutdown();
+
+/**
+ * Processes the given command list, either directly or by queueing it to the worker thread.
+ * @param list Pointer to the command list in emulated memory
+ * @param size Size of the command list in bytes
+ */
+void ProcessCommandList(const u32* list, u32 size);
+
+/// Blocks until all queued command lists have been processed and delivers their interrupts
+void Synchronize();
+
+/// Returns true if called from the GPU worker thread
+bool IsGPUThread();
+
+/// Records a P3D interrupt raised on the worker thread, to be signaled later on the CPU thread
+void DeferP3DInterrupt();
+
+/// Signals any interrupts deferred by the worker thread. Must be called from the CPU thread.
+void DeliverInterrupts();
+
+} // namespace
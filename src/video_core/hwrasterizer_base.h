@@ -6,8 +6,15 @@
 
 #include "common/common_types.h"
 
+namespace GPU {
+namespace DisplayTransfer {
+struct Config;
+}
+}
+
 namespace Pica {
 namespace VertexShader {
+struct InputVertex;
 struct OutputVertex;
 }
 }
@@ -23,17 +30,36 @@ public:
     /// Reset the rasterizer, such as flushing all caches and updating all state
     virtual void Reset() = 0;
 
-    /// Queues the primitive formed by the given vertices for rendering
-    virtual void AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                             const Pica::VertexShader::OutputVertex& v1,
-                             const Pica::VertexShader::OutputVertex& v2) = 0;
+    /**
+     * Adds a shaded vertex to the current batch, for the triangles of the draw passed to AddIndexedTriangle
+     * @return Index of the vertex within the batch
+     */
+    virtual u32 AddVertex(const Pica::VertexShader::OutputVertex& v) = 0;
+
+    /// Queues the primitive formed by the vertices of the current draw with the given batch indices
+    virtual void AddIndexedTriangle(u32 v0, u32 v1, u32 v2) = 0;
+
+    /**
+     * Prepares a draw whose vertex shader is run by the host GPU instead of the shader interpreter.
+     * @return False if the current vertex shader can't be run by the rasterizer, in which case the
+     *         vertices of the draw have to be shaded on the CPU and submitted through AddVertex
+     */
+    virtual bool BeginHostShadedDraw() = 0;
 
-    /// Draw the current batch of triangles
+    /// Queues the primitive formed by the given unshaded vertices, for draws prepared by BeginHostShadedDraw
+    virtual void AddUnshadedTriangle(const Pica::VertexShader::InputVertex& v0,
+                                     const Pica::VertexShader::InputVertex& v1,
+                                     const Pica::VertexShader::InputVertex& v2) = 0;
+
+    /// Draw the current batch of triangles. The draw may be deferred and merged with later ones.
     virtual void DrawTriangles() = 0;
 
     /// Commit the rasterizer's framebuffer contents immediately to the current 3DS memory framebuffer
     virtual void CommitFramebuffer() = 0;
 
+    /// Notify rasterizer that the specified PICA register is about to be changed
+    virtual void NotifyPicaRegisterChanging(u32 id) = 0;
+
     /// Notify rasterizer that the specified PICA register has been changed
     virtual void NotifyPicaRegisterChanged(u32 id) = 0;
 
@@ -42,4 +68,22 @@ public:
 
     /// Notify rasterizer that a 3DS memory region has been changed
     virtual void NotifyFlush(PAddr addr, u32 size) = 0;
+
+    /// Notify rasterizer that all PICA registers have been restored, e.g. from a snapshot, so none of its state is current
+    virtual void NotifyStateRestored() = 0;
+
+    /**
+     * Performs a display transfer between framebuffers held by the rasterizer, without going
+     * through 3DS memory.
+     * @return True if the transfer has been performed, false if it has to be done in memory
+     */
+    virtual bool AccelerateDisplayTransfer(const GPU::DisplayTransfer::Config& config, PAddr src_addr, PAddr dst_addr) = 0;
+
+    /**
+     * Performs a memory fill of a framebuffer held by the rasterizer, without going through 3DS memory.
+     * @param value Bytes of a single fill value as they would be stored in memory
+     * @param value_size Number of bytes in the fill value (2, 3 or 4)
+     * @return True if the fill has been performed, false if it has to be done in memory
+     */
+    virtual bool AccelerateFill(PAddr start, PAddr end, const u8* value, u32 value_size) = 0;
 };
@@ -5,7 +5,13 @@
 #include <cstring>
 #include <unordered_map>
 
+#include "common/chunk_file.h"
+
+#include "command_processor.h"
 #include "pica.h"
+#include "rasterizer.h"
+#include "texture_cache.h"
+#include "vertex_shader.h"
 
 namespace Pica {
 
@@ -48,22 +54,28 @@ std::string Regs::GetCommandName(int index) {
         ADD_FIELD(vertex_attributes);
         ADD_FIELD(index_array);
         ADD_FIELD(num_vertices);
+        ADD_FIELD(geometry_stage_config);
         ADD_FIELD(trigger_draw);
         ADD_FIELD(trigger_draw_indexed);
         ADD_FIELD(vs_default_attributes_setup);
         ADD_FIELD(command_buffer);
+        ADD_FIELD(gs_config);
         ADD_FIELD(triangle_topology);
         ADD_FIELD(gs.bool_uniforms);
         ADD_FIELD(gs.int_uniforms);
+        ADD_FIELD(gs.input_buffer_config);
         ADD_FIELD(gs.main_offset);
         ADD_FIELD(gs.input_register_map);
+        ADD_FIELD(gs.output_mask);
         ADD_FIELD(gs.uniform_setup);
         ADD_FIELD(gs.program);
         ADD_FIELD(gs.swizzle_patterns);
         ADD_FIELD(vs.bool_uniforms);
         ADD_FIELD(vs.int_uniforms);
+        ADD_FIELD(vs.input_buffer_config);
         ADD_FIELD(vs.main_offset);
         ADD_FIELD(vs.input_register_map);
+        ADD_FIELD(vs.output_mask);
         ADD_FIELD(vs.uniform_setup);
         ADD_FIELD(vs.program);
         ADD_FIELD(vs.swizzle_patterns);
@@ -81,10 +93,31 @@ std::string Regs::GetCommandName(int index) {
 }
 
 void Init() {
+    Rasterizer::Init();
 }
 
 void Shutdown() {
+    CommandProcessor::Shutdown();
+    Rasterizer::Shutdown();
+    TextureCache::FullFlush();
+    VertexShader::Shutdown();
     memset(&g_state, 0, sizeof(State));
 }
 
+void DoState(PointerWrap& p) {
+    auto s = p.Section("Pica", 1);
+    if (!s)
+        return;
+
+    p.DoVoid(&g_state.regs, sizeof(g_state.regs));
+    p.DoVoid(&g_state.vs, sizeof(g_state.vs));
+    p.DoVoid(&g_state.gs, sizeof(g_state.gs));
+
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        VertexShader::InvalidateDecodedProgram();
+        Rasterizer::InvalidateDrawState();
+        TextureCache::FullFlush();
+    }
+}
+
 }
@@ -16,6 +16,8 @@
 #include "common/logging/log.h"
 #include "common/vector_math.h"
 
+class PointerWrap;
+
 namespace Pica {
 
 // Returns index corresponding to the Regs member labeled by field_name
@@ -745,7 +747,12 @@ struct Regs {
     // Number of vertices to render
     u32 num_vertices;
 
-    INSERT_PADDING_WORDS(0x5);
+    union {
+        // Set to 2 when the geometry shader runs on the output of the vertex shader
+        BitField<0, 2, u32> geometry_shader_mode;
+    } geometry_stage_config;
+
+    INSERT_PADDING_WORDS(0x4);
 
     // These two trigger rendering of triangles
     u32 trigger_draw;
@@ -788,7 +795,21 @@ struct Regs {
         }
     } command_buffer;
 
-    INSERT_PADDING_WORDS(0x20);
+    INSERT_PADDING_WORDS(0x14);
+
+    struct GSConfig {
+        enum class Mode : u32 {
+            Point             = 0, // One invocation per fixed number of input attributes
+            VariablePrimitive = 1,
+            FixedPrimitive    = 2,
+        };
+
+        union {
+            BitField<0, 2, Mode> mode;
+        };
+    } gs_config;
+
+    INSERT_PADDING_WORDS(0xb);
 
     enum class TriangleTopology : u32 {
         List   = 0,
@@ -811,7 +832,13 @@ struct Regs {
             BitField<24, 8, u32> w;
         } int_uniforms[4];
 
-        INSERT_PADDING_WORDS(0x5);
+        INSERT_PADDING_WORDS(0x4);
+
+        union {
+            // Number of input attributes minus one. The geometry shader runs whenever its input
+            // buffer holds this many attributes.
+            BitField<0, 4, u32> max_input_attribute_index;
+        } input_buffer_config;
 
         // Offset to shader program entry point (in words)
         BitField<0, 16, u32> main_offset;
@@ -845,8 +872,11 @@ struct Regs {
             }
         } input_register_map;
 
-        // OUTMAP_MASK, 0x28E, CODETRANSFER_END
-        INSERT_PADDING_WORDS(0x3);
+        // Output registers written by the shader, one bit per register
+        BitField<0, 16, u32> output_mask;
+
+        // 0x28E, CODETRANSFER_END
+        INSERT_PADDING_WORDS(0x2);
 
         struct {
             enum Format : u32
@@ -968,13 +998,17 @@ ASSERT_REG_POSITION(framebuffer, 0x110);
 ASSERT_REG_POSITION(vertex_attributes, 0x200);
 ASSERT_REG_POSITION(index_array, 0x227);
 ASSERT_REG_POSITION(num_vertices, 0x228);
+ASSERT_REG_POSITION(geometry_stage_config, 0x229);
 ASSERT_REG_POSITION(trigger_draw, 0x22e);
 ASSERT_REG_POSITION(trigger_draw_indexed, 0x22f);
 ASSERT_REG_POSITION(vs_default_attributes_setup, 0x232);
 ASSERT_REG_POSITION(command_buffer, 0x238);
+ASSERT_REG_POSITION(gs_config, 0x252);
 ASSERT_REG_POSITION(triangle_topology, 0x25e);
 ASSERT_REG_POSITION(gs, 0x280);
 ASSERT_REG_POSITION(vs, 0x2b0);
+ASSERT_REG_POSITION(gs.input_buffer_config, 0x289);
+ASSERT_REG_POSITION(gs.output_mask, 0x28d);
 
 #undef ASSERT_REG_POSITION
 #endif // !defined(_MSC_VER)
@@ -1120,6 +1154,9 @@ void Init();
 /// Shutdown Pica state
 void Shutdown();
 
+/// Saves or restores the registers and shader memory, invalidating what was derived from them
+void DoState(PointerWrap& p);
+
 extern State g_state; ///< Current Pica state
 
 } // namespace
@@ -4,7 +4,7 @@
 
 #pragma once
 
-#include <functional>
+#include "common/logging/log.h"
 
 #include "video_core/pica.h"
 
@@ -18,19 +18,18 @@ namespace Pica {
  */
 template<typename VertexType>
 struct PrimitiveAssembler {
-    using TriangleHandler = std::function<void(VertexType& v0,
-                                               VertexType& v1,
-                                               VertexType& v2)>;
-
     PrimitiveAssembler(Regs::TriangleTopology topology);
 
     /*
      * Queues a vertex, builds primitives from the vertex queue according to the given
      * triangle topology, and calls triangle_handler for each generated primitive.
+     * The handler is a template parameter rather than a std::function, so that the call
+     * can be inlined: this runs for every vertex of every draw call.
      * NOTE: We could specify the triangle handler in the constructor, but this way we can
      * keep event and handler code next to each other.
      */
-    void SubmitVertex(VertexType& vtx, TriangleHandler triangle_handler);
+    template<typename TriangleHandler>
+    void SubmitVertex(VertexType& vtx, TriangleHandler&& triangle_handler);
 
 private:
     Regs::TriangleTopology topology;
@@ -40,5 +39,44 @@ private:
     bool strip_ready = false;
 };
 
+template<typename VertexType>
+template<typename TriangleHandler>
+void PrimitiveAssembler<VertexType>::SubmitVertex(VertexType& vtx, TriangleHandler&& triangle_handler)
+{
+    switch (topology) {
+        // TODO: Figure out what's different with TriangleTopology::Shader.
+        case Regs::TriangleTopology::List:
+        case Regs::TriangleTopology::Shader:
+            if (buffer_index < 2) {
+                buffer[buffer_index++] = vtx;
+            } else {
+                buffer_index = 0;
+
+                triangle_handler(buffer[0], buffer[1], vtx);
+            }
+            break;
+
+        case Regs::TriangleTopology::Strip:
+        case Regs::TriangleTopology::Fan:
+            if (strip_ready)
+                triangle_handler(buffer[0], buffer[1], vtx);
+
+            buffer[buffer_index] = vtx;
+
+            if (topology == Regs::TriangleTopology::Strip) {
+                strip_ready |= (buffer_index == 1);
+                buffer_index = !buffer_index;
+            } else if (topology == Regs::TriangleTopology::Fan) {
+                buffer_index = 1;
+                strip_ready = true;
+            }
+            break;
+
+        default:
+            LOG_ERROR(HW_GPU, "Unknown triangle topology %x:", (int)topology);
+            break;
+    }
+}
+
 
 } // namespace
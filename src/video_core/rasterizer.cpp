@@ -3,217 +3,284 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <atomic>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
 
 #include "common/color.h"
 #include "common/common_types.h"
 #include "common/math_util.h"
 #include "common/profiler.h"
+#include "common/profiler_reporting.h"
+#include "common/thread_pool.h"
 
 #include "core/hw/gpu.h"
 #include "core/memory.h"
+#include "core/settings.h"
 
 #include "debug_utils/debug_utils.h"
 #include "math.h"
 #include "pica.h"
 #include "rasterizer.h"
+#include "texture_cache.h"
 #include "vertex_shader.h"
 #include "video_core/utils.h"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define RASTERIZER_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace Pica {
 
 namespace Rasterizer {
 
-static void DrawPixel(int x, int y, const Math::Vec4<u8>& color) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetColorBufferPhysicalAddress();
+template <Regs::ColorFormat format>
+static const Math::Vec4<u8> DecodeColor(const u8* bytes) {
+    switch (format) {
+    case Regs::ColorFormat::RGBA8:
+        return Color::DecodeRGBA8(bytes);
+
+    case Regs::ColorFormat::RGB8:
+        return Color::DecodeRGB8(bytes);
+
+    case Regs::ColorFormat::RGB5A1:
+        return Color::DecodeRGB5A1(bytes);
 
-    // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
-    // NOTE: The framebuffer height register contains the actual FB height minus one.
-    y = framebuffer.height - y;
+    case Regs::ColorFormat::RGB565:
+        return Color::DecodeRGB565(bytes);
+
+    case Regs::ColorFormat::RGBA4:
+        return Color::DecodeRGBA4(bytes);
+    }
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(framebuffer.color_format.Value()));
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer.width * bytes_per_pixel;
-    u8* dst_pixel = Memory::GetPhysicalPointer(addr) + dst_offset;
+    return {0, 0, 0, 0};
+}
 
-    switch (framebuffer.color_format) {
+template <Regs::ColorFormat format>
+static void EncodeColor(const Math::Vec4<u8>& color, u8* bytes) {
+    switch (format) {
     case Regs::ColorFormat::RGBA8:
-        Color::EncodeRGBA8(color, dst_pixel);
+        Color::EncodeRGBA8(color, bytes);
         break;
 
     case Regs::ColorFormat::RGB8:
-        Color::EncodeRGB8(color, dst_pixel);
+        Color::EncodeRGB8(color, bytes);
         break;
 
     case Regs::ColorFormat::RGB5A1:
-        Color::EncodeRGB5A1(color, dst_pixel);
+        Color::EncodeRGB5A1(color, bytes);
         break;
 
     case Regs::ColorFormat::RGB565:
-        Color::EncodeRGB565(color, dst_pixel);
+        Color::EncodeRGB565(color, bytes);
         break;
 
     case Regs::ColorFormat::RGBA4:
-        Color::EncodeRGBA4(color, dst_pixel);
+        Color::EncodeRGBA4(color, bytes);
         break;
-
-    default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
-        UNIMPLEMENTED();
     }
 }
 
-static const Math::Vec4<u8> GetPixel(int x, int y) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetColorBufferPhysicalAddress();
-
-    y = framebuffer.height - y;
-
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(framebuffer.color_format.Value()));
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer.width * bytes_per_pixel;
-    u8* src_pixel = Memory::GetPhysicalPointer(addr) + src_offset;
+template <Regs::DepthFormat format>
+static u32 DecodeDepth(const u8* bytes) {
+    switch (format) {
+    case Regs::DepthFormat::D16:
+        return Color::DecodeD16(bytes);
 
-    switch (framebuffer.color_format) {
-    case Regs::ColorFormat::RGBA8:
-        return Color::DecodeRGBA8(src_pixel);
+    case Regs::DepthFormat::D24:
+        return Color::DecodeD24(bytes);
 
-    case Regs::ColorFormat::RGB8:
-        return Color::DecodeRGB8(src_pixel);
+    case Regs::DepthFormat::D24S8:
+        return Color::DecodeD24S8(bytes).x;
+    }
 
-    case Regs::ColorFormat::RGB5A1:
-        return Color::DecodeRGB5A1(src_pixel);
+    return 0;
+}
 
-    case Regs::ColorFormat::RGB565:
-        return Color::DecodeRGB565(src_pixel);
+template <Regs::DepthFormat format>
+static void EncodeDepth(u32 value, u8* bytes) {
+    switch (format) {
+    case Regs::DepthFormat::D16:
+        Color::EncodeD16(value, bytes);
+        break;
 
-    case Regs::ColorFormat::RGBA4:
-        return Color::DecodeRGBA4(src_pixel);
+    case Regs::DepthFormat::D24:
+        Color::EncodeD24(value, bytes);
+        break;
 
-    default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
-        UNIMPLEMENTED();
+    case Regs::DepthFormat::D24S8:
+        Color::EncodeD24X8(value, bytes);
+        break;
     }
+}
 
+// Fallbacks for unknown formats, which have already been reported when setting up the accessor
+static const Math::Vec4<u8> DecodeUnknownColor(const u8* bytes) {
     return {0, 0, 0, 0};
 }
 
-static u32 GetDepth(int x, int y) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
-
-    y = framebuffer.height - y;
-
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
+static void EncodeUnknownColor(const Math::Vec4<u8>& color, u8* bytes) {
+}
 
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* src_pixel = depth_buffer + src_offset;
+static u32 DecodeUnknownDepth(const u8* bytes) {
+    return 0;
+}
 
-    switch (framebuffer.depth_format) {
-        case Regs::DepthFormat::D16:
-            return Color::DecodeD16(src_pixel);
-        case Regs::DepthFormat::D24:
-            return Color::DecodeD24(src_pixel);
-        case Regs::DepthFormat::D24S8:
-            return Color::DecodeD24S8(src_pixel).x;
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
-            UNIMPLEMENTED();
-            return 0;
-    }
+static void EncodeUnknownDepth(u32 value, u8* bytes) {
 }
 
-static u8 GetStencil(int x, int y) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
+/**
+ * Provides access to the color and depth/stencil buffers configured in the given registers.
+ * Format dispatch and address setup happen once on construction, so that accessing a pixel
+ * only computes its Morton offset and calls the format-specific conversion function.
+ */
+class FramebufferAccessor {
+public:
+    explicit FramebufferAccessor(const Regs& regs) {
+        const auto& framebuffer = regs.framebuffer;
+
+        // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
+        // NOTE: The framebuffer height register contains the actual FB height minus one.
+        flip_y = framebuffer.height;
+        width = framebuffer.width;
+
+        color_buffer = Memory::GetPhysicalPointer(framebuffer.GetColorBufferPhysicalAddress());
+        color_bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(framebuffer.color_format.Value()));
+        color_stride = width * color_bytes_per_pixel;
+
+        switch (framebuffer.color_format) {
+        case Regs::ColorFormat::RGBA8:
+            SetColorFormat<Regs::ColorFormat::RGBA8>();
+            break;
 
-    y = framebuffer.height - y;
+        case Regs::ColorFormat::RGB8:
+            SetColorFormat<Regs::ColorFormat::RGB8>();
+            break;
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
+        case Regs::ColorFormat::RGB5A1:
+            SetColorFormat<Regs::ColorFormat::RGB5A1>();
+            break;
 
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* src_pixel = depth_buffer + src_offset;
+        case Regs::ColorFormat::RGB565:
+            SetColorFormat<Regs::ColorFormat::RGB565>();
+            break;
 
-    switch (framebuffer.depth_format) {
-        case Regs::DepthFormat::D24S8:
-            return Color::DecodeD24S8(src_pixel).y;
+        case Regs::ColorFormat::RGBA4:
+            SetColorFormat<Regs::ColorFormat::RGBA4>();
+            break;
 
         default:
-            LOG_WARNING(HW_GPU, "GetStencil called for function which doesn't have a stencil component (format %u)", framebuffer.depth_format);
-            return 0;
-    }
-}
-
-static void SetDepth(int x, int y, u32 value) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
-
-    y = framebuffer.height - y;
-
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
+            LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
+            UNIMPLEMENTED();
+            decode_color = DecodeUnknownColor;
+            encode_color = EncodeUnknownColor;
+            break;
+        }
 
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* dst_pixel = depth_buffer + dst_offset;
+        depth_buffer = Memory::GetPhysicalPointer(framebuffer.GetDepthBufferPhysicalAddress());
+        has_stencil = framebuffer.depth_format == Regs::DepthFormat::D24S8;
 
-    switch (framebuffer.depth_format) {
+        switch (framebuffer.depth_format) {
         case Regs::DepthFormat::D16:
-            Color::EncodeD16(value, dst_pixel);
+            SetDepthFormat<Regs::DepthFormat::D16>();
             break;
 
         case Regs::DepthFormat::D24:
-            Color::EncodeD24(value, dst_pixel);
+            SetDepthFormat<Regs::DepthFormat::D24>();
             break;
 
         case Regs::DepthFormat::D24S8:
-            Color::EncodeD24X8(value, dst_pixel);
+            SetDepthFormat<Regs::DepthFormat::D24S8>();
             break;
 
         default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
-            UNIMPLEMENTED();
+            // The depth buffer is only accessed when depth testing is enabled
+            if (regs.output_merger.depth_test_enable) {
+                LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", (u32)framebuffer.depth_format);
+                UNIMPLEMENTED();
+            }
+            depth_bytes_per_pixel = 0;
+            depth_stride = 0;
+            decode_depth = DecodeUnknownDepth;
+            encode_depth = EncodeUnknownDepth;
             break;
+        }
     }
-}
 
-static void SetStencil(int x, int y, u8 value) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
+    const Math::Vec4<u8> GetPixel(int x, int y) const {
+        return decode_color(GetColorAddress(x, y));
+    }
 
-    y = framebuffer.height - y;
+    void DrawPixel(int x, int y, const Math::Vec4<u8>& color) const {
+        encode_color(color, GetColorAddress(x, y));
+    }
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
+    u32 GetDepth(int x, int y) const {
+        return decode_depth(GetDepthAddress(x, y));
+    }
 
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* dst_pixel = depth_buffer + dst_offset;
+    void SetDepth(int x, int y, u32 value) const {
+        encode_depth(value, GetDepthAddress(x, y));
+    }
 
-    switch (framebuffer.depth_format) {
-        case Pica::Regs::DepthFormat::D16:
-        case Pica::Regs::DepthFormat::D24:
-            // Nothing to do
-            break;
+    /// Returns the stencil value of the given pixel, or zero if the depth format has no stencil
+    u8 GetStencil(int x, int y) const {
+        return has_stencil ? (u8)Color::DecodeD24S8(GetDepthAddress(x, y)).y : 0;
+    }
 
-        case Pica::Regs::DepthFormat::D24S8:
-            Color::EncodeX24S8(value, dst_pixel);
-            break;
+    /// Sets the stencil value of the given pixel, if the depth format has a stencil component
+    void SetStencil(int x, int y, u8 value) const {
+        if (has_stencil)
+            Color::EncodeX24S8(value, GetDepthAddress(x, y));
+    }
 
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
-            UNIMPLEMENTED();
-            break;
+private:
+    template <Regs::ColorFormat format>
+    void SetColorFormat() {
+        decode_color = DecodeColor<format>;
+        encode_color = EncodeColor<format>;
+    }
+
+    template <Regs::DepthFormat format>
+    void SetDepthFormat() {
+        depth_bytes_per_pixel = Regs::BytesPerDepthPixel(format);
+        depth_stride = width * depth_bytes_per_pixel;
+        decode_depth = DecodeDepth<format>;
+        encode_depth = EncodeDepth<format>;
+    }
+
+    u8* GetColorAddress(int x, int y) const {
+        y = flip_y - y;
+        return color_buffer + VideoCore::GetMortonTileOffset(x, y, color_bytes_per_pixel, color_stride)
+                            + VideoCore::MortonInterleave(x, y) * color_bytes_per_pixel;
     }
-}
+
+    u8* GetDepthAddress(int x, int y) const {
+        y = flip_y - y;
+        return depth_buffer + VideoCore::GetMortonTileOffset(x, y, depth_bytes_per_pixel, depth_stride)
+                            + VideoCore::MortonInterleave(x, y) * depth_bytes_per_pixel;
+    }
+
+    int flip_y;
+    u32 width;
+
+    u8* color_buffer;
+    u32 color_bytes_per_pixel;
+    u32 color_stride;
+    const Math::Vec4<u8> (*decode_color)(const u8* bytes);
+    void (*encode_color)(const Math::Vec4<u8>& color, u8* bytes);
+
+    u8* depth_buffer;
+    u32 depth_bytes_per_pixel;
+    u32 depth_stride;
+    bool has_stencil;
+    u32 (*decode_depth)(const u8* bytes);
+    void (*encode_depth)(u32 value, u8* bytes);
+};
 
 // TODO: Should the stencil mask be applied to the "dest" or "ref" operands? Most likely not!
 static u8 PerformStencilAction(Regs::StencilAction action, u8 dest, u8 ref) {
@@ -266,851 +333,1990 @@ static int SignedArea (const Math::Vec2<Fix12P4>& vtx1,
     return Math::Cross(vec1, vec2).z;
 };
 
-static Common::Profiling::TimingCategory rasterization_category("Rasterization");
+/// Width and height of the pixel blocks which are tested against the triangle edges as a whole
+static const int BLOCK_SIZE = 4;
 
 /**
- * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
- * culling via recursion.
+ * Edge function of the line from vtx1 to vtx2, i.e. SignedArea(vtx1, vtx2, p) + bias for any
+ * point p in rasterizer coordinates, split up into its per-pixel increments.
  */
-static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
-                                    const VertexShader::OutputVertex& v1,
-                                    const VertexShader::OutputVertex& v2,
-                                    bool reversed = false)
-{
-    const auto& regs = g_state.regs;
-    Common::Profiling::ScopeTimer timer(rasterization_category);
-
-    // vertex positions in rasterizer coordinates
-    static auto FloatToFix = [](float24 flt) {
-        // TODO: Rounding here is necessary to prevent garbage pixels at
-        //       triangle borders. Is it that the correct solution, though?
-        return Fix12P4(static_cast<unsigned short>(round(flt.ToFloat32() * 16.0f)));
-    };
-    static auto ScreenToRasterizerCoordinates = [](const Math::Vec3<float24>& vec) {
-        return Math::Vec3<Fix12P4>{FloatToFix(vec.x), FloatToFix(vec.y), FloatToFix(vec.z)};
-    };
+struct EdgeFunction {
+    EdgeFunction(const Math::Vec2<Fix12P4>& vtx1, const Math::Vec2<Fix12P4>& vtx2, int bias) {
+        const int dx = (int)vtx2.x - (int)vtx1.x;
+        const int dy = (int)vtx2.y - (int)vtx1.y;
+        coeff_x = -dy;
+        coeff_y = dx;
+        constant = bias + dy * (int)vtx1.x - dx * (int)vtx1.y;
+        step_x = coeff_x * 0x10;
+        step_y = coeff_y * 0x10;
+    }
 
-    Math::Vec3<Fix12P4> vtxpos[3]{ ScreenToRasterizerCoordinates(v0.screenpos),
-                                   ScreenToRasterizerCoordinates(v1.screenpos),
-                                   ScreenToRasterizerCoordinates(v2.screenpos) };
+    int Evaluate(int x, int y) const {
+        return coeff_x * x + coeff_y * y + constant;
+    }
 
-    if (regs.cull_mode == Regs::CullMode::KeepAll) {
-        // Make sure we always end up with a triangle wound counter-clockwise
-        if (!reversed && SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
-        }
-    } else {
-        if (!reversed && regs.cull_mode == Regs::CullMode::KeepClockWise) {
-            // Reverse vertex order and use the CCW code path.
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
-        }
+    /// Largest value over a block given the value at its top left pixel
+    int BlockMax(int value) const {
+        return value + std::max(0, step_x * (BLOCK_SIZE - 1)) + std::max(0, step_y * (BLOCK_SIZE - 1));
+    }
 
-        // Cull away triangles which are wound clockwise.
-        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
-            return;
+    /// Smallest value over a block given the value at its top left pixel
+    int BlockMin(int value) const {
+        return value + std::min(0, step_x * (BLOCK_SIZE - 1)) + std::min(0, step_y * (BLOCK_SIZE - 1));
     }
 
-    // TODO: Proper scissor rect test!
-    u16 min_x = std::min({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
-    u16 min_y = std::min({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
-    u16 max_x = std::max({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
-    u16 max_y = std::max({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+    int coeff_x, coeff_y, constant;
 
-    min_x &= Fix12P4::IntMask();
-    min_y &= Fix12P4::IntMask();
-    max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
-    max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    /// Change of the value when moving one pixel along the respective axis
+    int step_x, step_y;
+};
 
-    // Triangle filling rules: Pixels on the right-sided edge or on flat bottom edges are not
-    // drawn. Pixels on any other triangle border are drawn. This is implemented with three bias
-    // values which are added to the barycentric coordinates w0, w1 and w2, respectively.
-    // NOTE: These are the PSP filling rules. Not sure if the 3DS uses the same ones...
-    auto IsRightSideOrFlatBottomEdge = [](const Math::Vec2<Fix12P4>& vtx,
-                                          const Math::Vec2<Fix12P4>& line1,
-                                          const Math::Vec2<Fix12P4>& line2)
-    {
-        if (line1.y == line2.y) {
-            // just check if vertex is above us => bottom line parallel to x-axis
-            return vtx.y < line1.y;
-        } else {
-            // check if vertex is on our left => right side
-            // TODO: Not sure how likely this is to overflow
-            return (int)vtx.x < (int)line1.x + ((int)line2.x - (int)line1.x) * ((int)vtx.y - (int)line1.y) / ((int)line2.y - (int)line1.y);
-        }
-    };
-    int bias0 = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
-    int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
-    int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+/// Attributes interpolated across a triangle: the vertex attributes divided by w, followed by 1/w
+enum InterpolatedAttribute {
+    AttributeColorR, AttributeColorG, AttributeColorB, AttributeColorA,
+    AttributeTc0U, AttributeTc0V,
+    AttributeTc1U, AttributeTc1V,
+    AttributeTc2U, AttributeTc2V,
+    AttributeInverseW,
 
-    auto w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
+    NUM_INTERPOLATED_ATTRIBUTES
+};
 
-    auto textures = regs.GetTextures();
-    auto tev_stages = regs.GetTevStages();
+/**
+ * Plane equations of the interpolated attributes of a triangle, set up once per triangle. The
+ * attributes are linear in screen space, so each of them is the dot product of its vertex
+ * values with the unnormalized barycentric coordinates (w0, w1, w2) of a pixel, and changes by
+ * a constant amount per pixel step. Normalizing by w0 + w1 + w2 can be skipped, since it cancels
+ * out in the perspective correction.
+ */
+struct AttributePlanes {
+    AttributePlanes(const VertexShader::OutputVertex& v0, const VertexShader::OutputVertex& v1,
+                    const VertexShader::OutputVertex& v2, const EdgeFunction& edge0,
+                    const EdgeFunction& edge1, const EdgeFunction& edge2) {
+        const VertexShader::OutputVertex* vertices[3] = { &v0, &v1, &v2 };
+        for (int i = 0; i < 3; ++i) {
+            const VertexShader::OutputVertex& v = *vertices[i];
+            const float24 values[NUM_INTERPOLATED_ATTRIBUTES] = {
+                v.color.r(), v.color.g(), v.color.b(), v.color.a(),
+                v.tc0.u(), v.tc0.v(), v.tc1.u(), v.tc1.v(), v.tc2.u(), v.tc2.v(),
+                v.pos.w
+            };
+            for (int attr = 0; attr < NUM_INTERPOLATED_ATTRIBUTES; ++attr)
+                coeffs[attr][i] = values[attr].ToFloat32();
+        }
 
-    bool stencil_action_enable = g_state.regs.output_merger.stencil_test.enable && g_state.regs.framebuffer.depth_format == Regs::DepthFormat::D24S8;
-    const auto stencil_test = g_state.regs.output_merger.stencil_test;
+        for (int attr = 0; attr < NUM_INTERPOLATED_ATTRIBUTES; ++attr) {
+            step_x[attr] = coeffs[attr][0] * edge0.step_x + coeffs[attr][1] * edge1.step_x + coeffs[attr][2] * edge2.step_x;
+            step_y[attr] = coeffs[attr][0] * edge0.step_y + coeffs[attr][1] * edge1.step_y + coeffs[attr][2] * edge2.step_y;
+        }
+    }
 
-    // Enter rasterization loop, starting at the center of the topleft bounding box corner.
-    // TODO: Not sure if looping through x first might be faster
-    for (u16 y = min_y + 8; y < max_y; y += 0x10) {
-        for (u16 x = min_x + 8; x < max_x; x += 0x10) {
+    /// Computes the attributes of the pixel with the given barycentric coordinates from scratch
+    void Evaluate(int w0, int w1, int w2, float (&values)[NUM_INTERPOLATED_ATTRIBUTES]) const {
+        for (int attr = 0; attr < NUM_INTERPOLATED_ATTRIBUTES; ++attr)
+            values[attr] = coeffs[attr][0] * w0 + coeffs[attr][1] * w1 + coeffs[attr][2] * w2;
+    }
 
-            // Calculate the barycentric coordinates w0, w1 and w2
-            int w0 = bias0 + SignedArea(vtxpos[1].xy(), vtxpos[2].xy(), {x, y});
-            int w1 = bias1 + SignedArea(vtxpos[2].xy(), vtxpos[0].xy(), {x, y});
-            int w2 = bias2 + SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), {x, y});
-            int wsum = w0 + w1 + w2;
+    /// Moves the attributes one pixel to the right
+    void StepX(float (&values)[NUM_INTERPOLATED_ATTRIBUTES]) const {
+        for (int attr = 0; attr < NUM_INTERPOLATED_ATTRIBUTES; ++attr)
+            values[attr] += step_x[attr];
+    }
 
-            // If current pixel is not covered by the current primitive
-            if (w0 < 0 || w1 < 0 || w2 < 0)
-                continue;
+    /// Moves the attributes one pixel down
+    void StepY(float (&values)[NUM_INTERPOLATED_ATTRIBUTES]) const {
+        for (int attr = 0; attr < NUM_INTERPOLATED_ATTRIBUTES; ++attr)
+            values[attr] += step_y[attr];
+    }
 
-            auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
-                                                float24::FromFloat32(static_cast<float>(w1)),
-                                                float24::FromFloat32(static_cast<float>(w2)));
-            float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
-
-            // Perspective correct attribute interpolation:
-            // Attribute values cannot be calculated by simple linear interpolation since
-            // they are not linear in screen space. For example, when interpolating a
-            // texture coordinate across two vertices, something simple like
-            //     u = (u0*w0 + u1*w1)/(w0+w1)
-            // will not work. However, the attribute value divided by the
-            // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
-            // in screenspace. Hence, we can linearly interpolate these two independently and
-            // calculate the interpolated attribute by dividing the results.
-            // I.e.
-            //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
-            //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
-            //     u = u_over_w / one_over_w
-            //
-            // The generalization to three vertices is straightforward in baricentric coordinates.
-            auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
-                auto attr_over_w = Math::MakeVec(attr0, attr1, attr2);
-                float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
-                return interpolated_attr_over_w * interpolated_w_inverse;
-            };
+    float coeffs[NUM_INTERPOLATED_ATTRIBUTES][3];
+    float step_x[NUM_INTERPOLATED_ATTRIBUTES];
+    float step_y[NUM_INTERPOLATED_ATTRIBUTES];
+};
 
-            Math::Vec4<u8> primary_color{
-                (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
-            };
+static Common::Profiling::TimingCategory rasterization_category("Rasterization");
 
-            Math::Vec2<float24> uv[3];
-            uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
-            uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
-            uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
-            uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
-            uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
-            uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
-
-            Math::Vec4<u8> texture_color[3]{};
-            for (int i = 0; i < 3; ++i) {
-                const auto& texture = textures[i];
-                if (!texture.enabled)
-                    continue;
+/// Rectangle in rasterizer coordinates which limits the pixels touched by a triangle
+struct ScissorRect {
+    int min_x, min_y;
+    int max_x, max_y;
+};
 
-                DEBUG_ASSERT(0 != texture.config.address);
-
-                int s = (int)(uv[i].u() * float24::FromFloat32(static_cast<float>(texture.config.width))).ToFloat32();
-                int t = (int)(uv[i].v() * float24::FromFloat32(static_cast<float>(texture.config.height))).ToFloat32();
-                static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
-                    switch (mode) {
-                        case Regs::TextureConfig::ClampToEdge:
-                            val = std::max(val, 0);
-                            val = std::min(val, (int)size - 1);
-                            return val;
-
-                        case Regs::TextureConfig::ClampToBorder:
-                            return val;
-
-                        case Regs::TextureConfig::Repeat:
-                            return (int)((unsigned)val % size);
-
-                        case Regs::TextureConfig::MirroredRepeat:
-                        {
-                            unsigned int coord = ((unsigned)val % (2 * size));
-                            if (coord >= size)
-                                coord = 2 * size - 1 - coord;
-                            return (int)coord;
-                        }
+/// Rectangle large enough to not clip anything
+static const ScissorRect unbounded_rect = { 0, 0, 0x10000, 0x10000 };
 
-                        default:
-                            LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
-                            UNIMPLEMENTED();
-                            return 0;
-                    }
-                };
-
-                if ((texture.config.wrap_s == Regs::TextureConfig::ClampToBorder && (s < 0 || s >= texture.config.width))
-                    || (texture.config.wrap_t == Regs::TextureConfig::ClampToBorder && (t < 0 || t >= texture.config.height))) {
-                    auto border_color = texture.config.border_color;
-                    texture_color[i] = { border_color.r, border_color.g, border_color.b, border_color.a };
-                } else {
-                    // Textures are laid out from bottom to top, hence we invert the t coordinate.
-                    // NOTE: This may not be the right place for the inversion.
-                    // TODO: Check if this applies to ETC textures, too.
-                    s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
-                    t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
-
-                    u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
-                    auto info = DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
-
-                    // TODO: Apply the min and mag filters to the texture
-                    texture_color[i] = DebugUtils::LookupTexture(texture_data, s, t, info);
-#if PICA_DUMP_TEXTURES
-                    DebugUtils::DumpTexture(texture.config, texture_data);
-#endif
-                }
-            }
+static DrawState draw_state;
 
-            // Texture environment - consists of 6 stages of color and alpha combining.
-            //
-            // Color combiners take three input color values from some source (e.g. interpolated
-            // vertex color, texture color, previous stage, etc), perform some very simple
-            // operations on each of them (e.g. inversion) and then calculate the output color
-            // with some basic arithmetic. Alpha combiners can be configured separately but work
-            // analogously.
-            Math::Vec4<u8> combiner_output;
-            Math::Vec4<u8> combiner_buffer = {
-                regs.tev_combiner_buffer_color.r, regs.tev_combiner_buffer_color.g,
-                regs.tev_combiner_buffer_color.b, regs.tev_combiner_buffer_color.a
-            };
+/// Cleared once draw_state has been decoded from the current registers
+static bool draw_state_dirty = true;
 
-            for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-                const auto& tev_stage = tev_stages[tev_stage_index];
-                using Source = Regs::TevStageConfig::Source;
-                using ColorModifier = Regs::TevStageConfig::ColorModifier;
-                using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
-                using Operation = Regs::TevStageConfig::Operation;
+const DrawState& GetDrawState() {
+    return draw_state;
+}
 
-                auto GetSource = [&](Source source) -> Math::Vec4<u8> {
-                    switch (source) {
-                    case Source::PrimaryColor:
+void NotifyRegisterChanged(u32 id) {
+    // Registers from the vertex attribute setup on only configure the geometry pipeline
+    if (id < PICA_REG_INDEX(vertex_attributes))
+        draw_state_dirty = true;
+}
 
-                    // HACK: Until we implement fragment lighting, use primary_color
-                    case Source::PrimaryFragmentColor:
-                        return primary_color;
+void InvalidateDrawState() {
+    draw_state_dirty = true;
+}
 
-                    // HACK: Until we implement fragment lighting, use zero
-                    case Source::SecondaryFragmentColor:
-                        return {0, 0, 0, 0};
+static void DecodeDrawState() {
+    const auto& regs = g_state.regs;
+    const auto& output_merger = regs.output_merger;
+    DrawState& state = draw_state;
+
+    auto& viewport = state.viewport;
+    viewport.halfsize_x = float24::FromRawFloat24(regs.viewport_size_x);
+    viewport.halfsize_y = float24::FromRawFloat24(regs.viewport_size_y);
+    viewport.offset_x   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.x));
+    viewport.offset_y   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.y));
+    viewport.zscale     = float24::FromRawFloat24(regs.viewport_depth_range);
+    viewport.offset_z   = float24::FromRawFloat24(regs.viewport_depth_far_plane);
+
+    // The clipper leaves triangles which lie within its guard band unclipped against the x and y
+    // planes, so drawing has to be limited to the viewport
+    float width = viewport.halfsize_x.ToFloat32() * 2;
+    float height = viewport.halfsize_y.ToFloat32() * 2;
+    state.viewport_min_x = regs.viewport_corner.x * 16;
+    state.viewport_min_y = regs.viewport_corner.y * 16;
+    state.viewport_max_x = state.viewport_min_x + static_cast<int>(width * 16);
+    state.viewport_max_y = state.viewport_min_y + static_cast<int>(height * 16);
+
+    state.cull_mode = regs.cull_mode;
+
+    const auto textures = regs.GetTextures();
+    for (unsigned i = 0; i < textures.size(); ++i) {
+        // Texture configurations can't be assigned, as their bitfields can't
+        state.textures[i].enabled = textures[i].enabled;
+        std::memcpy(&state.textures[i].config, &textures[i].config, sizeof(Regs::TextureConfig));
+        state.textures[i].format = textures[i].format;
+    }
+    state.combiner_buffer_color = {
+        (u8)regs.tev_combiner_buffer_color.r, (u8)regs.tev_combiner_buffer_color.g,
+        (u8)regs.tev_combiner_buffer_color.b, (u8)regs.tev_combiner_buffer_color.a
+    };
 
-                    case Source::Texture0:
-                        return texture_color[0];
+    state.alpha_test_enable = output_merger.alpha_test.enable != 0;
+    state.alpha_test_func = output_merger.alpha_test.func;
+    state.alpha_test_ref = (u8)output_merger.alpha_test.ref;
+
+    const auto& stencil_test = output_merger.stencil_test;
+    state.stencil_action_enable = stencil_test.enable && regs.framebuffer.depth_format == Regs::DepthFormat::D24S8;
+    state.stencil_test_func = stencil_test.func;
+    state.stencil_mask = (u8)stencil_test.mask;
+    state.stencil_reference_value = (u8)stencil_test.reference_value;
+    state.stencil_replacement_value = (u8)stencil_test.replacement_value;
+    state.stencil_fail_action = stencil_test.action_stencil_fail;
+    state.depth_fail_action = stencil_test.action_depth_fail;
+    state.depth_pass_action = stencil_test.action_depth_pass;
+
+    state.depth_test_enable = output_merger.depth_test_enable != 0;
+    state.depth_test_func = output_merger.depth_test_func;
+    state.depth_write_enable = output_merger.depth_write_enable != 0;
+    state.num_depth_bits = state.depth_test_enable ? Regs::DepthBitsPerPixel(regs.framebuffer.depth_format) : 0;
+
+    const auto& blending = output_merger.alpha_blending;
+    state.alphablend_enable = output_merger.alphablend_enable != 0;
+    state.blend_equation_rgb = blending.blend_equation_rgb;
+    state.blend_equation_a = blending.blend_equation_a;
+    state.factor_source_rgb = blending.factor_source_rgb;
+    state.factor_dest_rgb = blending.factor_dest_rgb;
+    state.factor_source_a = blending.factor_source_a;
+    state.factor_dest_a = blending.factor_dest_a;
+    state.blend_const = {
+        (u8)output_merger.blend_const.r, (u8)output_merger.blend_const.g,
+        (u8)output_merger.blend_const.b, (u8)output_merger.blend_const.a
+    };
+    state.logic_op = output_merger.logic_op;
 
-                    case Source::Texture1:
-                        return texture_color[1];
+    state.red_enable = output_merger.red_enable != 0;
+    state.green_enable = output_merger.green_enable != 0;
+    state.blue_enable = output_merger.blue_enable != 0;
+    state.alpha_enable = output_merger.alpha_enable != 0;
 
-                    case Source::Texture2:
-                        return texture_color[2];
+    state.color_replace = !state.alphablend_enable && state.logic_op == Regs::LogicOp::Copy &&
+                          state.red_enable && state.green_enable && state.blue_enable && state.alpha_enable;
+}
 
-                    case Source::PreviousBuffer:
-                        return combiner_buffer;
+/// Conservative range of the depth values in one BLOCK_SIZE x BLOCK_SIZE block of the depth buffer
+struct DepthRange {
+    u32 min;
+    u32 max;
+    /// Cleared when the range has to be read from memory again
+    bool valid;
+};
 
-                    case Source::Constant:
-                        return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a};
+/**
+ * Hierarchical Z buffer: Depth ranges of the blocks of the current depth buffer, which allow
+ * skipping blocks that are certain to fail the depth test before anything is interpolated.
+ * Ranges are read from memory when a block is first tested and widened as depth is written.
+ * They are dropped when the depth buffer is changed by anything else, at the same points the
+ * texture cache is notified. Tiles don't share blocks, so the worker threads can access them
+ * without locking.
+ */
+static struct {
+    PAddr addr;
+    u32 size;
+    Regs::DepthFormat format;
+    int width, height;
+    int blocks_x, blocks_y;
+    std::vector<DepthRange> ranges;
+} hiz;
+
+/// Fraction of the depth range added to either side of a triangle's depth bounds for rounding
+static const float HIZ_RELATIVE_MARGIN = 1.0f / (1 << 20);
+
+/// Points the hierarchical Z buffer at the current depth buffer. Regs must not change until the triangles are drawn.
+static void PrepareHierarchicalZ() {
+    const auto& framebuffer = g_state.regs.framebuffer;
 
-                    case Source::Previous:
-                        return combiner_output;
+    // Depth is only accessed with depth testing enabled, and the format may be invalid otherwise
+    if (!g_state.regs.output_merger.depth_test_enable)
+        return;
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0, 0};
-                    }
-                };
+    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
+    const int width = framebuffer.GetWidth();
+    const int height = framebuffer.GetHeight();
+    if (addr == hiz.addr && framebuffer.depth_format == hiz.format && width == hiz.width && height == hiz.height)
+        return;
+
+    hiz.addr = addr;
+    hiz.size = Regs::BytesPerDepthPixel(framebuffer.depth_format) * width * height;
+    hiz.format = framebuffer.depth_format;
+    hiz.width = width;
+    hiz.height = height;
+    hiz.blocks_x = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    hiz.blocks_y = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    hiz.ranges.assign(hiz.blocks_x * hiz.blocks_y, DepthRange{ 0, 0, false });
+}
 
-                static auto GetColorModifier = [](ColorModifier factor, const Math::Vec4<u8>& values) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case ColorModifier::SourceColor:
-                        return values.rgb();
+/// Returns the depth range of the block at the given grid position in rasterizer coordinates, if it has one
+static DepthRange* FindDepthRange(int grid_x, int grid_y) {
+    const int block_x = grid_x / (BLOCK_SIZE * 0x10);
+    const int block_y = grid_y / (BLOCK_SIZE * 0x10);
 
-                    case ColorModifier::OneMinusSourceColor:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
+    // Partial blocks at the framebuffer border are left out
+    if ((block_x + 1) * BLOCK_SIZE > hiz.width || (block_y + 1) * BLOCK_SIZE > hiz.height)
+        return nullptr;
 
-                    case ColorModifier::SourceAlpha:
-                        return values.aaa();
+    return &hiz.ranges[block_x + block_y * hiz.blocks_x];
+}
 
-                    case ColorModifier::OneMinusSourceAlpha:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
+static void ComputeDepthRange(DepthRange& range, const FramebufferAccessor& framebuffer, int grid_x, int grid_y) {
+    const int x0 = grid_x >> 4;
+    const int y0 = grid_y >> 4;
+
+    range.min = std::numeric_limits<u32>::max();
+    range.max = 0;
+    for (int y = y0; y < y0 + BLOCK_SIZE; ++y) {
+        for (int x = x0; x < x0 + BLOCK_SIZE; ++x) {
+            const u32 z = framebuffer.GetDepth(x, y);
+            range.min = std::min(range.min, z);
+            range.max = std::max(range.max, z);
+        }
+    }
+    range.valid = true;
+}
 
-                    case ColorModifier::SourceRed:
-                        return values.rrr();
+/// Returns true if BlockFailsDepthTest can give a result for the given depth test function
+static bool IsHierarchicalZCompareFunc(Regs::CompareFunc func) {
+    return func != Regs::CompareFunc::Always && func != Regs::CompareFunc::NotEqual;
+}
 
-                    case ColorModifier::OneMinusSourceRed:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
+/**
+ * Returns true if every depth in [min_z, max_z] fails the depth test against every depth in the
+ * range. Pixel depths are truncated to integers, hence the comparisons against range values + 1.
+ */
+static bool BlockFailsDepthTest(Regs::CompareFunc func, float min_z, float max_z, const DepthRange& range) {
+    const float range_min = static_cast<float>(range.min);
+    const float range_max = static_cast<float>(range.max);
 
-                    case ColorModifier::SourceGreen:
-                        return values.ggg();
+    switch (func) {
+    case Regs::CompareFunc::Never:
+        return true;
 
-                    case ColorModifier::OneMinusSourceGreen:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
+    case Regs::CompareFunc::Equal:
+        return max_z < range_min || min_z >= range_max + 1;
 
-                    case ColorModifier::SourceBlue:
-                        return values.bbb();
+    case Regs::CompareFunc::LessThan:
+        return min_z >= range_max;
 
-                    case ColorModifier::OneMinusSourceBlue:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
-                    }
-                };
+    case Regs::CompareFunc::LessThanOrEqual:
+        return min_z >= range_max + 1;
 
-                static auto GetAlphaModifier = [](AlphaModifier factor, const Math::Vec4<u8>& values) -> u8 {
-                    switch (factor) {
-                    case AlphaModifier::SourceAlpha:
-                        return values.a();
+    case Regs::CompareFunc::GreaterThan:
+        return max_z < range_min + 1;
 
-                    case AlphaModifier::OneMinusSourceAlpha:
-                        return 255 - values.a();
+    case Regs::CompareFunc::GreaterThanOrEqual:
+        return max_z < range_min;
 
-                    case AlphaModifier::SourceRed:
-                        return values.r();
+    default:
+        return false;
+    }
+}
 
-                    case AlphaModifier::OneMinusSourceRed:
-                        return 255 - values.r();
+/**
+ * The texture environment configuration is compiled into a table of per-stage function pointers
+ * whenever the TEV registers change, so that evaluating it for a pixel doesn't need to switch over
+ * the sources, modifiers and operations of each stage.
+ */
+namespace Tev {
+
+using Source = Regs::TevStageConfig::Source;
+using ColorModifier = Regs::TevStageConfig::ColorModifier;
+using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+using Operation = Regs::TevStageConfig::Operation;
+
+/// Slots of the per-pixel array holding all values a combiner stage can read
+enum Input : u8 {
+    InputPrimaryColor,
+    InputZero,
+    InputTexture0,
+    InputTexture1,
+    InputTexture2,
+    InputPreviousBuffer,
+    InputConstant,
+    InputPrevious,
+
+    NUM_INPUTS
+};
 
-                    case AlphaModifier::SourceGreen:
-                        return values.g();
+template <ColorModifier factor>
+static Math::Vec3<u8> GetColorModifier(const Math::Vec4<u8>& values) {
+    switch (factor) {
+    case ColorModifier::SourceColor:
+        return values.rgb();
 
-                    case AlphaModifier::OneMinusSourceGreen:
-                        return 255 - values.g();
+    case ColorModifier::OneMinusSourceColor:
+        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
 
-                    case AlphaModifier::SourceBlue:
-                        return values.b();
+    case ColorModifier::SourceAlpha:
+        return values.aaa();
 
-                    case AlphaModifier::OneMinusSourceBlue:
-                        return 255 - values.b();
-                    }
-                };
-
-                static auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
-
-                    case Operation::Modulate:
-                        return ((input[0] * input[1]) / 255).Cast<u8>();
-
-                    case Operation::Add:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+    case ColorModifier::OneMinusSourceAlpha:
+        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
 
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
-                        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
-                        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
-                        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
-                        return result.Cast<u8>();
-                    }
+    case ColorModifier::SourceRed:
+        return values.rrr();
 
-                    case Operation::Lerp:
-                        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
+    case ColorModifier::OneMinusSourceRed:
+        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
 
-                    case Operation::Subtract:
-                    {
-                        auto result = input[0].Cast<int>() - input[1].Cast<int>();
-                        result.r() = std::max(0, result.r());
-                        result.g() = std::max(0, result.g());
-                        result.b() = std::max(0, result.b());
-                        return result.Cast<u8>();
-                    }
+    case ColorModifier::SourceGreen:
+        return values.ggg();
 
-                    case Operation::MultiplyThenAdd:
-                    {
-                        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+    case ColorModifier::OneMinusSourceGreen:
+        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
 
-                    case Operation::AddThenMultiply:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        result = (result * input[2].Cast<int>()) / 255;
-                        return result.Cast<u8>();
-                    }
-                    case Operation::Dot3_RGB:
-                    {
-                        // Not fully accurate.
-                        // Worst case scenario seems to yield a +/-3 error
-                        // Some HW results indicate that the per-component computation can't have a higher precision than 1/256,
-                        // while dot3_rgb( (0x80,g0,b0),(0x7F,g1,b1) ) and dot3_rgb( (0x80,g0,b0),(0x80,g1,b1) ) give different results
-                        int result = ((input[0].r() * 2 - 255) * (input[1].r() * 2 - 255) + 128) / 256 +
-                                     ((input[0].g() * 2 - 255) * (input[1].g() * 2 - 255) + 128) / 256 +
-                                     ((input[0].b() * 2 - 255) * (input[1].b() * 2 - 255) + 128) / 256;
-                        result = std::max(0, std::min(255, result));
-                        return { (u8)result, (u8)result, (u8)result };
-                    }
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0};
-                    }
-                };
+    case ColorModifier::SourceBlue:
+        return values.bbb();
 
-                static auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+    case ColorModifier::OneMinusSourceBlue:
+    default:
+        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
+    }
+}
 
-                    case Operation::Modulate:
-                        return input[0] * input[1] / 255;
+template <AlphaModifier factor>
+static u8 GetAlphaModifier(const Math::Vec4<u8>& values) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:
+        return values.a();
 
-                    case Operation::Add:
-                        return std::min(255, input[0] + input[1]);
+    case AlphaModifier::OneMinusSourceAlpha:
+        return 255 - values.a();
 
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = static_cast<int>(input[0]) + static_cast<int>(input[1]) - 128;
-                        return static_cast<u8>(MathUtil::Clamp<int>(result, 0, 255));
-                    }
+    case AlphaModifier::SourceRed:
+        return values.r();
 
-                    case Operation::Lerp:
-                        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
+    case AlphaModifier::OneMinusSourceRed:
+        return 255 - values.r();
 
-                    case Operation::Subtract:
-                        return std::max(0, (int)input[0] - (int)input[1]);
+    case AlphaModifier::SourceGreen:
+        return values.g();
 
-                    case Operation::MultiplyThenAdd:
-                        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
+    case AlphaModifier::OneMinusSourceGreen:
+        return 255 - values.g();
 
-                    case Operation::AddThenMultiply:
-                        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
+    case AlphaModifier::SourceBlue:
+        return values.b();
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return 0;
-                    }
-                };
-
-                // color combiner
-                // NOTE: Not sure if the alpha combiner might use the color output of the previous
-                //       stage as input. Hence, we currently don't directly write the result to
-                //       combiner_output.rgb(), but instead store it in a temporary variable until
-                //       alpha combining has been done.
-                Math::Vec3<u8> color_result[3] = {
-                    GetColorModifier(tev_stage.color_modifier1, GetSource(tev_stage.color_source1)),
-                    GetColorModifier(tev_stage.color_modifier2, GetSource(tev_stage.color_source2)),
-                    GetColorModifier(tev_stage.color_modifier3, GetSource(tev_stage.color_source3))
-                };
-                auto color_output = ColorCombine(tev_stage.color_op, color_result);
-
-                // alpha combiner
-                std::array<u8,3> alpha_result = {
-                    GetAlphaModifier(tev_stage.alpha_modifier1, GetSource(tev_stage.alpha_source1)),
-                    GetAlphaModifier(tev_stage.alpha_modifier2, GetSource(tev_stage.alpha_source2)),
-                    GetAlphaModifier(tev_stage.alpha_modifier3, GetSource(tev_stage.alpha_source3))
-                };
-                auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
-
-                combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.GetColorMultiplier());
-                combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.GetColorMultiplier());
-                combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.GetColorMultiplier());
-                combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.GetAlphaMultiplier());
-
-                if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index)) {
-                    combiner_buffer.r() = combiner_output.r();
-                    combiner_buffer.g() = combiner_output.g();
-                    combiner_buffer.b() = combiner_output.b();
-                }
+    case AlphaModifier::OneMinusSourceBlue:
+    default:
+        return 255 - values.b();
+    }
+}
 
-                if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index)) {
-                    combiner_buffer.a() = combiner_output.a();
-                }
-            }
+template <Operation op>
+static Math::Vec3<u8> ColorCombine(const Math::Vec3<u8> input[3]) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
 
-            const auto& output_merger = regs.output_merger;
-            // TODO: Does alpha testing happen before or after stencil?
-            if (output_merger.alpha_test.enable) {
-                bool pass = false;
+    case Operation::Modulate:
+        return ((input[0] * input[1]) / 255).Cast<u8>();
 
-                switch (output_merger.alpha_test.func) {
-                case Regs::CompareFunc::Never:
-                    pass = false;
-                    break;
+    case Operation::Add:
+    {
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
 
-                case Regs::CompareFunc::Always:
-                    pass = true;
-                    break;
+    case Operation::AddSigned:
+    {
+        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
+        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
+        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
+        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
+        return result.Cast<u8>();
+    }
 
-                case Regs::CompareFunc::Equal:
-                    pass = combiner_output.a() == output_merger.alpha_test.ref;
-                    break;
+    case Operation::Lerp:
+        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
 
-                case Regs::CompareFunc::NotEqual:
-                    pass = combiner_output.a() != output_merger.alpha_test.ref;
-                    break;
+    case Operation::Subtract:
+    {
+        auto result = input[0].Cast<int>() - input[1].Cast<int>();
+        result.r() = std::max(0, result.r());
+        result.g() = std::max(0, result.g());
+        result.b() = std::max(0, result.b());
+        return result.Cast<u8>();
+    }
 
-                case Regs::CompareFunc::LessThan:
-                    pass = combiner_output.a() < output_merger.alpha_test.ref;
-                    break;
+    case Operation::MultiplyThenAdd:
+    {
+        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
 
-                case Regs::CompareFunc::LessThanOrEqual:
-                    pass = combiner_output.a() <= output_merger.alpha_test.ref;
-                    break;
+    case Operation::AddThenMultiply:
+    {
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        result = (result * input[2].Cast<int>()) / 255;
+        return result.Cast<u8>();
+    }
 
-                case Regs::CompareFunc::GreaterThan:
-                    pass = combiner_output.a() > output_merger.alpha_test.ref;
-                    break;
+    case Operation::Dot3_RGB:
+    {
+        // Not fully accurate.
+        // Worst case scenario seems to yield a +/-3 error
+        // Some HW results indicate that the per-component computation can't have a higher precision than 1/256,
+        // while dot3_rgb( (0x80,g0,b0),(0x7F,g1,b1) ) and dot3_rgb( (0x80,g0,b0),(0x80,g1,b1) ) give different results
+        int result = ((input[0].r() * 2 - 255) * (input[1].r() * 2 - 255) + 128) / 256 +
+                     ((input[0].g() * 2 - 255) * (input[1].g() * 2 - 255) + 128) / 256 +
+                     ((input[0].b() * 2 - 255) * (input[1].b() * 2 - 255) + 128) / 256;
+        result = std::max(0, std::min(255, result));
+        return { (u8)result, (u8)result, (u8)result };
+    }
 
-                case Regs::CompareFunc::GreaterThanOrEqual:
-                    pass = combiner_output.a() >= output_merger.alpha_test.ref;
-                    break;
-                }
+    default:
+        return {0, 0, 0};
+    }
+}
 
-                if (!pass)
-                    continue;
-            }
+template <Operation op>
+static u8 AlphaCombine(const std::array<u8,3>& input) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
 
-            u8 old_stencil = 0;
-            if (stencil_action_enable) {
-                old_stencil = GetStencil(x >> 4, y >> 4);
-                u8 dest = old_stencil & stencil_test.mask;
-                u8 ref = stencil_test.reference_value & stencil_test.mask;
-
-                bool pass = false;
-                switch (stencil_test.func) {
-                case Regs::CompareFunc::Never:
-                    pass = false;
-                    break;
-
-                case Regs::CompareFunc::Always:
-                    pass = true;
-                    break;
-
-                case Regs::CompareFunc::Equal:
-                    pass = (ref == dest);
-                    break;
-
-                case Regs::CompareFunc::NotEqual:
-                    pass = (ref != dest);
-                    break;
-
-                case Regs::CompareFunc::LessThan:
-                    pass = (ref < dest);
-                    break;
-
-                case Regs::CompareFunc::LessThanOrEqual:
-                    pass = (ref <= dest);
-                    break;
-
-                case Regs::CompareFunc::GreaterThan:
-                    pass = (ref > dest);
-                    break;
-
-                case Regs::CompareFunc::GreaterThanOrEqual:
-                    pass = (ref >= dest);
-                    break;
-                }
+    case Operation::Modulate:
+        return input[0] * input[1] / 255;
 
-                if (!pass) {
-                    u8 new_stencil = PerformStencilAction(stencil_test.action_stencil_fail, old_stencil, stencil_test.replacement_value);
-                    SetStencil(x >> 4, y >> 4, new_stencil);
-                    continue;
-                }
-            }
+    case Operation::Add:
+        return std::min(255, input[0] + input[1]);
 
-            // TODO: Does depth indeed only get written even if depth testing is enabled?
-            if (output_merger.depth_test_enable) {
-                unsigned num_bits = Regs::DepthBitsPerPixel(regs.framebuffer.depth_format);
-                u32 z = (u32)((v0.screenpos[2].ToFloat32() * w0 +
-                               v1.screenpos[2].ToFloat32() * w1 +
-                               v2.screenpos[2].ToFloat32() * w2) * ((1 << num_bits) - 1) / wsum);
-                u32 ref_z = GetDepth(x >> 4, y >> 4);
+    case Operation::AddSigned:
+    {
+        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+        auto result = static_cast<int>(input[0]) + static_cast<int>(input[1]) - 128;
+        return static_cast<u8>(MathUtil::Clamp<int>(result, 0, 255));
+    }
 
-                bool pass = false;
+    case Operation::Lerp:
+        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
 
-                switch (output_merger.depth_test_func) {
-                case Regs::CompareFunc::Never:
-                    pass = false;
-                    break;
+    case Operation::Subtract:
+        return std::max(0, (int)input[0] - (int)input[1]);
 
-                case Regs::CompareFunc::Always:
-                    pass = true;
-                    break;
+    case Operation::MultiplyThenAdd:
+        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
 
-                case Regs::CompareFunc::Equal:
-                    pass = z == ref_z;
-                    break;
+    case Operation::AddThenMultiply:
+        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
 
-                case Regs::CompareFunc::NotEqual:
-                    pass = z != ref_z;
-                    break;
+    default:
+        return 0;
+    }
+}
 
-                case Regs::CompareFunc::LessThan:
-                    pass = z < ref_z;
-                    break;
+using ColorModifierFunc = Math::Vec3<u8> (*)(const Math::Vec4<u8>& values);
+using AlphaModifierFunc = u8 (*)(const Math::Vec4<u8>& values);
+using ColorCombineFunc = Math::Vec3<u8> (*)(const Math::Vec3<u8> input[3]);
+using AlphaCombineFunc = u8 (*)(const std::array<u8,3>& input);
+
+static Input GetInput(Source source) {
+    switch (source) {
+    case Source::PrimaryColor:
+    // HACK: Until we implement fragment lighting, use primary_color
+    case Source::PrimaryFragmentColor:
+        return InputPrimaryColor;
+
+    // HACK: Until we implement fragment lighting, use zero
+    case Source::SecondaryFragmentColor:
+        return InputZero;
+
+    case Source::Texture0:        return InputTexture0;
+    case Source::Texture1:        return InputTexture1;
+    case Source::Texture2:        return InputTexture2;
+    case Source::PreviousBuffer:  return InputPreviousBuffer;
+    case Source::Constant:        return InputConstant;
+    case Source::Previous:        return InputPrevious;
 
-                case Regs::CompareFunc::LessThanOrEqual:
-                    pass = z <= ref_z;
-                    break;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner source %d", (int)source);
+        return InputZero;
+    }
+}
 
-                case Regs::CompareFunc::GreaterThan:
-                    pass = z > ref_z;
-                    break;
+static ColorModifierFunc GetColorModifierFunc(ColorModifier factor) {
+    switch (factor) {
+    case ColorModifier::SourceColor:         return &GetColorModifier<ColorModifier::SourceColor>;
+    case ColorModifier::OneMinusSourceColor: return &GetColorModifier<ColorModifier::OneMinusSourceColor>;
+    case ColorModifier::SourceAlpha:         return &GetColorModifier<ColorModifier::SourceAlpha>;
+    case ColorModifier::OneMinusSourceAlpha: return &GetColorModifier<ColorModifier::OneMinusSourceAlpha>;
+    case ColorModifier::SourceRed:           return &GetColorModifier<ColorModifier::SourceRed>;
+    case ColorModifier::OneMinusSourceRed:   return &GetColorModifier<ColorModifier::OneMinusSourceRed>;
+    case ColorModifier::SourceGreen:         return &GetColorModifier<ColorModifier::SourceGreen>;
+    case ColorModifier::OneMinusSourceGreen: return &GetColorModifier<ColorModifier::OneMinusSourceGreen>;
+    case ColorModifier::SourceBlue:          return &GetColorModifier<ColorModifier::SourceBlue>;
+    case ColorModifier::OneMinusSourceBlue:  return &GetColorModifier<ColorModifier::OneMinusSourceBlue>;
 
-                case Regs::CompareFunc::GreaterThanOrEqual:
-                    pass = z >= ref_z;
-                    break;
-                }
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner modifier %d", (int)factor);
+        return &GetColorModifier<ColorModifier::SourceColor>;
+    }
+}
 
-                if (!pass) {
-                    if (stencil_action_enable) {
-                        u8 new_stencil = PerformStencilAction(stencil_test.action_depth_fail, old_stencil, stencil_test.replacement_value);
-                        SetStencil(x >> 4, y >> 4, new_stencil);
-                    }
-                    continue;
-                }
+static AlphaModifierFunc GetAlphaModifierFunc(AlphaModifier factor) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:         return &GetAlphaModifier<AlphaModifier::SourceAlpha>;
+    case AlphaModifier::OneMinusSourceAlpha: return &GetAlphaModifier<AlphaModifier::OneMinusSourceAlpha>;
+    case AlphaModifier::SourceRed:           return &GetAlphaModifier<AlphaModifier::SourceRed>;
+    case AlphaModifier::OneMinusSourceRed:   return &GetAlphaModifier<AlphaModifier::OneMinusSourceRed>;
+    case AlphaModifier::SourceGreen:         return &GetAlphaModifier<AlphaModifier::SourceGreen>;
+    case AlphaModifier::OneMinusSourceGreen: return &GetAlphaModifier<AlphaModifier::OneMinusSourceGreen>;
+    case AlphaModifier::SourceBlue:          return &GetAlphaModifier<AlphaModifier::SourceBlue>;
+    case AlphaModifier::OneMinusSourceBlue:
+    default:                                 return &GetAlphaModifier<AlphaModifier::OneMinusSourceBlue>;
+    }
+}
 
-                if (output_merger.depth_write_enable)
-                    SetDepth(x >> 4, y >> 4, z);
+static ColorCombineFunc GetColorCombineFunc(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return &ColorCombine<Operation::Replace>;
+    case Operation::Modulate:        return &ColorCombine<Operation::Modulate>;
+    case Operation::Add:             return &ColorCombine<Operation::Add>;
+    case Operation::AddSigned:       return &ColorCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return &ColorCombine<Operation::Lerp>;
+    case Operation::Subtract:        return &ColorCombine<Operation::Subtract>;
+    case Operation::Dot3_RGB:        return &ColorCombine<Operation::Dot3_RGB>;
+    case Operation::MultiplyThenAdd: return &ColorCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return &ColorCombine<Operation::AddThenMultiply>;
 
-                if (stencil_action_enable) {
-                    // TODO: What happens if stencil testing is enabled, but depth testing is not? Will stencil get updated anyway?
-                    u8 new_stencil = PerformStencilAction(stencil_test.action_depth_pass, old_stencil, stencil_test.replacement_value);
-                    SetStencil(x >> 4, y >> 4, new_stencil);
-                }
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d", (int)op);
+        return &ColorCombine<static_cast<Operation>(0xF)>;
+    }
+}
+
+static AlphaCombineFunc GetAlphaCombineFunc(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return &AlphaCombine<Operation::Replace>;
+    case Operation::Modulate:        return &AlphaCombine<Operation::Modulate>;
+    case Operation::Add:             return &AlphaCombine<Operation::Add>;
+    case Operation::AddSigned:       return &AlphaCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return &AlphaCombine<Operation::Lerp>;
+    case Operation::Subtract:        return &AlphaCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return &AlphaCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return &AlphaCombine<Operation::AddThenMultiply>;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d", (int)op);
+        return &AlphaCombine<static_cast<Operation>(0xF)>;
+    }
+}
+
+/// Combiner stage with its sources, modifiers and operations resolved ahead of time
+struct CompiledStage {
+    /// Whether the stage outputs the previous stage's result unchanged
+    bool passthrough;
+    bool updates_buffer_color;
+    bool updates_buffer_alpha;
+
+    Input color_inputs[3];
+    Input alpha_inputs[3];
+    ColorModifierFunc color_modifiers[3];
+    AlphaModifierFunc alpha_modifiers[3];
+    ColorCombineFunc color_combine;
+    AlphaCombineFunc alpha_combine;
+
+    Math::Vec4<u8> constant;
+    unsigned color_multiplier;
+    unsigned alpha_multiplier;
+};
+
+static struct {
+    /// Raw TEV register words the stages were compiled from
+    std::array<u32, 6 * 5 + 1> config;
+    bool valid = false;
+
+    std::array<CompiledStage, 6> stages;
+} pipeline;
+
+static bool IsPassThroughStage(const Regs::TevStageConfig& stage) {
+    return (stage.color_op == Operation::Replace &&
+            stage.alpha_op == Operation::Replace &&
+            stage.color_source1 == Source::Previous &&
+            stage.alpha_source1 == Source::Previous &&
+            stage.color_modifier1 == ColorModifier::SourceColor &&
+            stage.alpha_modifier1 == AlphaModifier::SourceAlpha &&
+            stage.GetColorMultiplier() == 1 &&
+            stage.GetAlphaMultiplier() == 1);
+}
+
+/// Compiles the TEV stages again if their registers changed since they were last compiled
+static void UpdatePipeline() {
+    const auto& regs = g_state.regs;
+    const auto tev_stages = regs.GetTevStages();
+
+    std::array<u32, 6 * 5 + 1> config;
+    static_assert(sizeof(Regs::TevStageConfig) == 5 * sizeof(u32), "Unexpected TevStageConfig size");
+    static_assert(sizeof(regs.tev_combiner_buffer_input) == sizeof(u32), "Unexpected combiner buffer input size");
+    std::memcpy(config.data(), tev_stages.data(), 6 * sizeof(Regs::TevStageConfig));
+    std::memcpy(&config[6 * 5], &regs.tev_combiner_buffer_input, sizeof(u32));
+
+    if (pipeline.valid && config == pipeline.config)
+        return;
+
+    pipeline.config = config;
+    pipeline.valid = true;
+
+    for (unsigned i = 0; i < tev_stages.size(); ++i) {
+        const auto& tev_stage = tev_stages[i];
+        CompiledStage& stage = pipeline.stages[i];
+
+        stage.passthrough = IsPassThroughStage(tev_stage);
+        stage.updates_buffer_color = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(i);
+        stage.updates_buffer_alpha = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(i);
+
+        const Source color_sources[3] = { tev_stage.color_source1, tev_stage.color_source2, tev_stage.color_source3 };
+        const Source alpha_sources[3] = { tev_stage.alpha_source1, tev_stage.alpha_source2, tev_stage.alpha_source3 };
+        const ColorModifier color_modifiers[3] = { tev_stage.color_modifier1, tev_stage.color_modifier2, tev_stage.color_modifier3 };
+        const AlphaModifier alpha_modifiers[3] = { tev_stage.alpha_modifier1, tev_stage.alpha_modifier2, tev_stage.alpha_modifier3 };
+        for (int j = 0; j < 3; ++j) {
+            stage.color_inputs[j] = GetInput(color_sources[j]);
+            stage.alpha_inputs[j] = GetInput(alpha_sources[j]);
+            stage.color_modifiers[j] = GetColorModifierFunc(color_modifiers[j]);
+            stage.alpha_modifiers[j] = GetAlphaModifierFunc(alpha_modifiers[j]);
+        }
+
+        stage.color_combine = GetColorCombineFunc(tev_stage.color_op);
+        stage.alpha_combine = GetAlphaCombineFunc(tev_stage.alpha_op);
+
+        stage.constant = { (u8)tev_stage.const_r, (u8)tev_stage.const_g, (u8)tev_stage.const_b, (u8)tev_stage.const_a };
+        stage.color_multiplier = tev_stage.GetColorMultiplier();
+        stage.alpha_multiplier = tev_stage.GetAlphaMultiplier();
+    }
+}
+
+/**
+ * Runs the compiled combiner stages for a pixel
+ * @param inputs Combiner inputs of the pixel, the constant and previous slots are overwritten
+ * @return Output of the last stage
+ */
+static Math::Vec4<u8> Evaluate(Math::Vec4<u8> (&inputs)[NUM_INPUTS]) {
+    Math::Vec4<u8>& output = inputs[InputPrevious];
+    Math::Vec4<u8>& buffer = inputs[InputPreviousBuffer];
+
+    for (const CompiledStage& stage : pipeline.stages) {
+        if (!stage.passthrough) {
+            inputs[InputConstant] = stage.constant;
+
+            // NOTE: Not sure if the alpha combiner might use the color output of the previous
+            //       stage as input. Hence, the output is only written after alpha combining.
+            const Math::Vec3<u8> color_result[3] = {
+                stage.color_modifiers[0](inputs[stage.color_inputs[0]]),
+                stage.color_modifiers[1](inputs[stage.color_inputs[1]]),
+                stage.color_modifiers[2](inputs[stage.color_inputs[2]])
+            };
+            const Math::Vec3<u8> color_output = stage.color_combine(color_result);
+
+            const std::array<u8,3> alpha_result = {{
+                stage.alpha_modifiers[0](inputs[stage.alpha_inputs[0]]),
+                stage.alpha_modifiers[1](inputs[stage.alpha_inputs[1]]),
+                stage.alpha_modifiers[2](inputs[stage.alpha_inputs[2]])
+            }};
+            const u8 alpha_output = stage.alpha_combine(alpha_result);
+
+            output[0] = std::min((unsigned)255, color_output.r() * stage.color_multiplier);
+            output[1] = std::min((unsigned)255, color_output.g() * stage.color_multiplier);
+            output[2] = std::min((unsigned)255, color_output.b() * stage.color_multiplier);
+            output[3] = std::min((unsigned)255, alpha_output * stage.alpha_multiplier);
+        }
+
+        if (stage.updates_buffer_color) {
+            buffer.r() = output.r();
+            buffer.g() = output.g();
+            buffer.b() = output.b();
+        }
+
+        if (stage.updates_buffer_alpha)
+            buffer.a() = output.a();
+    }
+
+    return output;
+}
+
+} // namespace Tev
+
+/**
+ * Texture sampling of the software rasterizer. The wrapping and filtering configuration of each
+ * texture is resolved once per triangle, so that sampling a pixel only needs to look at it.
+ */
+namespace Sampler {
+
+using WrapMode = Regs::TextureConfig::WrapMode;
+using TextureFilter = Regs::TextureConfig::TextureFilter;
+
+/// Wrapping configuration of one texture coordinate
+struct Axis {
+    WrapMode mode;
+    int size;
+    /// size - 1 if the size is a power of two, so that repeating only needs to mask the texel index
+    int mask;
+};
+
+/// Wraps a texel index into the texture, returns -1 for indices outside of a ClampToBorder texture
+static int Wrap(const Axis& axis, int val) {
+    switch (axis.mode) {
+    case Regs::TextureConfig::ClampToEdge:
+        return MathUtil::Clamp(val, 0, axis.size - 1);
+
+    case Regs::TextureConfig::ClampToBorder:
+        return (val < 0 || val >= axis.size) ? -1 : val;
+
+    case Regs::TextureConfig::Repeat:
+        if (axis.mask != 0)
+            return val & axis.mask;
+        return (int)((unsigned)val % axis.size);
+
+    case Regs::TextureConfig::MirroredRepeat:
+    {
+        unsigned coord = (axis.mask != 0) ? ((unsigned)val & (2 * axis.mask + 1))
+                                          : ((unsigned)val % (2 * axis.size));
+        if (coord >= (unsigned)axis.size)
+            coord = 2 * axis.size - 1 - coord;
+        return (int)coord;
+    }
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)axis.mode);
+        UNIMPLEMENTED();
+        return 0;
+    }
+}
+
+struct TextureSampler {
+    const TextureCache::DecodedTexture* texture;
+    Axis s;
+    Axis t;
+    TextureFilter filter;
+    Math::Vec4<u8> border_color;
+};
+
+static Axis MakeAxis(WrapMode mode, int size) {
+    const bool power_of_two = size > 1 && (size & (size - 1)) == 0;
+    return { mode, size, power_of_two ? size - 1 : 0 };
+}
+
+/**
+ * Sets up a sampler for the given texture
+ * @param minified Whether the texture is minified across the triangle it's sampled for, which
+ *                 selects between the minification and magnification filter
+ */
+static void Setup(TextureSampler& sampler, const Regs::TextureConfig& config,
+                  const TextureCache::DecodedTexture* texture, bool minified) {
+    sampler.texture = texture;
+    sampler.s = MakeAxis(config.wrap_s, config.width);
+    sampler.t = MakeAxis(config.wrap_t, config.height);
+    sampler.filter = minified ? config.min_filter.Value() : config.mag_filter.Value();
+    sampler.border_color = { (u8)config.border_color.r, (u8)config.border_color.g,
+                             (u8)config.border_color.b, (u8)config.border_color.a };
+}
+
+/// Returns the texel at the given (unwrapped) texel indices
+static Math::Vec4<u8> Fetch(const TextureSampler& sampler, int s, int t) {
+    s = Wrap(sampler.s, s);
+    t = Wrap(sampler.t, t);
+    if (s < 0 || t < 0)
+        return sampler.border_color;
+
+    // Textures are laid out from bottom to top, hence we invert the t coordinate.
+    // NOTE: This may not be the right place for the inversion.
+    // TODO: Check if this applies to ETC textures, too.
+    return sampler.texture->Lookup(s, sampler.t.size - 1 - t);
+}
+
+/**
+ * Blends four texels with the given fractional position between them
+ * @param texels Texels at (s, t), (s + 1, t), (s, t + 1) and (s + 1, t + 1)
+ * @param frac_s Position between the left and right texels, in 1/256 units
+ * @param frac_t Position between the top and bottom texels, in 1/256 units
+ */
+static Math::Vec4<u8> BilinearBlend(const Math::Vec4<u8> (&texels)[4], int frac_s, int frac_t) {
+    // The weights always add up to 256, so the weighted sum of each component fits into 16 bits
+    const int w11 = (frac_s * frac_t) >> 8;
+    const int w10 = (frac_s * (256 - frac_t)) >> 8;
+    const int w01 = ((256 - frac_s) * frac_t) >> 8;
+    const int w00 = 256 - w10 - w01 - w11;
+
+#ifdef RASTERIZER_SSE2
+    u32 packed[4];
+    std::memcpy(packed, texels, sizeof(packed));
+
+    // Top texels in the first row, bottom ones in the second, with 16 bits per component
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, packed[1], packed[0]), zero);
+    const __m128i bottom = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, packed[3], packed[2]), zero);
+    const __m128i top_weights = _mm_set_epi16(w10, w10, w10, w10, w00, w00, w00, w00);
+    const __m128i bottom_weights = _mm_set_epi16(w11, w11, w11, w11, w01, w01, w01, w01);
+
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(top, top_weights), _mm_mullo_epi16(bottom, bottom_weights));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(sum, 8);
+
+    const u32 result = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+    Math::Vec4<u8> color;
+    std::memcpy(&color, &result, sizeof(color));
+    return color;
+#else
+    Math::Vec4<u8> color;
+    for (int i = 0; i < 4; ++i) {
+        color[i] = (texels[0][i] * w00 + texels[1][i] * w10 +
+                    texels[2][i] * w01 + texels[3][i] * w11) >> 8;
+    }
+    return color;
+#endif
+}
+
+static Math::Vec4<u8> Sample(const TextureSampler& sampler, const Math::Vec2<float24>& uv) {
+    if (sampler.filter == Regs::TextureConfig::Nearest) {
+        int s = (int)(uv.u() * float24::FromFloat32(static_cast<float>(sampler.s.size))).ToFloat32();
+        int t = (int)(uv.v() * float24::FromFloat32(static_cast<float>(sampler.t.size))).ToFloat32();
+        return Fetch(sampler, s, t);
+    }
+
+    // Texel position relative to the centers of the texels, in 1/256 texel units
+    const int s = (int)std::floor(uv.u().ToFloat32() * sampler.s.size * 256.f) - 128;
+    const int t = (int)std::floor(uv.v().ToFloat32() * sampler.t.size * 256.f) - 128;
+    const int s0 = s >> 8;
+    const int t0 = t >> 8;
+
+    const Math::Vec4<u8> texels[4] = {
+        Fetch(sampler, s0, t0),
+        Fetch(sampler, s0 + 1, t0),
+        Fetch(sampler, s0, t0 + 1),
+        Fetch(sampler, s0 + 1, t0 + 1)
+    };
+    return BilinearBlend(texels, s & 0xFF, t & 0xFF);
+}
+
+/**
+ * Estimates whether a texture is minified across a triangle, by comparing the areas the triangle
+ * covers in texture and screen space. Mip levels aren't emulated, so this only selects the filter.
+ */
+static bool IsMinified(const Regs::TextureConfig& config, const Math::Vec2<float24>& tc0,
+                       const Math::Vec2<float24>& tc1, const Math::Vec2<float24>& tc2, float screen_area) {
+    const float du1 = (tc1.u() - tc0.u()).ToFloat32() * config.width;
+    const float dv1 = (tc1.v() - tc0.v()).ToFloat32() * config.height;
+    const float du2 = (tc2.u() - tc0.u()).ToFloat32() * config.width;
+    const float dv2 = (tc2.v() - tc0.v()).ToFloat32() * config.height;
+    const float texel_area = std::abs(du1 * dv2 - du2 * dv1) / 2;
+    return texel_area > screen_area;
+}
+
+} // namespace Sampler
+
+/**
+ * Blending, logic op and color write mask stage, which combines the TEV output of a pixel with the
+ * contents of the framebuffer
+ */
+static Math::Vec4<u8> BlendPixel(const DrawState& state, const Math::Vec4<u8>& source,
+                                 const Math::Vec4<u8>& dest) {
+    Math::Vec4<u8> blend_output = source;
+
+    if (state.alphablend_enable) {
+        auto LookupFactorRGB = [&](Regs::BlendFactor factor) -> Math::Vec3<u8> {
+            switch (factor) {
+            case Regs::BlendFactor::Zero :
+                return Math::Vec3<u8>(0, 0, 0);
+
+            case Regs::BlendFactor::One :
+                return Math::Vec3<u8>(255, 255, 255);
+
+            case Regs::BlendFactor::SourceColor:
+                return source.rgb();
+
+            case Regs::BlendFactor::OneMinusSourceColor:
+                return Math::Vec3<u8>(255 - source.r(), 255 - source.g(), 255 - source.b());
+
+            case Regs::BlendFactor::DestColor:
+                return dest.rgb();
+
+            case Regs::BlendFactor::OneMinusDestColor:
+                return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
+
+            case Regs::BlendFactor::SourceAlpha:
+                return Math::Vec3<u8>(source.a(), source.a(), source.a());
+
+            case Regs::BlendFactor::OneMinusSourceAlpha:
+                return Math::Vec3<u8>(255 - source.a(), 255 - source.a(), 255 - source.a());
+
+            case Regs::BlendFactor::DestAlpha:
+                return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
+
+            case Regs::BlendFactor::OneMinusDestAlpha:
+                return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
+
+            case Regs::BlendFactor::ConstantColor:
+                return Math::Vec3<u8>(state.blend_const.r(), state.blend_const.g(), state.blend_const.b());
+
+            case Regs::BlendFactor::OneMinusConstantColor:
+                return Math::Vec3<u8>(255 - state.blend_const.r(), 255 - state.blend_const.g(), 255 - state.blend_const.b());
+
+            case Regs::BlendFactor::ConstantAlpha:
+                return Math::Vec3<u8>(state.blend_const.a(), state.blend_const.a(), state.blend_const.a());
+
+            case Regs::BlendFactor::OneMinusConstantAlpha:
+                return Math::Vec3<u8>(255 - state.blend_const.a(), 255 - state.blend_const.a(), 255 - state.blend_const.a());
+
+            default:
+                LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
+                UNIMPLEMENTED();
+                break;
             }
+        };
 
-            auto dest = GetPixel(x >> 4, y >> 4);
-            Math::Vec4<u8> blend_output = combiner_output;
+        auto LookupFactorA = [&](Regs::BlendFactor factor) -> u8 {
+            switch (factor) {
+            case Regs::BlendFactor::Zero:
+                return 0;
 
-            if (output_merger.alphablend_enable) {
-                auto params = output_merger.alpha_blending;
+            case Regs::BlendFactor::One:
+                return 255;
 
-                auto LookupFactorRGB = [&](Regs::BlendFactor factor) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case Regs::BlendFactor::Zero :
-                        return Math::Vec3<u8>(0, 0, 0);
+            case Regs::BlendFactor::SourceAlpha:
+                return source.a();
 
-                    case Regs::BlendFactor::One :
-                        return Math::Vec3<u8>(255, 255, 255);
+            case Regs::BlendFactor::OneMinusSourceAlpha:
+                return 255 - source.a();
 
-                    case Regs::BlendFactor::SourceColor:
-                        return combiner_output.rgb();
+            case Regs::BlendFactor::DestAlpha:
+                return dest.a();
 
-                    case Regs::BlendFactor::OneMinusSourceColor:
-                        return Math::Vec3<u8>(255 - combiner_output.r(), 255 - combiner_output.g(), 255 - combiner_output.b());
+            case Regs::BlendFactor::OneMinusDestAlpha:
+                return 255 - dest.a();
 
-                    case Regs::BlendFactor::DestColor:
-                        return dest.rgb();
+            case Regs::BlendFactor::ConstantAlpha:
+                return state.blend_const.a();
 
-                    case Regs::BlendFactor::OneMinusDestColor:
-                        return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
+            case Regs::BlendFactor::OneMinusConstantAlpha:
+                return 255 - state.blend_const.a();
 
-                    case Regs::BlendFactor::SourceAlpha:
-                        return Math::Vec3<u8>(combiner_output.a(), combiner_output.a(), combiner_output.a());
+            default:
+                LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
+                UNIMPLEMENTED();
+                break;
+            }
+        };
+
+        static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
+                                               const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
+                                               Regs::BlendEquation equation) {
+            Math::Vec4<int> result;
+
+            auto src_result = (src  *  srcfactor).Cast<int>();
+            auto dst_result = (dest * destfactor).Cast<int>();
+
+            switch (equation) {
+            case Regs::BlendEquation::Add:
+                result = (src_result + dst_result) / 255;
+                break;
+
+            case Regs::BlendEquation::Subtract:
+                result = (src_result - dst_result) / 255;
+                break;
+
+            case Regs::BlendEquation::ReverseSubtract:
+                result = (dst_result - src_result) / 255;
+                break;
+
+            // TODO: How do these two actually work?
+            //       OpenGL doesn't include the blend factors in the min/max computations,
+            //       but is this what the 3DS actually does?
+            case Regs::BlendEquation::Min:
+                result.r() = std::min(src.r(), dest.r());
+                result.g() = std::min(src.g(), dest.g());
+                result.b() = std::min(src.b(), dest.b());
+                result.a() = std::min(src.a(), dest.a());
+                break;
+
+            case Regs::BlendEquation::Max:
+                result.r() = std::max(src.r(), dest.r());
+                result.g() = std::max(src.g(), dest.g());
+                result.b() = std::max(src.b(), dest.b());
+                result.a() = std::max(src.a(), dest.a());
+                break;
+
+            default:
+                LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
+                UNIMPLEMENTED();
+            }
 
-                    case Regs::BlendFactor::OneMinusSourceAlpha:
-                        return Math::Vec3<u8>(255 - combiner_output.a(), 255 - combiner_output.a(), 255 - combiner_output.a());
+            return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
+                            MathUtil::Clamp(result.g(), 0, 255),
+                            MathUtil::Clamp(result.b(), 0, 255),
+                            MathUtil::Clamp(result.a(), 0, 255));
+        };
 
-                    case Regs::BlendFactor::DestAlpha:
-                        return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
+        auto srcfactor = Math::MakeVec(LookupFactorRGB(state.factor_source_rgb),
+                                       LookupFactorA(state.factor_source_a));
+        auto dstfactor = Math::MakeVec(LookupFactorRGB(state.factor_dest_rgb),
+                                       LookupFactorA(state.factor_dest_a));
 
-                    case Regs::BlendFactor::OneMinusDestAlpha:
-                        return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
+        blend_output     = EvaluateBlendEquation(source, srcfactor, dest, dstfactor, state.blend_equation_rgb);
+        blend_output.a() = EvaluateBlendEquation(source, srcfactor, dest, dstfactor, state.blend_equation_a).a();
+    } else {
+        static auto LogicOp = [](u8 src, u8 dest, Regs::LogicOp op) -> u8 {
+            switch (op) {
+            case Regs::LogicOp::Clear:
+                return 0;
 
-                    case Regs::BlendFactor::ConstantColor:
-                        return Math::Vec3<u8>(output_merger.blend_const.r, output_merger.blend_const.g, output_merger.blend_const.b);
+            case Regs::LogicOp::And:
+                return src & dest;
 
-                    case Regs::BlendFactor::OneMinusConstantColor:
-                        return Math::Vec3<u8>(255 - output_merger.blend_const.r, 255 - output_merger.blend_const.g, 255 - output_merger.blend_const.b);
+            case Regs::LogicOp::AndReverse:
+                return src & ~dest;
 
-                    case Regs::BlendFactor::ConstantAlpha:
-                        return Math::Vec3<u8>(output_merger.blend_const.a, output_merger.blend_const.a, output_merger.blend_const.a);
+            case Regs::LogicOp::Copy:
+                return src;
 
-                    case Regs::BlendFactor::OneMinusConstantAlpha:
-                        return Math::Vec3<u8>(255 - output_merger.blend_const.a, 255 - output_merger.blend_const.a, 255 - output_merger.blend_const.a);
+            case Regs::LogicOp::Set:
+                return 255;
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
+            case Regs::LogicOp::CopyInverted:
+                return ~src;
 
-                auto LookupFactorA = [&](Regs::BlendFactor factor) -> u8 {
-                    switch (factor) {
-                    case Regs::BlendFactor::Zero:
-                        return 0;
+            case Regs::LogicOp::NoOp:
+                return dest;
 
-                    case Regs::BlendFactor::One:
-                        return 255;
+            case Regs::LogicOp::Invert:
+                return ~dest;
 
-                    case Regs::BlendFactor::SourceAlpha:
-                        return combiner_output.a();
+            case Regs::LogicOp::Nand:
+                return ~(src & dest);
 
-                    case Regs::BlendFactor::OneMinusSourceAlpha:
-                        return 255 - combiner_output.a();
+            case Regs::LogicOp::Or:
+                return src | dest;
 
-                    case Regs::BlendFactor::DestAlpha:
-                        return dest.a();
+            case Regs::LogicOp::Nor:
+                return ~(src | dest);
 
-                    case Regs::BlendFactor::OneMinusDestAlpha:
-                        return 255 - dest.a();
+            case Regs::LogicOp::Xor:
+                return src ^ dest;
 
-                    case Regs::BlendFactor::ConstantAlpha:
-                        return output_merger.blend_const.a;
+            case Regs::LogicOp::Equiv:
+                return ~(src ^ dest);
 
-                    case Regs::BlendFactor::OneMinusConstantAlpha:
-                        return 255 - output_merger.blend_const.a;
+            case Regs::LogicOp::AndInverted:
+                return ~src & dest;
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
-
-                static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
-                                                       const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
-                                                       Regs::BlendEquation equation) {
-                    Math::Vec4<int> result;
-
-                    auto src_result = (src  *  srcfactor).Cast<int>();
-                    auto dst_result = (dest * destfactor).Cast<int>();
-
-                    switch (equation) {
-                    case Regs::BlendEquation::Add:
-                        result = (src_result + dst_result) / 255;
-                        break;
-
-                    case Regs::BlendEquation::Subtract:
-                        result = (src_result - dst_result) / 255;
-                        break;
-
-                    case Regs::BlendEquation::ReverseSubtract:
-                        result = (dst_result - src_result) / 255;
-                        break;
-
-                    // TODO: How do these two actually work?
-                    //       OpenGL doesn't include the blend factors in the min/max computations,
-                    //       but is this what the 3DS actually does?
-                    case Regs::BlendEquation::Min:
-                        result.r() = std::min(src.r(), dest.r());
-                        result.g() = std::min(src.g(), dest.g());
-                        result.b() = std::min(src.b(), dest.b());
-                        result.a() = std::min(src.a(), dest.a());
-                        break;
-
-                    case Regs::BlendEquation::Max:
-                        result.r() = std::max(src.r(), dest.r());
-                        result.g() = std::max(src.g(), dest.g());
-                        result.b() = std::max(src.b(), dest.b());
-                        result.a() = std::max(src.a(), dest.a());
-                        break;
-
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
-                        UNIMPLEMENTED();
-                    }
+            case Regs::LogicOp::OrReverse:
+                return src | ~dest;
+
+            case Regs::LogicOp::OrInverted:
+                return ~src | dest;
+            }
+        };
+
+        blend_output = Math::MakeVec(
+            LogicOp(source.r(), dest.r(), state.logic_op),
+            LogicOp(source.g(), dest.g(), state.logic_op),
+            LogicOp(source.b(), dest.b(), state.logic_op),
+            LogicOp(source.a(), dest.a(), state.logic_op));
+    }
+
+    return {
+        state.red_enable   ? blend_output.r() : dest.r(),
+        state.green_enable ? blend_output.g() : dest.g(),
+        state.blue_enable  ? blend_output.b() : dest.b(),
+        state.alpha_enable ? blend_output.a() : dest.a()
+    };
+}
+
+#ifdef RASTERIZER_SSE2
+/// Copies the alpha of each of four packed RGBA8 colors into all of its components
+static __m128i BroadcastAlpha(__m128i colors) {
+    const __m128i alpha = _mm_srli_epi32(colors, 24);
+    const __m128i alpha2 = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+    return _mm_or_si128(alpha2, _mm_slli_epi32(alpha2, 16));
+}
+
+/// Returns the given blend factor for four packed RGBA8 pixels, see LookupFactorRGB in BlendPixel
+static __m128i LookupBlendFactors(Regs::BlendFactor factor, __m128i source, __m128i dest, __m128i constant) {
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    switch (factor) {
+    case Regs::BlendFactor::Zero:                  return _mm_setzero_si128();
+    case Regs::BlendFactor::One:                   return ones;
+    case Regs::BlendFactor::SourceColor:           return source;
+    case Regs::BlendFactor::OneMinusSourceColor:   return _mm_xor_si128(source, ones);
+    case Regs::BlendFactor::DestColor:             return dest;
+    case Regs::BlendFactor::OneMinusDestColor:     return _mm_xor_si128(dest, ones);
+    case Regs::BlendFactor::SourceAlpha:           return BroadcastAlpha(source);
+    case Regs::BlendFactor::OneMinusSourceAlpha:   return _mm_xor_si128(BroadcastAlpha(source), ones);
+    case Regs::BlendFactor::DestAlpha:             return BroadcastAlpha(dest);
+    case Regs::BlendFactor::OneMinusDestAlpha:     return _mm_xor_si128(BroadcastAlpha(dest), ones);
+    case Regs::BlendFactor::ConstantColor:         return constant;
+    case Regs::BlendFactor::OneMinusConstantColor: return _mm_xor_si128(constant, ones);
+    case Regs::BlendFactor::ConstantAlpha:         return BroadcastAlpha(constant);
+    case Regs::BlendFactor::OneMinusConstantAlpha: return _mm_xor_si128(BroadcastAlpha(constant), ones);
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown blend factor %x", (u32)factor);
+        UNIMPLEMENTED();
+        return _mm_setzero_si128();
+    }
+}
+
+/// Divides eight 16-bit values by 255, rounding down. Exact for all 16-bit values.
+static __m128i DivideBy255(__m128i values) {
+    return _mm_srli_epi16(_mm_mulhi_epu16(values, _mm_set1_epi16((short)0x8081)), 7);
+}
+
+/// Evaluates a blend equation for four packed RGBA8 pixels, see EvaluateBlendEquation in BlendPixel
+static __m128i EvaluateBlendEquations(Regs::BlendEquation equation, __m128i source, __m128i source_factor,
+                                      __m128i dest, __m128i dest_factor) {
+    switch (equation) {
+    case Regs::BlendEquation::Min:
+        return _mm_min_epu8(source, dest);
+
+    case Regs::BlendEquation::Max:
+        return _mm_max_epu8(source, dest);
+
+    case Regs::BlendEquation::Add:
+    case Regs::BlendEquation::Subtract:
+    case Regs::BlendEquation::ReverseSubtract:
+        break;
+
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown blend equation %x", (u32)equation);
+        UNIMPLEMENTED();
+        return source;
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    __m128i results[2];
+    for (int half = 0; half < 2; ++half) {
+        // Two pixels at a time, with 16 bits per component
+        auto widen = [&](__m128i colors) {
+            return half == 0 ? _mm_unpacklo_epi8(colors, zero) : _mm_unpackhi_epi8(colors, zero);
+        };
+        const __m128i source_result = _mm_mullo_epi16(widen(source), widen(source_factor));
+        const __m128i dest_result = _mm_mullo_epi16(widen(dest), widen(dest_factor));
+
+        // Saturating arithmetic clamps the result like BlendPixel does: sums of 255 * 255 and more
+        // end up above 255 after the division, which packing saturates, and differences below
+        // zero end up as zero
+        __m128i result;
+        if (equation == Regs::BlendEquation::Add) {
+            result = _mm_adds_epu16(source_result, dest_result);
+        } else if (equation == Regs::BlendEquation::Subtract) {
+            result = _mm_subs_epu16(source_result, dest_result);
+        } else {
+            result = _mm_subs_epu16(dest_result, source_result);
+        }
+        results[half] = DivideBy255(result);
+    }
+    return _mm_packus_epi16(results[0], results[1]);
+}
+
+/// Applies a logic op to four packed RGBA8 pixels, see LogicOp in BlendPixel
+static __m128i EvaluateLogicOps(Regs::LogicOp op, __m128i source, __m128i dest) {
+    const __m128i ones = _mm_set1_epi32(-1);
+
+    switch (op) {
+    case Regs::LogicOp::Clear:        return _mm_setzero_si128();
+    case Regs::LogicOp::And:          return _mm_and_si128(source, dest);
+    case Regs::LogicOp::AndReverse:   return _mm_andnot_si128(dest, source);
+    case Regs::LogicOp::Copy:         return source;
+    case Regs::LogicOp::Set:          return ones;
+    case Regs::LogicOp::CopyInverted: return _mm_xor_si128(source, ones);
+    case Regs::LogicOp::NoOp:         return dest;
+    case Regs::LogicOp::Invert:       return _mm_xor_si128(dest, ones);
+    case Regs::LogicOp::Nand:         return _mm_xor_si128(_mm_and_si128(source, dest), ones);
+    case Regs::LogicOp::Or:           return _mm_or_si128(source, dest);
+    case Regs::LogicOp::Nor:          return _mm_xor_si128(_mm_or_si128(source, dest), ones);
+    case Regs::LogicOp::Xor:          return _mm_xor_si128(source, dest);
+    case Regs::LogicOp::Equiv:        return _mm_xor_si128(_mm_xor_si128(source, dest), ones);
+    case Regs::LogicOp::AndInverted:  return _mm_andnot_si128(source, dest);
+    case Regs::LogicOp::OrReverse:    return _mm_or_si128(source, _mm_xor_si128(dest, ones));
+    case Regs::LogicOp::OrInverted:   return _mm_or_si128(_mm_xor_si128(source, ones), dest);
+    }
+    return source;
+}
+
+/// Vectorized BlendPixel for four packed RGBA8 pixels, with the same results
+static __m128i BlendPixels(const DrawState& state, __m128i source, __m128i dest) {
+    const __m128i alpha_mask = _mm_set1_epi32(0xFF000000);
+    __m128i blend_output;
+
+    if (state.alphablend_enable) {
+        u32 packed_constant;
+        std::memcpy(&packed_constant, &state.blend_const, sizeof(packed_constant));
+        const __m128i constant = _mm_set1_epi32(packed_constant);
+
+        // Color and alpha factors are only looked up separately if they differ
+        auto LookupFactors = [&](Regs::BlendFactor factor_rgb, Regs::BlendFactor factor_a) {
+            const __m128i factors = LookupBlendFactors(factor_rgb, source, dest, constant);
+            if (factor_a == factor_rgb)
+                return factors;
+            const __m128i alpha_factors = LookupBlendFactors(factor_a, source, dest, constant);
+            return _mm_or_si128(_mm_andnot_si128(alpha_mask, factors), _mm_and_si128(alpha_mask, alpha_factors));
+        };
+        const __m128i source_factor = LookupFactors(state.factor_source_rgb, state.factor_source_a);
+        const __m128i dest_factor = LookupFactors(state.factor_dest_rgb, state.factor_dest_a);
+
+        blend_output = EvaluateBlendEquations(state.blend_equation_rgb, source, source_factor, dest, dest_factor);
+        if (state.blend_equation_a != state.blend_equation_rgb) {
+            const __m128i alpha_output = EvaluateBlendEquations(state.blend_equation_a, source, source_factor,
+                                                                dest, dest_factor);
+            blend_output = _mm_or_si128(_mm_andnot_si128(alpha_mask, blend_output),
+                                        _mm_and_si128(alpha_mask, alpha_output));
+        }
+    } else {
+        blend_output = EvaluateLogicOps(state.logic_op, source, dest);
+    }
+
+    const __m128i write_mask = _mm_set1_epi32((state.red_enable   ? 0x000000FF : 0) |
+                                              (state.green_enable ? 0x0000FF00 : 0) |
+                                              (state.blue_enable  ? 0x00FF0000 : 0) |
+                                              (state.alpha_enable ? 0xFF000000 : 0));
+    return _mm_or_si128(_mm_and_si128(write_mask, blend_output), _mm_andnot_si128(write_mask, dest));
+}
+#endif
+
+/**
+ * Pixels of a row which have passed all tests, queued up so that the blending stage can process
+ * them together. Must be flushed before any of their framebuffer contents are read again.
+ */
+struct BlendQueue {
+    static const int SIZE = 4;
+
+    int x[SIZE];
+    int y[SIZE];
+    Math::Vec4<u8> colors[SIZE];
+    int count = 0;
+
+    void Push(int pixel_x, int pixel_y, const Math::Vec4<u8>& color) {
+        x[count] = pixel_x;
+        y[count] = pixel_y;
+        colors[count] = color;
+        ++count;
+    }
+
+    /// Blends the queued pixels with the framebuffer contents and writes the results
+    void Flush(const DrawState& state, const FramebufferAccessor& framebuffer) {
+        if (count == 0)
+            return;
+
+#ifdef RASTERIZER_SSE2
+        Math::Vec4<u8> dest[SIZE]{};
+        for (int i = 0; i < count; ++i)
+            dest[i] = framebuffer.GetPixel(x[i], y[i]);
+
+        static_assert(sizeof(colors) == sizeof(__m128i), "BlendQueue must hold four RGBA8 colors");
+        __m128i source_pixels, dest_pixels;
+        std::memcpy(&source_pixels, colors, sizeof(source_pixels));
+        std::memcpy(&dest_pixels, dest, sizeof(dest_pixels));
+
+        const __m128i result_pixels = BlendPixels(state, source_pixels, dest_pixels);
+        Math::Vec4<u8> results[SIZE];
+        std::memcpy(results, &result_pixels, sizeof(results));
+
+        for (int i = 0; i < count; ++i)
+            framebuffer.DrawPixel(x[i], y[i], results[i]);
+#else
+        for (int i = 0; i < count; ++i)
+            framebuffer.DrawPixel(x[i], y[i], BlendPixel(state, colors[i], framebuffer.GetPixel(x[i], y[i])));
+#endif
+        count = 0;
+    }
+};
+
+/**
+ * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
+ * culling via recursion. Only pixels whose centers lie inside the given rectangle are drawn.
+ */
+static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
+                                    const VertexShader::OutputVertex& v1,
+                                    const VertexShader::OutputVertex& v2,
+                                    const ScissorRect& rect,
+                                    bool reversed = false)
+{
+    const DrawState& state = draw_state;
+    Common::Profiling::ScopeTimer timer(rasterization_category);
+
+    // vertex positions in rasterizer coordinates
+    static auto FloatToFix = [](float24 flt) {
+        // TODO: Rounding here is necessary to prevent garbage pixels at
+        //       triangle borders. Is it that the correct solution, though?
+        return Fix12P4(static_cast<unsigned short>(round(flt.ToFloat32() * 16.0f)));
+    };
+    static auto ScreenToRasterizerCoordinates = [](const Math::Vec3<float24>& vec) {
+        return Math::Vec3<Fix12P4>{FloatToFix(vec.x), FloatToFix(vec.y), FloatToFix(vec.z)};
+    };
+
+    Math::Vec3<Fix12P4> vtxpos[3]{ ScreenToRasterizerCoordinates(v0.screenpos),
+                                   ScreenToRasterizerCoordinates(v1.screenpos),
+                                   ScreenToRasterizerCoordinates(v2.screenpos) };
+
+    if (state.cull_mode == Regs::CullMode::KeepAll) {
+        // Make sure we always end up with a triangle wound counter-clockwise
+        if (!reversed && SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
+            ProcessTriangleInternal(v0, v2, v1, rect, true);
+            return;
+        }
+    } else {
+        if (!reversed && state.cull_mode == Regs::CullMode::KeepClockWise) {
+            // Reverse vertex order and use the CCW code path.
+            ProcessTriangleInternal(v0, v2, v1, rect, true);
+            return;
+        }
+
+        // Cull away triangles which are wound clockwise.
+        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
+            return;
+    }
+
+    // TODO: Proper scissor rect test!
+    u16 min_x = std::min({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
+    u16 min_y = std::min({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+    u16 max_x = std::max({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
+    u16 max_y = std::max({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+
+    min_x &= Fix12P4::IntMask();
+    min_y &= Fix12P4::IntMask();
+    max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
+
+    min_x = static_cast<u16>(std::max({ (int)min_x, rect.min_x, state.viewport_min_x }));
+    min_y = static_cast<u16>(std::max({ (int)min_y, rect.min_y, state.viewport_min_y }));
+    max_x = static_cast<u16>(std::min({ (int)max_x, rect.max_x, state.viewport_max_x }));
+    max_y = static_cast<u16>(std::min({ (int)max_y, rect.max_y, state.viewport_max_y }));
+
+    // Triangle filling rules: Pixels on the right-sided edge or on flat bottom edges are not
+    // drawn. Pixels on any other triangle border are drawn. This is implemented with three bias
+    // values which are added to the barycentric coordinates w0, w1 and w2, respectively.
+    // NOTE: These are the PSP filling rules. Not sure if the 3DS uses the same ones...
+    auto IsRightSideOrFlatBottomEdge = [](const Math::Vec2<Fix12P4>& vtx,
+                                          const Math::Vec2<Fix12P4>& line1,
+                                          const Math::Vec2<Fix12P4>& line2)
+    {
+        if (line1.y == line2.y) {
+            // just check if vertex is above us => bottom line parallel to x-axis
+            return vtx.y < line1.y;
+        } else {
+            // check if vertex is on our left => right side
+            // TODO: Not sure how likely this is to overflow
+            return (int)vtx.x < (int)line1.x + ((int)line2.x - (int)line1.x) * ((int)vtx.y - (int)line1.y) / ((int)line2.y - (int)line1.y);
+        }
+    };
+    int bias0 = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
+    int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
+    int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+
+    const auto& textures = state.textures;
+
+    // Screen space area of the triangle in pixels
+    const float screen_area = std::abs(SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy())) / (2.f * 16 * 16);
+    const Math::Vec2<float24>* tex_coords[3][3] = {
+        { &v0.tc0, &v1.tc0, &v2.tc0 },
+        { &v0.tc1, &v1.tc1, &v2.tc1 },
+        { &v0.tc2, &v1.tc2, &v2.tc2 },
+    };
+
+    std::shared_ptr<const TextureCache::DecodedTexture> decoded_textures[3];
+    Sampler::TextureSampler samplers[3];
+    for (int i = 0; i < 3; ++i) {
+        if (!textures[i].enabled)
+            continue;
+
+        decoded_textures[i] = TextureCache::GetTexture({ textures[i].enabled, textures[i].config, textures[i].format });
+        const bool minified = Sampler::IsMinified(textures[i].config, *tex_coords[i][0],
+                                                  *tex_coords[i][1], *tex_coords[i][2], screen_area);
+        Sampler::Setup(samplers[i], textures[i].config, decoded_textures[i].get(), minified);
+    }
+
+    const bool stencil_action_enable = state.stencil_action_enable;
+
+    const FramebufferAccessor framebuffer(g_state.regs);
+    BlendQueue blend_queue;
+
+    // Without alpha testing, texturing and color combining can't discard pixels, so the depth and
+    // stencil tests can run first and skip them for pixels which are discarded anyway.
+    const bool early_depth_stencil = !state.alpha_test_enable;
+
+    const float depth_scale = static_cast<float>((1u << state.num_depth_bits) - 1);
+    const float z0 = v0.screenpos[2].ToFloat32();
+    const float z1 = v1.screenpos[2].ToFloat32();
+    const float z2 = v2.screenpos[2].ToFloat32();
+
+    // Blocks failing the depth test as a whole can only be skipped if the failing pixels have no
+    // side effects, which they do with stencil actions enabled
+    const bool hiz_test_enable = state.depth_test_enable && !stencil_action_enable &&
+                                 IsHierarchicalZCompareFunc(state.depth_test_func);
+    const bool hiz_update_enable = state.depth_test_enable && state.depth_write_enable;
+
+    // Range of the depth values written to the current block
+    u32 written_min_z, written_max_z;
+
+    // Stencil and depth tests of a single pixel, including their buffer updates. Returns false if
+    // the pixel is discarded.
+    auto DepthStencilTest = [&](u16 x, u16 y, u32 z) -> bool {
+        u8 old_stencil = 0;
+        if (stencil_action_enable) {
+            old_stencil = framebuffer.GetStencil(x >> 4, y >> 4);
+            u8 dest = old_stencil & state.stencil_mask;
+            u8 ref = state.stencil_reference_value & state.stencil_mask;
+
+            bool pass = false;
+            switch (state.stencil_test_func) {
+            case Regs::CompareFunc::Never:
+                pass = false;
+                break;
+
+            case Regs::CompareFunc::Always:
+                pass = true;
+                break;
+
+            case Regs::CompareFunc::Equal:
+                pass = (ref == dest);
+                break;
+
+            case Regs::CompareFunc::NotEqual:
+                pass = (ref != dest);
+                break;
+
+            case Regs::CompareFunc::LessThan:
+                pass = (ref < dest);
+                break;
+
+            case Regs::CompareFunc::LessThanOrEqual:
+                pass = (ref <= dest);
+                break;
+
+            case Regs::CompareFunc::GreaterThan:
+                pass = (ref > dest);
+                break;
+
+            case Regs::CompareFunc::GreaterThanOrEqual:
+                pass = (ref >= dest);
+                break;
+            }
+
+            if (!pass) {
+                u8 new_stencil = PerformStencilAction(state.stencil_fail_action, old_stencil, state.stencil_replacement_value);
+                framebuffer.SetStencil(x >> 4, y >> 4, new_stencil);
+                return false;
+            }
+        }
+
+        // TODO: Does depth indeed only get written even if depth testing is enabled?
+        if (state.depth_test_enable) {
+            u32 ref_z = framebuffer.GetDepth(x >> 4, y >> 4);
 
-                    return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
-                                    MathUtil::Clamp(result.g(), 0, 255),
-                                    MathUtil::Clamp(result.b(), 0, 255),
-                                    MathUtil::Clamp(result.a(), 0, 255));
-                };
+            bool pass = false;
 
-                auto srcfactor = Math::MakeVec(LookupFactorRGB(params.factor_source_rgb),
-                                               LookupFactorA(params.factor_source_a));
-                auto dstfactor = Math::MakeVec(LookupFactorRGB(params.factor_dest_rgb),
-                                               LookupFactorA(params.factor_dest_a));
+            switch (state.depth_test_func) {
+            case Regs::CompareFunc::Never:
+                pass = false;
+                break;
 
-                blend_output     = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_rgb);
-                blend_output.a() = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_a).a();
-            } else {
-                static auto LogicOp = [](u8 src, u8 dest, Regs::LogicOp op) -> u8 {
-                    switch (op) {
-                    case Regs::LogicOp::Clear:
-                        return 0;
+            case Regs::CompareFunc::Always:
+                pass = true;
+                break;
 
-                    case Regs::LogicOp::And:
-                        return src & dest;
+            case Regs::CompareFunc::Equal:
+                pass = z == ref_z;
+                break;
+
+            case Regs::CompareFunc::NotEqual:
+                pass = z != ref_z;
+                break;
+
+            case Regs::CompareFunc::LessThan:
+                pass = z < ref_z;
+                break;
+
+            case Regs::CompareFunc::LessThanOrEqual:
+                pass = z <= ref_z;
+                break;
+
+            case Regs::CompareFunc::GreaterThan:
+                pass = z > ref_z;
+                break;
+
+            case Regs::CompareFunc::GreaterThanOrEqual:
+                pass = z >= ref_z;
+                break;
+            }
+
+            if (!pass) {
+                if (stencil_action_enable) {
+                    u8 new_stencil = PerformStencilAction(state.depth_fail_action, old_stencil, state.stencil_replacement_value);
+                    framebuffer.SetStencil(x >> 4, y >> 4, new_stencil);
+                }
+                return false;
+            }
 
-                    case Regs::LogicOp::AndReverse:
-                        return src & ~dest;
+            if (state.depth_write_enable) {
+                framebuffer.SetDepth(x >> 4, y >> 4, z);
+                written_min_z = std::min(written_min_z, z);
+                written_max_z = std::max(written_max_z, z);
+            }
 
-                    case Regs::LogicOp::Copy:
-                        return src;
+            if (stencil_action_enable) {
+                // TODO: What happens if stencil testing is enabled, but depth testing is not? Will stencil get updated anyway?
+                u8 new_stencil = PerformStencilAction(state.depth_pass_action, old_stencil, state.stencil_replacement_value);
+                framebuffer.SetStencil(x >> 4, y >> 4, new_stencil);
+            }
+        }
 
-                    case Regs::LogicOp::Set:
-                        return 255;
+        return true;
+    };
 
-                    case Regs::LogicOp::CopyInverted:
-                        return ~src;
+    // Edge functions are linear in screen space, so they are stepped incrementally instead of
+    // being recomputed for every pixel. The bounding box is traversed in blocks of
+    // BLOCK_SIZE x BLOCK_SIZE pixels: Blocks outside of any edge are skipped entirely, and the
+    // per-pixel coverage test is skipped for blocks which are inside of all edges.
+    const EdgeFunction edge0(vtxpos[1].xy(), vtxpos[2].xy(), bias0);
+    const EdgeFunction edge1(vtxpos[2].xy(), vtxpos[0].xy(), bias1);
+    const EdgeFunction edge2(vtxpos[0].xy(), vtxpos[1].xy(), bias2);
 
-                    case Regs::LogicOp::NoOp:
-                        return dest;
+    const AttributePlanes planes(v0, v1, v2, edge0, edge1, edge2);
 
-                    case Regs::LogicOp::Invert:
-                        return ~dest;
+    // Enter rasterization loop, starting at the center of the topleft bounding box corner. Blocks
+    // are aligned to a grid of BLOCK_SIZE pixels, which the hierarchical Z buffer is based on.
+    // TODO: Not sure if looping through x first might be faster
+    const int grid_min_x = min_x & ~(BLOCK_SIZE * 0x10 - 1);
+    const int grid_min_y = min_y & ~(BLOCK_SIZE * 0x10 - 1);
+    for (int grid_y = grid_min_y; grid_y < max_y; grid_y += BLOCK_SIZE * 0x10) {
+        const int block_y = std::max<int>(grid_y, min_y) + 8;
+        for (int grid_x = grid_min_x; grid_x < max_x; grid_x += BLOCK_SIZE * 0x10) {
+            const int block_x = std::max<int>(grid_x, min_x) + 8;
+            const int block_w0 = edge0.Evaluate(block_x, block_y);
+            const int block_w1 = edge1.Evaluate(block_x, block_y);
+            const int block_w2 = edge2.Evaluate(block_x, block_y);
+
+            if (edge0.BlockMax(block_w0) < 0 || edge1.BlockMax(block_w1) < 0 || edge2.BlockMax(block_w2) < 0)
+                continue;
 
-                    case Regs::LogicOp::Nand:
-                        return ~(src & dest);
+            DepthRange* depth_range = (hiz_test_enable || hiz_update_enable) ?
+                                      FindDepthRange(grid_x, grid_y) : nullptr;
+
+            if (hiz_test_enable && depth_range != nullptr) {
+                if (!depth_range->valid)
+                    ComputeDepthRange(*depth_range, framebuffer, grid_x, grid_y);
+
+                // Depth is linear in screen space, so its extremes over the block are at its
+                // corners. Pixels inside the triangle can't exceed the range of its vertices.
+                const int corner_offset = BLOCK_SIZE - 1;
+                const int wsum = block_w0 + block_w1 + block_w2;
+                float corner_min_z = std::numeric_limits<float>::max();
+                float corner_max_z = std::numeric_limits<float>::lowest();
+                for (int corner = 0; corner < 4; ++corner) {
+                    const int dx = (corner & 1) ? corner_offset : 0;
+                    const int dy = (corner & 2) ? corner_offset : 0;
+                    const int w0 = block_w0 + edge0.step_x * dx + edge0.step_y * dy;
+                    const int w1 = block_w1 + edge1.step_x * dx + edge1.step_y * dy;
+                    const int w2 = block_w2 + edge2.step_x * dx + edge2.step_y * dy;
+                    const float z = (z0 * w0 + z1 * w1 + z2 * w2) * depth_scale / wsum;
+                    corner_min_z = std::min(corner_min_z, z);
+                    corner_max_z = std::max(corner_max_z, z);
+                }
 
-                    case Regs::LogicOp::Or:
-                        return src | dest;
+                // Allow for the rounding differences to the per-pixel computation
+                const float margin = depth_scale * HIZ_RELATIVE_MARGIN + 1.0f;
+                const float min_z = std::max(corner_min_z, std::min({ z0, z1, z2 }) * depth_scale) - margin;
+                const float max_z = std::min(corner_max_z, std::max({ z0, z1, z2 }) * depth_scale) + margin;
 
-                    case Regs::LogicOp::Nor:
-                        return ~(src | dest);
+                if (BlockFailsDepthTest(state.depth_test_func, min_z, max_z, *depth_range))
+                    continue;
+            }
 
-                    case Regs::LogicOp::Xor:
-                        return src ^ dest;
+            const bool block_covered = edge0.BlockMin(block_w0) >= 0 &&
+                                       edge1.BlockMin(block_w1) >= 0 &&
+                                       edge2.BlockMin(block_w2) >= 0;
+
+            const int block_end_x = std::min<int>(max_x, grid_x + BLOCK_SIZE * 0x10);
+            const int block_end_y = std::min<int>(max_y, grid_y + BLOCK_SIZE * 0x10);
+
+            written_min_z = std::numeric_limits<u32>::max();
+            written_max_z = 0;
+
+            // Attribute values are only stepped within a block, so rounding errors can't accumulate
+            float row_attributes[NUM_INTERPOLATED_ATTRIBUTES];
+            planes.Evaluate(block_w0, block_w1, block_w2, row_attributes);
+
+            int row_w0 = block_w0, row_w1 = block_w1, row_w2 = block_w2;
+            for (u16 y = block_y; y < block_end_y; y += 0x10,
+                 row_w0 += edge0.step_y, row_w1 += edge1.step_y, row_w2 += edge2.step_y,
+                 planes.StepY(row_attributes)) {
+
+                // Barycentric coordinates w0, w1 and w2 of the current pixel
+                int w0 = row_w0, w1 = row_w1, w2 = row_w2;
+                float attributes[NUM_INTERPOLATED_ATTRIBUTES];
+                std::memcpy(attributes, row_attributes, sizeof(attributes));
+                for (u16 x = block_x; x < block_end_x; x += 0x10,
+                     w0 += edge0.step_x, w1 += edge1.step_x, w2 += edge2.step_x,
+                     planes.StepX(attributes)) {
+
+                    int wsum = w0 + w1 + w2;
+
+                    // If current pixel is not covered by the current primitive
+                    if (!block_covered && (w0 < 0 || w1 < 0 || w2 < 0))
+                        continue;
+
+                    u32 z = 0;
+                    if (state.depth_test_enable)
+                        z = (u32)((z0 * w0 + z1 * w1 + z2 * w2) * depth_scale / wsum);
+
+                    if (early_depth_stencil && !DepthStencilTest(x, y, z))
+                        continue;
+
+                    // Perspective correct attribute interpolation:
+                    // Attribute values cannot be calculated by simple linear interpolation since
+                    // they are not linear in screen space. For example, when interpolating a
+                    // texture coordinate across two vertices, something simple like
+                    //     u = (u0*w0 + u1*w1)/(w0+w1)
+                    // will not work. However, the attribute value divided by the
+                    // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
+                    // in screenspace. Hence, we can linearly interpolate these two independently and
+                    // calculate the interpolated attribute by dividing the results.
+                    // I.e.
+                    //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
+                    //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
+                    //     u = u_over_w / one_over_w
+                    //
+                    // The vertex attributes have been divided by w by the clipper already, and
+                    // their planes step the numerators of these fractions from pixel to pixel.
+                    const float interpolated_w = 1.0f / attributes[AttributeInverseW];
+                    auto GetInterpolatedAttribute = [&](InterpolatedAttribute attr) {
+                        return float24::FromFloat32(attributes[attr] * interpolated_w);
+                    };
+
+                    Math::Vec4<u8> primary_color{
+                        (u8)(GetInterpolatedAttribute(AttributeColorR).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(AttributeColorG).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(AttributeColorB).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(AttributeColorA).ToFloat32() * 255)
+                    };
+
+                    Math::Vec2<float24> uv[3];
+                    uv[0].u() = GetInterpolatedAttribute(AttributeTc0U);
+                    uv[0].v() = GetInterpolatedAttribute(AttributeTc0V);
+                    uv[1].u() = GetInterpolatedAttribute(AttributeTc1U);
+                    uv[1].v() = GetInterpolatedAttribute(AttributeTc1V);
+                    uv[2].u() = GetInterpolatedAttribute(AttributeTc2U);
+                    uv[2].v() = GetInterpolatedAttribute(AttributeTc2V);
+
+                    Math::Vec4<u8> texture_color[3]{};
+                    for (int i = 0; i < 3; ++i) {
+                        if (!textures[i].enabled)
+                            continue;
+
+                        DEBUG_ASSERT(0 != textures[i].config.address);
+
+                        texture_color[i] = Sampler::Sample(samplers[i], uv[i]);
+#if PICA_DUMP_TEXTURES
+                        DebugUtils::DumpTexture(textures[i].config, Memory::GetPhysicalPointer(textures[i].config.GetPhysicalAddress()));
+#endif
+                    }
 
-                    case Regs::LogicOp::Equiv:
-                        return ~(src ^ dest);
+                    // Texture environment - consists of 6 stages of color and alpha combining.
+                    //
+                    // Color combiners take three input color values from some source (e.g. interpolated
+                    // vertex color, texture color, previous stage, etc), perform some very simple
+                    // operations on each of them (e.g. inversion) and then calculate the output color
+                    // with some basic arithmetic. Alpha combiners can be configured separately but work
+                    // analogously.
+                    Math::Vec4<u8> tev_inputs[Tev::NUM_INPUTS];
+                    tev_inputs[Tev::InputPrimaryColor] = primary_color;
+                    tev_inputs[Tev::InputZero] = { 0, 0, 0, 0 };
+                    tev_inputs[Tev::InputTexture0] = texture_color[0];
+                    tev_inputs[Tev::InputTexture1] = texture_color[1];
+                    tev_inputs[Tev::InputTexture2] = texture_color[2];
+                    tev_inputs[Tev::InputPreviousBuffer] = state.combiner_buffer_color;
+                    tev_inputs[Tev::InputPrevious] = { 0, 0, 0, 0 };
+
+                    const Math::Vec4<u8> combiner_output = Tev::Evaluate(tev_inputs);
+
+                    // TODO: Does alpha testing happen before or after stencil?
+                    if (state.alpha_test_enable) {
+                        bool pass = false;
+
+                        switch (state.alpha_test_func) {
+                        case Regs::CompareFunc::Never:
+                            pass = false;
+                            break;
+
+                        case Regs::CompareFunc::Always:
+                            pass = true;
+                            break;
+
+                        case Regs::CompareFunc::Equal:
+                            pass = combiner_output.a() == state.alpha_test_ref;
+                            break;
+
+                        case Regs::CompareFunc::NotEqual:
+                            pass = combiner_output.a() != state.alpha_test_ref;
+                            break;
+
+                        case Regs::CompareFunc::LessThan:
+                            pass = combiner_output.a() < state.alpha_test_ref;
+                            break;
+
+                        case Regs::CompareFunc::LessThanOrEqual:
+                            pass = combiner_output.a() <= state.alpha_test_ref;
+                            break;
+
+                        case Regs::CompareFunc::GreaterThan:
+                            pass = combiner_output.a() > state.alpha_test_ref;
+                            break;
+
+                        case Regs::CompareFunc::GreaterThanOrEqual:
+                            pass = combiner_output.a() >= state.alpha_test_ref;
+                            break;
+                        }
 
-                    case Regs::LogicOp::AndInverted:
-                        return ~src & dest;
+                        if (!pass)
+                            continue;
+                    }
 
-                    case Regs::LogicOp::OrReverse:
-                        return src | ~dest;
+                    if (!early_depth_stencil && !DepthStencilTest(x, y, z))
+                        continue;
 
-                    case Regs::LogicOp::OrInverted:
-                        return ~src | dest;
+                    if (state.color_replace) {
+                        framebuffer.DrawPixel(x >> 4, y >> 4, combiner_output);
+                        continue;
                     }
-                };
 
-                blend_output = Math::MakeVec(
-                    LogicOp(combiner_output.r(), dest.r(), output_merger.logic_op),
-                    LogicOp(combiner_output.g(), dest.g(), output_merger.logic_op),
-                    LogicOp(combiner_output.b(), dest.b(), output_merger.logic_op),
-                    LogicOp(combiner_output.a(), dest.a(), output_merger.logic_op));
+                    blend_queue.Push(x >> 4, y >> 4, combiner_output);
+                    if (blend_queue.count == BlendQueue::SIZE)
+                        blend_queue.Flush(state, framebuffer);
+                }
             }
 
-            const Math::Vec4<u8> result = {
-                output_merger.red_enable   ? blend_output.r() : dest.r(),
-                output_merger.green_enable ? blend_output.g() : dest.g(),
-                output_merger.blue_enable  ? blend_output.b() : dest.b(),
-                output_merger.alpha_enable ? blend_output.a() : dest.a()
-            };
+            blend_queue.Flush(state, framebuffer);
+
+            // Widening the range keeps it conservative without having to read the block again
+            if (depth_range != nullptr && depth_range->valid && written_min_z <= written_max_z) {
+                depth_range->min = std::min(depth_range->min, written_min_z);
+                depth_range->max = std::max(depth_range->max, written_max_z);
+            }
+        }
+    }
+}
+
+// Tiled rasterization: Triangles are binned into screen-space tiles of TILE_SIZE x TILE_SIZE
+// pixels. When the batch is flushed, each tile is rasterized by one thread at a time, drawing
+// the triangles overlapping it in submission order. Since no two tiles share a pixel, this
+// produces exactly the same result as rasterizing the triangles one after another.
+
+static const int TILE_SIZE = 32;
+
+struct Triangle {
+    std::array<VertexShader::OutputVertex, 3> vertices;
+};
+
+/// Triangles submitted since the last flush
+static std::vector<Triangle> triangles;
+
+/// Per-tile lists of indices into `triangles`, in submission order
+static std::vector<std::vector<u32>> tile_bins;
+static int tiles_x = 0;
+static int tiles_y = 0;
+
+/// Number of threads which rasterize the tiles of a flush, or 0 if triangles aren't binned
+static int num_tile_threads = 0;
+
+/// Index of the next tile to be picked up by any thread
+static std::atomic<int> next_tile(0);
+
+static ScissorRect GetTileRect(int tile_x, int tile_y) {
+    // Tiles along the right and top borders extend to infinity so that binning never drops
+    // pixels which the untiled code path would have drawn.
+    ScissorRect rect;
+    rect.min_x = tile_x * TILE_SIZE * 16;
+    rect.min_y = tile_y * TILE_SIZE * 16;
+    rect.max_x = (tile_x == tiles_x - 1) ? unbounded_rect.max_x : rect.min_x + TILE_SIZE * 16;
+    rect.max_y = (tile_y == tiles_y - 1) ? unbounded_rect.max_y : rect.min_y + TILE_SIZE * 16;
+    return rect;
+}
 
-            DrawPixel(x >> 4, y >> 4, result);
+/// Rasterizes tiles until none are left in the current flush
+static void RasterizeTiles() {
+    const int num_tiles = tiles_x * tiles_y;
+
+    int tile;
+    while ((tile = next_tile++) < num_tiles) {
+        const ScissorRect rect = GetTileRect(tile % tiles_x, tile / tiles_x);
+        for (u32 index : tile_bins[tile]) {
+            const auto& vertices = triangles[index].vertices;
+            ProcessTriangleInternal(vertices[0], vertices[1], vertices[2], rect);
         }
     }
 }
 
+void Init() {
+    draw_state_dirty = true;
+    num_tile_threads = std::max(Settings::values.rasterizer_threads, 0);
+}
+
+void Shutdown() {
+    num_tile_threads = 0;
+
+    std::vector<Triangle>().swap(triangles);
+    std::vector<std::vector<u32>>().swap(tile_bins);
+
+    hiz.addr = 0;
+    hiz.size = 0;
+    hiz.width = hiz.height = 0;
+    std::vector<DepthRange>().swap(hiz.ranges);
+}
+
+void BeginDraw() {
+    if (!draw_state_dirty)
+        return;
+
+    DecodeDrawState();
+    Tev::UpdatePipeline();
+    PrepareHierarchicalZ();
+    draw_state_dirty = false;
+}
+
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2) {
-    ProcessTriangleInternal(v0, v1, v2);
+    if (num_tile_threads == 0) {
+        ProcessTriangleInternal(v0, v1, v2, unbounded_rect);
+        return;
+    }
+
+    if (triangles.empty()) {
+        // Framebuffer registers can't change in the middle of a batch, so size the grid here
+        const auto& framebuffer = g_state.regs.framebuffer;
+        tiles_x = std::max<int>(1, (framebuffer.GetWidth() + TILE_SIZE - 1) / TILE_SIZE);
+        tiles_y = std::max<int>(1, (framebuffer.GetHeight() + TILE_SIZE - 1) / TILE_SIZE);
+        tile_bins.resize(tiles_x * tiles_y);
+    }
+
+    const u32 index = static_cast<u32>(triangles.size());
+    triangles.push_back({{{ v0, v1, v2 }}});
+
+    // Conservative screen-space bounding box in whole pixels. Coordinates are non-negative
+    // after clipping and viewport transformation.
+    auto ToPixel = [](float24 value) {
+        return static_cast<int>(value.ToFloat32());
+    };
+    const int min_x = ToPixel(std::min({ v0.screenpos.x, v1.screenpos.x, v2.screenpos.x }));
+    const int min_y = ToPixel(std::min({ v0.screenpos.y, v1.screenpos.y, v2.screenpos.y }));
+    const int max_x = ToPixel(std::max({ v0.screenpos.x, v1.screenpos.x, v2.screenpos.x })) + 1;
+    const int max_y = ToPixel(std::max({ v0.screenpos.y, v1.screenpos.y, v2.screenpos.y })) + 1;
+
+    const int first_tile_x = std::min(std::max(min_x, 0) / TILE_SIZE, tiles_x - 1);
+    const int first_tile_y = std::min(std::max(min_y, 0) / TILE_SIZE, tiles_y - 1);
+    const int last_tile_x = std::min(std::max(max_x, 0) / TILE_SIZE, tiles_x - 1);
+    const int last_tile_y = std::min(std::max(max_y, 0) / TILE_SIZE, tiles_y - 1);
+
+    for (int tile_y = first_tile_y; tile_y <= last_tile_y; ++tile_y)
+        for (int tile_x = first_tile_x; tile_x <= last_tile_x; ++tile_x)
+            tile_bins[tile_y * tiles_x + tile_x].push_back(index);
+}
+
+/// Drops cached textures decoded from the current render targets, which may have been drawn to
+static void InvalidateRenderTargetTextures() {
+    const auto& framebuffer = g_state.regs.framebuffer;
+    const u32 num_pixels = framebuffer.GetWidth() * framebuffer.GetHeight();
+
+    TextureCache::NotifyFlush(framebuffer.GetColorBufferPhysicalAddress(),
+                              Regs::BytesPerColorPixel(framebuffer.color_format) * num_pixels);
+
+    // The color buffer may be used as a depth buffer later on
+    NotifyFlush(framebuffer.GetColorBufferPhysicalAddress(),
+                Regs::BytesPerColorPixel(framebuffer.color_format) * num_pixels);
+    TextureCache::NotifyFlush(framebuffer.GetDepthBufferPhysicalAddress(),
+                              Regs::BytesPerDepthPixel(framebuffer.depth_format) * num_pixels);
+}
+
+void NotifyFlush(PAddr addr, u32 size) {
+    if (hiz.size != 0 && MathUtil::IntervalsIntersect(addr, size, hiz.addr, hiz.size)) {
+        for (auto& range : hiz.ranges)
+            range.valid = false;
+    }
+}
+
+void FlushTriangles() {
+    if (triangles.empty()) {
+        InvalidateRenderTargetTextures();
+        return;
+    }
+
+    next_tile = 0;
+
+    // Tiles are handed out dynamically, so pool threads which pick up their task late just find
+    // fewer tiles left
+    Common::ThreadPool& pool = Common::GetThreadPool();
+    const unsigned num_tasks = std::min<unsigned>(num_tile_threads, pool.GetWorkerCount());
+    Common::TaskGroup group;
+    for (unsigned i = 0; i < num_tasks; ++i)
+        pool.Submit(group, RasterizeTiles);
+
+    // Help out instead of idling, then wait until no pool thread touches the bins anymore
+    RasterizeTiles();
+    pool.Wait(group);
+
+    triangles.clear();
+    for (auto& bin : tile_bins)
+        bin.clear();
+
+    InvalidateRenderTargetTextures();
 }
 
 } // namespace Rasterizer
@@ -4,6 +4,13 @@
 
 #pragma once
 
+#include <array>
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "video_core/pica.h"
+
 namespace Pica {
 
 namespace VertexShader {
@@ -12,10 +19,115 @@ namespace VertexShader {
 
 namespace Rasterizer {
 
+/**
+ * Pica state read by the clipper and the rasterizer, decoded from the registers once per draw
+ * instead of being extracted from their bitfields for every triangle and pixel. It's only decoded
+ * again by BeginDraw() after registers affecting it were changed.
+ */
+struct DrawState {
+    /// Viewport transformation from clip space to screen space
+    struct Viewport {
+        float24 halfsize_x;
+        float24 offset_x;
+        float24 halfsize_y;
+        float24 offset_y;
+        float24 zscale;
+        float24 offset_z;
+    } viewport;
+
+    /// Viewport in rasterizer coordinates, which drawing is limited to
+    int viewport_min_x, viewport_min_y;
+    int viewport_max_x, viewport_max_y;
+
+    Regs::CullMode cull_mode;
+
+    struct Texture {
+        bool enabled;
+        Regs::TextureConfig config;
+        Regs::TextureFormat format;
+    };
+    std::array<Texture, 3> textures;
+    Math::Vec4<u8> combiner_buffer_color;
+
+    bool alpha_test_enable;
+    Regs::CompareFunc alpha_test_func;
+    u8 alpha_test_ref;
+
+    /// Whether the stencil test and its buffer updates run, which requires a D24S8 depth buffer
+    bool stencil_action_enable;
+    Regs::CompareFunc stencil_test_func;
+    u8 stencil_mask;
+    u8 stencil_reference_value;
+    u8 stencil_replacement_value;
+    Regs::StencilAction stencil_fail_action;
+    Regs::StencilAction depth_fail_action;
+    Regs::StencilAction depth_pass_action;
+
+    bool depth_test_enable;
+    Regs::CompareFunc depth_test_func;
+    bool depth_write_enable;
+    /// Number of bits of the depth values, or 0 if depth testing is disabled
+    unsigned num_depth_bits;
+
+    /// If false, logic blending is used
+    bool alphablend_enable;
+    Regs::BlendEquation blend_equation_rgb;
+    Regs::BlendEquation blend_equation_a;
+    Regs::BlendFactor factor_source_rgb;
+    Regs::BlendFactor factor_dest_rgb;
+    Regs::BlendFactor factor_source_a;
+    Regs::BlendFactor factor_dest_a;
+    Math::Vec4<u8> blend_const;
+    Regs::LogicOp logic_op;
+
+    bool red_enable, green_enable, blue_enable, alpha_enable;
+
+    /// Whether the TEV output is written as is, so the framebuffer doesn't need to be read for blending
+    bool color_replace;
+};
+
+/// Returns the draw state of the current draw, as decoded by BeginDraw()
+const DrawState& GetDrawState();
+
+/**
+ * Decodes the draw state again if registers affecting it were changed since the last draw. Must
+ * be called before the triangles of each draw are submitted.
+ */
+void BeginDraw();
+
+/// Marks the draw state outdated if the given register affects it. Called on register changes.
+void NotifyRegisterChanged(u32 id);
+
+/// Marks the draw state outdated, after the registers were changed as a whole
+void InvalidateDrawState();
+
+/// Starts the rasterizer worker threads if tiled rasterization is enabled in the settings
+void Init();
+
+/// Stops the rasterizer worker threads
+void Shutdown();
+
+/**
+ * Rasterizes the given triangle. With tiled rasterization enabled, the triangle is only binned
+ * into screen tiles and drawn on the next call to FlushTriangles().
+ */
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2);
 
+/**
+ * Draws all binned triangles, distributing the screen tiles across the worker threads. Must be
+ * called at the end of every draw call, since it also drops cached textures which alias the
+ * render targets.
+ */
+void FlushTriangles();
+
+/**
+ * Drops the hierarchical depth information derived from the given memory region. Must be called
+ * whenever the depth buffer may have been changed by anything but the software rasterizer.
+ */
+void NotifyFlush(PAddr addr, u32 size);
+
 } // namespace Rasterizer
 
 } // namespace Pica
@@ -0,0 +1,26 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/make_unique.h"
+#include "common/profiler_reporting.h"
+
+#include "video_core/renderer_null/renderer_null.h"
+
+RendererNull::RendererNull() {
+    hw_rasterizer = Common::make_unique<RasterizerNull>();
+}
+
+void RendererNull::SwapBuffers() {
+    auto& profiler = Common::Profiling::GetProfilingManager();
+    profiler.FinishFrame();
+    Common::Profiling::GetHLECallProfiler().FinishFrame();
+    {
+        auto aggregator = Common::Profiling::GetTimingResultsAggregator();
+        aggregator->AddFrame(profiler.GetPreviousFrameResults());
+    }
+
+    m_current_frame++;
+
+    profiler.BeginFrame();
+}
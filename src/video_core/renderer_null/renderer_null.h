@@ -0,0 +1,53 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/renderer_base.h"
+
+/// Hardware rasterizer which ignores everything, leaving all rendering to the software rasterizer.
+class RasterizerNull : public HWRasterizer {
+public:
+    void InitObjects() override {}
+    void Reset() override {}
+    u32 AddVertex(const Pica::VertexShader::OutputVertex& v) override {
+        return 0;
+    }
+    void AddIndexedTriangle(u32 v0, u32 v1, u32 v2) override {}
+    bool BeginHostShadedDraw() override {
+        return false;
+    }
+    void AddUnshadedTriangle(const Pica::VertexShader::InputVertex& v0,
+                             const Pica::VertexShader::InputVertex& v1,
+                             const Pica::VertexShader::InputVertex& v2) override {}
+    void DrawTriangles() override {}
+    void CommitFramebuffer() override {}
+    void NotifyPicaRegisterChanging(u32 id) override {}
+    void NotifyPicaRegisterChanged(u32 id) override {}
+    void NotifyPreRead(PAddr addr, u32 size) override {}
+    void NotifyFlush(PAddr addr, u32 size) override {}
+    void NotifyStateRestored() override {}
+    bool AccelerateDisplayTransfer(const GPU::DisplayTransfer::Config& config, PAddr src_addr, PAddr dst_addr) override {
+        return false;
+    }
+    bool AccelerateFill(PAddr start, PAddr end, const u8* value, u32 value_size) override {
+        return false;
+    }
+};
+
+/**
+ * Renderer which doesn't display anything and needs no graphics context, for running headless.
+ * Emulated rendering still happens in the software rasterizer, and frames are still counted and
+ * reported to the profiler.
+ */
+class RendererNull : public RendererBase {
+public:
+    RendererNull();
+
+    void SwapBuffers() override;
+    void SetWindow(EmuWindow* window) override {}
+    void Init() override {}
+    void ShutDown() override {}
+};
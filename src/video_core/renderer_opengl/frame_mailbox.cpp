@@ -0,0 +1,84 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+
+#include "video_core/renderer_opengl/frame_mailbox.h"
+
+FrameMailbox::FrameMailbox() {
+    for (auto& frame : frames)
+        free_queue.push_back(&frame);
+}
+
+FrameMailbox::Frame* FrameMailbox::GetRenderFrame() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Frame* frame;
+    if (!free_queue.empty()) {
+        frame = free_queue.front();
+        free_queue.pop_front();
+    } else {
+        // At most one frame is being presented, so with three frames one of them must be queued
+        ASSERT(!present_queue.empty());
+        frame = present_queue.front();
+        present_queue.pop_front();
+    }
+
+    return frame;
+}
+
+void FrameMailbox::ReleaseRenderFrame(Frame* frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        present_queue.push_back(frame);
+    }
+    frame_ready.notify_one();
+}
+
+FrameMailbox::Frame* FrameMailbox::TryGetPresentFrame(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (!frame_ready.wait_for(lock, timeout, [this]{ return !present_queue.empty() || interrupted; }) || interrupted) {
+        interrupted = false;
+        return nullptr;
+    }
+
+    // Older frames are outdated already, so they can be rendered to again right away
+    while (present_queue.size() > 1) {
+        free_queue.push_back(present_queue.front());
+        present_queue.pop_front();
+    }
+
+    if (presented_frame != nullptr)
+        free_queue.push_back(presented_frame);
+
+    presented_frame = present_queue.front();
+    present_queue.pop_front();
+    return presented_frame;
+}
+
+void FrameMailbox::Interrupt() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        interrupted = true;
+    }
+    frame_ready.notify_one();
+}
+
+void FrameMailbox::ReleaseFrames() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& frame : frames) {
+        if (frame.render_fence != nullptr)
+            glDeleteSync(frame.render_fence);
+        if (frame.present_fence != nullptr)
+            glDeleteSync(frame.present_fence);
+        frame.render_fence = nullptr;
+        frame.present_fence = nullptr;
+
+        frame.render_framebuffer.Release();
+        frame.color.Release();
+        frame.width = frame.height = 0;
+    }
+}
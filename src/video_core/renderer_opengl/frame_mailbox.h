@@ -0,0 +1,80 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "common/common_types.h"
+
+#include "video_core/renderer_opengl/generated/gl_3_2_core.h"
+#include "video_core/renderer_opengl/gl_resource_manager.h"
+
+/**
+ * Triple-buffered mailbox handing finished frames from the emulation thread to the presentation
+ * thread. The emulation thread never waits for presentation: if no frame is free, the oldest
+ * frame which hasn't been presented yet is dropped and rendered to again. The presentation thread
+ * always picks the newest finished frame.
+ *
+ * Frame textures and fences are shared between the two threads' GL contexts. Framebuffer objects
+ * are not, so each thread attaches the textures to framebuffers of its own.
+ */
+class FrameMailbox {
+public:
+    static const size_t NUM_FRAMES = 3;
+
+    struct Frame {
+        /// Texture holding the composed screens, as laid out in the window
+        OGLTexture color;
+        u32 width = 0;
+        u32 height = 0;
+
+        /// Framebuffer of the emulation thread's context, drawing into color
+        OGLFramebuffer render_framebuffer;
+
+        /// Signaled once rendering to the frame has finished
+        GLsync render_fence = nullptr;
+        /// Signaled once presentation has finished reading from the frame
+        GLsync present_fence = nullptr;
+    };
+
+    FrameMailbox();
+
+    /// Returns a frame to render the next image to. Never blocks.
+    Frame* GetRenderFrame();
+
+    /// Queues the rendered frame for presentation
+    void ReleaseRenderFrame(Frame* frame);
+
+    /**
+     * Waits for a finished frame and takes it for presentation. Frames which were queued before it
+     * are skipped, and the frame presented previously is made available for rendering again.
+     * @return The newest finished frame, or nullptr if none was queued within the timeout
+     */
+    Frame* TryGetPresentFrame(std::chrono::milliseconds timeout);
+
+    /// Wakes up a waiting TryGetPresentFrame call without a frame, e.g. on shutdown
+    void Interrupt();
+
+    /// Deletes the GL objects of all frames. Must be called with the emulation thread's context current.
+    void ReleaseFrames();
+
+private:
+    std::array<Frame, NUM_FRAMES> frames;
+
+    std::mutex mutex;
+    std::condition_variable frame_ready;
+    bool interrupted = false;
+
+    /// Frames which can be rendered to
+    std::deque<Frame*> free_queue;
+    /// Finished frames waiting for presentation, oldest first
+    std::deque<Frame*> present_queue;
+    /// Frame currently shown by the presentation thread
+    Frame* presented_frame = nullptr;
+};
@@ -0,0 +1,261 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "common/common_paths.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+#include "common/thread.h"
+
+#include "video_core/renderer_opengl/gl_frame_capture.h"
+#include "video_core/renderer_opengl/gl_state.h"
+
+static const char* const screen_names[] = { "top", "bottom" };
+
+/**
+ * Converts a screen read back as RGBA8 into upright RGB24. The 3DS framebuffers are stored rotated,
+ * with texture rows running from the left column of the screen to its right one.
+ */
+static std::vector<u8> RotateScreen(const std::vector<u8>& rgba, u32 texture_width, u32 texture_height) {
+    const u32 width = texture_height;
+    const u32 height = texture_width;
+    std::vector<u8> rgb(width * height * 3);
+
+    for (u32 y = 0; y < height; ++y) {
+        u8* out = &rgb[y * width * 3];
+        const u8* in = &rgba[(texture_width - 1 - y) * 4];
+        for (u32 x = 0; x < width; ++x) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            out += 3;
+            in += texture_width * 4;
+        }
+    }
+    return rgb;
+}
+
+#ifdef HAVE_PNG
+static void WritePNG(const std::string& filename, const std::vector<u8>& rgb, u32 width, u32 height) {
+    FileUtil::IOFile file(filename, "wb");
+    if (!file.IsOpen()) {
+        LOG_ERROR(Render_OpenGL, "Could not open %s", filename.c_str());
+        return;
+    }
+
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_ptr != nullptr ? png_create_info_struct(png_ptr) : nullptr;
+    if (info_ptr == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Could not allocate the PNG structures");
+        png_destroy_write_struct(&png_ptr, nullptr);
+        return;
+    }
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        LOG_ERROR(Render_OpenGL, "Error while writing %s", filename.c_str());
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return;
+    }
+
+    png_init_io(png_ptr, file.GetHandle());
+    // Captures are written far more often than they are read, so favor speed over size
+    png_set_compression_level(png_ptr, 1);
+    png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+    png_write_info(png_ptr, info_ptr);
+
+    for (u32 y = 0; y < height; ++y)
+        png_write_row(png_ptr, const_cast<u8*>(&rgb[y * width * 3]));
+
+    png_write_end(png_ptr, nullptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+}
+#endif
+
+FrameCapture::FrameCapture(const std::string& path_, Format format_) : path(path_), format(format_) {
+    if (!path.empty() && path.back() != '/' && path.back() != '\\')
+        path += DIR_SEP;
+    FileUtil::CreateFullPath(path);
+
+#ifndef HAVE_PNG
+    if (format == Format::PNG) {
+        LOG_WARNING(Render_OpenGL, "Citra was built without libpng, capturing frames as raw video instead");
+        format = Format::Raw;
+    }
+#endif
+
+    LOG_INFO(Render_OpenGL, "Capturing frames to %s", path.c_str());
+
+    for (Readback& readback : ring) {
+        for (OGLBuffer& buffer : readback.buffers)
+            buffer.Create();
+    }
+
+    // Leave most of the host's cores to emulation
+    const unsigned num_workers = std::min(std::max(std::thread::hardware_concurrency() / 2, 1u), 4u);
+    for (unsigned i = 0; i < num_workers; ++i)
+        workers.emplace_back(&FrameCapture::WorkerLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+    for (size_t i = 0; i < RING_SIZE; ++i) {
+        Readback& readback = ring[(next_readback + i) % RING_SIZE];
+        if (readback.fence != nullptr)
+            FinishReadback(readback, true);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        running = false;
+    }
+    job_available.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+
+    LOG_INFO(Render_OpenGL, "Captured %llu frames", (unsigned long long)next_frame);
+}
+
+void FrameCapture::CaptureScreens(OpenGLState& state, const std::array<Screen, 2>& screens) {
+    CollectReadbacks();
+
+    // All readbacks are still in flight, only the oldest one can have finished by now
+    Readback& readback = ring[next_readback];
+    if (readback.fence != nullptr)
+        FinishReadback(readback, true);
+    next_readback = (next_readback + 1) % RING_SIZE;
+
+    readback.screens = screens;
+    readback.frame = next_frame++;
+
+    glActiveTexture(GL_TEXTURE0);
+    for (unsigned i = 0; i < 2; ++i) {
+        const Screen& screen = screens[i];
+
+        state.texture_units[0].enabled_2d = true;
+        state.texture_units[0].texture_2d = screen.texture;
+        state.Apply();
+
+        // The copy into the buffer is queued, and only waited for when the buffer is mapped
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[i].handle);
+        glBufferData(GL_PIXEL_PACK_BUFFER, screen.width * screen.height * 4, nullptr, GL_STREAM_READ);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    state.texture_units[0].texture_2d = 0;
+    state.Apply();
+
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool FrameCapture::FinishReadback(Readback& readback, bool wait) {
+    const GLenum result = glClientWaitSync(readback.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                           wait ? GL_TIMEOUT_IGNORED : 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+
+    auto pixels = std::make_shared<std::array<std::vector<u8>, 2>>();
+    for (unsigned i = 0; i < 2; ++i) {
+        const size_t size = readback.screens[i].width * readback.screens[i].height * 4;
+        (*pixels)[i].resize(size);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[i].handle);
+        const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (data != nullptr) {
+            std::memcpy((*pixels)[i].data(), data, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    const u64 frame = readback.frame;
+    const std::array<Screen, 2> screens = readback.screens;
+    {
+        // Bounds the memory held by frames waiting to be encoded, if the workers can't keep up
+        std::unique_lock<std::mutex> lock(job_mutex);
+        job_taken.wait(lock, [this]{ return jobs.size() < MAX_QUEUED_JOBS; });
+        jobs.push_back([this, frame, screens, pixels] { EncodeFrame(frame, screens, *pixels); });
+    }
+    job_available.notify_one();
+    return true;
+}
+
+void FrameCapture::CollectReadbacks() {
+    for (size_t i = 0; i < RING_SIZE; ++i) {
+        Readback& readback = ring[(next_readback + i) % RING_SIZE];
+        if (readback.fence == nullptr)
+            continue;
+        if (!FinishReadback(readback, false))
+            break;
+    }
+}
+
+void FrameCapture::EncodeFrame(u64 frame, const std::array<Screen, 2>& screens,
+                               const std::array<std::vector<u8>, 2>& pixels) {
+    std::array<std::vector<u8>, 2> rgb;
+    for (unsigned i = 0; i < 2; ++i)
+        rgb[i] = RotateScreen(pixels[i], screens[i].width, screens[i].height);
+
+    if (format == Format::PNG) {
+#ifdef HAVE_PNG
+        for (unsigned i = 0; i < 2; ++i) {
+            WritePNG(Common::StringFromFormat("%sframe_%06llu_%s.png", path.c_str(), (unsigned long long)frame,
+                                              screen_names[i]),
+                     rgb[i], screens[i].height, screens[i].width);
+        }
+#endif
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(raw_mutex);
+    raw_written.wait(lock, [this, frame]{ return next_raw_write == frame; });
+
+    for (unsigned i = 0; i < 2; ++i) {
+        RawStream& stream = raw_streams[i];
+        const u32 width = screens[i].height;
+        const u32 height = screens[i].width;
+        if (stream.width != width || stream.height != height) {
+            const std::string filename = Common::StringFromFormat("%s%s_%06llu_%ux%u.rgb", path.c_str(),
+                                                                  screen_names[i], (unsigned long long)frame,
+                                                                  width, height);
+            stream.file = FileUtil::IOFile(filename, "wb");
+            stream.width = width;
+            stream.height = height;
+        }
+        stream.file.WriteBytes(rgb[i].data(), rgb[i].size());
+    }
+
+    ++next_raw_write;
+    lock.unlock();
+    raw_written.notify_all();
+}
+
+void FrameCapture::WorkerLoop() {
+    Common::SetCurrentThreadName("FrameCapture");
+
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_available.wait(lock, [this]{ return !jobs.empty() || !running; });
+            if (jobs.empty())
+                break;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job_taken.notify_one();
+
+        job();
+    }
+}
@@ -0,0 +1,111 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "generated/gl_3_2_core.h"
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+
+#include "video_core/renderer_opengl/gl_resource_manager.h"
+
+class OpenGLState;
+
+/**
+ * Captures the emulated screens of every frame into Settings::values.frame_capture_path, either as
+ * numbered PNG images or as one raw RGB24 video stream per screen.
+ *
+ * The screens are read back into a ring of pixel buffers, which are only mapped a few frames later
+ * once their fence has signaled, so capturing doesn't stall the rendering pipeline. The pixels are
+ * then rotated upright, encoded and written out by a pool of worker threads.
+ *
+ * All functions must be called on the thread which owns the rendering context.
+ */
+class FrameCapture final : NonCopyable {
+public:
+    enum class Format {
+        PNG = 0, ///< One image per screen and frame, frame_<number>_<screen>.png
+        Raw = 1, ///< Consecutive frames of a size in <screen>_<first frame>_<width>x<height>.rgb
+    };
+
+    /// Texture holding an emulated screen, in the rotated layout of the 3DS framebuffers
+    struct Screen {
+        GLuint texture;
+        GLsizei width;
+        GLsizei height;
+    };
+
+    FrameCapture(const std::string& path, Format format);
+
+    /// Waits for the frames which are still being read back or encoded to be written out
+    ~FrameCapture();
+
+    /// Queues the readback of the top and bottom screens' textures as the next frame
+    void CaptureScreens(OpenGLState& state, const std::array<Screen, 2>& screens);
+
+private:
+    /// Number of frames which may be read back at once, after which capturing waits for the oldest
+    static const size_t RING_SIZE = 3;
+    /// Number of encoded frames which may be queued, after which capturing waits for the workers
+    static const size_t MAX_QUEUED_JOBS = 16;
+
+    struct Readback {
+        std::array<OGLBuffer, 2> buffers;
+        std::array<Screen, 2> screens;
+        u64 frame;
+        GLsync fence = nullptr;
+    };
+
+    /// Raw video stream of a screen, reopened under a new name whenever its size changes
+    struct RawStream {
+        FileUtil::IOFile file;
+        u32 width = 0;
+        u32 height = 0;
+    };
+
+    /**
+     * Maps a finished readback and hands its pixels over to the workers.
+     * @param wait Whether to wait for the readback to finish, rather than failing if it hasn't
+     * @return Whether the readback had finished
+     */
+    bool FinishReadback(Readback& readback, bool wait);
+
+    /// Finishes the readbacks which are done, from the oldest on
+    void CollectReadbacks();
+
+    /// Rotates the screens of a frame upright and writes them out. Called on the workers.
+    void EncodeFrame(u64 frame, const std::array<Screen, 2>& screens,
+                     const std::array<std::vector<u8>, 2>& pixels);
+    void WorkerLoop();
+
+    std::string path;
+    Format format;
+
+    std::array<Readback, RING_SIZE> ring;
+    size_t next_readback = 0;
+    u64 next_frame = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex job_mutex;
+    std::condition_variable job_available;
+    std::condition_variable job_taken;
+    std::deque<std::function<void()>> jobs;
+    bool running = true;
+
+    /// Frames are appended to the raw streams in order, each worker waiting for its turn
+    std::mutex raw_mutex;
+    std::condition_variable raw_written;
+    std::array<RawStream, 2> raw_streams;
+    u64 next_raw_write = 0;
+};
@@ -0,0 +1,143 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "common/logging/log.h"
+#include "common/profiler.h"
+
+#include "core/settings.h"
+
+#include "video_core/renderer_opengl/generated/gl_3_2_core.h"
+#include "video_core/renderer_opengl/gl_gpu_timer.h"
+
+// Part of OpenGL 3.3 and ARB_timer_query, which the generated 3.2 core loader doesn't cover.
+// glGetQueryObjectui64v isn't loaded either, but 32 bits of nanoseconds are plenty for a scope.
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+namespace GPUTimer {
+
+/// Number of queries in the ring. Scopes opened while all of them are waiting for results aren't measured.
+static const size_t MAX_QUERIES = 2048;
+
+/// Holds the total of its children, which are only ever fed by CollectResults
+static Common::Profiling::TimingCategory gpu_category("GPU");
+static Common::Profiling::TimingCategory draw_category("Draws", &gpu_category);
+static Common::Profiling::TimingCategory upload_category("Uploads", &gpu_category);
+static Common::Profiling::TimingCategory readback_category("Readbacks", &gpu_category);
+static Common::Profiling::TimingCategory screen_category("Screens", &gpu_category);
+
+static Common::Profiling::TimingCategory* const categories[] = {
+    &draw_category, &upload_category, &readback_category, &screen_category,
+};
+static_assert(sizeof(categories) / sizeof(categories[0]) == (size_t)Category::Count,
+              "Every category needs a profiler category");
+
+struct PendingQuery {
+    GLuint query;
+    Category category;
+};
+
+static bool enabled = false;
+static bool query_active = false;
+
+/// Queries which can be started, and the ones whose results haven't been read back yet, oldest first
+static std::vector<GLuint> free_queries;
+static std::deque<PendingQuery> pending_queries;
+
+static bool IsTimerQuerySupported() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 3 || (major == 3 && minor >= 3))
+        return true;
+
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension != nullptr && std::strcmp(extension, "GL_ARB_timer_query") == 0)
+            return true;
+    }
+    return false;
+}
+
+void Init() {
+    if (!Settings::values.profile_gpu)
+        return;
+
+    if (!IsTimerQuerySupported()) {
+        LOG_WARNING(Render_OpenGL, "Timer queries are not supported by the driver, GPU times won't be measured");
+        return;
+    }
+
+    free_queries.resize(MAX_QUERIES);
+    glGenQueries(MAX_QUERIES, free_queries.data());
+    enabled = true;
+}
+
+void Shutdown() {
+    if (!enabled)
+        return;
+
+    for (const PendingQuery& pending : pending_queries)
+        free_queries.push_back(pending.query);
+    pending_queries.clear();
+
+    glDeleteQueries((GLsizei)free_queries.size(), free_queries.data());
+    free_queries.clear();
+    enabled = false;
+}
+
+void CollectResults() {
+    if (!enabled)
+        return;
+
+    // Queries complete in the order they were issued, so the first unavailable one ends the search
+    while (!pending_queries.empty()) {
+        const PendingQuery& pending = pending_queries.front();
+
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint elapsed_ns = 0;
+        glGetQueryObjectuiv(pending.query, GL_QUERY_RESULT, &elapsed_ns);
+
+        auto elapsed = std::chrono::duration_cast<Common::Profiling::Duration>(std::chrono::nanoseconds(elapsed_ns));
+        categories[(size_t)pending.category]->AddTime(elapsed);
+        gpu_category.AddTime(elapsed);
+
+        free_queries.push_back(pending.query);
+        pending_queries.pop_front();
+    }
+}
+
+Scope::Scope(Category category) : active(false) {
+    if (!enabled || query_active || free_queries.empty())
+        return;
+
+    GLuint query = free_queries.back();
+    free_queries.pop_back();
+    pending_queries.push_back({ query, category });
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    query_active = active = true;
+}
+
+Scope::~Scope() {
+    if (!active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    query_active = false;
+}
+
+} // namespace
@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+/**
+ * Measures the time the host GPU spends on parts of a frame, using GL_TIME_ELAPSED queries, and
+ * reports it through the profiler as the "GPU" categories, next to the CPU ones.
+ *
+ * Queries are taken from a ring and only read back once their results are available, usually a
+ * few frames later, so measuring never stalls the pipeline. Times are therefore added to the
+ * profiler frame in which they arrive rather than the one they were measured in, which doesn't
+ * change their averages.
+ *
+ * Only a single time query can be active at once: a Scope opened while another one is active
+ * measures nothing, and its work is accounted to the outer scope.
+ *
+ * Enabled by Settings::values.profile_gpu. All functions must be called on the thread which owns
+ * the rendering context.
+ */
+namespace GPUTimer {
+
+enum class Category {
+    Draws,     ///< Batches of emulated triangles
+    Uploads,   ///< Surfaces, textures and screens loaded from 3DS memory
+    Readbacks, ///< Surfaces copied back to 3DS memory
+    Screens,   ///< Emulated screens drawn to the window
+
+    Count
+};
+
+/// Checks whether timer queries are supported and creates the query ring if profiling is enabled
+void Init();
+
+/// Deletes the query ring, discarding the results which haven't been read back yet
+void Shutdown();
+
+/// Reads back the queries which have finished and adds their times to the profiler. Called once per frame.
+void CollectResults();
+
+/// Measures the GPU time of the commands issued during its lifetime
+class Scope : NonCopyable {
+public:
+    explicit Scope(Category category);
+    ~Scope();
+
+private:
+    bool active;
+};
+
+} // namespace
@@ -0,0 +1,201 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+
+#include "common/string_util.h"
+
+#include "core/core_timing.h"
+
+#include "video_core/renderer_opengl/gl_perf_overlay.h"
+
+/// Packs the five rows of a 3x5 glyph, top row first, with the leftmost pixel in the highest bit
+#define GLYPH(r0, r1, r2, r3, r4) (u16)((r0 << 12) | (r1 << 9) | (r2 << 6) | (r3 << 3) | r4)
+
+/// Glyphs of the ASCII characters from ' ' to '_'. Lowercase letters are drawn as uppercase ones.
+static const u16 font_glyphs[] = {
+    GLYPH(0, 0, 0, 0, 0), GLYPH(2, 2, 2, 0, 2), GLYPH(5, 5, 0, 0, 0), GLYPH(5, 7, 5, 7, 5), //  !"#
+    GLYPH(3, 6, 7, 3, 6), GLYPH(5, 1, 2, 4, 5), GLYPH(2, 5, 2, 5, 3), GLYPH(2, 2, 0, 0, 0), // $%&'
+    GLYPH(1, 2, 2, 2, 1), GLYPH(4, 2, 2, 2, 4), GLYPH(0, 5, 2, 5, 0), GLYPH(0, 2, 7, 2, 0), // ()*+
+    GLYPH(0, 0, 0, 2, 4), GLYPH(0, 0, 7, 0, 0), GLYPH(0, 0, 0, 0, 2), GLYPH(1, 1, 2, 4, 4), // ,-./
+    GLYPH(7, 5, 5, 5, 7), GLYPH(2, 6, 2, 2, 7), GLYPH(7, 1, 7, 4, 7), GLYPH(7, 1, 3, 1, 7), // 0123
+    GLYPH(5, 5, 7, 1, 1), GLYPH(7, 4, 7, 1, 7), GLYPH(7, 4, 7, 5, 7), GLYPH(7, 1, 2, 2, 2), // 4567
+    GLYPH(7, 5, 7, 5, 7), GLYPH(7, 5, 7, 1, 7), GLYPH(0, 2, 0, 2, 0), GLYPH(0, 2, 0, 2, 4), // 89:;
+    GLYPH(1, 2, 4, 2, 1), GLYPH(0, 7, 0, 7, 0), GLYPH(4, 2, 1, 2, 4), GLYPH(6, 1, 2, 0, 2), // <=>?
+    GLYPH(2, 5, 5, 4, 3), GLYPH(2, 5, 7, 5, 5), GLYPH(6, 5, 6, 5, 6), GLYPH(3, 4, 4, 4, 3), // @ABC
+    GLYPH(6, 5, 5, 5, 6), GLYPH(7, 4, 6, 4, 7), GLYPH(7, 4, 6, 4, 4), GLYPH(3, 4, 5, 5, 3), // DEFG
+    GLYPH(5, 5, 7, 5, 5), GLYPH(7, 2, 2, 2, 7), GLYPH(1, 1, 1, 5, 2), GLYPH(5, 5, 6, 5, 5), // HIJK
+    GLYPH(4, 4, 4, 4, 7), GLYPH(5, 7, 7, 5, 5), GLYPH(6, 5, 5, 5, 5), GLYPH(2, 5, 5, 5, 2), // LMNO
+    GLYPH(6, 5, 6, 4, 4), GLYPH(2, 5, 5, 6, 3), GLYPH(6, 5, 6, 5, 5), GLYPH(3, 4, 2, 1, 6), // PQRS
+    GLYPH(7, 2, 2, 2, 2), GLYPH(5, 5, 5, 5, 7), GLYPH(5, 5, 5, 5, 2), GLYPH(5, 5, 7, 7, 5), // TUVW
+    GLYPH(5, 5, 2, 5, 5), GLYPH(5, 5, 2, 2, 2), GLYPH(7, 1, 2, 4, 7), GLYPH(6, 4, 4, 4, 6), // XYZ[
+    GLYPH(4, 4, 2, 1, 1), GLYPH(3, 1, 1, 1, 3), GLYPH(2, 5, 0, 0, 0), GLYPH(0, 0, 0, 0, 7), // \]^_
+};
+
+#undef GLYPH
+
+/// Horizontal distance between characters, and vertical distance between lines of text
+static const int CHAR_ADVANCE = 4;
+static const int LINE_ADVANCE = 7;
+
+/// Frame time which fills the height of the graph, and the one the 3DS renders at
+static const float GRAPH_MAX_MS = 50.0f;
+static const float TARGET_FRAME_MS = 1000.0f / 60.0f;
+static const int GRAPH_HEIGHT = 32;
+
+static const Math::Vec4<u8> background_color = { 0, 0, 0, 160 };
+static const Math::Vec4<u8> text_color = { 255, 255, 255, 255 };
+static const Math::Vec4<u8> target_line_color = { 128, 128, 128, 255 };
+static const Math::Vec4<u8> fast_frame_color = { 64, 224, 64, 255 };
+static const Math::Vec4<u8> slow_frame_color = { 240, 208, 32, 255 };
+static const Math::Vec4<u8> stutter_frame_color = { 240, 48, 48, 255 };
+
+void PerfOverlay::InitObjects(OpenGLState& state) {
+    pixels.resize(WIDTH * HEIGHT * 4);
+
+    texture.Create();
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = texture.handle;
+    state.Apply();
+
+    glActiveTexture(GL_TEXTURE0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WIDTH, HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    state.texture_units[0].texture_2d = 0;
+    state.Apply();
+}
+
+void PerfOverlay::AddFrame(const Common::Profiling::ProfilingFrameResult& results) {
+    const u64 ticks = CoreTiming::GetTicks();
+
+    // The ticks before the first recorded frame are unknown, so it only serves as a starting point
+    if (last_ticks != 0) {
+        FrameStats& frame = frames[next_frame];
+        frame.frame_time_ms = std::chrono::duration<float, std::milli>(results.interframe_time).count();
+        frame.ticks = ticks - last_ticks;
+
+        next_frame = (next_frame + 1) % FRAME_HISTORY;
+        num_frames = std::min(num_frames + 1, FRAME_HISTORY);
+    }
+    last_ticks = ticks;
+
+    num_top_categories = 0;
+    for (unsigned id = 0; id < results.time_per_category.size(); ++id) {
+        const Common::Profiling::Duration time = results.time_per_category[id];
+        if (time == Common::Profiling::Duration::zero())
+            continue;
+
+        // Insertion into the short list, which is kept sorted by time
+        size_t pos = num_top_categories;
+        while (pos > 0 && top_categories[pos - 1].second < time) {
+            if (pos < TOP_CATEGORIES)
+                top_categories[pos] = top_categories[pos - 1];
+            --pos;
+        }
+        if (pos < TOP_CATEGORIES) {
+            top_categories[pos] = { id, time };
+            num_top_categories = std::min(num_top_categories + 1, TOP_CATEGORIES);
+        }
+    }
+}
+
+const PerfOverlay::FrameStats& PerfOverlay::GetFrame(size_t age) const {
+    return frames[(next_frame + FRAME_HISTORY - 1 - age) % FRAME_HISTORY];
+}
+
+void PerfOverlay::FillRect(int x, int y, int width, int height, const Math::Vec4<u8>& color) {
+    for (int row = std::max(y, 0); row < std::min(y + height, HEIGHT); ++row) {
+        for (int column = std::max(x, 0); column < std::min(x + width, WIDTH); ++column) {
+            u8* pixel = &pixels[(row * WIDTH + column) * 4];
+            pixel[0] = color.r();
+            pixel[1] = color.g();
+            pixel[2] = color.b();
+            pixel[3] = color.a();
+        }
+    }
+}
+
+void PerfOverlay::DrawText(int x, int y, const std::string& text, const Math::Vec4<u8>& color) {
+    for (char c : text) {
+        if (c >= 'a' && c <= 'z')
+            c = c - 'a' + 'A';
+        if (c < ' ' || c > '_')
+            c = '?';
+
+        const u16 glyph = font_glyphs[c - ' '];
+        for (int row = 0; row < 5; ++row) {
+            for (int column = 0; column < 3; ++column) {
+                if (glyph & (1 << (14 - row * 3 - column)))
+                    FillRect(x + column, y + row, 1, 1, color);
+            }
+        }
+        x += CHAR_ADVANCE;
+    }
+}
+
+void PerfOverlay::Update(OpenGLState& state) {
+    FillRect(0, 0, WIDTH, HEIGHT, background_color);
+
+    // Speed and frame rate are averaged over the most recent frames, the graph shows the rest
+    const size_t average_frames = std::min(num_frames, AVERAGE_FRAMES);
+    float host_ms = 0.0f;
+    u64 ticks = 0;
+    float max_frame_ms = 0.0f;
+    for (size_t age = 0; age < average_frames; ++age) {
+        host_ms += GetFrame(age).frame_time_ms;
+        ticks += GetFrame(age).ticks;
+        max_frame_ms = std::max(max_frame_ms, GetFrame(age).frame_time_ms);
+    }
+
+    int y = 2;
+    if (host_ms > 0.0f) {
+        const float emulated_ms = (float)ticks * 1000.0f / g_clock_rate_arm11;
+        DrawText(2, y, Common::StringFromFormat("SPEED %3.0f%%  FPS %4.1f", emulated_ms / host_ms * 100.0f,
+                                                average_frames * 1000.0f / host_ms), text_color);
+        y += LINE_ADVANCE;
+        DrawText(2, y, Common::StringFromFormat("FRAME %4.1f MS  MAX %4.1f MS", host_ms / average_frames,
+                                                max_frame_ms), text_color);
+    } else {
+        y += LINE_ADVANCE;
+    }
+    y += LINE_ADVANCE + 1;
+
+    // One column per frame, the latest one on the right
+    const int graph_bottom = y + GRAPH_HEIGHT;
+    for (size_t age = 0; age < num_frames; ++age) {
+        const float frame_ms = GetFrame(age).frame_time_ms;
+        const int height = std::min(GRAPH_HEIGHT, std::max(1, (int)(frame_ms / GRAPH_MAX_MS * GRAPH_HEIGHT)));
+        const Math::Vec4<u8>& color = frame_ms <= TARGET_FRAME_MS * 1.1f ? fast_frame_color :
+                                      frame_ms <= TARGET_FRAME_MS * 2.1f ? slow_frame_color : stutter_frame_color;
+        FillRect(WIDTH - 3 - (int)age, graph_bottom - height, 1, height, color);
+    }
+    FillRect(2, graph_bottom - (int)(TARGET_FRAME_MS / GRAPH_MAX_MS * GRAPH_HEIGHT), WIDTH - 4, 1, target_line_color);
+    y = graph_bottom + 3;
+
+    const auto& categories = Common::Profiling::GetProfilingManager().GetTimingCategoriesInfo();
+    for (size_t i = 0; i < num_top_categories; ++i) {
+        const auto& category = top_categories[i];
+        const float time_ms = std::chrono::duration<float, std::milli>(category.second).count();
+        const std::string time = Common::StringFromFormat("%5.2f MS", time_ms);
+
+        // Long names are cut off before the time
+        const size_t max_name_length = (WIDTH - 4) / CHAR_ADVANCE - time.size() - 1;
+        DrawText(2, y, std::string(categories[category.first].name).substr(0, max_name_length), text_color);
+        DrawText(WIDTH - 2 - (int)time.size() * CHAR_ADVANCE, y, time, text_color);
+        y += LINE_ADVANCE;
+    }
+
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = texture.handle;
+    state.Apply();
+
+    glActiveTexture(GL_TEXTURE0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
@@ -0,0 +1,90 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/profiler_reporting.h"
+#include "common/vector_math.h"
+
+#include "video_core/renderer_opengl/generated/gl_3_2_core.h"
+#include "video_core/renderer_opengl/gl_resource_manager.h"
+#include "video_core/renderer_opengl/gl_state.h"
+
+/**
+ * Performance statistics drawn over the emulated screens: the emulation speed (emulated CPU time
+ * relative to host time), the frame rate, a graph of the recent frame times and the profiler
+ * categories which took the most time in the last frame.
+ *
+ * The statistics of each frame go into a fixed ring which is only written and read on the
+ * rendering thread, so nothing is allocated or locked per frame, and nothing is recorded at all
+ * while the overlay is disabled. The overlay is rasterized on the CPU into a small texture with a
+ * built-in 3x5 pixel font, which the renderer then blends over the window.
+ */
+class PerfOverlay : NonCopyable {
+public:
+    /// Width and height of the overlay texture in pixels
+    static const int WIDTH = 156;
+    static const int HEIGHT = 80;
+
+    /**
+     * Creates the overlay texture.
+     * @param state Renderer state, which is applied again after creating it
+     */
+    void InitObjects(OpenGLState& state);
+
+    /**
+     * Records the statistics of a finished frame.
+     * @param results Profiler results of the frame, as returned by GetPreviousFrameResults()
+     */
+    void AddFrame(const Common::Profiling::ProfilingFrameResult& results);
+
+    /**
+     * Redraws the overlay from the recorded frames and uploads it to the texture.
+     * @param state Renderer state, through which the texture is left bound to texture unit 0
+     */
+    void Update(OpenGLState& state);
+
+    GLuint GetTexture() const { return texture.handle; }
+
+private:
+    /// Number of frames shown in the graph, one pixel column each
+    static const size_t FRAME_HISTORY = WIDTH - 4;
+    /// Number of frames the speed and frame rate are averaged over
+    static const size_t AVERAGE_FRAMES = 30;
+    /// Number of profiler categories listed
+    static const size_t TOP_CATEGORIES = 4;
+
+    struct FrameStats {
+        /// Host time since the previous frame, including swapping, in milliseconds
+        float frame_time_ms;
+        /// Emulated CPU ticks since the previous frame
+        u64 ticks;
+    };
+
+    /// Returns the recorded frame the given number of frames before the latest one
+    const FrameStats& GetFrame(size_t age) const;
+
+    void FillRect(int x, int y, int width, int height, const Math::Vec4<u8>& color);
+    void DrawText(int x, int y, const std::string& text, const Math::Vec4<u8>& color);
+
+    std::array<FrameStats, FRAME_HISTORY> frames;
+    /// Index of the slot the next frame is recorded to, and number of valid slots
+    size_t next_frame = 0;
+    size_t num_frames = 0;
+    u64 last_ticks = 0;
+
+    /// Profiler category ids and times of the last frame which took the most time, longest first
+    std::array<std::pair<unsigned, Common::Profiling::Duration>, TOP_CATEGORIES> top_categories;
+    size_t num_top_categories = 0;
+
+    /// RGBA8 pixels of the overlay, top row first
+    std::vector<u8> pixels;
+    OGLTexture texture;
+};
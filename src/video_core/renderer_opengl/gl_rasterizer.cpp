@@ -2,18 +2,30 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
 #include "common/color.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/make_unique.h"
 #include "common/math_util.h"
+#include "common/string_util.h"
+#include "common/thread.h"
 
+#include "core/hle/kernel/process.h"
+#include "core/hw/display_transfer.h"
 #include "core/hw/gpu.h"
+#include "core/hw/memory_fill.h"
 #include "core/memory.h"
 #include "core/settings.h"
 
 #include "video_core/pica.h"
+#include "video_core/debug_utils/debug_utils.h"
 #include "video_core/utils.h"
+#include "video_core/video_core.h"
+#include "video_core/renderer_opengl/gl_gpu_timer.h"
 #include "video_core/renderer_opengl/gl_rasterizer.h"
 #include "video_core/renderer_opengl/gl_shaders.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
@@ -21,435 +33,733 @@
 
 #include "generated/gl_3_2_core.h"
 
-static bool IsPassThroughTevStage(const Pica::Regs::TevStageConfig& stage) {
-    return (stage.color_op == Pica::Regs::TevStageConfig::Operation::Replace &&
-            stage.alpha_op == Pica::Regs::TevStageConfig::Operation::Replace &&
-            stage.color_source1 == Pica::Regs::TevStageConfig::Source::Previous &&
-            stage.alpha_source1 == Pica::Regs::TevStageConfig::Source::Previous &&
-            stage.color_modifier1 == Pica::Regs::TevStageConfig::ColorModifier::SourceColor &&
-            stage.alpha_modifier1 == Pica::Regs::TevStageConfig::AlphaModifier::SourceAlpha &&
-            stage.GetColorMultiplier() == 1 &&
-            stage.GetAlphaMultiplier() == 1);
-}
-
-RasterizerOpenGL::RasterizerOpenGL() : last_fb_color_addr(0), last_fb_depth_addr(0) { }
-RasterizerOpenGL::~RasterizerOpenGL() { }
-
-void RasterizerOpenGL::InitObjects() {
-    // Create the hardware shader program and get attrib/uniform locations
-    shader.Create(GLShaders::g_vertex_shader_hw, GLShaders::g_fragment_shader_hw);
-    attrib_position = glGetAttribLocation(shader.handle, "vert_position");
-    attrib_color = glGetAttribLocation(shader.handle, "vert_color");
-    attrib_texcoords = glGetAttribLocation(shader.handle, "vert_texcoords");
-
-    uniform_alphatest_enabled = glGetUniformLocation(shader.handle, "alphatest_enabled");
-    uniform_alphatest_func = glGetUniformLocation(shader.handle, "alphatest_func");
-    uniform_alphatest_ref = glGetUniformLocation(shader.handle, "alphatest_ref");
-
-    uniform_tex = glGetUniformLocation(shader.handle, "tex");
-
-    uniform_tev_combiner_buffer_color = glGetUniformLocation(shader.handle, "tev_combiner_buffer_color");
-
-    const auto tev_stages = Pica::g_state.regs.GetTevStages();
-    for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        auto& uniform_tev_cfg = uniform_tev_cfgs[tev_stage_index];
+/// Size of the ring the vertex batches are streamed through
+static const GLsizeiptr VERTEX_BUFFER_SIZE = 4 * 1024 * 1024;
+/// Size of the ring the index batches are streamed through
+static const GLsizeiptr INDEX_BUFFER_SIZE = 1024 * 1024;
+
+/// Largest supported internal resolution multiplier
+static const int MAX_RESOLUTION_FACTOR = 10;
+
+/// Binding points of the uniform blocks of the generated shaders
+static const GLuint UNIFORM_BINDING_SHADER_DATA = 0;
+static const GLuint UNIFORM_BINDING_VS_UNIFORMS = 1;
+static const GLuint UNIFORM_BINDING_UBER_CONFIG = 2;
+
+RasterizerOpenGL::RasterizerOpenGL() : cur_color_surface(nullptr), cur_depth_surface(nullptr), res_scale(1),
+                                       dirty_flags(DirtyAll), current_shader(nullptr), disk_shader_cache_loaded(false),
+                                       shader_dirty(true), shader_compile_mode(ShaderCompileMode::Immediate),
+                                       compile_running(false), uber_config_valid(false),
+                                       current_vertex_shader(nullptr), uniform_data_dirty(true) { }
+
+RasterizerOpenGL::~RasterizerOpenGL() {
+    if (compile_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(compile_mutex);
+            compile_running = false;
+            compile_jobs.clear();
+        }
+        compile_available.notify_one();
+        compile_thread.join();
+    }
 
-        std::string tev_ref_str = "tev_cfgs[" + std::to_string(tev_stage_index) + "]";
-        uniform_tev_cfg.enabled = glGetUniformLocation(shader.handle, (tev_ref_str + ".enabled").c_str());
-        uniform_tev_cfg.color_sources = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_sources").c_str());
-        uniform_tev_cfg.alpha_sources = glGetUniformLocation(shader.handle, (tev_ref_str + ".alpha_sources").c_str());
-        uniform_tev_cfg.color_modifiers = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_modifiers").c_str());
-        uniform_tev_cfg.alpha_modifiers = glGetUniformLocation(shader.handle, (tev_ref_str + ".alpha_modifiers").c_str());
-        uniform_tev_cfg.color_alpha_op = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_alpha_op").c_str());
-        uniform_tev_cfg.color_alpha_multiplier = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_alpha_multiplier").c_str());
-        uniform_tev_cfg.const_color = glGetUniformLocation(shader.handle, (tev_ref_str + ".const_color").c_str());
-        uniform_tev_cfg.updates_combiner_buffer_color_alpha = glGetUniformLocation(shader.handle, (tev_ref_str + ".updates_combiner_buffer_color_alpha").c_str());
+    for (const auto& shader : shader_cache) {
+        if (shader.second->compile_fence != nullptr)
+            glDeleteSync(shader.second->compile_fence);
     }
+}
 
+void RasterizerOpenGL::InitObjects() {
     // Generate VBO and VAO
-    vertex_buffer.Create();
+    vertex_buffer.Create(GL_ARRAY_BUFFER, VERTEX_BUFFER_SIZE);
+    index_buffer.Create(GL_ELEMENT_ARRAY_BUFFER, INDEX_BUFFER_SIZE);
     vertex_array.Create();
 
     // Update OpenGL state
     state.draw.vertex_array = vertex_array.handle;
     state.draw.vertex_buffer = vertex_buffer.handle;
-    state.draw.shader_program = shader.handle;
 
     state.Apply();
 
-    // Set the texture samplers to correspond to different texture units
-    glUniform1i(uniform_tex, 0);
-    glUniform1i(uniform_tex + 1, 1);
-    glUniform1i(uniform_tex + 2, 2);
-
-    // Set vertex attributes
-    glVertexAttribPointer(attrib_position, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, position));
-    glVertexAttribPointer(attrib_color, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, color));
-    glVertexAttribPointer(attrib_texcoords, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord0));
-    glVertexAttribPointer(attrib_texcoords + 1, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord1));
-    glVertexAttribPointer(attrib_texcoords + 2, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord2));
-    glEnableVertexAttribArray(attrib_position);
-    glEnableVertexAttribArray(attrib_color);
-    glEnableVertexAttribArray(attrib_texcoords);
-    glEnableVertexAttribArray(attrib_texcoords + 1);
-    glEnableVertexAttribArray(attrib_texcoords + 2);
-
-    // Create textures for OGL framebuffer that will be rendered to, initially 1x1 to succeed in framebuffer creation
-    fb_color_texture.texture.Create();
-    ReconfigureColorTexture(fb_color_texture, Pica::Regs::ColorFormat::RGBA8, 1, 1);
-
-    state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = fb_color_texture.texture.handle;
-    state.Apply();
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    state.texture_units[0].texture_2d = 0;
-    state.Apply();
+    // The index buffer binding is part of the vertex array's state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer.handle);
+
+    // Uniform blocks are shared by all generated programs, so they only need to be updated when
+    // their values change rather than whenever a different program is bound
+    uniform_buffer.Create();
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(UniformData), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_SHADER_DATA, uniform_buffer.handle);
+
+    std::memset(&vs_uniform_data, 0, sizeof(vs_uniform_data));
+    vs_uniform_buffer.Create();
+    glBindBuffer(GL_UNIFORM_BUFFER, vs_uniform_buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(VSUniformData), &vs_uniform_data, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_VS_UNIFORMS, vs_uniform_buffer.handle);
+
+    // Generated programs are compiled by the driver in the background if it can, or else by a
+    // worker thread if the frontend provides a second context. Otherwise they are linked right
+    // away, so there's no need for the uber shader.
+    if (ShaderUtil::IsParallelCompileSupported()) {
+        shader_compile_mode = ShaderCompileMode::DriverParallel;
+    } else if (VideoCore::g_emu_window != nullptr) {
+        compile_context = VideoCore::g_emu_window->CreateSharedContext();
+        if (compile_context != nullptr) {
+            shader_compile_mode = ShaderCompileMode::WorkerThread;
+            compile_running = true;
+            compile_thread = std::thread(&RasterizerOpenGL::CompileWorkerLoop, this);
+        }
+    }
 
-    fb_depth_texture.texture.Create();
-    ReconfigureDepthTexture(fb_depth_texture, Pica::Regs::DepthFormat::D16, 1, 1);
+    if (shader_compile_mode != ShaderCompileMode::Immediate) {
+        uber_config_buffer.Create();
+        glBindBuffer(GL_UNIFORM_BUFFER, uber_config_buffer.handle);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(UberConfigData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING_UBER_CONFIG, uber_config_buffer.handle);
 
-    state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = fb_depth_texture.texture.handle;
-    state.Apply();
+        uber_shader.shader.Create(GLShaders::g_vertex_shader_hw, GLShaders::g_fragment_shader_uber);
+        FinishShader(uber_shader);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        GLuint block_index = glGetUniformBlockIndex(uber_shader.shader.handle, "uber_config");
+        glUniformBlockBinding(uber_shader.shader.handle, block_index, UNIFORM_BINDING_UBER_CONFIG);
 
-    state.texture_units[0].texture_2d = 0;
-    state.Apply();
+        LOG_INFO(Render_OpenGL, "Compiling shaders in the background");
+    }
 
-    // Configure OpenGL framebuffer
+    // Configure OpenGL framebuffer. Attachments are set up for each surface in SyncFramebuffer.
     framebuffer.Create();
 
     state.draw.framebuffer = framebuffer.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fb_color_texture.texture.handle, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fb_depth_texture.texture.handle, 0);
+    copy_read_framebuffer.Create();
+    copy_draw_framebuffer.Create();
 
-    ASSERT_MSG(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
-               "OpenGL rasterizer framebuffer setup failed, status %X", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    texture_decoder.InitObjects();
+
+    // Surfaces keep the scale they were created with, so it can't be changed while running
+    res_scale = MathUtil::Clamp(Settings::values.resolution_factor, 1, MAX_RESOLUTION_FACTOR);
 }
 
 void RasterizerOpenGL::Reset() {
-    const auto& regs = Pica::g_state.regs;
+    NotifyStateRestored();
 
-    SyncCullMode();
-    SyncBlendEnabled();
-    SyncBlendFuncs();
-    SyncBlendColor();
-    SyncAlphaTest();
-    SyncLogicOp();
-    SyncStencilTest();
-    SyncDepthTest();
-
-    // TEV stage 0
-    SyncTevSources(0, regs.tev_stage0);
-    SyncTevModifiers(0, regs.tev_stage0);
-    SyncTevOps(0, regs.tev_stage0);
-    SyncTevColor(0, regs.tev_stage0);
-    SyncTevMultipliers(0, regs.tev_stage0);
-
-    // TEV stage 1
-    SyncTevSources(1, regs.tev_stage1);
-    SyncTevModifiers(1, regs.tev_stage1);
-    SyncTevOps(1, regs.tev_stage1);
-    SyncTevColor(1, regs.tev_stage1);
-    SyncTevMultipliers(1, regs.tev_stage1);
-
-    // TEV stage 2
-    SyncTevSources(2, regs.tev_stage2);
-    SyncTevModifiers(2, regs.tev_stage2);
-    SyncTevOps(2, regs.tev_stage2);
-    SyncTevColor(2, regs.tev_stage2);
-    SyncTevMultipliers(2, regs.tev_stage2);
-
-    // TEV stage 3
-    SyncTevSources(3, regs.tev_stage3);
-    SyncTevModifiers(3, regs.tev_stage3);
-    SyncTevOps(3, regs.tev_stage3);
-    SyncTevColor(3, regs.tev_stage3);
-    SyncTevMultipliers(3, regs.tev_stage3);
-
-    // TEV stage 4
-    SyncTevSources(4, regs.tev_stage4);
-    SyncTevModifiers(4, regs.tev_stage4);
-    SyncTevOps(4, regs.tev_stage4);
-    SyncTevColor(4, regs.tev_stage4);
-    SyncTevMultipliers(4, regs.tev_stage4);
-
-    // TEV stage 5
-    SyncTevSources(5, regs.tev_stage5);
-    SyncTevModifiers(5, regs.tev_stage5);
-    SyncTevOps(5, regs.tev_stage5);
-    SyncTevColor(5, regs.tev_stage5);
-    SyncTevMultipliers(5, regs.tev_stage5);
-
-    SyncCombinerColor();
-    SyncCombinerWriteFlags();
+    // 3DS memory may have been changed by the software renderer in the meantime
+    DiscardSurfaces();
 
     res_cache.FullFlush();
 }
 
-void RasterizerOpenGL::AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                                   const Pica::VertexShader::OutputVertex& v1,
-                                   const Pica::VertexShader::OutputVertex& v2) {
-    vertex_batch.push_back(HardwareVertex(v0));
-    vertex_batch.push_back(HardwareVertex(v1));
-    vertex_batch.push_back(HardwareVertex(v2));
+void RasterizerOpenGL::NotifyStateRestored() {
+    vertex_batch.clear();
+    index_batch.clear();
+    unshaded_vertex_batch.clear();
+    current_vertex_shader = nullptr;
+
+    // Sync all state on the next draw and regenerate the shader for the current TEV configuration
+    dirty_flags = DirtyAll;
+    shader_dirty = true;
+}
+
+u32 RasterizerOpenGL::AddVertex(const Pica::VertexShader::OutputVertex& v) {
+    vertex_batch.push_back(HardwareVertex(v));
+    return static_cast<u32>(vertex_batch.size() - 1);
+}
+
+void RasterizerOpenGL::AddIndexedTriangle(u32 v0, u32 v1, u32 v2) {
+    index_batch.push_back(v0);
+    index_batch.push_back(v1);
+    index_batch.push_back(v2);
+}
+
+bool RasterizerOpenGL::BeginHostShadedDraw() {
+    if (!Settings::values.use_hw_vertex_shader)
+        return false;
+
+    PicaVSConfig config = PicaVSConfig::CurrentConfig();
+
+    auto cached_shader = vertex_shader_cache.find(config);
+    if (cached_shader == vertex_shader_cache.end())
+        cached_shader = vertex_shader_cache.emplace(config, GLShaders::GenerateVertexShader(config)).first;
+
+    if (cached_shader->second.empty())
+        return false;
+
+    // Triangles shaded on the CPU use a different program and vertex layout
+    FlushBatch();
+
+    current_vs_config = config;
+    current_vertex_shader = &cached_shader->second;
+    return true;
+}
+
+void RasterizerOpenGL::AddUnshadedTriangle(const Pica::VertexShader::InputVertex& v0,
+                                           const Pica::VertexShader::InputVertex& v1,
+                                           const Pica::VertexShader::InputVertex& v2) {
+    for (const auto* vertex : { &v0, &v1, &v2 }) {
+        for (unsigned attribute = 0; attribute < current_vs_config.num_attributes; ++attribute) {
+            for (unsigned comp = 0; comp < 4; ++comp)
+                unshaded_vertex_batch.push_back(vertex->attr[attribute][comp].ToFloat32());
+        }
+    }
 }
 
 void RasterizerOpenGL::DrawTriangles() {
+    // Host shaded draws read the vertex shader uniforms when they're flushed, so they're drawn
+    // right away. Other draws are merged until the state changes, unless the following draws could
+    // depend on the results of this one or the batch would no longer fit the stream buffers.
+    const size_t max_vertices = vertex_buffer.GetSize() / sizeof(HardwareVertex);
+    const size_t max_indices = index_buffer.GetSize() / sizeof(u32) / 3 * 3;
+    if (current_vertex_shader != nullptr || IsFeedbackDraw() ||
+        vertex_batch.size() >= max_vertices || index_batch.size() >= max_indices) {
+        FlushBatch();
+    }
+}
+
+bool RasterizerOpenGL::IsFeedbackDraw() const {
+    const auto& regs = Pica::g_state.regs;
+
+    u32 pixels = regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    PAddr color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
+    u32 color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format) * pixels;
+    PAddr depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
+    u32 depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format) * pixels;
+
+    for (const auto& texture : regs.GetTextures()) {
+        if (!texture.enabled)
+            continue;
+
+        const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
+        PAddr texture_addr = texture.config.GetPhysicalAddress();
+        u32 texture_size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2;
+
+        if (MathUtil::IntervalsIntersect(texture_addr, texture_size, color_addr, color_size) ||
+            MathUtil::IntervalsIntersect(texture_addr, texture_size, depth_addr, depth_size)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RasterizerOpenGL::FlushBatch() {
+    if (index_batch.empty() && unshaded_vertex_batch.empty()) {
+        // Vertices of draws which didn't form any triangles
+        vertex_batch.clear();
+        current_vertex_shader = nullptr;
+        return;
+    }
+
     SyncFramebuffer();
     SyncDrawState();
 
-    glBufferData(GL_ARRAY_BUFFER, vertex_batch.size() * sizeof(HardwareVertex), vertex_batch.data(), GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertex_batch.size());
+    {
+        GPUTimer::Scope gpu_timer(GPUTimer::Category::Draws);
+
+        if (current_vertex_shader != nullptr) {
+            DrawUnshadedBatch();
+            current_vertex_shader = nullptr;
+        }
+
+        const GLsizeiptr vertices_size = vertex_batch.size() * sizeof(HardwareVertex);
+        const GLsizeiptr indices_size = index_batch.size() * sizeof(u32);
+
+        if (index_batch.empty()) {
+            // Only the host shaded draw
+        } else if (vertices_size <= vertex_buffer.GetSize() && indices_size <= index_buffer.GetSize()) {
+            // Strips, fans and indexed draws share most of their vertices between triangles, so
+            // each vertex is only uploaded once
+            auto mapped_vertices = vertex_buffer.Map(vertices_size, sizeof(HardwareVertex));
+            std::memcpy(mapped_vertices.first, vertex_batch.data(), vertices_size);
+            vertex_buffer.Unmap(vertices_size);
+
+            auto mapped_indices = index_buffer.Map(indices_size, sizeof(u32));
+            std::memcpy(mapped_indices.first, index_batch.data(), indices_size);
+            index_buffer.Unmap(indices_size);
+
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)index_batch.size(), GL_UNSIGNED_INT,
+                                     (GLvoid*)mapped_indices.second,
+                                     (GLint)(mapped_vertices.second / sizeof(HardwareVertex)));
+        } else {
+            DrawBatchInChunks();
+        }
+    }
 
     vertex_batch.clear();
+    index_batch.clear();
+
+    // The surfaces now hold rendering results which haven't been written to 3DS memory, and
+    // readbacks queued before don't reflect them anymore
+    cur_color_surface->dirty = true;
+    cur_color_surface->sampler_copy_valid = false;
+    DiscardReadback(cur_color_surface->readback);
+    cur_depth_surface->dirty = true;
+    DiscardReadback(cur_depth_surface->readback);
 
     // Flush the resource cache at the current depth and color framebuffer addresses for render-to-texture
-    const auto& regs = Pica::g_state.regs;
+    res_cache.NotifyFlush(cur_color_surface->addr, cur_color_surface->size);
+    res_cache.NotifyFlush(cur_depth_surface->addr, cur_depth_surface->size);
+}
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+void RasterizerOpenGL::CommitFramebuffer() {
+    FlushBatch();
 
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    for (auto& surface : color_surfaces) {
+        if (surface.second->dirty || surface.second->readback.IsPending())
+            CommitColorBuffer(*surface.second);
+    }
+
+    for (auto& surface : depth_surfaces) {
+        if (surface.second->dirty || surface.second->readback.IsPending())
+            CommitDepthBuffer(*surface.second);
+    }
 
-    res_cache.NotifyFlush(cur_fb_color_addr, cur_fb_color_size);
-    res_cache.NotifyFlush(cur_fb_depth_addr, cur_fb_depth_size);
+    for (auto& surface : display_surfaces) {
+        if (surface.second->dirty)
+            CommitDisplaySurface(*surface.second);
+    }
+
+    for (const auto& fill : pending_fills)
+        WritePendingFill(fill, fill.addr, fill.addr + fill.size);
+    pending_fills.clear();
 }
 
-void RasterizerOpenGL::CommitFramebuffer() {
-    CommitColorBuffer();
-    CommitDepthBuffer();
+void RasterizerOpenGL::NotifyPicaRegisterChanging(u32 id) {
+    if (!Settings::values.use_hw_renderer)
+        return;
+
+    // Registers from the vertex attribute configuration onwards only affect vertex processing,
+    // which has already been done for the queued triangles
+    if (id < PICA_REG_INDEX(vertex_attributes))
+        FlushBatch();
 }
 
 void RasterizerOpenGL::NotifyPicaRegisterChanged(u32 id) {
-    const auto& regs = Pica::g_state.regs;
-
     if (!Settings::values.use_hw_renderer)
         return;
 
     switch(id) {
     // Culling
     case PICA_REG_INDEX(cull_mode):
-        SyncCullMode();
+        dirty_flags |= DirtyCullMode;
         break;
 
     // Blending
     case PICA_REG_INDEX(output_merger.alphablend_enable):
-        SyncBlendEnabled();
+        dirty_flags |= DirtyBlendEnabled;
         break;
     case PICA_REG_INDEX(output_merger.alpha_blending):
-        SyncBlendFuncs();
+        dirty_flags |= DirtyBlendFuncs;
         break;
     case PICA_REG_INDEX(output_merger.blend_const):
-        SyncBlendColor();
+        dirty_flags |= DirtyBlendColor;
         break;
 
     // Alpha test
     case PICA_REG_INDEX(output_merger.alpha_test):
-        SyncAlphaTest();
+        dirty_flags |= DirtyAlphaTest;
         break;
 
     // Stencil test
     case PICA_REG_INDEX(output_merger.stencil_test):
-        SyncStencilTest();
+        dirty_flags |= DirtyStencilTest;
         break;
 
     // Depth test
     case PICA_REG_INDEX(output_merger.depth_test_enable):
-        SyncDepthTest();
+        dirty_flags |= DirtyDepthTest;
         break;
 
     // Logic op
     case PICA_REG_INDEX(output_merger.logic_op):
-        SyncLogicOp();
+        dirty_flags |= DirtyLogicOp;
         break;
 
-    // TEV stage 0
+    // TEV stage color, alpha and combiner configuration, which are baked into the generated shader
     case PICA_REG_INDEX(tev_stage0.color_source1):
-        SyncTevSources(0, regs.tev_stage0);
-        break;
     case PICA_REG_INDEX(tev_stage0.color_modifier1):
-        SyncTevModifiers(0, regs.tev_stage0);
-        break;
     case PICA_REG_INDEX(tev_stage0.color_op):
-        SyncTevOps(0, regs.tev_stage0);
-        break;
-    case PICA_REG_INDEX(tev_stage0.const_r):
-        SyncTevColor(0, regs.tev_stage0);
-        break;
     case PICA_REG_INDEX(tev_stage0.color_scale):
-        SyncTevMultipliers(0, regs.tev_stage0);
-        break;
-
-    // TEV stage 1
     case PICA_REG_INDEX(tev_stage1.color_source1):
-        SyncTevSources(1, regs.tev_stage1);
-        break;
     case PICA_REG_INDEX(tev_stage1.color_modifier1):
-        SyncTevModifiers(1, regs.tev_stage1);
-        break;
     case PICA_REG_INDEX(tev_stage1.color_op):
-        SyncTevOps(1, regs.tev_stage1);
-        break;
-    case PICA_REG_INDEX(tev_stage1.const_r):
-        SyncTevColor(1, regs.tev_stage1);
-        break;
     case PICA_REG_INDEX(tev_stage1.color_scale):
-        SyncTevMultipliers(1, regs.tev_stage1);
-        break;
-
-    // TEV stage 2
     case PICA_REG_INDEX(tev_stage2.color_source1):
-        SyncTevSources(2, regs.tev_stage2);
-        break;
     case PICA_REG_INDEX(tev_stage2.color_modifier1):
-        SyncTevModifiers(2, regs.tev_stage2);
-        break;
     case PICA_REG_INDEX(tev_stage2.color_op):
-        SyncTevOps(2, regs.tev_stage2);
-        break;
-    case PICA_REG_INDEX(tev_stage2.const_r):
-        SyncTevColor(2, regs.tev_stage2);
-        break;
     case PICA_REG_INDEX(tev_stage2.color_scale):
-        SyncTevMultipliers(2, regs.tev_stage2);
-        break;
-
-    // TEV stage 3
     case PICA_REG_INDEX(tev_stage3.color_source1):
-        SyncTevSources(3, regs.tev_stage3);
-        break;
     case PICA_REG_INDEX(tev_stage3.color_modifier1):
-        SyncTevModifiers(3, regs.tev_stage3);
-        break;
     case PICA_REG_INDEX(tev_stage3.color_op):
-        SyncTevOps(3, regs.tev_stage3);
-        break;
-    case PICA_REG_INDEX(tev_stage3.const_r):
-        SyncTevColor(3, regs.tev_stage3);
-        break;
     case PICA_REG_INDEX(tev_stage3.color_scale):
-        SyncTevMultipliers(3, regs.tev_stage3);
-        break;
-
-    // TEV stage 4
     case PICA_REG_INDEX(tev_stage4.color_source1):
-        SyncTevSources(4, regs.tev_stage4);
-        break;
     case PICA_REG_INDEX(tev_stage4.color_modifier1):
-        SyncTevModifiers(4, regs.tev_stage4);
-        break;
     case PICA_REG_INDEX(tev_stage4.color_op):
-        SyncTevOps(4, regs.tev_stage4);
-        break;
-    case PICA_REG_INDEX(tev_stage4.const_r):
-        SyncTevColor(4, regs.tev_stage4);
-        break;
     case PICA_REG_INDEX(tev_stage4.color_scale):
-        SyncTevMultipliers(4, regs.tev_stage4);
-        break;
-
-    // TEV stage 5
     case PICA_REG_INDEX(tev_stage5.color_source1):
-        SyncTevSources(5, regs.tev_stage5);
-        break;
     case PICA_REG_INDEX(tev_stage5.color_modifier1):
-        SyncTevModifiers(5, regs.tev_stage5);
-        break;
     case PICA_REG_INDEX(tev_stage5.color_op):
-        SyncTevOps(5, regs.tev_stage5);
+    case PICA_REG_INDEX(tev_stage5.color_scale):
+    case PICA_REG_INDEX(tev_combiner_buffer_input):
+        shader_dirty = true;
         break;
+
+    // TEV stage constant colors
+    case PICA_REG_INDEX(tev_stage0.const_r):
+    case PICA_REG_INDEX(tev_stage1.const_r):
+    case PICA_REG_INDEX(tev_stage2.const_r):
+    case PICA_REG_INDEX(tev_stage3.const_r):
+    case PICA_REG_INDEX(tev_stage4.const_r):
     case PICA_REG_INDEX(tev_stage5.const_r):
-        SyncTevColor(5, regs.tev_stage5);
-        break;
-    case PICA_REG_INDEX(tev_stage5.color_scale):
-        SyncTevMultipliers(5, regs.tev_stage5);
+        dirty_flags |= DirtyTevColors;
         break;
 
     // TEV combiner buffer color
     case PICA_REG_INDEX(tev_combiner_buffer_color):
-        SyncCombinerColor();
-        break;
-
-    // TEV combiner buffer write flags
-    case PICA_REG_INDEX(tev_combiner_buffer_input):
-        SyncCombinerWriteFlags();
+        dirty_flags |= DirtyCombinerColor;
         break;
     }
 }
 
 void RasterizerOpenGL::NotifyPreRead(PAddr addr, u32 size) {
-    const auto& regs = Pica::g_state.regs;
-
     if (!Settings::values.use_hw_renderer)
         return;
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
-
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    FlushBatch();
 
-    // If source memory region overlaps 3DS framebuffers, commit them before the copy happens
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_color_addr, cur_fb_color_size))
-        CommitColorBuffer();
-
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_depth_addr, cur_fb_depth_size))
-        CommitDepthBuffer();
+    // If source memory region overlaps rendered surfaces, commit them before the copy happens
+    CommitSurfaces(addr, size);
 }
 
 void RasterizerOpenGL::NotifyFlush(PAddr addr, u32 size) {
-    const auto& regs = Pica::g_state.regs;
-
     if (!Settings::values.use_hw_renderer)
         return;
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    FlushBatch();
 
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    // Like unwritten rendering results, readbacks of the surfaces in the region are superseded
+    for (auto& surface : color_surfaces) {
+        if (MathUtil::IntervalsIntersect(addr, size, surface.second->addr, surface.second->size))
+            DiscardReadback(surface.second->readback);
+    }
+    for (auto& surface : depth_surfaces) {
+        if (MathUtil::IntervalsIntersect(addr, size, surface.second->addr, surface.second->size))
+            DiscardReadback(surface.second->readback);
+    }
+
+    // If modified memory region overlaps the bound surfaces, reload their contents into OpenGL.
+    // Other surfaces are dropped and loaded again from memory the next time they are used.
+    if (cur_color_surface != nullptr &&
+        MathUtil::IntervalsIntersect(addr, size, cur_color_surface->addr, cur_color_surface->size)) {
+        ReloadColorBuffer(*cur_color_surface);
+    }
 
-    // If modified memory region overlaps 3DS framebuffers, reload their contents into OpenGL
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_color_addr, cur_fb_color_size))
-        ReloadColorBuffer();
+    if (cur_depth_surface != nullptr &&
+        MathUtil::IntervalsIntersect(addr, size, cur_depth_surface->addr, cur_depth_surface->size)) {
+        ReloadDepthBuffer(*cur_depth_surface);
+    }
 
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_depth_addr, cur_fb_depth_size))
-        ReloadDepthBuffer();
+    EraseSurfaces(addr, size);
+    DiscardPendingFills(addr, size);
 
     // Notify cache of flush in case the region touches a cached resource
     res_cache.NotifyFlush(addr, size);
 }
 
-void RasterizerOpenGL::ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height) {
+/// Returns the color buffer format storing pixels the same way as the given display transfer format
+static Pica::Regs::ColorFormat ToColorFormat(GPU::Regs::PixelFormat format) {
+    switch (format) {
+    case GPU::Regs::PixelFormat::RGBA8:  return Pica::Regs::ColorFormat::RGBA8;
+    case GPU::Regs::PixelFormat::RGB8:   return Pica::Regs::ColorFormat::RGB8;
+    case GPU::Regs::PixelFormat::RGB565: return Pica::Regs::ColorFormat::RGB565;
+    case GPU::Regs::PixelFormat::RGB5A1: return Pica::Regs::ColorFormat::RGB5A1;
+    case GPU::Regs::PixelFormat::RGBA4:  return Pica::Regs::ColorFormat::RGBA4;
+    default:
+        UNREACHABLE();
+    }
+}
+
+bool RasterizerOpenGL::AccelerateDisplayTransfer(const GPU::DisplayTransfer::Config& config, PAddr src_addr, PAddr dst_addr) {
+    if (!Settings::values.use_hw_renderer || !config.input_tiled)
+        return false;
+
+    if (config.input_format > GPU::Regs::PixelFormat::RGBA4 || config.output_format > GPU::Regs::PixelFormat::RGBA4)
+        return false;
+
+    FlushBatch();
+
+    // Only transfers from framebuffers which have been rendered to can be done on the GPU
+    u32 input_height = config.output_height << config.vertical_scale;
+    SurfaceKey src_key(src_addr, (u32)ToColorFormat(config.input_format), config.input_width, input_height);
+    auto src_surface = color_surfaces.find(src_key);
+    if (src_surface == color_surfaces.end())
+        return false;
+
+    Pica::Regs::ColorFormat dst_format = ToColorFormat(config.output_format);
+    u32 dst_size = config.output_width * config.output_height * Pica::Regs::BytesPerColorPixel(dst_format);
+    SurfaceKey dst_key(dst_addr, (u32)dst_format, config.output_width, config.output_height);
+
+    // Tiled output is kept as a regular surface, which can be rendered to or sampled from later
+    auto& dst_surfaces = config.output_tiled ? color_surfaces : display_surfaces;
+    auto dst_surface = dst_surfaces.find(dst_key);
+    const void* existing_dst = (dst_surface != dst_surfaces.end()) ? dst_surface->second.get() : nullptr;
+
+    // Partially overlapping surfaces would have to be merged with the result
+    if (IsOverlappedByOtherSurface(dst_addr, dst_size, existing_dst))
+        return false;
+
+    DiscardPendingFills(dst_addr, dst_size);
+
+    if (dst_surface == dst_surfaces.end()) {
+        std::unique_ptr<ColorSurface> new_surface = Common::make_unique<ColorSurface>();
+        new_surface->addr = dst_addr;
+        new_surface->size = dst_size;
+        new_surface->sampler_copy_valid = false;
+
+        // The transfer overwrites the whole surface, so there is no need to load it from memory
+        new_surface->texture.texture.Create();
+        ReconfigureColorTexture(new_surface->texture, dst_format, config.output_width, config.output_height, res_scale);
+
+        dst_surface = dst_surfaces.emplace(dst_key, std::move(new_surface)).first;
+    }
+
+    ColorSurface& src = *src_surface->second;
+    ColorSurface& dst = *dst_surface->second;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_read_framebuffer.handle);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, src.texture.texture.handle, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_draw_framebuffer.handle);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst.texture.texture.handle, 0);
+
+    // Linear filtering halfway between two texels averages them like the transfer's box filter
+    GLint dst_width = config.output_width * res_scale;
+    GLint dst_height = config.output_height * res_scale;
+    GLint dst_y0 = config.flip_vertically ? dst_height : 0;
+    GLint dst_y1 = config.flip_vertically ? 0 : dst_height;
+    glBlitFramebuffer(0, 0, src.texture.width * res_scale, src.texture.height * res_scale, 0, dst_y0, dst_width, dst_y1,
+                      GL_COLOR_BUFFER_BIT, (config.horizontal_scale || config.vertical_scale) ? GL_LINEAR : GL_NEAREST);
+
+    // Restore the binding tracked by the state
+    glBindFramebuffer(GL_FRAMEBUFFER, state.draw.framebuffer);
+
+    dst.dirty = true;
+    dst.sampler_copy_valid = false;
+
+    // Textures loaded from the destination are outdated now
+    res_cache.NotifyFlush(dst_addr, dst_size);
+
+    return true;
+}
+
+bool RasterizerOpenGL::AccelerateFill(PAddr start, PAddr end, const u8* value, u32 value_size) {
+    if (!Settings::values.use_hw_renderer)
+        return false;
+
+    FlushBatch();
+
+    const u32 size = end - start;
+
+    ColorSurface* color_surface = nullptr;
+    for (auto& surface : color_surfaces) {
+        if (surface.second->addr == start && surface.second->size == size)
+            color_surface = surface.second.get();
+    }
+
+    DepthSurface* depth_surface = nullptr;
+    for (auto& surface : depth_surfaces) {
+        if (surface.second->addr == start && surface.second->size == size)
+            depth_surface = surface.second.get();
+    }
+
+    // Fill values are stored as is, so they have to match the surface's pixel size
+    if (color_surface != nullptr &&
+        Pica::Regs::BytesPerColorPixel(color_surface->texture.format) != value_size) {
+        color_surface = nullptr;
+    }
+
+    if (depth_surface != nullptr &&
+        Pica::Regs::BytesPerDepthPixel(depth_surface->texture.format) != value_size) {
+        depth_surface = nullptr;
+    }
+
+    void* target = color_surface ? static_cast<void*>(color_surface) : static_cast<void*>(depth_surface);
+    if (IsOverlappedByOtherSurface(start, size, target))
+        return false;
+
+    if (color_surface != nullptr) {
+        FillColorSurface(*color_surface, value);
+    } else if (depth_surface != nullptr) {
+        FillDepthSurface(*depth_surface, value);
+    } else {
+        // Nothing holds this region yet, so remember the fill in case it is rendered to next.
+        // Reading the region writes the fill to memory first.
+        DiscardPendingFills(start, size);
+
+        PendingFill fill;
+        fill.addr = start;
+        fill.size = size;
+        std::copy(value, value + value_size, fill.value.begin());
+        fill.value_size = value_size;
+        pending_fills.push_back(fill);
+    }
+
+    res_cache.NotifyFlush(start, size);
+
+    return true;
+}
+
+void RasterizerOpenGL::FillColorSurface(ColorSurface& surface, const u8* value) {
+    Math::Vec4<u8> color;
+    switch (surface.texture.format) {
+    case Pica::Regs::ColorFormat::RGBA8:  color = Color::DecodeRGBA8(value);  break;
+    case Pica::Regs::ColorFormat::RGB8:   color = Color::DecodeRGB8(value);   break;
+    case Pica::Regs::ColorFormat::RGB5A1: color = Color::DecodeRGB5A1(value); break;
+    case Pica::Regs::ColorFormat::RGB565: color = Color::DecodeRGB565(value); break;
+    case Pica::Regs::ColorFormat::RGBA4:  color = Color::DecodeRGBA4(value);  break;
+    default:
+        UNREACHABLE();
+    }
+
+    OpenGLState clear_state = state;
+    clear_state.color_mask.red_enabled = GL_TRUE;
+    clear_state.color_mask.green_enabled = GL_TRUE;
+    clear_state.color_mask.blue_enabled = GL_TRUE;
+    clear_state.color_mask.alpha_enabled = GL_TRUE;
+    clear_state.draw.framebuffer = copy_draw_framebuffer.handle;
+    clear_state.Apply();
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface.texture.texture.handle, 0);
+    glClearColor(color.r() / 255.0f, color.g() / 255.0f, color.b() / 255.0f, color.a() / 255.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    state.Apply();
+
+    surface.dirty = true;
+    surface.sampler_copy_valid = false;
+    DiscardReadback(surface.readback);
+}
+
+void RasterizerOpenGL::FillDepthSurface(DepthSurface& surface, const u8* value) {
+    u32 raw_value = 0;
+    std::memcpy(&raw_value, value, Pica::Regs::BytesPerDepthPixel(surface.texture.format));
+
+    GLenum attachment = GL_DEPTH_ATTACHMENT;
+    GLbitfield mask = GL_DEPTH_BUFFER_BIT;
+
+    OpenGLState clear_state = state;
+    clear_state.depth.write_mask = GL_TRUE;
+    clear_state.stencil.write_mask = 0xFF;
+    clear_state.draw.framebuffer = copy_draw_framebuffer.handle;
+    clear_state.Apply();
+
+    // Surface copies only use the color attachment, so it has to be detached for depth-only clears
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    switch (surface.texture.format) {
+    case Pica::Regs::DepthFormat::D16:
+        glClearDepth(raw_value / 65535.0);
+        break;
+
+    case Pica::Regs::DepthFormat::D24:
+        glClearDepth((raw_value & 0xFFFFFF) / 16777215.0);
+        break;
+
+    case Pica::Regs::DepthFormat::D24S8:
+        glClearDepth((raw_value & 0xFFFFFF) / 16777215.0);
+        glClearStencil(raw_value >> 24);
+        attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+        mask |= GL_STENCIL_BUFFER_BIT;
+        break;
+
+    default:
+        UNREACHABLE();
+    }
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, surface.texture.texture.handle, 0);
+    glClear(mask);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+
+    state.Apply();
+
+    surface.dirty = true;
+    DiscardReadback(surface.readback);
+}
+
+bool RasterizerOpenGL::HasDisplaySurface(PAddr addr, u32 width, u32 height, GPU::Regs::PixelFormat format) const {
+    if (!Settings::values.use_hw_renderer || format > GPU::Regs::PixelFormat::RGBA4)
+        return false;
+
+    return display_surfaces.count(SurfaceKey(addr, (u32)ToColorFormat(format), width, height)) != 0;
+}
+
+bool RasterizerOpenGL::BlitDisplaySurface(PAddr addr, u32 width, u32 height, GPU::Regs::PixelFormat format, GLuint dst_texture) {
+    if (!HasDisplaySurface(addr, width, height, format))
+        return false;
+
+    auto surface = display_surfaces.find(SurfaceKey(addr, (u32)ToColorFormat(format), width, height));
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_read_framebuffer.handle);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface->second->texture.texture.handle, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_draw_framebuffer.handle);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst_texture, 0);
+
+    // The destination is expected to have the same scale as the surface
+    glBlitFramebuffer(0, 0, width * res_scale, height * res_scale, 0, 0, width * res_scale, height * res_scale,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    // Don't keep the destination attached, since it doesn't belong to the rasterizer
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, OpenGLState::GetCurState().draw.framebuffer);
+
+    return true;
+}
+
+void RasterizerOpenGL::BlitTexture(GLuint src_texture, GLsizei src_width, GLsizei src_height,
+                                   GLuint dst_texture, GLsizei dst_width, GLsizei dst_height,
+                                   GLenum attachment, GLbitfield buffers, GLenum filter) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_read_framebuffer.handle);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D, src_texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_draw_framebuffer.handle);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, dst_texture, 0);
+
+    glBlitFramebuffer(0, 0, src_width, src_height, 0, 0, dst_width, dst_height, buffers, filter);
+
+    // Temporary textures are passed in here, so don't leave them attached
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+
+    // Restore the binding tracked by the state
+    glBindFramebuffer(GL_FRAMEBUFFER, state.draw.framebuffer);
+}
+
+void RasterizerOpenGL::ScaleTexture(const TextureInfo& src, TextureInfo& dst) {
+    // Linear filtering averages the covered pixels when scaling down by a factor of two
+    BlitTexture(src.texture.handle, src.width * src.scale, src.height * src.scale,
+                dst.texture.handle, dst.width * dst.scale, dst.height * dst.scale,
+                GL_COLOR_ATTACHMENT0, GL_COLOR_BUFFER_BIT, src.scale > dst.scale ? GL_LINEAR : GL_NEAREST);
+}
+
+void RasterizerOpenGL::ScaleTexture(const DepthTextureInfo& src, DepthTextureInfo& dst) {
+    // Depth and stencil values can't be filtered
+    if (src.format == Pica::Regs::DepthFormat::D24S8) {
+        BlitTexture(src.texture.handle, src.width * src.scale, src.height * src.scale,
+                    dst.texture.handle, dst.width * dst.scale, dst.height * dst.scale,
+                    GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    } else {
+        BlitTexture(src.texture.handle, src.width * src.scale, src.height * src.scale,
+                    dst.texture.handle, dst.width * dst.scale, dst.height * dst.scale,
+                    GL_DEPTH_ATTACHMENT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+}
+
+void RasterizerOpenGL::ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height, u32 scale) {
     GLint internal_format;
 
     texture.format = format;
     texture.width = width;
     texture.height = height;
+    texture.scale = scale;
 
     switch (format) {
     case Pica::Regs::ColorFormat::RGBA8:
@@ -497,19 +807,26 @@ void RasterizerOpenGL::ReconfigureColorTexture(TextureInfo& texture, Pica::Regs:
     state.Apply();
 
     glActiveTexture(GL_TEXTURE0);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width * scale, texture.height * scale, 0,
                  texture.gl_format, texture.gl_type, nullptr);
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
     state.texture_units[0].texture_2d = 0;
     state.Apply();
 }
 
-void RasterizerOpenGL::ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height) {
+void RasterizerOpenGL::ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height, u32 scale) {
     GLint internal_format;
 
     texture.format = format;
     texture.width = width;
     texture.height = height;
+    texture.scale = scale;
 
     switch (format) {
     case Pica::Regs::DepthFormat::D16:
@@ -541,9 +858,17 @@ void RasterizerOpenGL::ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::
     state.Apply();
 
     glActiveTexture(GL_TEXTURE0);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width * scale, texture.height * scale, 0,
                  texture.gl_format, texture.gl_type, nullptr);
 
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
     state.texture_units[0].texture_2d = 0;
     state.Apply();
 }
@@ -551,73 +876,314 @@ void RasterizerOpenGL::ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::
 void RasterizerOpenGL::SyncFramebuffer() {
     const auto& regs = Pica::g_state.regs;
 
+    u32 width = regs.framebuffer.GetWidth();
+    u32 height = regs.framebuffer.GetHeight();
+
     PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
     Pica::Regs::ColorFormat new_fb_color_format = regs.framebuffer.color_format;
+    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(new_fb_color_format) * width * height;
+    SurfaceKey color_key(cur_fb_color_addr, (u32)new_fb_color_format, width, height);
+
+    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
+    Pica::Regs::DepthFormat new_fb_depth_format = regs.framebuffer.depth_format;
+    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(new_fb_depth_format) * width * height;
+    SurfaceKey depth_key(cur_fb_depth_addr, (u32)new_fb_depth_format, width, height);
+
+    bool attachments_changed = false;
+
+    auto color_surface = color_surfaces.find(color_key);
+    if (color_surface == color_surfaces.end()) {
+        // A deferred fill of exactly this framebuffer is applied to the new surface, without ever touching memory
+        PendingFill fill;
+        bool filled = TakePendingFill(cur_fb_color_addr, cur_fb_color_size,
+                                      Pica::Regs::BytesPerColorPixel(new_fb_color_format), fill);
+
+        // Make sure memory holds the latest data of any surface in the way before loading from it
+        CommitSurfaces(cur_fb_color_addr, cur_fb_color_size);
+        EraseSurfaces(cur_fb_color_addr, cur_fb_color_size);
+
+        std::unique_ptr<ColorSurface> new_surface = Common::make_unique<ColorSurface>();
+        new_surface->addr = cur_fb_color_addr;
+        new_surface->size = cur_fb_color_size;
+        new_surface->dirty = false;
+        new_surface->sampler_copy_valid = false;
+
+        new_surface->texture.texture.Create();
+        ReconfigureColorTexture(new_surface->texture, new_fb_color_format, width, height, res_scale);
+        if (filled) {
+            FillColorSurface(*new_surface, fill.value.data());
+        } else {
+            ReloadColorBuffer(*new_surface);
+        }
+
+        color_surface = color_surfaces.emplace(color_key, std::move(new_surface)).first;
+    }
+
+    if (color_surface->second.get() != cur_color_surface) {
+        // Rendering to the previous surface is done for now, so its readback can be queued already.
+        // It's only waited for when its memory is used, by which time it has usually completed.
+        if (cur_color_surface != nullptr)
+            StartColorReadback(*cur_color_surface);
+
+        cur_color_surface = color_surface->second.get();
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cur_color_surface->texture.texture.handle, 0);
+        attachments_changed = true;
+    }
+
+    auto depth_surface = depth_surfaces.find(depth_key);
+    if (depth_surface == depth_surfaces.end()) {
+        PendingFill fill;
+        bool filled = TakePendingFill(cur_fb_depth_addr, cur_fb_depth_size,
+                                      Pica::Regs::BytesPerDepthPixel(new_fb_depth_format), fill);
+
+        CommitSurfaces(cur_fb_depth_addr, cur_fb_depth_size);
+        EraseSurfaces(cur_fb_depth_addr, cur_fb_depth_size);
+
+        std::unique_ptr<DepthSurface> new_surface = Common::make_unique<DepthSurface>();
+        new_surface->addr = cur_fb_depth_addr;
+        new_surface->size = cur_fb_depth_size;
+        new_surface->dirty = false;
+
+        new_surface->texture.texture.Create();
+        ReconfigureDepthTexture(new_surface->texture, new_fb_depth_format, width, height, res_scale);
+        if (filled) {
+            FillDepthSurface(*new_surface, fill.value.data());
+        } else {
+            ReloadDepthBuffer(*new_surface);
+        }
+
+        depth_surface = depth_surfaces.emplace(depth_key, std::move(new_surface)).first;
+    }
+
+    if (depth_surface->second.get() != cur_depth_surface) {
+        if (cur_depth_surface != nullptr)
+            StartDepthReadback(*cur_depth_surface);
+
+        cur_depth_surface = depth_surface->second.get();
+        GLuint depth_handle = cur_depth_surface->texture.texture.handle;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_handle, 0);
+
+        // Only attach depth buffer as stencil if it supports stencil
+        switch (new_fb_depth_format) {
+        case Pica::Regs::DepthFormat::D16:
+        case Pica::Regs::DepthFormat::D24:
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+            break;
+
+        case Pica::Regs::DepthFormat::D24S8:
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_handle, 0);
+            break;
+
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", new_fb_depth_format);
+            UNIMPLEMENTED();
+            break;
+        }
+
+        attachments_changed = true;
+    }
+
+    if (attachments_changed) {
+        ASSERT_MSG(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+                   "OpenGL rasterizer framebuffer setup failed, status %X", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    }
+}
+
+void RasterizerOpenGL::CommitSurfaces(PAddr addr, u32 size) {
+    CommitPendingFills(addr, size);
+
+    for (auto& surface : color_surfaces) {
+        ColorSurface& color_surface = *surface.second;
+        if ((color_surface.dirty || color_surface.readback.IsPending()) &&
+            MathUtil::IntervalsIntersect(addr, size, color_surface.addr, color_surface.size))
+            CommitColorBuffer(color_surface);
+    }
+
+    for (auto& surface : depth_surfaces) {
+        DepthSurface& depth_surface = *surface.second;
+        if ((depth_surface.dirty || depth_surface.readback.IsPending()) &&
+            MathUtil::IntervalsIntersect(addr, size, depth_surface.addr, depth_surface.size))
+            CommitDepthBuffer(depth_surface);
+    }
+
+    for (auto& surface : display_surfaces) {
+        ColorSurface& display_surface = *surface.second;
+        if (display_surface.dirty && MathUtil::IntervalsIntersect(addr, size, display_surface.addr, display_surface.size))
+            CommitDisplaySurface(display_surface);
+    }
+}
+
+void RasterizerOpenGL::EraseSurfaces(PAddr addr, u32 size) {
+    for (auto it = color_surfaces.begin(); it != color_surfaces.end();) {
+        if (it->second.get() != cur_color_surface &&
+            MathUtil::IntervalsIntersect(addr, size, it->second->addr, it->second->size)) {
+            it = color_surfaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = depth_surfaces.begin(); it != depth_surfaces.end();) {
+        if (it->second.get() != cur_depth_surface &&
+            MathUtil::IntervalsIntersect(addr, size, it->second->addr, it->second->size)) {
+            it = depth_surfaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = display_surfaces.begin(); it != display_surfaces.end();) {
+        if (MathUtil::IntervalsIntersect(addr, size, it->second->addr, it->second->size)) {
+            it = display_surfaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RasterizerOpenGL::DiscardSurfaces() {
+    // Detach the surfaces before deleting their textures
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+
+    cur_color_surface = nullptr;
+    cur_depth_surface = nullptr;
+    color_surfaces.clear();
+    depth_surfaces.clear();
+    display_surfaces.clear();
+    pending_fills.clear();
+}
+
+void RasterizerOpenGL::CommitPendingFills(PAddr addr, u32 size) {
+    auto it = std::remove_if(pending_fills.begin(), pending_fills.end(), [addr, size](const PendingFill& fill) {
+        if (!MathUtil::IntervalsIntersect(addr, size, fill.addr, fill.size))
+            return false;
+
+        WritePendingFill(fill, fill.addr, fill.addr + fill.size);
+        return true;
+    });
+    pending_fills.erase(it, pending_fills.end());
+}
+
+void RasterizerOpenGL::DiscardPendingFills(PAddr addr, u32 size) {
+    auto it = std::remove_if(pending_fills.begin(), pending_fills.end(), [addr, size](const PendingFill& fill) {
+        if (!MathUtil::IntervalsIntersect(addr, size, fill.addr, fill.size))
+            return false;
+
+        // Keep whatever the fill covers on either side of the overwritten region
+        WritePendingFill(fill, fill.addr, addr);
+        WritePendingFill(fill, addr + size, fill.addr + fill.size);
+        return true;
+    });
+    pending_fills.erase(it, pending_fills.end());
+}
+
+bool RasterizerOpenGL::TakePendingFill(PAddr addr, u32 size, u32 value_size, PendingFill& fill) {
+    auto it = std::find_if(pending_fills.begin(), pending_fills.end(), [=](const PendingFill& fill) {
+        return fill.addr == addr && fill.size == size && fill.value_size == value_size;
+    });
+    if (it == pending_fills.end())
+        return false;
+
+    fill = *it;
+    pending_fills.erase(it);
+    return true;
+}
+
+void RasterizerOpenGL::WritePendingFill(const PendingFill& fill, PAddr begin, PAddr end) {
+    begin = std::max(begin, fill.addr);
+    end = std::min(end, fill.addr + fill.size);
+    if (begin >= end)
+        return;
+
+    u8* start = Memory::GetPhysicalPointer(begin);
+    if (start == nullptr)
+        return;
+
+    GPU::MemoryFill::Fill(start, start + (end - begin), fill.value.data(), fill.value_size,
+                          (begin - fill.addr) % fill.value_size);
+    Memory::RecordPhysicalWrite(begin, end - begin);
+}
+
+bool RasterizerOpenGL::IsOverlappedByOtherSurface(PAddr addr, u32 size, const void* except) const {
+    for (const auto& surface : color_surfaces) {
+        if (surface.second.get() != except && MathUtil::IntervalsIntersect(addr, size, surface.second->addr, surface.second->size))
+            return true;
+    }
 
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    Pica::Regs::DepthFormat new_fb_depth_format = regs.framebuffer.depth_format;
+    for (const auto& surface : depth_surfaces) {
+        if (surface.second.get() != except && MathUtil::IntervalsIntersect(addr, size, surface.second->addr, surface.second->size))
+            return true;
+    }
+
+    for (const auto& surface : display_surfaces) {
+        if (surface.second.get() != except && MathUtil::IntervalsIntersect(addr, size, surface.second->addr, surface.second->size))
+            return true;
+    }
 
-    bool fb_size_changed = fb_color_texture.width != regs.framebuffer.GetWidth() ||
-                           fb_color_texture.height != regs.framebuffer.GetHeight();
+    return false;
+}
 
-    bool color_fb_prop_changed = fb_color_texture.format != new_fb_color_format ||
-                                 fb_size_changed;
+RasterizerOpenGL::ColorSurface* RasterizerOpenGL::FindTextureSurface(const Pica::Regs::FullTextureConfig& config) {
+    // Only texture formats with a matching color buffer format can have been rendered to
+    if (config.format > Pica::Regs::TextureFormat::RGBA4)
+        return nullptr;
 
-    bool depth_fb_prop_changed = fb_depth_texture.format != new_fb_depth_format ||
-                                 fb_size_changed;
+    SurfaceKey key(config.config.GetPhysicalAddress(), (u32)config.format,
+                   config.config.width, config.config.height);
 
-    bool color_fb_modified = last_fb_color_addr != cur_fb_color_addr ||
-                             color_fb_prop_changed;
+    auto it = color_surfaces.find(key);
+    return it != color_surfaces.end() ? it->second.get() : nullptr;
+}
 
-    bool depth_fb_modified = last_fb_depth_addr != cur_fb_depth_addr ||
-                             depth_fb_prop_changed;
+void RasterizerOpenGL::BindSurfaceAsTexture(ColorSurface& surface, unsigned texture_unit,
+                                            const Pica::Regs::FullTextureConfig& config) {
+    GLsizei width = surface.texture.width * surface.texture.scale;
+    GLsizei height = surface.texture.height * surface.texture.scale;
 
-    // Commit if framebuffer modified in any way
-    if (color_fb_modified)
-        CommitColorBuffer();
+    if (surface.sampler_copy.handle == 0) {
+        surface.sampler_copy.Create();
 
-    if (depth_fb_modified)
-        CommitDepthBuffer();
+        state.texture_units[texture_unit].texture_2d = surface.sampler_copy.handle;
+        state.Apply();
 
-    // Reconfigure framebuffer textures if any property has changed
-    if (color_fb_prop_changed) {
-        ReconfigureColorTexture(fb_color_texture, new_fb_color_format,
-                                regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
+        glActiveTexture(GL_TEXTURE0 + texture_unit);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
     }
 
-    if (depth_fb_prop_changed) {
-        ReconfigureDepthTexture(fb_depth_texture, new_fb_depth_format,
-                                regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
+    if (!surface.sampler_copy_valid) {
+        // Textures loaded from 3DS memory are stored bottom row first, while framebuffers are
+        // stored top row first, so copy the surface upside down on the GPU.
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_read_framebuffer.handle);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface.texture.texture.handle, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_draw_framebuffer.handle);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface.sampler_copy.handle, 0);
 
-        // Only attach depth buffer as stencil if it supports stencil
-        switch (new_fb_depth_format) {
-        case Pica::Regs::DepthFormat::D16:
-        case Pica::Regs::DepthFormat::D24:
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
-            break;
+        glBlitFramebuffer(0, 0, width, height, 0, height, width, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 
-        case Pica::Regs::DepthFormat::D24S8:
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, fb_depth_texture.texture.handle, 0);
-            break;
+        // Restore the binding tracked by the state
+        glBindFramebuffer(GL_FRAMEBUFFER, state.draw.framebuffer);
 
-        default:
-            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", new_fb_depth_format);
-            UNIMPLEMENTED();
-            break;
-        }
+        surface.sampler_copy_valid = true;
     }
 
-    // Load buffer data again if fb modified in any way
-    if (color_fb_modified) {
-        last_fb_color_addr = cur_fb_color_addr;
+    state.texture_units[texture_unit].texture_2d = surface.sampler_copy.handle;
+    state.Apply();
 
-        ReloadColorBuffer();
-    }
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, PicaToGL::TextureFilterMode(config.config.mag_filter));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, PicaToGL::TextureFilterMode(config.config.min_filter));
 
-    if (depth_fb_modified) {
-        last_fb_depth_addr = cur_fb_depth_addr;
+    GLenum wrap_s = PicaToGL::WrapMode(config.config.wrap_s);
+    GLenum wrap_t = PicaToGL::WrapMode(config.config.wrap_t);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
 
-        ReloadDepthBuffer();
+    if (wrap_s == GL_CLAMP_TO_BORDER || wrap_t == GL_CLAMP_TO_BORDER) {
+        auto border_color = PicaToGL::ColorRGBA8((u8*)&config.config.border_color.r);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color.data());
     }
 }
 
@@ -668,9 +1234,11 @@ void RasterizerOpenGL::SyncBlendColor() {
 
 void RasterizerOpenGL::SyncAlphaTest() {
     const auto& regs = Pica::g_state.regs;
-    glUniform1i(uniform_alphatest_enabled, regs.output_merger.alpha_test.enable);
-    glUniform1i(uniform_alphatest_func, (GLint)regs.output_merger.alpha_test.func.Value());
-    glUniform1f(uniform_alphatest_ref, regs.output_merger.alpha_test.ref / 255.0f);
+    uniform_data.alphatest_ref = regs.output_merger.alpha_test.ref / 255.0f;
+    uniform_data_dirty = true;
+
+    // The comparison function is baked into the generated shader
+    shader_dirty = true;
 }
 
 void RasterizerOpenGL::SyncLogicOp() {
@@ -692,56 +1260,415 @@ void RasterizerOpenGL::SyncDepthTest() {
     state.depth.write_mask = regs.output_merger.depth_write_enable ? GL_TRUE : GL_FALSE;
 }
 
-void RasterizerOpenGL::SyncTevSources(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    GLint color_srcs[3] = { (GLint)config.color_source1.Value(),
-                            (GLint)config.color_source2.Value(),
-                            (GLint)config.color_source3.Value() };
-    GLint alpha_srcs[3] = { (GLint)config.alpha_source1.Value(),
-                            (GLint)config.alpha_source2.Value(),
-                            (GLint)config.alpha_source3.Value() };
+void RasterizerOpenGL::SyncTevColor(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
+    uniform_data.tev_const_colors[stage_index] = PicaToGL::ColorRGBA8((u8*)&config.const_r);
+    uniform_data_dirty = true;
+}
 
-    glUniform3iv(uniform_tev_cfgs[stage_index].color_sources, 1, color_srcs);
-    glUniform3iv(uniform_tev_cfgs[stage_index].alpha_sources, 1, alpha_srcs);
+void RasterizerOpenGL::SyncCombinerColor() {
+    uniform_data.tev_combiner_buffer_color = PicaToGL::ColorRGBA8((u8*)&Pica::g_state.regs.tev_combiner_buffer_color.r);
+    uniform_data_dirty = true;
 }
 
-void RasterizerOpenGL::SyncTevModifiers(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    GLint color_mods[3] = { (GLint)config.color_modifier1.Value(),
-                            (GLint)config.color_modifier2.Value(),
-                            (GLint)config.color_modifier3.Value() };
-    GLint alpha_mods[3] = { (GLint)config.alpha_modifier1.Value(),
-                            (GLint)config.alpha_modifier2.Value(),
-                            (GLint)config.alpha_modifier3.Value() };
+void RasterizerOpenGL::DrawBatchInChunks() {
+    // Only single draws larger than the stream buffers end up here, so this doesn't need to be fast
+    const size_t max_vertices = vertex_buffer.GetSize() / sizeof(HardwareVertex) / 3 * 3;
+
+    for (size_t first = 0; first < index_batch.size(); first += max_vertices) {
+        size_t count = std::min(index_batch.size() - first, max_vertices);
+        GLsizeiptr size = count * sizeof(HardwareVertex);
+
+        auto mapped = vertex_buffer.Map(size, sizeof(HardwareVertex));
+        for (size_t i = 0; i < count; ++i)
+            std::memcpy(mapped.first + i * sizeof(HardwareVertex), &vertex_batch[index_batch[first + i]], sizeof(HardwareVertex));
+        vertex_buffer.Unmap(size);
 
-    glUniform3iv(uniform_tev_cfgs[stage_index].color_modifiers, 1, color_mods);
-    glUniform3iv(uniform_tev_cfgs[stage_index].alpha_modifiers, 1, alpha_mods);
+        glDrawArrays(GL_TRIANGLES, (GLint)(mapped.second / sizeof(HardwareVertex)), (GLsizei)count);
+    }
 }
 
-void RasterizerOpenGL::SyncTevOps(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    glUniform2i(uniform_tev_cfgs[stage_index].color_alpha_op, (GLint)config.color_op.Value(), (GLint)config.alpha_op.Value());
+void RasterizerOpenGL::DrawUnshadedBatch() {
+    const HostShadedProgram& program = GetHostShadedProgram();
+
+    // The fixed vertex attributes of the program bound by SyncDrawState may overlap the raw ones
+    if (current_shader != nullptr) {
+        glDisableVertexAttribArray(current_shader->attrib_position);
+        glDisableVertexAttribArray(current_shader->attrib_color);
+        glDisableVertexAttribArray(current_shader->attrib_texcoords);
+        glDisableVertexAttribArray(current_shader->attrib_texcoords + 1);
+        glDisableVertexAttribArray(current_shader->attrib_texcoords + 2);
+    }
+
+    state.draw.shader_program = program.shader.shader.handle;
+    state.Apply();
+
+    SyncVSUniforms();
+
+    const unsigned num_attributes = current_vs_config.num_attributes;
+    const GLsizei stride = num_attributes * 4 * sizeof(GLfloat);
+
+    if (program.attrib_attributes != -1) {
+        for (unsigned attribute = 0; attribute < num_attributes; ++attribute) {
+            glVertexAttribPointer(program.attrib_attributes + attribute, 4, GL_FLOAT, GL_FALSE, stride,
+                                  (GLvoid*)(attribute * 4 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(program.attrib_attributes + attribute);
+        }
+    }
+
+    const size_t num_vertices = unshaded_vertex_batch.size() * sizeof(GLfloat) / stride;
+    const size_t max_vertices = vertex_buffer.GetSize() / stride / 3 * 3;
+
+    for (size_t first = 0; first < num_vertices; first += max_vertices) {
+        size_t count = std::min(num_vertices - first, max_vertices);
+        GLsizeiptr size = count * stride;
+
+        auto mapped = vertex_buffer.Map(size, stride);
+        std::memcpy(mapped.first, &unshaded_vertex_batch[first * stride / sizeof(GLfloat)], size);
+        vertex_buffer.Unmap(size);
+
+        glDrawArrays(GL_TRIANGLES, (GLint)(mapped.second / stride), (GLsizei)count);
+    }
+
+    unshaded_vertex_batch.clear();
+
+    if (program.attrib_attributes != -1) {
+        for (unsigned attribute = 0; attribute < num_attributes; ++attribute)
+            glDisableVertexAttribArray(program.attrib_attributes + attribute);
+    }
+
+    // Bind the regular program and its vertex attributes again on the next draw
+    current_shader = nullptr;
+    shader_dirty = true;
 }
 
-void RasterizerOpenGL::SyncTevColor(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    auto const_color = PicaToGL::ColorRGBA8((u8*)&config.const_r);
-    glUniform4fv(uniform_tev_cfgs[stage_index].const_color, 1, const_color.data());
+const RasterizerOpenGL::HostShadedProgram& RasterizerOpenGL::GetHostShadedProgram() {
+    PicaShaderConfig fragment_config = PicaShaderConfig::CurrentConfig();
+    u64 key = Common::ComputeHash64(&current_vs_config, sizeof(current_vs_config));
+    key = Common::ComputeHash64(&fragment_config, sizeof(fragment_config), key);
+
+    std::unique_ptr<HostShadedProgram>& cached_program = host_shaded_programs[key];
+    if (cached_program != nullptr)
+        return *cached_program;
+
+    cached_program = Common::make_unique<HostShadedProgram>();
+    HostShadedProgram& program = *cached_program;
+
+    LinkShader(program.shader, current_vertex_shader->c_str(), fragment_config);
+
+    program.attrib_attributes = glGetAttribLocation(program.shader.shader.handle, "vert_attributes");
+
+    GLuint block_index = glGetUniformBlockIndex(program.shader.shader.handle, "vs_uniforms");
+    if (block_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program.shader.shader.handle, block_index, UNIFORM_BINDING_VS_UNIFORMS);
+
+    LOG_DEBUG(Render_OpenGL, "Linked host shaded program %u, %u programs cached",
+              program.shader.shader.handle, (unsigned)host_shaded_programs.size());
+
+    return program;
 }
 
-void RasterizerOpenGL::SyncTevMultipliers(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    glUniform2i(uniform_tev_cfgs[stage_index].color_alpha_multiplier, config.GetColorMultiplier(), config.GetAlphaMultiplier());
+void RasterizerOpenGL::LinkShader(PicaShader& shader, const char* vertex_shader, const PicaShaderConfig& config) {
+    std::string fragment_shader = GLShaders::GenerateFragmentShader(config);
+    shader.shader.Create(vertex_shader, fragment_shader.c_str());
+    FinishShader(shader);
 }
 
-void RasterizerOpenGL::SyncCombinerColor() {
-    auto combiner_color = PicaToGL::ColorRGBA8((u8*)&Pica::g_state.regs.tev_combiner_buffer_color.r);
-    glUniform4fv(uniform_tev_combiner_buffer_color, 1, combiner_color.data());
+void RasterizerOpenGL::FinishShader(PicaShader& shader) {
+    shader.attrib_position = glGetAttribLocation(shader.shader.handle, "vert_position");
+    shader.attrib_color = glGetAttribLocation(shader.shader.handle, "vert_color");
+    shader.attrib_texcoords = glGetAttribLocation(shader.shader.handle, "vert_texcoords");
+
+    shader.uniform_tex = glGetUniformLocation(shader.shader.handle, "tex");
+
+    // The block is optimized out of shaders which use neither constant colors nor alpha testing
+    GLuint block_index = glGetUniformBlockIndex(shader.shader.handle, "shader_data");
+    if (block_index != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader.shader.handle, block_index, UNIFORM_BINDING_SHADER_DATA);
+
+    GLuint previous_program = state.draw.shader_program;
+    state.draw.shader_program = shader.shader.handle;
+    state.Apply();
+
+    // Set the texture samplers to correspond to different texture units
+    glUniform1i(shader.uniform_tex, 0);
+    glUniform1i(shader.uniform_tex + 1, 1);
+    glUniform1i(shader.uniform_tex + 2, 2);
+
+    state.draw.shader_program = previous_program;
+    state.Apply();
+
+    shader.linked = true;
 }
 
-void RasterizerOpenGL::SyncCombinerWriteFlags() {
-    const auto& regs = Pica::g_state.regs;
-    const auto tev_stages = regs.GetTevStages();
-    for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        glUniform2i(uniform_tev_cfgs[tev_stage_index].updates_combiner_buffer_color_alpha,
-                    regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index),
-                    regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index));
+RasterizerOpenGL::PicaShader* RasterizerOpenGL::CreateShader(const PicaShaderConfig& config) {
+    std::unique_ptr<PicaShader>& cached_shader = shader_cache[config];
+    cached_shader = Common::make_unique<PicaShader>();
+
+    PicaShader& shader = *cached_shader;
+
+    // Programs compiled in the background are finished by SetShader once they're ready
+    switch (shader_compile_mode) {
+    case ShaderCompileMode::Immediate:
+        LinkShader(shader, GLShaders::g_vertex_shader_hw, config);
+        break;
+
+    case ShaderCompileMode::DriverParallel:
+        shader.shader.CreateAsync(GLShaders::g_vertex_shader_hw, GLShaders::GenerateFragmentShader(config).c_str());
+        break;
+
+    case ShaderCompileMode::WorkerThread:
+        {
+            std::lock_guard<std::mutex> lock(compile_mutex);
+            compile_jobs.push_back({ &shader, GLShaders::GenerateFragmentShader(config) });
+        }
+        compile_available.notify_one();
+
+        // The handle is only known once the worker is done with it
+        LOG_DEBUG(Render_OpenGL, "Queued shader, %u shaders cached", (unsigned)shader_cache.size());
+        return &shader;
+    }
+
+    LOG_DEBUG(Render_OpenGL, "Generated shader %u, %u shaders cached",
+              shader.shader.handle, (unsigned)shader_cache.size());
+
+    return &shader;
+}
+
+bool RasterizerOpenGL::PollShader(PicaShader& shader) {
+    if (shader_compile_mode == ShaderCompileMode::DriverParallel) {
+        if (!ShaderUtil::IsProgramReady(shader.shader.handle))
+            return false;
+        ShaderUtil::FinishProgram(shader.shader.handle);
+    } else {
+        GLsync fence;
+        {
+            std::lock_guard<std::mutex> lock(compile_mutex);
+            fence = shader.compile_fence;
+        }
+        if (fence == nullptr)
+            return false;
+
+        // The program was created in the worker's context, so it may only be used once the
+        // commands which linked it have completed
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            return false;
+
+        glDeleteSync(fence);
+        shader.compile_fence = nullptr;
+    }
+
+    FinishShader(shader);
+    return true;
+}
+
+const RasterizerOpenGL::PicaShader* RasterizerOpenGL::SetUberShader(const PicaShaderConfig& config) {
+    if (!uber_config_valid || !(uber_config == config)) {
+        UberConfigData data;
+        std::memset(&data, 0, sizeof(data));
+        for (unsigned i = 0; i < data.tev_stages.size(); ++i) {
+            const auto& stage = config.tev_stages[i];
+            data.tev_stages[i] = {{ stage.sources_raw, stage.modifiers_raw, stage.ops_raw, stage.scales_raw }};
+        }
+        data.alpha_test_func = static_cast<GLuint>(config.alpha_test_func);
+        data.combiner_buffer_updates = config.combiner_buffer_updates;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, uber_config_buffer.handle);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UberConfigData), &data);
+
+        uber_config = config;
+        uber_config_valid = true;
+    }
+
+    // Check again on the next draw whether the generated program has become ready
+    shader_dirty = true;
+    return &uber_shader;
+}
+
+void RasterizerOpenGL::LoadDiskShaderCache() {
+    disk_shader_cache_loaded = true;
+
+    if (Kernel::g_current_process == nullptr)
+        return;
+
+    class ConfigReader : public LinearDiskCacheReader<PicaShaderConfig, u8> {
+    public:
+        void Read(const PicaShaderConfig& key, const u8* value, u32 value_size) override {
+            configs.push_back(key);
+        }
+
+        std::vector<PicaShaderConfig> configs;
+    };
+
+    const std::string& cache_dir = FileUtil::GetUserPath(D_SHADERCACHE_IDX);
+    if (!FileUtil::CreateFullPath(cache_dir))
+        return;
+
+    u64 program_id = Kernel::g_current_process->codeset->program_id;
+    std::string filename = Common::StringFromFormat("%s%08x%08x.gl.bin", cache_dir.c_str(),
+                                                    (u32)(program_id >> 32), (u32)(program_id & 0xFFFFFFFF));
+
+    ConfigReader reader;
+    disk_shader_cache.OpenAndRead(filename.c_str(), reader);
+
+    for (const auto& config : reader.configs) {
+        if (shader_cache.find(config) == shader_cache.end())
+            CreateShader(config);
+    }
+
+    LOG_INFO(Render_OpenGL, "Precompiled %u shaders from %s", (unsigned)reader.configs.size(), filename.c_str());
+}
+
+void RasterizerOpenGL::SetShader() {
+    if (!disk_shader_cache_loaded)
+        LoadDiskShaderCache();
+
+    PicaShaderConfig config = PicaShaderConfig::CurrentConfig();
+
+    PicaShader* generated_shader;
+    auto cached_shader = shader_cache.find(config);
+    if (cached_shader != shader_cache.end()) {
+        generated_shader = cached_shader->second.get();
+    } else {
+        generated_shader = CreateShader(config);
+
+        // Remember the configuration so that the next run of this title can compile it up front
+        disk_shader_cache.Append(config, nullptr, 0);
+        disk_shader_cache.Sync();
+    }
+
+    // Programs compiling in the background are only waited for once the driver is done with them
+    const PicaShader* shader = generated_shader;
+    if (!generated_shader->linked && !PollShader(*generated_shader))
+        shader = SetUberShader(config);
+
+    const PicaShader* previous_shader = current_shader;
+    current_shader = shader;
+
+    if (current_shader == previous_shader)
+        return;
+
+    state.draw.shader_program = current_shader->shader.handle;
+    state.Apply();
+
+    // Attribute locations aren't guaranteed to be identical between programs, so re-point the
+    // vertex attributes whenever they differ from the ones of the previously bound shader.
+    if (previous_shader == nullptr ||
+        previous_shader->attrib_position != current_shader->attrib_position ||
+        previous_shader->attrib_color != current_shader->attrib_color ||
+        previous_shader->attrib_texcoords != current_shader->attrib_texcoords) {
+
+        if (previous_shader != nullptr) {
+            glDisableVertexAttribArray(previous_shader->attrib_position);
+            glDisableVertexAttribArray(previous_shader->attrib_color);
+            glDisableVertexAttribArray(previous_shader->attrib_texcoords);
+            glDisableVertexAttribArray(previous_shader->attrib_texcoords + 1);
+            glDisableVertexAttribArray(previous_shader->attrib_texcoords + 2);
+        }
+
+        GLuint attrib_position = current_shader->attrib_position;
+        GLuint attrib_color = current_shader->attrib_color;
+        GLuint attrib_texcoords = current_shader->attrib_texcoords;
+
+        glVertexAttribPointer(attrib_position, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, position));
+        glVertexAttribPointer(attrib_color, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, color));
+        glVertexAttribPointer(attrib_texcoords, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord0));
+        glVertexAttribPointer(attrib_texcoords + 1, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord1));
+        glVertexAttribPointer(attrib_texcoords + 2, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord2));
+        glEnableVertexAttribArray(attrib_position);
+        glEnableVertexAttribArray(attrib_color);
+        glEnableVertexAttribArray(attrib_texcoords);
+        glEnableVertexAttribArray(attrib_texcoords + 1);
+        glEnableVertexAttribArray(attrib_texcoords + 2);
+    }
+}
+
+void RasterizerOpenGL::CompileWorkerLoop() {
+    Common::SetCurrentThreadName("ShaderCompiler");
+    compile_context->MakeCurrent();
+
+    while (true) {
+        CompileJob job;
+        {
+            std::unique_lock<std::mutex> lock(compile_mutex);
+            compile_available.wait(lock, [this]{ return !compile_jobs.empty() || !compile_running; });
+            if (!compile_running)
+                break;
+            job = std::move(compile_jobs.front());
+            compile_jobs.pop_front();
+        }
+
+        GLuint program = ShaderUtil::LoadShaders(GLShaders::g_vertex_shader_hw, job.fragment_shader.c_str());
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(compile_mutex);
+        job.shader->shader.handle = program;
+        job.shader->compile_fence = fence;
     }
+
+    compile_context->DoneCurrent();
+}
+
+void RasterizerOpenGL::SyncUniforms() {
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer.handle);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UniformData), &uniform_data);
+}
+
+void RasterizerOpenGL::SyncVSUniforms() {
+    const auto& uniforms = Pica::g_state.vs.uniforms;
+
+    VSUniformData data;
+    for (unsigned i = 0; i < data.f.size(); ++i) {
+        for (unsigned comp = 0; comp < 4; ++comp)
+            data.f[i][comp] = uniforms.f[i][comp].ToFloat32();
+    }
+    for (unsigned i = 0; i < data.i.size(); ++i) {
+        for (unsigned comp = 0; comp < 4; ++comp)
+            data.i[i][comp] = uniforms.i[i][comp];
+    }
+
+    // Consecutive draws often use the same matrices, comparing is far cheaper than uploading
+    if (std::memcmp(&data, &vs_uniform_data, sizeof(data)) == 0)
+        return;
+
+    vs_uniform_data = data;
+    glBindBuffer(GL_UNIFORM_BUFFER, vs_uniform_buffer.handle);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(VSUniformData), &vs_uniform_data);
+}
+
+void RasterizerOpenGL::SyncDirtyState() {
+    if (dirty_flags == 0)
+        return;
+
+    if (dirty_flags & DirtyCullMode)
+        SyncCullMode();
+    if (dirty_flags & DirtyBlendEnabled)
+        SyncBlendEnabled();
+    if (dirty_flags & DirtyBlendFuncs)
+        SyncBlendFuncs();
+    if (dirty_flags & DirtyBlendColor)
+        SyncBlendColor();
+    if (dirty_flags & DirtyAlphaTest)
+        SyncAlphaTest();
+    if (dirty_flags & DirtyLogicOp)
+        SyncLogicOp();
+    if (dirty_flags & DirtyStencilTest)
+        SyncStencilTest();
+    if (dirty_flags & DirtyDepthTest)
+        SyncDepthTest();
+
+    if (dirty_flags & DirtyTevColors) {
+        const auto tev_stages = Pica::g_state.regs.GetTevStages();
+        for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
+            SyncTevColor(tev_stage_index, tev_stages[tev_stage_index]);
+        }
+    }
+
+    if (dirty_flags & DirtyCombinerColor)
+        SyncCombinerColor();
+
+    dirty_flags = 0;
 }
 
 void RasterizerOpenGL::SyncDrawState() {
@@ -754,39 +1681,94 @@ void RasterizerOpenGL::SyncDrawState() {
     // OpenGL uses different y coordinates, so negate corner offset and flip origin
     // TODO: Ensure viewport_corner.x should not be negated or origin flipped
     // TODO: Use floating-point viewports for accuracy if supported
-    glViewport((GLsizei)static_cast<float>(regs.viewport_corner.x),
-                -(GLsizei)static_cast<float>(regs.viewport_corner.y)
-                    + regs.framebuffer.GetHeight() - viewport_height,
-                viewport_width, viewport_height);
+    GLint viewport_x = (GLint)static_cast<float>(regs.viewport_corner.x);
+    GLint viewport_y = -(GLint)static_cast<float>(regs.viewport_corner.y)
+                       + regs.framebuffer.GetHeight() - viewport_height;
+    glViewport(viewport_x * res_scale, viewport_y * res_scale,
+               viewport_width * res_scale, viewport_height * res_scale);
 
-    // Sync bound texture(s), upload if not cached
     const auto pica_textures = regs.GetTextures();
+
+    // Textures which weren't rendered to as a whole are loaded from memory, so it has to hold the
+    // latest rendering results first. This is done up front since committing rebinds texture unit 0.
+    for (const auto& texture : pica_textures) {
+        if (texture.enabled && FindTextureSurface(texture) == nullptr) {
+            const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
+            CommitSurfaces(texture.config.GetPhysicalAddress(),
+                           info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2);
+        }
+    }
+
+    // Sync bound texture(s), upload if not cached
     for (unsigned texture_index = 0; texture_index < pica_textures.size(); ++texture_index) {
         const auto& texture = pica_textures[texture_index];
 
         if (texture.enabled) {
             state.texture_units[texture_index].enabled_2d = true;
-            res_cache.LoadAndBindTexture(state, texture_index, texture);
+
+            // Sample textures which have been rendered to straight from their surface
+            ColorSurface* surface = FindTextureSurface(texture);
+            if (surface != nullptr) {
+                BindSurfaceAsTexture(*surface, texture_index, texture);
+            } else {
+                res_cache.LoadAndBindTexture(state, texture_decoder, texture_index, texture);
+            }
         } else {
             state.texture_units[texture_index].enabled_2d = false;
         }
     }
 
-    // Skip processing TEV stages that simply pass the previous stage results through
-    const auto tev_stages = regs.GetTevStages();
-    for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        glUniform1i(uniform_tev_cfgs[tev_stage_index].enabled, !IsPassThroughTevStage(tev_stages[tev_stage_index]));
+    SyncDirtyState();
+
+    // Bind the shader generated for the current TEV and alpha test configuration
+    if (shader_dirty) {
+        shader_dirty = false;
+        SetShader();
     }
 
     state.Apply();
+
+    if (uniform_data_dirty) {
+        SyncUniforms();
+        uniform_data_dirty = false;
+    }
 }
 
-void RasterizerOpenGL::ReloadColorBuffer() {
-    u8* color_buffer = Memory::GetPhysicalPointer(Pica::g_state.regs.framebuffer.GetColorBufferPhysicalAddress());
+void RasterizerOpenGL::ReloadColorBuffer(ColorSurface& surface) {
+    TextureInfo& fb_color_texture = surface.texture;
+    surface.dirty = false;
+    surface.sampler_copy_valid = false;
+    DiscardReadback(surface.readback);
+
+    u8* color_buffer = Memory::GetPhysicalPointer(surface.addr);
 
     if (color_buffer == nullptr)
         return;
 
+    GPUTimer::Scope gpu_timer(GPUTimer::Category::Uploads);
+
+    u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
+
+    // Scaled surfaces are loaded at native resolution first, then stretched on the GPU
+    TextureInfo native_texture;
+    TextureInfo& upload_texture = (fb_color_texture.scale != 1) ? native_texture : fb_color_texture;
+    if (fb_color_texture.scale != 1) {
+        native_texture.texture.Create();
+        ReconfigureColorTexture(native_texture, fb_color_texture.format, fb_color_texture.width, fb_color_texture.height, 1);
+    }
+
+    // Color buffer formats are a subset of the texture formats, so the GPU decoder can handle them
+    if (!texture_decoder.Decode(state, color_buffer, fb_color_texture.width * fb_color_texture.height * bytes_per_pixel,
+                                static_cast<Pica::Regs::TextureFormat>(fb_color_texture.format),
+                                fb_color_texture.width, fb_color_texture.height, false, upload_texture.texture.handle)) {
+        UploadColorBuffer(upload_texture, color_buffer);
+    }
+
+    if (fb_color_texture.scale != 1)
+        ScaleTexture(native_texture, fb_color_texture);
+}
+
+void RasterizerOpenGL::UploadColorBuffer(TextureInfo& fb_color_texture, const u8* color_buffer) {
     u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
 
     std::unique_ptr<u8[]> temp_fb_color_buffer(new u8[fb_color_texture.width * fb_color_texture.height * bytes_per_pixel]);
@@ -798,7 +1780,7 @@ void RasterizerOpenGL::ReloadColorBuffer() {
             u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_color_texture.width * bytes_per_pixel;
             u32 gl_pixel_index = (x + y * fb_color_texture.width) * bytes_per_pixel;
 
-            u8* pixel = color_buffer + dst_offset;
+            const u8* pixel = color_buffer + dst_offset;
             memcpy(&temp_fb_color_buffer[gl_pixel_index], pixel, bytes_per_pixel);
         }
     }
@@ -815,8 +1797,12 @@ void RasterizerOpenGL::ReloadColorBuffer() {
     state.Apply();
 }
 
-void RasterizerOpenGL::ReloadDepthBuffer() {
-    PAddr depth_buffer_addr = Pica::g_state.regs.framebuffer.GetDepthBufferPhysicalAddress();
+void RasterizerOpenGL::ReloadDepthBuffer(DepthSurface& surface) {
+    DepthTextureInfo& fb_depth_texture = surface.texture;
+    surface.dirty = false;
+    DiscardReadback(surface.readback);
+
+    PAddr depth_buffer_addr = surface.addr;
 
     if (depth_buffer_addr == 0)
         return;
@@ -827,11 +1813,21 @@ void RasterizerOpenGL::ReloadDepthBuffer() {
     if (depth_buffer == nullptr)
         return;
 
+    GPUTimer::Scope gpu_timer(GPUTimer::Category::Uploads);
+
     u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
 
     // OpenGL needs 4 bpp alignment for D24
     u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
 
+    // Scaled surfaces are loaded at native resolution first, then stretched on the GPU
+    DepthTextureInfo native_texture;
+    DepthTextureInfo& upload_texture = (fb_depth_texture.scale != 1) ? native_texture : fb_depth_texture;
+    if (fb_depth_texture.scale != 1) {
+        native_texture.texture.Create();
+        ReconfigureDepthTexture(native_texture, fb_depth_texture.format, fb_depth_texture.width, fb_depth_texture.height, 1);
+    }
+
     std::unique_ptr<u8[]> temp_fb_depth_buffer(new u8[fb_depth_texture.width * fb_depth_texture.height * gl_bpp]);
 
     u8* temp_fb_depth_data = bytes_per_pixel == 3 ? (temp_fb_depth_buffer.get() + 1) : temp_fb_depth_buffer.get();
@@ -862,7 +1858,7 @@ void RasterizerOpenGL::ReloadDepthBuffer() {
     }
 
     state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = fb_depth_texture.texture.handle;
+    state.texture_units[0].texture_2d = upload_texture.texture.handle;
     state.Apply();
 
     glActiveTexture(GL_TEXTURE0);
@@ -871,91 +1867,235 @@ void RasterizerOpenGL::ReloadDepthBuffer() {
 
     state.texture_units[0].texture_2d = 0;
     state.Apply();
+
+    if (fb_depth_texture.scale != 1)
+        ScaleTexture(native_texture, fb_depth_texture);
+}
+
+void RasterizerOpenGL::StartReadback(SurfaceReadback& readback, GLuint texture, GLenum gl_format, GLenum gl_type,
+                                     GLsizeiptr size) {
+    DiscardReadback(readback);
+
+    readback.buffer.Create();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.handle);
+    if (readback.size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        readback.size = size;
+    }
+
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = texture;
+    state.Apply();
+
+    // With a pack buffer bound, the copy is only queued and the pointer is an offset into the buffer
+    glActiveTexture(GL_TEXTURE0);
+    {
+        GPUTimer::Scope gpu_timer(GPUTimer::Category::Readbacks);
+        glGetTexImage(GL_TEXTURE_2D, 0, gl_format, gl_type, nullptr);
+    }
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    state.texture_units[0].texture_2d = 0;
+    state.Apply();
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
-void RasterizerOpenGL::CommitColorBuffer() {
-    if (last_fb_color_addr != 0) {
-        u8* color_buffer = Memory::GetPhysicalPointer(last_fb_color_addr);
+const u8* RasterizerOpenGL::MapReadback(SurfaceReadback& readback) {
+    glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
 
-        if (color_buffer != nullptr) {
-            u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer.handle);
+    const u8* data = static_cast<const u8*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback.size, GL_MAP_READ_BIT));
+    if (data == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Failed to map surface readback buffer");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    return data;
+}
 
-            std::unique_ptr<u8[]> temp_gl_color_buffer(new u8[fb_color_texture.width * fb_color_texture.height * bytes_per_pixel]);
+void RasterizerOpenGL::FinishReadback(SurfaceReadback& readback) {
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
 
-            state.texture_units[0].enabled_2d = true;
-            state.texture_units[0].texture_2d = fb_color_texture.texture.handle;
-            state.Apply();
+void RasterizerOpenGL::DiscardReadback(SurfaceReadback& readback) {
+    if (readback.fence != nullptr) {
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+    }
+}
 
-            glActiveTexture(GL_TEXTURE0);
-            glGetTexImage(GL_TEXTURE_2D, 0, fb_color_texture.gl_format, fb_color_texture.gl_type, temp_gl_color_buffer.get());
+void RasterizerOpenGL::StartColorReadback(ColorSurface& surface) {
+    const TextureInfo& fb_color_texture = surface.texture;
+    if (!surface.dirty)
+        return;
+    surface.dirty = false;
 
-            state.texture_units[0].texture_2d = 0;
-            state.Apply();
+    if (surface.addr == 0 || Memory::GetPhysicalPointer(surface.addr) == nullptr)
+        return;
 
-            // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
-            for (int y = 0; y < fb_color_texture.height; ++y) {
-                for (int x = 0; x < fb_color_texture.width; ++x) {
-                    const u32 coarse_y = y & ~7;
-                    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_color_texture.width * bytes_per_pixel;
-                    u32 gl_pixel_index = x * bytes_per_pixel + y * fb_color_texture.width * bytes_per_pixel;
+    u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
 
-                    u8* pixel = color_buffer + dst_offset;
-                    memcpy(pixel, &temp_gl_color_buffer[gl_pixel_index], bytes_per_pixel);
-                }
+    // Scaled surfaces are only brought down to native resolution when they are read back. The
+    // temporary texture is only deleted by OpenGL once the queued copy from it is done.
+    TextureInfo native_texture;
+    GLuint read_texture = fb_color_texture.texture.handle;
+    if (fb_color_texture.scale != 1) {
+        native_texture.texture.Create();
+        ReconfigureColorTexture(native_texture, fb_color_texture.format, fb_color_texture.width, fb_color_texture.height, 1);
+        ScaleTexture(fb_color_texture, native_texture);
+        read_texture = native_texture.texture.handle;
+    }
+
+    StartReadback(surface.readback, read_texture, fb_color_texture.gl_format, fb_color_texture.gl_type,
+                  fb_color_texture.width * fb_color_texture.height * bytes_per_pixel);
+}
+
+void RasterizerOpenGL::FinishColorReadback(ColorSurface& surface) {
+    const TextureInfo& fb_color_texture = surface.texture;
+    if (!surface.readback.IsPending())
+        return;
+
+    const u8* gl_color_buffer = MapReadback(surface.readback);
+    if (gl_color_buffer == nullptr)
+        return;
+
+    u8* color_buffer = Memory::GetPhysicalPointer(surface.addr);
+    if (color_buffer != nullptr) {
+        u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
+
+        // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
+        for (int y = 0; y < fb_color_texture.height; ++y) {
+            for (int x = 0; x < fb_color_texture.width; ++x) {
+                const u32 coarse_y = y & ~7;
+                u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_color_texture.width * bytes_per_pixel;
+                u32 gl_pixel_index = x * bytes_per_pixel + y * fb_color_texture.width * bytes_per_pixel;
+
+                u8* pixel = color_buffer + dst_offset;
+                memcpy(pixel, &gl_color_buffer[gl_pixel_index], bytes_per_pixel);
             }
         }
+        Memory::RecordPhysicalWrite(surface.addr, surface.size);
+    }
+
+    FinishReadback(surface.readback);
+}
+
+void RasterizerOpenGL::CommitColorBuffer(ColorSurface& surface) {
+    StartColorReadback(surface);
+    FinishColorReadback(surface);
+}
+
+void RasterizerOpenGL::CommitDisplaySurface(ColorSurface& surface) {
+    const TextureInfo& texture = surface.texture;
+    surface.dirty = false;
+
+    u8* buffer = Memory::GetPhysicalPointer(surface.addr);
+    if (buffer == nullptr)
+        return;
+
+    TextureInfo native_texture;
+    GLuint read_texture = texture.texture.handle;
+    if (texture.scale != 1) {
+        native_texture.texture.Create();
+        ReconfigureColorTexture(native_texture, texture.format, texture.width, texture.height, 1);
+        ScaleTexture(texture, native_texture);
+        read_texture = native_texture.texture.handle;
     }
+
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = read_texture;
+    state.Apply();
+
+    // Linear framebuffers are stored in the same row order as OpenGL textures
+    glActiveTexture(GL_TEXTURE0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, texture.gl_format, texture.gl_type, buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    Memory::RecordPhysicalWrite(surface.addr, surface.size);
+
+    state.texture_units[0].texture_2d = 0;
+    state.Apply();
 }
 
-void RasterizerOpenGL::CommitDepthBuffer() {
-    if (last_fb_depth_addr != 0) {
-        // TODO: Output seems correct visually, but doesn't quite match sw renderer output. One of them is wrong.
-        u8* depth_buffer = Memory::GetPhysicalPointer(last_fb_depth_addr);
+void RasterizerOpenGL::StartDepthReadback(DepthSurface& surface) {
+    const DepthTextureInfo& fb_depth_texture = surface.texture;
+    if (!surface.dirty)
+        return;
+    surface.dirty = false;
+
+    if (surface.addr == 0 || Memory::GetPhysicalPointer(surface.addr) == nullptr)
+        return;
+
+    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
 
-        if (depth_buffer != nullptr) {
-            u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
+    // OpenGL needs 4 bpp alignment for D24
+    u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
 
-            // OpenGL needs 4 bpp alignment for D24
-            u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
+    // Scaled surfaces are only brought down to native resolution when they are read back
+    DepthTextureInfo native_texture;
+    GLuint read_texture = fb_depth_texture.texture.handle;
+    if (fb_depth_texture.scale != 1) {
+        native_texture.texture.Create();
+        ReconfigureDepthTexture(native_texture, fb_depth_texture.format, fb_depth_texture.width, fb_depth_texture.height, 1);
+        ScaleTexture(fb_depth_texture, native_texture);
+        read_texture = native_texture.texture.handle;
+    }
 
-            std::unique_ptr<u8[]> temp_gl_depth_buffer(new u8[fb_depth_texture.width * fb_depth_texture.height * gl_bpp]);
+    StartReadback(surface.readback, read_texture, fb_depth_texture.gl_format, fb_depth_texture.gl_type,
+                  fb_depth_texture.width * fb_depth_texture.height * gl_bpp);
+}
 
-            state.texture_units[0].enabled_2d = true;
-            state.texture_units[0].texture_2d = fb_depth_texture.texture.handle;
-            state.Apply();
+void RasterizerOpenGL::FinishDepthReadback(DepthSurface& surface) {
+    const DepthTextureInfo& fb_depth_texture = surface.texture;
+    if (!surface.readback.IsPending())
+        return;
 
-            glActiveTexture(GL_TEXTURE0);
-            glGetTexImage(GL_TEXTURE_2D, 0, fb_depth_texture.gl_format, fb_depth_texture.gl_type, temp_gl_depth_buffer.get());
+    const u8* gl_depth_buffer = MapReadback(surface.readback);
+    if (gl_depth_buffer == nullptr)
+        return;
 
-            state.texture_units[0].texture_2d = 0;
-            state.Apply();
+    // TODO: Output seems correct visually, but doesn't quite match sw renderer output. One of them is wrong.
+    u8* depth_buffer = Memory::GetPhysicalPointer(surface.addr);
+    if (depth_buffer != nullptr) {
+        u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
+        u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
 
-            u8* temp_gl_depth_data = bytes_per_pixel == 3 ? (temp_gl_depth_buffer.get() + 1) : temp_gl_depth_buffer.get();
+        const u8* gl_depth_data = bytes_per_pixel == 3 ? (gl_depth_buffer + 1) : gl_depth_buffer;
 
-            if (fb_depth_texture.format == Pica::Regs::DepthFormat::D24S8) {
-                for (int y = 0; y < fb_depth_texture.height; ++y) {
-                    for (int x = 0; x < fb_depth_texture.width; ++x) {
-                        const u32 coarse_y = y & ~7;
-                        u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
-                        u32 gl_pixel_index = (x + y * fb_depth_texture.width);
+        if (fb_depth_texture.format == Pica::Regs::DepthFormat::D24S8) {
+            for (int y = 0; y < fb_depth_texture.height; ++y) {
+                for (int x = 0; x < fb_depth_texture.width; ++x) {
+                    const u32 coarse_y = y & ~7;
+                    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
+                    u32 gl_pixel_index = (x + y * fb_depth_texture.width);
 
-                        u8* pixel = depth_buffer + dst_offset;
-                        u32 depth_stencil = ((u32*)temp_gl_depth_data)[gl_pixel_index];
-                        *(u32*)pixel = (depth_stencil >> 8) | (depth_stencil << 24);
-                    }
+                    u8* pixel = depth_buffer + dst_offset;
+                    u32 depth_stencil = ((const u32*)gl_depth_data)[gl_pixel_index];
+                    *(u32*)pixel = (depth_stencil >> 8) | (depth_stencil << 24);
                 }
-            } else {
-                for (int y = 0; y < fb_depth_texture.height; ++y) {
-                    for (int x = 0; x < fb_depth_texture.width; ++x) {
-                        const u32 coarse_y = y & ~7;
-                        u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
-                        u32 gl_pixel_index = (x + y * fb_depth_texture.width) * gl_bpp;
-
-                        u8* pixel = depth_buffer + dst_offset;
-                        memcpy(pixel, &temp_gl_depth_data[gl_pixel_index], bytes_per_pixel);
-                    }
+            }
+        } else {
+            for (int y = 0; y < fb_depth_texture.height; ++y) {
+                for (int x = 0; x < fb_depth_texture.width; ++x) {
+                    const u32 coarse_y = y & ~7;
+                    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
+                    u32 gl_pixel_index = (x + y * fb_depth_texture.width) * gl_bpp;
+
+                    u8* pixel = depth_buffer + dst_offset;
+                    memcpy(pixel, &gl_depth_data[gl_pixel_index], bytes_per_pixel);
                 }
             }
         }
+        Memory::RecordPhysicalWrite(surface.addr, surface.size);
     }
+
+    FinishReadback(surface.readback);
+}
+
+void RasterizerOpenGL::CommitDepthBuffer(DepthSurface& surface) {
+    StartDepthReadback(surface);
+    FinishDepthReadback(surface);
 }
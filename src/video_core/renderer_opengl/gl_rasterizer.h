@@ -4,15 +4,32 @@
 
 #pragma once
 
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "common/common_types.h"
+#include "common/emu_window.h"
+#include "common/linear_disk_cache.h"
+
+#include "core/hw/gpu.h"
 
 #include "video_core/hwrasterizer_base.h"
 #include "video_core/vertex_shader.h"
 
 #include "gl_state.h"
 #include "gl_rasterizer_cache.h"
+#include "gl_shader_gen.h"
+#include "gl_stream_buffer.h"
+#include "gl_texture_decoder.h"
 
 class RasterizerOpenGL : public HWRasterizer {
 public:
@@ -26,17 +43,29 @@ public:
     /// Reset the rasterizer, such as flushing all caches and updating all state
     void Reset() override;
 
-    /// Queues the primitive formed by the given vertices for rendering
-    void AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                     const Pica::VertexShader::OutputVertex& v1,
-                     const Pica::VertexShader::OutputVertex& v2) override;
+    /// Adds a shaded vertex to the current batch
+    u32 AddVertex(const Pica::VertexShader::OutputVertex& v) override;
+
+    /// Queues the primitive formed by the given vertices of the current batch for rendering
+    void AddIndexedTriangle(u32 v0, u32 v1, u32 v2) override;
+
+    /// Looks up the GLSL translation of the current vertex shader, translating it if it isn't cached yet
+    bool BeginHostShadedDraw() override;
+
+    /// Queues the primitive formed by the given unshaded vertices
+    void AddUnshadedTriangle(const Pica::VertexShader::InputVertex& v0,
+                             const Pica::VertexShader::InputVertex& v1,
+                             const Pica::VertexShader::InputVertex& v2) override;
 
     /// Draw the current batch of triangles
     void DrawTriangles() override;
 
-    /// Commit the rasterizer's framebuffer contents immediately to the current 3DS memory framebuffer
+    /// Commit all rendering results which haven't been written back yet to 3DS memory
     void CommitFramebuffer() override;
 
+    /// Notify rasterizer that the specified PICA register is about to be changed
+    void NotifyPicaRegisterChanging(u32 id) override;
+
     /// Notify rasterizer that the specified PICA register has been changed
     void NotifyPicaRegisterChanged(u32 id) override;
 
@@ -46,25 +75,98 @@ public:
     /// Notify rasterizer that a 3DS memory region has been changed
     void NotifyFlush(PAddr addr, u32 size) override;
 
+    /// Marks all state as dirty, so that it's synced from the PICA registers on the next draw
+    void NotifyStateRestored() override;
+
+    /// Blits between surfaces if both sides of the transfer are held by the rasterizer
+    bool AccelerateDisplayTransfer(const GPU::DisplayTransfer::Config& config, PAddr src_addr, PAddr dst_addr) override;
+
+    /// Clears the surface covering exactly the filled range, or defers fills of regions not held by any surface
+    bool AccelerateFill(PAddr start, PAddr end, const u8* value, u32 value_size) override;
+
+    /**
+     * Copies the linear framebuffer produced by an accelerated display transfer into the given
+     * texture, which must have the same dimensions.
+     * @return False if there is no such framebuffer, in which case it has to be loaded from memory
+     */
+    bool BlitDisplaySurface(PAddr addr, u32 width, u32 height, GPU::Regs::PixelFormat format, GLuint dst_texture);
+
+    /// Returns true if BlitDisplaySurface would find a framebuffer with the given properties
+    bool HasDisplaySurface(PAddr addr, u32 width, u32 height, GPU::Regs::PixelFormat format) const;
+
+    /// Returns the multiplier of the native resolution at which surfaces are rendered
+    u32 GetResolutionScale() const { return res_scale; }
+
 private:
-    /// Structure used for managing texture environment states
-    struct TEVConfigUniforms {
-        GLuint enabled;
-        GLuint color_sources;
-        GLuint alpha_sources;
-        GLuint color_modifiers;
-        GLuint alpha_modifiers;
-        GLuint color_alpha_op;
-        GLuint color_alpha_multiplier;
-        GLuint const_color;
-        GLuint updates_combiner_buffer_color_alpha;
+    /// Groups of PICA state which have changed since the last draw
+    enum DirtyFlag : u32 {
+        DirtyCullMode       = 1 << 0,
+        DirtyBlendEnabled   = 1 << 1,
+        DirtyBlendFuncs     = 1 << 2,
+        DirtyBlendColor     = 1 << 3,
+        DirtyAlphaTest      = 1 << 4,
+        DirtyLogicOp        = 1 << 5,
+        DirtyStencilTest    = 1 << 6,
+        DirtyDepthTest      = 1 << 7,
+        DirtyTevColors      = 1 << 8,
+        DirtyCombinerColor  = 1 << 9,
+
+        DirtyAll            = (1 << 10) - 1,
+    };
+
+    /// Shader program generated for one PicaShaderConfig, along with its attribute and uniform locations
+    struct PicaShader {
+        OGLShader shader;
+        /// False while the program is still being compiled in the background
+        bool linked = false;
+        /// Set by the compile worker once it has linked the program, guarded by compile_mutex
+        GLsync compile_fence = nullptr;
+
+        GLuint attrib_position;
+        GLuint attrib_color;
+        GLuint attrib_texcoords;
+
+        GLuint uniform_tex;
+    };
+
+    /// Program running a translated vertex shader in front of a generated fragment shader
+    struct HostShadedProgram {
+        PicaShader shader;
+
+        GLint attrib_attributes;
+    };
+
+    /// Values of the uniforms shared by all generated fragment shaders, in the std140 layout of their uniform block
+    struct UniformData {
+        std::array<std::array<GLfloat, 4>, 6> tev_const_colors;
+        std::array<GLfloat, 4> tev_combiner_buffer_color;
+        GLfloat alphatest_ref;
+    };
+    static_assert(sizeof(UniformData) == 7 * 4 * sizeof(GLfloat) + sizeof(GLfloat), "UniformData doesn't match the std140 layout");
+
+    /// Configuration implemented by the uber shader, in the std140 layout of its uniform block
+    struct UberConfigData {
+        std::array<std::array<GLuint, 4>, 6> tev_stages;
+        GLuint alpha_test_func;
+        GLuint combiner_buffer_updates;
+        GLuint padding[2];
+    };
+    static_assert(sizeof(UberConfigData) == 7 * 4 * sizeof(GLuint), "UberConfigData doesn't match the std140 layout");
+
+    /// Pica vertex shader uniforms, in the std140 layout of the uniform block of translated vertex shaders
+    struct VSUniformData {
+        std::array<std::array<GLfloat, 4>, 96> f;
+        std::array<std::array<GLint, 4>, 4> i;
     };
+    static_assert(sizeof(VSUniformData) == 100 * 4 * sizeof(GLfloat), "VSUniformData doesn't match the std140 layout");
 
     /// Structure used for storing information about color textures
     struct TextureInfo {
         OGLTexture texture;
+        /// Native dimensions; the OpenGL texture is scale times as large
         GLsizei width;
         GLsizei height;
+        u32 scale;
         Pica::Regs::ColorFormat format;
         GLenum gl_format;
         GLenum gl_type;
@@ -73,13 +175,71 @@ private:
     /// Structure used for storing information about depth textures
     struct DepthTextureInfo {
         OGLTexture texture;
+        /// Native dimensions; the OpenGL texture is scale times as large
         GLsizei width;
         GLsizei height;
+        u32 scale;
         Pica::Regs::DepthFormat format;
         GLenum gl_format;
         GLenum gl_type;
     };
 
+    /**
+     * Copy of a surface's texture into a pixel pack buffer, which is queued when rendering to the
+     * surface is done for now and only written to 3DS memory once that memory is used.
+     */
+    struct SurfaceReadback {
+        OGLBuffer buffer;
+        GLsizeiptr size = 0;
+        GLsync fence = nullptr; ///< Signaled once the copy has completed, null if none is pending
+
+        ~SurfaceReadback() {
+            if (fence != nullptr)
+                glDeleteSync(fence);
+        }
+
+        bool IsPending() const { return fence != nullptr; }
+    };
+
+    /// Color framebuffer kept resident in an OpenGL texture between uses
+    struct ColorSurface {
+        TextureInfo texture;
+        PAddr addr;
+        u32 size;
+        /// Set when the texture holds rendering results which haven't been read back to 3DS memory yet
+        bool dirty;
+
+        /// Vertically flipped copy matching the layout of textures loaded from 3DS memory
+        OGLTexture sampler_copy;
+        /// Set when sampler_copy reflects the current contents of the surface
+        bool sampler_copy_valid;
+
+        SurfaceReadback readback;
+    };
+
+    /// Depth framebuffer kept resident in an OpenGL texture between uses
+    struct DepthSurface {
+        DepthTextureInfo texture;
+        PAddr addr;
+        u32 size;
+        /// Set when the texture holds rendering results which haven't been read back to 3DS memory yet
+        bool dirty;
+
+        SurfaceReadback readback;
+    };
+
+    /// Memory fill which has been deferred until its region is used next
+    struct PendingFill {
+        PAddr addr;
+        u32 size;
+        /// Bytes of a single fill value as they are stored in memory
+        std::array<u8, 4> value;
+        u32 value_size;
+    };
+
+    /// Address, format, width and height of a framebuffer in 3DS memory
+    using SurfaceKey = std::tuple<PAddr, u32, u32, u32>;
+
     /// Structure that the hardware rendered vertices are composed of
     struct HardwareVertex {
         HardwareVertex(const Pica::VertexShader::OutputVertex& v) {
@@ -106,15 +266,67 @@ private:
         GLfloat tex_coord2[2];
     };
 
-    /// Reconfigure the OpenGL color texture to use the given format and dimensions
-    void ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height);
+    /// Reconfigure the OpenGL color texture to use the given format and native dimensions, multiplied by scale
+    void ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height, u32 scale);
+
+    /// Reconfigure the OpenGL depth texture to use the given format and native dimensions, multiplied by scale
+    void ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height, u32 scale);
 
-    /// Reconfigure the OpenGL depth texture to use the given format and dimensions
-    void ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height);
+    /**
+     * Copies the whole source texture into the whole destination texture, stretching it as necessary
+     * @param attachment Framebuffer attachment point matching the format of both textures
+     * @param buffers Buffer mask passed to glBlitFramebuffer
+     * @param filter Filter used when the dimensions differ; GL_NEAREST for depth and stencil
+     */
+    void BlitTexture(GLuint src_texture, GLsizei src_width, GLsizei src_height,
+                     GLuint dst_texture, GLsizei dst_width, GLsizei dst_height,
+                     GLenum attachment, GLbitfield buffers, GLenum filter);
+
+    /// Copies the color texture into another one of the same format, converting between their scales
+    void ScaleTexture(const TextureInfo& src, TextureInfo& dst);
 
-    /// Syncs the state and contents of the OpenGL framebuffer to match the current PICA framebuffer
+    /// Copies the depth texture into another one of the same format, converting between their scales
+    void ScaleTexture(const DepthTextureInfo& src, DepthTextureInfo& dst);
+
+    /// Binds the surfaces matching the current PICA framebuffer, creating and loading them if necessary
     void SyncFramebuffer();
 
+    /// Writes back the dirty or read back surfaces overlapping the given memory region to 3DS memory
+    void CommitSurfaces(PAddr addr, u32 size);
+
+    /// Drops the surfaces overlapping the given memory region, except for the bound ones
+    void EraseSurfaces(PAddr addr, u32 size);
+
+    /// Drops all surfaces without writing them back
+    void DiscardSurfaces();
+
+    /// Returns true if any surface other than the given one overlaps the given region of 3DS memory
+    bool IsOverlappedByOtherSurface(PAddr addr, u32 size, const void* except) const;
+
+    /// Writes the pending fills overlapping the given memory region to 3DS memory
+    void CommitPendingFills(PAddr addr, u32 size);
+
+    /// Drops the pending fills overlapping the overwritten memory region, writing only their remaining parts
+    void DiscardPendingFills(PAddr addr, u32 size);
+
+    /// Removes the pending fill covering exactly the given region with values of the given size, if there is one
+    bool TakePendingFill(PAddr addr, u32 size, u32 value_size, PendingFill& fill);
+
+    /// Writes the part of the pending fill within [begin, end) to 3DS memory
+    static void WritePendingFill(const PendingFill& fill, PAddr begin, PAddr end);
+
+    /// Clears the surface's OpenGL texture to the given fill value
+    void FillColorSurface(ColorSurface& surface, const u8* value);
+
+    /// Clears the surface's OpenGL texture to the given fill value
+    void FillDepthSurface(DepthSurface& surface, const u8* value);
+
+    /// Returns the color surface with the same address, format and dimensions as the texture, if any
+    ColorSurface* FindTextureSurface(const Pica::Regs::FullTextureConfig& config);
+
+    /// Binds a flipped copy of the color surface to the given texture unit, for render-to-texture
+    void BindSurfaceAsTexture(ColorSurface& surface, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
+
     /// Syncs the cull mode to match the PICA register
     void SyncCullMode();
 
@@ -139,77 +351,200 @@ private:
     /// Syncs the depth test states to match the PICA register
     void SyncDepthTest();
 
-    /// Syncs the specified TEV stage's color and alpha sources to match the PICA register
-    void SyncTevSources(unsigned stage_index, const Pica::Regs::TevStageConfig& config);
-
-    /// Syncs the specified TEV stage's color and alpha modifiers to match the PICA register
-    void SyncTevModifiers(unsigned stage_index, const Pica::Regs::TevStageConfig& config);
-
-    /// Syncs the specified TEV stage's color and alpha combiner operations to match the PICA register
-    void SyncTevOps(unsigned stage_index, const Pica::Regs::TevStageConfig& config);
-
     /// Syncs the specified TEV stage's constant color to match the PICA register
     void SyncTevColor(unsigned stage_index, const Pica::Regs::TevStageConfig& config);
 
-    /// Syncs the specified TEV stage's color and alpha multipliers to match the PICA register
-    void SyncTevMultipliers(unsigned stage_index, const Pica::Regs::TevStageConfig& config);
-
     /// Syncs the TEV combiner color buffer to match the PICA register
     void SyncCombinerColor();
 
-    /// Syncs the TEV combiner write flags to match the PICA register
-    void SyncCombinerWriteFlags();
+    /// Links the given vertex shader with the fragment shader for the given configuration
+    void LinkShader(PicaShader& shader, const char* vertex_shader, const PicaShaderConfig& config);
+
+    /// Looks up the attribute and uniform locations of a linked program and sets its samplers
+    void FinishShader(PicaShader& shader);
+
+    /**
+     * Generates the shader program for the given configuration and adds it to the cache. If the
+     * driver supports it, the program is compiled in the background and isn't linked on return.
+     */
+    PicaShader* CreateShader(const PicaShaderConfig& config);
+
+    /// Finishes a program compiled in the background if it's ready, returning false if it isn't yet
+    bool PollShader(PicaShader& shader);
+
+    /// Selects the uber shader, configured to implement the given configuration
+    const PicaShader* SetUberShader(const PicaShaderConfig& config);
+
+    /// Main loop of the shader compile worker thread
+    void CompileWorkerLoop();
+
+    /// Returns the program for the vertex shader of the current host shaded draw, linking it if needed
+    const HostShadedProgram& GetHostShadedProgram();
+
+    /// Opens the on-disk shader cache of the running title and precompiles the programs it lists
+    void LoadDiskShaderCache();
+
+    /// Binds the shader program matching the current PICA state, generating it if it isn't cached yet
+    void SetShader();
+
+    /// Uploads the uniform values shared by all generated shader programs
+    void SyncUniforms();
+
+    /// Uploads the Pica vertex shader uniforms for host shaded draws, if they've changed since the last upload
+    void SyncVSUniforms();
+
+    /// Syncs the groups of PICA state flagged in dirty_flags to the OpenGL state
+    void SyncDirtyState();
 
     /// Syncs the remaining OpenGL drawing state to match the current PICA state
     void SyncDrawState();
 
-    /// Copies the 3DS color framebuffer into the OpenGL color framebuffer texture
-    void ReloadColorBuffer();
+    /// Returns true if a draw with the current state would read from the bound framebuffer
+    bool IsFeedbackDraw() const;
 
-    /// Copies the 3DS depth framebuffer into the OpenGL depth framebuffer texture
-    void ReloadDepthBuffer();
+    /// Submits all queued triangles with the current state
+    void FlushBatch();
 
-    /**
-     * Save the current OpenGL color framebuffer to the current PICA framebuffer in 3DS memory
-     * Loads the OpenGL framebuffer textures into temporary buffers
-     * Then copies into the 3DS framebuffer using proper Morton order
-     */
-    void CommitColorBuffer();
+    /// Draws the queued triangles with their vertices copied out, for batches too large for the stream buffers
+    void DrawBatchInChunks();
+
+    /// Submits the queued unshaded triangles, with the vertex shader uniforms read from the Pica state
+    void DrawUnshadedBatch();
+
+    /// Copies the 3DS color framebuffer into the surface's OpenGL texture
+    void ReloadColorBuffer(ColorSurface& surface);
+
+    /// Copies the tiled color buffer into the native resolution texture on the CPU
+    void UploadColorBuffer(TextureInfo& fb_color_texture, const u8* color_buffer);
+
+    /// Copies the 3DS depth framebuffer into the surface's OpenGL texture
+    void ReloadDepthBuffer(DepthSurface& surface);
+
+    /// Queues a copy of the given texture into a readback buffer, ending with a fence
+    void StartReadback(SurfaceReadback& readback, GLuint texture, GLenum gl_format, GLenum gl_type, GLsizeiptr size);
 
     /**
-     * Save the current OpenGL depth framebuffer to the current PICA framebuffer in 3DS memory
-     * Loads the OpenGL framebuffer textures into temporary buffers
-     * Then copies into the 3DS framebuffer using proper Morton order
+     * Waits for a pending readback and maps its buffer, which has to be unmapped with
+     * FinishReadback() afterwards. Returns nullptr if the buffer can't be mapped.
      */
-    void CommitDepthBuffer();
+    const u8* MapReadback(SurfaceReadback& readback);
+    void FinishReadback(SurfaceReadback& readback);
+
+    /// Drops the pending readback of a surface whose contents became outdated
+    static void DiscardReadback(SurfaceReadback& readback);
+
+    /// Starts reading back the contents of a dirty color surface, without waiting for them
+    void StartColorReadback(ColorSurface& surface);
+
+    /// Writes the results of a pending readback to 3DS memory in Morton order
+    void FinishColorReadback(ColorSurface& surface);
+
+    /// Save the surface's OpenGL color texture to its framebuffer in 3DS memory, waiting for any readback
+    void CommitColorBuffer(ColorSurface& surface);
+
+    /// Writes the contents of a display surface to 3DS memory, in linear order
+    void CommitDisplaySurface(ColorSurface& surface);
+
+    /// Starts reading back the contents of a dirty depth surface, without waiting for them
+    void StartDepthReadback(DepthSurface& surface);
+
+    /// Writes the results of a pending readback to 3DS memory in Morton order
+    void FinishDepthReadback(DepthSurface& surface);
+
+    /// Save the surface's OpenGL depth texture to its framebuffer in 3DS memory, waiting for any readback
+    void CommitDepthBuffer(DepthSurface& surface);
 
     RasterizerCacheOpenGL res_cache;
+    TextureDecoderOpenGL texture_decoder;
 
+    /// Vertices of all the draws which have been merged since the last FlushBatch, each stored once
     std::vector<HardwareVertex> vertex_batch;
+    /// Triangles of all the merged draws, as indices into vertex_batch
+    std::vector<u32> index_batch;
+    /// Raw attributes of the vertices of a host shaded draw, four floats per attribute
+    std::vector<GLfloat> unshaded_vertex_batch;
 
     OpenGLState state;
 
-    PAddr last_fb_color_addr;
-    PAddr last_fb_depth_addr;
+    // Framebuffers rendered to so far, kept in OpenGL textures and only written back on demand
+    std::map<SurfaceKey, std::unique_ptr<ColorSurface>> color_surfaces;
+    std::map<SurfaceKey, std::unique_ptr<DepthSurface>> depth_surfaces;
+    // Linear framebuffers written by display transfers, which are displayed straight from OpenGL
+    std::map<SurfaceKey, std::unique_ptr<ColorSurface>> display_surfaces;
+    ColorSurface* cur_color_surface;
+    DepthSurface* cur_depth_surface;
+
+    /// Fills of regions not held by any surface, never overlapping a surface or each other
+    std::vector<PendingFill> pending_fills;
 
     // Hardware rasterizer
-    TextureInfo fb_color_texture;
-    DepthTextureInfo fb_depth_texture;
-    OGLShader shader;
     OGLVertexArray vertex_array;
-    OGLBuffer vertex_buffer;
+    OGLStreamBuffer vertex_buffer;
+    OGLStreamBuffer index_buffer;
     OGLFramebuffer framebuffer;
 
-    // Hardware vertex shader
-    GLuint attrib_position;
-    GLuint attrib_color;
-    GLuint attrib_texcoords;
-
-    // Hardware fragment shader
-    GLuint uniform_alphatest_enabled;
-    GLuint uniform_alphatest_func;
-    GLuint uniform_alphatest_ref;
-    GLuint uniform_tex;
-    GLuint uniform_tev_combiner_buffer_color;
-    TEVConfigUniforms uniform_tev_cfgs[6];
+    /// Framebuffers used to copy color surfaces into their sampler copies
+    OGLFramebuffer copy_read_framebuffer;
+    OGLFramebuffer copy_draw_framebuffer;
+
+    /// Multiplier of the native resolution at which surfaces are rendered, read from the settings on init
+    u32 res_scale;
+
+    /// Combination of DirtyFlag values, resolved into OpenGL state right before drawing
+    u32 dirty_flags;
+
+    // Generated shader programs, keyed by the PICA state they implement
+    std::unordered_map<PicaShaderConfig, std::unique_ptr<PicaShader>> shader_cache;
+    const PicaShader* current_shader;
+    /// Configurations seen by previous runs of the current title, so they can be compiled up front
+    LinearDiskCache<PicaShaderConfig, u8> disk_shader_cache;
+    bool disk_shader_cache_loaded;
+    /// Set when PICA state affecting the generated shader code has changed, or while the current
+    /// configuration is drawn with the uber shader
+    bool shader_dirty;
+
+    /// How generated programs are compiled. Unless it's Immediate, the uber shader is drawn with
+    /// until they are ready.
+    enum class ShaderCompileMode {
+        Immediate,      ///< Linked right away, stalling the draw which needs them
+        DriverParallel, ///< Linked in the background by the driver (KHR/ARB_parallel_shader_compile)
+        WorkerThread,   ///< Linked by compile_thread, in a context sharing objects with the rendering one
+    };
+    ShaderCompileMode shader_compile_mode;
+
+    /// Program compiled by the worker, along with the fragment shader source
+    struct CompileJob {
+        PicaShader* shader;
+        std::string fragment_shader;
+    };
+
+    std::unique_ptr<EmuWindow::SharedContext> compile_context;
+    std::thread compile_thread;
+    std::mutex compile_mutex;
+    std::condition_variable compile_available;
+    std::deque<CompileJob> compile_jobs;
+    bool compile_running;
+
+    PicaShader uber_shader;
+    /// Configuration last uploaded to the uber shader's uniform block
+    PicaShaderConfig uber_config;
+    bool uber_config_valid;
+    OGLBuffer uber_config_buffer;
+
+    /// Translated vertex shaders, or empty strings for programs which can't be translated
+    std::unordered_map<PicaVSConfig, std::string> vertex_shader_cache;
+    /// Programs of host shaded draws, keyed by a hash of their vertex and fragment shader configurations
+    std::unordered_map<u64, std::unique_ptr<HostShadedProgram>> host_shaded_programs;
+    /// Configuration and translation of the vertex shader of the current host shaded draw, if any
+    PicaVSConfig current_vs_config;
+    const std::string* current_vertex_shader;
+
+    UniformData uniform_data;
+    /// Set when the uniform values have changed
+    bool uniform_data_dirty;
+    OGLBuffer uniform_buffer;
+
+    /// Last uploaded vertex shader uniforms
+    VSUniformData vs_uniform_data;
+    OGLBuffer vs_uniform_buffer;
 };
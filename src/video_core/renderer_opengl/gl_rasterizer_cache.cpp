@@ -2,82 +2,494 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+#include "common/hash.h"
+#include "common/logging/log.h"
 #include "common/make_unique.h"
-#include "common/math_util.h"
+#include "common/profiler.h"
+#include "common/thread_pool.h"
 #include "common/vector_math.h"
 
 #include "core/memory.h"
+#include "core/settings.h"
 
+#include "video_core/renderer_opengl/gl_gpu_timer.h"
 #include "video_core/renderer_opengl/gl_rasterizer_cache.h"
 #include "video_core/renderer_opengl/pica_to_gl.h"
 #include "video_core/debug_utils/debug_utils.h"
+#include "video_core/texture_decoder.h"
+
+/// Textures at least this tall are decoded in parallel on the thread pool
+static const int MIN_SPLIT_DECODE_HEIGHT = 64;
+
+/// Size of the 3DS memory the cached textures were decoded from, and of the textures themselves on the host GPU
+static Common::Profiling::MemoryCounter texture_cache_counter("Texture Cache");
+static Common::Profiling::MemoryCounter texture_vram_counter("Texture Cache VRAM");
+
+// Not part of the core profile, but of GL_EXT_texture_compression_s3tc and GL 4.3 respectively
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+
+/// Estimated size of a texture, which is stored as RGBA8 unless it has been kept compressed
+static u64 TextureVRAMSize(GLuint width, GLuint height, GLenum internal_format) {
+    switch (internal_format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGB8_ETC2:
+        return (u64)width * height / 2;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        return (u64)width * height;
+    default:
+        return (u64)width * height * 4;
+    }
+}
+
+static Pica::TextureDecoder::CompressedFormat ToCompressedFormat(GLenum internal_format) {
+    switch (internal_format) {
+    case GL_COMPRESSED_RGB8_ETC2:
+        return Pica::TextureDecoder::CompressedFormat::ETC2_RGB8;
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        return Pica::TextureDecoder::CompressedFormat::BC1;
+    default:
+        return Pica::TextureDecoder::CompressedFormat::BC2;
+    }
+}
+
+static bool IsExtensionSupported(const char* name) {
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension != nullptr && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Calls body(first_row, end_row) for bands of whole tile rows of a texture, which are processed
+ * in parallel on the shared thread pool for large textures. The last band takes any rows which
+ * don't fill a tile.
+ */
+static void ForEachTileBand(int height, const std::function<void(int, int)>& body) {
+    if (height < MIN_SPLIT_DECODE_HEIGHT) {
+        body(0, height);
+        return;
+    }
+
+    Common::ThreadPool& pool = Common::GetThreadPool();
+    const size_t tile_rows = height / 8;
+    const size_t band_size = std::max<size_t>(1, tile_rows / (pool.GetWorkerCount() + 1));
+
+    pool.ParallelFor(0, tile_rows, band_size, [&](size_t first_tile_row, size_t end_tile_row) {
+        const int end_row = (end_tile_row == tile_rows) ? height : (int)end_tile_row * 8;
+        body((int)first_tile_row * 8, end_row);
+    });
+}
+
+/// Number of most recently bound textures which are never evicted, as they may be bound for the current draw
+static const size_t MIN_RESIDENT_TEXTURES = 3;
+
+/// Upper bound of the free pool, which is also trimmed to fit the VRAM budget
+static const size_t MAX_FREE_TEXTURES = 64;
+
+RasterizerCacheOpenGL::RasterizerCacheOpenGL() {
+    if (!Settings::values.texture_pack_path.empty())
+        replacer = Common::make_unique<TextureReplacer>(Settings::values.texture_pack_path);
+}
 
 RasterizerCacheOpenGL::~RasterizerCacheOpenGL() {
     FullFlush();
+
+    for (auto& upload : upload_buffers) {
+        if (upload.fence != nullptr)
+            glDeleteSync(upload.fence);
+    }
 }
 
-void RasterizerCacheOpenGL::LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config) {
+void RasterizerCacheOpenGL::LoadAndBindTexture(OpenGLState &state, TextureDecoderOpenGL& decoder, unsigned texture_unit,
+                                               const Pica::Regs::FullTextureConfig& config) {
     PAddr texture_addr = config.config.GetPhysicalAddress();
 
     const auto cached_texture = texture_cache.find(texture_addr);
 
-    if (cached_texture != texture_cache.end()) {
-        state.texture_units[texture_unit].texture_2d = cached_texture->second->texture.handle;
+    if (cached_texture != texture_cache.end() && IsUpToDate(texture_addr, *cached_texture->second)) {
+        lru_list.splice(lru_list.begin(), lru_list, cached_texture->second->lru_position);
+        const GLuint handle = GetTextureHandle(state, texture_unit, *cached_texture->second);
+        state.texture_units[texture_unit].texture_2d = handle;
         state.Apply();
+        ApplySampler(handle, texture_unit, config.config);
     } else {
-        std::unique_ptr<CachedTexture> new_texture = Common::make_unique<CachedTexture>();
-
-        new_texture->texture.Create();
-        state.texture_units[texture_unit].texture_2d = new_texture->texture.handle;
-        state.Apply();
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, PicaToGL::TextureFilterMode(config.config.mag_filter));
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, PicaToGL::TextureFilterMode(config.config.min_filter));
+        EraseTexture(texture_addr);
 
-        GLenum wrap_s = PicaToGL::WrapMode(config.config.wrap_s);
-        GLenum wrap_t = PicaToGL::WrapMode(config.config.wrap_t);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
-
-        if (wrap_s == GL_CLAMP_TO_BORDER || wrap_t == GL_CLAMP_TO_BORDER) {
-            auto border_color = PicaToGL::ColorRGBA8((u8*)&config.config.border_color.r);
-            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color.data());
-        }
+        std::unique_ptr<CachedTexture> new_texture = Common::make_unique<CachedTexture>();
 
         const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
 
         new_texture->width = info.width;
         new_texture->height = info.height;
-        new_texture->size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format);
+        new_texture->internal_format = GetInternalFormat(info.format, info.width, info.height);
+        new_texture->size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2;
 
         u8* texture_src_data = Memory::GetPhysicalPointer(texture_addr);
-        std::unique_ptr<Math::Vec4<u8>[]> temp_texture_buffer_rgba(new Math::Vec4<u8>[info.width * info.height]);
+        new_texture->hash = Common::ComputeHash64(texture_src_data, new_texture->size);
+        new_texture->write_stamp = Memory::GetWriteStamp();
+        Memory::TrackPhysicalWrites(texture_addr, new_texture->size);
 
-        for (int y = 0; y < info.height; ++y) {
-            for (int x = 0; x < info.width; ++x) {
-                temp_texture_buffer_rgba[x + info.width * y] = Pica::DebugUtils::LookupTexture(texture_src_data, x, info.height - 1 - y, info);
+        new_texture->content_key = MakeContentKey(new_texture->hash, config);
+        auto shared_texture = content_index.find(new_texture->content_key);
+        if (shared_texture != content_index.end())
+            new_texture->texture = shared_texture->second.lock();
+
+        if (new_texture->texture != nullptr) {
+            state.texture_units[texture_unit].texture_2d = new_texture->texture->handle;
+            state.Apply();
+        } else {
+            GPUTimer::Scope gpu_timer(GPUTimer::Category::Uploads);
+
+            // Textures of the same size and format are recycled, which saves reallocating their storage too
+            new_texture->texture = TakeFreeTexture(info.width, info.height, new_texture->internal_format);
+            const bool reused = new_texture->texture != nullptr;
+            if (!reused) {
+                new_texture->texture = std::make_shared<OGLTexture>();
+                new_texture->texture->Create();
+                // The name may have belonged to a deleted texture replacement
+                applied_samplers.erase(new_texture->texture->handle);
+            }
+            vram_size += TextureVRAMSize(info.width, info.height, new_texture->internal_format);
+
+            state.texture_units[texture_unit].texture_2d = new_texture->texture->handle;
+            state.Apply();
+
+            if (new_texture->internal_format != GL_RGBA) {
+                UploadCompressedTexture(texture_src_data, info.format, info.width, info.height,
+                                        new_texture->internal_format, reused);
+            } else {
+                // Try decoding on the GPU first, which only needs the raw data to be uploaded
+                if (!reused)
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+                if (!decoder.Decode(state, texture_src_data, new_texture->size, info.format,
+                                    info.width, info.height, true, new_texture->texture->handle)) {
+                    UploadDecodedTexture(texture_src_data, info.format, info.width, info.height);
+                }
             }
+
+            content_index[new_texture->content_key] = new_texture->texture;
         }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, temp_texture_buffer_rgba.get());
+        // The emulated texture is shown until its replacement has been decoded
+        if (replacer != nullptr)
+            new_texture->replacement = replacer->Find(new_texture->hash, info.format, info.width, info.height);
 
+        const GLuint handle = GetTextureHandle(state, texture_unit, *new_texture);
+        state.texture_units[texture_unit].texture_2d = handle;
+        state.Apply();
+        ApplySampler(handle, texture_unit, config.config);
+
+        cached_ranges.add({ boost::icl::interval<PAddr>::right_open(texture_addr, texture_addr + new_texture->size),
+                            std::set<PAddr>{ texture_addr } });
+        lru_list.push_front(texture_addr);
+        new_texture->lru_position = lru_list.begin();
+
+        texture_cache_counter.Add(new_texture->size);
         texture_cache.emplace(texture_addr, std::move(new_texture));
+
+        EnforceBudget();
     }
 }
 
+bool RasterizerCacheOpenGL::IsUpToDate(PAddr addr, CachedTexture& texture) {
+    if (!Memory::PhysicalWrittenSince(addr, texture.size, texture.write_stamp))
+        return true;
+
+    // The CPU wrote to the texture's pages, but possibly not to the texture itself (or it wrote
+    // the same data again), so compare the contents before deciding to upload it again.
+    if (Common::ComputeHash64(Memory::GetPhysicalPointer(addr), texture.size) != texture.hash)
+        return false;
+
+    texture.write_stamp = Memory::GetWriteStamp();
+    Memory::TrackPhysicalWrites(addr, texture.size);
+    return true;
+}
+
+GLuint RasterizerCacheOpenGL::GetTextureHandle(OpenGLState& state, unsigned texture_unit, CachedTexture& texture) {
+    if (texture.replacement == nullptr)
+        return texture.texture->handle;
+
+    bool uploaded;
+    const GLuint replacement = replacer->GetTexture(state, texture_unit, *texture.replacement, uploaded);
+    if (replacement == 0)
+        return texture.texture->handle;
+
+    // A new texture may reuse the name of a deleted one, whose sampler parameters don't apply to it
+    if (uploaded)
+        applied_samplers.erase(replacement);
+    return replacement;
+}
+
 void RasterizerCacheOpenGL::NotifyFlush(PAddr addr, u32 size) {
     // Flush any texture that falls in the flushed region
-    // TODO: Optimize by also inserting upper bound (addr + size) of each texture into the same map and also narrow using lower_bound
-    auto cache_upper_bound = texture_cache.upper_bound(addr + size);
-    for (auto it = texture_cache.begin(); it != cache_upper_bound;) {
-        if (MathUtil::IntervalsIntersect(addr, size, it->first, it->second->size)) {
-            it = texture_cache.erase(it);
+    std::set<PAddr> flushed_textures;
+    auto overlapping = cached_ranges.equal_range(boost::icl::interval<PAddr>::right_open(addr, addr + size));
+    for (auto it = overlapping.first; it != overlapping.second; ++it)
+        flushed_textures.insert(it->second.begin(), it->second.end());
+
+    for (PAddr texture_addr : flushed_textures)
+        EraseTexture(texture_addr);
+}
+
+void RasterizerCacheOpenGL::FullFlush() {
+    for (const auto& cached_texture : texture_cache)
+        ReleaseTexture(*cached_texture.second);
+    texture_cache.clear();
+    cached_ranges.clear();
+    content_index.clear();
+
+    EnforceBudget();
+}
+
+void RasterizerCacheOpenGL::EraseTexture(PAddr addr) {
+    auto it = texture_cache.find(addr);
+    if (it == texture_cache.end())
+        return;
+
+    cached_ranges.subtract({ boost::icl::interval<PAddr>::right_open(addr, addr + it->second->size),
+                             std::set<PAddr>{ addr } });
+
+    // Drop the content index entry along with the last cached texture using it
+    const ContentKey content_key = it->second->content_key;
+    ReleaseTexture(*it->second);
+    texture_cache.erase(it);
+
+    auto index_it = content_index.find(content_key);
+    if (index_it != content_index.end() && index_it->second.expired())
+        content_index.erase(index_it);
+}
+
+void RasterizerCacheOpenGL::ReleaseTexture(CachedTexture& texture) {
+    lru_list.erase(texture.lru_position);
+    texture_cache_counter.Add(-(s64)texture.size);
+
+    // Textures shared with other cached ones stay in use
+    if (texture.texture.use_count() == 1) {
+        const u64 size = TextureVRAMSize(texture.width, texture.height, texture.internal_format);
+        vram_size -= size;
+        free_vram_size += size;
+
+        free_textures[FreeKey(texture.width, texture.height, texture.internal_format)].push_back(std::move(*texture.texture));
+        ++num_free_textures;
+    }
+
+    texture_vram_counter.Set(vram_size + free_vram_size);
+}
+
+std::shared_ptr<OGLTexture> RasterizerCacheOpenGL::TakeFreeTexture(GLuint width, GLuint height, GLenum internal_format) {
+    auto it = free_textures.find(FreeKey(width, height, internal_format));
+    if (it == free_textures.end())
+        return nullptr;
+
+    auto texture = std::make_shared<OGLTexture>(std::move(it->second.back()));
+    it->second.pop_back();
+    if (it->second.empty())
+        free_textures.erase(it);
+
+    --num_free_textures;
+    free_vram_size -= TextureVRAMSize(width, height, internal_format);
+    return texture;
+}
+
+void RasterizerCacheOpenGL::EnforceBudget() {
+    const u64 budget = Settings::values.texture_cache_size > 0 ?
+            (u64)Settings::values.texture_cache_size * 1024 * 1024 : std::numeric_limits<u64>::max();
+
+    // Unused textures are deleted first, the widest ones first, before evicting cached ones
+    while (true) {
+        const bool over_budget = vram_size + free_vram_size > budget;
+
+        if (!free_textures.empty() && (over_budget || num_free_textures > MAX_FREE_TEXTURES)) {
+            auto it = std::prev(free_textures.end());
+            free_vram_size -= TextureVRAMSize(std::get<0>(it->first), std::get<1>(it->first), std::get<2>(it->first));
+            applied_samplers.erase(it->second.back().handle);
+            it->second.pop_back();
+            if (it->second.empty())
+                free_textures.erase(it);
+            --num_free_textures;
+        } else if (over_budget && lru_list.size() > MIN_RESIDENT_TEXTURES) {
+            EraseTexture(lru_list.back());
         } else {
-            ++it;
+            break;
         }
     }
+
+    texture_vram_counter.Set(vram_size + free_vram_size);
 }
 
-void RasterizerCacheOpenGL::FullFlush() {
-    texture_cache.clear();
+GLenum RasterizerCacheOpenGL::GetInternalFormat(Pica::Regs::TextureFormat format, GLuint width, GLuint height) {
+    if (!Settings::values.use_compressed_textures || width % 8 != 0 || height % 8 != 0)
+        return GL_RGBA;
+
+    if (!compressed_formats_checked) {
+        GLint major = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        GLint minor = 0;
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        has_etc2 = major > 4 || (major == 4 && minor >= 3) || IsExtensionSupported("GL_ARB_ES3_compatibility");
+        has_s3tc = IsExtensionSupported("GL_EXT_texture_compression_s3tc");
+        compressed_formats_checked = true;
+    }
+
+    // ETC2 decodes ETC1 blocks as they are, while transcoding to BC1 loses some precision
+    if (format == Pica::Regs::TextureFormat::ETC1 && has_etc2)
+        return GL_COMPRESSED_RGB8_ETC2;
+    if (format == Pica::Regs::TextureFormat::ETC1 && has_s3tc)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if (format == Pica::Regs::TextureFormat::ETC1A4 && has_s3tc)
+        return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    return GL_RGBA;
+}
+
+RasterizerCacheOpenGL::ContentKey RasterizerCacheOpenGL::MakeContentKey(u64 hash, const Pica::Regs::FullTextureConfig& config) {
+    return std::make_tuple(hash, static_cast<u32>(config.format), static_cast<u32>(config.config.width),
+                           static_cast<u32>(config.config.height));
+}
+
+RasterizerCacheOpenGL::SamplerKey RasterizerCacheOpenGL::MakeSamplerKey(const Pica::Regs::TextureConfig& config) {
+    u32 modes = config.mag_filter | (config.min_filter << 1) | (config.wrap_t << 2) | (config.wrap_s << 4);
+    u32 border_color = 0;
+    if (config.wrap_s == Pica::Regs::TextureConfig::ClampToBorder ||
+        config.wrap_t == Pica::Regs::TextureConfig::ClampToBorder) {
+        border_color = config.border_color.r | (config.border_color.g << 8) |
+                       (config.border_color.b << 16) | (config.border_color.a << 24);
+    }
+    return { modes, border_color };
+}
+
+void RasterizerCacheOpenGL::ApplySampler(GLuint texture, unsigned texture_unit, const Pica::Regs::TextureConfig& config) {
+    const SamplerKey key = MakeSamplerKey(config);
+
+    auto applied = applied_samplers.find(texture);
+    if (applied != applied_samplers.end() && applied->second == key)
+        return;
+    applied_samplers[texture] = key;
+
+    // The texture may have been bound to its unit already, in which case applying the state
+    // didn't select that unit
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, PicaToGL::TextureFilterMode(config.mag_filter));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, PicaToGL::TextureFilterMode(config.min_filter));
+
+    GLenum wrap_s = PicaToGL::WrapMode(config.wrap_s);
+    GLenum wrap_t = PicaToGL::WrapMode(config.wrap_t);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
+
+    if (wrap_s == GL_CLAMP_TO_BORDER || wrap_t == GL_CLAMP_TO_BORDER) {
+        auto border_color = PicaToGL::ColorRGBA8((u8*)&config.border_color.r);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color.data());
+    }
+}
+
+void* RasterizerCacheOpenGL::MapUploadBuffer(GLsizeiptr size) {
+    UploadBuffer& upload = upload_buffers[next_upload_buffer];
+
+    upload.buffer.Create();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer.handle);
+
+    // With several buffers in the pool this rarely has to wait, but the previous upload from
+    // this buffer must be done before its memory can be overwritten
+    if (upload.fence != nullptr) {
+        glClientWaitSync(upload.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(upload.fence);
+        upload.fence = nullptr;
+    }
+
+    if (upload.size < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        upload.size = size;
+    }
+
+    void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (data == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Failed to map texture upload buffer");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    return data;
+}
+
+void RasterizerCacheOpenGL::FinishUpload() {
+    upload_buffers[next_upload_buffer].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next_upload_buffer = (next_upload_buffer + 1) % NUM_UPLOAD_BUFFERS;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void RasterizerCacheOpenGL::UploadDecodedTexture(const u8* source, Pica::Regs::TextureFormat format,
+                                                 int width, int height) {
+    const GLsizeiptr size = width * height * sizeof(Math::Vec4<u8>);
+    auto dst = static_cast<Math::Vec4<u8>*>(MapUploadBuffer(size));
+
+    if (dst == nullptr) {
+        std::vector<Math::Vec4<u8>> texels(width * height);
+        Pica::TextureDecoder::DecodeTexture(source, format, width, height, texels.data(), true);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+        return;
+    }
+
+    // Bands of whole tile rows, with the first rows of the PICA texture ending up at the end
+    // of the flipped destination
+    const size_t tile_row_bytes = (width / 8) * Pica::TextureDecoder::GetTileSize(format);
+    ForEachTileBand(height, [&](int first_row, int end_row) {
+        Pica::TextureDecoder::DecodeTexture(source + (first_row / 8) * tile_row_bytes, format, width,
+                                            end_row - first_row, dst + (height - end_row) * width, true);
+    });
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // The copy into the texture is queued and made from the buffer, so it doesn't stall here
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    FinishUpload();
+}
+
+void RasterizerCacheOpenGL::UploadCompressedTexture(const u8* source, Pica::Regs::TextureFormat format,
+                                                    int width, int height, GLenum internal_format, bool reused) {
+    const Pica::TextureDecoder::CompressedFormat compressed_format = ToCompressedFormat(internal_format);
+    const size_t block_row_bytes = (width / 4) * Pica::TextureDecoder::GetCompressedBlockSize(compressed_format);
+    const GLsizei size = (GLsizei)(block_row_bytes * (height / 4));
+
+    // Compressed storage is allocated along with its first upload
+    auto upload = [&](const void* data) {
+        if (reused)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, internal_format, size, data);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, size, data);
+    };
+
+    auto dst = static_cast<u8*>(MapUploadBuffer(size));
+    if (dst == nullptr) {
+        std::vector<u8> blocks(size);
+        Pica::TextureDecoder::TranscodeTexture(source, format, width, height, blocks.data(), compressed_format);
+        upload(blocks.data());
+        return;
+    }
+
+    // Bands are always made of whole tiles, since compressed textures are a multiple of 8 tall
+    const size_t tile_row_bytes = (width / 8) * Pica::TextureDecoder::GetTileSize(format);
+    ForEachTileBand(height, [&](int first_row, int end_row) {
+        Pica::TextureDecoder::TranscodeTexture(source + (first_row / 8) * tile_row_bytes, format, width,
+                                               end_row - first_row, dst + ((height - end_row) / 4) * block_row_bytes,
+                                               compressed_format);
+    });
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    upload(nullptr);
+    FinishUpload();
 }
@@ -6,17 +6,31 @@
 
 #include "gl_state.h"
 #include "gl_resource_manager.h"
+#include "gl_texture_decoder.h"
+#include "gl_texture_replacer.h"
 #include "video_core/pica.h"
 
+#include <array>
+#include <list>
 #include <memory>
 #include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/icl/interval_map.hpp>
 
 class RasterizerCacheOpenGL : NonCopyable {
 public:
+    /// Indexes the texture pack, if Settings::values.texture_pack_path is set
+    RasterizerCacheOpenGL();
     ~RasterizerCacheOpenGL();
 
     /// Loads a texture from 3DS memory to OpenGL and caches it (if not already cached)
-    void LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
+    void LoadAndBindTexture(OpenGLState &state, TextureDecoderOpenGL& decoder, unsigned texture_unit,
+                            const Pica::Regs::FullTextureConfig& config);
 
     /// Flush any cached resource that touches the flushed region
     void NotifyFlush(PAddr addr, u32 size);
@@ -25,12 +39,153 @@ public:
     void FullFlush();
 
 private:
+    /// Hash of the source data, format, width and height
+    using ContentKey = std::tuple<u64, u32, u32, u32>;
+
+    /// Packed filter and wrap modes, and the border color if any wrap mode uses it
+    using SamplerKey = std::pair<u32, u32>;
+
     struct CachedTexture {
-        OGLTexture texture;
+        /// Shared between all cached textures with the same contents
+        std::shared_ptr<OGLTexture> texture;
         GLuint width;
         GLuint height;
+        /// GL_RGBA, or the block compressed format ETC1 textures are uploaded in if supported
+        GLenum internal_format;
         u32 size;
+
+        u64 hash;           ///< Hash of the texture data the texture has been decoded from
+        u32 write_stamp;    ///< Memory write stamp at the time the contents were last verified
+        ContentKey content_key;
+
+        /// Texture pack image shown instead of the texture once it has been loaded, if any
+        std::shared_ptr<TextureReplacer::Replacement> replacement;
+
+        /// Entry of the texture in lru_list
+        std::list<PAddr>::iterator lru_position;
+    };
+
+    /**
+     * Checks whether the cached texture still matches the emulated memory it was decoded from.
+     * Textures are only hashed again if the CPU wrote to their memory pages in the meantime.
+     */
+    bool IsUpToDate(PAddr addr, CachedTexture& texture);
+
+    /**
+     * Returns the GL texture to sample a cached texture from, which is its replacement once that
+     * has been loaded. Uploading the replacement may change the texture bound to the given unit.
+     */
+    GLuint GetTextureHandle(OpenGLState& state, unsigned texture_unit, CachedTexture& texture);
+
+    /// Removes the texture at the given address from both the cache and the range index
+    void EraseTexture(PAddr addr);
+
+    /**
+     * Drops a cached texture which is about to be removed from the LRU list and the memory
+     * accounting. Its GL texture goes to the free pool, unless another cached texture uses it.
+     */
+    void ReleaseTexture(CachedTexture& texture);
+
+    /// Takes a GL texture from the free pool, or returns nullptr if there's none of the given size and format
+    std::shared_ptr<OGLTexture> TakeFreeTexture(GLuint width, GLuint height, GLenum internal_format);
+
+    /**
+     * Deletes textures from the free pool and evicts the least recently bound cached textures
+     * until the estimated VRAM use fits in the texture_cache_size budget.
+     */
+    void EnforceBudget();
+
+    /**
+     * Returns the format to store a texture in on the host GPU. ETC1 and ETC1A4 textures are kept
+     * block compressed if the driver supports a suitable format, and RGBA8 is used for all others.
+     */
+    GLenum GetInternalFormat(Pica::Regs::TextureFormat format, GLuint width, GLuint height);
+
+    static ContentKey MakeContentKey(u64 hash, const Pica::Regs::FullTextureConfig& config);
+    static SamplerKey MakeSamplerKey(const Pica::Regs::TextureConfig& config);
+
+    /**
+     * Sets the filter and wrap modes of the given texture, which is bound to the given unit, unless
+     * they are already the ones it was last sampled with.
+     */
+    void ApplySampler(GLuint texture, unsigned texture_unit, const Pica::Regs::TextureConfig& config);
+
+    /**
+     * Decodes a texture on the CPU straight into a pooled pixel unpack buffer and uploads it from
+     * there to the texture bound to the active unit. Large textures are split into bands of tile
+     * rows, which are decoded in parallel on the shared thread pool.
+     */
+    void UploadDecodedTexture(const u8* source, Pica::Regs::TextureFormat format, int width, int height);
+
+    /**
+     * Transcodes an ETC1 or ETC1A4 texture into the given compressed format on the CPU, in parallel
+     * for large textures, and uploads it like UploadDecodedTexture does.
+     * @param reused Whether the texture already has storage of that size and format
+     */
+    void UploadCompressedTexture(const u8* source, Pica::Regs::TextureFormat format, int width, int height,
+                                 GLenum internal_format, bool reused);
+
+    /**
+     * Binds the next buffer of the upload pool and maps the given number of bytes of it, waiting
+     * for the last upload from it first.
+     * @return The mapped memory, or nullptr (with no buffer bound) if mapping failed
+     */
+    void* MapUploadBuffer(GLsizeiptr size);
+
+    /// Fences the upload made from the mapped buffer after unmapping it, and moves on to the next one
+    void FinishUpload();
+
+    /// Buffer which CPU-decoded textures are uploaded from
+    struct UploadBuffer {
+        OGLBuffer buffer;
+        GLsizeiptr size = 0;
+        GLsync fence = nullptr; ///< Signaled once the last upload from this buffer has completed
     };
 
+    static const size_t NUM_UPLOAD_BUFFERS = 4;
+    std::array<UploadBuffer, NUM_UPLOAD_BUFFERS> upload_buffers;
+    size_t next_upload_buffer = 0;
+
     std::map<PAddr, std::unique_ptr<CachedTexture>> texture_cache;
+
+    /// Maps memory ranges to the addresses of the cached textures overlapping them
+    boost::icl::interval_map<PAddr, std::set<PAddr>> cached_ranges;
+
+    /**
+     * Secondary index of the GL textures in use by texture_cache, by their contents. Identical
+     * textures at different addresses, or a texture which moved, reuse the same GL texture
+     * instead of being decoded and uploaded again.
+     */
+    std::map<ContentKey, std::weak_ptr<OGLTexture>> content_index;
+
+    /// Addresses of the cached textures, most recently bound first
+    std::list<PAddr> lru_list;
+
+    /**
+     * GL textures which aren't used by any cached texture anymore, by width, height and internal
+     * format. Decoded textures are always stored as RGBA8, so they can be reused for any texture
+     * of the same size without reallocating their storage, and compressed ones for any other
+     * texture uploaded in the same compressed format.
+     */
+    using FreeKey = std::tuple<GLuint, GLuint, GLenum>;
+    std::map<FreeKey, std::vector<OGLTexture>> free_textures;
+    size_t num_free_textures = 0;
+
+    /**
+     * Sampler parameters last set on each GL texture of the cache, including the pooled ones.
+     * Parameters are only re-specified when a texture is bound with a different sampling setup.
+     */
+    std::unordered_map<GLuint, SamplerKey> applied_samplers;
+
+    /// Estimated size of the GL textures used by texture_cache, and of the ones in free_textures
+    u64 vram_size = 0;
+    u64 free_vram_size = 0;
+
+    /// Block compressed formats supported by the driver, queried on first use
+    bool compressed_formats_checked = false;
+    bool has_etc2 = false;
+    bool has_s3tc = false;
+
+    /// Loads the replacements of textures from the texture pack, unless there's none
+    std::unique_ptr<TextureReplacer> replacer;
 };
@@ -47,6 +47,12 @@ public:
         handle = ShaderUtil::LoadShaders(vert_shader, frag_shader);
     }
 
+    /// Starts creating the internal OpenGL resource in the background, see ShaderUtil::StartLoadShaders
+    void CreateAsync(const char* vert_shader, const char* frag_shader) {
+        if (handle != 0) return;
+        handle = ShaderUtil::StartLoadShaders(vert_shader, frag_shader);
+    }
+
     /// Deletes the internal OpenGL resource
     void Release() {
         if (handle == 0) return;
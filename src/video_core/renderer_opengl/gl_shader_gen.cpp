@@ -0,0 +1,748 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+
+#include "common/logging/log.h"
+
+#include "video_core/vertex_shader_program.h"
+#include "video_core/renderer_opengl/gl_shader_gen.h"
+
+using Pica::Regs;
+using TevStageConfig = Regs::TevStageConfig;
+using Pica::VertexShader::DecodedInstruction;
+using Pica::VertexShader::DecodedProgram;
+using Pica::VertexShader::DecodedSource;
+
+PicaShaderConfig PicaShaderConfig::CurrentConfig() {
+    const auto& regs = Pica::g_state.regs;
+
+    PicaShaderConfig config;
+    // Zero everything including padding, since configurations are compared and hashed bytewise
+    std::memset(&config, 0, sizeof(PicaShaderConfig));
+
+    config.alpha_test_func = regs.output_merger.alpha_test.enable ?
+        regs.output_merger.alpha_test.func.Value() : Regs::CompareFunc::Always;
+
+    const auto tev_stages = regs.GetTevStages();
+    for (unsigned i = 0; i < tev_stages.size(); ++i) {
+        u32 words[5];
+        static_assert(sizeof(words) == sizeof(TevStageConfig), "Unexpected TevStageConfig size");
+        std::memcpy(words, &tev_stages[i], sizeof(words));
+
+        // Word 3 holds the constant color, which is a uniform
+        config.tev_stages[i] = { words[0], words[1], words[2], words[4] };
+    }
+
+    config.combiner_buffer_updates = regs.tev_combiner_buffer_input.update_mask_rgb |
+                                     (regs.tev_combiner_buffer_input.update_mask_a << 4);
+
+    return config;
+}
+
+PicaVSConfig PicaVSConfig::CurrentConfig() {
+    const auto& regs = Pica::g_state.regs;
+
+    PicaVSConfig config;
+    std::memset(&config, 0, sizeof(PicaVSConfig));
+
+    config.program_hash = Pica::VertexShader::GetDecodedProgram().hash;
+    config.main_offset = regs.vs.main_offset;
+    config.num_attributes = regs.vertex_attributes.GetNumTotalAttributes();
+
+    static_assert(sizeof(config.input_register_map) == sizeof(regs.vs.input_register_map), "Unexpected input register map size");
+    std::memcpy(&config.input_register_map, &regs.vs.input_register_map, sizeof(config.input_register_map));
+    static_assert(sizeof(config.output_attributes) == sizeof(regs.vs_output_attributes), "Unexpected output attributes size");
+    std::memcpy(config.output_attributes.data(), regs.vs_output_attributes, sizeof(config.output_attributes));
+
+    const auto& bool_uniforms = Pica::g_state.vs.uniforms.b;
+    for (unsigned i = 0; i < bool_uniforms.size(); ++i)
+        config.bool_uniforms |= (bool_uniforms[i] ? 1 : 0) << i;
+
+    return config;
+}
+
+namespace GLShaders {
+
+/// Restores a TevStageConfig from the raw words stored in a shader configuration
+static void GetTevStage(const PicaShaderConfig::TevStage& stage, TevStageConfig& config) {
+    const u32 words[5] = { stage.sources_raw, stage.modifiers_raw, stage.ops_raw, 0, stage.scales_raw };
+    std::memcpy(&config, words, sizeof(config));
+}
+
+static bool IsPassThroughTevStage(const TevStageConfig& stage) {
+    return (stage.color_op == TevStageConfig::Operation::Replace &&
+            stage.alpha_op == TevStageConfig::Operation::Replace &&
+            stage.color_source1 == TevStageConfig::Source::Previous &&
+            stage.alpha_source1 == TevStageConfig::Source::Previous &&
+            stage.color_modifier1 == TevStageConfig::ColorModifier::SourceColor &&
+            stage.alpha_modifier1 == TevStageConfig::AlphaModifier::SourceAlpha &&
+            stage.GetColorMultiplier() == 1 &&
+            stage.GetAlphaMultiplier() == 1);
+}
+
+/// Returns the GLSL expression for the given TEV source in the given stage
+static std::string GetSource(TevStageConfig::Source source, unsigned stage_index) {
+    using Source = TevStageConfig::Source;
+    switch (source) {
+    case Source::PrimaryColor:
+    // HACK: Until we implement fragment lighting, use primary_color
+    case Source::PrimaryFragmentColor:
+        return "o[2]";
+
+    // HACK: Until we implement fragment lighting, use zero
+    case Source::SecondaryFragmentColor:
+        return "vec4(0.0)";
+
+    case Source::Texture0:
+        return "texcolor0";
+
+    case Source::Texture1:
+        return "texcolor1";
+
+    case Source::Texture2:
+        return "texcolor2";
+
+    case Source::PreviousBuffer:
+        return "combiner_buffer";
+
+    case Source::Constant:
+        return "const_color[" + std::to_string(stage_index) + "]";
+
+    case Source::Previous:
+        return "last_tex_env_out";
+
+    default:
+        // TODO: Texture3 (procedural texture) is not supported
+        LOG_CRITICAL(Render_OpenGL, "Unknown TEV source %u", (u32)source);
+        return "vec4(0.0)";
+    }
+}
+
+static std::string GetColorModifier(TevStageConfig::ColorModifier modifier, const std::string& source) {
+    using ColorModifier = TevStageConfig::ColorModifier;
+    switch (modifier) {
+    case ColorModifier::SourceColor:
+        return source + ".rgb";
+    case ColorModifier::OneMinusSourceColor:
+        return "vec3(1.0) - " + source + ".rgb";
+    case ColorModifier::SourceAlpha:
+        return source + ".aaa";
+    case ColorModifier::OneMinusSourceAlpha:
+        return "vec3(1.0) - " + source + ".aaa";
+    case ColorModifier::SourceRed:
+        return source + ".rrr";
+    case ColorModifier::OneMinusSourceRed:
+        return "vec3(1.0) - " + source + ".rrr";
+    case ColorModifier::SourceGreen:
+        return source + ".ggg";
+    case ColorModifier::OneMinusSourceGreen:
+        return "vec3(1.0) - " + source + ".ggg";
+    case ColorModifier::SourceBlue:
+        return source + ".bbb";
+    case ColorModifier::OneMinusSourceBlue:
+        return "vec3(1.0) - " + source + ".bbb";
+    default:
+        LOG_CRITICAL(Render_OpenGL, "Unknown TEV color modifier %u", (u32)modifier);
+        return "vec3(0.0)";
+    }
+}
+
+static std::string GetAlphaModifier(TevStageConfig::AlphaModifier modifier, const std::string& source) {
+    using AlphaModifier = TevStageConfig::AlphaModifier;
+    switch (modifier) {
+    case AlphaModifier::SourceAlpha:
+        return source + ".a";
+    case AlphaModifier::OneMinusSourceAlpha:
+        return "1.0 - " + source + ".a";
+    case AlphaModifier::SourceRed:
+        return source + ".r";
+    case AlphaModifier::OneMinusSourceRed:
+        return "1.0 - " + source + ".r";
+    case AlphaModifier::SourceGreen:
+        return source + ".g";
+    case AlphaModifier::OneMinusSourceGreen:
+        return "1.0 - " + source + ".g";
+    case AlphaModifier::SourceBlue:
+        return source + ".b";
+    case AlphaModifier::OneMinusSourceBlue:
+        return "1.0 - " + source + ".b";
+    default:
+        LOG_CRITICAL(Render_OpenGL, "Unknown TEV alpha modifier %u", (u32)modifier);
+        return "0.0";
+    }
+}
+
+/**
+ * Returns the GLSL expression combining the three operands named `operands`[0..2] with the
+ * given operation. `one` is the GLSL expression of one in the operands' type.
+ */
+static std::string GetCombine(TevStageConfig::Operation operation, const std::string& operands, const std::string& one) {
+    const std::string a = operands + "[0]";
+    const std::string b = operands + "[1]";
+    const std::string c = operands + "[2]";
+
+    using Operation = TevStageConfig::Operation;
+    switch (operation) {
+    case Operation::Replace:
+        return a;
+    case Operation::Modulate:
+        return a + " * " + b;
+    case Operation::Add:
+        return "min(" + a + " + " + b + ", 1.0)";
+    case Operation::AddSigned:
+        return "clamp(" + a + " + " + b + " - " + one + " * 0.5, 0.0, 1.0)";
+    case Operation::Lerp:
+        return a + " * " + c + " + " + b + " * (" + one + " - " + c + ")";
+    case Operation::Subtract:
+        return "max(" + a + " - " + b + ", 0.0)";
+    case Operation::MultiplyThenAdd:
+        return "min(" + a + " * " + b + " + " + c + ", 1.0)";
+    case Operation::AddThenMultiply:
+        return "min(" + a + " + " + b + ", 1.0) * " + c;
+    default:
+        LOG_CRITICAL(Render_OpenGL, "Unknown TEV combiner operation %u", (u32)operation);
+        return one + " * 0.0";
+    }
+}
+
+/// Returns the GLSL condition under which a fragment fails the given alpha test
+static std::string GetAlphaTestFailCondition(Regs::CompareFunc func) {
+    using CompareFunc = Regs::CompareFunc;
+    switch (func) {
+    case CompareFunc::Never:
+        return "true";
+    case CompareFunc::Always:
+        return "false";
+    case CompareFunc::Equal:
+        return "last_tex_env_out.a != alphatest_ref";
+    case CompareFunc::NotEqual:
+        return "last_tex_env_out.a == alphatest_ref";
+    case CompareFunc::LessThan:
+        return "last_tex_env_out.a >= alphatest_ref";
+    case CompareFunc::LessThanOrEqual:
+        return "last_tex_env_out.a > alphatest_ref";
+    case CompareFunc::GreaterThan:
+        return "last_tex_env_out.a <= alphatest_ref";
+    case CompareFunc::GreaterThanOrEqual:
+        return "last_tex_env_out.a < alphatest_ref";
+    default:
+        LOG_CRITICAL(Render_OpenGL, "Unknown alpha test function %u", (u32)func);
+        return "false";
+    }
+}
+
+std::string GenerateFragmentShader(const PicaShaderConfig& config) {
+    std::array<TevStageConfig, 6> stages;
+    std::array<bool, 6> stage_enabled;
+    bool uses_texture[3] = {};
+
+    for (unsigned i = 0; i < stages.size(); ++i) {
+        GetTevStage(config.tev_stages[i], stages[i]);
+        stage_enabled[i] = !IsPassThroughTevStage(stages[i]);
+        if (!stage_enabled[i])
+            continue;
+
+        const TevStageConfig::Source sources[] = {
+            stages[i].color_source1, stages[i].color_source2, stages[i].color_source3,
+            stages[i].alpha_source1, stages[i].alpha_source2, stages[i].alpha_source3
+        };
+        for (auto source : sources) {
+            if (source == TevStageConfig::Source::Texture0) uses_texture[0] = true;
+            if (source == TevStageConfig::Source::Texture1) uses_texture[1] = true;
+            if (source == TevStageConfig::Source::Texture2) uses_texture[2] = true;
+        }
+    }
+
+    std::string out = R"(
+#version 150 core
+
+#define NUM_VTX_ATTR 7
+#define NUM_TEV_STAGES 6
+
+in vec4 o[NUM_VTX_ATTR];
+out vec4 color;
+
+uniform sampler2D tex[3];
+
+layout (std140) uniform shader_data {
+    vec4 const_color[NUM_TEV_STAGES];
+    vec4 tev_combiner_buffer_color;
+    float alphatest_ref;
+};
+
+void main(void) {
+    vec4 combiner_buffer = tev_combiner_buffer_color;
+    vec4 last_tex_env_out = vec4(0.0);
+)";
+
+    // Sample each texture at most once
+    // TODO: Texture coordinates of texture 2 are unverified
+    static const char* tex_coords[] = { "o[3].xy", "o[3].zw", "o[5].zw" };
+    for (int i = 0; i < 3; ++i) {
+        if (uses_texture[i]) {
+            out += "    vec4 texcolor" + std::to_string(i) + " = texture(tex[" + std::to_string(i) + "], " +
+                   tex_coords[i] + ");\n";
+        }
+    }
+
+    for (unsigned i = 0; i < stages.size(); ++i) {
+        const auto& stage = stages[i];
+        const std::string index = std::to_string(i);
+
+        if (stage_enabled[i]) {
+            out += "\n    // TEV stage " + index + "\n";
+            out += "    vec3 color_results_" + index + "[3] = vec3[3](" +
+                   GetColorModifier(stage.color_modifier1, GetSource(stage.color_source1, i)) + ", " +
+                   GetColorModifier(stage.color_modifier2, GetSource(stage.color_source2, i)) + ", " +
+                   GetColorModifier(stage.color_modifier3, GetSource(stage.color_source3, i)) + ");\n";
+            out += "    float alpha_results_" + index + "[3] = float[3](" +
+                   GetAlphaModifier(stage.alpha_modifier1, GetSource(stage.alpha_source1, i)) + ", " +
+                   GetAlphaModifier(stage.alpha_modifier2, GetSource(stage.alpha_source2, i)) + ", " +
+                   GetAlphaModifier(stage.alpha_modifier3, GetSource(stage.alpha_source3, i)) + ");\n";
+            out += "    last_tex_env_out = vec4(min((" +
+                   GetCombine(stage.color_op, "color_results_" + index, "vec3(1.0)") + ") * " +
+                   std::to_string(stage.GetColorMultiplier()) + ".0, 1.0), min((" +
+                   GetCombine(stage.alpha_op, "alpha_results_" + index, "1.0") + ") * " +
+                   std::to_string(stage.GetAlphaMultiplier()) + ".0, 1.0));\n";
+        }
+
+        if (config.combiner_buffer_updates & (1 << i))
+            out += "    combiner_buffer.rgb = last_tex_env_out.rgb;\n";
+
+        if (config.combiner_buffer_updates & (0x10 << i))
+            out += "    combiner_buffer.a = last_tex_env_out.a;\n";
+    }
+
+    if (config.alpha_test_func != Regs::CompareFunc::Always)
+        out += "\n    if (" + GetAlphaTestFailCondition(config.alpha_test_func) + ")\n        discard;\n";
+
+    out += "\n    color = last_tex_env_out;\n}\n";
+    return out;
+}
+
+/// Upper bound for the number of instructions in a translated program, after inlining calls
+static const unsigned MAX_TRANSLATED_INSTRUCTIONS = 4096;
+
+/// Maximum nesting depth of calls, conditionals and loops, same as the interpreter's call stack
+static const unsigned MAX_NESTING_DEPTH = 16;
+
+/**
+ * Translates a decoded program into structured GLSL. Flow control depending on boolean uniforms is
+ * resolved during the translation, calls are inlined and conditionals and loops become GLSL blocks.
+ * Jumps are only supported in the forward direction within the enclosing block.
+ */
+class VertexShaderTranslator {
+public:
+    VertexShaderTranslator(const DecodedProgram& program, u32 bool_uniforms)
+        : program(program), bool_uniforms(bool_uniforms) {
+    }
+
+    /**
+     * Appends the translation of the instructions in [begin, end) to the output
+     * @return False if the instructions can't be translated
+     */
+    bool TranslateRange(u32 begin, u32 end, const std::string& indent);
+
+    std::string out;
+
+private:
+    bool GetBoolUniform(const DecodedInstruction& instr) const {
+        return (bool_uniforms & (1 << instr.bool_uniform_id)) != 0;
+    }
+
+    bool TranslateArithmetic(const DecodedInstruction& instr, const std::string& indent);
+
+    /// Translates a nested block of instructions, such as the body of a call or conditional
+    bool TranslateBlock(u32 begin, u32 end, const std::string& indent);
+
+    const DecodedProgram& program;
+    const u32 bool_uniforms;
+
+    unsigned num_instructions = 0;
+    unsigned depth = 0;
+    unsigned num_loops = 0;
+};
+
+/// Returns the GLSL expression reading the given source operand, or an empty string if it's not supported
+static std::string GetSourceOperand(const DecodedSource& source) {
+    using nihstro::RegisterType;
+
+    static const char components[] = "xyzw";
+    std::string swizzle = ".";
+    for (int i = 0; i < 4; ++i)
+        swizzle += components[source.selectors[i]];
+
+    const auto& reg = source.source_register;
+    const std::string index = std::to_string(reg.GetIndex());
+
+    std::string value;
+    if (source.address_register_index != 0) {
+        // The uniform arrays used for skinning are the main user of relative addressing. Indices
+        // out of range read the other register types on hardware; here they're clamped instead.
+        if (reg.GetRegisterType() != RegisterType::FloatUniform)
+            return "";
+
+        static const char* offsets[] = { "address_registers.x", "address_registers.y", "loop_counter" };
+        value = "vs_f[clamp(" + index + " + " + offsets[source.address_register_index - 1] + ", 0, 95)]";
+    } else {
+        switch (reg.GetRegisterType()) {
+        case RegisterType::Input:
+            value = "reg_in[" + index + "]";
+            break;
+
+        case RegisterType::Temporary:
+            value = "reg_tmp[" + index + "]";
+            break;
+
+        case RegisterType::FloatUniform:
+            value = "vs_f[" + index + "]";
+            break;
+
+        default:
+            return "vec4(0.0)";
+        }
+    }
+
+    return source.negate ? "(-" + value + swizzle + ")" : value + swizzle;
+}
+
+/// Returns the GLSL expression evaluating the flow control condition of the given instruction
+static std::string GetCondition(const DecodedInstruction& instr) {
+    using ConditionOp = DecodedInstruction::ConditionOp;
+
+    const std::string x = std::string(instr.refx ? "" : "!") + "conditional_code.x";
+    const std::string y = std::string(instr.refy ? "" : "!") + "conditional_code.y";
+
+    switch (instr.condition_op) {
+    case ConditionOp::Or:    return "(" + x + " || " + y + ")";
+    case ConditionOp::And:   return "(" + x + " && " + y + ")";
+    case ConditionOp::JustX: return x;
+    case ConditionOp::JustY:
+    default:                 return y;
+    }
+}
+
+bool VertexShaderTranslator::TranslateArithmetic(const DecodedInstruction& instr, const std::string& indent) {
+    using Op = DecodedInstruction::Op;
+    using CompareOp = DecodedInstruction::CompareOp;
+    using Pica::VertexShader::REGISTER_OUTPUT;
+    using Pica::VertexShader::REGISTER_TEMPORARY;
+
+    std::string src[3];
+    for (int i = 0; i < instr.num_sources; ++i) {
+        src[i] = GetSourceOperand(instr.src[i]);
+        if (src[i].empty())
+            return false;
+    }
+
+    if (instr.op == Op::MOVA) {
+        if (instr.dest_enabled[0])
+            out += indent + "address_registers.x = int(" + src[0] + ".x);\n";
+        if (instr.dest_enabled[1])
+            out += indent + "address_registers.y = int(" + src[0] + ".y);\n";
+        return true;
+    }
+
+    if (instr.op == Op::CMP) {
+        static const char components[] = "xy";
+        for (int i = 0; i < 2; ++i) {
+            const char* compare;
+            switch (instr.compare_ops[i]) {
+            case CompareOp::Equal:        compare = " == "; break;
+            case CompareOp::NotEqual:     compare = " != "; break;
+            case CompareOp::LessThan:     compare = " < ";  break;
+            case CompareOp::LessEqual:    compare = " <= "; break;
+            case CompareOp::GreaterThan:  compare = " > ";  break;
+            case CompareOp::GreaterEqual: compare = " >= "; break;
+            default:
+                return false;
+            }
+
+            const std::string component = std::string(".") + components[i];
+            out += indent + "conditional_code" + component + " = " +
+                   src[0] + component + compare + src[1] + component + ";\n";
+        }
+        return true;
+    }
+
+    std::string value;
+    switch (instr.op) {
+    case Op::ADD: value = src[0] + " + " + src[1]; break;
+    case Op::MUL: value = src[0] + " * " + src[1]; break;
+    case Op::MAD: value = src[0] + " * " + src[1] + " + " + src[2]; break;
+    case Op::FLR: value = "floor(" + src[0] + ")"; break;
+    case Op::MAX: value = "max(" + src[0] + ", " + src[1] + ")"; break;
+    case Op::MIN: value = "min(" + src[0] + ", " + src[1] + ")"; break;
+    case Op::DP3: value = "vec4(dot(" + src[0] + ".xyz, " + src[1] + ".xyz))"; break;
+    case Op::DP4: value = "vec4(dot(" + src[0] + ", " + src[1] + "))"; break;
+    case Op::RCP: value = "vec4(1.0) / " + src[0]; break;
+    case Op::RSQ: value = "inversesqrt(" + src[0] + ")"; break;
+    case Op::MOV: value = src[0]; break;
+    case Op::SLT: value = "vec4(lessThan(" + src[0] + ", " + src[1] + "))"; break;
+    default:
+        return false;
+    }
+
+    std::string dest;
+    if (instr.dest_register >= REGISTER_OUTPUT && instr.dest_register < REGISTER_OUTPUT + 16) {
+        dest = "reg_out[" + std::to_string(instr.dest_register - REGISTER_OUTPUT) + "]";
+    } else if (instr.dest_register >= REGISTER_TEMPORARY && instr.dest_register < REGISTER_TEMPORARY + 16) {
+        dest = "reg_tmp[" + std::to_string(instr.dest_register - REGISTER_TEMPORARY) + "]";
+    } else {
+        // Writes to invalid registers are discarded
+        return true;
+    }
+
+    static const char components[] = "xyzw";
+    std::string mask;
+    for (int i = 0; i < 4; ++i) {
+        if (instr.dest_enabled[i])
+            mask += components[i];
+    }
+
+    if (!mask.empty())
+        out += indent + dest + "." + mask + " = (" + value + ")." + mask + ";\n";
+
+    return true;
+}
+
+bool VertexShaderTranslator::TranslateBlock(u32 begin, u32 end, const std::string& indent) {
+    if (depth == MAX_NESTING_DEPTH)
+        return false;
+
+    ++depth;
+    bool result = TranslateRange(begin, end, indent);
+    --depth;
+    return result;
+}
+
+bool VertexShaderTranslator::TranslateRange(u32 begin, u32 end, const std::string& indent) {
+    using Op = DecodedInstruction::Op;
+
+    const std::string inner_indent = indent + "    ";
+
+    u32 pc = begin;
+    while (pc < end) {
+        if (pc >= program.code.size() || ++num_instructions > MAX_TRANSLATED_INSTRUCTIONS)
+            return false;
+
+        const DecodedInstruction& instr = program.code[pc];
+
+        switch (instr.op) {
+        case Op::ADD:
+        case Op::MUL:
+        case Op::FLR:
+        case Op::MAX:
+        case Op::MIN:
+        case Op::DP3:
+        case Op::DP4:
+        case Op::RCP:
+        case Op::RSQ:
+        case Op::MOVA:
+        case Op::MOV:
+        case Op::SLT:
+        case Op::CMP:
+        case Op::MAD:
+            if (!TranslateArithmetic(instr, indent))
+                return false;
+            ++pc;
+            break;
+
+        case Op::NOP:
+            ++pc;
+            break;
+
+        case Op::END:
+            // Nothing after this is executed, so the rest of the block is skipped
+            out += indent + "return;\n";
+            return true;
+
+        case Op::JMPU:
+            if (!GetBoolUniform(instr)) {
+                ++pc;
+                break;
+            }
+
+            if (instr.dest_offset <= pc || instr.dest_offset > end)
+                return false;
+            pc = instr.dest_offset;
+            break;
+
+        case Op::JMPC:
+            // A forward jump is the same as skipping the instructions in between unless the
+            // condition is false
+            if (instr.dest_offset <= pc || instr.dest_offset > end)
+                return false;
+
+            out += indent + "if (!" + GetCondition(instr) + ") {\n";
+            if (!TranslateBlock(pc + 1, instr.dest_offset, inner_indent))
+                return false;
+            out += indent + "}\n";
+            pc = instr.dest_offset;
+            break;
+
+        case Op::CALL:
+            if (!TranslateBlock(instr.dest_offset, instr.dest_offset + instr.num_instructions, indent))
+                return false;
+            ++pc;
+            break;
+
+        case Op::CALLU:
+            if (GetBoolUniform(instr) &&
+                !TranslateBlock(instr.dest_offset, instr.dest_offset + instr.num_instructions, indent)) {
+                return false;
+            }
+            ++pc;
+            break;
+
+        case Op::CALLC:
+            out += indent + "if (" + GetCondition(instr) + ") {\n";
+            if (!TranslateBlock(instr.dest_offset, instr.dest_offset + instr.num_instructions, inner_indent))
+                return false;
+            out += indent + "}\n";
+            ++pc;
+            break;
+
+        case Op::IFU:
+        case Op::IFC:
+        {
+            // The "then" block runs up to dest_offset, followed by num_instructions of "else" block
+            const u32 else_offset = instr.dest_offset;
+            const u32 end_offset = instr.dest_offset + instr.num_instructions;
+            if (else_offset <= pc || end_offset > end)
+                return false;
+
+            if (instr.op == Op::IFU) {
+                bool translated = GetBoolUniform(instr) ? TranslateBlock(pc + 1, else_offset, indent)
+                                                        : TranslateBlock(else_offset, end_offset, indent);
+                if (!translated)
+                    return false;
+            } else {
+                out += indent + "if (" + GetCondition(instr) + ") {\n";
+                if (!TranslateBlock(pc + 1, else_offset, inner_indent))
+                    return false;
+                out += indent + "} else {\n";
+                if (!TranslateBlock(else_offset, end_offset, inner_indent))
+                    return false;
+                out += indent + "}\n";
+            }
+
+            pc = end_offset;
+            break;
+        }
+
+        case Op::LOOP:
+        {
+            // The loop body ends with the instruction at dest_offset and runs int_uniform.x + 1 times
+            if (instr.dest_offset <= pc || instr.dest_offset + 1 > end)
+                return false;
+
+            const std::string uniform = "vs_i[" + std::to_string(instr.int_uniform_id) + "]";
+            const std::string iteration = "loop_iteration" + std::to_string(num_loops++);
+
+            out += indent + "loop_counter = " + uniform + ".y;\n";
+            out += indent + "for (int " + iteration + " = 0; " + iteration + " <= " + uniform + ".x; ++" + iteration + ") {\n";
+            if (!TranslateBlock(pc + 1, instr.dest_offset + 1, inner_indent))
+                return false;
+            out += inner_indent + "loop_counter += " + uniform + ".z;\n";
+            out += indent + "}\n";
+
+            pc = instr.dest_offset + 1;
+            break;
+        }
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string GenerateVertexShader(const PicaVSConfig& config) {
+    const DecodedProgram& program = Pica::VertexShader::GetDecodedProgram();
+
+    VertexShaderTranslator translator(program, config.bool_uniforms);
+    if (!translator.TranslateRange(config.main_offset, static_cast<u32>(program.code.size()), "    ")) {
+        LOG_DEBUG(Render_OpenGL, "Vertex shader %016llx can't be translated, shading on the CPU",
+                  (unsigned long long)config.program_hash);
+        return "";
+    }
+
+    std::string out = R"(
+#version 150 core
+
+#define NUM_VTX_ATTR 7
+
+)";
+
+    out += "in vec4 vert_attributes[" + std::to_string(config.num_attributes) + "];\n";
+    out += R"(
+out vec4 o[NUM_VTX_ATTR];
+
+layout (std140) uniform vs_uniforms {
+    vec4 vs_f[96];
+    ivec4 vs_i[4];
+};
+
+vec4 reg_in[16];
+vec4 reg_tmp[16];
+vec4 reg_out[16];
+ivec2 address_registers;
+int loop_counter;
+bvec2 conditional_code;
+
+void exec_shader() {
+)";
+
+    out += translator.out;
+    out += R"(}
+
+void main() {
+    for (int i = 0; i < 16; ++i) {
+        reg_in[i] = vec4(0.0);
+        reg_tmp[i] = vec4(0.0);
+        reg_out[i] = vec4(0.0);
+    }
+    address_registers = ivec2(0);
+    loop_counter = 0;
+    conditional_code = bvec2(false);
+
+)";
+
+    // Input registers which aren't mapped to an attribute read as zero
+    for (unsigned attribute = 0; attribute < std::min(config.num_attributes, 16u); ++attribute) {
+        unsigned reg = (config.input_register_map >> (4 * attribute)) & 0xF;
+        out += "    reg_in[" + std::to_string(reg) + "] = vert_attributes[" + std::to_string(attribute) + "];\n";
+    }
+
+    out += "\n    exec_shader();\n\n";
+    out += "    for (int i = 0; i < NUM_VTX_ATTR; ++i)\n        o[i] = vec4(0.0);\n";
+
+    // Output semantics index the components of the output vertex, four per entry of o
+    static const char components[] = "xyzw";
+    for (unsigned i = 0; i < config.output_attributes.size(); ++i) {
+        for (unsigned comp = 0; comp < 4; ++comp) {
+            unsigned semantic = (config.output_attributes[i] >> (8 * comp)) & 0x1F;
+            if (semantic >= 4 * 7)
+                continue;
+
+            out += std::string("    o[") + std::to_string(semantic / 4) + "]." + components[semantic % 4] +
+                   " = reg_out[" + std::to_string(i) + "]." + components[comp] + ";\n";
+        }
+    }
+
+    out += R"(
+    // The hardware takes the absolute and saturates vertex colors before interpolating them
+    o[2] = min(abs(o[2]), vec4(1.0));
+
+    gl_Position = vec4(o[0].x, -o[0].y, -o[0].z, o[0].w);
+}
+)";
+
+    return out;
+}
+
+} // namespace
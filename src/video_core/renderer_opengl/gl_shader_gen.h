@@ -0,0 +1,110 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "common/common_types.h"
+#include "common/hash.h"
+
+#include "video_core/pica.h"
+
+/**
+ * Pica state which the generated fragment shader code depends on. Everything else (constant
+ * colors, the combiner buffer color, the alpha test reference value) is passed in as uniforms,
+ * so that changing it doesn't require a new shader program.
+ */
+struct PicaShaderConfig {
+    /// Builds the configuration matching the current Pica register state
+    static PicaShaderConfig CurrentConfig();
+
+    bool operator ==(const PicaShaderConfig& other) const {
+        return std::memcmp(this, &other, sizeof(PicaShaderConfig)) == 0;
+    }
+
+    /// Raw words of a TEV stage configuration, without the constant color
+    struct TevStage {
+        u32 sources_raw;
+        u32 modifiers_raw;
+        u32 ops_raw;
+        u32 scales_raw;
+    };
+
+    /// Alpha test function, or Always if alpha testing is disabled
+    Pica::Regs::CompareFunc alpha_test_func;
+
+    std::array<TevStage, 6> tev_stages;
+
+    /// Which TEV stages write to the combiner buffer (bits 0-3: color, bits 4-7: alpha)
+    u32 combiner_buffer_updates;
+};
+
+namespace std {
+
+template <>
+struct hash<PicaShaderConfig> {
+    size_t operator()(const PicaShaderConfig& config) const {
+        return static_cast<size_t>(Common::ComputeHash64(&config, sizeof(PicaShaderConfig)));
+    }
+};
+
+} // namespace std
+
+/**
+ * Pica state which the generated vertex shader code depends on. Float and integer uniforms are
+ * passed in as uniforms, while the boolean uniforms are baked into the code so that flow control
+ * depending on them can be resolved during the translation.
+ */
+struct PicaVSConfig {
+    /// Builds the configuration matching the current Pica register and shader state
+    static PicaVSConfig CurrentConfig();
+
+    bool operator ==(const PicaVSConfig& other) const {
+        return std::memcmp(this, &other, sizeof(PicaVSConfig)) == 0;
+    }
+
+    /// Hash of the program code and swizzle data
+    u64 program_hash;
+
+    u32 main_offset;
+    u32 num_attributes;
+
+    /// Raw words of the input register map and of the output attribute mapping
+    u64 input_register_map;
+    std::array<u32, 7> output_attributes;
+
+    /// One bit per boolean uniform
+    u32 bool_uniforms;
+};
+
+namespace std {
+
+template <>
+struct hash<PicaVSConfig> {
+    size_t operator()(const PicaVSConfig& config) const {
+        return static_cast<size_t>(Common::ComputeHash64(&config, sizeof(PicaVSConfig)));
+    }
+};
+
+} // namespace std
+
+namespace GLShaders {
+
+/// Generates a fragment shader implementing the given TEV and alpha test configuration
+std::string GenerateFragmentShader(const PicaShaderConfig& config);
+
+/**
+ * Translates the currently loaded Pica vertex shader program into a GLSL vertex shader, which
+ * feeds the same outputs as g_vertex_shader_hw to the generated fragment shaders.
+ * @param config Configuration of the current program, as returned by PicaVSConfig::CurrentConfig()
+ * @return The GLSL source, or an empty string if the program uses flow control or instructions
+ *         which can't be translated, in which case its vertices have to be shaded on the CPU
+ */
+std::string GenerateVertexShader(const PicaVSConfig& config);
+
+} // namespace
@@ -5,9 +5,15 @@
 #include "gl_shader_util.h"
 #include "common/logging/log.h"
 
+#include <cstring>
 #include <vector>
 #include <algorithm>
 
+// Part of KHR_parallel_shader_compile and ARB_parallel_shader_compile, which share the value
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace ShaderUtil {
 
 GLuint LoadShaders(const char* vertex_shader, const char* fragment_shader) {
@@ -87,4 +93,65 @@ GLuint LoadShaders(const char* vertex_shader, const char* fragment_shader) {
     return program_id;
 }
 
+bool IsParallelCompileSupported() {
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension == nullptr)
+            continue;
+        if (std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 ||
+            std::strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+            return true;
+    }
+    return false;
+}
+
+GLuint StartLoadShaders(const char* vertex_shader, const char* fragment_shader) {
+    GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(vertex_shader_id, 1, &vertex_shader, nullptr);
+    glCompileShader(vertex_shader_id);
+    glShaderSource(fragment_shader_id, 1, &fragment_shader, nullptr);
+    glCompileShader(fragment_shader_id);
+
+    // Querying the compile status here would wait for the compiler, so errors are only reported
+    // through the program's info log
+    GLuint program_id = glCreateProgram();
+    glAttachShader(program_id, vertex_shader_id);
+    glAttachShader(program_id, fragment_shader_id);
+    glLinkProgram(program_id);
+
+    // The shaders are only flagged for deletion, they live on as long as they're attached
+    glDeleteShader(vertex_shader_id);
+    glDeleteShader(fragment_shader_id);
+
+    return program_id;
+}
+
+bool IsProgramReady(GLuint program_id) {
+    GLint completed = GL_FALSE;
+    glGetProgramiv(program_id, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != GL_FALSE;
+}
+
+void FinishProgram(GLuint program_id) {
+    GLint result = GL_FALSE;
+    int info_log_length;
+
+    glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+    glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &info_log_length);
+
+    if (info_log_length > 1) {
+        std::vector<char> program_error(info_log_length);
+        glGetProgramInfoLog(program_id, info_log_length, nullptr, &program_error[0]);
+        if (result) {
+            LOG_DEBUG(Render_OpenGL, "%s", &program_error[0]);
+        } else {
+            LOG_ERROR(Render_OpenGL, "Error linking shader:\n%s", &program_error[0]);
+        }
+    }
+}
+
 }
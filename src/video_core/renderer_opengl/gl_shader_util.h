@@ -10,4 +10,19 @@ namespace ShaderUtil {
 
 GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
 
+/// Returns true if the driver compiles and links programs in the background (KHR/ARB_parallel_shader_compile)
+bool IsParallelCompileSupported();
+
+/**
+ * Starts compiling and linking a program without waiting for the result. The program mustn't be
+ * used before IsProgramReady() returned true, and its status is checked by FinishProgram().
+ */
+GLuint StartLoadShaders(const char* vertex_shader, const char* fragment_shader);
+
+/// Returns true once a program started by StartLoadShaders() has finished linking
+bool IsProgramReady(GLuint program_id);
+
+/// Logs the link status of a program started by StartLoadShaders(), waiting for it if needed
+void FinishProgram(GLuint program_id);
+
 }
@@ -0,0 +1,88 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+
+#include "video_core/renderer_opengl/gl_stream_buffer.h"
+
+void OGLStreamBuffer::Create(GLenum target, GLsizeiptr size) {
+    if (handle != 0) return;
+
+    glGenBuffers(1, &handle);
+
+    this->target = target;
+    buffer_size = size;
+    region_size = size / NUM_REGIONS;
+    allocated = false;
+    position = unfenced_position = 0;
+}
+
+void OGLStreamBuffer::Release() {
+    if (handle == 0) return;
+
+    for (GLsync& fence : fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    glDeleteBuffers(1, &handle);
+    handle = 0;
+}
+
+void OGLStreamBuffer::FenceRegions(GLsizeiptr start, GLsizeiptr end) {
+    for (GLsizeiptr region = start / region_size; region * region_size < end; ++region) {
+        if (fences[region] == nullptr)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+void OGLStreamBuffer::WaitForRegions(GLsizeiptr start, GLsizeiptr end) {
+    for (GLsizeiptr region = start / region_size; region * region_size < end; ++region) {
+        if (fences[region] != nullptr) {
+            glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fences[region]);
+            fences[region] = nullptr;
+        }
+    }
+}
+
+std::pair<u8*, GLintptr> OGLStreamBuffer::Map(GLsizeiptr size, GLsizeiptr alignment) {
+    ASSERT(size <= buffer_size);
+
+    if (!allocated) {
+        glBufferData(target, buffer_size, nullptr, GL_STREAM_DRAW);
+        allocated = true;
+    }
+
+    // Fence the regions which have been completely written since the last call. The draws reading
+    // them have been issued by now, so the regions are free again once the fences signal.
+    GLsizeiptr fenced_end = position / region_size * region_size;
+    if (fenced_end > unfenced_position) {
+        FenceRegions(unfenced_position, fenced_end);
+        unfenced_position = fenced_end;
+    }
+
+    position = (position + alignment - 1) / alignment * alignment;
+
+    if (position + size > buffer_size) {
+        // Wrap around, fencing whatever was written at the end of the buffer since the last fence
+        FenceRegions(unfenced_position, buffer_size);
+        position = unfenced_position = 0;
+    }
+
+    WaitForRegions(position, position + size);
+
+    void* pointer = glMapBufferRange(target, position, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+    return std::make_pair(static_cast<u8*>(pointer), static_cast<GLintptr>(position));
+}
+
+void OGLStreamBuffer::Unmap(GLsizeiptr used_size) {
+    glUnmapBuffer(target);
+
+    position += used_size;
+}
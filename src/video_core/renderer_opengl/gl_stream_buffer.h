@@ -0,0 +1,78 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <utility>
+
+#include "common/common_types.h"
+
+#include "video_core/renderer_opengl/generated/gl_3_2_core.h"
+
+/**
+ * Buffer object which is written to as a ring, for data which is uploaded once and drawn once.
+ *
+ * The storage is allocated a single time and then filled through unsynchronized mappings, so the
+ * driver never has to reallocate or orphan it. The buffer is split into regions, each of which
+ * gets a fence once it has been written and drawn from; a region is only reused after its fence
+ * has signaled.
+ *
+ * The buffer has to be bound to its target while calling Map and Unmap.
+ */
+class OGLStreamBuffer : private NonCopyable {
+public:
+    OGLStreamBuffer() = default;
+    ~OGLStreamBuffer() { Release(); }
+
+    /**
+     * Creates the internal OpenGL buffer. Storage is allocated on the first call to Map.
+     * @param target Target the buffer will be bound to, e.g. GL_ARRAY_BUFFER
+     * @param size Size of the ring in bytes
+     */
+    void Create(GLenum target, GLsizeiptr size);
+
+    /// Deletes the internal OpenGL buffer and any pending fences
+    void Release();
+
+    /**
+     * Maps the next free part of the buffer for writing, waiting for the GPU if it is still in use.
+     * @param size Number of bytes to map, at most GetSize()
+     * @param alignment Alignment of the returned offset, e.g. the vertex stride
+     * @return Pointer to the mapped memory and its offset from the start of the buffer
+     */
+    std::pair<u8*, GLintptr> Map(GLsizeiptr size, GLsizeiptr alignment);
+
+    /**
+     * Unmaps the buffer after a call to Map.
+     * @param used_size Number of bytes which were actually written, at most the mapped size
+     */
+    void Unmap(GLsizeiptr used_size);
+
+    /// Returns the size of the ring in bytes
+    GLsizeiptr GetSize() const { return buffer_size; }
+
+    GLuint handle = 0;
+
+private:
+    static const int NUM_REGIONS = 16;
+
+    /// Inserts fences for the regions overlapping [start, end) which don't have one yet
+    void FenceRegions(GLsizeiptr start, GLsizeiptr end);
+
+    /// Waits until the GPU is done with the regions overlapping [start, end)
+    void WaitForRegions(GLsizeiptr start, GLsizeiptr end);
+
+    GLenum target = GL_ARRAY_BUFFER;
+    GLsizeiptr buffer_size = 0;
+    GLsizeiptr region_size = 0;
+    bool allocated = false;
+
+    /// Offset at which the next mapping starts
+    GLsizeiptr position = 0;
+    /// Start of the data which has been written but isn't covered by a fence yet
+    GLsizeiptr unfenced_position = 0;
+
+    std::array<GLsync, NUM_REGIONS> fences{};
+};
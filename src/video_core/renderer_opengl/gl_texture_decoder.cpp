@@ -0,0 +1,259 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "video_core/renderer_opengl/gl_texture_decoder.h"
+
+/// Texture unit the raw data is bound to. Units 0-2 are used by the PICA fragment shader emulation.
+static const GLuint RAW_DATA_TEXTURE_UNIT = 3;
+
+// Covers the viewport with a triangle strip of four vertices, without any vertex attributes
+static const char vertex_shader[] = R"(
+#version 150 core
+
+void main() {
+    gl_Position = vec4(float((gl_VertexID & 1) * 2 - 1), float((gl_VertexID & 2) - 1), 0.0, 1.0);
+}
+)";
+
+// Mirrors DebugUtils::LookupTexture, using integer math so results match the CPU decoder exactly
+static const char fragment_shader[] = R"(
+#version 150 core
+
+uniform usamplerBuffer raw_data;
+uniform int format;
+uniform ivec2 size;
+uniform bool flip_y;
+
+out vec4 color;
+
+uint ReadByte(int offset) {
+    return texelFetch(raw_data, offset).r;
+}
+
+uint ReadU16(int offset) {
+    return ReadByte(offset) | (ReadByte(offset + 1) << 8);
+}
+
+uint ReadU32(int offset) {
+    return ReadU16(offset) | (ReadU16(offset + 2) << 16);
+}
+
+uint Convert4To8(uint value) {
+    return (value << 4) | value;
+}
+
+uint Convert5To8(uint value) {
+    return ((value << 3) | (value >> 2)) & 0xFFu;
+}
+
+uint Convert6To8(uint value) {
+    return (value << 2) | (value >> 4);
+}
+
+// Interleaves the lower 3 bits of each coordinate, see VideoCore::MortonInterleave
+int MortonInterleave(int x, int y) {
+    int i = 0;
+    for (int bit = 0; bit < 3; ++bit) {
+        i |= ((x >> bit) & 1) << (2 * bit);
+        i |= ((y >> bit) & 1) << (2 * bit + 1);
+    }
+    return i;
+}
+
+uvec3 DecodeETC1(uint low, uint high, int x, int y) {
+    int texel = 4 * x + y;
+
+    if ((high & 1u) != 0u) {
+        int tmp = x;
+        x = y;
+        y = tmp;
+    }
+
+    ivec3 base;
+    if ((high & 2u) != 0u) {
+        // Differential mode: 5 bit base color for the first half, plus a 3 bit signed delta for the second
+        base = ivec3((high >> 27) & 0x1Fu, (high >> 19) & 0x1Fu, (high >> 11) & 0x1Fu);
+        if (x >= 2) {
+            ivec3 delta = ivec3((high >> 24) & 7u, (high >> 16) & 7u, (high >> 8) & 7u);
+            base += delta - 8 * (delta >> 2);
+        }
+        base = ivec3(Convert5To8(uint(base.r) & 0xFFu), Convert5To8(uint(base.g) & 0xFFu), Convert5To8(uint(base.b) & 0xFFu));
+    } else if (x < 2) {
+        base = ivec3(Convert4To8((high >> 28) & 0xFu), Convert4To8((high >> 20) & 0xFu), Convert4To8((high >> 12) & 0xFu));
+    } else {
+        base = ivec3(Convert4To8((high >> 24) & 0xFu), Convert4To8((high >> 16) & 0xFu), Convert4To8((high >> 8) & 0xFu));
+    }
+
+    const int modifier_table[16] = int[16](2, 8, 5, 17, 9, 29, 13, 42, 18, 60, 24, 80, 33, 106, 47, 183);
+
+    uint table_index = (x < 2) ? ((high >> 5) & 7u) : ((high >> 2) & 7u);
+    int modifier = modifier_table[2 * int(table_index) + int((low >> texel) & 1u)];
+    if (((low >> (16 + texel)) & 1u) != 0u)
+        modifier = -modifier;
+
+    return uvec3(clamp(base + modifier, 0, 255));
+}
+
+uvec4 Decode(int x, int y) {
+    int coarse_x = x & ~7;
+    int coarse_y = y & ~7;
+    int texel = coarse_y * size.x + coarse_x * 8 + MortonInterleave(x, y);
+
+    switch (format) {
+    case 0: // RGBA8
+    {
+        int offset = texel * 4;
+        return uvec4(ReadByte(offset + 3), ReadByte(offset + 2), ReadByte(offset + 1), ReadByte(offset));
+    }
+    case 1: // RGB8
+    {
+        int offset = texel * 3;
+        return uvec4(ReadByte(offset + 2), ReadByte(offset + 1), ReadByte(offset), 255u);
+    }
+    case 2: // RGB5A1
+    {
+        uint pixel = ReadU16(texel * 2);
+        return uvec4(Convert5To8((pixel >> 11) & 0x1Fu), Convert5To8((pixel >> 6) & 0x1Fu),
+                     Convert5To8((pixel >> 1) & 0x1Fu), (pixel & 1u) * 255u);
+    }
+    case 3: // RGB565
+    {
+        uint pixel = ReadU16(texel * 2);
+        return uvec4(Convert5To8((pixel >> 11) & 0x1Fu), Convert6To8((pixel >> 5) & 0x3Fu),
+                     Convert5To8(pixel & 0x1Fu), 255u);
+    }
+    case 4: // RGBA4
+    {
+        uint pixel = ReadU16(texel * 2);
+        return uvec4(Convert4To8((pixel >> 12) & 0xFu), Convert4To8((pixel >> 8) & 0xFu),
+                     Convert4To8((pixel >> 4) & 0xFu), Convert4To8(pixel & 0xFu));
+    }
+    case 5: // IA8
+    {
+        uint i = ReadByte(texel * 2 + 1);
+        return uvec4(i, i, i, ReadByte(texel * 2));
+    }
+    case 7: // I8
+    {
+        uint i = ReadByte(texel);
+        return uvec4(i, i, i, 255u);
+    }
+    case 8: // A8
+        return uvec4(0u, 0u, 0u, ReadByte(texel));
+    case 9: // IA4
+    {
+        uint value = ReadByte(texel);
+        uint i = Convert4To8(value >> 4);
+        return uvec4(i, i, i, Convert4To8(value & 0xFu));
+    }
+    case 10: // I4
+    {
+        uint i = Convert4To8((ReadByte(texel / 2) >> (4 * (texel & 1))) & 0xFu);
+        return uvec4(i, i, i, 255u);
+    }
+    case 11: // A4
+        return uvec4(0u, 0u, 0u, Convert4To8((ReadByte(texel / 2) >> (4 * (texel & 1))) & 0xFu));
+    case 12: // ETC1
+    case 13: // ETC1A4
+    {
+        // ETC1 further subdivides each 8x8 tile into four 4x4 subtiles of 8 bytes each, preceded
+        // by 8 bytes of 4 bit alpha values in the case of ETC1A4
+        int subtile_bytes = (format == 13) ? 2 : 1;
+        int subtile_index = ((x / 4) & 1) + 2 * ((y / 4) & 1);
+        int offset = coarse_x * subtile_bytes * 4 + coarse_y * subtile_bytes * 4 * (size.x / 8)
+                     + subtile_index * subtile_bytes * 8;
+
+        uint alpha = 255u;
+        if (format == 13) {
+            int alpha_index = (x & 3) * 4 + (y & 3);
+            alpha = Convert4To8((ReadU32(offset + 4 * (alpha_index / 8)) >> (4 * (alpha_index % 8))) & 0xFu);
+            offset += 8;
+        }
+
+        return uvec4(DecodeETC1(ReadU32(offset), ReadU32(offset + 4), x & 3, y & 3), alpha);
+    }
+    default:
+        return uvec4(0u);
+    }
+}
+
+void main() {
+    int x = int(gl_FragCoord.x);
+    int y = int(gl_FragCoord.y);
+    if (flip_y)
+        y = size.y - 1 - y;
+
+    color = vec4(Decode(x, y)) / 255.0;
+}
+)";
+
+void TextureDecoderOpenGL::InitObjects() {
+    shader.Create(vertex_shader, fragment_shader);
+    uniform_raw_data = glGetUniformLocation(shader.handle, "raw_data");
+    uniform_format = glGetUniformLocation(shader.handle, "format");
+    uniform_size = glGetUniformLocation(shader.handle, "size");
+    uniform_flip_y = glGetUniformLocation(shader.handle, "flip_y");
+
+    vertex_array.Create();
+    framebuffer.Create();
+
+    raw_buffer.Create();
+    raw_texture.Create();
+
+    glActiveTexture(GL_TEXTURE0 + RAW_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, raw_texture.handle);
+    glBindBuffer(GL_TEXTURE_BUFFER, raw_buffer.handle);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, raw_buffer.handle);
+
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_raw_size);
+}
+
+bool TextureDecoderOpenGL::Decode(OpenGLState& state, const u8* data, u32 size, Pica::Regs::TextureFormat format,
+                                  u32 width, u32 height, bool flip_y, GLuint dst_texture) {
+    if (shader.handle == 0 || data == nullptr || size > (u32)max_raw_size)
+        return false;
+
+    // Only the decoding draw must be affected by this, so start from the rasterizer's state
+    OpenGLState decode_state = state;
+    decode_state.cull.enabled = false;
+    decode_state.depth.test_enabled = false;
+    decode_state.depth.write_mask = GL_FALSE;
+    decode_state.stencil.test_enabled = false;
+    decode_state.blend.enabled = false;
+    decode_state.logic_op = GL_COPY;
+    decode_state.color_mask.red_enabled = GL_TRUE;
+    decode_state.color_mask.green_enabled = GL_TRUE;
+    decode_state.color_mask.blue_enabled = GL_TRUE;
+    decode_state.color_mask.alpha_enabled = GL_TRUE;
+    decode_state.draw.framebuffer = framebuffer.handle;
+    decode_state.draw.vertex_array = vertex_array.handle;
+    decode_state.draw.shader_program = shader.handle;
+    decode_state.Apply();
+
+    glBindBuffer(GL_TEXTURE_BUFFER, raw_buffer.handle);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+
+    glActiveTexture(GL_TEXTURE0 + RAW_DATA_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, raw_texture.handle);
+
+    glUniform1i(uniform_raw_data, RAW_DATA_TEXTURE_UNIT);
+    glUniform1i(uniform_format, (GLint)format);
+    glUniform2i(uniform_size, width, height);
+    glUniform1i(uniform_flip_y, flip_y);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst_texture, 0);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, width, height);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    state.Apply();
+
+    return true;
+}
@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/pica.h"
+#include "video_core/renderer_opengl/generated/gl_3_2_core.h"
+#include "video_core/renderer_opengl/gl_resource_manager.h"
+#include "video_core/renderer_opengl/gl_state.h"
+
+/**
+ * Decodes tiled PICA textures on the GPU.
+ *
+ * The raw texture data is uploaded as is into a buffer texture, and a fragment shader computes
+ * the Morton offset of each texel and converts it from the PICA format (including ETC1) while
+ * rendering into the destination texture. This turns the CPU side of a texture upload into a
+ * single copy of the source data.
+ */
+class TextureDecoderOpenGL : NonCopyable {
+public:
+    /// Creates the decoding program and the buffers it reads from
+    void InitObjects();
+
+    /**
+     * Decodes a tiled PICA texture into the given texture, whose storage must already have the
+     * given dimensions and a color-renderable format.
+     * @param state Rasterizer state, which is applied again after decoding
+     * @param data Raw texture data in 3DS memory
+     * @param size Size of the raw texture data in bytes
+     * @param format Format of the raw data; equal to the matching ColorFormat for framebuffers
+     * @param flip_y Whether to store the bottom row of the PICA texture first, like texture uploads do
+     * @return False if the texture can't be decoded on the GPU and must be decoded on the CPU
+     */
+    bool Decode(OpenGLState& state, const u8* data, u32 size, Pica::Regs::TextureFormat format,
+                u32 width, u32 height, bool flip_y, GLuint dst_texture);
+
+private:
+    OGLShader shader;
+    OGLVertexArray vertex_array;
+    OGLFramebuffer framebuffer;
+
+    /// Buffer holding the raw data, and the texture viewing it as an array of bytes
+    OGLBuffer raw_buffer;
+    OGLTexture raw_texture;
+    GLint max_raw_size = 0;
+
+    GLuint uniform_raw_data;
+    GLuint uniform_format;
+    GLuint uniform_size;
+    GLuint uniform_flip_y;
+};
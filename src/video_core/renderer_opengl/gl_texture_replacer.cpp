@@ -0,0 +1,224 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/profiler.h"
+
+#include "video_core/renderer_opengl/gl_resource_manager.h"
+#include "video_core/renderer_opengl/gl_state.h"
+#include "video_core/renderer_opengl/gl_texture_replacer.h"
+
+/// Largest width and height of replacement images, which covers 8x scaling of the largest PICA textures
+static const u32 MAX_IMAGE_SIZE = 8192;
+
+/// Size of the replacement textures on the host GPU
+static Common::Profiling::MemoryCounter replacement_vram_counter("Texture Replacements VRAM");
+
+/// Pixels of a replacement image, written by the pool worker decoding it
+struct DecodedImage {
+    std::atomic<bool> done{ false };
+    /// RGBA8 rows from the bottom one up, as GL expects them, or empty if decoding failed
+    std::vector<u8> pixels;
+    u32 width = 0;
+    u32 height = 0;
+};
+
+struct TextureReplacer::Replacement {
+    ~Replacement() {
+        if (texture.handle != 0)
+            replacement_vram_counter.Add(-(s64)size);
+    }
+
+    /// Dropped once the image has been uploaded
+    std::shared_ptr<DecodedImage> image;
+    OGLTexture texture;
+    u64 size = 0;
+};
+
+#ifdef HAVE_PNG
+/// Position in a mapped PNG file, which libpng reads from
+struct PNGSource {
+    const u8* data;
+    size_t size;
+    size_t offset;
+};
+
+static void ReadPNGData(png_structp png_ptr, png_bytep out, png_size_t length) {
+    PNGSource* source = static_cast<PNGSource*>(png_get_io_ptr(png_ptr));
+    if (length > source->size - source->offset)
+        png_error(png_ptr, "unexpected end of file");
+
+    std::memcpy(out, source->data + source->offset, length);
+    source->offset += length;
+}
+
+/// Decodes a PNG image of any color type into RGBA8 rows, the bottom one first
+static bool DecodePNG(const u8* data, size_t size, DecodedImage& image) {
+    if (size < 8 || png_sig_cmp(const_cast<u8*>(data), 0, 8) != 0)
+        return false;
+
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_ptr != nullptr ? png_create_info_struct(png_ptr) : nullptr;
+    if (info_ptr == nullptr) {
+        png_destroy_read_struct(&png_ptr, nullptr, nullptr);
+        return false;
+    }
+
+    // Declared before setjmp, so that errors don't jump over their destructors
+    std::vector<png_bytep> rows;
+    PNGSource source = { data, size, 0 };
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        image.pixels.clear();
+        return false;
+    }
+
+    png_set_read_fn(png_ptr, &source, ReadPNGData);
+    png_read_info(png_ptr, info_ptr);
+
+    const u32 width = png_get_image_width(png_ptr, info_ptr);
+    const u32 height = png_get_image_height(png_ptr, info_ptr);
+    if (width == 0 || height == 0 || width > MAX_IMAGE_SIZE || height > MAX_IMAGE_SIZE)
+        png_error(png_ptr, "unsupported image size");
+
+    const png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    if ((color_type & PNG_COLOR_MASK_ALPHA) == 0 && !png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_set_add_alpha(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 4);
+    rows.resize(height);
+    for (u32 y = 0; y < height; ++y)
+        rows[y] = &image.pixels[(size_t)(height - 1 - y) * width * 4];
+
+    png_read_image(png_ptr, rows.data());
+    png_read_end(png_ptr, nullptr);
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    return true;
+}
+#endif
+
+/// Decodes a replacement image, called on the thread pool
+static void DecodeImage(const std::string& filename, DecodedImage& image) {
+    FileUtil::MappedFile file(filename);
+    bool decoded = false;
+#ifdef HAVE_PNG
+    decoded = file.IsOpen() && DecodePNG(file.GetData(), (size_t)file.GetSize(), image);
+#endif
+    if (!decoded)
+        LOG_ERROR(Render_OpenGL, "Could not decode replacement texture %s", filename.c_str());
+
+    image.done.store(true, std::memory_order_release);
+}
+
+TextureReplacer::TextureReplacer(const std::string& path) {
+#ifndef HAVE_PNG
+    LOG_WARNING(Render_OpenGL, "Citra was built without libpng, textures can't be replaced");
+    return;
+#endif
+
+    if (!FileUtil::IsDirectory(path)) {
+        LOG_ERROR(Render_OpenGL, "Texture pack %s is not a directory", path.c_str());
+        return;
+    }
+
+    IndexDirectory(path);
+    LOG_INFO(Render_OpenGL, "Indexed %u replacement textures in %s", (unsigned)index.size(), path.c_str());
+}
+
+TextureReplacer::~TextureReplacer() {
+    Common::GetThreadPool().Wait(decodes);
+}
+
+void TextureReplacer::IndexDirectory(const std::string& directory) {
+    FileUtil::DirectoryIterator iterator(directory);
+    FileUtil::FSTEntry entry;
+
+    while (iterator.Next(entry)) {
+        if (entry.isDirectory) {
+            IndexDirectory(entry.physicalName);
+            continue;
+        }
+
+        u32 width, height, format;
+        u64 hash;
+        int length = 0;
+        if (std::sscanf(entry.virtualName.c_str(), "tex_%ux%u_%16" SCNx64 "_%u.png%n",
+                        &width, &height, &hash, &format, &length) != 4 ||
+            (size_t)length != entry.virtualName.size()) {
+            continue;
+        }
+
+        if (!index.emplace(Key(width, height, format, hash), entry.physicalName).second)
+            LOG_WARNING(Render_OpenGL, "Ignoring duplicate replacement texture %s", entry.physicalName.c_str());
+    }
+}
+
+std::shared_ptr<TextureReplacer::Replacement> TextureReplacer::Find(u64 hash, Pica::Regs::TextureFormat format,
+                                                                    u32 width, u32 height) {
+    // Nothing but the index is touched for the textures which aren't replaced
+    const Key key(width, height, static_cast<u32>(format), hash);
+    auto file = index.find(key);
+    if (file == index.end())
+        return nullptr;
+
+    std::weak_ptr<Replacement>& slot = loaded[key];
+    std::shared_ptr<Replacement> replacement = slot.lock();
+    if (replacement != nullptr)
+        return replacement;
+
+    replacement = std::make_shared<Replacement>();
+    replacement->image = std::make_shared<DecodedImage>();
+    slot = replacement;
+
+    // The worker only shares the image, so that the GL texture is always deleted on this thread
+    std::shared_ptr<DecodedImage> image = replacement->image;
+    const std::string filename = file->second;
+    Common::GetThreadPool().Submit(decodes, [image, filename] { DecodeImage(filename, *image); });
+    return replacement;
+}
+
+GLuint TextureReplacer::GetTexture(OpenGLState& state, unsigned texture_unit, Replacement& replacement,
+                                   bool& uploaded) {
+    uploaded = false;
+    if (replacement.texture.handle != 0)
+        return replacement.texture.handle;
+
+    // Either still being decoded, or failed to
+    if (replacement.image == nullptr || !replacement.image->done.load(std::memory_order_acquire))
+        return 0;
+
+    std::shared_ptr<DecodedImage> image = std::move(replacement.image);
+    if (image->pixels.empty())
+        return 0;
+
+    replacement.texture.Create();
+    state.texture_units[texture_unit].texture_2d = replacement.texture.handle;
+    state.Apply();
+    glActiveTexture(GL_TEXTURE0 + texture_unit);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 image->pixels.data());
+
+    replacement.size = image->pixels.size();
+    replacement_vram_counter.Add(replacement.size);
+    uploaded = true;
+    return replacement.texture.handle;
+}
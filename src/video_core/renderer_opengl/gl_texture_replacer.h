@@ -0,0 +1,75 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "generated/gl_3_2_core.h"
+
+#include "common/common_types.h"
+#include "common/thread_pool.h"
+
+#include "video_core/pica.h"
+
+class OpenGLState;
+
+/**
+ * Replaces emulated textures by the images of a texture pack, Settings::values.texture_pack_path.
+ *
+ * Replacement images are PNG files named tex_<width>x<height>_<hash>_<format>.png, with the width,
+ * height and format of the PICA texture, and the 16 hexadecimal digits of the Common::ComputeHash64
+ * hash of its data. They may be of any size, and may be sorted into subdirectories of the pack.
+ *
+ * The pack is indexed once at boot, without opening any of the images. An image is only decoded
+ * the first time its texture is loaded, on the shared thread pool, and uploaded once it is ready.
+ * Until then the emulated texture is shown, so large packs never stall rendering.
+ *
+ * All functions must be called on the thread which owns the rendering context.
+ */
+class TextureReplacer final : NonCopyable {
+public:
+    /// Replacement of a texture, which is shared by all the cached textures with its contents
+    struct Replacement;
+
+    explicit TextureReplacer(const std::string& path);
+
+    /// Waits for the images which are still being decoded
+    ~TextureReplacer();
+
+    /**
+     * Finds the replacement of a texture loaded from 3DS memory, and starts decoding its image
+     * unless it is already loaded.
+     * @return The replacement, or nullptr if the pack doesn't replace this texture
+     */
+    std::shared_ptr<Replacement> Find(u64 hash, Pica::Regs::TextureFormat format, u32 width, u32 height);
+
+    /**
+     * Returns the GL texture of a replacement, uploading its image first if it has just been
+     * decoded, in which case the texture is left bound to the given unit.
+     * @param uploaded Set to whether the texture has been created by this call
+     * @return The texture, or 0 while the image is still being decoded or if it couldn't be
+     */
+    GLuint GetTexture(OpenGLState& state, unsigned texture_unit, Replacement& replacement, bool& uploaded);
+
+private:
+    /// Width, height, format and hash of the replaced texture
+    using Key = std::tuple<u32, u32, u32, u64>;
+
+    /// Recursively adds the images of a directory to the index
+    void IndexDirectory(const std::string& directory);
+
+    /// Image file of each replaced texture
+    std::map<Key, std::string> index;
+
+    /// Replacements in use by the rasterizer cache, which are freed along with its last texture
+    std::map<Key, std::weak_ptr<Replacement>> loaded;
+
+    /// Decodes of images, which may outlive the replacements they were started for
+    Common::TaskGroup decodes;
+};
@@ -9,16 +9,20 @@
 #include "common/assert.h"
 #include "common/emu_window.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 #include "common/profiler_reporting.h"
+#include "common/thread.h"
 
 #include "core/hw/gpu.h"
 #include "core/hw/hw.h"
 #include "core/hw/lcd.h"
+#include "core/host_threads.h"
 #include "core/memory.h"
 #include "core/settings.h"
 
 #include "video_core/video_core.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
+#include "video_core/renderer_opengl/gl_gpu_timer.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
 #include "video_core/renderer_opengl/gl_shaders.h"
 
@@ -57,7 +61,7 @@ static std::array<GLfloat, 3*2> MakeOrthographicMatrix(const float width, const
 }
 
 /// RendererOpenGL constructor
-RendererOpenGL::RendererOpenGL() {
+RendererOpenGL::RendererOpenGL() : present_thread_running(false) {
     hw_rasterizer.reset(new RasterizerOpenGL());
     resolution_width  = std::max(VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth);
     resolution_height = VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight;
@@ -65,6 +69,8 @@ RendererOpenGL::RendererOpenGL() {
 
 /// RendererOpenGL destructor
 RendererOpenGL::~RendererOpenGL() {
+    ShutDown();
+    GPUTimer::Shutdown();
 }
 
 /// Swap buffers (render frame)
@@ -84,20 +90,55 @@ void RendererOpenGL::SwapBuffers() {
 
         if (color_fill.is_enabled) {
             LoadColorToActiveGLTexture(color_fill.color_r, color_fill.color_g, color_fill.color_b, textures[i]);
+            textures[i].uploaded_addr = 0;
 
             // Resize the texture in case the framebuffer size has changed
             textures[i].width = 1;
             textures[i].height = 1;
         } else {
+            // Framebuffers produced by accelerated display transfers are copied on the host GPU,
+            // at the rasterizer's internal resolution
+            const PAddr framebuffer_addr = framebuffer.active_fb == 0 ?
+                    framebuffer.address_left1 : framebuffer.address_left2;
+            auto gl_rasterizer = static_cast<RasterizerOpenGL*>(hw_rasterizer.get());
+            bool blitted = Settings::values.use_hw_renderer &&
+                framebuffer.stride == framebuffer.width * GPU::Regs::BytesPerPixel(framebuffer.color_format) &&
+                gl_rasterizer->HasDisplaySurface(framebuffer_addr, framebuffer.width, framebuffer.height,
+                                                 framebuffer.color_format);
+            u32 scale = blitted ? gl_rasterizer->GetResolutionScale() : 1;
+
             if (textures[i].width != (GLsizei)framebuffer.width ||
                 textures[i].height != (GLsizei)framebuffer.height ||
-                textures[i].format != framebuffer.color_format) {
+                textures[i].format != framebuffer.color_format ||
+                textures[i].scale != scale) {
                 // Reallocate texture if the framebuffer size has changed.
                 // This is expected to not happen very often and hence should not be a
                 // performance problem.
-                ConfigureFramebufferTexture(textures[i], framebuffer);
+                ConfigureFramebufferTexture(textures[i], framebuffer, scale);
+            }
+
+            if (blitted) {
+                gl_rasterizer->BlitDisplaySurface(framebuffer_addr, framebuffer.width, framebuffer.height,
+                                                  framebuffer.color_format, textures[i].handle);
+                textures[i].uploaded_addr = 0;
+            } else {
+                // Memory has to hold the latest rendering results and fills before it is displayed
+                const u32 framebuffer_size = framebuffer.stride * framebuffer.height;
+                hw_rasterizer->NotifyPreRead(framebuffer_addr, framebuffer_size);
+
+                // Screens which didn't change since the last upload, like most bottom screens, are
+                // displayed from the texture as it is
+                TextureInfo& texture = textures[i];
+                if (texture.uploaded_addr != framebuffer_addr || texture.uploaded_stride != framebuffer.stride ||
+                    Memory::PhysicalWrittenSince(framebuffer_addr, framebuffer_size, texture.upload_stamp)) {
+
+                    texture.upload_stamp = Memory::GetWriteStamp();
+                    Memory::TrackPhysicalWrites(framebuffer_addr, framebuffer_size);
+                    LoadFBToActiveGLTexture(framebuffer, texture);
+                    texture.uploaded_addr = framebuffer_addr;
+                    texture.uploaded_stride = framebuffer.stride;
+                }
             }
-            LoadFBToActiveGLTexture(framebuffer, textures[i]);
 
             // Resize the texture in case the framebuffer size has changed
             textures[i].width = framebuffer.width;
@@ -105,18 +146,41 @@ void RendererOpenGL::SwapBuffers() {
         }
     }
 
-    DrawScreens();
+    {
+        GPUTimer::Scope gpu_timer(GPUTimer::Category::Screens);
+        if (mailbox != nullptr) {
+            DrawScreensToMailbox();
+        } else {
+            DrawScreens();
+        }
+    }
+
+    if (frame_capture != nullptr) {
+        std::array<FrameCapture::Screen, 2> screens;
+        for (int i : {0, 1}) {
+            screens[i].texture = textures[i].handle;
+            screens[i].width = textures[i].width * textures[i].scale;
+            screens[i].height = textures[i].height * textures[i].scale;
+        }
+        frame_capture->CaptureScreens(state, screens);
+    }
+
+    GPUTimer::CollectResults();
 
     auto& profiler = Common::Profiling::GetProfilingManager();
     profiler.FinishFrame();
+    Common::Profiling::GetHLECallProfiler().FinishFrame();
+    if (Settings::values.show_perf_overlay)
+        perf_overlay.AddFrame(profiler.GetPreviousFrameResults());
     {
         auto aggregator = Common::Profiling::GetTimingResultsAggregator();
         aggregator->AddFrame(profiler.GetPreviousFrameResults());
     }
 
-    // Swap buffers
+    // Swap buffers, unless the presentation thread takes care of it
     render_window->PollEvents();
-    render_window->SwapBuffers();
+    if (mailbox == nullptr)
+        render_window->SwapBuffers();
 
     prev_state.Apply();
 
@@ -129,6 +193,9 @@ void RendererOpenGL::SwapBuffers() {
 
         if (Settings::values.use_hw_renderer) {
             hw_rasterizer->Reset();
+        } else {
+            // The software renderer continues from whatever is in 3DS memory
+            hw_rasterizer->CommitFramebuffer();
         }
     }
 
@@ -175,8 +242,11 @@ void RendererOpenGL::LoadFBToActiveGLTexture(const GPU::Regs::FramebufferConfig&
     //       differ from the LCD resolution.
     // TODO: Applications could theoretically crash Citra here by specifying too large
     //       framebuffer sizes. We should make sure that this cannot happen.
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, framebuffer.width, framebuffer.height,
-                    texture.gl_format, texture.gl_type, framebuffer_data);
+    {
+        GPUTimer::Scope gpu_timer(GPUTimer::Category::Uploads);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, framebuffer.width, framebuffer.height,
+                        texture.gl_format, texture.gl_type, framebuffer_data);
+    }
 
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
@@ -235,6 +305,7 @@ void RendererOpenGL::InitOpenGLObjects() {
     // Allocate textures for each screen
     for (auto& texture : textures) {
         glGenTextures(1, &texture.handle);
+        texture.uploaded_addr = 0;
 
         // Allocation of storage is deferred until the first frame, when we
         // know the framebuffer size.
@@ -254,17 +325,21 @@ void RendererOpenGL::InitOpenGLObjects() {
     state.texture_units[0].texture_2d = 0;
     state.Apply();
 
+    perf_overlay.InitObjects(state);
+
     hw_rasterizer->InitObjects();
 }
 
 void RendererOpenGL::ConfigureFramebufferTexture(TextureInfo& texture,
-                                                 const GPU::Regs::FramebufferConfig& framebuffer) {
+                                                 const GPU::Regs::FramebufferConfig& framebuffer, u32 scale) {
     GPU::Regs::PixelFormat format = framebuffer.color_format;
     GLint internal_format;
 
     texture.format = format;
     texture.width = framebuffer.width;
     texture.height = framebuffer.height;
+    texture.scale = scale;
+    texture.uploaded_addr = 0;
 
     switch (format) {
     case GPU::Regs::PixelFormat::RGBA8:
@@ -310,7 +385,7 @@ void RendererOpenGL::ConfigureFramebufferTexture(TextureInfo& texture,
     state.Apply();
 
     glActiveTexture(GL_TEXTURE0);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width * scale, texture.height * scale, 0,
             texture.gl_format, texture.gl_type, nullptr);
 }
 
@@ -333,6 +408,34 @@ void RendererOpenGL::DrawSingleScreenRotated(const TextureInfo& texture, float x
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
+/**
+ * Draws the performance overlay in the top left corner of the window, at twice its size. Expects
+ * the screen program to be bound.
+ */
+void RendererOpenGL::DrawPerfOverlay() {
+    perf_overlay.Update(state);
+
+    const float width = PerfOverlay::WIDTH * 2.f;
+    const float height = PerfOverlay::HEIGHT * 2.f;
+    std::array<ScreenRectVertex, 4> vertices = {
+        ScreenRectVertex(0.f,   0.f,    0.f, 0.f),
+        ScreenRectVertex(width, 0.f,    1.f, 0.f),
+        ScreenRectVertex(0.f,   height, 0.f, 1.f),
+        ScreenRectVertex(width, height, 1.f, 1.f),
+    };
+
+    state.blend.enabled = true;
+    state.blend.src_rgb_func = state.blend.src_a_func = GL_SRC_ALPHA;
+    state.blend.dst_rgb_func = state.blend.dst_a_func = GL_ONE_MINUS_SRC_ALPHA;
+    state.Apply();
+
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices.data());
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    state.blend.enabled = false;
+    state.Apply();
+}
+
 /**
  * Draws the emulated screens to the emulator window.
  */
@@ -359,9 +462,113 @@ void RendererOpenGL::DrawScreens() {
     DrawSingleScreenRotated(textures[1], (float)layout.bottom_screen.left,(float)layout.bottom_screen.top,
         (float)layout.bottom_screen.GetWidth(), (float)layout.bottom_screen.GetHeight());
 
+    if (Settings::values.show_perf_overlay)
+        DrawPerfOverlay();
+
     m_current_frame++;
 }
 
+/**
+ * Draws the emulated screens into a frame of the mailbox and queues it for presentation.
+ */
+void RendererOpenGL::DrawScreensToMailbox() {
+    auto layout = render_window->GetFramebufferLayout();
+    FrameMailbox::Frame* frame = mailbox->GetRenderFrame();
+
+    // The presentation thread may still be reading from the frame
+    if (frame->present_fence != nullptr) {
+        glWaitSync(frame->present_fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(frame->present_fence);
+        frame->present_fence = nullptr;
+    }
+
+    // Left over if the frame was dropped without being presented
+    if (frame->render_fence != nullptr) {
+        glDeleteSync(frame->render_fence);
+        frame->render_fence = nullptr;
+    }
+
+    if (frame->width != layout.width || frame->height != layout.height) {
+        frame->color.Create();
+        frame->render_framebuffer.Create();
+
+        state.texture_units[0].enabled_2d = true;
+        state.texture_units[0].texture_2d = frame->color.handle;
+        state.Apply();
+
+        glActiveTexture(GL_TEXTURE0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, layout.width, layout.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        state.texture_units[0].texture_2d = 0;
+        state.draw.framebuffer = frame->render_framebuffer.handle;
+        state.Apply();
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame->color.handle, 0);
+
+        frame->width = layout.width;
+        frame->height = layout.height;
+    }
+
+    state.draw.framebuffer = frame->render_framebuffer.handle;
+    state.Apply();
+
+    DrawScreens();
+
+    state.draw.framebuffer = 0;
+    state.Apply();
+
+    frame->render_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // The other context only sees the fence once it has been flushed
+    glFlush();
+
+    mailbox->ReleaseRenderFrame(frame);
+}
+
+/**
+ * Presents the frames queued in the mailbox to the window, using the window's own context.
+ */
+void RendererOpenGL::PresentThreadLoop() {
+    Common::SetCurrentThreadName("PresentThread");
+    HostThreads::ApplyToCurrentThread(HostThreads::Role::Present);
+    render_window->MakeCurrent();
+
+    glClearColor(Settings::values.bg_red, Settings::values.bg_green, Settings::values.bg_blue, 0.0f);
+
+    // Framebuffer objects aren't shared between contexts, unlike the frame textures
+    OGLFramebuffer read_framebuffer;
+    read_framebuffer.Create();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer.handle);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    while (present_thread_running) {
+        FrameMailbox::Frame* frame = mailbox->TryGetPresentFrame(std::chrono::milliseconds(100));
+        if (frame == nullptr)
+            continue;
+
+        glWaitSync(frame->render_fence, 0, GL_TIMEOUT_IGNORED);
+
+        // The window may have been resized since the frame was rendered
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame->color.handle, 0);
+        glBlitFramebuffer(0, 0, frame->width, frame->height, 0, 0, frame->width, frame->height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+        frame->present_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        render_window->SwapBuffers();
+    }
+
+    read_framebuffer.Release();
+    render_window->DoneCurrent();
+}
+
 /// Updates the framerate
 void RendererOpenGL::UpdateFramerate() {
 }
@@ -387,9 +594,46 @@ void RendererOpenGL::Init() {
     LOG_INFO(Render_OpenGL, "GL_VERSION: %s", glGetString(GL_VERSION));
     LOG_INFO(Render_OpenGL, "GL_VENDOR: %s", glGetString(GL_VENDOR));
     LOG_INFO(Render_OpenGL, "GL_RENDERER: %s", glGetString(GL_RENDERER));
+
+    if (Settings::values.use_present_thread) {
+        shared_context = render_window->CreateSharedContext();
+        if (shared_context != nullptr) {
+            // All rendering objects are created in the shared context, since the window's context
+            // is handed over to the presentation thread
+            render_window->DoneCurrent();
+            shared_context->MakeCurrent();
+        } else {
+            LOG_WARNING(Render_OpenGL, "Shared contexts are not supported by the frontend, presenting from the emulation thread");
+        }
+    }
+
     InitOpenGLObjects();
+    GPUTimer::Init();
+
+    if (!Settings::values.frame_capture_path.empty()) {
+        frame_capture = Common::make_unique<FrameCapture>(Settings::values.frame_capture_path,
+                                                          (FrameCapture::Format)Settings::values.frame_capture_format);
+    }
+
+    if (shared_context != nullptr) {
+        mailbox = Common::make_unique<FrameMailbox>();
+        present_thread_running = true;
+        present_thread = std::thread(&RendererOpenGL::PresentThreadLoop, this);
+    }
 }
 
 /// Shutdown the renderer
 void RendererOpenGL::ShutDown() {
+    // Writes out the frames which are still being captured
+    frame_capture = nullptr;
+
+    if (!present_thread.joinable())
+        return;
+
+    present_thread_running = false;
+    mailbox->Interrupt();
+    present_thread.join();
+
+    mailbox->ReleaseFrames();
+    mailbox = nullptr;
 }
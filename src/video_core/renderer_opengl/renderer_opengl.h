@@ -5,19 +5,24 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include "generated/gl_3_2_core.h"
 
+#include "common/emu_window.h"
 #include "common/math_util.h"
 
 #include "core/hw/gpu.h"
 
 #include "video_core/renderer_base.h"
 #include "video_core/renderer_opengl/gl_state.h"
+#include "video_core/renderer_opengl/frame_mailbox.h"
+#include "video_core/renderer_opengl/gl_frame_capture.h"
+#include "video_core/renderer_opengl/gl_perf_overlay.h"
 #include "video_core/renderer_opengl/gl_rasterizer.h"
 
-class EmuWindow;
-
 class RendererOpenGL : public RendererBase {
 public:
 
@@ -43,18 +48,29 @@ private:
     /// Structure used for storing information about the textures for each 3DS screen
     struct TextureInfo {
         GLuint handle;
+        /// Dimensions of the framebuffer; the OpenGL texture is scale times as large
         GLsizei width;
         GLsizei height;
+        u32 scale;
         GPU::Regs::PixelFormat format;
         GLenum gl_format;
         GLenum gl_type;
+
+        /// Framebuffer last uploaded from memory, with an address of 0 if the texture holds something else
+        PAddr uploaded_addr;
+        u32 uploaded_stride;
+        /// Write stamp (see Memory::GetWriteStamp) taken right before the last upload
+        u32 upload_stamp;
     };
 
     void InitOpenGLObjects();
     void ConfigureFramebufferTexture(TextureInfo& texture,
-                                     const GPU::Regs::FramebufferConfig& framebuffer);
+                                     const GPU::Regs::FramebufferConfig& framebuffer, u32 scale);
     void DrawScreens();
+    void DrawScreensToMailbox();
+    void PresentThreadLoop();
     void DrawSingleScreenRotated(const TextureInfo& texture, float x, float y, float w, float h);
+    void DrawPerfOverlay();
     void UpdateFramerate();
 
     // Loads framebuffer from emulated memory into the active OpenGL texture.
@@ -86,4 +102,16 @@ private:
     // Shader attribute input indices
     GLuint attrib_position;
     GLuint attrib_tex_coord;
+
+    PerfOverlay perf_overlay;
+
+    /// Set while frames are being captured, see Settings::values.frame_capture_path
+    std::unique_ptr<FrameCapture> frame_capture;
+
+    // Presentation thread, which owns the window's context while the emulation thread renders
+    // with a shared one and hands finished frames over through the mailbox
+    std::unique_ptr<EmuWindow::SharedContext> shared_context;
+    std::unique_ptr<FrameMailbox> mailbox;
+    std::thread present_thread;
+    std::atomic<bool> present_thread_running;
 };
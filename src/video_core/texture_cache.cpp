@@ -0,0 +1,79 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <map>
+#include <mutex>
+
+#include "common/math_util.h"
+
+#include "core/memory.h"
+
+#include "debug_utils/debug_utils.h"
+#include "texture_cache.h"
+#include "texture_decoder.h"
+
+namespace Pica {
+
+namespace TextureCache {
+
+/// Cached textures, keyed by their physical address
+static std::map<PAddr, std::shared_ptr<const DecodedTexture>> texture_cache;
+
+/// Guards texture_cache, since the rasterizer worker threads may look up textures concurrently
+static std::mutex cache_mutex;
+
+static std::shared_ptr<const DecodedTexture> DecodeTexture(const Regs::FullTextureConfig& config) {
+    const auto info = DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
+    const u8* source = Memory::GetPhysicalPointer(info.physical_address);
+
+    auto texture = std::make_shared<DecodedTexture>();
+    texture->address = info.physical_address;
+    texture->size = info.width * info.height * Regs::NibblesPerPixel(info.format) / 2;
+    texture->format = info.format;
+    texture->width = info.width;
+    texture->height = info.height;
+    texture->texels.resize(info.width * info.height);
+
+    TextureDecoder::DecodeTexture(source, info.format, info.width, info.height, texture->texels.data(), false);
+
+    return texture;
+}
+
+std::shared_ptr<const DecodedTexture> GetTexture(const Regs::FullTextureConfig& config) {
+    const PAddr address = config.config.GetPhysicalAddress();
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    auto& cached = texture_cache[address];
+    if (cached == nullptr || cached->format != config.format ||
+        cached->width != (int)config.config.width || cached->height != (int)config.config.height) {
+        // Entries still held by a rasterizer thread stay alive until it's done with them
+        cached = DecodeTexture(config);
+    }
+
+    return cached;
+}
+
+void NotifyFlush(PAddr addr, u32 size) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    // Textures starting past the end of the flushed region can't overlap it
+    auto cache_upper_bound = texture_cache.lower_bound(addr + size);
+    for (auto it = texture_cache.begin(); it != cache_upper_bound;) {
+        if (MathUtil::IntervalsIntersect(addr, size, it->first, it->second->size)) {
+            it = texture_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FullFlush() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    texture_cache.clear();
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,56 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "pica.h"
+
+/**
+ * Cache of textures decoded to linear RGBA8 for the software rasterizer, so that sampling a
+ * texel doesn't need to decode its (possibly compressed) block every time.
+ *
+ * Cached textures are invalidated when the memory they have been decoded from is reported to
+ * have changed via NotifyFlush(), i.e. at the same points the hardware rasterizer's texture
+ * cache is notified, as well as when the software rasterizer renders to them.
+ */
+namespace Pica {
+
+namespace TextureCache {
+
+struct DecodedTexture {
+    PAddr address;
+    u32 size; ///< Size of the source texture data in bytes
+    Regs::TextureFormat format;
+    int width;
+    int height;
+
+    /// Decoded texels, in the same orientation as DebugUtils::LookupTexture uses
+    std::vector<Math::Vec4<u8>> texels;
+
+    const Math::Vec4<u8>& Lookup(int s, int t) const {
+        return texels[s + t * width];
+    }
+};
+
+/**
+ * Returns the decoded contents of the given texture, decoding it if it isn't cached yet.
+ * Can be called from multiple threads at the same time.
+ */
+std::shared_ptr<const DecodedTexture> GetTexture(const Regs::FullTextureConfig& config);
+
+/// Drops any cached texture decoded from the given memory region
+void NotifyFlush(PAddr addr, u32 size);
+
+/// Drops all cached textures
+void FullFlush();
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,588 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#include "common/color.h"
+#include "common/logging/log.h"
+#include "common/math_util.h"
+
+#include "texture_decoder.h"
+#include "utils.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXTURE_DECODER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Pica {
+
+namespace TextureDecoder {
+
+/// Number of texels in a tile
+static const int TILE_TEXELS = 64;
+
+/// Texel coordinates of each Morton index in a tile, packed as (y << 3) | x
+static const std::array<u8, TILE_TEXELS> morton_to_xy = []{
+    std::array<u8, TILE_TEXELS> table;
+    for (u32 y = 0; y < 8; ++y) {
+        for (u32 x = 0; x < 8; ++x) {
+            table[VideoCore::MortonInterleave(x, y)] = (y << 3) | x;
+        }
+    }
+    return table;
+}();
+
+/**
+ * Moves the texels of a tile from Morton order to their place in the destination.
+ * Each group of four consecutive Morton indices forms a 2x2 quad, so texels are moved in pairs.
+ */
+static void StoreMortonTile(const u32* texels, Math::Vec4<u8>* dst, ptrdiff_t dst_stride) {
+    for (int i = 0; i < TILE_TEXELS; i += 4) {
+        const int x = morton_to_xy[i] & 7;
+        const int y = morton_to_xy[i] >> 3;
+        Math::Vec4<u8>* row = dst + y * dst_stride + x;
+
+#ifdef TEXTURE_DECODER_SSE2
+        __m128i quad = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + i));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(row), quad);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(row + dst_stride), _mm_srli_si128(quad, 8));
+#else
+        std::memcpy(row, texels + i, 2 * sizeof(u32));
+        std::memcpy(row + dst_stride, texels + i + 2, 2 * sizeof(u32));
+#endif
+    }
+}
+
+/// Packs the given components into the in-memory layout of a Math::Vec4<u8>
+static inline u32 PackRGBA(u32 r, u32 g, u32 b, u32 a) {
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline u32 PackRGBA(const Math::Vec4<u8>& color) {
+    return PackRGBA(color.r(), color.g(), color.b(), color.a());
+}
+
+#ifdef TEXTURE_DECODER_SSE2
+
+/// Expands the n-bit values in the lower bits of each 16-bit lane to 8 bits, like Color::ConvertNTo8
+template <int bits>
+static inline __m128i Expand16(__m128i value) {
+    return _mm_or_si128(_mm_slli_epi16(value, 8 - bits), _mm_srli_epi16(value, 2 * bits - 8));
+}
+
+template <>
+inline __m128i Expand16<4>(__m128i value) {
+    return _mm_or_si128(_mm_slli_epi16(value, 4), value);
+}
+
+template <>
+inline __m128i Expand16<1>(__m128i value) {
+    return _mm_mullo_epi16(value, _mm_set1_epi16(255));
+}
+
+/// Interleaves 8-bit components held in 16-bit lanes into eight RGBA8 texels
+static inline void StoreRGBA16(__m128i r, __m128i g, __m128i b, __m128i a, u32* out) {
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi16(rg, ba));
+}
+
+static void DecodeRGBA8(const u8* tile, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; i += 4) {
+        // Each texel is stored as ABGR, so reverse the bytes of every 32-bit lane
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + i * 4));
+        value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+        value = _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, 0xB1), 0xB1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), value);
+    }
+}
+
+static void Decode16(const u8* tile, Regs::TextureFormat format, u32* out) {
+    const __m128i mask1 = _mm_set1_epi16(0x1);
+    const __m128i mask4 = _mm_set1_epi16(0xF);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask8 = _mm_set1_epi16(0xFF);
+    const __m128i opaque = _mm_set1_epi16(0xFF);
+
+    for (int i = 0; i < TILE_TEXELS; i += 8) {
+        __m128i pixel = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + i * 2));
+
+        switch (format) {
+        case Regs::TextureFormat::RGB5A1:
+            StoreRGBA16(Expand16<5>(_mm_and_si128(_mm_srli_epi16(pixel, 11), mask5)),
+                        Expand16<5>(_mm_and_si128(_mm_srli_epi16(pixel, 6), mask5)),
+                        Expand16<5>(_mm_and_si128(_mm_srli_epi16(pixel, 1), mask5)),
+                        Expand16<1>(_mm_and_si128(pixel, mask1)), out + i);
+            break;
+
+        case Regs::TextureFormat::RGB565:
+            StoreRGBA16(Expand16<5>(_mm_and_si128(_mm_srli_epi16(pixel, 11), mask5)),
+                        Expand16<6>(_mm_and_si128(_mm_srli_epi16(pixel, 5), mask6)),
+                        Expand16<5>(_mm_and_si128(pixel, mask5)), opaque, out + i);
+            break;
+
+        case Regs::TextureFormat::RGBA4:
+            StoreRGBA16(Expand16<4>(_mm_and_si128(_mm_srli_epi16(pixel, 12), mask4)),
+                        Expand16<4>(_mm_and_si128(_mm_srli_epi16(pixel, 8), mask4)),
+                        Expand16<4>(_mm_and_si128(_mm_srli_epi16(pixel, 4), mask4)),
+                        Expand16<4>(_mm_and_si128(pixel, mask4)), out + i);
+            break;
+
+        case Regs::TextureFormat::IA8:
+        {
+            // Alpha is stored in the low byte, intensity in the high byte
+            __m128i intensity = _mm_srli_epi16(pixel, 8);
+            StoreRGBA16(intensity, intensity, intensity, _mm_and_si128(pixel, mask8), out + i);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+
+static void Decode8(const u8* tile, Regs::TextureFormat format, u32* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi16(0xFF);
+
+    for (int i = 0; i < TILE_TEXELS; i += 8) {
+        __m128i value = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(tile + i)), zero);
+
+        switch (format) {
+        case Regs::TextureFormat::I8:
+            StoreRGBA16(value, value, value, opaque, out + i);
+            break;
+
+        case Regs::TextureFormat::A8:
+            StoreRGBA16(zero, zero, zero, value, out + i);
+            break;
+
+        case Regs::TextureFormat::IA4:
+        {
+            __m128i intensity = Expand16<4>(_mm_srli_epi16(value, 4));
+            __m128i alpha = Expand16<4>(_mm_and_si128(value, _mm_set1_epi16(0xF)));
+            StoreRGBA16(intensity, intensity, intensity, alpha, out + i);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+
+#else
+
+static void DecodeRGBA8(const u8* tile, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; ++i)
+        out[i] = PackRGBA(Color::DecodeRGBA8(tile + i * 4));
+}
+
+static void Decode16(const u8* tile, Regs::TextureFormat format, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; ++i) {
+        const u8* texel = tile + i * 2;
+
+        switch (format) {
+        case Regs::TextureFormat::RGB5A1:
+            out[i] = PackRGBA(Color::DecodeRGB5A1(texel));
+            break;
+
+        case Regs::TextureFormat::RGB565:
+            out[i] = PackRGBA(Color::DecodeRGB565(texel));
+            break;
+
+        case Regs::TextureFormat::RGBA4:
+            out[i] = PackRGBA(Color::DecodeRGBA4(texel));
+            break;
+
+        case Regs::TextureFormat::IA8:
+            out[i] = PackRGBA(texel[1], texel[1], texel[1], texel[0]);
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+static void Decode8(const u8* tile, Regs::TextureFormat format, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; ++i) {
+        const u8 value = tile[i];
+
+        switch (format) {
+        case Regs::TextureFormat::I8:
+            out[i] = PackRGBA(value, value, value, 255);
+            break;
+
+        case Regs::TextureFormat::A8:
+            out[i] = PackRGBA(0, 0, 0, value);
+            break;
+
+        case Regs::TextureFormat::IA4:
+        {
+            u32 intensity = Color::Convert4To8(value >> 4);
+            out[i] = PackRGBA(intensity, intensity, intensity, Color::Convert4To8(value & 0xF));
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+
+#endif // TEXTURE_DECODER_SSE2
+
+static void DecodeRGB8(const u8* tile, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; ++i)
+        out[i] = PackRGBA(Color::DecodeRGB8(tile + i * 3));
+}
+
+static void Decode4(const u8* tile, Regs::TextureFormat format, u32* out) {
+    for (int i = 0; i < TILE_TEXELS; i += 2) {
+        // The first texel of each pair is stored in the low nibble
+        const u8 value = tile[i / 2];
+        const u32 first = Color::Convert4To8(value & 0xF);
+        const u32 second = Color::Convert4To8(value >> 4);
+
+        if (format == Regs::TextureFormat::I4) {
+            out[i] = PackRGBA(first, first, first, 255);
+            out[i + 1] = PackRGBA(second, second, second, 255);
+        } else {
+            out[i] = PackRGBA(0, 0, 0, first);
+            out[i + 1] = PackRGBA(0, 0, 0, second);
+        }
+    }
+}
+
+/**
+ * Decodes one 4x4 ETC1 subtile.
+ * @param alpha 4 bit alpha values of ETC1A4, indexed by x * 4 + y, or all ones for ETC1
+ */
+static void DecodeETC1Subtile(u64 block, u64 alpha, Math::Vec4<u8>* dst, ptrdiff_t dst_stride) {
+    static const int modifier_table[8][2] = {
+        {  2,  8 }, {  5, 17 }, {  9,  29 }, { 13,  42 },
+        { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+    };
+
+    const u32 low = static_cast<u32>(block);
+    const u32 high = static_cast<u32>(block >> 32);
+    const bool flip = (high & 1) != 0;
+    const bool differential = (high & 2) != 0;
+
+    // Base colors of the two halves of the subtile
+    int base[2][3];
+    if (differential) {
+        int r = (high >> 27) & 0x1F, g = (high >> 19) & 0x1F, b = (high >> 11) & 0x1F;
+        int dr = ((high >> 24) & 7) ^ 4, dg = ((high >> 16) & 7) ^ 4, db = ((high >> 8) & 7) ^ 4;
+        int delta[3] = { dr - 4, dg - 4, db - 4 };
+        int color[3] = { r, g, b };
+        for (int c = 0; c < 3; ++c) {
+            base[0][c] = Color::Convert5To8(static_cast<u8>(color[c]));
+            base[1][c] = Color::Convert5To8(static_cast<u8>(color[c] + delta[c]));
+        }
+    } else {
+        for (int half = 0; half < 2; ++half) {
+            int shift = half ? 0 : 4;
+            base[half][0] = Color::Convert4To8(((high >> 24) >> shift) & 0xF);
+            base[half][1] = Color::Convert4To8(((high >> 16) >> shift) & 0xF);
+            base[half][2] = Color::Convert4To8(((high >> 8) >> shift) & 0xF);
+        }
+    }
+
+    const int table_index[2] = { static_cast<int>((high >> 5) & 7), static_cast<int>((high >> 2) & 7) };
+
+    for (int x = 0; x < 4; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            const int texel = 4 * x + y;
+            const int half = ((flip ? y : x) >= 2) ? 1 : 0;
+
+            int modifier = modifier_table[table_index[half]][(low >> texel) & 1];
+            if ((low >> (16 + texel)) & 1)
+                modifier = -modifier;
+
+            Math::Vec4<u8>& out = dst[y * dst_stride + x];
+            out.r() = static_cast<u8>(MathUtil::Clamp(base[half][0] + modifier, 0, 255));
+            out.g() = static_cast<u8>(MathUtil::Clamp(base[half][1] + modifier, 0, 255));
+            out.b() = static_cast<u8>(MathUtil::Clamp(base[half][2] + modifier, 0, 255));
+            out.a() = Color::Convert4To8((alpha >> (4 * texel)) & 0xF);
+        }
+    }
+}
+
+size_t GetTileSize(Regs::TextureFormat format) {
+    switch (format) {
+    case Regs::TextureFormat::ETC1:
+        return 4 * sizeof(u64);
+
+    case Regs::TextureFormat::ETC1A4:
+        return 8 * sizeof(u64);
+
+    default:
+        return TILE_TEXELS * Regs::NibblesPerPixel(format) / 2;
+    }
+}
+
+void DecodeTile(const u8* tile, Regs::TextureFormat format, Math::Vec4<u8>* dst, ptrdiff_t dst_stride) {
+    if (format == Regs::TextureFormat::ETC1 || format == Regs::TextureFormat::ETC1A4) {
+        // ETC1 further subdivides each 8x8 tile into four 4x4 subtiles, which are stored linearly
+        const bool has_alpha = (format == Regs::TextureFormat::ETC1A4);
+
+        for (int subtile_index = 0; subtile_index < 4; ++subtile_index) {
+            u64 alpha = 0xFFFFFFFFFFFFFFFF;
+            if (has_alpha) {
+                std::memcpy(&alpha, tile, sizeof(u64));
+                tile += sizeof(u64);
+            }
+
+            u64 block;
+            std::memcpy(&block, tile, sizeof(u64));
+            tile += sizeof(u64);
+
+            int x = (subtile_index & 1) * 4;
+            int y = (subtile_index >> 1) * 4;
+            DecodeETC1Subtile(block, alpha, dst + y * dst_stride + x, dst_stride);
+        }
+        return;
+    }
+
+    alignas(16) u32 texels[TILE_TEXELS];
+
+    switch (format) {
+    case Regs::TextureFormat::RGBA8:
+        DecodeRGBA8(tile, texels);
+        break;
+
+    case Regs::TextureFormat::RGB8:
+        DecodeRGB8(tile, texels);
+        break;
+
+    case Regs::TextureFormat::RGB5A1:
+    case Regs::TextureFormat::RGB565:
+    case Regs::TextureFormat::RGBA4:
+    case Regs::TextureFormat::IA8:
+        Decode16(tile, format, texels);
+        break;
+
+    case Regs::TextureFormat::I8:
+    case Regs::TextureFormat::A8:
+    case Regs::TextureFormat::IA4:
+        Decode8(tile, format, texels);
+        break;
+
+    case Regs::TextureFormat::I4:
+    case Regs::TextureFormat::A4:
+        Decode4(tile, format, texels);
+        break;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown texture format: %x", (u32)format);
+        std::fill(std::begin(texels), std::end(texels), 0);
+        break;
+    }
+
+    StoreMortonTile(texels, dst, dst_stride);
+}
+
+void DecodeTexture(const u8* source, Regs::TextureFormat format, int width, int height,
+                   Math::Vec4<u8>* dst, bool flip_y) {
+    const size_t tile_size = GetTileSize(format);
+    const ptrdiff_t dst_stride = flip_y ? -width : width;
+
+    for (int tile_y = 0; tile_y < height; tile_y += 8) {
+        Math::Vec4<u8>* dst_row = dst + (flip_y ? height - 1 - tile_y : tile_y) * width;
+
+        for (int tile_x = 0; tile_x < width; tile_x += 8) {
+            DecodeTile(source, format, dst_row + tile_x, dst_stride);
+            source += tile_size;
+        }
+    }
+}
+
+/**
+ * Flips an ETC1 block upside down. Blocks split into a top and a bottom half swap them, which in
+ * the rare case of a differential block whose swapped color delta is out of range means falling
+ * back to individual mode and its 4 bit colors.
+ */
+static u64 FlipETC1Block(u64 block) {
+    u32 low = static_cast<u32>(block);
+    u32 high = static_cast<u32>(block >> 32);
+
+    // Texel indices are stored column by column, so each nibble holds a column from top to bottom
+    low = ((low & 0x11111111) << 3) | ((low & 0x22222222) << 1) |
+          ((low & 0x44444444) >> 1) | ((low & 0x88888888) >> 3);
+
+    if ((high & 1) == 0)
+        return (static_cast<u64>(high) << 32) | low;
+
+    const u32 table_indices = ((high >> 5) & 7) | (((high >> 2) & 7) << 3);
+    high = (high & ~0xFCu) | (table_indices << 2);
+
+    if ((high & 2) == 0) {
+        // Individual mode, swap the 4 bit color of each half
+        const u32 colors = high >> 8;
+        high = (high & 0xFF) | ((((colors & 0x0F0F0F) << 4) | ((colors >> 4) & 0x0F0F0F)) << 8);
+        return (static_cast<u64>(high) << 32) | low;
+    }
+
+    int base[3], delta[3];
+    bool representable = true;
+    for (int c = 0; c < 3; ++c) {
+        base[c] = (high >> (27 - 8 * c)) & 0x1F;
+        delta[c] = static_cast<int>(((high >> (24 - 8 * c)) & 7) ^ 4) - 4;
+        representable &= (delta[c] != -4);
+    }
+
+    u32 colors = 0;
+    for (int c = 0; c < 3; ++c) {
+        const int first = base[c] + delta[c]; // Color of the bottom half, which becomes the top one
+        if (representable) {
+            colors |= ((first << 3) | ((-delta[c]) & 7)) << (16 - 8 * c);
+        } else {
+            const int first4 = (first * 15 + 15) / 31;
+            const int second4 = (base[c] * 15 + 15) / 31;
+            colors |= ((first4 << 4) | second4) << (16 - 8 * c);
+        }
+    }
+    high = (high & 0xFD) | (representable ? 2 : 0) | (colors << 8);
+    return (static_cast<u64>(high) << 32) | low;
+}
+
+/// Packs a color into RGB565, as used by BC1 endpoints
+static inline u16 PackRGB565(const Math::Vec4<u8>& color) {
+    return static_cast<u16>(((color.r() >> 3) << 11) | ((color.g() >> 2) << 5) | (color.b() >> 3));
+}
+
+static inline Math::Vec3<int> UnpackRGB565(u16 color) {
+    const int r = (color >> 11) & 0x1F, g = (color >> 5) & 0x3F, b = color & 0x1F;
+    return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+/**
+ * Encodes a 4x4 block of texels into the BC1 color block format, with the two texels which are
+ * furthest apart as endpoints. ETC1 blocks only hold colors along two lines through the gray axis,
+ * which this approximates well, at a fraction of the cost of a more thorough search.
+ * @param texels Texels of the block, row by row from the top one
+ */
+static void EncodeBC1Block(const Math::Vec4<u8>* texels, u8* dst) {
+    int endpoints[2] = { 0, 0 };
+    int max_distance = -1;
+    for (int i = 0; i < 16; ++i) {
+        for (int j = i + 1; j < 16; ++j) {
+            const int dr = texels[i].r() - texels[j].r();
+            const int dg = texels[i].g() - texels[j].g();
+            const int db = texels[i].b() - texels[j].b();
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance > max_distance) {
+                max_distance = distance;
+                endpoints[0] = i;
+                endpoints[1] = j;
+            }
+        }
+    }
+
+    u16 color0 = PackRGB565(texels[endpoints[0]]);
+    u16 color1 = PackRGB565(texels[endpoints[1]]);
+    // The first endpoint must be the larger one to select the four color mode
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    u32 indices = 0;
+    if (color0 != color1) {
+        const Math::Vec3<int> palette0 = UnpackRGB565(color0);
+        const Math::Vec3<int> palette1 = UnpackRGB565(color1);
+        const Math::Vec3<int> palette[4] = {
+            palette0, palette1, (palette0 * 2 + palette1) / 3, (palette0 + palette1 * 2) / 3
+        };
+
+        for (int i = 0; i < 16; ++i) {
+            const Math::Vec3<int> color(texels[i].r(), texels[i].g(), texels[i].b());
+            u32 best_index = 0;
+            int best_distance = std::numeric_limits<int>::max();
+            for (u32 index = 0; index < 4; ++index) {
+                const Math::Vec3<int> difference = color - palette[index];
+                const int distance = difference.Length2();
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best_index = index;
+                }
+            }
+            indices |= best_index << (2 * i);
+        }
+    }
+
+    std::memcpy(dst, &color0, sizeof(u16));
+    std::memcpy(dst + 2, &color1, sizeof(u16));
+    std::memcpy(dst + 4, &indices, sizeof(u32));
+}
+
+size_t GetCompressedBlockSize(CompressedFormat format) {
+    return format == CompressedFormat::BC2 ? 16 : 8;
+}
+
+void TranscodeTexture(const u8* source, Regs::TextureFormat format, int width, int height,
+                      u8* dst, CompressedFormat dst_format) {
+    const size_t tile_size = GetTileSize(format);
+    const size_t block_size = GetCompressedBlockSize(dst_format);
+    const size_t block_row_size = (width / 4) * block_size;
+
+    for (int tile_y = 0; tile_y < height; tile_y += 8) {
+        // The two block rows of the tile, with the texture stored upside down
+        u8* dst_row = dst + ((height - 8 - tile_y) / 4) * block_row_size;
+
+        for (int tile_x = 0; tile_x < width; tile_x += 8) {
+            u8* dst_tile = dst_row + (tile_x / 4) * block_size;
+
+            if (dst_format == CompressedFormat::ETC2_RGB8) {
+                for (int subtile_index = 0; subtile_index < 4; ++subtile_index) {
+                    u64 block;
+                    std::memcpy(&block, source + subtile_index * sizeof(u64), sizeof(u64));
+                    block = FlipETC1Block(block);
+
+                    // The top subtiles of the PICA tile end up in the upper block row of the flipped one
+                    u8* out = dst_tile + (1 - (subtile_index >> 1)) * block_row_size + (subtile_index & 1) * block_size;
+                    for (int i = 0; i < 8; ++i)
+                        out[i] = static_cast<u8>(block >> (56 - 8 * i));
+                }
+            } else {
+                Math::Vec4<u8> texels[8 * 8];
+                DecodeTile(source, format, texels + 7 * 8, -8);
+
+                for (int block_y = 0; block_y < 2; ++block_y) {
+                    for (int block_x = 0; block_x < 2; ++block_x) {
+                        Math::Vec4<u8> block[16];
+                        for (int y = 0; y < 4; ++y) {
+                            for (int x = 0; x < 4; ++x)
+                                block[y * 4 + x] = texels[(block_y * 4 + y) * 8 + block_x * 4 + x];
+                        }
+
+                        u8* out = dst_tile + block_y * block_row_size + block_x * block_size;
+                        if (dst_format == CompressedFormat::BC2) {
+                            // Decoded alpha values are exact multiples of 17, so this is lossless
+                            u64 alpha = 0;
+                            for (int i = 0; i < 16; ++i)
+                                alpha |= static_cast<u64>(block[i].a() >> 4) << (4 * i);
+                            std::memcpy(out, &alpha, sizeof(u64));
+                            out += sizeof(u64);
+                        }
+                        EncodeBC1Block(block, out);
+                    }
+                }
+            }
+
+            source += tile_size;
+        }
+    }
+}
+
+} // namespace
+
+} // namespace
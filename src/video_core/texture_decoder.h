@@ -0,0 +1,67 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "pica.h"
+
+/**
+ * Bulk decoders converting whole 8x8 tiles of PICA textures to linear RGBA8 at once.
+ *
+ * These produce the same results as DebugUtils::LookupTexture, but decode a tile per call rather
+ * than looking up the format and Morton offset of every single texel. On x86-64 the common
+ * formats are decoded four texels at a time with SSE2.
+ */
+namespace Pica {
+
+namespace TextureDecoder {
+
+/// Returns the number of bytes an encoded 8x8 tile of the given format takes up
+size_t GetTileSize(Regs::TextureFormat format);
+
+/**
+ * Decodes one 8x8 tile.
+ * @param tile Pointer to the encoded tile data
+ * @param format Format of the tile data
+ * @param dst Destination of the texel at the tile's local coordinates (0, 0)
+ * @param dst_stride Distance between two rows of texels in dst, in texels. May be negative to
+ *                   store the tile upside down.
+ */
+void DecodeTile(const u8* tile, Regs::TextureFormat format, Math::Vec4<u8>* dst, ptrdiff_t dst_stride);
+
+/**
+ * Decodes a whole texture into width * height linear texels.
+ * @param source Pointer to the encoded texture data
+ * @param flip_y If true, the texel at t = height - 1 is stored first, as OpenGL textures expect
+ */
+void DecodeTexture(const u8* source, Regs::TextureFormat format, int width, int height,
+                   Math::Vec4<u8>* dst, bool flip_y);
+
+/// Block compressed host GPU formats which ETC1 and ETC1A4 textures can be transcoded into
+enum class CompressedFormat {
+    ETC2_RGB8, ///< ETC1 blocks, passed through except for flipping them. Only for ETC1.
+    BC1,       ///< DXT1, re-encoded from the decoded colors. Only for ETC1.
+    BC2,       ///< DXT3, for ETC1A4, whose explicit 4 bit alpha values are kept as they are
+};
+
+/// Returns the number of bytes a 4x4 block of the given compressed format takes up
+size_t GetCompressedBlockSize(CompressedFormat format);
+
+/**
+ * Transcodes a whole ETC1 or ETC1A4 texture into 4x4 blocks of a compressed format, stored
+ * upside down as OpenGL expects, like DecodeTexture with flip_y does.
+ * @param width Width of the texture, which must be a multiple of 8
+ * @param height Height of the texture, which must be a multiple of 8
+ */
+void TranscodeTexture(const u8* source, Regs::TextureFormat format, int width, int height,
+                      u8* dst, CompressedFormat dst_format);
+
+} // namespace
+
+} // namespace
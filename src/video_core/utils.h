@@ -37,15 +37,22 @@ void DumpTGA(std::string filename, short width, short height, u8* raw_data);
 
 /**
  * Interleave the lower 3 bits of each coordinate to get the intra-block offsets, which are
- * arranged in a Z-order curve. More details on the bit manipulation at:
+ * arranged in a Z-order curve. The table holds the result of interleaving the bits, e.g. via
  * https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
  */
 static inline u32 MortonInterleave(u32 x, u32 y) {
-    u32 i = (x & 7) | ((y & 7) << 8); // ---- -210
-    i = (i ^ (i << 2)) & 0x1313;      // ---2 --10
-    i = (i ^ (i << 1)) & 0x1515;      // ---2 -1-0
-    i = (i | (i >> 7)) & 0x3F;
-    return i;
+    // Indexed by (y & 7) * 8 + (x & 7)
+    static const u8 morton_lut[64] = {
+         0,  1,  4,  5, 16, 17, 20, 21,
+         2,  3,  6,  7, 18, 19, 22, 23,
+         8,  9, 12, 13, 24, 25, 28, 29,
+        10, 11, 14, 15, 26, 27, 30, 31,
+        32, 33, 36, 37, 48, 49, 52, 53,
+        34, 35, 38, 39, 50, 51, 54, 55,
+        40, 41, 44, 45, 56, 57, 60, 61,
+        42, 43, 46, 47, 58, 59, 62, 63,
+    };
+    return morton_lut[((y & 7) << 3) | (x & 7)];
 }
 
 /**
@@ -82,4 +89,12 @@ static inline u32 GetMortonOffset(u32 x, u32 y, u32 bytes_per_pixel) {
     return (i + offset) * bytes_per_pixel;
 }
 
+/**
+ * Calculates the offset of the 8x8 tile containing the given pixel in a Morton-ordered image
+ * @param stride Size of one row of pixels in bytes
+ */
+static inline u32 GetMortonTileOffset(u32 x, u32 y, u32 bytes_per_pixel, u32 stride) {
+    return (x & ~7) * 8 * bytes_per_pixel + (y & ~7) * stride;
+}
+
 } // namespace
@@ -0,0 +1,147 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/logging/log.h"
+
+#include "core/memory.h"
+
+#include "vertex_loader.h"
+
+namespace Pica {
+
+/**
+ * Converts one attribute with NumElements elements of type T to float24. Missing components are
+ * set to (0, 0, 0, 1). This is *not* carried over from the default attribute settings even if
+ * they're enabled for this attribute.
+ */
+template <typename T, int NumElements>
+static void FetchAttribute(const u8* source, Math::Vec4<float24>& out) {
+    // Vertex arrays don't need to be aligned to the element size
+    T values[NumElements];
+    std::memcpy(values, source, sizeof(values));
+
+    for (int i = 0; i < NumElements; ++i)
+        out[i] = float24::FromFloat32(static_cast<float>(values[i]));
+
+    for (int i = NumElements; i < 4; ++i)
+        out[i] = float24::FromFloat32((i == 3) ? 1.0f : 0.0f);
+}
+
+/// Fetch functions for each element format (see Regs::VertexAttributeFormat) and element count
+static void (*const fetch_functions[4][4])(const u8*, Math::Vec4<float24>&) = {
+    { &FetchAttribute<s8, 1>,    &FetchAttribute<s8, 2>,    &FetchAttribute<s8, 3>,    &FetchAttribute<s8, 4>    },
+    { &FetchAttribute<u8, 1>,    &FetchAttribute<u8, 2>,    &FetchAttribute<u8, 3>,    &FetchAttribute<u8, 4>    },
+    { &FetchAttribute<s16, 1>,   &FetchAttribute<s16, 2>,   &FetchAttribute<s16, 3>,   &FetchAttribute<s16, 4>   },
+    { &FetchAttribute<float, 1>, &FetchAttribute<float, 2>, &FetchAttribute<float, 3>, &FetchAttribute<float, 4> },
+};
+
+void VertexLoader::Setup(const Regs& regs) {
+    const auto& attribute_config = regs.vertex_attributes;
+    const u32 base_address = attribute_config.GetPhysicalBaseAddress();
+
+    num_total_attributes = attribute_config.GetNumTotalAttributes();
+
+    for (auto& attribute : attributes)
+        attribute.type = AttributeType::None;
+
+    // Setup attribute data from loaders
+    for (int loader = 0; loader < 12; ++loader) {
+        const auto& loader_config = attribute_config.attribute_loaders[loader];
+
+        u32 load_address = base_address + loader_config.data_offset;
+
+        // TODO: What happens if a loader overwrites a previous one's data?
+        for (unsigned component = 0; component < loader_config.component_count; ++component) {
+            u32 attribute_index = loader_config.GetComponent(component);
+            auto& attribute = attributes[attribute_index];
+
+            const int num_elements = attribute_config.GetNumElements(attribute_index);
+
+            attribute.type = AttributeType::Array;
+            attribute.address = load_address;
+            attribute.stride = static_cast<u32>(loader_config.byte_count);
+            attribute.size = attribute_config.GetStride(attribute_index);
+
+            attribute.fetch = fetch_functions[static_cast<int>(attribute_config.GetFormat(attribute_index))][num_elements - 1];
+
+            load_address += attribute.size;
+        }
+    }
+
+    for (int i = 0; i < num_total_attributes; ++i) {
+        auto& attribute = attributes[i];
+
+        if (attribute.type == AttributeType::Array) {
+            // Vertex arrays are contiguous in physical memory, so the host pointer only needs to
+            // be looked up once for each array.
+            attribute.source = Memory::GetPhysicalPointer(attribute.address);
+            if (attribute.source == nullptr) {
+                LOG_ERROR(HW_GPU, "Attribute %x reads from invalid address 0x%08x", i, attribute.address);
+                attribute.type = AttributeType::None;
+            }
+        } else if (attribute_config.IsDefaultAttribute(i)) {
+            // Load the default attribute if we're configured to do so
+            attribute.type = AttributeType::Default;
+            attribute.default_value = g_state.vs.default_attributes[i];
+        }
+    }
+}
+
+void VertexLoader::LoadVertex(u32 vertex, VertexShader::InputVertex& input) const {
+    for (int i = 0; i < num_total_attributes; ++i) {
+        const auto& attribute = attributes[i];
+
+        switch (attribute.type) {
+        case AttributeType::Array:
+            attribute.fetch(attribute.source + attribute.stride * vertex, input.attr[i]);
+            LOG_TRACE(HW_GPU, "Loaded attribute %x for vertex %x from 0x%08x: (%f, %f, %f, %f)",
+                      i, vertex, attribute.address + attribute.stride * vertex,
+                      input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
+                      input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
+            break;
+
+        case AttributeType::Default:
+            input.attr[i] = attribute.default_value;
+            LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x: (%f, %f, %f, %f)",
+                      i, vertex,
+                      input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
+                      input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
+            break;
+
+        case AttributeType::None:
+            // TODO(yuriks): In this case, no data gets loaded and the vertex remains
+            //              with the last value it had. This isn't currently maintained
+            //              as global state, however, and so won't work in Cita yet.
+            break;
+        }
+    }
+}
+
+void VertexLoader::LoadVertices(u32 first, u32 count, VertexShader::InputVertex* inputs) const {
+    for (int i = 0; i < num_total_attributes; ++i) {
+        const auto& attribute = attributes[i];
+
+        switch (attribute.type) {
+        case AttributeType::Array:
+        {
+            const u8* source = attribute.source + attribute.stride * first;
+            for (u32 vertex = 0; vertex < count; ++vertex, source += attribute.stride)
+                attribute.fetch(source, inputs[vertex].attr[i]);
+            break;
+        }
+
+        case AttributeType::Default:
+            for (u32 vertex = 0; vertex < count; ++vertex)
+                inputs[vertex].attr[i] = attribute.default_value;
+            break;
+
+        case AttributeType::None:
+            break;
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,79 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "pica.h"
+#include "vertex_shader.h"
+
+namespace Pica {
+
+/**
+ * Loads vertex shader input attributes from the vertex arrays configured in the Pica registers.
+ *
+ * The attribute configuration is evaluated once per draw in Setup(): each attribute's source
+ * array is translated to a host pointer, and a fetch function specialized for its element format
+ * and count is selected. Loading a vertex then only requires one call per attribute.
+ */
+class VertexLoader {
+public:
+    /// Evaluates the attribute configuration in the given registers
+    void Setup(const Regs& regs);
+
+    /// Loads the attributes of the vertex with the given index
+    void LoadVertex(u32 vertex, VertexShader::InputVertex& input) const;
+
+    /**
+     * Loads the attributes of `count` consecutive vertices, starting at index `first`. This goes
+     * through the vertex arrays one attribute at a time, so each array is read sequentially.
+     */
+    void LoadVertices(u32 first, u32 count, VertexShader::InputVertex* inputs) const;
+
+    /**
+     * Calls callback(address, size) for each range of physical memory read when loading the vertex
+     * with the given index, which is needed by the command list recorder.
+     */
+    template <typename Callback>
+    void ForEachMemoryAccess(u32 vertex, Callback callback) const {
+        for (int i = 0; i < num_total_attributes; ++i) {
+            const auto& attribute = attributes[i];
+            if (attribute.type == AttributeType::Array)
+                callback(attribute.address + attribute.stride * vertex, attribute.size);
+        }
+    }
+
+private:
+    using FetchFunction = void (*)(const u8* source, Math::Vec4<float24>& out);
+
+    enum class AttributeType {
+        Array,   ///< Loaded from a vertex array
+        Default, ///< Set to the default attribute value
+        None,    ///< Not loaded at all (keeps the previous value)
+    };
+
+    struct Attribute {
+        AttributeType type;
+
+        /// Host pointer to the attribute data of the first vertex
+        const u8* source;
+        /// Physical address of the attribute data of the first vertex
+        u32 address;
+        /// Distance between consecutive vertices in bytes
+        u32 stride;
+        /// Size of the attribute data of a single vertex in bytes
+        u32 size;
+
+        FetchFunction fetch;
+
+        /// Value used for default attributes
+        Math::Vec4<float24> default_value;
+    };
+
+    int num_total_attributes = 0;
+    Attribute attributes[16];
+};
+
+} // namespace
@@ -2,17 +2,28 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <array>
+#include <memory>
+#include <unordered_map>
+
 #include <boost/container/static_vector.hpp>
 #include <boost/range/algorithm.hpp>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
 #include <common/file_util.h>
 
 #include <nihstro/shader_bytecode.h>
 
+#include "common/hash.h"
+#include "common/make_unique.h"
 #include "common/profiler.h"
 
 #include "pica.h"
 #include "vertex_shader.h"
+#include "vertex_shader_program.h"
 #include "debug_utils/debug_utils.h"
 
 using nihstro::OpCode;
@@ -25,18 +36,47 @@ namespace Pica {
 
 namespace VertexShader {
 
+/// Triangle emitted by a geometry shader invocation
+struct EmittedTriangle {
+    OutputVertex vertices[3];
+};
+
+/// Vertex emission state of a geometry shader invocation
+struct GeometryEmitter {
+    /// Set by SETEMIT: the output vertex buffer entry which EMIT writes to, whether EMIT then
+    /// completes a triangle, and whether that triangle's winding is reversed
+    u8 vertex_id;
+    bool prim_emit;
+    bool winding;
+
+    OutputVertex buffer[3];
+
+    /// Triangles emitted so far, in a preallocated array of MAX_EMITTED_TRIANGLES entries
+    EmittedTriangle* triangles;
+    unsigned num_triangles;
+};
+
+/**
+ * Shader state for a batch of vertices which are processed in lockstep. Each instruction is
+ * decoded once and then applied to all lanes. Registers are stored in SoA layout (all lanes of
+ * a component are adjacent) so that the per-lane loops can be vectorized by the compiler.
+ */
+template <int NumLanes>
 struct VertexShaderState {
+    struct Register {
+        float24 comp[4][NumLanes];
+    };
+
     u32 program_counter;
 
-    const float24* input_register_table[16];
-    Math::Vec4<float24> output_registers[16];
+    Register registers[NUM_REGISTERS];
 
-    Math::Vec4<float24> temporary_registers[16];
-    bool conditional_code[2];
+    bool conditional_code[2][NumLanes];
 
-    // Two Address registers and one loop counter
+    // Two address registers per lane and one loop counter
     // TODO: How many bits do these actually have?
-    s32 address_registers[3];
+    s32 address_registers[2][NumLanes];
+    s32 loop_counter;
 
     enum {
         INVALID_ADDRESS = 0xFFFFFFFF
@@ -58,21 +98,585 @@ struct VertexShaderState {
         u32 max_offset; // maximum program counter ever reached
         u32 max_opdesc_id; // maximum swizzle pattern index ever used
     } debug;
+
+    /// Uniforms of the shader unit running the program
+    const State::ShaderSetup* setup;
+
+    /// Emitters of each lane's geometry shader invocation, or nullptr for the vertex shader
+    GeometryEmitter* emitters;
+};
+
+/**
+ * Arithmetic on all lanes of one register component. float24 values are stored as plain floats and
+ * don't lose any precision in the operators, so the lanes can be processed as packed floats.
+ */
+template <int NumLanes>
+struct LaneOps {
+    using Row = float24[NumLanes];
+
+    static void Add(const Row& a, const Row& b, Row& out) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            out[lane] = a[lane] + b[lane];
+    }
+
+    static void Mul(const Row& a, const Row& b, Row& out) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            out[lane] = a[lane] * b[lane];
+    }
+
+    /// out = a * b + c
+    static void MulAdd(const Row& a, const Row& b, const Row& c, Row& out) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            out[lane] = a[lane] * b[lane] + c[lane];
+    }
+
+    static void Max(const Row& a, const Row& b, Row& out) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            out[lane] = std::max(a[lane], b[lane]);
+    }
+
+    static void Min(const Row& a, const Row& b, Row& out) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            out[lane] = std::min(a[lane], b[lane]);
+    }
+
+    static void Negate(Row& a) {
+        for (int lane = 0; lane < NumLanes; ++lane)
+            a[lane] = -a[lane];
+    }
 };
 
-static void ProcessShaderCode(VertexShaderState& state) {
-    const auto& uniforms = g_state.vs.uniforms;
-    const auto& swizzle_data = g_state.vs.swizzle_data;
-    const auto& program_code = g_state.vs.program_code;
+#if defined(__x86_64__) || defined(_M_X64)
+static_assert(sizeof(float24) == sizeof(float), "float24 needs to be stored as a float for SSE");
+
+template <>
+struct LaneOps<4> {
+    using Row = float24[4];
+
+    static __m128 Load(const Row& a) {
+        return _mm_loadu_ps(reinterpret_cast<const float*>(a));
+    }
+
+    static void Store(Row& a, __m128 value) {
+        _mm_storeu_ps(reinterpret_cast<float*>(a), value);
+    }
+
+    static void Add(const Row& a, const Row& b, Row& out) {
+        Store(out, _mm_add_ps(Load(a), Load(b)));
+    }
+
+    static void Mul(const Row& a, const Row& b, Row& out) {
+        Store(out, _mm_mul_ps(Load(a), Load(b)));
+    }
+
+    static void MulAdd(const Row& a, const Row& b, const Row& c, Row& out) {
+        Store(out, _mm_add_ps(_mm_mul_ps(Load(a), Load(b)), Load(c)));
+    }
+
+    // std::max(a, b) returns a unless a < b, which is what maxps does with swapped operands (also
+    // for NaNs). The same goes for std::min and minps.
+    static void Max(const Row& a, const Row& b, Row& out) {
+        Store(out, _mm_max_ps(Load(b), Load(a)));
+    }
+
+    static void Min(const Row& a, const Row& b, Row& out) {
+        Store(out, _mm_min_ps(Load(b), Load(a)));
+    }
+
+    static void Negate(Row& a) {
+        Store(a, _mm_xor_ps(Load(a), _mm_set1_ps(-0.0f)));
+    }
+};
+#endif
+
+/// Resolves where the given source register is read from
+static void ResolveSourceRegister(const SourceRegister& source_reg, const State::ShaderSetup& setup,
+                                  const float24*& uniform, u8& register_index) {
+    uniform = nullptr;
+
+    switch (source_reg.GetRegisterType()) {
+    case RegisterType::Input:
+        register_index = REGISTER_INPUT + source_reg.GetIndex();
+        break;
+
+    case RegisterType::Temporary:
+        register_index = REGISTER_TEMPORARY + source_reg.GetIndex();
+        break;
+
+    case RegisterType::FloatUniform:
+        uniform = &setup.uniforms.f[source_reg.GetIndex()].x;
+        break;
+
+    default:
+        register_index = REGISTER_ZERO;
+        break;
+    }
+}
+
+static void DecodeSource(const SourceRegister& source_reg, const State::ShaderSetup& setup, int address_register_index,
+                         const int selectors[4], bool negate, DecodedSource& source) {
+    ResolveSourceRegister(source_reg, setup, source.uniform, source.register_index);
+    source.address_register_index = address_register_index;
+    for (int i = 0; i < 4; ++i)
+        source.selectors[i] = selectors[i];
+    source.negate = negate;
+    source.source_register = source_reg;
+}
+
+/// Opcodes of the geometry shader instructions, which nihstro doesn't name
+enum : u32 {
+    OPCODE_EMIT    = 0x2A,
+    OPCODE_SETEMIT = 0x2B,
+};
+
+static void DecodeInstruction(u32 program_word, const State::ShaderSetup& setup, DecodedInstruction& decoded) {
+    const auto& swizzle_data = setup.swizzle_data;
+
+    using Op = DecodedInstruction::Op;
+
+    const Instruction instr = { program_word };
+
+    decoded.hex = instr.hex;
+    decoded.num_sources = 0;
+    decoded.dest_register = REGISTER_DISCARD;
+    for (int i = 0; i < 4; ++i)
+        decoded.dest_enabled[i] = false;
+    decoded.operand_desc_id = 0;
+
+    // SETEMIT fields, which sit above the ones of the other instructions
+    decoded.emit_vertex_id = (instr.hex >> 24) & 3;
+    decoded.emit_primitive = ((instr.hex >> 23) & 1) != 0;
+    decoded.emit_winding = ((instr.hex >> 22) & 1) != 0;
+
+    // Flow control fields; these are only meaningful for flow control instructions
+    switch (instr.flow_control.op) {
+    case instr.flow_control.Or:
+        decoded.condition_op = DecodedInstruction::ConditionOp::Or;
+        break;
+
+    case instr.flow_control.And:
+        decoded.condition_op = DecodedInstruction::ConditionOp::And;
+        break;
+
+    case instr.flow_control.JustX:
+        decoded.condition_op = DecodedInstruction::ConditionOp::JustX;
+        break;
+
+    case instr.flow_control.JustY:
+    default:
+        decoded.condition_op = DecodedInstruction::ConditionOp::JustY;
+        break;
+    }
+    decoded.refx = instr.flow_control.refx;
+    decoded.refy = instr.flow_control.refy;
+    decoded.bool_uniform_id = instr.flow_control.bool_uniform_id;
+    decoded.int_uniform_id = instr.flow_control.int_uniform_id;
+    decoded.dest_offset = instr.flow_control.dest_offset;
+    decoded.num_instructions = instr.flow_control.num_instructions;
+
+    switch (instr.opcode.Value().GetInfo().type) {
+    case OpCode::Type::Arithmetic:
+    {
+        const SwizzlePattern swizzle = { swizzle_data[instr.common.operand_desc_id] };
+        const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
+
+        const int selectors_src1[4] = {
+            (int)swizzle.GetSelectorSrc1(0), (int)swizzle.GetSelectorSrc1(1),
+            (int)swizzle.GetSelectorSrc1(2), (int)swizzle.GetSelectorSrc1(3),
+        };
+        const int selectors_src2[4] = {
+            (int)swizzle.GetSelectorSrc2(0), (int)swizzle.GetSelectorSrc2(1),
+            (int)swizzle.GetSelectorSrc2(2), (int)swizzle.GetSelectorSrc2(3),
+        };
+
+        // Relative addressing only applies to the first source operand in the encoding
+        const int address_register_index = instr.common.address_register_index;
+
+        DecodeSource(instr.common.GetSrc1(is_inverted), setup, is_inverted ? 0 : address_register_index,
+                     selectors_src1, (bool)swizzle.negate_src1, decoded.src[0]);
+        DecodeSource(instr.common.GetSrc2(is_inverted), setup, is_inverted ? address_register_index : 0,
+                     selectors_src2, (bool)swizzle.negate_src2, decoded.src[1]);
+
+        decoded.dest_register = (instr.common.dest.Value() < 0x10) ? REGISTER_OUTPUT + instr.common.dest.Value().GetIndex()
+                              : (instr.common.dest.Value() < 0x20) ? REGISTER_TEMPORARY + instr.common.dest.Value().GetIndex()
+                              : REGISTER_DISCARD;
+        for (int i = 0; i < 4; ++i)
+            decoded.dest_enabled[i] = swizzle.DestComponentEnabled(i);
+
+        decoded.operand_desc_id = instr.common.operand_desc_id;
+
+        // Most instructions read two operands, the ones below only use the first
+        decoded.num_sources = 2;
+
+        switch (instr.opcode.Value().EffectiveOpCode()) {
+        case OpCode::Id::ADD:  decoded.op = Op::ADD; break;
+        case OpCode::Id::MUL:  decoded.op = Op::MUL; break;
+        case OpCode::Id::MAX:  decoded.op = Op::MAX; break;
+        case OpCode::Id::MIN:  decoded.op = Op::MIN; break;
+        case OpCode::Id::DP3:  decoded.op = Op::DP3; break;
+        case OpCode::Id::DP4:  decoded.op = Op::DP4; break;
+        case OpCode::Id::SLT:
+        case OpCode::Id::SLTI: decoded.op = Op::SLT; break;
+
+        case OpCode::Id::FLR:  decoded.op = Op::FLR;  decoded.num_sources = 1; break;
+        case OpCode::Id::RCP:  decoded.op = Op::RCP;  decoded.num_sources = 1; break;
+        case OpCode::Id::RSQ:  decoded.op = Op::RSQ;  decoded.num_sources = 1; break;
+        case OpCode::Id::MOVA: decoded.op = Op::MOVA; decoded.num_sources = 1; break;
+        case OpCode::Id::MOV:  decoded.op = Op::MOV;  decoded.num_sources = 1; break;
+
+        case OpCode::Id::CMP:
+        {
+            decoded.op = Op::CMP;
+
+            auto compare_op = instr.common.compare_op;
+            for (int i = 0; i < 2; ++i) {
+                auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
+                auto& decoded_op = decoded.compare_ops[i];
+
+                switch (op) {
+                    case compare_op.Equal:        decoded_op = DecodedInstruction::CompareOp::Equal;        break;
+                    case compare_op.NotEqual:     decoded_op = DecodedInstruction::CompareOp::NotEqual;     break;
+                    case compare_op.LessThan:     decoded_op = DecodedInstruction::CompareOp::LessThan;     break;
+                    case compare_op.LessEqual:    decoded_op = DecodedInstruction::CompareOp::LessEqual;    break;
+                    case compare_op.GreaterThan:  decoded_op = DecodedInstruction::CompareOp::GreaterThan;  break;
+                    case compare_op.GreaterEqual: decoded_op = DecodedInstruction::CompareOp::GreaterEqual; break;
+                    default:                      decoded_op = DecodedInstruction::CompareOp::Unknown;      break;
+                }
+            }
+            break;
+        }
+
+        default:
+            decoded.op = Op::UnhandledArithmetic;
+            decoded.num_sources = 0;
+            break;
+        }
+
+        break;
+    }
+
+    case OpCode::Type::MultiplyAdd:
+    {
+        if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) ||
+            (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI)) {
+            const SwizzlePattern swizzle = { swizzle_data[instr.mad.operand_desc_id] };
+
+            bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
+
+            const int selectors_src1[4] = {
+                (int)swizzle.GetSelectorSrc1(0), (int)swizzle.GetSelectorSrc1(1),
+                (int)swizzle.GetSelectorSrc1(2), (int)swizzle.GetSelectorSrc1(3),
+            };
+            const int selectors_src2[4] = {
+                (int)swizzle.GetSelectorSrc2(0), (int)swizzle.GetSelectorSrc2(1),
+                (int)swizzle.GetSelectorSrc2(2), (int)swizzle.GetSelectorSrc2(3),
+            };
+            const int selectors_src3[4] = {
+                (int)swizzle.GetSelectorSrc3(0), (int)swizzle.GetSelectorSrc3(1),
+                (int)swizzle.GetSelectorSrc3(2), (int)swizzle.GetSelectorSrc3(3),
+            };
+
+            DecodeSource(instr.mad.GetSrc1(is_inverted), setup, 0, selectors_src1, (bool)swizzle.negate_src1, decoded.src[0]);
+            DecodeSource(instr.mad.GetSrc2(is_inverted), setup, 0, selectors_src2, (bool)swizzle.negate_src2, decoded.src[1]);
+            DecodeSource(instr.mad.GetSrc3(is_inverted), setup, 0, selectors_src3, (bool)swizzle.negate_src3, decoded.src[2]);
+
+            decoded.dest_register = (instr.mad.dest.Value() < 0x10) ? REGISTER_OUTPUT + instr.mad.dest.Value().GetIndex()
+                                  : (instr.mad.dest.Value() < 0x20) ? REGISTER_TEMPORARY + instr.mad.dest.Value().GetIndex()
+                                  : REGISTER_DISCARD;
+            for (int i = 0; i < 4; ++i)
+                decoded.dest_enabled[i] = swizzle.DestComponentEnabled(i);
+
+            decoded.operand_desc_id = instr.mad.operand_desc_id;
+            decoded.op = Op::MAD;
+            decoded.num_sources = 3;
+        } else {
+            decoded.op = Op::UnhandledMultiplyAdd;
+        }
+        break;
+    }
+
+    default:
+    {
+        const u32 opcode = instr.hex >> 26;
+        if (opcode == OPCODE_EMIT || opcode == OPCODE_SETEMIT) {
+            decoded.op = (opcode == OPCODE_EMIT) ? Op::EMIT : Op::SETEMIT;
+            break;
+        }
+
+        switch (instr.opcode.Value()) {
+        case OpCode::Id::END:   decoded.op = Op::END;   break;
+        case OpCode::Id::NOP:   decoded.op = Op::NOP;   break;
+        case OpCode::Id::JMPC:  decoded.op = Op::JMPC;  break;
+        case OpCode::Id::JMPU:  decoded.op = Op::JMPU;  break;
+        case OpCode::Id::CALL:  decoded.op = Op::CALL;  break;
+        case OpCode::Id::CALLU: decoded.op = Op::CALLU; break;
+        case OpCode::Id::CALLC: decoded.op = Op::CALLC; break;
+        case OpCode::Id::IFU:   decoded.op = Op::IFU;   break;
+        case OpCode::Id::IFC:   decoded.op = Op::IFC;   break;
+        case OpCode::Id::LOOP:  decoded.op = Op::LOOP;  break;
+        default:                decoded.op = Op::Unhandled; break;
+        }
+        break;
+    }
+    }
+}
+
+/// Number of decoded programs to keep around before the cache is flushed
+static const size_t MAX_CACHED_PROGRAMS = 64;
+
+/// Decoded programs, keyed by a hash of the program code and swizzle data they were decoded from
+static std::unordered_map<u64, std::unique_ptr<DecodedProgram>> program_cache;
+
+/// Decoded versions of the currently loaded programs, or nullptr if they need to be looked up again
+static const DecodedProgram* current_program = nullptr;
+static const DecodedProgram* current_geometry_program = nullptr;
+
+/**
+ * Seed of the hashes of geometry shader programs. Decoded operands point to the uniforms of their
+ * shader unit, so the same code loaded into both units must be decoded separately.
+ */
+static const u64 GEOMETRY_PROGRAM_HASH_SEED = 1;
+
+void InvalidateDecodedProgram() {
+    current_program = nullptr;
+    current_geometry_program = nullptr;
+}
+
+void Shutdown() {
+    program_cache.clear();
+    current_program = nullptr;
+    current_geometry_program = nullptr;
+}
+
+/// Returns the decoded version of the program loaded into the given shader unit
+static const DecodedProgram* LookupDecodedProgram(const State::ShaderSetup& setup, u64 seed) {
+    u64 hash = Common::ComputeHash64(setup.program_code.data(), sizeof(setup.program_code), seed);
+    hash = Common::ComputeHash64(setup.swizzle_data.data(), sizeof(setup.swizzle_data), hash);
+
+    auto it = program_cache.find(hash);
+    if (it == program_cache.end()) {
+        if (program_cache.size() >= MAX_CACHED_PROGRAMS) {
+            program_cache.clear();
+            current_program = nullptr;
+            current_geometry_program = nullptr;
+        }
+
+        auto program = Common::make_unique<DecodedProgram>();
+        for (size_t offset = 0; offset < program->code.size(); ++offset)
+            DecodeInstruction(setup.program_code[offset], setup, program->code[offset]);
+        program->hash = hash;
+
+        it = program_cache.emplace(hash, std::move(program)).first;
+    }
+
+    return it->second.get();
+}
+
+const DecodedProgram& GetDecodedProgram() {
+    if (current_program == nullptr)
+        current_program = LookupDecodedProgram(g_state.vs, 0);
+    return *current_program;
+}
+
+const DecodedProgram& GetDecodedGeometryProgram() {
+    if (current_geometry_program == nullptr)
+        current_geometry_program = LookupDecodedProgram(g_state.gs, GEOMETRY_PROGRAM_HASH_SEED);
+    return *current_geometry_program;
+}
+
+void PrepareDecodedProgram() {
+    GetDecodedProgram();
+}
+
+/// Returns the register offset given by the address register with the given (1-based) index
+template <int NumLanes>
+static int GetAddressOffset(const VertexShaderState<NumLanes>& state, int address_register_index, int lane) {
+    switch (address_register_index) {
+    case 0:
+        return 0;
+
+    case 1:
+    case 2:
+        return state.address_registers[address_register_index - 1][lane];
+
+    default:
+        return state.loop_counter;
+    }
+}
+
+/// Reads the given source operand for all lanes, applying swizzling and negation
+template <int NumLanes>
+static void LoadSourceOperand(const VertexShaderState<NumLanes>& state, const DecodedSource& source,
+                              float24 (&out)[4][NumLanes]) {
+    if (source.address_register_index == 0) {
+        if (source.uniform != nullptr) {
+            for (int i = 0; i < 4; ++i) {
+                const float24 value = source.uniform[source.selectors[i]];
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    out[i][lane] = value;
+            }
+        } else {
+            const auto& reg = state.registers[source.register_index];
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    out[i][lane] = reg.comp[source.selectors[i]][lane];
+        }
+    } else {
+        // With relative addressing, each lane may read from a different register
+        for (int lane = 0; lane < NumLanes; ++lane) {
+            const SourceRegister reg = source.source_register + GetAddressOffset(state, source.address_register_index, lane);
+
+            const float24* uniform;
+            u8 register_index;
+            ResolveSourceRegister(reg, *state.setup, uniform, register_index);
+
+            for (int i = 0; i < 4; ++i) {
+                out[i][lane] = (uniform != nullptr) ? uniform[source.selectors[i]]
+                             : state.registers[register_index].comp[source.selectors[i]][lane];
+            }
+        }
+    }
 
-    // Placeholder for invalid inputs
-    static float24 dummy_vec4_float24[4];
+    if (source.negate) {
+        for (int i = 0; i < 4; ++i)
+            LaneOps<NumLanes>::Negate(out[i]);
+    }
+}
+
+template <int NumLanes>
+static void Call(VertexShaderState<NumLanes>& state, u32 offset, u32 num_instructions,
+                 u32 return_offset, u8 repeat_count, u8 loop_increment) {
+    state.program_counter = offset - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
+    ASSERT(state.call_stack.size() < state.call_stack.capacity());
+    state.call_stack.push_back({ offset + num_instructions, return_offset, repeat_count, loop_increment, offset });
+}
+
+/**
+ * Evaluates the flow control condition of the given instruction for all lanes.
+ * @param result Set to the outcome of the condition if all lanes agree on it
+ * @return False if the lanes disagree on the outcome, true otherwise
+ */
+template <int NumLanes>
+static bool EvaluateCondition(const VertexShaderState<NumLanes>& state, const DecodedInstruction& instr, bool& result) {
+    for (int lane = 0; lane < NumLanes; ++lane) {
+        bool results[2] = { instr.refx == state.conditional_code[0][lane],
+                            instr.refy == state.conditional_code[1][lane] };
+
+        bool lane_result;
+        switch (instr.condition_op) {
+        case DecodedInstruction::ConditionOp::Or:
+            lane_result = results[0] || results[1];
+            break;
+
+        case DecodedInstruction::ConditionOp::And:
+            lane_result = results[0] && results[1];
+            break;
+
+        case DecodedInstruction::ConditionOp::JustX:
+            lane_result = results[0];
+            break;
+
+        case DecodedInstruction::ConditionOp::JustY:
+        default:
+            lane_result = results[1];
+            break;
+        }
+
+        if (lane == 0)
+            result = lane_result;
+        else if (lane_result != result)
+            return false;
+    }
+
+    return true;
+}
+
+/// Maps the output registers of a lane to the semantics of an output vertex
+template <int NumLanes>
+static void WriteOutputs(const VertexShaderState<NumLanes>& state, int lane, OutputVertex& ret) {
+    // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
+    // figure out what those circumstances are and enable the remaining outputs then.
+    for (int i = 0; i < 7; ++i) {
+        // The output map applies to whichever shader unit runs last
+        const auto& output_register_map = g_state.regs.vs_output_attributes[i];
+
+        u32 semantics[4] = {
+            output_register_map.map_x, output_register_map.map_y,
+            output_register_map.map_z, output_register_map.map_w
+        };
+
+        for (int comp = 0; comp < 4; ++comp) {
+            float24* out = ((float24*)&ret) + semantics[comp];
+            if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
+                *out = state.registers[REGISTER_OUTPUT + i].comp[comp][lane];
+            } else {
+                // Zero output so that attributes which aren't output won't have denormals in them,
+                // which would slow us down later.
+                memset(out, 0, sizeof(*out));
+            }
+        }
+    }
+
+    // The hardware takes the absolute and saturates vertex colors like this, *before* doing interpolation
+    for (int i = 0; i < 4; ++i) {
+        ret.color[i] = float24::FromFloat32(
+            std::fmin(std::fabs(ret.color[i].ToFloat32()), 1.0f));
+    }
+
+    LOG_TRACE(Render_Software, "Output vertex: pos (%.2f, %.2f, %.2f, %.2f), col(%.2f, %.2f, %.2f, %.2f), tc0(%.2f, %.2f)",
+        ret.pos.x.ToFloat32(), ret.pos.y.ToFloat32(), ret.pos.z.ToFloat32(), ret.pos.w.ToFloat32(),
+        ret.color.x.ToFloat32(), ret.color.y.ToFloat32(), ret.color.z.ToFloat32(), ret.color.w.ToFloat32(),
+        ret.tc0.u().ToFloat32(), ret.tc0.v().ToFloat32());
+}
+
+template <int NumLanes>
+static void WriteOutputs(const VertexShaderState<NumLanes>& state, int lane, OutputRegisters& ret) {
+    for (int i = 0; i < 16; ++i)
+        for (int comp = 0; comp < 4; ++comp)
+            ret.value[i][comp] = state.registers[REGISTER_OUTPUT + i].comp[comp][lane];
+}
+
+/// Stores the current outputs of a lane in its vertex buffer, and emits a triangle if SETEMIT asked for one
+template <int NumLanes>
+static void EmitVertex(const VertexShaderState<NumLanes>& state, int lane) {
+    GeometryEmitter& emitter = state.emitters[lane];
+    if (emitter.vertex_id >= 3) {
+        LOG_ERROR(HW_GPU, "Invalid geometry shader output vertex %d", (int)emitter.vertex_id);
+        return;
+    }
+
+    WriteOutputs(state, lane, emitter.buffer[emitter.vertex_id]);
+    if (!emitter.prim_emit)
+        return;
+
+    if (emitter.num_triangles == MAX_EMITTED_TRIANGLES) {
+        LOG_ERROR(HW_GPU, "Geometry shader emitted more than %u triangles", MAX_EMITTED_TRIANGLES);
+        return;
+    }
+
+    EmittedTriangle& triangle = emitter.triangles[emitter.num_triangles++];
+    triangle.vertices[0] = emitter.buffer[emitter.winding ? 1 : 0];
+    triangle.vertices[1] = emitter.buffer[emitter.winding ? 0 : 1];
+    triangle.vertices[2] = emitter.buffer[2];
+}
+
+/**
+ * Runs the given shader program on all lanes of the given state.
+ * @return False if the lanes took different paths through the program, in which case the
+ *         state is left in an undefined condition and each lane needs to be run separately.
+ */
+template <int NumLanes>
+static bool ProcessShaderCode(VertexShaderState<NumLanes>& state, const DecodedProgram& program) {
+    const auto& uniforms = state.setup->uniforms;
+
+    using Op = DecodedInstruction::Op;
+    using CompareOp = DecodedInstruction::CompareOp;
 
     while (true) {
         if (!state.call_stack.empty()) {
             auto& top = state.call_stack.back();
             if (state.program_counter == top.final_address) {
-                state.address_registers[2] += top.loop_increment;
+                state.loop_counter += top.loop_increment;
 
                 if (top.repeat_counter-- == 0) {
                     state.program_counter = top.return_address;
@@ -87,450 +691,372 @@ static void ProcessShaderCode(VertexShaderState& state) {
         }
 
         bool exit_loop = false;
-        const Instruction instr = { program_code[state.program_counter] };
-        const SwizzlePattern swizzle = { swizzle_data[instr.common.operand_desc_id] };
+        const DecodedInstruction& instr = program.code[state.program_counter];
 
-        static auto call = [](VertexShaderState& state, u32 offset, u32 num_instructions,
-                              u32 return_offset, u8 repeat_count, u8 loop_increment) {
-            state.program_counter = offset - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
-            ASSERT(state.call_stack.size() < state.call_stack.capacity());
-            state.call_stack.push_back({ offset + num_instructions, return_offset, repeat_count, loop_increment, offset });
-        };
         state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + state.program_counter);
 
-        auto LookupSourceRegister = [&](const SourceRegister& source_reg) -> const float24* {
-            switch (source_reg.GetRegisterType()) {
-            case RegisterType::Input:
-                return state.input_register_table[source_reg.GetIndex()];
-
-            case RegisterType::Temporary:
-                return &state.temporary_registers[source_reg.GetIndex()].x;
+        float24 src1[4][NumLanes];
+        float24 src2[4][NumLanes];
+        float24 src3[4][NumLanes];
+        if (instr.num_sources != 0) {
+            LoadSourceOperand(state, instr.src[0], src1);
+            if (instr.num_sources > 1)
+                LoadSourceOperand(state, instr.src[1], src2);
+            if (instr.num_sources > 2)
+                LoadSourceOperand(state, instr.src[2], src3);
+
+            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.operand_desc_id);
+        }
 
-            case RegisterType::FloatUniform:
-                return &uniforms.f[source_reg.GetIndex()].x;
+        auto& dest = state.registers[instr.dest_register].comp;
 
-            default:
-                return dummy_vec4_float24;
-            }
-        };
+        // Flow control depending on uniforms is the same for all lanes, but conditions
+        // evaluated from the conditional code registers may differ between lanes.
+        bool condition;
 
-        switch (instr.opcode.Value().GetInfo().type) {
-        case OpCode::Type::Arithmetic:
+        switch (instr.op) {
+        case Op::ADD:
         {
-            const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-            const int address_offset = (instr.common.address_register_index == 0)
-                                       ? 0 : state.address_registers[instr.common.address_register_index - 1];
-
-            const float24* src1_ = LookupSourceRegister(instr.common.GetSrc1(is_inverted) + (!is_inverted * address_offset));
-            const float24* src2_ = LookupSourceRegister(instr.common.GetSrc2(is_inverted) + ( is_inverted * address_offset));
-
-            const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-            const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
-
-            float24 src1[4] = {
-                src1_[(int)swizzle.GetSelectorSrc1(0)],
-                src1_[(int)swizzle.GetSelectorSrc1(1)],
-                src1_[(int)swizzle.GetSelectorSrc1(2)],
-                src1_[(int)swizzle.GetSelectorSrc1(3)],
-            };
-            if (negate_src1) {
-                src1[0] = src1[0] * float24::FromFloat32(-1);
-                src1[1] = src1[1] * float24::FromFloat32(-1);
-                src1[2] = src1[2] * float24::FromFloat32(-1);
-                src1[3] = src1[3] * float24::FromFloat32(-1);
+                LaneOps<NumLanes>::Add(src1[i], src2[i], dest[i]);
             }
-            float24 src2[4] = {
-                src2_[(int)swizzle.GetSelectorSrc2(0)],
-                src2_[(int)swizzle.GetSelectorSrc2(1)],
-                src2_[(int)swizzle.GetSelectorSrc2(2)],
-                src2_[(int)swizzle.GetSelectorSrc2(3)],
-            };
-            if (negate_src2) {
-                src2[0] = src2[0] * float24::FromFloat32(-1);
-                src2[1] = src2[1] * float24::FromFloat32(-1);
-                src2[2] = src2[2] * float24::FromFloat32(-1);
-                src2[3] = src2[3] * float24::FromFloat32(-1);
-            }
-
-            float24* dest = (instr.common.dest.Value() < 0x10) ? &state.output_registers[instr.common.dest.Value().GetIndex()][0]
-                        : (instr.common.dest.Value() < 0x20) ? &state.temporary_registers[instr.common.dest.Value().GetIndex()][0]
-                        : dummy_vec4_float24;
 
-            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.common.operand_desc_id);
-
-            switch (instr.opcode.Value().EffectiveOpCode()) {
-            case OpCode::Id::ADD:
-            {
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+            break;
+        }
 
-                    dest[i] = src1[i] + src2[i];
-                }
+        case Op::MUL:
+        {
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                break;
+                LaneOps<NumLanes>::Mul(src1[i], src2[i], dest[i]);
             }
 
-            case OpCode::Id::MUL:
-            {
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+            break;
+        }
 
-                    dest[i] = src1[i] * src2[i];
-                }
+        case Op::FLR:
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                break;
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = float24::FromFloat32(std::floor(src1[i][lane].ToFloat32()));
             }
+            break;
 
-            case OpCode::Id::FLR:
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
-
-                    dest[i] = float24::FromFloat32(std::floor(src1[i].ToFloat32()));
-                }
-                break;
+        case Op::MAX:
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-            case OpCode::Id::MAX:
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+                LaneOps<NumLanes>::Max(src1[i], src2[i], dest[i]);
+            }
+            break;
 
-                    dest[i] = std::max(src1[i], src2[i]);
-                }
-                break;
+        case Op::MIN:
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-            case OpCode::Id::MIN:
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+                LaneOps<NumLanes>::Min(src1[i], src2[i], dest[i]);
+            }
+            break;
 
-                    dest[i] = std::min(src1[i], src2[i]);
-                }
-                break;
+        case Op::DP3:
+        case Op::DP4:
+        {
+            float24 dot[NumLanes];
+            int num_components = (instr.op == Op::DP3) ? 3 : 4;
+            for (int lane = 0; lane < NumLanes; ++lane)
+                dot[lane] = float24::FromFloat32(0.f);
 
-            case OpCode::Id::DP3:
-            case OpCode::Id::DP4:
-            {
-                float24 dot = float24::FromFloat32(0.f);
-                int num_components = (instr.opcode.Value() == OpCode::Id::DP3) ? 3 : 4;
-                for (int i = 0; i < num_components; ++i)
-                    dot = dot + src1[i] * src2[i];
+            for (int i = 0; i < num_components; ++i)
+                LaneOps<NumLanes>::MulAdd(src1[i], src2[i], dot, dot);
 
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                    dest[i] = dot;
-                }
-                break;
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = dot[lane];
             }
+            break;
+        }
 
-            // Reciprocal
-            case OpCode::Id::RCP:
-            {
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+        // Reciprocal
+        case Op::RCP:
+        {
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
+
+                // TODO: Be stable against division by zero!
+                // TODO: I think this might be wrong... we should only use one component here
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = float24::FromFloat32(1.0f / src1[i][lane].ToFloat32());
+            }
 
-                    // TODO: Be stable against division by zero!
-                    // TODO: I think this might be wrong... we should only use one component here
-                    dest[i] = float24::FromFloat32(1.0f / src1[i].ToFloat32());
-                }
+            break;
+        }
 
-                break;
+        // Reciprocal Square Root
+        case Op::RSQ:
+        {
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
+
+                // TODO: Be stable against division by zero!
+                // TODO: I think this might be wrong... we should only use one component here
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = float24::FromFloat32(1.0f / sqrt(src1[i][lane].ToFloat32()));
             }
 
-            // Reciprocal Square Root
-            case OpCode::Id::RSQ:
-            {
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+            break;
+        }
 
-                    // TODO: Be stable against division by zero!
-                    // TODO: I think this might be wrong... we should only use one component here
-                    dest[i] = float24::FromFloat32(1.0f / sqrt(src1[i].ToFloat32()));
-                }
+        case Op::MOVA:
+        {
+            for (int i = 0; i < 2; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                break;
+                // TODO: Figure out how the rounding is done on hardware
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    state.address_registers[i][lane] = static_cast<s32>(src1[i][lane].ToFloat32());
             }
 
-            case OpCode::Id::MOVA:
-            {
-                for (int i = 0; i < 2; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+            break;
+        }
 
-                    // TODO: Figure out how the rounding is done on hardware
-                    state.address_registers[i] = static_cast<s32>(src1[i].ToFloat32());
-                }
+        case Op::MOV:
+        {
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                break;
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = src1[i][lane];
             }
+            break;
+        }
 
-            case OpCode::Id::MOV:
-            {
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+        case Op::SLT:
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                    dest[i] = src1[i];
-                }
-                break;
+                for (int lane = 0; lane < NumLanes; ++lane)
+                    dest[i][lane] = (src1[i][lane] < src2[i][lane]) ? float24::FromFloat32(1.0f) : float24::FromFloat32(0.0f);
             }
+            break;
 
-            case OpCode::Id::SLT:
-            case OpCode::Id::SLTI:
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
-
-                    dest[i] = (src1[i] < src2[i]) ? float24::FromFloat32(1.0f) : float24::FromFloat32(0.0f);
-                }
-                break;
-
-            case OpCode::Id::CMP:
-                for (int i = 0; i < 2; ++i) {
-                    // TODO: Can you restrict to one compare via dest masking?
+        case Op::CMP:
+            for (int i = 0; i < 2; ++i) {
+                // TODO: Can you restrict to one compare via dest masking?
 
-                    auto compare_op = instr.common.compare_op;
-                    auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
+                for (int lane = 0; lane < NumLanes; ++lane) {
+                    bool& result = state.conditional_code[i][lane];
 
-                    switch (op) {
-                        case compare_op.Equal:
-                            state.conditional_code[i] = (src1[i] == src2[i]);
+                    switch (instr.compare_ops[i]) {
+                        case CompareOp::Equal:
+                            result = (src1[i][lane] == src2[i][lane]);
                             break;
 
-                        case compare_op.NotEqual:
-                            state.conditional_code[i] = (src1[i] != src2[i]);
+                        case CompareOp::NotEqual:
+                            result = (src1[i][lane] != src2[i][lane]);
                             break;
 
-                        case compare_op.LessThan:
-                            state.conditional_code[i] = (src1[i] <  src2[i]);
+                        case CompareOp::LessThan:
+                            result = (src1[i][lane] <  src2[i][lane]);
                             break;
 
-                        case compare_op.LessEqual:
-                            state.conditional_code[i] = (src1[i] <= src2[i]);
+                        case CompareOp::LessEqual:
+                            result = (src1[i][lane] <= src2[i][lane]);
                             break;
 
-                        case compare_op.GreaterThan:
-                            state.conditional_code[i] = (src1[i] >  src2[i]);
+                        case CompareOp::GreaterThan:
+                            result = (src1[i][lane] >  src2[i][lane]);
                             break;
 
-                        case compare_op.GreaterEqual:
-                            state.conditional_code[i] = (src1[i] >= src2[i]);
+                        case CompareOp::GreaterEqual:
+                            result = (src1[i][lane] >= src2[i][lane]);
                             break;
 
                         default:
-                            LOG_ERROR(HW_GPU, "Unknown compare mode %x", static_cast<int>(op));
+                        {
+                            const Instruction raw_instr = { instr.hex };
+                            LOG_ERROR(HW_GPU, "Unknown compare mode %x",
+                                      static_cast<int>((i == 0) ? raw_instr.common.compare_op.x.Value() : raw_instr.common.compare_op.y.Value()));
                             break;
+                        }
                     }
                 }
-                break;
-
-            default:
-                LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
-                DEBUG_ASSERT(false);
-                break;
             }
-
             break;
-        }
-
-        case OpCode::Type::MultiplyAdd:
-        {
-            if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) ||
-                (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI)) {
-                const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
-
-                bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
-
-                const float24* src1_ = LookupSourceRegister(instr.mad.GetSrc1(is_inverted));
-                const float24* src2_ = LookupSourceRegister(instr.mad.GetSrc2(is_inverted));
-                const float24* src3_ = LookupSourceRegister(instr.mad.GetSrc3(is_inverted));
-
-                const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-                const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
-                const bool negate_src3 = ((bool)swizzle.negate_src3 != false);
-
-                float24 src1[4] = {
-                    src1_[(int)swizzle.GetSelectorSrc1(0)],
-                    src1_[(int)swizzle.GetSelectorSrc1(1)],
-                    src1_[(int)swizzle.GetSelectorSrc1(2)],
-                    src1_[(int)swizzle.GetSelectorSrc1(3)],
-                };
-                if (negate_src1) {
-                    src1[0] = src1[0] * float24::FromFloat32(-1);
-                    src1[1] = src1[1] * float24::FromFloat32(-1);
-                    src1[2] = src1[2] * float24::FromFloat32(-1);
-                    src1[3] = src1[3] * float24::FromFloat32(-1);
-                }
-                float24 src2[4] = {
-                    src2_[(int)swizzle.GetSelectorSrc2(0)],
-                    src2_[(int)swizzle.GetSelectorSrc2(1)],
-                    src2_[(int)swizzle.GetSelectorSrc2(2)],
-                    src2_[(int)swizzle.GetSelectorSrc2(3)],
-                };
-                if (negate_src2) {
-                    src2[0] = src2[0] * float24::FromFloat32(-1);
-                    src2[1] = src2[1] * float24::FromFloat32(-1);
-                    src2[2] = src2[2] * float24::FromFloat32(-1);
-                    src2[3] = src2[3] * float24::FromFloat32(-1);
-                }
-                float24 src3[4] = {
-                    src3_[(int)swizzle.GetSelectorSrc3(0)],
-                    src3_[(int)swizzle.GetSelectorSrc3(1)],
-                    src3_[(int)swizzle.GetSelectorSrc3(2)],
-                    src3_[(int)swizzle.GetSelectorSrc3(3)],
-                };
-                if (negate_src3) {
-                    src3[0] = src3[0] * float24::FromFloat32(-1);
-                    src3[1] = src3[1] * float24::FromFloat32(-1);
-                    src3[2] = src3[2] * float24::FromFloat32(-1);
-                    src3[3] = src3[3] * float24::FromFloat32(-1);
-                }
-
-                float24* dest = (instr.mad.dest.Value() < 0x10) ? &state.output_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : (instr.mad.dest.Value() < 0x20) ? &state.temporary_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : dummy_vec4_float24;
 
-                for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
-                        continue;
+        case Op::MAD:
+            for (int i = 0; i < 4; ++i) {
+                if (!instr.dest_enabled[i])
+                    continue;
 
-                    dest[i] = src1[i] * src2[i] + src3[i];
-                }
-            } else {
-                LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                LaneOps<NumLanes>::MulAdd(src1[i], src2[i], src3[i], dest[i]);
             }
             break;
-        }
 
-        default:
-        {
-            static auto evaluate_condition = [](const VertexShaderState& state, bool refx, bool refy, Instruction::FlowControlType flow_control) {
-                bool results[2] = { refx == state.conditional_code[0],
-                                    refy == state.conditional_code[1] };
+        case Op::END:
+            exit_loop = true;
+            break;
 
-                switch (flow_control.op) {
-                case flow_control.Or:
-                    return results[0] || results[1];
+        case Op::JMPC:
+            if (!EvaluateCondition(state, instr, condition))
+                return false;
 
-                case flow_control.And:
-                    return results[0] && results[1];
+            if (condition) {
+                state.program_counter = instr.dest_offset - 1;
+            }
+            break;
 
-                case flow_control.JustX:
-                    return results[0];
+        case Op::JMPU:
+            if (uniforms.b[instr.bool_uniform_id]) {
+                state.program_counter = instr.dest_offset - 1;
+            }
+            break;
 
-                case flow_control.JustY:
-                    return results[1];
-                }
-            };
+        case Op::CALL:
+            Call(state,
+                 instr.dest_offset,
+                 instr.num_instructions,
+                 state.program_counter + 1, 0, 0);
+            break;
 
-            // Handle each instruction on its own
-            switch (instr.opcode.Value()) {
-            case OpCode::Id::END:
-                exit_loop = true;
-                break;
+        case Op::CALLU:
+            if (uniforms.b[instr.bool_uniform_id]) {
+                Call(state,
+                    instr.dest_offset,
+                    instr.num_instructions,
+                    state.program_counter + 1, 0, 0);
+            }
+            break;
 
-            case OpCode::Id::JMPC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    state.program_counter = instr.flow_control.dest_offset - 1;
-                }
-                break;
+        case Op::CALLC:
+            if (!EvaluateCondition(state, instr, condition))
+                return false;
 
-            case OpCode::Id::JMPU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    state.program_counter = instr.flow_control.dest_offset - 1;
-                }
-                break;
+            if (condition) {
+                Call(state,
+                    instr.dest_offset,
+                    instr.num_instructions,
+                    state.program_counter + 1, 0, 0);
+            }
+            break;
 
-            case OpCode::Id::CALL:
-                call(state,
-                     instr.flow_control.dest_offset,
-                     instr.flow_control.num_instructions,
-                     state.program_counter + 1, 0, 0);
-                break;
+        case Op::NOP:
+            break;
 
-            case OpCode::Id::CALLU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        state.program_counter + 1, 0, 0);
-                }
-                break;
+        case Op::IFU:
+            if (uniforms.b[instr.bool_uniform_id]) {
+                Call(state,
+                     state.program_counter + 1,
+                     instr.dest_offset - state.program_counter - 1,
+                     instr.dest_offset + instr.num_instructions, 0, 0);
+            } else {
+                Call(state,
+                     instr.dest_offset,
+                     instr.num_instructions,
+                     instr.dest_offset + instr.num_instructions, 0, 0);
+            }
 
-            case OpCode::Id::CALLC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        state.program_counter + 1, 0, 0);
-                }
-                break;
+            break;
 
-            case OpCode::Id::NOP:
-                break;
+        case Op::IFC:
+        {
+            // TODO: Do we need to consider swizzlers here?
 
-            case OpCode::Id::IFU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                         state.program_counter + 1,
-                         instr.flow_control.dest_offset - state.program_counter - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
-                } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
-                }
+            if (!EvaluateCondition(state, instr, condition))
+                return false;
 
-                break;
+            if (condition) {
+                Call(state,
+                     state.program_counter + 1,
+                     instr.dest_offset - state.program_counter - 1,
+                     instr.dest_offset + instr.num_instructions, 0, 0);
+            } else {
+                Call(state,
+                     instr.dest_offset,
+                     instr.num_instructions,
+                     instr.dest_offset + instr.num_instructions, 0, 0);
+            }
 
-            case OpCode::Id::IFC:
-            {
-                // TODO: Do we need to consider swizzlers here?
+            break;
+        }
 
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                         state.program_counter + 1,
-                         instr.flow_control.dest_offset - state.program_counter - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
-                } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
-                }
+        case Op::LOOP:
+        {
+            state.loop_counter = uniforms.i[instr.int_uniform_id].y;
+
+            // The loop body ends with the instruction at dest_offset
+            Call(state,
+                 state.program_counter + 1,
+                 instr.dest_offset - state.program_counter,
+                 instr.dest_offset + 1,
+                 uniforms.i[instr.int_uniform_id].x,
+                 uniforms.i[instr.int_uniform_id].z);
+            break;
+        }
 
+        case Op::SETEMIT:
+            if (state.emitters == nullptr) {
+                LOG_ERROR(HW_GPU, "SETEMIT used outside of a geometry shader");
                 break;
             }
 
-            case OpCode::Id::LOOP:
-            {
-                state.address_registers[2] = uniforms.i[instr.flow_control.int_uniform_id].y;
-
-                call(state,
-                     state.program_counter + 1,
-                     instr.flow_control.dest_offset - state.program_counter + 1,
-                     instr.flow_control.dest_offset + 1,
-                     uniforms.i[instr.flow_control.int_uniform_id].x,
-                     uniforms.i[instr.flow_control.int_uniform_id].z);
-                break;
+            for (int lane = 0; lane < NumLanes; ++lane) {
+                GeometryEmitter& emitter = state.emitters[lane];
+                emitter.vertex_id = instr.emit_vertex_id;
+                emitter.prim_emit = instr.emit_primitive;
+                emitter.winding = instr.emit_winding;
             }
+            break;
 
-            default:
-                LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+        case Op::EMIT:
+            if (state.emitters == nullptr) {
+                LOG_ERROR(HW_GPU, "EMIT used outside of a geometry shader");
                 break;
             }
 
+            for (int lane = 0; lane < NumLanes; ++lane)
+                EmitVertex(state, lane);
+            break;
+
+        case Op::UnhandledArithmetic:
+        {
+            const Instruction raw_instr = { instr.hex };
+            LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
+                      (int)raw_instr.opcode.Value().EffectiveOpCode(), raw_instr.opcode.Value().GetInfo().name, raw_instr.hex);
+            DEBUG_ASSERT(false);
+            break;
+        }
+
+        case Op::UnhandledMultiplyAdd:
+        {
+            const Instruction raw_instr = { instr.hex };
+            LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
+                      (int)raw_instr.opcode.Value().EffectiveOpCode(), raw_instr.opcode.Value().GetInfo().name, raw_instr.hex);
+            break;
+        }
+
+        case Op::Unhandled:
+        default:
+        {
+            const Instruction raw_instr = { instr.hex };
+            LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
+                      (int)raw_instr.opcode.Value().EffectiveOpCode(), raw_instr.opcode.Value().GetInfo().name, raw_instr.hex);
             break;
         }
         }
@@ -540,89 +1066,169 @@ static void ProcessShaderCode(VertexShaderState& state) {
         if (exit_loop)
             break;
     }
+
+    return true;
 }
 
 static Common::Profiling::TimingCategory shader_category("Vertex Shader");
+static Common::Profiling::TimingCategory geometry_shader_category("Geometry Shader");
 
-OutputVertex RunShader(const InputVertex& input, int num_attributes, const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
-    Common::Profiling::ScopeTimer timer(shader_category);
-
-    VertexShaderState state;
-
+/// Sets up the state of NumLanes invocations of a shader unit, reading the given input vertices
+template <int NumLanes>
+static void InitializeState(VertexShaderState<NumLanes>& state, const InputVertex* const inputs[NumLanes],
+                            int num_attributes, const Regs::ShaderConfig& config,
+                            const State::ShaderSetup& setup, GeometryEmitter* emitters) {
     state.program_counter = config.main_offset;
     state.debug.max_offset = 0;
     state.debug.max_opdesc_id = 0;
+    state.setup = &setup;
+    state.emitters = emitters;
 
-    // Setup input register table
+    // Setup input registers. Registers which aren't mapped to an attribute read as zero.
+    memset(&state.registers[REGISTER_INPUT], 0, 16 * sizeof(state.registers[0]));
+    memset(&state.registers[REGISTER_ZERO], 0, sizeof(state.registers[0]));
     const auto& attribute_register_map = config.input_register_map;
-    float24 dummy_register;
-    boost::fill(state.input_register_table, &dummy_register);
-
-    if (num_attributes > 0) state.input_register_table[attribute_register_map.attribute0_register] = &input.attr[0].x;
-    if (num_attributes > 1) state.input_register_table[attribute_register_map.attribute1_register] = &input.attr[1].x;
-    if (num_attributes > 2) state.input_register_table[attribute_register_map.attribute2_register] = &input.attr[2].x;
-    if (num_attributes > 3) state.input_register_table[attribute_register_map.attribute3_register] = &input.attr[3].x;
-    if (num_attributes > 4) state.input_register_table[attribute_register_map.attribute4_register] = &input.attr[4].x;
-    if (num_attributes > 5) state.input_register_table[attribute_register_map.attribute5_register] = &input.attr[5].x;
-    if (num_attributes > 6) state.input_register_table[attribute_register_map.attribute6_register] = &input.attr[6].x;
-    if (num_attributes > 7) state.input_register_table[attribute_register_map.attribute7_register] = &input.attr[7].x;
-    if (num_attributes > 8) state.input_register_table[attribute_register_map.attribute8_register] = &input.attr[8].x;
-    if (num_attributes > 9) state.input_register_table[attribute_register_map.attribute9_register] = &input.attr[9].x;
-    if (num_attributes > 10) state.input_register_table[attribute_register_map.attribute10_register] = &input.attr[10].x;
-    if (num_attributes > 11) state.input_register_table[attribute_register_map.attribute11_register] = &input.attr[11].x;
-    if (num_attributes > 12) state.input_register_table[attribute_register_map.attribute12_register] = &input.attr[12].x;
-    if (num_attributes > 13) state.input_register_table[attribute_register_map.attribute13_register] = &input.attr[13].x;
-    if (num_attributes > 14) state.input_register_table[attribute_register_map.attribute14_register] = &input.attr[14].x;
-    if (num_attributes > 15) state.input_register_table[attribute_register_map.attribute15_register] = &input.attr[15].x;
-
-    state.conditional_code[0] = false;
-    state.conditional_code[1] = false;
-
-    ProcessShaderCode(state);
+    for (int attribute = 0; attribute < std::min(num_attributes, 16); ++attribute) {
+        auto& reg = state.registers[REGISTER_INPUT + attribute_register_map.GetRegisterForAttribute(attribute)];
+        for (int i = 0; i < 4; ++i)
+            for (int lane = 0; lane < NumLanes; ++lane)
+                reg.comp[i][lane] = inputs[lane]->attr[attribute][i];
+    }
+
+    for (int lane = 0; lane < NumLanes; ++lane) {
+        state.conditional_code[0][lane] = false;
+        state.conditional_code[1][lane] = false;
+    }
+}
+
+/**
+ * Runs the vertex shader on NumLanes vertices in lockstep.
+ * @return False if the vertices diverged, in which case the outputs are not written
+ */
+template <int NumLanes, typename Output>
+static bool RunShaderLanes(const DecodedProgram& program, const InputVertex* const inputs[NumLanes],
+                           Output* const outputs[NumLanes], int num_attributes,
+                           const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
+    VertexShaderState<NumLanes> state;
+    InitializeState(state, inputs, num_attributes, config, setup, nullptr);
+
+    if (!ProcessShaderCode(state, program))
+        return false;
+
 #if PICA_DUMP_SHADERS
     DebugUtils::DumpShader(setup.program_code.data(), state.debug.max_offset, setup.swizzle_data.data(),
                            state.debug.max_opdesc_id, config.main_offset,
                            g_state.regs.vs_output_attributes); // TODO: Don't hardcode VS here
 #endif
 
-    // Setup output data
+    for (int lane = 0; lane < NumLanes; ++lane)
+        WriteOutputs(state, lane, *outputs[lane]);
+
+    return true;
+}
+
+OutputVertex RunShader(const InputVertex& input, int num_attributes, const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
+    Common::Profiling::ScopeTimer timer(shader_category);
+
+    const InputVertex* inputs[1] = { &input };
     OutputVertex ret;
-    // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
-    // figure out what those circumstances are and enable the remaining outputs then.
-    for (int i = 0; i < 7; ++i) {
-        const auto& output_register_map = g_state.regs.vs_output_attributes[i]; // TODO: Don't hardcode VS here
+    OutputVertex* outputs[1] = { &ret };
+    RunShaderLanes<1>(GetDecodedProgram(), inputs, outputs, num_attributes, config, setup);
+    return ret;
+}
 
-        u32 semantics[4] = {
-            output_register_map.map_x, output_register_map.map_y,
-            output_register_map.map_z, output_register_map.map_w
-        };
+template <typename Output>
+static void RunShaderBatchImpl(const InputVertex* inputs, Output* outputs, int count, int num_attributes,
+                               const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
+    Common::Profiling::ScopeTimer timer(shader_category);
 
-        for (int comp = 0; comp < 4; ++comp) {
-            float24* out = ((float24*)&ret) + semantics[comp];
-            if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
-                *out = state.output_registers[i][comp];
-            } else {
-                // Zero output so that attributes which aren't output won't have denormals in them,
-                // which would slow us down later.
-                memset(out, 0, sizeof(*out));
-            }
-        }
+    ASSERT(count > 0 && count <= BATCH_SIZE);
+
+    // Unused lanes duplicate the first vertex, so they never cause divergence
+    const InputVertex* lane_inputs[BATCH_SIZE];
+    Output dummy_outputs[BATCH_SIZE];
+    Output* lane_outputs[BATCH_SIZE];
+    for (int lane = 0; lane < BATCH_SIZE; ++lane) {
+        lane_inputs[lane] = &inputs[lane < count ? lane : 0];
+        lane_outputs[lane] = (lane < count) ? &outputs[lane] : &dummy_outputs[lane];
     }
 
-    // The hardware takes the absolute and saturates vertex colors like this, *before* doing interpolation
-    for (int i = 0; i < 4; ++i) {
-        ret.color[i] = float24::FromFloat32(
-            std::fmin(std::fabs(ret.color[i].ToFloat32()), 1.0f));
+    const DecodedProgram& program = GetDecodedProgram();
+    if (RunShaderLanes<BATCH_SIZE>(program, lane_inputs, lane_outputs, num_attributes, config, setup))
+        return;
+
+    // The vertices took different branches, so fall back to shading them one by one
+    for (int i = 0; i < count; ++i)
+        RunShaderLanes<1>(program, &lane_inputs[i], &lane_outputs[i], num_attributes, config, setup);
+}
+
+void RunShaderBatch(const InputVertex* inputs, OutputVertex* outputs, int count, int num_attributes,
+                    const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
+    RunShaderBatchImpl(inputs, outputs, count, num_attributes, config, setup);
+}
+
+void RunShaderBatch(const InputVertex* inputs, OutputRegisters* outputs, int count, int num_attributes,
+                    const Regs::ShaderConfig& config, const State::ShaderSetup& setup) {
+    RunShaderBatchImpl(inputs, outputs, count, num_attributes, config, setup);
+}
+
+/// Triangles emitted by each lane of the geometry shader batch being run
+static std::array<std::array<EmittedTriangle, MAX_EMITTED_TRIANGLES>, BATCH_SIZE> emitted_triangles;
+
+/**
+ * Runs NumLanes geometry shader invocations in lockstep.
+ * @return False if the invocations diverged, in which case the emitted triangles are incomplete
+ */
+template <int NumLanes>
+static bool RunGeometryShaderLanes(const DecodedProgram& program, const InputVertex* const inputs[NumLanes],
+                                   GeometryEmitter* emitters, int num_attributes) {
+    for (int lane = 0; lane < NumLanes; ++lane) {
+        emitters[lane].vertex_id = 0;
+        emitters[lane].prim_emit = false;
+        emitters[lane].winding = false;
+        emitters[lane].num_triangles = 0;
     }
 
-    LOG_TRACE(Render_Software, "Output vertex: pos (%.2f, %.2f, %.2f, %.2f), col(%.2f, %.2f, %.2f, %.2f), tc0(%.2f, %.2f)",
-        ret.pos.x.ToFloat32(), ret.pos.y.ToFloat32(), ret.pos.z.ToFloat32(), ret.pos.w.ToFloat32(),
-        ret.color.x.ToFloat32(), ret.color.y.ToFloat32(), ret.color.z.ToFloat32(), ret.color.w.ToFloat32(),
-        ret.tc0.u().ToFloat32(), ret.tc0.v().ToFloat32());
+    VertexShaderState<NumLanes> state;
+    InitializeState(state, inputs, num_attributes, g_state.regs.gs, g_state.gs, emitters);
+    return ProcessShaderCode(state, program);
+}
 
-    return ret;
+static void FlushEmittedTriangles(GeometryEmitter& emitter, const TriangleHandler& triangle_handler) {
+    for (unsigned i = 0; i < emitter.num_triangles; ++i) {
+        EmittedTriangle& triangle = emitter.triangles[i];
+        triangle_handler(triangle.vertices[0], triangle.vertices[1], triangle.vertices[2]);
+    }
 }
 
+void RunGeometryShaderBatch(const InputVertex* inputs, int count, int num_attributes,
+                            const TriangleHandler& triangle_handler) {
+    Common::Profiling::ScopeTimer timer(geometry_shader_category);
+
+    ASSERT(count > 0 && count <= BATCH_SIZE);
+
+    // Unused lanes duplicate the first invocation like in RunShaderBatch, but their triangles are dropped
+    const InputVertex* lane_inputs[BATCH_SIZE];
+    GeometryEmitter emitters[BATCH_SIZE];
+    for (int lane = 0; lane < BATCH_SIZE; ++lane) {
+        lane_inputs[lane] = &inputs[lane < count ? lane : 0];
+        emitters[lane].triangles = emitted_triangles[lane].data();
+    }
+
+    // Triangles are only passed on once the whole batch has finished, so that a diverged batch can
+    // be run again lane by lane without emitting anything twice
+    const DecodedProgram& program = GetDecodedGeometryProgram();
+    if (RunGeometryShaderLanes<BATCH_SIZE>(program, lane_inputs, emitters, num_attributes)) {
+        for (int i = 0; i < count; ++i)
+            FlushEmittedTriangles(emitters[i], triangle_handler);
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        RunGeometryShaderLanes<1>(program, &lane_inputs[i], &emitters[i], num_attributes);
+        FlushEmittedTriangles(emitters[i], triangle_handler);
+    }
+}
 
 } // namespace
 
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <functional>
 #include <type_traits>
 
 #include "common/vector_math.h"
@@ -67,6 +68,65 @@ static_assert(sizeof(OutputVertex) == 32 * sizeof(float), "OutputVertex has inva
 
 OutputVertex RunShader(const InputVertex& input, int num_attributes, const Regs::ShaderConfig& config, const State::ShaderSetup& setup);
 
+/// Maximum number of vertices processed by a single call to RunShaderBatch
+static const int BATCH_SIZE = 4;
+
+/**
+ * Runs the vertex shader on up to BATCH_SIZE vertices at once. Instruction decoding is shared
+ * between all vertices of the batch, which is considerably faster than calling RunShader for
+ * each vertex separately.
+ * @param inputs Array of count input vertices
+ * @param outputs Array of count output vertices to write the results to
+ * @param count Number of vertices in the batch, must be in the range [1, BATCH_SIZE]
+ */
+void RunShaderBatch(const InputVertex* inputs, OutputVertex* outputs, int count, int num_attributes,
+                    const Regs::ShaderConfig& config, const State::ShaderSetup& setup);
+
+/// Raw contents of the output registers of a shader invocation
+struct OutputRegisters {
+    Math::Vec4<float24> value[16];
+};
+
+/**
+ * Runs the vertex shader like the other overload, but stores the raw output registers, which
+ * the geometry shader reads from, instead of mapping them to output vertices.
+ */
+void RunShaderBatch(const InputVertex* inputs, OutputRegisters* outputs, int count, int num_attributes,
+                    const Regs::ShaderConfig& config, const State::ShaderSetup& setup);
+
+/// Called with each triangle emitted by the geometry shader
+using TriangleHandler = std::function<void(OutputVertex& v0, OutputVertex& v1, OutputVertex& v2)>;
+
+/// Maximum number of triangles a single geometry shader invocation may emit
+static const unsigned MAX_EMITTED_TRIANGLES = 64;
+
+/**
+ * Runs the geometry shader on up to BATCH_SIZE invocations at once, on the same engine and cache
+ * of decoded programs as the vertex shader. Emitted triangles are collected in preallocated buffers
+ * and passed to the handler once the batch has finished, in the order of the invocations.
+ * Unlike RunShaderBatch, this must not be called from several threads at once.
+ * @param inputs Array of count inputs, holding the input attributes of one invocation each
+ * @param count Number of invocations in the batch, must be in the range [1, BATCH_SIZE]
+ */
+void RunGeometryShaderBatch(const InputVertex* inputs, int count, int num_attributes,
+                            const TriangleHandler& triangle_handler);
+
+/**
+ * Decodes the current program ahead of time, after which RunShaderBatch may be called from
+ * several threads at once until the program or swizzle data is modified.
+ */
+void PrepareDecodedProgram();
+
+/**
+ * Notifies the shader interpreter that the program code or swizzle data of either shader unit has
+ * been modified. The programs are decoded again (or fetched from the cache of decoded programs)
+ * on the next run.
+ */
+void InvalidateDecodedProgram();
+
+/// Releases all cached decoded programs
+void Shutdown();
+
 } // namespace
 
 } // namespace
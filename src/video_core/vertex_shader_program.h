@@ -0,0 +1,117 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/common_types.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Layout of the vertex shader register file
+enum : u8 {
+    REGISTER_INPUT     = 0,  ///< 16 input registers
+    REGISTER_TEMPORARY = 16, ///< 16 temporary registers
+    REGISTER_OUTPUT    = 32, ///< 16 output registers
+    REGISTER_ZERO      = 48, ///< Always reads as zero, used for invalid source registers
+    REGISTER_DISCARD   = 49, ///< Write target for invalid destination registers
+    NUM_REGISTERS      = 50,
+};
+
+/// Source operand with register lookup and swizzling resolved ahead of time
+struct DecodedSource {
+    /// Uniform read by this operand, or nullptr if it reads from the register file
+    const float24* uniform;
+    /// Register file index, if this operand doesn't read a uniform
+    u8 register_index;
+    /// Address register used for relative addressing (1-based), or 0 if none is used
+    u8 address_register_index;
+    /// Source component for each of the four operand components
+    u8 selectors[4];
+    bool negate;
+    /// Undecoded register, needed to apply relative addressing at runtime
+    nihstro::SourceRegister source_register;
+};
+
+/// Shader instruction with all fields and operands decoded ahead of time
+struct DecodedInstruction {
+    enum class Op : u8 {
+        // Arithmetic
+        ADD, MUL, FLR, MAX, MIN, DP3, DP4, RCP, RSQ, MOVA, MOV, SLT, CMP, MAD,
+
+        // Flow control
+        END, NOP, JMPC, JMPU, CALL, CALLU, CALLC, IFU, IFC, LOOP,
+
+        // Geometry shader vertex emission
+        SETEMIT, EMIT,
+
+        UnhandledArithmetic,
+        UnhandledMultiplyAdd,
+        Unhandled,
+    };
+
+    enum class CompareOp : u8 {
+        Equal, NotEqual, LessThan, LessEqual, GreaterThan, GreaterEqual, Unknown
+    };
+
+    enum class ConditionOp : u8 {
+        Or, And, JustX, JustY
+    };
+
+    Op op;
+    u8 num_sources;
+    DecodedSource src[3];
+
+    u8 dest_register;
+    bool dest_enabled[4];
+
+    CompareOp compare_ops[2];
+
+    ConditionOp condition_op;
+    bool refx;
+    bool refy;
+    u8 bool_uniform_id;
+    u8 int_uniform_id;
+    u32 dest_offset;
+    u32 num_instructions;
+
+    u32 operand_desc_id;
+
+    /// SETEMIT fields: output vertex buffer entry, whether EMIT completes a triangle with it, and
+    /// whether that triangle's winding is reversed
+    u8 emit_vertex_id;
+    bool emit_primitive;
+    bool emit_winding;
+
+    /// Raw instruction word, used for logging unhandled instructions
+    u32 hex;
+};
+
+/// A full shader program, decoded from the shader program and swizzle memory
+struct DecodedProgram {
+    std::array<DecodedInstruction, 1024> code;
+
+    /// Hash of the program code and swizzle data the program was decoded from
+    u64 hash;
+};
+
+/**
+ * Returns the decoded version of the currently loaded program, decoding it first if it isn't
+ * cached. Besides the interpreter, this is used to translate the program into host shaders.
+ */
+const DecodedProgram& GetDecodedProgram();
+
+/// Returns the decoded version of the currently loaded geometry shader program
+const DecodedProgram& GetDecodedGeometryProgram();
+
+} // namespace
+
+} // namespace
@@ -8,8 +8,10 @@
 #include "core/core.h"
 #include "core/settings.h"
 
+#include "gpu_thread.h"
 #include "video_core.h"
 #include "renderer_base.h"
+#include "renderer_null/renderer_null.h"
 #include "renderer_opengl/renderer_opengl.h"
 
 #include "pica.h"
@@ -22,6 +24,8 @@ namespace VideoCore {
 EmuWindow*      g_emu_window    = nullptr;     ///< Frontend emulator window
 RendererBase*   g_renderer      = nullptr;     ///< Renderer plugin
 
+RendererType    g_renderer_type = RendererType::OpenGL;
+
 std::atomic<bool> g_hw_renderer_enabled;
 
 /// Initialize the video core
@@ -29,15 +33,25 @@ void Init(EmuWindow* emu_window) {
     Pica::Init();
 
     g_emu_window = emu_window;
-    g_renderer = new RendererOpenGL();
+    switch (g_renderer_type) {
+    case RendererType::OpenGL:
+        g_renderer = new RendererOpenGL();
+        break;
+    case RendererType::Null:
+        g_renderer = new RendererNull();
+        break;
+    }
     g_renderer->SetWindow(g_emu_window);
     g_renderer->Init();
 
+    GPUThread::Init();
+
     LOG_DEBUG(Render, "initialized OK");
 }
 
 /// Shutdown the video core
 void Shutdown() {
+    GPUThread::Shutdown();
     Pica::Shutdown();
 
     delete g_renderer;
@@ -32,6 +32,15 @@ static const int kScreenBottomHeight    = 240;  ///< 3DS bottom screen height
 extern RendererBase*   g_renderer;              ///< Renderer plugin
 extern EmuWindow*      g_emu_window;            ///< Emu window
 
+/// Renderers which can be created by Init()
+enum class RendererType {
+    OpenGL,
+    Null, ///< Displays nothing, for headless runs. Requires the hardware renderer to be disabled.
+};
+
+/// Type of the renderer created by the next call to Init()
+extern RendererType g_renderer_type;
+
 // TODO: Wrap this in a user settings struct along with any other graphics settings (often set from qt ui)
 extern std::atomic<bool> g_hw_renderer_enabled;
 